@@ -0,0 +1,120 @@
+// FNV-1a
+static u64
+asset_pack_hash_path(char *path, u32 length)
+{
+  u64 result = 0xcbf29ce484222325ull;
+  for (u32 char_idx = 0; char_idx < length; ++char_idx)
+  {
+    result ^= (u8)path[char_idx];
+    result *= 0x100000001b3ull;
+  }
+
+  return(result);
+}
+
+static b32
+asset_pack_open(Asset_Pack *pack, char *filename)
+{
+  *pack     = (Asset_Pack){ 0 };
+  pack->map = os_file_map(filename);
+
+  // sizes are checked by subtraction so that no offset in a corrupt pack can
+  // wrap a sum around and pass
+  u64 size = pack->map.size;
+  Asset_Pack_Header *header = (Asset_Pack_Header *)pack->map.data;
+  b32 result = (size >= sizeof(Asset_Pack_Header)) &&
+               (header->magic == AssetPack_Magic) && (header->version == AssetPack_Version) &&
+               (header->slot_count > header->entry_count) && !(header->slot_count & (header->slot_count - 1)) &&
+               ((u64)header->slot_count * sizeof(Asset_Pack_Slot) <= size - sizeof(Asset_Pack_Header)) &&
+               (header->entries_offset <= size) &&
+               ((u64)header->entry_count * sizeof(Asset_Pack_Entry) <= size - header->entries_offset) &&
+               (header->paths_offset <= size);
+  if (result)
+  {
+    pack->header  = header;
+    pack->slots   = (Asset_Pack_Slot *)(header + 1);
+    pack->entries = (Asset_Pack_Entry *)(pack->map.data + header->entries_offset);
+    pack->paths   = (char *)(pack->map.data + header->paths_offset);
+  }
+
+  // every slot names an entry, and every entry's path and payload lie inside
+  // the mapping, so asset_pack_find can trust them
+  for (u32 slot_idx = 0; result && (slot_idx < header->slot_count); ++slot_idx)
+  {
+    result = (pack->slots[slot_idx].entry_idx_plus_one <= header->entry_count);
+  }
+
+  for (u32 entry_idx = 0; result && (entry_idx < header->entry_count); ++entry_idx)
+  {
+    Asset_Pack_Entry *entry = pack->entries + entry_idx;
+    result = (entry->path_offset <= size - header->paths_offset) &&
+             (entry->path_length <= size - header->paths_offset - entry->path_offset) &&
+             (entry->offset <= size) && (entry->size <= size - entry->offset);
+  }
+
+  if (!result)
+  {
+    os_file_unmap(&pack->map);
+    *pack = (Asset_Pack){ 0 };
+  }
+
+  return(result);
+}
+
+static void
+asset_pack_close(Asset_Pack *pack)
+{
+  os_file_unmap(&pack->map);
+  *pack = (Asset_Pack){ 0 };
+}
+
+// Returns a blob with data == 0 when the pack has no such path.
+static Asset_Blob
+asset_pack_find(Asset_Pack *pack, char *path)
+{
+  Asset_Blob result = { 0 };
+  if (!pack->header)
+  {
+    return(result);
+  }
+
+  u32 length = 0;
+  while (path[length])
+  {
+    ++length;
+  }
+
+  u64 hash = asset_pack_hash_path(path, length);
+  u32 mask = pack->header->slot_count - 1;
+  // slot_count > entry_count leaves an empty slot to stop at, but a bad pack
+  // may not, so the probe gives up after every slot
+  u32 slot_idx = (u32)hash & mask;
+  for (u32 probe = 0; probe < pack->header->slot_count; ++probe, slot_idx = (slot_idx + 1) & mask)
+  {
+    Asset_Pack_Slot *slot = pack->slots + slot_idx;
+    if (!slot->entry_idx_plus_one)
+    {
+      break;
+    }
+
+    if (slot->path_hash == hash)
+    {
+      // confirm against the stored path so a hash collision cannot alias two files
+      Asset_Pack_Entry *entry = pack->entries + slot->entry_idx_plus_one - 1;
+      b32 match = (entry->path_length == length);
+      for (u32 char_idx = 0; match && (char_idx < length); ++char_idx)
+      {
+        match = (pack->paths[entry->path_offset + char_idx] == path[char_idx]);
+      }
+
+      if (match)
+      {
+        result.data = pack->map.data + entry->offset;
+        result.size = entry->size;
+        break;
+      }
+    }
+  }
+
+  return(result);
+}
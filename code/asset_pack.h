@@ -0,0 +1,70 @@
+#if !defined(ASSET_PACK_H)
+#define ASSET_PACK_H
+
+// A single archive replacing the loose files under data/. The whole file is
+// mapped read-only and lookups hand out pointers straight into the mapping,
+// so nothing is copied between the page cache and the decoders.
+//
+// Layout of a pack:
+//   Asset_Pack_Header
+//   Asset_Pack_Slot[slot_count]     open addressed, slot_count a power of two
+//   Asset_Pack_Entry[entry_count]
+//   path strings (not terminated)
+//   payloads, each AssetPack_PayloadAlign aligned
+//
+// Paths are relative to data/ with forward slashes, e.g.
+// "textures/gray-brick/displacement.png".
+
+#define AssetPack_Magic         0x4B415041 // "APAK"
+#define AssetPack_Version       1
+#define AssetPack_PayloadAlign  4096
+// built next to the executables by build.bat and build.sh (tools/pack_data.c)
+#define AssetPack_DefaultPath   "data.pak"
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 entry_count;
+  u32 slot_count;
+  u64 entries_offset;
+  u64 paths_offset;
+} Asset_Pack_Header;
+
+typedef struct
+{
+  u64 path_hash;
+  u32 entry_idx_plus_one;
+  u32 _pad_a;
+} Asset_Pack_Slot;
+
+typedef struct
+{
+  u64 path_hash;
+  u64 offset;
+  u64 size;
+  u32 path_offset;
+  u32 path_length;
+} Asset_Pack_Entry;
+
+typedef struct
+{
+  u8  *data;
+  u64  size;
+} Asset_Blob;
+
+typedef struct
+{
+  OS_File_Map        map;
+  Asset_Pack_Header *header;
+  Asset_Pack_Slot   *slots;
+  Asset_Pack_Entry  *entries;
+  char              *paths;
+} Asset_Pack;
+
+static u64        asset_pack_hash_path(char *path, u32 length);
+static b32        asset_pack_open(Asset_Pack *pack, char *filename);
+static void       asset_pack_close(Asset_Pack *pack);
+static Asset_Blob asset_pack_find(Asset_Pack *pack, char *path);
+
+#endif
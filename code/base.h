@@ -15,7 +15,11 @@ typedef float    f32;
 typedef double   f64;
 typedef s32      b32;
 
-#define AssertBreak() __debugbreak()
+#if defined(_MSC_VER)
+# define AssertBreak() __debugbreak()
+#else
+# define AssertBreak() __builtin_trap()
+#endif
 #define Assert(cond) do{if(!(cond)){AssertBreak();}}while(0)
 #define AssertTrue(x) Assert((!!(x))==true)
 #define AssertFalse(x) Assert((!!(x))==false)
@@ -25,7 +29,28 @@ typedef s32      b32;
 #define true 1
 #define false 0
 
-#define Minimum(a,b) ((a)<(b))?(a):(b)
+#if defined(_MSC_VER)
+# include <intrin.h>
+# define AtomicCompareExchangeU32(dest, exchange, comparand) (u32)_InterlockedCompareExchange((volatile long *)(dest), (long)(exchange), (long)(comparand))
+# define AtomicIncrementU32(dest) (u32)_InterlockedIncrement((volatile long *)(dest))
+# define AtomicAddU64(dest, value) (u64)_InterlockedExchangeAdd64((volatile __int64 *)(dest), (__int64)(value))
+# define CompletePreviousWritesBeforeFutureWrites() _WriteBarrier()
+# define CompletePreviousReadsBeforeFutureReads() _ReadBarrier()
+# define ThreadLocal __declspec(thread)
+# define ReadCPUTimer() __rdtsc()
+#else
+# include <x86intrin.h>
+# define AtomicCompareExchangeU32(dest, exchange, comparand) __sync_val_compare_and_swap((dest), (comparand), (exchange))
+# define AtomicIncrementU32(dest) __sync_add_and_fetch((dest), 1)
+# define AtomicAddU64(dest, value) __sync_fetch_and_add((dest), (value))
+# define CompletePreviousWritesBeforeFutureWrites() __asm__ __volatile__("" ::: "memory")
+# define CompletePreviousReadsBeforeFutureReads() __asm__ __volatile__("" ::: "memory")
+# define ThreadLocal __thread
+# define ReadCPUTimer() __rdtsc()
+#endif
+
+#define Minimum(a,b) (((a)<(b))?(a):(b))
+#define Maximum(a,b) (((a)>(b))?(a):(b))
 #define AlignAToB(a,b) (((a)+((b)-1))&(~((b)-1)))
 #define KB(v) (1024llu*((u64)v))
 #define MB(v) (1024llu*KB(v))
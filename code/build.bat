@@ -4,6 +4,106 @@ setlocal enabledelayedexpansion
 if not exist ..\build mkdir ..\build
 pushd ..\build
 cl /Zi /Od /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\main.c /link /incremental:no /out:engine.exe user32.lib gdi32.lib d3d11.lib dxguid.lib winmm.lib d3dcompiler.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\main_soft.c /link /incremental:no /out:engine_soft.exe user32.lib gdi32.lib winmm.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\residency_sim.c /link /incremental:no /out:residency_sim.exe
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\vtex_bake.c /link /incremental:no /out:vtex_bake.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\normal_bake.c /link /incremental:no /out:normal_bake.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\cone_bake.c /link /incremental:no /out:cone_bake.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\shadow_check.c /link /incremental:no /out:shadow_check.exe
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\shadow_filter_check.c /link /incremental:no /out:shadow_filter_check.exe
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\light_cluster_bench.c /link /incremental:no /out:light_cluster_bench.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\shader_cache_check.c /link /incremental:no /out:shader_cache_check.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\reflection_probe_check.c /link /incremental:no /out:reflection_probe_check.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\reflection_bake.c /link /incremental:no /out:reflection_bake.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\bvh_bench.c /link /incremental:no /out:bvh_bench.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\lightmap_check.c /link /incremental:no /out:lightmap_check.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\lightmap_bake.c /link /incremental:no /out:lightmap_bake.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\vertex_ao_check.c /link /incremental:no /out:vertex_ao_check.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\vertex_ao_bake.c /link /incremental:no /out:vertex_ao_bake.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\irradiance_check.c /link /incremental:no /out:irradiance_check.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\irradiance_bake.c /link /incremental:no /out:irradiance_bake.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\pvs_check.c /link /incremental:no /out:pvs_check.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\pvs_bake.c /link /incremental:no /out:pvs_bake.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\pvs_sim.c /link /incremental:no /out:pvs_sim.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\occlusion_bench.c /link /incremental:no /out:occlusion_bench.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\soft_frame.c /link /incremental:no /out:soft_frame.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\input_record_check.c /link /incremental:no /out:input_record_check.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\profile_check.c /link /incremental:no /out:profile_check.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\pack_data.c /link /incremental:no /out:pack_data.exe user32.lib
+cl /Zi /O2 /W4 /DENGINE_DEBUG /nologo /wd4201 ..\code\tools\shader_report.c /link /incremental:no /out:shader_report.exe dxguid.lib d3dcompiler.lib
+
+rem cascade fitting, shadow filtering, light binning, the shader cache, the
+rem probe baker, the BVH, the lightmap baker, the occlusion baker, the
+rem irradiance volume, the visible sets, occlusion culling, input replay and
+rem the profiler must hold before anything ships; the full 10M triangle
+rem stress run is bvh_bench.exe with no arguments
+shadow_check.exe || exit /b 1
+shadow_filter_check.exe || exit /b 1
+light_cluster_bench.exe || exit /b 1
+shader_cache_check.exe || exit /b 1
+reflection_probe_check.exe || exit /b 1
+bvh_bench.exe 1000000 || exit /b 1
+lightmap_check.exe || exit /b 1
+vertex_ao_check.exe || exit /b 1
+irradiance_check.exe || exit /b 1
+pvs_check.exe || exit /b 1
+occlusion_bench.exe || exit /b 1
+input_record_check.exe || exit /b 1
+profile_check.exe || exit /b 1
+
+rem texture residency along the built-in camera path, with invented set sizes
+rem that make the bins trade mips to stay in budget
+residency_sim.exe -synthetic || exit /b 1
+
+rem the virtual texture runtime on a small neutral bake, through a cache too
+rem small to hold it, so tiles have to be evicted
+vtex_bake.exe bake vtex_check.vtex - - - 8 || exit /b 1
+vtex_bake.exe replay vtex_check.vtex 600 32 || exit /b 1
+
+rem normals and cone step maps are baked from displacement, then shipped in
+rem place of normal.png and displacement.png
+for /d %%d in (..\data\textures\*) do if exist %%d\displacement.png normal_bake.exe %%d\displacement.png %%d\normal.tex || exit /b 1
+for /d %%d in (..\data\textures\*) do if exist %%d\displacement.png cone_bake.exe %%d\displacement.png %%d\displacement.tex || exit /b 1
+
+rem and residency again, with the bins sized from the maps just baked
+residency_sim.exe || exit /b 1
+
+rem the reflective instances sample these in place of rendering reflections
+reflection_bake.exe ..\data\reflection_probes.rpb || exit /b 1
+
+rem the static instances read their directional light from this in place of
+rem the shadow maps
+lightmap_bake.exe ..\data\lightmap.lmp || exit /b 1
+
+rem and this darkens their ambient where they meet
+vertex_ao_bake.exe ..\data\vertex_ao.vao || exit /b 1
+
+rem instances without a lightmap take their ambient from this
+irradiance_bake.exe ..\data\irradiance_volume.irv || exit /b 1
+
+rem the shaded pass only draws what the camera's cell can see, where that
+rem drops enough to pay, and no cell does in the open default hall; this is
+rem how much it culls along the built-in camera path, and fails if it drops
+rem anything the camera can see
+pvs_bake.exe ..\data\visibility.pvs || exit /b 1
+pvs_sim.exe ..\data\visibility.pvs || exit /b 1
+
+rem the default scene drawn by the software backend from what was just baked,
+rem the same on every thread count
+soft_frame.exe soft_frame.ppm 640 360 2 || exit /b 1
+
+rem ps_main's instruction count for every variant the engine compiles, next
+rem to the uber shader's
+shader_report.exe shader_variants.txt || exit /b 1
+
+rem the engine reads its assets from this pack
+pack_data.exe ..\data data.pak || exit /b 1
+
+rem and starts up headless from it, drawing the same frame again when it plays
+rem back what it just recorded; engine_soft.json opens in ui.perfetto.dev
+engine_soft.exe -frames 3 -size 320 180 -record engine_soft.inp -out engine_soft.ppm -trace engine_soft.json || exit /b 1
+engine_soft.exe -replay engine_soft.inp -size 320 180 -out engine_soft_replay.ppm || exit /b 1
+fc /b engine_soft.ppm engine_soft_replay.ppm > nul || exit /b 1
 popd
 if errorlevel 1 exit
 
@@ -0,0 +1,110 @@
+#!/bin/sh
+# Linux build for the portable tools and the engine on the software backend.
+# The D3D11 engine is built by build.bat.
+set -e
+
+mkdir -p ../build
+cd ../build
+
+CFLAGS="-g -O2 -std=gnu11 -Wall -Wextra -Wno-missing-braces -Wno-unused-function -DENGINE_DEBUG"
+cc $CFLAGS ../code/main_soft.c -o engine_soft -lm -lpthread
+cc $CFLAGS ../code/tools/residency_sim.c -o residency_sim -lm
+cc $CFLAGS ../code/tools/vtex_bake.c -o vtex_bake -lm -lpthread
+cc $CFLAGS ../code/tools/normal_bake.c -o normal_bake -lm -lpthread
+cc $CFLAGS ../code/tools/cone_bake.c -o cone_bake -lm -lpthread
+cc $CFLAGS ../code/tools/pack_data.c -o pack_data
+cc $CFLAGS ../code/tools/shadow_check.c -o shadow_check -lm
+cc $CFLAGS ../code/tools/shadow_filter_check.c -o shadow_filter_check -lm
+cc $CFLAGS ../code/tools/light_cluster_bench.c -o light_cluster_bench -lm -lpthread
+cc $CFLAGS ../code/tools/shader_cache_check.c -o shader_cache_check -lm -lpthread
+cc $CFLAGS ../code/tools/reflection_probe_check.c -o reflection_probe_check -lm -lpthread
+cc $CFLAGS ../code/tools/reflection_bake.c -o reflection_bake -lm -lpthread
+cc $CFLAGS ../code/tools/bvh_bench.c -o bvh_bench -lm -lpthread
+cc $CFLAGS ../code/tools/lightmap_check.c -o lightmap_check -lm -lpthread
+cc $CFLAGS ../code/tools/lightmap_bake.c -o lightmap_bake -lm -lpthread
+cc $CFLAGS ../code/tools/vertex_ao_check.c -o vertex_ao_check -lm -lpthread
+cc $CFLAGS ../code/tools/vertex_ao_bake.c -o vertex_ao_bake -lm -lpthread
+cc $CFLAGS ../code/tools/irradiance_check.c -o irradiance_check -lm -lpthread
+cc $CFLAGS ../code/tools/irradiance_bake.c -o irradiance_bake -lm -lpthread
+cc $CFLAGS ../code/tools/pvs_check.c -o pvs_check -lm -lpthread
+cc $CFLAGS ../code/tools/pvs_bake.c -o pvs_bake -lm -lpthread
+cc $CFLAGS ../code/tools/pvs_sim.c -o pvs_sim -lm -lpthread
+cc $CFLAGS ../code/tools/occlusion_bench.c -o occlusion_bench -lm -lpthread
+cc $CFLAGS ../code/tools/soft_frame.c -o soft_frame -lm -lpthread
+cc $CFLAGS ../code/tools/input_record_check.c -o input_record_check -lm -lpthread
+cc $CFLAGS ../code/tools/profile_check.c -o profile_check -lm -lpthread
+
+# cascade fitting, shadow filtering, light binning, the shader cache, the
+# probe baker, the BVH, the lightmap baker, the occlusion baker, the
+# irradiance volume, the visible sets, occlusion culling, input replay and
+# the profiler must hold before anything ships; the full 10M triangle
+# stress run is ./bvh_bench with no arguments
+./shadow_check
+./shadow_filter_check
+./light_cluster_bench
+./shader_cache_check
+./reflection_probe_check
+./bvh_bench 1000000
+./lightmap_check
+./vertex_ao_check
+./irradiance_check
+./pvs_check
+./occlusion_bench
+./input_record_check
+./profile_check
+
+# texture residency along the built-in camera path, with invented set sizes
+# that make the bins trade mips to stay in budget
+./residency_sim -synthetic
+
+# the virtual texture runtime on a small neutral bake, through a cache too
+# small to hold it, so tiles have to be evicted
+./vtex_bake bake vtex_check.vtex - - - 8
+./vtex_bake replay vtex_check.vtex 600 32
+
+# normals and cone step maps are baked from displacement, then shipped in
+# place of normal.png and displacement.png
+for dir in ../data/textures/*/; do
+  if [ -f "${dir}displacement.png" ] && [ ! "${dir}normal.tex" -nt "${dir}displacement.png" ]; then
+    ./normal_bake "${dir}displacement.png" "${dir}normal.tex"
+  fi
+  if [ -f "${dir}displacement.png" ] && [ ! "${dir}displacement.tex" -nt "${dir}displacement.png" ]; then
+    ./cone_bake "${dir}displacement.png" "${dir}displacement.tex"
+  fi
+done
+
+# and residency again, with the bins sized from the maps just baked
+./residency_sim
+
+# the reflective instances sample these in place of rendering reflections
+./reflection_bake ../data/reflection_probes.rpb
+
+# the static instances read their directional light from this in place of
+# the shadow maps
+./lightmap_bake ../data/lightmap.lmp
+
+# and this darkens their ambient where they meet
+./vertex_ao_bake ../data/vertex_ao.vao
+
+# instances without a lightmap take their ambient from this
+./irradiance_bake ../data/irradiance_volume.irv
+
+# the shaded pass only draws what the camera's cell can see, where that
+# drops enough to pay, and no cell does in the open default hall; this is
+# how much it culls along the built-in camera path, and fails if it drops
+# anything the camera can see
+./pvs_bake ../data/visibility.pvs
+./pvs_sim ../data/visibility.pvs
+
+# the default scene drawn by the software backend from what was just baked,
+# the same on every thread count
+./soft_frame soft_frame.ppm 640 360 2
+
+# the engine reads its assets from this pack
+./pack_data ../data data.pak
+
+# and starts up headless from it, drawing the same frame again when it plays
+# back what it just recorded; engine_soft.json opens in ui.perfetto.dev
+./engine_soft -frames 3 -size 320 180 -record engine_soft.inp -out engine_soft.ppm -trace engine_soft.json
+./engine_soft -replay engine_soft.inp -size 320 180 -out engine_soft_replay.ppm
+cmp engine_soft.ppm engine_soft_replay.ppm
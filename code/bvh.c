@@ -0,0 +1,1063 @@
+typedef struct
+{
+  Bvh_Box box;
+  v3f     centroid;
+  u32     source_idx;
+} Bvh_Ref;
+
+// Binary nodes while building; count is 0 for interior nodes, whose
+// children are first and first + 1.
+typedef struct
+{
+  Bvh_Box box;
+  u32     first;
+  u32     count;
+} Bvh_Build_Node;
+
+typedef struct
+{
+  Bvh_Box box;
+  u32     count;
+} Bvh_Bin;
+
+typedef struct
+{
+  Bvh_Box bounds;
+  Bvh_Box centroid_bounds;
+  Bvh_Bin bins[3][Bvh_BinCount];
+} Bvh_Bins;
+
+typedef struct
+{
+  Bvh_Source_Triangle *source;
+  Bvh_Ref             *refs;
+  Bvh_Build_Node      *nodes;
+  volatile u64         node_count;
+
+  Bvh                 *bvh;
+  u32                  bvh_node_count;
+  u32                  bvh_triangle_count;
+} Bvh_Builder;
+
+typedef struct
+{
+  Bvh_Builder *builder;
+  u32          node_idx;
+  u32          begin;
+  u32          end;
+} Bvh_Task;
+
+typedef struct
+{
+  Bvh_Builder *builder;
+  u32          begin;
+  u32          end;
+  // 0 for the bounds pass, else the bins pass over centroid_bounds
+  b32          binning;
+  Bvh_Box      centroid_bounds;
+  Bvh_Bins     result;
+} Bvh_Chunk_Job;
+
+static Bvh_Box
+bvh_box_empty(void)
+{
+  Bvh_Box result = { { 1e30f, 1e30f, 1e30f }, { -1e30f, -1e30f, -1e30f } };
+  return(result);
+}
+
+static void
+bvh_box_grow(Bvh_Box *box, v3f p)
+{
+  box->min.x = Minimum(box->min.x, p.x);
+  box->min.y = Minimum(box->min.y, p.y);
+  box->min.z = Minimum(box->min.z, p.z);
+  box->max.x = Maximum(box->max.x, p.x);
+  box->max.y = Maximum(box->max.y, p.y);
+  box->max.z = Maximum(box->max.z, p.z);
+}
+
+// other may be empty
+static void
+bvh_box_union(Bvh_Box *box, Bvh_Box other)
+{
+  box->min.x = Minimum(box->min.x, other.min.x);
+  box->min.y = Minimum(box->min.y, other.min.y);
+  box->min.z = Minimum(box->min.z, other.min.z);
+  box->max.x = Maximum(box->max.x, other.max.x);
+  box->max.y = Maximum(box->max.y, other.max.y);
+  box->max.z = Maximum(box->max.z, other.max.z);
+}
+
+// half the surface area; only ratios matter
+static f32
+bvh_box_area(Bvh_Box box)
+{
+  v3f extent = v3f_sub(box.max, box.min);
+  f32 result = (extent.x < 0.0f) ? 0.0f : (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+  return(result);
+}
+
+static f32
+bvh_bin_scale(Bvh_Box centroid_bounds, u32 axis)
+{
+  f32 extent = centroid_bounds.max.v[axis] - centroid_bounds.min.v[axis];
+  f32 result = (extent > 0.0f) ? ((f32)Bvh_BinCount * 0.9999f / extent) : 0.0f;
+  return(result);
+}
+
+// binning and partitioning must agree to the bit, so both come through here
+static u32
+bvh_bin_index(f32 centroid, f32 min, f32 scale)
+{
+  f32 offset = (centroid - min) * scale;
+  u32 result = (u32)Maximum(offset, 0.0f);
+  result = Minimum(result, Bvh_BinCount - 1);
+  return(result);
+}
+
+static void
+bvh_range_bounds(Bvh_Ref *refs, u32 begin, u32 end, Bvh_Bins *bins)
+{
+  bins->bounds          = bvh_box_empty();
+  bins->centroid_bounds = bvh_box_empty();
+  for (u32 ref_idx = begin; ref_idx < end; ++ref_idx)
+  {
+    bvh_box_union(&bins->bounds, refs[ref_idx].box);
+    bvh_box_grow(&bins->centroid_bounds, refs[ref_idx].centroid);
+  }
+}
+
+static void
+bvh_range_bin(Bvh_Ref *refs, u32 begin, u32 end, Bvh_Box centroid_bounds, Bvh_Bins *bins)
+{
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    for (u32 bin_idx = 0; bin_idx < Bvh_BinCount; ++bin_idx)
+    {
+      bins->bins[axis][bin_idx] = (Bvh_Bin){ bvh_box_empty(), 0 };
+    }
+  }
+
+  // unpacked up front; reading them through the box each time stalls on the copy
+  f32 mins[3]   = { centroid_bounds.min.x, centroid_bounds.min.y, centroid_bounds.min.z };
+  f32 scales[3] = { bvh_bin_scale(centroid_bounds, 0), bvh_bin_scale(centroid_bounds, 1), bvh_bin_scale(centroid_bounds, 2) };
+  for (u32 ref_idx = begin; ref_idx < end; ++ref_idx)
+  {
+    Bvh_Ref *ref = refs + ref_idx;
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      Bvh_Bin *bin = bins->bins[axis] + bvh_bin_index(ref->centroid.v[axis], mins[axis], scales[axis]);
+      bvh_box_union(&bin->box, ref->box);
+      ++bin->count;
+    }
+  }
+}
+
+static void
+bvh_chunk_job(void *data)
+{
+  Bvh_Chunk_Job *job = (Bvh_Chunk_Job *)data;
+  if (job->binning)
+  {
+    bvh_range_bin(job->builder->refs, job->begin, job->end, job->centroid_bounds, &job->result);
+  }
+  else
+  {
+    bvh_range_bounds(job->builder->refs, job->begin, job->end, &job->result);
+  }
+}
+
+// Either pass over a big range, in chunks across the queue. The chunks only
+// depend on the range, and min, max and counts merge the same in any order.
+static void
+bvh_range_pass_parallel(Bvh_Builder *builder, OS_Work_Queue *queue, u32 begin, u32 end, b32 binning, Bvh_Bins *bins)
+{
+  static Bvh_Chunk_Job jobs[1024];
+  u32 chunk_size  = Maximum(Bvh_ChunkTriangles, (end - begin + ArrayCount(jobs) - 1) / ArrayCount(jobs));
+  u32 chunk_count = 0;
+  for (u32 chunk_begin = begin; chunk_begin < end; chunk_begin += chunk_size)
+  {
+    Bvh_Chunk_Job *job = jobs + chunk_count++;
+    job->builder         = builder;
+    job->begin           = chunk_begin;
+    job->end             = Minimum(chunk_begin + chunk_size, end);
+    job->binning         = binning;
+    job->centroid_bounds = bins->centroid_bounds;
+    os_work_queue_add(queue, bvh_chunk_job, job);
+  }
+  os_work_queue_complete_all(queue);
+
+  if (binning)
+  {
+    for (u32 chunk_idx = 0; chunk_idx < chunk_count; ++chunk_idx)
+    {
+      for (u32 axis = 0; axis < 3; ++axis)
+      {
+        for (u32 bin_idx = 0; bin_idx < Bvh_BinCount; ++bin_idx)
+        {
+          Bvh_Bin *bin   = bins->bins[axis] + bin_idx;
+          Bvh_Bin *chunk = jobs[chunk_idx].result.bins[axis] + bin_idx;
+          if (!chunk_idx)
+          {
+            *bin = *chunk;
+          }
+          else
+          {
+            bvh_box_union(&bin->box, chunk->box);
+            bin->count += chunk->count;
+          }
+        }
+      }
+    }
+  }
+  else
+  {
+    bins->bounds          = bvh_box_empty();
+    bins->centroid_bounds = bvh_box_empty();
+    for (u32 chunk_idx = 0; chunk_idx < chunk_count; ++chunk_idx)
+    {
+      bvh_box_union(&bins->bounds, jobs[chunk_idx].result.bounds);
+      bvh_box_union(&bins->centroid_bounds, jobs[chunk_idx].result.centroid_bounds);
+    }
+  }
+}
+
+// Bins [begin, end) (already bounded in bins) and partitions it at the
+// cheapest split; returns where the right half starts. Ranges whose
+// centroids all coincide, or whose best split leaves a side empty, are cut
+// in the middle instead. queue is 0 on the workers, which may not feed it.
+static u32
+bvh_split_range(Bvh_Builder *builder, u32 begin, u32 end, Bvh_Bins *bins, OS_Work_Queue *queue)
+{
+  Bvh_Ref *refs = builder->refs;
+  if (queue && (end - begin >= Bvh_ParallelTriangles))
+  {
+    bvh_range_pass_parallel(builder, queue, begin, end, true, bins);
+  }
+  else
+  {
+    bvh_range_bin(refs, begin, end, bins->centroid_bounds, bins);
+  }
+
+  u32 best_axis = 3, best_bin = 0;
+  f32 best_cost = 1e30f;
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    if (bvh_bin_scale(bins->centroid_bounds, axis) == 0.0f)
+    {
+      continue;
+    }
+
+    // sweep from the right, then from the left pricing each boundary
+    f32 right_cost[Bvh_BinCount];
+    Bvh_Box right_box = bvh_box_empty();
+    u32 right_count   = 0;
+    for (u32 bin_idx = Bvh_BinCount - 1; bin_idx > 0; --bin_idx)
+    {
+      bvh_box_union(&right_box, bins->bins[axis][bin_idx].box);
+      right_count += bins->bins[axis][bin_idx].count;
+      right_cost[bin_idx] = bvh_box_area(right_box) * (f32)right_count;
+    }
+
+    Bvh_Box left_box = bvh_box_empty();
+    u32 left_count   = 0;
+    for (u32 bin_idx = 1; bin_idx < Bvh_BinCount; ++bin_idx)
+    {
+      bvh_box_union(&left_box, bins->bins[axis][bin_idx - 1].box);
+      left_count += bins->bins[axis][bin_idx - 1].count;
+      f32 cost = bvh_box_area(left_box) * (f32)left_count + right_cost[bin_idx];
+      if (left_count && (left_count < end - begin) && (cost < best_cost))
+      {
+        best_cost = cost;
+        best_axis = axis;
+        best_bin  = bin_idx;
+      }
+    }
+  }
+
+  u32 result = begin + (end - begin) / 2;
+  if (best_axis < 3)
+  {
+    f32 scale = bvh_bin_scale(bins->centroid_bounds, best_axis);
+    f32 min   = bins->centroid_bounds.min.v[best_axis];
+    u32 left  = begin;
+    u32 right = end;
+    while (left < right)
+    {
+      if (bvh_bin_index(refs[left].centroid.v[best_axis], min, scale) < best_bin)
+      {
+        ++left;
+      }
+      else
+      {
+        Bvh_Ref swap = refs[left];
+        refs[left]   = refs[--right];
+        refs[right]  = swap;
+      }
+    }
+
+    Assert((left > begin) && (left < end));
+    result = left;
+  }
+
+  return(result);
+}
+
+static u32
+bvh_alloc_node_pair(Bvh_Builder *builder)
+{
+  u32 result = (u32)AtomicAddU64(&builder->node_count, 2);
+  return(result);
+}
+
+static void
+bvh_build_subtree(Bvh_Builder *builder, u32 node_idx, u32 begin, u32 end)
+{
+  Bvh_Bins bins;
+  bvh_range_bounds(builder->refs, begin, end, &bins);
+
+  Bvh_Build_Node *node = builder->nodes + node_idx;
+  node->box = bins.bounds;
+  if (end - begin <= Bvh_MaxLeafTriangles)
+  {
+    node->first = begin;
+    node->count = end - begin;
+  }
+  else
+  {
+    u32 mid      = bvh_split_range(builder, begin, end, &bins, 0);
+    u32 children = bvh_alloc_node_pair(builder);
+    node->first  = children;
+    node->count  = 0;
+    bvh_build_subtree(builder, children, begin, mid);
+    bvh_build_subtree(builder, children + 1, mid, end);
+  }
+}
+
+static void
+bvh_subtree_job(void *data)
+{
+  Bvh_Task *task = (Bvh_Task *)data;
+  bvh_build_subtree(task->builder, task->node_idx, task->begin, task->end);
+}
+
+static void
+bvh_collapse_leaf(Bvh_Builder *builder, Bvh_Build_Node *leaf, Bvh_Node *dest, u32 slot)
+{
+  Bvh *bvh = builder->bvh;
+  dest->child[slot]      = Bvh_LeafBit | builder->bvh_triangle_count;
+  dest->leaf_count[slot] = leaf->count;
+  for (u32 ref_idx = leaf->first; ref_idx < leaf->first + leaf->count; ++ref_idx)
+  {
+    Bvh_Source_Triangle *source   = builder->source + builder->refs[ref_idx].source_idx;
+    Bvh_Triangle        *triangle = bvh->triangles + builder->bvh_triangle_count++;
+    triangle->v0           = source->p[0];
+    triangle->e1           = v3f_sub(source->p[1], source->p[0]);
+    triangle->e2           = v3f_sub(source->p[2], source->p[0]);
+    triangle->source_idx   = builder->refs[ref_idx].source_idx;
+    triangle->instance_idx = source->instance_idx;
+  }
+}
+
+// Emits one wide node for children, pulling their descendants up into it
+// (largest interior child opened first) until it is full, then the wide
+// children depth first after it.
+static u32
+bvh_collapse(Bvh_Builder *builder, Bvh_Build_Node *first_children[], u32 first_count)
+{
+  u32 result = builder->bvh_node_count++;
+
+  Bvh_Build_Node *children[Bvh_Width];
+  u32 child_count = first_count;
+  for (u32 child_idx = 0; child_idx < first_count; ++child_idx)
+  {
+    children[child_idx] = first_children[child_idx];
+  }
+
+  while (child_count < Bvh_Width)
+  {
+    s32 open_idx  = -1;
+    f32 open_area = -1.0f;
+    for (u32 child_idx = 0; child_idx < child_count; ++child_idx)
+    {
+      f32 area = bvh_box_area(children[child_idx]->box);
+      if (!children[child_idx]->count && (area > open_area))
+      {
+        open_idx  = (s32)child_idx;
+        open_area = area;
+      }
+    }
+
+    if (open_idx < 0)
+    {
+      break;
+    }
+
+    Bvh_Build_Node *opened  = children[open_idx];
+    children[open_idx]      = builder->nodes + opened->first;
+    children[child_count++] = builder->nodes + opened->first + 1;
+  }
+
+  // the node array is sized up front, so dest stays put through the recursion
+  Bvh_Node *dest = builder->bvh->nodes + result;
+  for (u32 slot = 0; slot < Bvh_Width; ++slot)
+  {
+    Bvh_Box box = (slot < child_count) ? children[slot]->box : bvh_box_empty();
+    dest->min_x[slot]      = box.min.x;
+    dest->min_y[slot]      = box.min.y;
+    dest->min_z[slot]      = box.min.z;
+    dest->max_x[slot]      = box.max.x;
+    dest->max_y[slot]      = box.max.y;
+    dest->max_z[slot]      = box.max.z;
+    dest->child[slot]      = Bvh_EmptyChild;
+    dest->leaf_count[slot] = 0;
+  }
+
+  for (u32 slot = 0; slot < child_count; ++slot)
+  {
+    if (children[slot]->count)
+    {
+      bvh_collapse_leaf(builder, children[slot], dest, slot);
+    }
+    else
+    {
+      Bvh_Build_Node *grandchildren[2] = { builder->nodes + children[slot]->first, builder->nodes + children[slot]->first + 1 };
+      dest->child[slot] = bvh_collapse(builder, grandchildren, 2);
+    }
+  }
+
+  return(result);
+}
+
+static void
+bvh_build(Bvh *bvh, Bvh_Source_Triangle *source, u32 triangle_count, OS_Work_Queue *queue)
+{
+  *bvh = (Bvh){ 0 };
+  bvh->bounds = bvh_box_empty();
+  if (!triangle_count)
+  {
+    return;
+  }
+
+  Bvh_Builder builder = { .source = source, .bvh = bvh };
+  u64 refs_size  = (u64)triangle_count * sizeof(Bvh_Ref);
+  u64 nodes_size = (u64)2 * triangle_count * sizeof(Bvh_Build_Node);
+  builder.refs   = (Bvh_Ref *)os_memory_alloc(refs_size);
+  builder.nodes  = (Bvh_Build_Node *)os_memory_alloc(nodes_size);
+  for (u32 triangle_idx = 0; triangle_idx < triangle_count; ++triangle_idx)
+  {
+    Bvh_Ref *ref = builder.refs + triangle_idx;
+    ref->box        = bvh_box_empty();
+    ref->source_idx = triangle_idx;
+    for (u32 vertex = 0; vertex < 3; ++vertex)
+    {
+      bvh_box_grow(&ref->box, source[triangle_idx].p[vertex]);
+    }
+    ref->centroid = v3f_scale(0.5f, v3f_add(ref->box.min, ref->box.max));
+  }
+
+  // The top splits, depth first on this thread. Ranges under the subtree
+  // size are set aside for the workers.
+  u32 subtree_triangles = Maximum(triangle_count / Bvh_TargetSubtrees, Bvh_MinSubtreeTriangles);
+  u32 task_capacity     = 64 * (triangle_count / subtree_triangles + 1);
+  u64 tasks_size        = (u64)2 * task_capacity * sizeof(Bvh_Task);
+  Bvh_Task *tasks       = (Bvh_Task *)os_memory_alloc(tasks_size);
+  Bvh_Task *pending     = tasks + task_capacity;
+  u32 task_count    = 0;
+  u32 pending_count = 0;
+
+  builder.node_count = 1;
+  pending[pending_count++] = (Bvh_Task){ &builder, 0, 0, triangle_count };
+  while (pending_count)
+  {
+    Bvh_Task task = pending[--pending_count];
+    if (task.end - task.begin <= subtree_triangles)
+    {
+      // a lopsided top can leave more ranges than planned; the tree comes
+      // out the same wherever they build
+      if (task_count < task_capacity)
+      {
+        tasks[task_count++] = task;
+      }
+      else
+      {
+        bvh_subtree_job(&task);
+      }
+      continue;
+    }
+
+    Bvh_Bins bins;
+    if (queue && (task.end - task.begin >= Bvh_ParallelTriangles))
+    {
+      bvh_range_pass_parallel(&builder, queue, task.begin, task.end, false, &bins);
+    }
+    else
+    {
+      bvh_range_bounds(builder.refs, task.begin, task.end, &bins);
+    }
+
+    u32 mid      = bvh_split_range(&builder, task.begin, task.end, &bins, queue);
+    u32 children = bvh_alloc_node_pair(&builder);
+    builder.nodes[task.node_idx] = (Bvh_Build_Node){ bins.bounds, children, 0 };
+
+    Assert(pending_count + 2 <= task_capacity);
+    pending[pending_count++] = (Bvh_Task){ &builder, children + 1, mid, task.end };
+    pending[pending_count++] = (Bvh_Task){ &builder, children, task.begin, mid };
+  }
+
+  // the subtrees, a queue's worth at a time
+  for (u32 task_idx = 0; task_idx < task_count; ++task_idx)
+  {
+    if (queue)
+    {
+      os_work_queue_add(queue, bvh_subtree_job, tasks + task_idx);
+      if ((task_idx + 1) % 512 == 0)
+      {
+        os_work_queue_complete_all(queue);
+      }
+    }
+    else
+    {
+      bvh_subtree_job(tasks + task_idx);
+    }
+  }
+
+  if (queue)
+  {
+    os_work_queue_complete_all(queue);
+  }
+
+  // collapse, with room for the worst case of one wide node per binary split
+  bvh->node_capacity = (u32)(builder.node_count / 2 + 1);
+  bvh->nodes     = (Bvh_Node *)os_memory_alloc((u64)bvh->node_capacity * sizeof(Bvh_Node));
+  bvh->triangles = (Bvh_Triangle *)os_memory_alloc((u64)triangle_count * sizeof(Bvh_Triangle));
+  bvh->bounds    = builder.nodes[0].box;
+  // a tree that is one leaf still gets a node to hold it
+  Bvh_Build_Node *root = builder.nodes;
+  bvh_collapse(&builder, &root, 1);
+
+  bvh->node_count     = builder.bvh_node_count;
+  bvh->triangle_count = builder.bvh_triangle_count;
+  Assert(bvh->triangle_count == triangle_count);
+
+  os_memory_free(tasks, tasks_size);
+  os_memory_free(builder.nodes, nodes_size);
+  os_memory_free(builder.refs, refs_size);
+}
+
+static void
+bvh_free(Bvh *bvh)
+{
+  if (bvh->nodes)
+  {
+    os_memory_free(bvh->nodes, (u64)bvh->node_capacity * sizeof(Bvh_Node));
+    os_memory_free(bvh->triangles, (u64)bvh->triangle_count * sizeof(Bvh_Triangle));
+  }
+  *bvh = (Bvh){ 0 };
+}
+
+static u32
+bvh_scene_triangle_count(Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count])
+{
+  u32 result = 0;
+  for (u32 batch_idx = 0; batch_idx < scene->static_batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch = scene->batches + batch_idx;
+    u32 instance_count = batch->instance_count;
+    if (batch_idx == scene->static_batch_count - 1)
+    {
+      instance_count = scene->static_last_batch_instance_count;
+    }
+
+    result += instance_count * (meshes[batch->model].index_count / 3);
+  }
+
+  return(result);
+}
+
+static void
+bvh_gather_scene(Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count], Bvh_Source_Triangle *dest)
+{
+  for (u32 batch_idx = 0; batch_idx < scene->static_batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch = scene->batches + batch_idx;
+    Scene_Mesh  *mesh  = meshes + batch->model;
+    u32 instance_end   = batch->first_instance + batch->instance_count;
+    if (batch_idx == scene->static_batch_count - 1)
+    {
+      instance_end = batch->first_instance + scene->static_last_batch_instance_count;
+    }
+
+    for (u32 instance_idx = batch->first_instance; instance_idx < instance_end; ++instance_idx)
+    {
+      Model_Instance *instance = scene->ins + instance_idx;
+      for (u32 index = 0; index < mesh->index_count; index += 3)
+      {
+        for (u32 vertex = 0; vertex < 3; ++vertex)
+        {
+          v3f p = mesh->vertices[mesh->indices[index + vertex]].p;
+          dest->p[vertex] = v3f_add(m33_mul_v3f(instance->model_to_world_xform, p), instance->p);
+        }
+        dest->instance_idx = instance_idx;
+        ++dest;
+      }
+    }
+  }
+}
+
+static b32
+bvh_triangle_intersect(Bvh_Triangle *triangle, v3f origin, v3f dir, f32 t_min, f32 t_max, Bvh_Hit *hit)
+{
+  b32 result = false;
+  v3f p      = v3f_cross(dir, triangle->e2);
+  f32 det    = v3f_inner(triangle->e1, p);
+  if (fabsf(det) >= 1e-12f)
+  {
+    f32 inv_det = 1.0f / det;
+    v3f s = v3f_sub(origin, triangle->v0);
+    f32 u = v3f_inner(s, p) * inv_det;
+    if ((u >= 0.0f) && (u <= 1.0f))
+    {
+      v3f q = v3f_cross(s, triangle->e1);
+      f32 v = v3f_inner(dir, q) * inv_det;
+      f32 t = v3f_inner(triangle->e2, q) * inv_det;
+      if ((v >= 0.0f) && (u + v <= 1.0f) && (t > t_min) && (t < t_max))
+      {
+        hit->t            = t;
+        hit->u            = u;
+        hit->v            = v;
+        hit->source_idx   = triangle->source_idx;
+        hit->instance_idx = triangle->instance_idx;
+        result = true;
+      }
+    }
+  }
+
+  return(result);
+}
+
+typedef struct
+{
+  u32 node_idx;
+  f32 t_enter;
+} Bvh_Stack_Entry;
+
+// The near and far planes of each axis, picked once per ray by the sign of
+// its direction, so that the slab test needs no min/max swap. An empty slot's
+// inverted box then always comes out with enter > exit.
+typedef struct
+{
+  v3f origin;
+  v3f dir;
+  __m128 origin_x, origin_y, origin_z;
+  __m128 inv_x, inv_y, inv_z;
+  u32 near_x, near_y, near_z;
+} Bvh_Ray;
+
+static Bvh_Ray
+bvh_ray_make(v3f origin, v3f dir)
+{
+  Bvh_Ray result;
+  result.origin   = origin;
+  result.dir      = dir;
+  result.origin_x = _mm_set1_ps(origin.x);
+  result.origin_y = _mm_set1_ps(origin.y);
+  result.origin_z = _mm_set1_ps(origin.z);
+  result.inv_x    = _mm_set1_ps(1.0f / dir.x);
+  result.inv_y    = _mm_set1_ps(1.0f / dir.y);
+  result.inv_z    = _mm_set1_ps(1.0f / dir.z);
+  // offsets in floats from min_x to the near plane array; the sign of the
+  // inverse, so -0 counts as negative
+  result.near_x   = (1.0f / dir.x < 0.0f) ? 3 * Bvh_Width : 0;
+  result.near_y   = (1.0f / dir.y < 0.0f) ? 3 * Bvh_Width : 0;
+  result.near_z   = (1.0f / dir.z < 0.0f) ? 3 * Bvh_Width : 0;
+  return(result);
+}
+
+// Entry distances of the four children in enter; returns the mask of those
+// the ray passes through within [t_min, t_max]. The slab is the first operand
+// of max and min so a NaN from 0 * inf (a ray in a box's plane) drops out.
+static u32
+bvh_ray_node(Bvh_Ray *ray, Bvh_Node *node, __m128 t_min, __m128 t_max, __m128 *enter)
+{
+  f32 *planes = node->min_x;
+  __m128 near_x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes + ray->near_x), ray->origin_x), ray->inv_x);
+  __m128 near_y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes + ray->near_y + Bvh_Width), ray->origin_y), ray->inv_y);
+  __m128 near_z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes + ray->near_z + 2 * Bvh_Width), ray->origin_z), ray->inv_z);
+  __m128 far_x  = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes + (3 * Bvh_Width - ray->near_x)), ray->origin_x), ray->inv_x);
+  __m128 far_y  = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes + (3 * Bvh_Width - ray->near_y) + Bvh_Width), ray->origin_y), ray->inv_y);
+  __m128 far_z  = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes + (3 * Bvh_Width - ray->near_z) + 2 * Bvh_Width), ray->origin_z), ray->inv_z);
+
+  __m128 t_enter = _mm_max_ps(near_z, _mm_max_ps(near_y, _mm_max_ps(near_x, t_min)));
+  __m128 t_exit  = _mm_min_ps(far_z, _mm_min_ps(far_y, _mm_min_ps(far_x, t_max)));
+  *enter = t_enter;
+  u32 result = (u32)_mm_movemask_ps(_mm_cmple_ps(t_enter, t_exit));
+  return(result);
+}
+
+// Closest hit when any_hit is false, else the first hit found. Children are
+// visited nearest first, and stack entries past the closest hit so far are
+// dropped when popped.
+static b32
+bvh_trace(Bvh *bvh, v3f origin, v3f dir, f32 t_min, f32 t_max, b32 any_hit, Bvh_Hit *hit)
+{
+  b32 result = false;
+  hit->t = t_max;
+  if (!bvh->node_count)
+  {
+    return(result);
+  }
+
+  Bvh_Ray ray = bvh_ray_make(origin, dir);
+  __m128 t_min_4 = _mm_set1_ps(t_min);
+
+  Bvh_Stack_Entry stack[Bvh_StackSize];
+  u32 stack_count = 0;
+  stack[stack_count++] = (Bvh_Stack_Entry){ 0, t_min };
+  while (stack_count)
+  {
+    Bvh_Stack_Entry entry = stack[--stack_count];
+    if (entry.t_enter > hit->t)
+    {
+      continue;
+    }
+
+    Bvh_Node *node = bvh->nodes + entry.node_idx;
+    __m128 enter;
+    u32 mask = bvh_ray_node(&ray, node, t_min_4, _mm_set1_ps(hit->t), &enter);
+    if (!mask)
+    {
+      continue;
+    }
+
+    // the children hit, nearest first
+    f32 enter_t[Bvh_Width];
+    _mm_storeu_ps(enter_t, enter);
+    u32 order[Bvh_Width];
+    u32 order_count = 0;
+    for (u32 slot = 0; slot < Bvh_Width; ++slot)
+    {
+      if (mask & (1 << slot))
+      {
+        u32 insert = order_count++;
+        while (insert && (enter_t[order[insert - 1]] > enter_t[slot]))
+        {
+          order[insert] = order[insert - 1];
+          --insert;
+        }
+        order[insert] = slot;
+      }
+    }
+
+    // leaves now, interior children pushed farthest first so the nearest pops next
+    for (u32 order_idx = 0; order_idx < order_count; ++order_idx)
+    {
+      u32 slot  = order[order_idx];
+      u32 child = node->child[slot];
+      if (child & Bvh_LeafBit)
+      {
+        Bvh_Triangle *triangle = bvh->triangles + (child & ~Bvh_LeafBit);
+        for (u32 triangle_idx = 0; triangle_idx < node->leaf_count[slot]; ++triangle_idx)
+        {
+          if (bvh_triangle_intersect(triangle + triangle_idx, origin, dir, t_min, hit->t, hit))
+          {
+            result = true;
+            if (any_hit)
+            {
+              return(result);
+            }
+          }
+        }
+      }
+    }
+
+    for (u32 order_idx = order_count; order_idx > 0; --order_idx)
+    {
+      u32 slot  = order[order_idx - 1];
+      u32 child = node->child[slot];
+      if (!(child & Bvh_LeafBit))
+      {
+        Assert(stack_count < Bvh_StackSize);
+        stack[stack_count++] = (Bvh_Stack_Entry){ child, enter_t[slot] };
+      }
+    }
+  }
+
+  return(result);
+}
+
+static b32
+bvh_intersect(Bvh *bvh, v3f origin, v3f dir, f32 t_min, f32 t_max, Bvh_Hit *hit)
+{
+  b32 result = bvh_trace(bvh, origin, dir, t_min, t_max, false, hit);
+  return(result);
+}
+
+static b32
+bvh_occluded(Bvh *bvh, v3f origin, v3f dir, f32 t_min, f32 t_max)
+{
+  Bvh_Hit hit;
+  b32 result = bvh_trace(bvh, origin, dir, t_min, t_max, true, &hit);
+  return(result);
+}
+
+// The packet's per lane data as SSE registers, with the direction signs
+// every lane agrees on; coherent is false when they do not agree.
+typedef struct
+{
+  __m128 origin_x, origin_y, origin_z;
+  __m128 dir_x, dir_y, dir_z;
+  __m128 inv_x, inv_y, inv_z;
+  __m128 t_min;
+  u32 near_x, near_y, near_z;
+  b32 coherent;
+} Bvh_Packet_Rays;
+
+static Bvh_Packet_Rays
+bvh_packet_rays_make(Bvh_Packet *packet)
+{
+  Bvh_Packet_Rays result;
+  __m128 one = _mm_set1_ps(1.0f);
+  result.origin_x = _mm_loadu_ps(packet->origin_x);
+  result.origin_y = _mm_loadu_ps(packet->origin_y);
+  result.origin_z = _mm_loadu_ps(packet->origin_z);
+  result.dir_x    = _mm_loadu_ps(packet->dir_x);
+  result.dir_y    = _mm_loadu_ps(packet->dir_y);
+  result.dir_z    = _mm_loadu_ps(packet->dir_z);
+  result.inv_x    = _mm_div_ps(one, result.dir_x);
+  result.inv_y    = _mm_div_ps(one, result.dir_y);
+  result.inv_z    = _mm_div_ps(one, result.dir_z);
+  result.t_min    = _mm_loadu_ps(packet->t_min);
+
+  __m128 zero = _mm_setzero_ps();
+  u32 negative_x = (u32)_mm_movemask_ps(_mm_cmplt_ps(result.inv_x, zero));
+  u32 negative_y = (u32)_mm_movemask_ps(_mm_cmplt_ps(result.inv_y, zero));
+  u32 negative_z = (u32)_mm_movemask_ps(_mm_cmplt_ps(result.inv_z, zero));
+  result.coherent = ((negative_x == 0) || (negative_x == 0xF)) &&
+                    ((negative_y == 0) || (negative_y == 0xF)) &&
+                    ((negative_z == 0) || (negative_z == 0xF));
+  result.near_x   = negative_x ? 3 * Bvh_Width : 0;
+  result.near_y   = negative_y ? 3 * Bvh_Width : 0;
+  result.near_z   = negative_z ? 3 * Bvh_Width : 0;
+  return(result);
+}
+
+// the lanes that pass through slot's box within [t_min, t_max], and in
+// enter the nearest of their entry distances
+static u32
+bvh_packet_box(Bvh_Packet_Rays *rays, Bvh_Node *node, u32 slot, __m128 t_max, f32 *enter)
+{
+  f32 *planes = node->min_x;
+  __m128 near_x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(planes[rays->near_x + slot]), rays->origin_x), rays->inv_x);
+  __m128 near_y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(planes[rays->near_y + Bvh_Width + slot]), rays->origin_y), rays->inv_y);
+  __m128 near_z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(planes[rays->near_z + 2 * Bvh_Width + slot]), rays->origin_z), rays->inv_z);
+  __m128 far_x  = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(planes[3 * Bvh_Width - rays->near_x + slot]), rays->origin_x), rays->inv_x);
+  __m128 far_y  = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(planes[4 * Bvh_Width - rays->near_y + slot]), rays->origin_y), rays->inv_y);
+  __m128 far_z  = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(planes[5 * Bvh_Width - rays->near_z + slot]), rays->origin_z), rays->inv_z);
+
+  __m128 t_enter = _mm_max_ps(near_z, _mm_max_ps(near_y, _mm_max_ps(near_x, rays->t_min)));
+  __m128 t_exit  = _mm_min_ps(far_z, _mm_min_ps(far_y, _mm_min_ps(far_x, t_max)));
+  __m128 inside  = _mm_cmple_ps(t_enter, t_exit);
+
+  __m128 nearest = _mm_or_ps(_mm_and_ps(inside, t_enter), _mm_andnot_ps(inside, _mm_set1_ps(1e30f)));
+  nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+  nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(1, 0, 3, 2)));
+  *enter  = _mm_cvtss_f32(nearest);
+
+  u32 result = (u32)_mm_movemask_ps(inside);
+  return(result);
+}
+
+// Moller-Trumbore on all four lanes against one triangle; returns the lanes
+// that hit closer than t_max (and within active), with t, u and v updated.
+static u32
+bvh_packet_triangle(Bvh_Packet_Rays *rays, Bvh_Triangle *triangle, u32 active, __m128 *t_max, __m128 *u_out, __m128 *v_out)
+{
+  __m128 e1_x = _mm_set1_ps(triangle->e1.x), e1_y = _mm_set1_ps(triangle->e1.y), e1_z = _mm_set1_ps(triangle->e1.z);
+  __m128 e2_x = _mm_set1_ps(triangle->e2.x), e2_y = _mm_set1_ps(triangle->e2.y), e2_z = _mm_set1_ps(triangle->e2.z);
+
+  // p = dir x e2
+  __m128 p_x = _mm_sub_ps(_mm_mul_ps(rays->dir_y, e2_z), _mm_mul_ps(rays->dir_z, e2_y));
+  __m128 p_y = _mm_sub_ps(_mm_mul_ps(rays->dir_z, e2_x), _mm_mul_ps(rays->dir_x, e2_z));
+  __m128 p_z = _mm_sub_ps(_mm_mul_ps(rays->dir_x, e2_y), _mm_mul_ps(rays->dir_y, e2_x));
+  __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1_x, p_x), _mm_mul_ps(e1_y, p_y)), _mm_mul_ps(e1_z, p_z));
+
+  __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 valid    = _mm_cmpge_ps(_mm_and_ps(det, abs_mask), _mm_set1_ps(1e-12f));
+  __m128 inv_det  = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+  // s = origin - v0, q = s x e1
+  __m128 s_x = _mm_sub_ps(rays->origin_x, _mm_set1_ps(triangle->v0.x));
+  __m128 s_y = _mm_sub_ps(rays->origin_y, _mm_set1_ps(triangle->v0.y));
+  __m128 s_z = _mm_sub_ps(rays->origin_z, _mm_set1_ps(triangle->v0.z));
+  __m128 u   = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s_x, p_x), _mm_mul_ps(s_y, p_y)), _mm_mul_ps(s_z, p_z)), inv_det);
+
+  __m128 q_x = _mm_sub_ps(_mm_mul_ps(s_y, e1_z), _mm_mul_ps(s_z, e1_y));
+  __m128 q_y = _mm_sub_ps(_mm_mul_ps(s_z, e1_x), _mm_mul_ps(s_x, e1_z));
+  __m128 q_z = _mm_sub_ps(_mm_mul_ps(s_x, e1_y), _mm_mul_ps(s_y, e1_x));
+  __m128 v   = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rays->dir_x, q_x), _mm_mul_ps(rays->dir_y, q_y)), _mm_mul_ps(rays->dir_z, q_z)), inv_det);
+  __m128 t   = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2_x, q_x), _mm_mul_ps(e2_y, q_y)), _mm_mul_ps(e2_z, q_z)), inv_det);
+
+  __m128 zero = _mm_setzero_ps();
+  __m128 one  = _mm_set1_ps(1.0f);
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(u, one));
+  valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+  valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+  valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, rays->t_min));
+  valid = _mm_and_ps(valid, _mm_cmplt_ps(t, *t_max));
+
+  u32 result = (u32)_mm_movemask_ps(valid) & active;
+  if (result)
+  {
+    __m128i lanes = _mm_and_si128(_mm_set1_epi32((s32)result), _mm_set_epi32(8, 4, 2, 1));
+    __m128  take  = _mm_castsi128_ps(_mm_cmpgt_epi32(lanes, _mm_setzero_si128()));
+    *t_max = _mm_or_ps(_mm_and_ps(take, t), _mm_andnot_ps(take, *t_max));
+    *u_out = _mm_or_ps(_mm_and_ps(take, u), _mm_andnot_ps(take, *u_out));
+    *v_out = _mm_or_ps(_mm_and_ps(take, v), _mm_andnot_ps(take, *v_out));
+  }
+
+  return(result);
+}
+
+// Packet counterpart of bvh_trace. Each lane has its own t_max; a node is
+// entered when any lane still active passes through it. any_hit retires lanes
+// as they hit and stops once all have.
+static u32
+bvh_trace_packet(Bvh *bvh, Bvh_Packet *packet, b32 any_hit, Bvh_Packet_Hit *hit)
+{
+  u32 result = 0;
+  for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+  {
+    hit->t[lane] = packet->t_max[lane];
+  }
+
+  if (!bvh->node_count)
+  {
+    return(result);
+  }
+
+  Bvh_Packet_Rays rays = bvh_packet_rays_make(packet);
+  if (!rays.coherent)
+  {
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      v3f origin = { packet->origin_x[lane], packet->origin_y[lane], packet->origin_z[lane] };
+      v3f dir    = { packet->dir_x[lane], packet->dir_y[lane], packet->dir_z[lane] };
+      Bvh_Hit lane_hit = { 0 };
+      if (bvh_trace(bvh, origin, dir, packet->t_min[lane], packet->t_max[lane], any_hit, &lane_hit))
+      {
+        result |= 1 << lane;
+        hit->t[lane]            = lane_hit.t;
+        hit->u[lane]            = lane_hit.u;
+        hit->v[lane]            = lane_hit.v;
+        hit->source_idx[lane]   = lane_hit.source_idx;
+        hit->instance_idx[lane] = lane_hit.instance_idx;
+      }
+    }
+    return(result);
+  }
+
+  u32 all_lanes = (1 << Bvh_PacketSize) - 1;
+  __m128 t_max = _mm_loadu_ps(packet->t_max);
+  __m128 u     = _mm_setzero_ps();
+  __m128 v     = _mm_setzero_ps();
+
+  Bvh_Stack_Entry stack[Bvh_StackSize];
+  u32 stack_count = 0;
+  stack[stack_count++] = (Bvh_Stack_Entry){ 0, 0.0f };
+  while (stack_count && (!any_hit || (result != all_lanes)))
+  {
+    // past every lane's closest hit so far
+    Bvh_Stack_Entry entry = stack[--stack_count];
+    __m128 farthest = _mm_max_ps(t_max, _mm_shuffle_ps(t_max, t_max, _MM_SHUFFLE(2, 3, 0, 1)));
+    farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+    if (entry.t_enter > _mm_cvtss_f32(farthest))
+    {
+      continue;
+    }
+
+    // the children some active lane enters, nearest first
+    Bvh_Node *node = bvh->nodes + entry.node_idx;
+    u32 active = any_hit ? (all_lanes & ~result) : all_lanes;
+    f32 enter_t[Bvh_Width];
+    u32 order[Bvh_Width];
+    u32 order_count = 0;
+    for (u32 slot = 0; slot < Bvh_Width; ++slot)
+    {
+      if ((node->child[slot] == Bvh_EmptyChild) || !(bvh_packet_box(&rays, node, slot, t_max, enter_t + slot) & active))
+      {
+        continue;
+      }
+
+      u32 insert = order_count++;
+      while (insert && (enter_t[order[insert - 1]] > enter_t[slot]))
+      {
+        order[insert] = order[insert - 1];
+        --insert;
+      }
+      order[insert] = slot;
+    }
+
+    for (u32 order_idx = 0; order_idx < order_count; ++order_idx)
+    {
+      u32 slot  = order[order_idx];
+      u32 child = node->child[slot];
+      if (!(child & Bvh_LeafBit))
+      {
+        continue;
+      }
+
+      u32 first = child & ~Bvh_LeafBit;
+      for (u32 triangle_idx = first; triangle_idx < first + node->leaf_count[slot]; ++triangle_idx)
+      {
+        Bvh_Triangle *triangle = bvh->triangles + triangle_idx;
+        u32 lanes = bvh_packet_triangle(&rays, triangle, active, &t_max, &u, &v);
+        for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+        {
+          if (lanes & (1 << lane))
+          {
+            hit->source_idx[lane]   = triangle->source_idx;
+            hit->instance_idx[lane] = triangle->instance_idx;
+          }
+        }
+        result |= lanes;
+        if (any_hit)
+        {
+          active &= ~lanes;
+        }
+      }
+    }
+
+    for (u32 order_idx = order_count; order_idx > 0; --order_idx)
+    {
+      u32 slot  = order[order_idx - 1];
+      u32 child = node->child[slot];
+      if (!(child & Bvh_LeafBit))
+      {
+        Assert(stack_count < Bvh_StackSize);
+        stack[stack_count++] = (Bvh_Stack_Entry){ child, enter_t[slot] };
+      }
+    }
+  }
+
+  _mm_storeu_ps(hit->t, t_max);
+  _mm_storeu_ps(hit->u, u);
+  _mm_storeu_ps(hit->v, v);
+  return(result);
+}
+
+static u32
+bvh_intersect_packet(Bvh *bvh, Bvh_Packet *packet, Bvh_Packet_Hit *hit)
+{
+  u32 result = bvh_trace_packet(bvh, packet, false, hit);
+  return(result);
+}
+
+static u32
+bvh_occluded_packet(Bvh *bvh, Bvh_Packet *packet)
+{
+  Bvh_Packet_Hit hit;
+  u32 result = bvh_trace_packet(bvh, packet, true, &hit);
+  return(result);
+}
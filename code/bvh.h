@@ -0,0 +1,135 @@
+#if !defined(BVH_H)
+#define BVH_H
+
+// A bounding volume hierarchy over world space triangles, for ray queries on
+// the CPU (the bakers in tools/, picking).
+//
+// The build bins triangle centroids along each axis and splits where the
+// surface area heuristic is lowest. The top of the tree is split on the
+// calling thread, binning big ranges across the work queue; every range
+// left under the subtree size then builds on its own worker. The result
+// does not depend on the thread count.
+//
+// The binary tree is then collapsed into 4-wide nodes, laid out depth first,
+// with the four child boxes stored per axis so one ray tests all of them in
+// one SSE pass. Leaves hold up to Bvh_MaxLeafTriangles triangles, stored in
+// leaf order next to each other.
+//
+// Packets trace Bvh_PacketSize rays together, one per SSE lane, through the
+// same nodes. They pay off when the rays are coherent (neighbouring pixels,
+// shadow rays toward one light); a packet whose directions do not share a
+// sign on every axis is traced ray by ray.
+
+#define Bvh_BinCount            16
+#define Bvh_MaxLeafTriangles    4
+#define Bvh_Width               4
+#define Bvh_PacketSize          4
+#define Bvh_StackSize           256
+// ranges with fewer triangles are built by one job
+#define Bvh_MinSubtreeTriangles 4096
+// and the top splits aim for about this many of them
+#define Bvh_TargetSubtrees      256
+// ranges at least this big bin across the queue, in chunks this big
+#define Bvh_ParallelTriangles   (1 << 17)
+#define Bvh_ChunkTriangles      (1 << 16)
+
+#define Bvh_LeafBit             0x80000000
+#define Bvh_EmptyChild          0xFFFFFFFF
+
+typedef struct
+{
+  v3f p[3];
+  u32 instance_idx;
+} Bvh_Source_Triangle;
+
+typedef struct
+{
+  v3f min;
+  v3f max;
+} Bvh_Box;
+
+// 128 bytes, two cache lines. Empty slots have inverted boxes, which no ray
+// enters.
+typedef struct
+{
+  f32 min_x[Bvh_Width];
+  f32 min_y[Bvh_Width];
+  f32 min_z[Bvh_Width];
+  f32 max_x[Bvh_Width];
+  f32 max_y[Bvh_Width];
+  f32 max_z[Bvh_Width];
+  // a node index, Bvh_LeafBit | the leaf's first triangle, or Bvh_EmptyChild
+  u32 child[Bvh_Width];
+  u32 leaf_count[Bvh_Width];
+} Bvh_Node;
+
+// precomputed for Moller-Trumbore
+typedef struct
+{
+  v3f v0;
+  v3f e1;
+  v3f e2;
+  // index into the source triangles
+  u32 source_idx;
+  u32 instance_idx;
+} Bvh_Triangle;
+
+typedef struct
+{
+  Bvh_Node     *nodes;
+  u32           node_count;
+  // what nodes was allocated for, a bound worked out before collapsing
+  u32           node_capacity;
+  Bvh_Triangle *triangles;
+  u32           triangle_count;
+  Bvh_Box       bounds;
+} Bvh;
+
+typedef struct
+{
+  f32 t;
+  // barycentrics of p[1] and p[2]
+  f32 u;
+  f32 v;
+  u32 source_idx;
+  u32 instance_idx;
+} Bvh_Hit;
+
+typedef struct
+{
+  f32 origin_x[Bvh_PacketSize];
+  f32 origin_y[Bvh_PacketSize];
+  f32 origin_z[Bvh_PacketSize];
+  f32 dir_x[Bvh_PacketSize];
+  f32 dir_y[Bvh_PacketSize];
+  f32 dir_z[Bvh_PacketSize];
+  f32 t_min[Bvh_PacketSize];
+  f32 t_max[Bvh_PacketSize];
+} Bvh_Packet;
+
+typedef struct
+{
+  f32 t[Bvh_PacketSize];
+  f32 u[Bvh_PacketSize];
+  f32 v[Bvh_PacketSize];
+  u32 source_idx[Bvh_PacketSize];
+  u32 instance_idx[Bvh_PacketSize];
+} Bvh_Packet_Hit;
+
+// the static instances of scene, through the renderer's meshes
+static u32  bvh_scene_triangle_count(Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count]);
+static void bvh_gather_scene(Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count], Bvh_Source_Triangle *dest);
+
+// queue may be 0
+static void bvh_build(Bvh *bvh, Bvh_Source_Triangle *source, u32 triangle_count, OS_Work_Queue *queue);
+static void bvh_free(Bvh *bvh);
+
+// Hits count for t in (t_min, t_max); dir need not be unit length, t is in
+// its units. Triangles are hit from both sides.
+static b32  bvh_intersect(Bvh *bvh, v3f origin, v3f dir, f32 t_min, f32 t_max, Bvh_Hit *hit);
+static b32  bvh_occluded(Bvh *bvh, v3f origin, v3f dir, f32 t_min, f32 t_max);
+// one bit per lane that hit; lanes that missed keep t = t_max
+static u32  bvh_intersect_packet(Bvh *bvh, Bvh_Packet *packet, Bvh_Packet_Hit *hit);
+static u32  bvh_occluded_packet(Bvh *bvh, Bvh_Packet *packet);
+
+#endif
@@ -0,0 +1,282 @@
+static s32
+cone_step_offset_compare(const void *a, const void *b)
+{
+  f32 distance_a = ((Cone_Step_Offset *)a)->distance;
+  f32 distance_b = ((Cone_Step_Offset *)b)->distance;
+  s32 result     = (distance_a > distance_b) - (distance_a < distance_b);
+  return(result);
+}
+
+// Every offset within the widest cone a full depth can hold, nearest first.
+// Distances are in UV units, so non-square maps get an elliptical window.
+static u32
+cone_step_offsets_build(Cone_Step_Map *map, Cone_Step_Offset *offsets, u32 max_offset_count)
+{
+  f32 reach     = ConeStep_MaxRatio * ConeStep_HeightScale;
+  s32 radius_x  = (s32)ceilf(reach * (f32)map->width);
+  s32 radius_y  = (s32)ceilf(reach * (f32)map->height);
+  u32 result    = 0;
+  for (s32 y = -radius_y; y <= radius_y; ++y)
+  {
+    for (s32 x = -radius_x; x <= radius_x; ++x)
+    {
+      f32 u        = (f32)x / (f32)map->width;
+      f32 v        = (f32)y / (f32)map->height;
+      f32 distance = sqrtf(u * u + v * v);
+      if ((x || y) && (distance <= reach) && (result < max_offset_count))
+      {
+        offsets[result++] = (Cone_Step_Offset){ (s16)x, (s16)y, distance };
+      }
+    }
+  }
+
+  qsort(offsets, result, sizeof(Cone_Step_Offset), cone_step_offset_compare);
+  return(result);
+}
+
+static f32
+cone_step_depth_at(Cone_Step_Map *map, s32 x, s32 y)
+{
+  u32 wrapped_x = (u32)(((x % (s32)map->width) + (s32)map->width) % (s32)map->width);
+  u32 wrapped_y = (u32)(((y % (s32)map->height) + (s32)map->height) % (s32)map->height);
+  return(map->depths[(u64)wrapped_y * map->width + wrapped_x]);
+}
+
+// For each texel p, every ray from p's top (depth 0) through another surface
+// point q is followed past q until it leaves the solid. The cone may reach
+// out to that exit point and no further: any wider and the ray could go in
+// and out of the surface before the tracer's binary search brackets it.
+//
+// A ray through q at UV distance r from p gives a ratio of at least
+// r / (depth_p * ConeStep_HeightScale), so once that reaches the best ratio
+// so far the remaining (farther) offsets are skipped.
+static void
+cone_step_bake_rows(Cone_Step_Map *map, Cone_Step_Offset *offsets, u32 offset_count, u32 row_begin, u32 row_end)
+{
+  f32 inv_width  = 1.0f / (f32)map->width;
+  f32 inv_height = 1.0f / (f32)map->height;
+  for (u32 y = row_begin; y < row_end; ++y)
+  {
+    for (u32 x = 0; x < map->width; ++x)
+    {
+      f32 depth = map->depths[(u64)y * map->width + x];
+      f32 reach = depth * ConeStep_HeightScale;
+      f32 best  = ConeStep_MaxRatio;
+      for (u32 offset_idx = 0; offset_idx < offset_count; ++offset_idx)
+      {
+        Cone_Step_Offset *offset = offsets + offset_idx;
+        if (offset->distance >= best * reach)
+        {
+          break;
+        }
+
+        f32 target_depth = cone_step_depth_at(map, (s32)x + offset->x, (s32)y + offset->y);
+        if (target_depth <= 0.0f)
+        {
+          continue;
+        }
+
+        // one texel along the major axis per step
+        f32 major  = (f32)Maximum(abs(offset->x), abs(offset->y));
+        f32 step_x = (f32)offset->x / major;
+        f32 step_y = (f32)offset->y / major;
+        f32 step_z = target_depth / major;
+        f32 ray_x  = (f32)offset->x;
+        f32 ray_y  = (f32)offset->y;
+        f32 ray_z  = target_depth;
+        for (;;)
+        {
+          ray_x += step_x;
+          ray_y += step_y;
+          ray_z += step_z;
+          if (ray_z >= depth)
+          {
+            break;
+          }
+
+          f32 u        = ray_x * inv_width;
+          f32 v        = ray_y * inv_height;
+          f32 distance = sqrtf(u * u + v * v);
+          f32 height   = (depth - ray_z) * ConeStep_HeightScale;
+          if (distance >= best * height)
+          {
+            break;
+          }
+
+          f32 surface_depth = cone_step_depth_at(map, (s32)x + (s32)floorf(ray_x + 0.5f), (s32)y + (s32)floorf(ray_y + 0.5f));
+          if (surface_depth > ray_z)
+          {
+            best = distance / height;
+            break;
+          }
+        }
+      }
+
+      map->ratios[(u64)y * map->width + x] = best;
+    }
+  }
+}
+
+// Rounds down: a slightly narrower cone only costs a step, a wider one can
+// skip a surface.
+static u8
+cone_step_encode_ratio(f32 ratio)
+{
+  f32 encoded = sqrtf(Maximum(ratio, 0.0f) / ConeStep_MaxRatio) * 255.0f;
+  u8 result   = (u8)Minimum(encoded, 255.0f);
+  return(result);
+}
+
+static f32
+cone_step_decode_ratio(f32 encoded)
+{
+  f32 result = encoded * encoded * ConeStep_MaxRatio;
+  return(result);
+}
+
+// Bilinear, wrapping, mip 0 only: r and g of an RG8 texture in [0, 1].
+static void
+cone_step_sample(u8 *texels, u32 width, u32 height, f32 u, f32 v, f32 *r, f32 *g)
+{
+  f32 x  = u * (f32)width - 0.5f;
+  f32 y  = v * (f32)height - 0.5f;
+  f32 fx = floorf(x);
+  f32 fy = floorf(y);
+  f32 tx = x - fx;
+  f32 ty = y - fy;
+
+  s32 x0 = (((s32)fx % (s32)width) + (s32)width) % (s32)width;
+  s32 y0 = (((s32)fy % (s32)height) + (s32)height) % (s32)height;
+  s32 x1 = (x0 + 1) % (s32)width;
+  s32 y1 = (y0 + 1) % (s32)height;
+
+  u8 *a = texels + ((u64)y0 * width + x0) * 2;
+  u8 *b = texels + ((u64)y0 * width + x1) * 2;
+  u8 *c = texels + ((u64)y1 * width + x0) * 2;
+  u8 *d = texels + ((u64)y1 * width + x1) * 2;
+  for (u32 channel = 0; channel < 2; ++channel)
+  {
+    f32 top    = (f32)a[channel] + ((f32)b[channel] - (f32)a[channel]) * tx;
+    f32 bottom = (f32)c[channel] + ((f32)d[channel] - (f32)c[channel]) * tx;
+    f32 value  = (top + (bottom - top) * ty) / 255.0f;
+    if (channel == 0)
+    {
+      *r = value;
+    }
+    else
+    {
+      *g = value;
+    }
+  }
+}
+
+// Step for step the same as parallax_uv2 with N = (0, 0, 1). Note that it
+// picks its sample count from dot(view_dir, -N), which is never positive for
+// a visible surface, so every pixel runs ParallaxLinear_MaxSamples.
+static Cone_Step_Trace
+cone_step_trace_linear(u8 *texels, u32 width, u32 height, f32 u, f32 v, f32 view_x, f32 view_y, f32 view_z)
+{
+  Cone_Step_Trace result = { u, v, 0 };
+
+  f32 facing        = Maximum(-view_z, 0.0f);
+  f32 sample_countf = (f32)ParallaxLinear_MaxSamples + ((f32)ParallaxLinear_MinSamples - (f32)ParallaxLinear_MaxSamples) * facing;
+  u32 sample_count  = (u32)sample_countf;
+
+  f32 depth_step    = 1.0f / sample_countf;
+  f32 step_u        = ((-ConeStep_HeightScale) * view_x / view_z) / sample_countf;
+  f32 step_v        = -(((-ConeStep_HeightScale) * view_y / view_z) / sample_countf);
+
+  f32 current_u = 0.0f, current_v = 0.0f;
+  f32 prev_u = 0.0f, prev_v = 0.0f;
+  f32 current_depth = 1.0f - depth_step;
+  f32 previous_depth = 1.0f;
+  f32 previous_map_depth = 0.0f;
+  for (u32 sample_idx = 0; sample_idx <= sample_count; ++sample_idx)
+  {
+    f32 current_map_depth, cone;
+    cone_step_sample(texels, width, height, u + current_u, v + current_v, &current_map_depth, &cone);
+    ++result.taps;
+
+    if (current_depth < current_map_depth)
+    {
+      f32 t     = (previous_map_depth - previous_depth) / (current_depth - previous_depth - current_map_depth + previous_map_depth);
+      result.u  = u + prev_u + t * step_u;
+      result.v  = v + prev_v + t * step_v;
+      break;
+    }
+
+    prev_u              = current_u;
+    prev_v              = current_v;
+    previous_depth      = current_depth;
+    previous_map_depth  = current_map_depth;
+    current_u          += step_u;
+    current_v          += step_v;
+    current_depth      -= depth_step;
+  }
+
+  return(result);
+}
+
+// Same as parallax_cone_uv: t is the ray's depth, t_outside the deepest
+// point known to be above the surface. gap is the ray's depth below the
+// surface at either end of the bracket, for the closing secant.
+static Cone_Step_Trace
+cone_step_trace_cone(u8 *texels, u32 width, u32 height, f32 u, f32 v, f32 view_x, f32 view_y, f32 view_z)
+{
+  Cone_Step_Trace result = { 0 };
+
+  f32 offset_u  = ((-ConeStep_HeightScale) * view_x) / view_z;
+  f32 offset_v  = -(((-ConeStep_HeightScale) * view_y) / view_z);
+  f32 travel    = sqrtf(view_x * view_x + view_y * view_y) / view_z;
+
+  f32 t           = 0.0f;
+  f32 t_outside   = 0.0f;
+  f32 gap         = 0.0f;
+  f32 gap_outside = 0.0f;
+  b32 inside      = false;
+  for (u32 step_idx = 0; (step_idx < ConeStep_ConeSteps) && !inside; ++step_idx)
+  {
+    f32 map_height, cone;
+    cone_step_sample(texels, width, height, u + t * offset_u, v + t * offset_v, &map_height, &cone);
+    ++result.taps;
+
+    f32 map_depth = 1.0f - map_height;
+    gap           = t - map_depth;
+    inside        = (gap >= 0.0f);
+    if (!inside)
+    {
+      f32 ratio   = cone_step_decode_ratio(cone);
+      t_outside   = t;
+      gap_outside = gap;
+      t           = Minimum(t + ratio * (map_depth - t) / Maximum(travel + ratio, 1e-5f), 1.0f);
+    }
+  }
+
+  if (inside && (t > t_outside))
+  {
+    for (u32 search_idx = 0; search_idx < ConeStep_SearchSteps; ++search_idx)
+    {
+      f32 t_middle = 0.5f * (t_outside + t);
+      f32 map_height, cone;
+      cone_step_sample(texels, width, height, u + t_middle * offset_u, v + t_middle * offset_v, &map_height, &cone);
+      ++result.taps;
+
+      f32 gap_middle = t_middle - (1.0f - map_height);
+      if (gap_middle >= 0.0f)
+      {
+        t   = t_middle;
+        gap = gap_middle;
+      }
+      else
+      {
+        t_outside   = t_middle;
+        gap_outside = gap_middle;
+      }
+    }
+    t = t_outside + (t - t_outside) * (-gap_outside / Maximum(gap - gap_outside, 1e-5f));
+  }
+
+  result.u = u + t * offset_u;
+  result.v = v + t * offset_v;
+  return(result);
+}
@@ -0,0 +1,61 @@
+#if !defined(CONE_STEP_H)
+#define CONE_STEP_H
+
+// Relaxed cone step maps (Policarpo and Oliveira). Every texel stores the
+// widest cone, apexed on its own surface point and opening upwards, that a
+// ray coming from above crosses the surface inside at most once. A tracer
+// can jump straight to the cone boundary and finish with a short binary
+// search, where parallax_uv2 has to march every depth slice.
+//
+// Units follow parallax_uv2: depth runs from 0 (top) to 1 (bottom) and a
+// full depth is ConeStep_HeightScale UV units, so a ratio of 1 is a 45
+// degree cone. Ratios are stored as sqrt(ratio / ConeStep_MaxRatio), which
+// keeps precision for the narrow cones near steep walls.
+//
+// The baked texture (cone_bake) is RG8: r the height parallax_uv2 reads,
+// g the encoded ratio.
+
+#define ConeStep_HeightScale    0.04f
+#define ConeStep_MaxRatio       4.0f
+#define ConeStep_ConeSteps      12
+#define ConeStep_SearchSteps    5
+
+// parallax_uv2's sample counts
+#define ParallaxLinear_MinSamples 8
+#define ParallaxLinear_MaxSamples 48
+
+typedef struct
+{
+  u32  width;
+  u32  height;
+  f32 *depths;
+  f32 *ratios;
+} Cone_Step_Map;
+
+// Search offsets around a texel, nearest first, so the bake can stop as soon
+// as no farther texel can narrow the cone.
+typedef struct
+{
+  s16 x;
+  s16 y;
+  f32 distance;
+} Cone_Step_Offset;
+
+typedef struct
+{
+  f32 u;
+  f32 v;
+  u32 taps;
+} Cone_Step_Trace;
+
+static u32             cone_step_offsets_build(Cone_Step_Map *map, Cone_Step_Offset *offsets, u32 max_offset_count);
+static void            cone_step_bake_rows(Cone_Step_Map *map, Cone_Step_Offset *offsets, u32 offset_count, u32 row_begin, u32 row_end);
+static u8              cone_step_encode_ratio(f32 ratio);
+static f32             cone_step_decode_ratio(f32 encoded);
+
+// CPU mirrors of parallax_uv2 and parallax_cone_uv, sampling mip 0 of an RG8
+// cone texture with bilinear filtering and wrapping.
+static Cone_Step_Trace cone_step_trace_linear(u8 *texels, u32 width, u32 height, f32 u, f32 v, f32 view_x, f32 view_y, f32 view_z);
+static Cone_Step_Trace cone_step_trace_cone(u8 *texels, u32 width, u32 height, f32 u, f32 v, f32 view_x, f32 view_y, f32 view_z);
+
+#endif
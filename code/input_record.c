@@ -0,0 +1,139 @@
+static u32
+input_record_pack_keys(OS_InputFlag *keys)
+{
+  u32 result = 0;
+  for (u32 key = 0; key < OS_KeyType_Count; ++key)
+  {
+    result |= (keys[key] & ((1 << InputRecord_KeyBits) - 1)) << (key * InputRecord_KeyBits);
+  }
+
+  return(result);
+}
+
+static void
+input_record_unpack_keys(u32 key_flags, OS_InputFlag *keys)
+{
+  for (u32 key = 0; key < OS_KeyType_Count; ++key)
+  {
+    keys[key] = (key_flags >> (key * InputRecord_KeyBits)) & ((1 << InputRecord_KeyBits) - 1);
+  }
+}
+
+static Input_Record_Header *
+input_record_parse(void *data, u64 size)
+{
+  Input_Record_Header *result = (Input_Record_Header *)data;
+  if (!data || (size < sizeof(Input_Record_Header)) ||
+      (result->magic != InputRecord_Magic) || (result->version != InputRecord_Version) ||
+      (result->key_count != OS_KeyType_Count) ||
+      (size < sizeof(Input_Record_Header) + (u64)result->frame_count * sizeof(Input_Record_Frame)))
+  {
+    result = 0;
+  }
+
+  return(result);
+}
+
+static void
+input_record_begin(Input_Recorder *recorder, char *filename)
+{
+  Assert(OS_KeyType_Count * InputRecord_KeyBits <= 32);
+
+  *recorder = (Input_Recorder){ 0 };
+  recorder->frames = os_memory_alloc(InputRecord_MaxFrames * sizeof(Input_Record_Frame));
+  if (recorder->frames)
+  {
+    recorder->mode     = InputRecordMode_Record;
+    recorder->filename = filename;
+  }
+}
+
+static b32
+input_replay_begin(Input_Recorder *recorder, char *filename)
+{
+  *recorder = (Input_Recorder){ 0 };
+  recorder->map = os_file_map(filename);
+
+  Input_Record_Header *header = input_record_parse(recorder->map.data, recorder->map.size);
+  if (header)
+  {
+    recorder->mode        = InputRecordMode_Replay;
+    recorder->filename    = filename;
+    recorder->frames      = (Input_Record_Frame *)(header + 1);
+    recorder->frame_count = header->frame_count;
+  }
+  else
+  {
+    os_file_unmap(&recorder->map);
+  }
+
+  return(header != 0);
+}
+
+static b32
+input_record_frame(Input_Recorder *recorder, s32 *cursor_dx, s32 *cursor_dy, f32 *game_update_secs)
+{
+  b32 result = true;
+  if ((recorder->mode == InputRecordMode_Record) && (recorder->frame_count < InputRecord_MaxFrames))
+  {
+    // a cursor can hardly leave the window's middle by more than s16 holds in a frame
+    Input_Record_Frame *frame = recorder->frames + recorder->frame_count++;
+    frame->key_flags        = input_record_pack_keys(g_input_key);
+    frame->cursor_dx        = (s16)Minimum(Maximum(*cursor_dx, -32768), 32767);
+    frame->cursor_dy        = (s16)Minimum(Maximum(*cursor_dy, -32768), 32767);
+    frame->game_update_secs = *game_update_secs;
+    *cursor_dx              = frame->cursor_dx;
+    *cursor_dy              = frame->cursor_dy;
+  }
+  else if (recorder->mode == InputRecordMode_Replay)
+  {
+    result = (recorder->next_frame < recorder->frame_count);
+    if (result)
+    {
+      Input_Record_Frame *frame = recorder->frames + recorder->next_frame++;
+      input_record_unpack_keys(frame->key_flags, g_input_key);
+      *cursor_dx        = frame->cursor_dx;
+      *cursor_dy        = frame->cursor_dy;
+      *game_update_secs = frame->game_update_secs;
+    }
+  }
+
+  return(result);
+}
+
+static b32
+input_record_end(Input_Recorder *recorder)
+{
+  b32 result = true;
+  if (recorder->mode == InputRecordMode_Record)
+  {
+    u64 size = sizeof(Input_Record_Header) + (u64)recorder->frame_count * sizeof(Input_Record_Frame);
+    u8 *file = os_memory_alloc(size);
+    result   = (file != 0);
+    if (result)
+    {
+      Input_Record_Header *header = (Input_Record_Header *)file;
+      header->magic       = InputRecord_Magic;
+      header->version     = InputRecord_Version;
+      header->frame_count = recorder->frame_count;
+      header->key_count   = OS_KeyType_Count;
+
+      Input_Record_Frame *frames = (Input_Record_Frame *)(header + 1);
+      for (u32 frame_idx = 0; frame_idx < recorder->frame_count; ++frame_idx)
+      {
+        frames[frame_idx] = recorder->frames[frame_idx];
+      }
+
+      result = os_file_write_all(recorder->filename, file, size);
+      os_memory_free(file, size);
+    }
+    os_memory_free(recorder->frames, InputRecord_MaxFrames * sizeof(Input_Record_Frame));
+  }
+  else if (recorder->mode == InputRecordMode_Replay)
+  {
+    os_file_unmap(&recorder->map);
+  }
+
+  *recorder = (Input_Recorder){ 0 };
+  return(result);
+}
@@ -0,0 +1,76 @@
+#if !defined(INPUT_RECORD_H)
+#define INPUT_RECORD_H
+
+// Records what the game reads from the platform every frame, so a run can be
+// played back exactly: the key flags os_input_fill_events leaves in
+// g_input_key, how far the cursor moved while roaming and the step the game
+// advanced by. On playback the recorded frame replaces the live one at the
+// same point in the loop, so everything after it, camera and lights and all,
+// runs the same frames again. Paired with a fixed step this makes benchmark
+// runs repeatable across machines and builds.
+//
+// Layout of a file:
+//   Input_Record_Header
+//   Input_Record_Frame[frame_count]
+
+#define InputRecord_Magic       0x50524E49 // "INRP"
+#define InputRecord_Version     1
+// an hour at 60 Hz; recording stops there
+#define InputRecord_MaxFrames   (60 * 60 * 60)
+// bits of key flags per key
+#define InputRecord_KeyBits     4
+// the step a fixed step run advances by, whatever the display
+#define InputRecord_FixedStep   (1.0f / 60.0f)
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 frame_count;
+  // OS_KeyType_Count when recorded
+  u32 key_count;
+} Input_Record_Header;
+
+// 12 bytes a frame
+typedef struct
+{
+  u32 key_flags;
+  s16 cursor_dx;
+  s16 cursor_dy;
+  f32 game_update_secs;
+} Input_Record_Frame;
+
+typedef u32 Input_Record_Mode;
+enum
+{
+  InputRecordMode_Off,
+  InputRecordMode_Record,
+  InputRecordMode_Replay,
+};
+
+typedef struct
+{
+  Input_Record_Mode   mode;
+  char               *filename;
+  // os_memory_alloc'd while recording, the mapped file while replaying
+  Input_Record_Frame *frames;
+  u32                 frame_count;
+  u32                 next_frame;
+  OS_File_Map         map;
+} Input_Recorder;
+
+static u32  input_record_pack_keys(OS_InputFlag *keys);
+static void input_record_unpack_keys(u32 key_flags, OS_InputFlag *keys);
+// 0 unless data holds a whole recording from this build's key set
+static Input_Record_Header *input_record_parse(void *data, u64 size);
+static void input_record_begin(Input_Recorder *recorder, char *filename);
+// false, leaving the recorder off, if filename holds no recording
+static b32  input_replay_begin(Input_Recorder *recorder, char *filename);
+// Called once a frame after os_input_fill_events. Recording, it keeps
+// g_input_key and the arguments as they are; replaying, it overwrites them
+// with the next recorded frame, and returns false once there are none left.
+static b32  input_record_frame(Input_Recorder *recorder, s32 *cursor_dx, s32 *cursor_dy, f32 *game_update_secs);
+// Writes out a recording and closes a replay. false if the write failed.
+static b32  input_record_end(Input_Recorder *recorder);
+
+#endif
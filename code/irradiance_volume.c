@@ -0,0 +1,481 @@
+static void
+irradiance_sh9_basis(v3f dir, f32 *basis)
+{
+  basis[0] = 0.282095f;
+  basis[1] = 0.488603f * dir.y;
+  basis[2] = 0.488603f * dir.z;
+  basis[3] = 0.488603f * dir.x;
+  basis[4] = 1.092548f * dir.x * dir.y;
+  basis[5] = 1.092548f * dir.y * dir.z;
+  basis[6] = 0.315392f * (3.0f * dir.z * dir.z - 1.0f);
+  basis[7] = 1.092548f * dir.x * dir.z;
+  basis[8] = 0.546274f * (dir.x * dir.x - dir.y * dir.y);
+}
+
+// irradiance_sh9_basis for four directions, one per lane
+static void
+irradiance_sh9_basis_4(__m128 x, __m128 y, __m128 z, __m128 *basis)
+{
+  __m128 k1 = _mm_set1_ps(0.488603f);
+  __m128 k2 = _mm_set1_ps(1.092548f);
+  basis[0] = _mm_set1_ps(0.282095f);
+  basis[1] = _mm_mul_ps(k1, y);
+  basis[2] = _mm_mul_ps(k1, z);
+  basis[3] = _mm_mul_ps(k1, x);
+  basis[4] = _mm_mul_ps(k2, _mm_mul_ps(x, y));
+  basis[5] = _mm_mul_ps(k2, _mm_mul_ps(y, z));
+  basis[6] = _mm_mul_ps(_mm_set1_ps(0.315392f), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(z, z)), _mm_set1_ps(1.0f)));
+  basis[7] = _mm_mul_ps(k2, _mm_mul_ps(x, z));
+  basis[8] = _mm_mul_ps(_mm_set1_ps(0.546274f), _mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+}
+
+// A spherical Fibonacci set: equal area bands in z, each turned by the
+// golden angle. Its neighbours in index are neighbours on the sphere, and a
+// stable sort by octant keeps most runs of four inside one.
+static void
+irradiance_sphere_directions(v3f *dirs, u32 count)
+{
+  Assert(count <= IrradianceVolume_MaxSamples);
+  v3f spiral[IrradianceVolume_MaxSamples];
+  u32 octants[IrradianceVolume_MaxSamples];
+  u32 octant_first[8] = { 0 };
+  f32 golden_angle    = PIF32 * (3.0f - sqrtf(5.0f));
+  for (u32 dir_idx = 0; dir_idx < count; ++dir_idx)
+  {
+    f32 z      = 1.0f - (2.0f * (f32)dir_idx + 1.0f) / (f32)count;
+    f32 radius = sqrtf(Maximum(1.0f - z * z, 0.0f));
+    f32 phi    = golden_angle * (f32)dir_idx;
+    spiral[dir_idx]  = (v3f){ radius * cosf(phi), radius * sinf(phi), z };
+    octants[dir_idx] = (spiral[dir_idx].x < 0.0f) | ((spiral[dir_idx].y < 0.0f) << 1) | ((spiral[dir_idx].z < 0.0f) << 2);
+    ++octant_first[octants[dir_idx]];
+  }
+
+  u32 running = 0;
+  for (u32 octant = 0; octant < 8; ++octant)
+  {
+    u32 octant_count     = octant_first[octant];
+    octant_first[octant] = running;
+    running             += octant_count;
+  }
+
+  for (u32 dir_idx = 0; dir_idx < count; ++dir_idx)
+  {
+    dirs[octant_first[octants[dir_idx]]++] = spiral[dir_idx];
+  }
+}
+
+static void
+irradiance_sh_project(v3f *dirs, v3f *radiance, u32 count, Irradiance_SH *sh)
+{
+  Assert((count % 4) == 0);
+  __m128 sums[IrradianceVolume_Coefficients * 3];
+  for (u32 sum_idx = 0; sum_idx < ArrayCount(sums); ++sum_idx)
+  {
+    sums[sum_idx] = _mm_setzero_ps();
+  }
+
+  for (u32 first = 0; first < count; first += 4)
+  {
+    v3f   *d = dirs + first;
+    v3f   *r = radiance + first;
+    __m128 basis[IrradianceVolume_Coefficients];
+    irradiance_sh9_basis_4(_mm_setr_ps(d[0].x, d[1].x, d[2].x, d[3].x), _mm_setr_ps(d[0].y, d[1].y, d[2].y, d[3].y),
+                           _mm_setr_ps(d[0].z, d[1].z, d[2].z, d[3].z), basis);
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      __m128 value = _mm_setr_ps(r[0].v[channel], r[1].v[channel], r[2].v[channel], r[3].v[channel]);
+      for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+      {
+        sums[coefficient * 3 + channel] = _mm_add_ps(sums[coefficient * 3 + channel], _mm_mul_ps(basis[coefficient], value));
+      }
+    }
+  }
+
+  // every direction stands for an equal share of the sphere
+  f32 weight = 4.0f * PIF32 / (f32)count;
+  for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+  {
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      f32 lanes[4];
+      _mm_storeu_ps(lanes, sums[coefficient * 3 + channel]);
+      sh->c[coefficient].v[channel] = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) * weight;
+    }
+  }
+}
+
+// The clamped cosine's bands are pi, 2pi/3 and pi/4 (Ramamoorthi and
+// Hanrahan); over pi, since ps_main wants the mean and not the integral.
+static void
+irradiance_sh_convolve(Irradiance_SH *sh)
+{
+  f32 band_scale[IrradianceVolume_Coefficients] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+  for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+  {
+    sh->c[coefficient] = v3f_scale(band_scale[coefficient], sh->c[coefficient]);
+  }
+}
+
+static v3f
+irradiance_sh_evaluate(Irradiance_SH *sh, v3f normal)
+{
+  f32 basis[IrradianceVolume_Coefficients];
+  irradiance_sh9_basis(normal, basis);
+  v3f result = v3f_zero();
+  for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+  {
+    result = v3f_add(result, v3f_scale(basis[coefficient], sh->c[coefficient]));
+  }
+
+  return(result);
+}
+
+// lightmap_pack_f16 with the sign kept
+static u16
+irradiance_pack_f16(f32 value)
+{
+  u32 sign    = (value < 0.0f) ? 0x8000 : 0;
+  f32 clamped = Minimum(fabsf(value), 65504.0f);
+  u32 result  = 0;
+  if (clamped >= ldexpf(1.0f, -14))
+  {
+    s32 exponent = 0;
+    f32 mantissa = frexpf(clamped, &exponent);
+    result = ((u32)(exponent + 14) << 10) + (u32)floorf((2.0f * mantissa - 1.0f) * 1024.0f + 0.5f);
+  }
+  else
+  {
+    result = (u32)floorf(clamped * ldexpf(1.0f, 24) + 0.5f);
+  }
+
+  return((u16)(sign | result));
+}
+
+static f32
+irradiance_unpack_f16(u16 packed)
+{
+  u32 exponent = (packed >> 10) & 0x1F;
+  u32 mantissa = packed & 0x3FF;
+  f32 result   = exponent ? ldexpf(1.0f + (f32)mantissa / 1024.0f, (s32)exponent - 15) : ldexpf((f32)mantissa, -24);
+  return((packed & 0x8000) ? -result : result);
+}
+
+// Centred on bounds. A side that would need more than the cap spreads the
+// probes further apart instead, the same on every axis.
+static void
+irradiance_volume_grid(Irradiance_Grid *grid, Bvh_Box bounds, f32 spacing)
+{
+  v3f extent = v3f_sub(bounds.max, bounds.min);
+  f32 widest = Maximum(extent.x, Maximum(extent.y, extent.z));
+  spacing    = Maximum(spacing, widest / (f32)(IrradianceVolume_MaxProbesAxis - 1));
+
+  u32 counts[3];
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    counts[axis] = (u32)ceilf(Maximum(extent.v[axis], 0.0f) / spacing) + 1;
+    counts[axis] = Minimum(counts[axis], IrradianceVolume_MaxProbesAxis);
+  }
+
+  v3f centre = v3f_scale(0.5f, v3f_add(bounds.min, bounds.max));
+  *grid = (Irradiance_Grid)
+  {
+    .origin        = v3f_sub(centre, v3f_scale(0.5f * spacing, (v3f){ (f32)(counts[0] - 1), (f32)(counts[1] - 1), (f32)(counts[2] - 1) })),
+    .spacing       = spacing,
+    .probe_count_x = counts[0],
+    .probe_count_y = counts[1],
+    .probe_count_z = counts[2],
+    .probe_count   = counts[0] * counts[1] * counts[2],
+  };
+}
+
+static v3f
+irradiance_albedo(Irradiance_Bake *bake, u32 instance_idx)
+{
+  Model_Instance *instance = bake->scene->ins + instance_idx;
+  Material_Type   material = bake->scene->info[instance_idx].material;
+  v3f result = { instance->colour.r, instance->colour.g, instance->colour.b };
+  if (material != MaterialType_None)
+  {
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      result.v[channel] *= bake->material_albedo[material].v[channel];
+    }
+  }
+
+  return(result);
+}
+
+// what the jobs share; next_probe hands them out
+typedef struct
+{
+  Irradiance_Bake *bake;
+  Irradiance_Grid *grid;
+  Irradiance_SH   *probes;
+  // 1 where a probe sees mostly front faces
+  u8              *valid;
+  v3f              dirs[IrradianceVolume_MaxSamples];
+  volatile u64     next_probe;
+} Irradiance_Jobs;
+
+// One probe, a packet at a time. The shadow rays of a packet's hits all head
+// toward the light, so they go out as a packet too.
+static void
+irradiance_bake_probe(Irradiance_Jobs *jobs, u32 probe_idx)
+{
+  Irradiance_Bake *bake = jobs->bake;
+  Irradiance_Grid *grid = jobs->grid;
+  u32 x = probe_idx % grid->probe_count_x;
+  u32 y = (probe_idx / grid->probe_count_x) % grid->probe_count_y;
+  u32 z = probe_idx / (grid->probe_count_x * grid->probe_count_y);
+  v3f p = v3f_add(grid->origin, v3f_scale(grid->spacing, (v3f){ (f32)x, (f32)y, (f32)z }));
+  v3f L = v3f_normalized(bake->light.dir);
+
+  v3f radiance[IrradianceVolume_MaxSamples];
+  u32 backfaces = 0;
+  for (u32 first = 0; first < bake->sample_count; first += Bvh_PacketSize)
+  {
+    Bvh_Packet packet;
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      v3f dir = jobs->dirs[first + lane];
+      packet.origin_x[lane] = p.x;
+      packet.origin_y[lane] = p.y;
+      packet.origin_z[lane] = p.z;
+      packet.dir_x[lane]    = dir.x;
+      packet.dir_y[lane]    = dir.y;
+      packet.dir_z[lane]    = dir.z;
+      packet.t_min[lane]    = 0.0f;
+      packet.t_max[lane]    = 1e30f;
+    }
+
+    Bvh_Packet_Hit hit;
+    u32 hits = bvh_intersect_packet(bake->bvh, &packet, &hit);
+
+    Bvh_Packet shadow;
+    v3f normals[Bvh_PacketSize];
+    u32 shadow_lanes = 0;
+    u32 first_shadow = Bvh_PacketSize;
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      v3f dir = jobs->dirs[first + lane];
+      radiance[first + lane] = bake->sky;
+      if (hits & (1 << lane))
+      {
+        Bvh_Source_Triangle *triangle = bake->triangles + hit.source_idx[lane];
+        // the meshes wind clockwise, front faces toward the viewer
+        normals[lane] = v3f_normalized(v3f_cross(v3f_sub(triangle->p[2], triangle->p[0]), v3f_sub(triangle->p[1], triangle->p[0])));
+        radiance[first + lane] = v3f_zero();
+        if (v3f_inner(normals[lane], dir) > 0.0f)
+        {
+          ++backfaces;
+        }
+        else if (bake->scene->ins[hit.instance_idx[lane]].enable_lighting && (v3f_inner(normals[lane], L) < 0.0f))
+        {
+          v3f hit_p  = v3f_add(p, v3f_scale(hit.t[lane], dir));
+          v3f origin = v3f_add(hit_p, v3f_scale(IrradianceVolume_RayEpsilon, normals[lane]));
+          shadow.origin_x[lane] = origin.x;
+          shadow.origin_y[lane] = origin.y;
+          shadow.origin_z[lane] = origin.z;
+          shadow.dir_x[lane]    = -L.x;
+          shadow.dir_y[lane]    = -L.y;
+          shadow.dir_z[lane]    = -L.z;
+          shadow.t_min[lane]    = 0.0f;
+          shadow.t_max[lane]    = bake->scene->ins[hit.instance_idx[lane]].receives_shadow ? 1e30f : 0.0f;
+          shadow_lanes         |= 1 << lane;
+          first_shadow          = Minimum(first_shadow, lane);
+        }
+      }
+    }
+
+    u32 occluded = 0;
+    if (shadow_lanes)
+    {
+      // lanes with no shadow ray repeat one that has and are not read
+      for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+      {
+        if (!(shadow_lanes & (1 << lane)))
+        {
+          shadow.origin_x[lane] = shadow.origin_x[first_shadow];
+          shadow.origin_y[lane] = shadow.origin_y[first_shadow];
+          shadow.origin_z[lane] = shadow.origin_z[first_shadow];
+          shadow.dir_x[lane]    = shadow.dir_x[first_shadow];
+          shadow.dir_y[lane]    = shadow.dir_y[first_shadow];
+          shadow.dir_z[lane]    = shadow.dir_z[first_shadow];
+          shadow.t_min[lane]    = shadow.t_min[first_shadow];
+          shadow.t_max[lane]    = shadow.t_max[first_shadow];
+        }
+      }
+      occluded = bvh_occluded_packet(bake->bvh, &shadow) & shadow_lanes;
+    }
+
+    // ps_main's diffuse: ambient plus the light, both saturated
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      v3f dir = jobs->dirs[first + lane];
+      if ((hits & (1 << lane)) && (v3f_inner(normals[lane], dir) <= 0.0f))
+      {
+        Model_Instance *instance = bake->scene->ins + hit.instance_idx[lane];
+        v3f albedo  = irradiance_albedo(bake, hit.instance_idx[lane]);
+        f32 n_dot_l = Maximum(-v3f_inner(normals[lane], L), 0.0f);
+        f32 shadow_multiplier = (occluded & (1 << lane)) ? 0.4f : 1.0f;
+        for (u32 channel = 0; channel < 3; ++channel)
+        {
+          f32 lit = instance->enable_lighting ? Minimum(bake->light.intensity.v[channel] * n_dot_l * albedo.v[channel] * shadow_multiplier, 1.0f) : albedo.v[channel];
+          radiance[first + lane].v[channel] = Minimum(0.1f * albedo.v[channel] + lit, 1.0f);
+        }
+      }
+    }
+  }
+
+  irradiance_sh_project(jobs->dirs, radiance, bake->sample_count, jobs->probes + probe_idx);
+  irradiance_sh_convolve(jobs->probes + probe_idx);
+  jobs->valid[probe_idx] = ((f32)backfaces <= IrradianceVolume_MaxBackfaces * (f32)bake->sample_count);
+}
+
+static void
+irradiance_probe_job(void *data)
+{
+  Irradiance_Jobs *jobs = (Irradiance_Jobs *)data;
+  for (u64 probe_idx = AtomicAddU64(&jobs->next_probe, 1); probe_idx < jobs->grid->probe_count;
+       probe_idx = AtomicAddU64(&jobs->next_probe, 1))
+  {
+    irradiance_bake_probe(jobs, (u32)probe_idx);
+  }
+}
+
+// As lightmap_dilate, on the grid: an invalid probe takes the mean of the
+// neighbours along the axes that were valid before this pass. valid is 1
+// for baked probes and pass + 2 for those a pass filled.
+static void
+irradiance_fill_invalid(Irradiance_Grid *grid, Irradiance_SH *probes, u8 *valid)
+{
+  s32 counts[3] = { (s32)grid->probe_count_x, (s32)grid->probe_count_y, (s32)grid->probe_count_z };
+  u32 filled = 1;
+  for (u32 pass = 0; filled && (pass < 250); ++pass)
+  {
+    filled = 0;
+    for (u32 probe_idx = 0; probe_idx < grid->probe_count; ++probe_idx)
+    {
+      if (valid[probe_idx])
+      {
+        continue;
+      }
+
+      s32 cell[3] = { (s32)(probe_idx % grid->probe_count_x), (s32)((probe_idx / grid->probe_count_x) % grid->probe_count_y),
+                      (s32)(probe_idx / (grid->probe_count_x * grid->probe_count_y)) };
+      Irradiance_SH sum = { 0 };
+      u32 count = 0;
+      for (u32 neighbour = 0; neighbour < 6; ++neighbour)
+      {
+        s32 at[3] = { cell[0], cell[1], cell[2] };
+        at[neighbour / 2] += (neighbour & 1) ? 1 : -1;
+        if ((at[neighbour / 2] < 0) || (at[neighbour / 2] >= counts[neighbour / 2]))
+        {
+          continue;
+        }
+
+        u32 neighbour_idx = ((u32)at[2] * grid->probe_count_y + (u32)at[1]) * grid->probe_count_x + (u32)at[0];
+        if (valid[neighbour_idx] && (valid[neighbour_idx] != pass + 2))
+        {
+          for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+          {
+            sum.c[coefficient] = v3f_add(sum.c[coefficient], probes[neighbour_idx].c[coefficient]);
+          }
+          ++count;
+        }
+      }
+
+      if (count)
+      {
+        for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+        {
+          probes[probe_idx].c[coefficient] = v3f_scale(1.0f / (f32)count, sum.c[coefficient]);
+        }
+        valid[probe_idx] = (u8)(pass + 2);
+        ++filled;
+      }
+    }
+  }
+}
+
+static void
+irradiance_volume_bake(Irradiance_Bake *bake, Irradiance_Grid *grid, Irradiance_SH *probes, OS_Work_Queue *queue)
+{
+  Assert((bake->sample_count > 0) && (bake->sample_count <= IrradianceVolume_MaxSamples) && ((bake->sample_count % Bvh_PacketSize) == 0));
+  Irradiance_Jobs *jobs = (Irradiance_Jobs *)os_memory_alloc(sizeof(Irradiance_Jobs));
+  jobs->bake       = bake;
+  jobs->grid       = grid;
+  jobs->probes     = probes;
+  jobs->valid      = (u8 *)os_memory_alloc(grid->probe_count);
+  jobs->next_probe = 0;
+  irradiance_sphere_directions(jobs->dirs, bake->sample_count);
+
+  if (queue)
+  {
+    for (u32 job_idx = 0; job_idx < IrradianceVolume_JobCount; ++job_idx)
+    {
+      os_work_queue_add(queue, irradiance_probe_job, jobs);
+    }
+    os_work_queue_complete_all(queue);
+  }
+  else
+  {
+    irradiance_probe_job(jobs);
+  }
+
+  irradiance_fill_invalid(grid, probes, jobs->valid);
+  os_memory_free(jobs->valid, grid->probe_count);
+  os_memory_free(jobs, sizeof(Irradiance_Jobs));
+}
+
+static u64
+irradiance_volume_file_size(Irradiance_Grid *grid)
+{
+  u64 result = sizeof(Irradiance_Volume_Header) + (u64)grid->probe_count * IrradianceVolume_ProbeHalves * sizeof(u16);
+  return(result);
+}
+
+static void
+irradiance_volume_encode(u8 *dest, Irradiance_Grid *grid, Irradiance_SH *probes)
+{
+  Irradiance_Volume_Header *header = (Irradiance_Volume_Header *)dest;
+  *header = (Irradiance_Volume_Header)
+  {
+    .magic         = IrradianceVolume_Magic,
+    .version       = IrradianceVolume_Version,
+    .probe_count_x = grid->probe_count_x,
+    .probe_count_y = grid->probe_count_y,
+    .probe_count_z = grid->probe_count_z,
+    .origin        = grid->origin,
+    .spacing       = grid->spacing,
+  };
+
+  u16 *packed = (u16 *)(header + 1);
+  for (u32 probe_idx = 0; probe_idx < grid->probe_count; ++probe_idx)
+  {
+    u16 *probe = packed + (u64)probe_idx * IrradianceVolume_ProbeHalves;
+    for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+    {
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        probe[coefficient * 3 + channel] = irradiance_pack_f16(probes[probe_idx].c[coefficient].v[channel]);
+      }
+    }
+    probe[IrradianceVolume_ProbeHalves - 1] = 0;
+  }
+}
+
+static Irradiance_Volume_Header *
+irradiance_volume_parse(u8 *data, u64 size)
+{
+  Irradiance_Volume_Header *result = (Irradiance_Volume_Header *)data;
+  b32 valid = data && (size >= sizeof(Irradiance_Volume_Header)) &&
+              (result->magic == IrradianceVolume_Magic) && (result->version == IrradianceVolume_Version) &&
+              (result->probe_count_x - 1 < IrradianceVolume_MaxProbesAxis) &&
+              (result->probe_count_y - 1 < IrradianceVolume_MaxProbesAxis) &&
+              (result->probe_count_z - 1 < IrradianceVolume_MaxProbesAxis) &&
+              (result->spacing > 0.0f) &&
+              (size >= sizeof(Irradiance_Volume_Header) +
+                       (u64)result->probe_count_x * result->probe_count_y * result->probe_count_z * IrradianceVolume_ProbeHalves * sizeof(u16));
+  return(valid ? result : 0);
+}
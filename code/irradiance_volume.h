@@ -0,0 +1,115 @@
+#if !defined(IRRADIANCE_VOLUME_H)
+#define IRRADIANCE_VOLUME_H
+
+// An irradiance volume: probes on a regular grid over the static scene, baked
+// offline by tools/irradiance_bake.c. Each one holds the light arriving at
+// its point as order 2 spherical harmonics (9 coefficients per channel), so
+// ps_main can light a surface it has no lightmap for (lightmap.h) with the
+// scene around it instead of a flat ambient. It interpolates the 8 probes
+// around a pixel trilinearly and evaluates them at the normal.
+//
+// A bake traces sample_count directions from every probe against the BVH
+// (bvh.h), four at a time as packets, and shades what they hit the way
+// ps_main shades it: ambient plus the directional light's diffuse term,
+// darkened to 0.4 in shadow. Misses return sky. The radiance is projected
+// onto the basis and convolved with the clamped cosine, which leaves the
+// cosine weighted mean radiance around a normal: the value ps_main
+// multiplies the albedo by. A probe whose rays mostly hit back
+// faces sits inside geometry; it takes the mean of its valid neighbours.
+//
+// Coefficients are stored as halves, 27 per probe padded to 28 so a probe is
+// seven RGBA16F texels: coefficient k of channel c is value 3 * k + c.
+//
+// Layout of a file:
+//   Irradiance_Volume_Header
+//   u16 coefficients[probe_count * IrradianceVolume_ProbeHalves]
+//   probes run x fastest, then y, then z
+
+#define IrradianceVolume_Magic          0x56525249 // "IRRV"
+#define IrradianceVolume_Version        1
+// relative to data/
+#define IrradianceVolume_DefaultPath    "irradiance_volume.irv"
+#define IrradianceVolume_Coefficients   9
+#define IrradianceVolume_ProbeHalves    28
+#define IrradianceVolume_ProbeTexels    (IrradianceVolume_ProbeHalves / 4)
+// world units between probes; the blocks are Scene_BlockWidth wide
+#define IrradianceVolume_ProbeSpacing   4.0f
+#define IrradianceVolume_MaxProbesAxis  64
+#define IrradianceVolume_MaxSamples     4096
+// a probe seeing more back faces than this is inside something
+#define IrradianceVolume_MaxBackfaces   0.25f
+// ray origins are pushed this far off a surface before tracing on
+#define IrradianceVolume_RayEpsilon     1e-3f
+// jobs that pull probes until none are left
+#define IrradianceVolume_JobCount       64
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 probe_count_x;
+  u32 probe_count_y;
+  u32 probe_count_z;
+  u32 _pad_a[3];
+  // the first probe, and the distance to its neighbours along every axis
+  v3f origin;
+  f32 spacing;
+} Irradiance_Volume_Header;
+
+// per channel, in the order of irradiance_sh9_basis
+typedef struct
+{
+  v3f c[IrradianceVolume_Coefficients];
+} Irradiance_SH;
+
+typedef struct
+{
+  v3f origin;
+  f32 spacing;
+  u32 probe_count_x;
+  u32 probe_count_y;
+  u32 probe_count_z;
+  u32 probe_count;
+} Irradiance_Grid;
+
+// What a bake sees: the static part of scene through the BVH built from it,
+// with albedos as in Lightmap_Bake. Rays that leave the scene return sky.
+typedef struct
+{
+  Scene_Instances     *scene;
+  Bvh                 *bvh;
+  // what bvh was built from, for the normals at hits
+  Bvh_Source_Triangle *triangles;
+  // directional
+  Light                light;
+  v3f                  material_albedo[MaterialType_Count];
+  v3f                  sky;
+  // at most IrradianceVolume_MaxSamples
+  u32                  sample_count;
+} Irradiance_Bake;
+
+// the 9 real spherical harmonics of bands 0 to 2 at a unit direction
+static void                      irradiance_sh9_basis(v3f dir, f32 *basis);
+// count directions spread evenly over the sphere, grouped by octant so four
+// in a row trace as one coherent packet
+static void                      irradiance_sphere_directions(v3f *dirs, u32 count);
+// Radiance seen along dirs (evenly spread, as above) onto the basis; count
+// is a multiple of 4.
+static void                      irradiance_sh_project(v3f *dirs, v3f *radiance, u32 count, Irradiance_SH *sh);
+// radiance to cosine weighted mean radiance, in place
+static void                      irradiance_sh_convolve(Irradiance_SH *sh);
+static v3f                       irradiance_sh_evaluate(Irradiance_SH *sh, v3f normal);
+// signed halves, to the nearest
+static u16                       irradiance_pack_f16(f32 value);
+static f32                       irradiance_unpack_f16(u16 packed);
+// probes spacing apart covering bounds, clamped to IrradianceVolume_MaxProbesAxis
+static void                      irradiance_volume_grid(Irradiance_Grid *grid, Bvh_Box bounds, f32 spacing);
+// Fills probes (grid->probe_count); queue may be 0. The result does not
+// depend on the thread count.
+static void                      irradiance_volume_bake(Irradiance_Bake *bake, Irradiance_Grid *grid, Irradiance_SH *probes, OS_Work_Queue *queue);
+static u64                       irradiance_volume_file_size(Irradiance_Grid *grid);
+static void                      irradiance_volume_encode(u8 *dest, Irradiance_Grid *grid, Irradiance_SH *probes);
+// Validates a file in place; returns 0 if it is not one.
+static Irradiance_Volume_Header *irradiance_volume_parse(u8 *data, u64 size);
+
+#endif
@@ -0,0 +1,330 @@
+static void
+light_cluster_grid_alloc(Light_Cluster_Grid *grid)
+{
+  grid->bounds        = os_memory_alloc(MaxLightCount * sizeof(Light_Cluster_Bounds));
+  grid->slice_entries = os_memory_alloc(LightCluster_Slices * MaxLightCount * sizeof(Light_Cluster_Slice_Entry));
+  grid->indices       = os_memory_alloc(LightCluster_MaxIndices * sizeof(u32));
+}
+
+static void
+light_cluster_set_camera(Light_Cluster_Grid *grid, m44 world_to_view, f32 tan_half_fov_x, f32 tan_half_fov_y,
+                         f32 near_plane, f32 far_plane)
+{
+  grid->world_to_view  = world_to_view;
+  grid->tan_half_fov_x = tan_half_fov_x;
+  grid->tan_half_fov_y = tan_half_fov_y;
+  grid->near_plane     = near_plane;
+  grid->far_plane      = far_plane;
+  grid->z_scale        = (f32)LightCluster_Slices / logf(far_plane / near_plane);
+  grid->z_bias         = -logf(near_plane) * grid->z_scale;
+}
+
+// Spot cones wider than 90 degrees are bounded around the disc at their
+// base, narrower ones by the sphere through the apex and the base rim.
+static Sphere
+light_cluster_light_sphere(Light *light)
+{
+  Sphere result = { light->P, light->range };
+  if (light->type == LightType_Spot)
+  {
+    v3f dir       = v3f_normalized(light->dir);
+    f32 cos_angle = light->spot_cos_outer;
+    if (cos_angle < 0.70710678f)
+    {
+      result.center = v3f_add(light->P, v3f_scale(light->range * cos_angle, dir));
+      result.radius = light->range * sqrtf(1.0f - cos_angle * cos_angle);
+    }
+    else
+    {
+      f32 half_extent = light->range / (2.0f * cos_angle);
+      result.center   = v3f_add(light->P, v3f_scale(half_extent, dir));
+      result.radius   = half_extent;
+    }
+  }
+
+  return(result);
+}
+
+static u32
+light_cluster_tile_of(f32 ndc, u32 tile_count)
+{
+  s32 tile   = (s32)floorf((ndc * 0.5f + 0.5f) * (f32)tile_count);
+  u32 result = (u32)Maximum(tile, 0);
+  result     = (result < tile_count) ? result : (tile_count - 1);
+  return(result);
+}
+
+static u32
+light_cluster_slice_of(Light_Cluster_Grid *grid, f32 view_z)
+{
+  s32 slice  = (s32)floorf(logf(Maximum(view_z, grid->near_plane)) * grid->z_scale + grid->z_bias);
+  u32 result = (u32)Maximum(slice, 0);
+  result     = (result < LightCluster_Slices) ? result : (LightCluster_Slices - 1);
+  return(result);
+}
+
+// The cluster ps_main picks for a point in view space. Tile rows count down
+// from the top of the screen as SV_Position does.
+static u32
+light_cluster_index_of(Light_Cluster_Grid *grid, v3f view_p)
+{
+  u32 x      = light_cluster_tile_of(view_p.x / (view_p.z * grid->tan_half_fov_x), LightCluster_TilesX);
+  u32 y      = (LightCluster_TilesY - 1) - light_cluster_tile_of(view_p.y / (view_p.z * grid->tan_half_fov_y), LightCluster_TilesY);
+  u32 z      = light_cluster_slice_of(grid, view_p.z);
+  u32 result = (z * LightCluster_TilesY + y) * LightCluster_TilesX + x;
+  return(result);
+}
+
+// The range of x/z (or y/z) a circle covers seen from the origin, from its
+// two tangent lines. Returns false when a tangent runs behind the eye, in
+// which case the circle spans the whole axis.
+static b32
+light_cluster_slope_range(f32 center_a, f32 center_z, f32 radius, f32 *min_slope, f32 *max_slope)
+{
+  b32 result      = false;
+  f32 distance_sq = center_a * center_a + center_z * center_z;
+  if (distance_sq > radius * radius)
+  {
+    f32 tangent  = sqrtf(distance_sq - radius * radius);
+    f32 denom_a  = center_a * radius + center_z * tangent;
+    f32 denom_b  = center_z * tangent - center_a * radius;
+    if ((denom_a > 0.0f) && (denom_b > 0.0f))
+    {
+      f32 slope_a = (center_a * tangent - center_z * radius) / denom_a;
+      f32 slope_b = (center_a * tangent + center_z * radius) / denom_b;
+      *min_slope  = Minimum(slope_a, slope_b);
+      *max_slope  = Maximum(slope_a, slope_b);
+      result      = true;
+    }
+  }
+
+  return(result);
+}
+
+// The tiles a sphere covers. Returns false when it is outside the frustum's
+// sides.
+static b32
+light_cluster_tiles_of(Light_Cluster_Grid *grid, v3f view_p, f32 radius, u8 *min_x, u8 *max_x, u8 *min_y, u8 *max_y)
+{
+  f32 left   = -1.0f, right = 1.0f;
+  f32 bottom = -1.0f, top   = 1.0f;
+  if (light_cluster_slope_range(view_p.x, view_p.z, radius, &left, &right))
+  {
+    left  /= grid->tan_half_fov_x;
+    right /= grid->tan_half_fov_x;
+  }
+
+  if (light_cluster_slope_range(view_p.y, view_p.z, radius, &bottom, &top))
+  {
+    bottom /= grid->tan_half_fov_y;
+    top    /= grid->tan_half_fov_y;
+  }
+
+  b32 result = (right >= -1.0f) && (left <= 1.0f) && (top >= -1.0f) && (bottom <= 1.0f);
+  *min_x = (u8)light_cluster_tile_of(left, LightCluster_TilesX);
+  *max_x = (u8)light_cluster_tile_of(right, LightCluster_TilesX);
+  *min_y = (u8)((LightCluster_TilesY - 1) - light_cluster_tile_of(top, LightCluster_TilesY));
+  *max_y = (u8)((LightCluster_TilesY - 1) - light_cluster_tile_of(bottom, LightCluster_TilesY));
+  return(result);
+}
+
+static Light_Cluster_Bounds
+light_cluster_bounds_of(Light_Cluster_Grid *grid, Light *light)
+{
+  Light_Cluster_Bounds result = { 0, 0, 0, 0, 1, 0 };
+  Sphere sphere = light_cluster_light_sphere(light);
+  v3f    view_p = m44_transform_point(grid->world_to_view, sphere.center);
+  if ((view_p.z + sphere.radius >= grid->near_plane) && (view_p.z - sphere.radius <= grid->far_plane) &&
+      light_cluster_tiles_of(grid, view_p, sphere.radius, &result.min_x, &result.max_x, &result.min_y, &result.max_y))
+  {
+    result.min_z = (u8)light_cluster_slice_of(grid, view_p.z - sphere.radius);
+    result.max_z = (u8)light_cluster_slice_of(grid, view_p.z + sphere.radius);
+  }
+
+  return(result);
+}
+
+static void
+light_cluster_bounds_job(void *data)
+{
+  Light_Cluster_Job  *job  = (Light_Cluster_Job *)data;
+  Light_Cluster_Grid *grid = job->grid;
+  for (u32 light_idx = job->begin; light_idx < job->end; ++light_idx)
+  {
+    Light *light = grid->lights + light_idx;
+    if ((light->type == LightType_Point) || (light->type == LightType_Spot))
+    {
+      grid->bounds[light_idx] = light_cluster_bounds_of(grid, light);
+    }
+    else
+    {
+      grid->bounds[light_idx] = (Light_Cluster_Bounds){ 0, 0, 0, 0, 1, 0 };
+    }
+  }
+}
+
+// Lists the lights that reach a slice with the tiles they cover inside it,
+// and counts their references. A light reaching into the slice from the
+// front or back only shows the cap of its sphere there, and the cap fits in
+// the smaller sphere centred where the slice's plane cuts the light's axis.
+static void
+light_cluster_count_job(void *data)
+{
+  Light_Cluster_Job  *job   = (Light_Cluster_Job *)data;
+  Light_Cluster_Grid *grid  = job->grid;
+  u32                 slice = job->begin;
+
+  f32 slice_near = expf(((f32)slice - grid->z_bias) / grid->z_scale);
+  f32 slice_far  = expf(((f32)slice + 1.0f - grid->z_bias) / grid->z_scale);
+  u32 *wanted    = grid->cluster_wanted + slice * LightCluster_TilesX * LightCluster_TilesY;
+  for (u32 cluster_idx = 0; cluster_idx < LightCluster_TilesX * LightCluster_TilesY; ++cluster_idx)
+  {
+    wanted[cluster_idx] = 0;
+  }
+
+  Light_Cluster_Slice_Entry *entries = grid->slice_entries + slice * MaxLightCount;
+  u32 entry_count = 0;
+  for (u32 light_idx = 0; light_idx < grid->light_count; ++light_idx)
+  {
+    Light_Cluster_Bounds bounds = grid->bounds[light_idx];
+    if ((slice < bounds.min_z) || (slice > bounds.max_z))
+    {
+      continue;
+    }
+
+    Light_Cluster_Slice_Entry entry = { light_idx, bounds.min_x, bounds.max_x, bounds.min_y, bounds.max_y };
+    if (bounds.min_z != bounds.max_z)
+    {
+      Sphere sphere = light_cluster_light_sphere(grid->lights + light_idx);
+      v3f    view_p = m44_transform_point(grid->world_to_view, sphere.center);
+      f32    plane  = (view_p.z < slice_near) ? slice_near : ((view_p.z > slice_far) ? slice_far : view_p.z);
+      f32    depth  = plane - view_p.z;
+      f32    radius = sqrtf(Maximum(sphere.radius * sphere.radius - depth * depth, 0.0f));
+      view_p.z      = plane;
+      if (!light_cluster_tiles_of(grid, view_p, radius, &entry.min_x, &entry.max_x, &entry.min_y, &entry.max_y))
+      {
+        continue;
+      }
+    }
+
+    entries[entry_count++] = entry;
+    for (u32 y = entry.min_y; y <= entry.max_y; ++y)
+    {
+      for (u32 x = entry.min_x; x <= entry.max_x; ++x)
+      {
+        ++wanted[y * LightCluster_TilesX + x];
+      }
+    }
+  }
+
+  grid->slice_entry_counts[slice] = entry_count;
+}
+
+static void
+light_cluster_fill_job(void *data)
+{
+  Light_Cluster_Job  *job   = (Light_Cluster_Job *)data;
+  Light_Cluster_Grid *grid  = job->grid;
+  u32                 slice = job->begin;
+
+  Light_Cluster *clusters = grid->clusters + slice * LightCluster_TilesX * LightCluster_TilesY;
+  u32           *wanted   = grid->cluster_wanted + slice * LightCluster_TilesX * LightCluster_TilesY;
+  for (u32 cluster_idx = 0; cluster_idx < LightCluster_TilesX * LightCluster_TilesY; ++cluster_idx)
+  {
+    // wanted now counts up to the capacity the prefix sum left in count
+    wanted[cluster_idx] = 0;
+  }
+
+  Light_Cluster_Slice_Entry *entries = grid->slice_entries + slice * MaxLightCount;
+  for (u32 entry_idx = 0; entry_idx < grid->slice_entry_counts[slice]; ++entry_idx)
+  {
+    Light_Cluster_Slice_Entry entry = entries[entry_idx];
+    for (u32 y = entry.min_y; y <= entry.max_y; ++y)
+    {
+      for (u32 x = entry.min_x; x <= entry.max_x; ++x)
+      {
+        u32 cluster_idx = y * LightCluster_TilesX + x;
+        if (wanted[cluster_idx] < clusters[cluster_idx].count)
+        {
+          grid->indices[clusters[cluster_idx].offset + wanted[cluster_idx]++] = entry.light;
+        }
+      }
+    }
+  }
+}
+
+static void
+light_cluster_run_jobs(Light_Cluster_Grid *grid, OS_Work_Queue *queue, OS_Work_Proc *proc, Light_Cluster_Job *jobs, u32 job_count)
+{
+  for (u32 job_idx = 0; job_idx < job_count; ++job_idx)
+  {
+    jobs[job_idx].grid = grid;
+    if (queue)
+    {
+      os_work_queue_add(queue, proc, jobs + job_idx);
+    }
+    else
+    {
+      proc(jobs + job_idx);
+    }
+  }
+
+  if (queue)
+  {
+    os_work_queue_complete_all(queue);
+  }
+}
+
+static void
+light_cluster_build(Light_Cluster_Grid *grid, Light *lights, u32 light_count, OS_Work_Queue *queue)
+{
+  grid->lights      = lights;
+  grid->light_count = Minimum(light_count, MaxLightCount);
+
+  u32 bounds_job_count = 0;
+  for (u32 light_idx = 0; light_idx < grid->light_count; light_idx += LightCluster_LightsPerJob)
+  {
+    Light_Cluster_Job *job = grid->jobs + bounds_job_count++;
+    job->begin = light_idx;
+    job->end   = Minimum(light_idx + LightCluster_LightsPerJob, grid->light_count);
+  }
+
+  Light_Cluster_Job *slice_jobs = grid->jobs + bounds_job_count;
+  for (u32 slice = 0; slice < LightCluster_Slices; ++slice)
+  {
+    slice_jobs[slice].begin = slice;
+    slice_jobs[slice].end   = slice + 1;
+  }
+
+  light_cluster_run_jobs(grid, queue, light_cluster_bounds_job, grid->jobs, bounds_job_count);
+  light_cluster_run_jobs(grid, queue, light_cluster_count_job, slice_jobs, LightCluster_Slices);
+
+  // clusters past the end of the index list get what is left, then nothing
+  u32 total = 0;
+  grid->index_count = 0;
+  for (u32 cluster_idx = 0; cluster_idx < LightCluster_Count; ++cluster_idx)
+  {
+    Light_Cluster *cluster = grid->clusters + cluster_idx;
+    cluster->offset    = grid->index_count;
+    cluster->count     = Minimum(grid->cluster_wanted[cluster_idx], LightCluster_MaxIndices - grid->index_count);
+    grid->index_count += cluster->count;
+    total             += grid->cluster_wanted[cluster_idx];
+  }
+  grid->dropped_count = total - grid->index_count;
+
+  light_cluster_run_jobs(grid, queue, light_cluster_fill_job, slice_jobs, LightCluster_Slices);
+}
+
+static void
+light_cluster_copy(Light_Cluster_Grid *grid, Light_Cluster *clusters, u32 *indices)
+{
+  for (u32 cluster_idx = 0; cluster_idx < LightCluster_Count; ++cluster_idx)
+  {
+    clusters[cluster_idx] = grid->clusters[cluster_idx];
+  }
+
+  for (u32 index_idx = 0; index_idx < grid->index_count; ++index_idx)
+  {
+    indices[index_idx] = grid->indices[index_idx];
+  }
+}
@@ -0,0 +1,98 @@
+#if !defined(LIGHT_CLUSTER_H)
+#define LIGHT_CLUSTER_H
+
+// Clustered forward lighting. The view frustum is cut into a grid of
+// LightCluster_TilesX x LightCluster_TilesY screen tiles and
+// LightCluster_Slices depth slices, spaced logarithmically between the near
+// and far planes of m44_make_perspective_z01. Every point and spot light's
+// bounding sphere is binned into the clusters it can touch, and ps_main only
+// walks the list of its own cluster.
+//
+// Directional lights reach every pixel and are not binned; they must come
+// first in the light array and are counted separately.
+//
+// The build runs threaded in three passes: one finds each light's cluster
+// box, one job per depth slice then tightens each light to the part of its
+// sphere inside the slice and counts references, and after a serial prefix
+// sum the same slice jobs fill the lists. Slices never share clusters, so
+// no job contends with another.
+
+#define LightCluster_TilesX           16
+#define LightCluster_TilesY           9
+#define LightCluster_Slices           24
+#define LightCluster_Count            (LightCluster_TilesX * LightCluster_TilesY * LightCluster_Slices)
+// size of the index list the GPU reads; references past it are dropped
+#define LightCluster_MaxIndices       (1 << 20)
+#define LightCluster_LightsPerJob     1024
+
+// offset into the index list and the number of lights there
+typedef struct
+{
+  u32 offset;
+  u32 count;
+} Light_Cluster;
+
+// inclusive cluster box of one light; min_z > max_z when it misses the frustum
+typedef struct
+{
+  u8 min_x, max_x;
+  u8 min_y, max_y;
+  u8 min_z, max_z;
+} Light_Cluster_Bounds;
+
+// a light's tiles within one slice, kept between the count and fill passes
+typedef struct
+{
+  u32 light;
+  u8  min_x, max_x;
+  u8  min_y, max_y;
+} Light_Cluster_Slice_Entry;
+
+typedef struct Light_Cluster_Grid Light_Cluster_Grid;
+typedef struct
+{
+  Light_Cluster_Grid *grid;
+  u32                 begin;
+  u32                 end;
+} Light_Cluster_Job;
+
+struct Light_Cluster_Grid
+{
+  m44                   world_to_view;
+  f32                   tan_half_fov_x;
+  f32                   tan_half_fov_y;
+  f32                   near_plane;
+  f32                   far_plane;
+  // slice = log(view z) * z_scale + z_bias
+  f32                   z_scale;
+  f32                   z_bias;
+
+  Light                     *lights;
+  u32                        light_count;
+  Light_Cluster_Bounds      *bounds;
+  // MaxLightCount per slice
+  Light_Cluster_Slice_Entry *slice_entries;
+  u32                        slice_entry_counts[LightCluster_Slices];
+
+  Light_Cluster              clusters[LightCluster_Count];
+  // references each cluster wants; clusters[].count is what fit
+  u32                        cluster_wanted[LightCluster_Count];
+  u32                       *indices;
+  u32                        index_count;
+  // references lost to a full index list in the last build
+  u32                        dropped_count;
+
+  Light_Cluster_Job          jobs[MaxLightCount / LightCluster_LightsPerJob + LightCluster_Slices];
+};
+
+static void          light_cluster_grid_alloc(Light_Cluster_Grid *grid);
+static void          light_cluster_set_camera(Light_Cluster_Grid *grid, m44 world_to_view, f32 tan_half_fov_x, f32 tan_half_fov_y,
+                                              f32 near_plane, f32 far_plane);
+static Sphere        light_cluster_light_sphere(Light *light);
+static u32           light_cluster_index_of(Light_Cluster_Grid *grid, v3f view_p);
+// queue may be 0 to build on the calling thread
+static void          light_cluster_build(Light_Cluster_Grid *grid, Light *lights, u32 light_count, OS_Work_Queue *queue);
+// copies the clusters and index_count indices out, e.g. into mapped GPU buffers
+static void          light_cluster_copy(Light_Cluster_Grid *grid, Light_Cluster *clusters, u32 *indices);
+
+#endif
@@ -0,0 +1,694 @@
+// Halves are 1 sign, 5 exponent (bias 15) and 10 mantissa bits; below
+// 2^-14 the exponent is 0 and the mantissa carries no implicit one. Rounding
+// up into the next exponent is a carry into its bits, so it needs no case.
+static u16
+lightmap_pack_f16(f32 value)
+{
+  f32 clamped = Minimum(Maximum(value, 0.0f), 65504.0f);
+  u32 result  = 0;
+  if (clamped >= ldexpf(1.0f, -14))
+  {
+    s32 exponent = 0;
+    f32 mantissa = frexpf(clamped, &exponent);
+    result = ((u32)(exponent + 14) << 10) + (u32)floorf((2.0f * mantissa - 1.0f) * 1024.0f + 0.5f);
+  }
+  else
+  {
+    result = (u32)floorf(clamped * ldexpf(1.0f, 24) + 0.5f);
+  }
+
+  return((u16)result);
+}
+
+static f32
+lightmap_unpack_f16(u16 packed)
+{
+  u32 exponent = (packed >> 10) & 0x1F;
+  u32 mantissa = packed & 0x3FF;
+  f32 result   = exponent ? ldexpf(1.0f + (f32)mantissa / 1024.0f, (s32)exponent - 15) : ldexpf((f32)mantissa, -24);
+  return((packed & 0x8000) ? -result : result);
+}
+
+// per static instance, the model of the batch it was added to
+static void
+lightmap_instance_models(Scene_Instances *scene, Scene_Model *models)
+{
+  for (u32 batch_idx = 0; batch_idx < scene->static_batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch = scene->batches + batch_idx;
+    u32 instance_end   = batch->first_instance + batch->instance_count;
+    if (batch_idx == scene->static_batch_count - 1)
+    {
+      instance_end = batch->first_instance + scene->static_last_batch_instance_count;
+    }
+
+    for (u32 instance_idx = batch->first_instance; instance_idx < instance_end; ++instance_idx)
+    {
+      models[instance_idx] = batch->model;
+    }
+  }
+}
+
+static v3f
+lightmap_world_p(Model_Instance *instance, v3f p)
+{
+  v3f result = v3f_add(m33_mul_v3f(instance->model_to_world_xform, p), instance->p);
+  return(result);
+}
+
+// The world distance the chart spans along u and along v: its uv box times
+// the area weighted mean of |dP/du| and |dP/dv| over its triangles.
+static v2f
+lightmap_chart_extent(Model_Instance *instance, Scene_Mesh *mesh, Scene_Mesh_Chart *chart, v2f uv_min, v2f uv_max)
+{
+  f32 length_u = 0.0f, length_v = 0.0f, area = 0.0f;
+  for (u32 index = chart->first_index; index < chart->first_index + chart->index_count; index += 3)
+  {
+    Model_Vertex *v0 = mesh->vertices + mesh->indices[index + 0];
+    Model_Vertex *v1 = mesh->vertices + mesh->indices[index + 1];
+    Model_Vertex *v2 = mesh->vertices + mesh->indices[index + 2];
+    v3f p0 = lightmap_world_p(instance, v0->p);
+    v3f e1 = v3f_sub(lightmap_world_p(instance, v1->p), p0);
+    v3f e2 = v3f_sub(lightmap_world_p(instance, v2->p), p0);
+    f32 du1 = v1->uv.x - v0->uv.x, dv1 = v1->uv.y - v0->uv.y;
+    f32 du2 = v2->uv.x - v0->uv.x, dv2 = v2->uv.y - v0->uv.y;
+    f32 det = du1 * dv2 - du2 * dv1;
+    v3f normal = v3f_cross(e1, e2);
+    f32 triangle_area = 0.5f * sqrtf(v3f_inner(normal, normal));
+    if ((fabsf(det) > 1e-12f) && (triangle_area > 0.0f))
+    {
+      v3f dp_du = v3f_scale(1.0f / det, v3f_sub(v3f_scale(dv2, e1), v3f_scale(dv1, e2)));
+      v3f dp_dv = v3f_scale(1.0f / det, v3f_sub(v3f_scale(du1, e2), v3f_scale(du2, e1)));
+      length_u += triangle_area * sqrtf(v3f_inner(dp_du, dp_du));
+      length_v += triangle_area * sqrtf(v3f_inner(dp_dv, dp_dv));
+      area     += triangle_area;
+    }
+  }
+
+  v2f result = { 0 };
+  if (area > 0.0f)
+  {
+    result.x = (uv_max.x - uv_min.x) * length_u / area;
+    result.y = (uv_max.y - uv_min.y) * length_v / area;
+  }
+  return(result);
+}
+
+typedef struct
+{
+  s32 width;
+  s32 height;
+  u32 chart_idx;
+} Lightmap_Pack_Entry;
+
+// tallest first, then widest; the index keeps the order total
+static s32
+lightmap_pack_entry_compare(const void *a, const void *b)
+{
+  Lightmap_Pack_Entry *entry_a = (Lightmap_Pack_Entry *)a;
+  Lightmap_Pack_Entry *entry_b = (Lightmap_Pack_Entry *)b;
+  s32 result = (entry_b->height - entry_a->height);
+  if (!result)
+  {
+    result = (entry_b->width - entry_a->width);
+  }
+  if (!result)
+  {
+    result = (entry_a->chart_idx > entry_b->chart_idx) - (entry_a->chart_idx < entry_b->chart_idx);
+  }
+  return(result);
+}
+
+static b32
+lightmap_pack(Lightmap_Layout *layout, Lightmap_Pack_Entry *entries, Tex_Skyline_Segment *segments, s32 width, s32 height)
+{
+  Tex_Atlas atlas;
+  tex_atlas_begin(&atlas, width, height, segments);
+  b32 result = true;
+  for (u32 entry_idx = 0; (entry_idx < layout->chart_count) && result; ++entry_idx)
+  {
+    Lightmap_Pack_Entry *entry = entries + entry_idx;
+    Lightmap_Chart      *chart = layout->charts + entry->chart_idx;
+    chart->width  = entry->width;
+    chart->height = entry->height;
+    result = tex_atlas_add(&atlas, entry->width, entry->height, &chart->x, &chart->y);
+  }
+
+  return(result);
+}
+
+static void
+lightmap_layout(Lightmap_Layout *layout, Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count], f32 texels_per_unit)
+{
+  *layout = (Lightmap_Layout){ 0 };
+  layout->instance_count = scene->static_instance_count;
+
+  Scene_Model models[MaxSceneInstances];
+  lightmap_instance_models(scene, models);
+
+  // the uv box of every mesh chart
+  v2f uv_min[SceneModel_Count][SceneMesh_MaxCharts];
+  v2f uv_max[SceneModel_Count][SceneMesh_MaxCharts];
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    Scene_Mesh *mesh = meshes + model;
+    for (u32 chart_idx = 0; chart_idx < mesh->chart_count; ++chart_idx)
+    {
+      Scene_Mesh_Chart *chart = mesh->charts + chart_idx;
+      uv_min[model][chart_idx] = (v2f){ 1e30f, 1e30f };
+      uv_max[model][chart_idx] = (v2f){ -1e30f, -1e30f };
+      for (u32 index = chart->first_index; index < chart->first_index + chart->index_count; ++index)
+      {
+        v2f uv = mesh->vertices[mesh->indices[index]].uv;
+        uv_min[model][chart_idx] = (v2f){ Minimum(uv_min[model][chart_idx].x, uv.x), Minimum(uv_min[model][chart_idx].y, uv.y) };
+        uv_max[model][chart_idx] = (v2f){ Maximum(uv_max[model][chart_idx].x, uv.x), Maximum(uv_max[model][chart_idx].y, uv.y) };
+      }
+    }
+  }
+
+  for (u32 instance_idx = 0; instance_idx < layout->instance_count; ++instance_idx)
+  {
+    if (scene->ins[instance_idx].enable_lighting)
+    {
+      layout->chart_count += meshes[models[instance_idx]].chart_count;
+    }
+  }
+
+  layout->charts = (Lightmap_Chart *)os_memory_alloc(Maximum(layout->chart_count, 1) * sizeof(Lightmap_Chart));
+  v2f *extents   = (v2f *)os_memory_alloc(Maximum(layout->chart_count, 1) * sizeof(v2f));
+  u32 chart_idx  = 0;
+  for (u32 instance_idx = 0; instance_idx < layout->instance_count; ++instance_idx)
+  {
+    Model_Instance *instance = scene->ins + instance_idx;
+    Scene_Model     model    = models[instance_idx];
+    layout->first_chart[instance_idx] = Lightmap_None;
+    if (instance->enable_lighting)
+    {
+      layout->first_chart[instance_idx] = chart_idx;
+      for (u32 mesh_chart = 0; mesh_chart < meshes[model].chart_count; ++mesh_chart)
+      {
+        layout->charts[chart_idx] = (Lightmap_Chart){ .instance_idx = instance_idx, .model = model, .mesh_chart = mesh_chart };
+        extents[chart_idx] = lightmap_chart_extent(instance, meshes + model, meshes[model].charts + mesh_chart,
+                                                   uv_min[model][mesh_chart], uv_max[model][mesh_chart]);
+        ++chart_idx;
+      }
+    }
+  }
+  Assert(chart_idx == layout->chart_count);
+
+  Lightmap_Pack_Entry *entries  = (Lightmap_Pack_Entry *)os_memory_alloc(Maximum(layout->chart_count, 1) * sizeof(Lightmap_Pack_Entry));
+  Tex_Skyline_Segment *segments = (Tex_Skyline_Segment *)os_memory_alloc(Lightmap_MaxAtlasSize * sizeof(Tex_Skyline_Segment));
+  b32 packed = false;
+  for (f32 density = texels_per_unit; !packed; density *= 0.5f)
+  {
+    s32 max_content = Lightmap_MaxAtlasSize - 2 * Lightmap_ChartPadding;
+    u64 total_area  = 0;
+    for (chart_idx = 0; chart_idx < layout->chart_count; ++chart_idx)
+    {
+      s32 content_width  = (s32)ceilf(extents[chart_idx].x * density);
+      s32 content_height = (s32)ceilf(extents[chart_idx].y * density);
+      content_width      = Minimum(Maximum(content_width, 1), max_content);
+      content_height     = Minimum(Maximum(content_height, 1), max_content);
+      entries[chart_idx] = (Lightmap_Pack_Entry){ content_width + 2 * Lightmap_ChartPadding, content_height + 2 * Lightmap_ChartPadding, chart_idx };
+      total_area        += (u64)entries[chart_idx].width * entries[chart_idx].height;
+    }
+    qsort(entries, layout->chart_count, sizeof(Lightmap_Pack_Entry), lightmap_pack_entry_compare);
+
+    // width x width / 2, then width x width, doubling
+    for (s32 width = Lightmap_MinAtlasSize; (width <= Lightmap_MaxAtlasSize) && !packed; width *= 2)
+    {
+      for (s32 height = width / 2; (height <= width) && !packed; height *= 2)
+      {
+        if ((u64)width * height >= total_area)
+        {
+          packed = lightmap_pack(layout, entries, segments, width, height);
+          layout->width           = width;
+          layout->height          = height;
+          layout->texels_per_unit = density;
+        }
+      }
+    }
+  }
+
+  for (chart_idx = 0; chart_idx < layout->chart_count; ++chart_idx)
+  {
+    Lightmap_Chart *chart = layout->charts + chart_idx;
+    v2f min = uv_min[chart->model][chart->mesh_chart];
+    v2f max = uv_max[chart->model][chart->mesh_chart];
+    f32 scale_x = (f32)(chart->width - 2 * Lightmap_ChartPadding) / (Maximum(max.x - min.x, 1e-6f) * (f32)layout->width);
+    f32 scale_y = (f32)(chart->height - 2 * Lightmap_ChartPadding) / (Maximum(max.y - min.y, 1e-6f) * (f32)layout->height);
+    chart->uv_transform = (v4f)
+    {
+      scale_x,
+      scale_y,
+      (f32)(chart->x + Lightmap_ChartPadding) / (f32)layout->width - min.x * scale_x,
+      (f32)(chart->y + Lightmap_ChartPadding) / (f32)layout->height - min.y * scale_y,
+    };
+  }
+
+  os_memory_free(segments, Lightmap_MaxAtlasSize * sizeof(Tex_Skyline_Segment));
+  os_memory_free(entries, Maximum(layout->chart_count, 1) * sizeof(Lightmap_Pack_Entry));
+  os_memory_free(extents, Maximum(layout->chart_count, 1) * sizeof(v2f));
+}
+
+static void
+lightmap_layout_free(Lightmap_Layout *layout)
+{
+  os_memory_free(layout->charts, Maximum(layout->chart_count, 1) * sizeof(Lightmap_Chart));
+  layout->charts      = 0;
+  layout->chart_count = 0;
+}
+
+static f32
+lightmap_random(u32 *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  f32 result = (f32)(*state >> 8) * (1.0f / 16777216.0f);
+  return(result);
+}
+
+static f32
+lightmap_radical_inverse(u32 bits)
+{
+  bits = (bits << 16) | (bits >> 16);
+  bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+  bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+  bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+  bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+  return((f32)bits * 2.3283064365386963e-10f);
+}
+
+// cosine weighted about normal, from a point in [0, 1)^2
+static v3f
+lightmap_cosine_direction(v3f normal, f32 xi_x, f32 xi_y)
+{
+  v3f up        = (fabsf(normal.y) < 0.999f) ? (v3f){ 0.0f, 1.0f, 0.0f } : (v3f){ 1.0f, 0.0f, 0.0f };
+  v3f tangent   = v3f_normalized(v3f_cross(up, normal));
+  v3f bitangent = v3f_cross(normal, tangent);
+  f32 radius    = sqrtf(xi_x);
+  f32 phi       = 2.0f * PIF32 * xi_y;
+  v3f result    = v3f_add(v3f_add(v3f_scale(radius * cosf(phi), tangent), v3f_scale(radius * sinf(phi), bitangent)),
+                          v3f_scale(sqrtf(Maximum(1.0f - xi_x, 0.0f)), normal));
+  return(result);
+}
+
+static v3f
+lightmap_albedo(Lightmap_Bake *bake, u32 instance_idx)
+{
+  Model_Instance *instance = bake->scene->ins + instance_idx;
+  Material_Type   material = bake->scene->info[instance_idx].material;
+  v3f result = { instance->colour.r, instance->colour.g, instance->colour.b };
+  if (material != MaterialType_None)
+  {
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      result.v[channel] *= bake->material_albedo[material].v[channel];
+    }
+  }
+
+  return(result);
+}
+
+// 1 if the directional light reaches p
+static f32
+lightmap_light_visibility(Lightmap_Bake *bake, Model_Instance *instance, v3f p, v3f face_normal)
+{
+  v3f L = v3f_normalized(bake->light.dir);
+  f32 result = 0.0f;
+  if (v3f_inner(face_normal, L) < 0.0f)
+  {
+    v3f origin = v3f_add(p, v3f_scale(Lightmap_RayEpsilon, face_normal));
+    result = (!instance->receives_shadow || !bvh_occluded(bake->bvh, origin, v3f_scale(-1.0f, L), 0.0f, 1e30f)) ? 1.0f : 0.0f;
+  }
+
+  return(result);
+}
+
+// What the path from origin along dir brings back, in the units ps_main
+// multiplies the albedo by. Each hit adds the directional light it reflects
+// and sends the path on in a cosine weighted direction; cosine weighting
+// cancels the n.l and the 1/pi of the diffuse integral, so the throughput
+// is just the product of the albedos.
+static v3f
+lightmap_trace_path(Lightmap_Bake *bake, v3f origin, v3f dir, u32 *rng)
+{
+  v3f result     = v3f_zero();
+  v3f throughput = v3f_s(1.0f);
+  for (u32 bounce = 0; bounce < bake->bounce_count; ++bounce)
+  {
+    Bvh_Hit hit;
+    if (!bvh_intersect(bake->bvh, origin, dir, 0.0f, 1e30f, &hit))
+    {
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        result.v[channel] += throughput.v[channel] * bake->sky.v[channel];
+      }
+      break;
+    }
+
+    Model_Instance      *instance = bake->scene->ins + hit.instance_idx;
+    Bvh_Source_Triangle *triangle = bake->triangles + hit.source_idx;
+    v3f albedo = lightmap_albedo(bake, hit.instance_idx);
+    v3f normal = v3f_normalized(v3f_cross(v3f_sub(triangle->p[1], triangle->p[0]), v3f_sub(triangle->p[2], triangle->p[0])));
+    if (v3f_inner(normal, dir) > 0.0f)
+    {
+      normal = v3f_scale(-1.0f, normal);
+    }
+
+    // unlit instances show their colour as it is
+    v3f reflected = albedo;
+    if (instance->enable_lighting)
+    {
+      v3f p       = v3f_add(origin, v3f_scale(hit.t, dir));
+      f32 n_dot_l = Maximum(-v3f_inner(normal, v3f_normalized(bake->light.dir)), 0.0f);
+      f32 lit     = lightmap_light_visibility(bake, instance, p, normal);
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        reflected.v[channel] = albedo.v[channel] * bake->light.intensity.v[channel] * n_dot_l * lit;
+      }
+      origin = v3f_add(p, v3f_scale(Lightmap_RayEpsilon, normal));
+      dir    = lightmap_cosine_direction(normal, lightmap_random(rng), lightmap_random(rng));
+    }
+
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      result.v[channel]     += throughput.v[channel] * reflected.v[channel];
+      throughput.v[channel] *= albedo.v[channel];
+    }
+
+    if (!instance->enable_lighting)
+    {
+      break;
+    }
+  }
+
+  return(result);
+}
+
+// p is the texel centre on the surface and dp_dx, dp_dy how it moves per
+// texel, so the samples spread over the texel's footprint
+static v4f
+lightmap_shade_texel(Lightmap_Bake *bake, Model_Instance *instance, v3f p, v3f dp_dx, v3f dp_dy, v3f normal, v3f face_normal, u32 seed)
+{
+  // Hammersley points, shifted per texel so neighbours do not share a
+  // pattern, and shifted again for the directions so they do not follow
+  // the positions
+  u32 rng      = seed;
+  f32 shift[4] = { lightmap_random(&rng), lightmap_random(&rng), lightmap_random(&rng), lightmap_random(&rng) };
+  f32 lit      = 0.0f;
+  v3f indirect = v3f_zero();
+  for (u32 sample_idx = 0; sample_idx < bake->sample_count; ++sample_idx)
+  {
+    f32 hammersley_x = ((f32)sample_idx + 0.5f) / (f32)bake->sample_count;
+    f32 hammersley_y = lightmap_radical_inverse(sample_idx);
+    f32 xi[4] = { hammersley_x + shift[0], hammersley_y + shift[1], hammersley_x + shift[2], hammersley_y + shift[3] };
+    for (u32 xi_idx = 0; xi_idx < 4; ++xi_idx)
+    {
+      xi[xi_idx] -= floorf(xi[xi_idx]);
+    }
+
+    v3f sample_p = v3f_add(p, v3f_add(v3f_scale(xi[0] - 0.5f, dp_dx), v3f_scale(xi[1] - 0.5f, dp_dy)));
+    lit         += lightmap_light_visibility(bake, instance, sample_p, face_normal);
+
+    v3f origin = v3f_add(sample_p, v3f_scale(Lightmap_RayEpsilon, face_normal));
+    v3f dir    = lightmap_cosine_direction(normal, xi[2], xi[3]);
+    if (v3f_inner(dir, face_normal) > 0.0f)
+    {
+      indirect = v3f_add(indirect, lightmap_trace_path(bake, origin, dir, &rng));
+    }
+  }
+
+  f32 visibility = lit / (f32)bake->sample_count;
+  f32 n_dot_l    = Maximum(-v3f_inner(normal, v3f_normalized(bake->light.dir)), 0.0f);
+  f32 shadow     = 0.4f + 0.6f * visibility;
+  v4f result     = { 0.0f, 0.0f, 0.0f, visibility };
+  for (u32 channel = 0; channel < 3; ++channel)
+  {
+    result.v[channel] = bake->light.intensity.v[channel] * n_dot_l * shadow + indirect.v[channel] / (f32)bake->sample_count;
+  }
+  return(result);
+}
+
+typedef struct
+{
+  Lightmap_Bake   *bake;
+  Lightmap_Layout *layout;
+  v4f             *texels;
+  // 1 where a triangle covers the texel centre
+  u8              *covered;
+  u32              tile_count_x;
+  u32              tile_count;
+  volatile u64     next_tile;
+} Lightmap_Tiles;
+
+static f32
+lightmap_edge(v2f a, v2f b, f32 x, f32 y)
+{
+  f32 result = (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+  return(result);
+}
+
+static void
+lightmap_rasterise_chart(Lightmap_Tiles *tiles, Lightmap_Chart *chart, s32 tile_x0, s32 tile_y0, s32 tile_x1, s32 tile_y1)
+{
+  Lightmap_Bake    *bake     = tiles->bake;
+  Lightmap_Layout  *layout   = tiles->layout;
+  Scene_Mesh       *mesh     = bake->meshes + chart->model;
+  Scene_Mesh_Chart *mesh_chart = mesh->charts + chart->mesh_chart;
+  Model_Instance   *instance = bake->scene->ins + chart->instance_idx;
+  v4f transform = chart->uv_transform;
+  s32 x0 = Maximum(tile_x0, chart->x), x1 = Minimum(tile_x1, chart->x + chart->width);
+  s32 y0 = Maximum(tile_y0, chart->y), y1 = Minimum(tile_y1, chart->y + chart->height);
+  for (u32 index = mesh_chart->first_index; index < mesh_chart->first_index + mesh_chart->index_count; index += 3)
+  {
+    v2f a[3];
+    v3f p[3], n[3];
+    for (u32 vertex = 0; vertex < 3; ++vertex)
+    {
+      Model_Vertex *model_vertex = mesh->vertices + mesh->indices[index + vertex];
+      a[vertex] = (v2f){ (model_vertex->uv.x * transform.x + transform.z) * (f32)layout->width,
+                         (model_vertex->uv.y * transform.y + transform.w) * (f32)layout->height };
+      p[vertex] = lightmap_world_p(instance, model_vertex->p);
+      n[vertex] = m33_mul_v3f(instance->model_to_world_xform_it, model_vertex->normal);
+    }
+
+    f32 area = lightmap_edge(a[0], a[1], a[2].x, a[2].y);
+    v3f e1   = v3f_sub(p[1], p[0]);
+    v3f e2   = v3f_sub(p[2], p[0]);
+    v3f face_normal = v3f_cross(e1, e2);
+    if ((fabsf(area) < 1e-9f) || (v3f_inner(face_normal, face_normal) < 1e-20f))
+    {
+      continue;
+    }
+
+    face_normal = v3f_normalized(face_normal);
+    if (v3f_inner(face_normal, v3f_add(n[0], v3f_add(n[1], n[2]))) < 0.0f)
+    {
+      face_normal = v3f_scale(-1.0f, face_normal);
+    }
+
+    // b1 and b2 are linear in the atlas position; these are their steps
+    f32 inv_area = 1.0f / area;
+    f32 b1_dx = (a[2].y - a[0].y) * inv_area,  b1_dy = -(a[2].x - a[0].x) * inv_area;
+    f32 b2_dx = -(a[1].y - a[0].y) * inv_area, b2_dy = (a[1].x - a[0].x) * inv_area;
+    v3f dp_dx = v3f_add(v3f_scale(b1_dx, e1), v3f_scale(b2_dx, e2));
+    v3f dp_dy = v3f_add(v3f_scale(b1_dy, e1), v3f_scale(b2_dy, e2));
+
+    s32 min_x = Maximum(x0, (s32)floorf(Minimum(a[0].x, Minimum(a[1].x, a[2].x))));
+    s32 max_x = Minimum(x1, (s32)ceilf(Maximum(a[0].x, Maximum(a[1].x, a[2].x))));
+    s32 min_y = Maximum(y0, (s32)floorf(Minimum(a[0].y, Minimum(a[1].y, a[2].y))));
+    s32 max_y = Minimum(y1, (s32)ceilf(Maximum(a[0].y, Maximum(a[1].y, a[2].y))));
+    for (s32 y = min_y; y < max_y; ++y)
+    {
+      for (s32 x = min_x; x < max_x; ++x)
+      {
+        u32 texel = (u32)y * (u32)layout->width + (u32)x;
+        f32 centre_x = (f32)x + 0.5f, centre_y = (f32)y + 0.5f;
+        f32 b0 = lightmap_edge(a[1], a[2], centre_x, centre_y) * inv_area;
+        f32 b1 = lightmap_edge(a[2], a[0], centre_x, centre_y) * inv_area;
+        f32 b2 = 1.0f - b0 - b1;
+        if (!tiles->covered[texel] && (b0 >= -1e-5f) && (b1 >= -1e-5f) && (b2 >= -1e-5f))
+        {
+          v3f texel_p = v3f_add(p[0], v3f_add(v3f_scale(b1, e1), v3f_scale(b2, e2)));
+          v3f normal  = v3f_add(v3f_scale(b0, n[0]), v3f_add(v3f_scale(b1, n[1]), v3f_scale(b2, n[2])));
+          u32 seed    = texel * 0x9E3779B9u + 0x7F4A7C15u;
+          tiles->texels[texel]  = lightmap_shade_texel(bake, instance, texel_p, dp_dx, dp_dy, v3f_normalized(normal), face_normal, seed);
+          tiles->covered[texel] = 1;
+        }
+      }
+    }
+  }
+}
+
+static void
+lightmap_tile_job(void *data)
+{
+  Lightmap_Tiles  *tiles  = (Lightmap_Tiles *)data;
+  Lightmap_Layout *layout = tiles->layout;
+  for (u64 tile = AtomicAddU64(&tiles->next_tile, 1); tile < tiles->tile_count; tile = AtomicAddU64(&tiles->next_tile, 1))
+  {
+    s32 tile_x0 = (s32)(tile % tiles->tile_count_x) * Lightmap_TileSize;
+    s32 tile_y0 = (s32)(tile / tiles->tile_count_x) * Lightmap_TileSize;
+    s32 tile_x1 = tile_x0 + Lightmap_TileSize;
+    s32 tile_y1 = tile_y0 + Lightmap_TileSize;
+    for (u32 chart_idx = 0; chart_idx < layout->chart_count; ++chart_idx)
+    {
+      Lightmap_Chart *chart = layout->charts + chart_idx;
+      if ((chart->x < tile_x1) && (chart->x + chart->width > tile_x0) &&
+          (chart->y < tile_y1) && (chart->y + chart->height > tile_y0))
+      {
+        lightmap_rasterise_chart(tiles, chart, tile_x0, tile_y0, tile_x1, tile_y1);
+      }
+    }
+  }
+}
+
+// Grows every chart's texels into its empty ones a ring at a time: an empty
+// texel takes the mean of the neighbours filled before this pass. covered
+// is 1 for rasterised texels and pass + 2 for those a pass filled.
+static void
+lightmap_dilate(Lightmap_Layout *layout, v4f *texels, u8 *covered)
+{
+  for (u32 chart_idx = 0; chart_idx < layout->chart_count; ++chart_idx)
+  {
+    Lightmap_Chart *chart = layout->charts + chart_idx;
+    u32 filled = 1;
+    for (u32 pass = 0; filled && (pass < 250); ++pass)
+    {
+      filled = 0;
+      for (s32 y = chart->y; y < chart->y + chart->height; ++y)
+      {
+        for (s32 x = chart->x; x < chart->x + chart->width; ++x)
+        {
+          u32 texel = (u32)y * (u32)layout->width + (u32)x;
+          if (!covered[texel])
+          {
+            v4f sum   = { 0 };
+            u32 count = 0;
+            for (s32 neighbour_y = Maximum(y - 1, chart->y); neighbour_y <= Minimum(y + 1, chart->y + chart->height - 1); ++neighbour_y)
+            {
+              for (s32 neighbour_x = Maximum(x - 1, chart->x); neighbour_x <= Minimum(x + 1, chart->x + chart->width - 1); ++neighbour_x)
+              {
+                u32 neighbour = (u32)neighbour_y * (u32)layout->width + (u32)neighbour_x;
+                if (covered[neighbour] && (covered[neighbour] != pass + 2))
+                {
+                  for (u32 channel = 0; channel < 4; ++channel)
+                  {
+                    sum.v[channel] += texels[neighbour].v[channel];
+                  }
+                  ++count;
+                }
+              }
+            }
+
+            if (count)
+            {
+              for (u32 channel = 0; channel < 4; ++channel)
+              {
+                texels[texel].v[channel] = sum.v[channel] / (f32)count;
+              }
+              covered[texel] = (u8)(pass + 2);
+              ++filled;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+static void
+lightmap_bake(Lightmap_Bake *bake, Lightmap_Layout *layout, v4f *texels, OS_Work_Queue *queue)
+{
+  u64 texel_count = (u64)layout->width * layout->height;
+  u8 *covered     = (u8 *)os_memory_alloc(texel_count);
+  for (u64 texel = 0; texel < texel_count; ++texel)
+  {
+    texels[texel]  = (v4f){ 0 };
+    covered[texel] = 0;
+  }
+
+  Lightmap_Tiles tiles =
+  {
+    .bake         = bake,
+    .layout       = layout,
+    .texels       = texels,
+    .covered      = covered,
+    .tile_count_x = ((u32)layout->width + Lightmap_TileSize - 1) / Lightmap_TileSize,
+  };
+  tiles.tile_count = tiles.tile_count_x * (((u32)layout->height + Lightmap_TileSize - 1) / Lightmap_TileSize);
+
+  if (queue)
+  {
+    for (u32 job_idx = 0; job_idx < Lightmap_JobCount; ++job_idx)
+    {
+      os_work_queue_add(queue, lightmap_tile_job, &tiles);
+    }
+    os_work_queue_complete_all(queue);
+  }
+  else
+  {
+    lightmap_tile_job(&tiles);
+  }
+
+  lightmap_dilate(layout, texels, covered);
+  os_memory_free(covered, texel_count);
+}
+
+static u64
+lightmap_file_size(Lightmap_Layout *layout)
+{
+  u64 result = sizeof(Lightmap_Header) + (u64)layout->instance_count * sizeof(u32) + (u64)layout->chart_count * sizeof(v4f) +
+               (u64)layout->width * layout->height * 4 * sizeof(u16);
+  return(result);
+}
+
+static void
+lightmap_encode(u8 *dest, Lightmap_Layout *layout, v4f *texels)
+{
+  Lightmap_Header *header = (Lightmap_Header *)dest;
+  *header = (Lightmap_Header)
+  {
+    .magic          = Lightmap_Magic,
+    .version        = Lightmap_Version,
+    .width          = (u32)layout->width,
+    .height         = (u32)layout->height,
+    .instance_count = layout->instance_count,
+    .chart_count    = layout->chart_count,
+  };
+
+  u32 *first_chart = (u32 *)(header + 1);
+  for (u32 instance_idx = 0; instance_idx < layout->instance_count; ++instance_idx)
+  {
+    first_chart[instance_idx] = layout->first_chart[instance_idx];
+  }
+
+  v4f *charts = (v4f *)(first_chart + layout->instance_count);
+  for (u32 chart_idx = 0; chart_idx < layout->chart_count; ++chart_idx)
+  {
+    charts[chart_idx] = layout->charts[chart_idx].uv_transform;
+  }
+
+  u16 *packed      = (u16 *)(charts + layout->chart_count);
+  u64  texel_count = (u64)layout->width * layout->height;
+  for (u64 texel = 0; texel < texel_count; ++texel)
+  {
+    for (u32 channel = 0; channel < 4; ++channel)
+    {
+      packed[texel * 4 + channel] = lightmap_pack_f16(texels[texel].v[channel]);
+    }
+  }
+}
+
+static Lightmap_Header *
+lightmap_parse(u8 *data, u64 size)
+{
+  Lightmap_Header *result = (Lightmap_Header *)data;
+  b32 valid = data && (size >= sizeof(Lightmap_Header)) &&
+              (result->magic == Lightmap_Magic) && (result->version == Lightmap_Version) &&
+              (result->width <= Lightmap_MaxAtlasSize) && (result->height <= Lightmap_MaxAtlasSize) &&
+              (result->instance_count <= MaxSceneInstances) &&
+              (size >= sizeof(Lightmap_Header) + (u64)result->instance_count * sizeof(u32) + (u64)result->chart_count * sizeof(v4f) +
+                       (u64)result->width * result->height * 4 * sizeof(u16));
+  return(valid ? result : 0);
+}
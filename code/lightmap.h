@@ -0,0 +1,116 @@
+#if !defined(LIGHTMAP_H)
+#define LIGHTMAP_H
+
+// Lightmaps for the static instances, baked offline by tools/lightmap_bake.c.
+//
+// Every chart of a mesh (scene_mesh.h) gets a rectangle of its own in one
+// atlas per lit static instance, sized from the world space it covers and
+// placed by the skyline packer (tex_pack.h). A scale and offset take the
+// chart's mesh uvs into its rectangle, so the meshes need no second uv set:
+// vs_main reads the instance's lightmap_first_chart plus the vertex's
+// lightmap_chart from g_lightmap_charts.
+//
+// The baker rasterises the charts into the atlas and path traces every
+// covered texel against the BVH (bvh.h), a tile at a time across the work
+// queue. RGB is the irradiance ps_main multiplies the albedo by: the
+// directional light's intensity times n.l, darkened to 0.4 in shadow the way
+// ps_main darkens it, plus what arrives after up to bounce_count diffuse
+// bounces. A is the fraction of the texel the light reaches, which scales
+// the specular term. Only the directional light is baked; the point and
+// spot lights move. Texels no triangle covers take their neighbours'
+// values, so bilinear filtering at a chart's edge never reads black.
+//
+// Layout of a file:
+//   Lightmap_Header
+//   u32 first_chart[instance_count]  per static instance, or Lightmap_None
+//   v4f charts[chart_count]          uv scale in xy, offset in zw
+//   u16 texels[width * height * 4]   DXGI_FORMAT_R16G16B16A16_FLOAT
+
+#define Lightmap_Magic          0x50414D4C // "LMAP"
+#define Lightmap_Version        1
+// relative to data/
+#define Lightmap_DefaultPath    "lightmap.lmp"
+#define Lightmap_TexelsPerUnit  4.0f
+#define Lightmap_MinAtlasSize   256
+#define Lightmap_MaxAtlasSize   4096
+// empty texels around every chart, filled from its edge
+#define Lightmap_ChartPadding   1
+#define Lightmap_TileSize       64
+// jobs that pull tiles until none are left
+#define Lightmap_JobCount       64
+// ray origins are pushed this far off a surface before tracing on
+#define Lightmap_RayEpsilon     1e-3f
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 width;
+  u32 height;
+  u32 instance_count;
+  u32 chart_count;
+  u32 _pad_a[2];
+} Lightmap_Header;
+
+typedef struct
+{
+  u32         instance_idx;
+  Scene_Model model;
+  // which of the model's mesh charts
+  u32         mesh_chart;
+  // the rectangle in texels, padding included
+  s32         x;
+  s32         y;
+  s32         width;
+  s32         height;
+  // mesh uv to atlas uv: uv * xy + zw
+  v4f         uv_transform;
+} Lightmap_Chart;
+
+typedef struct
+{
+  s32             width;
+  s32             height;
+  // what the charts were packed at, texels_per_unit or a half of it
+  f32             texels_per_unit;
+  Lightmap_Chart *charts;
+  u32             chart_count;
+  // the static instances, each Lightmap_None or the first of its charts
+  u32             instance_count;
+  u32             first_chart[MaxSceneInstances];
+} Lightmap_Layout;
+
+// What a bake sees: the static part of scene through the BVH built from it,
+// with albedos as in Reflection_Bake. Rays that leave the scene return sky.
+typedef struct
+{
+  Scene_Instances     *scene;
+  Scene_Mesh          *meshes;
+  Bvh                 *bvh;
+  // what bvh was built from, for the normals at hits
+  Bvh_Source_Triangle *triangles;
+  // directional
+  Light                light;
+  v3f                  material_albedo[MaterialType_Count];
+  v3f                  sky;
+  u32                  sample_count;
+  u32                  bounce_count;
+} Lightmap_Bake;
+
+// nearest half, for the non-negative values a lightmap holds
+static u16              lightmap_pack_f16(f32 value);
+static f32              lightmap_unpack_f16(u16 packed);
+// Charts for the lit static instances of scene, packed at texels_per_unit
+// into the smallest atlas that holds them, halving the density until one
+// under Lightmap_MaxAtlasSize does.
+static void             lightmap_layout(Lightmap_Layout *layout, Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count], f32 texels_per_unit);
+static void             lightmap_layout_free(Lightmap_Layout *layout);
+// Fills texels (layout->width * layout->height); queue may be 0. The result
+// does not depend on the thread count.
+static void             lightmap_bake(Lightmap_Bake *bake, Lightmap_Layout *layout, v4f *texels, OS_Work_Queue *queue);
+static u64              lightmap_file_size(Lightmap_Layout *layout);
+static void             lightmap_encode(u8 *dest, Lightmap_Layout *layout, v4f *texels);
+// Validates a file in place; returns 0 if it is not one.
+static Lightmap_Header *lightmap_parse(u8 *data, u64 size);
+
+#endif
@@ -1,6 +1,5 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
-#include <timeapi.h>
 
 #define COBJMACROS
 #include <d3d11.h>
@@ -10,21 +9,65 @@
 #include <dxgidebug.h>
 #include <d3d11sdklayers.h>
 #include <d3dcompiler.h>
+#include <emmintrin.h>
 
 #include "base.h"
 #include "my_math.h"
 #include "os/os.h"
+#include "tex_pack.h"
+#include "scene.h"
+#include "scene_mesh.h"
+#include "tex_residency.h"
+#include "vtex.h"
+#include "asset_pack.h"
+#include "tex_file.h"
+#include "shadow.h"
+#include "light_cluster.h"
+#include "shader_permutation.h"
+#include "shader_cache.h"
+#include "reflection_probe.h"
+#include "bvh.h"
+#include "lightmap.h"
+#include "vertex_ao.h"
+#include "irradiance_volume.h"
+#include "pvs.h"
+#include "occlusion.h"
+#include "input_record.h"
+#include "profile.h"
 
 #include "my_math.c"
 #include "os/os_win32.c"
+#include "tex_pack.c"
+#include "scene.c"
+#include "scene_mesh.c"
+#include "tex_residency.c"
+#include "vtex.c"
+#include "asset_pack.c"
+#include "tex_file.c"
+#include "shadow.c"
+#include "light_cluster.c"
+#include "shader_permutation.c"
+#include "shader_cache.c"
+#include "reflection_probe.c"
+#include "bvh.c"
+#include "lightmap.c"
+#include "vertex_ao.c"
+#include "irradiance_volume.c"
+#include "pvs.c"
+#include "occlusion.c"
+#include "input_record.c"
+#include "profile.c"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "./ext/stb_image.h"
 
-static HWND   g_w32_window;
-static s32    g_w32_window_width;
-static s32    g_w32_window_height;
+static OS_Window g_os_window;
+static Input_Recorder g_input_recorder;
 
+// Compiled shaders are kept here, next to the executable, keyed by a hash of
+// shader_main.hlsl, its includes, the entry point, target, flags and defines.
+#define DX11_ShaderPath           "../code/shaders/shader_main.hlsl"
+#define DX11_ShaderCacheDirectory "shader_cache"
 #if defined(ENGINE_DEBUG)
 # define DX11_ShaderCompileFlags (D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR|D3DCOMPILE_SKIP_OPTIMIZATION|D3DCOMPILE_ENABLE_STRICTNESS|D3DCOMPILE_WARNINGS_ARE_ERRORS)
 #else
@@ -73,54 +116,8 @@ enum
         ShaderType_Count,
 };
 
-typedef struct
-{
-        v3f p;
-        v3f tangent, bitangent, normal;
-        v2f uv;
-} Model_Vertex;
-
-typedef struct
-{
-        m33 model_to_world_xform;
-        m33 model_to_world_xform_it;
-        v3f p;
-        v4f colour;
-        u32 enable_lighting;
-} Model_Instance;
-
-#define MaxLightCount 8
-typedef u16 Light_Type;
-enum
-{
-        LightType_Directional,
-        LightType_Spot,
-        LightType_Point,
-        LightType_Count,
-};
-
-typedef struct
-{
-        v3f P;
-        u32 type;
-        // ------------- 16 -------------- //
-        v4f intensity;
-        // ------------- 16 -------------- //
-        v3f dir;
-        f32 _pad_a;
-        // ------------- 16 -------------- //
-        m44 world_to_light;
-        // ------------- 16 -------------- //
-        m44 projection;
-} Light;
-
-#define MaxModelInstances 2048
-typedef struct
-{
-        Model_Instance ins[MaxModelInstances];
-        u64 count;
-} Model_Instances;
-
+// One Texture2DArray per map kind. Every material packed into the same
+// array bin shares these, and instances select their set by slice.
 typedef union
 {
         struct
@@ -131,7 +128,7 @@ typedef union
                 ID3D11ShaderResourceView         *displace_srv;
         };
         ID3D11ShaderResourceView *srvs[4];
-} DX11_Texture2D_PBR;
+} DX11_Texture2D_PBR_Array;
 
 __declspec(align(16)) typedef struct
 {
@@ -142,21 +139,59 @@ __declspec(align(16)) typedef struct
 __declspec(align(16)) typedef struct
 {
         // ------------- 16 -------------- //
-        u32 enable_texture;
         u32 enable_reflections;
-        f32 _pad_a[2];
+        f32 _pad_a[3];
+        // ------------- 16 -------------- //
+        v3f irradiance_origin;
+        f32 irradiance_spacing;
+        // ------------- 16 -------------- //
+        u32 irradiance_probe_count[3];
+        u32 enable_irradiance_volume;
 } DX11_CBuffer_Main1;
 
+// One per material array bin, bound alongside the bin's SRVs. Holds whether
+// the bin's displacement carries cone step ratios (see cone_step.h).
+__declspec(align(16)) typedef struct
+{
+        u32 cone_step_enabled;
+        u32 _pad_a[3];
+} DX11_CBuffer_Material;
+
+// Describes the bound virtual texture (see vtex.h) and which texel of each
+// 8x8 block writes feedback this frame.
+__declspec(align(16)) typedef struct
+{
+        v2f virtual_size;
+        f32 mip_count;
+        f32 physical_size;
+        // ------------- 16 -------------- //
+        u32 feedback_jitter_x;
+        u32 feedback_jitter_y;
+        u32 _pad_a[2];
+} DX11_CBuffer_VTex;
+
 __declspec(align(16)) typedef struct
 {
         v3f eye_p;
-        u32 light_count;
+        u32 directional_light_count;
         // ------------- 16 -------------- //
-        
-        Light lights[MaxLightCount];
-        // ------------- sizeof(lights) % 16 == 0 -------------- //
+        v2f cluster_tiles_per_pixel;
+        f32 cluster_z_scale;
+        f32 cluster_z_bias;
 } DX11_CBuffer_Main2;
 
+__declspec(align(16)) typedef struct
+{
+        m44 cascade_world_to_clip[Shadow_CascadeCount];
+        // ------------- 16 -------------- //
+        // depth bias per cascade, in clip z
+        v4f cascade_depth_bias;
+        // ------------- 16 -------------- //
+        // the slice vs_depth_only is drawing into
+        u32 cascade_current;
+        u32 _pad_a[3];
+} DX11_CBuffer_Shadow;
+
 typedef struct
 {
         ID3D11Buffer *vbuffer, *ibuffer;
@@ -165,7 +200,15 @@ typedef struct
 
 // Main renderer state
 static ID3D11VertexShader               *g_dx11_vshader_main;
-static ID3D11PixelShader                *g_dx11_pshader_main;
+// ps_main variants by Shader_Key, looked up in the shader cache at init
+static ID3D11PixelShader                *g_dx11_pshader_variants[ShaderKey_Count];
+static Shader_Define                     g_dx11_pshader_defines[ShaderKey_Count][ShaderKey_MaxDefines];
+static Shader_Cache_Job                  g_dx11_pshader_jobs[ShaderKey_Count];
+static u32                               g_dx11_pshader_instruction_counts[ShaderKey_Count];
+// ps_main with every feature decided per pixel, for comparison
+static u32                               g_dx11_pshader_uber_instruction_count;
+static Shader_Cache                      g_shader_cache;
+static OS_Work_Queue                    *g_shader_queue;
 static ID3D11Buffer                     *g_dx11_cbuffer_main0;
 static ID3D11Buffer                     *g_dx11_cbuffer_main1;
 static ID3D11Buffer                     *g_dx11_cbuffer_main2;
@@ -174,50 +217,110 @@ static ID3D11Buffer                     *g_dx11_sbuffer_model_instances;
 static ID3D11ShaderResourceView         *g_dx11_sbuffer_model_instances_srv;
 static D3D11_VIEWPORT                    g_dx11_viewport_main;
 static u32                               g_light_count;
+static u32                               g_directional_light_count;
 static Light                             g_lights[MaxLightCount];
 static f32                               g_first_light_t;
 
+// Clustered lighting. Binning runs on its own queue so it never waits
+// behind streaming loads on g_work_queue.
+static OS_Work_Queue                    *g_light_cluster_queue;
+static Light_Cluster_Grid                g_light_cluster_grid;
+static ID3D11Buffer                     *g_dx11_sbuffer_lights;
+static ID3D11Buffer                     *g_dx11_sbuffer_light_clusters;
+static ID3D11Buffer                     *g_dx11_sbuffer_light_indices;
+// t9..t11: lights, clusters, indices
+static ID3D11ShaderResourceView         *g_dx11_light_srvs[3];
+// t12, a cube array of the baked probes (reflection_probe.h); 0 without a file
+static ID3D11ShaderResourceView         *g_dx11_reflection_probe_srv;
+// t13 and t14, the baked lightmap (lightmap.h) and its chart transforms; 0
+// without a file
+static ID3D11ShaderResourceView         *g_dx11_lightmap_srv;
+static ID3D11ShaderResourceView         *g_dx11_lightmap_charts_srv;
+// t15, the baked per vertex occlusion (vertex_ao.h); 0 without a file
+static ID3D11ShaderResourceView         *g_dx11_vertex_ao_srv;
+// t16, the baked irradiance probes (irradiance_volume.h); 0 without a file
+static ID3D11ShaderResourceView         *g_dx11_irradiance_volume_srv;
+
 static D3D11_VIEWPORT                    g_dx11_shadow_map_vp;
 static ID3D11VertexShader               *g_dx11_vshader_shadow;
+static ID3D11Buffer                     *g_dx11_cbuffer_shadow;
 static ID3D11Texture2D                  *g_dx11_shadow_map_tex;
 static ID3D11ShaderResourceView         *g_dx11_shadow_map_srv;
-static ID3D11DepthStencilView           *g_dx11_shadow_map_dsv;
+// one per cascade slice of g_dx11_shadow_map_tex
+static ID3D11DepthStencilView           *g_dx11_shadow_map_dsvs[Shadow_CascadeCount];
+// static casters only, copied into g_dx11_shadow_map_tex every frame
+static ID3D11Texture2D                  *g_dx11_shadow_static_tex;
+static ID3D11DepthStencilView           *g_dx11_shadow_static_dsvs[Shadow_CascadeCount];
+static Shadow_Cache                      g_shadow_cache;
+static u64                               g_shadow_frame;
+static Shadow_Cascades                   g_shadow_cascades;
+// the casters of the cascade being drawn, rebuilt per cascade every frame
+static Scene_Instances                  g_shadow_cascade_scene;
+// the baked visible sets (pvs.h) and what the shaded pass keeps of g_scene
+static OS_File_Map                      g_pvs_map;
+static Pvs_View                         g_pvs_view;
+static Scene_Instances                  g_pvs_scene;
+static u64                              g_pvs_frame;
+static u64                              g_pvs_frames_filtered;
+static u64                              g_pvs_culled_instances;
+// the occluder depth buffer (occlusion.h) and what survives it of the pass above
+static Occlusion_Buffer                 g_occlusion;
+static Scene_Instances                  g_occlusion_scene;
+static u64                              g_occlusion_frame;
+
+// The bound SRVs hold each bin's resident mips only; the full chains stay in
+// system memory, in staging textures, for dx11_update_material_residency to
+// copy back from.
+#define MaterialArray_MapCount           3
+static DX11_Texture2D_PBR_Array         g_dx11_material_arrays[TexPack_MaxArrays];
+static ID3D11Texture2D                 *g_dx11_material_array_sources[TexPack_MaxArrays][MaterialArray_MapCount];
+static u32                              g_dx11_material_array_resident_mip[TexPack_MaxArrays];
+static ID3D11Buffer                    *g_dx11_material_array_cbuffers[TexPack_MaxArrays];
+static b32                              g_dx11_material_array_cone_step[TexPack_MaxArrays];
+static u32                              g_dx11_material_array_count;
+static u32                              g_dx11_current_material_array;
+static Tex_Pack_Slot                    g_material_slots[MaterialType_Count];
+
+#define Residency_DefaultBudget          MB(96)
+#define Residency_DefaultLoadPerFrame    MB(8)
+static Residency_Manager                g_residency;
+// residency is per bin, as a bin's slices share one mip chain
+static u32                              g_material_texture_ids[MaterialType_Count];
+static u32                              g_material_array_texture_ids[TexPack_MaxArrays];
+
+static Scene_Instances                  g_scene;
+
+static Asset_Pack                       g_asset_pack;
 
-static DX11_Texture2D_PBR g_gray_brick_tex;
-static DX11_Texture2D_PBR g_oak_trunk_tex;
+// One material at a time may be virtual. Its instances carry
+// TextureSlice_VirtualBit and sample through the page table instead of a bin.
+#define DX11_VTex_FeedbackDivisor         8
+#define DX11_VTex_ReadbackLatency         3
+static OS_Work_Queue                   *g_work_queue;
+static VTex_System                      g_vtex;
+static b32                              g_vtex_enabled;
+static u32                             *g_vtex_feedback_texels;
+static u32                              g_vtex_feedback_width;
+static u32                              g_vtex_feedback_height;
+static u64                              g_vtex_frame;
+static ID3D11Texture2D                 *g_dx11_vtex_physical_texs[VTexLayer_Count];
+static ID3D11Texture2D                 *g_dx11_vtex_page_table_tex;
+// t5 is the page table, t6..t8 the physical caches in VTex_Layer order
+static ID3D11ShaderResourceView        *g_dx11_vtex_srvs[1 + VTexLayer_Count];
+static ID3D11Texture2D                 *g_dx11_vtex_feedback_tex;
+static ID3D11UnorderedAccessView       *g_dx11_vtex_feedback_uav;
+static ID3D11Texture2D                 *g_dx11_vtex_feedback_staging[DX11_VTex_ReadbackLatency];
+static ID3D11Buffer                    *g_dx11_vtex_cbuffer;
 
 static DX11_Model *g_dx11_current_model;
 static DX11_Model  g_dx11_cube_model;
 static DX11_Model  g_dx11_sphere_model;
 static DX11_Model  g_dx11_cylinder_model;
+static DX11_Model *g_dx11_scene_models[SceneModel_Count];
 
 static UINT g_model_vertices_stride   = sizeof(Model_Vertex);
 static UINT g_model_vertices_offsets  = 0;
 
-static Light
-create_directional_light(v3f P, v3f look_P, v4f intensity)
-{
-        Basis_R3 light_basis   = br3_from_center_to_target(P, look_P, (v3f){ 0.0f, 1.0f, 0.0f });
-        
-        Light result =
-        {
-                .P              = P,
-                .type           = LightType_Directional,
-                .intensity      = intensity,
-                .dir            = v3f_sub(look_P, P),
-                .world_to_light =
-                {
-                        light_basis.x.x, light_basis.y.x, light_basis.z.x, 0.0f,
-                        light_basis.x.y, light_basis.y.y, light_basis.z.y, 0.0f,
-                        light_basis.x.z, light_basis.y.z, light_basis.z.z, 0.0f,
-                        -v3f_inner(light_basis.x, P), -v3f_inner(light_basis.y, P), -v3f_inner(light_basis.z, P), 1.0f
-                },
-                .projection      = m44_make_orthographic_z01(-50, 50, -50, 50, 0.0f, 1000.0f)
-        };
-        
-        return(result);
-}
-
 static DX11_Model
 dx11_create_model(f32 *vbuffer, u32 vbuffer_size_in_bytes, u32 struct_size,
                   u32 *ibuffer, u32 ibuffer_length)
@@ -266,23 +369,24 @@ dx11_create_model(f32 *vbuffer, u32 vbuffer_size_in_bytes, u32 struct_size,
         return(result);
 }
 
-static ID3D11ShaderResourceView *
-dx11_create_texture2d_mipmapped(char *filename)
+// Uploads mip 0 of each slice, lets the GPU build the rest of the chain and
+// copies the lot into a staging texture, the source the resident copy is
+// cut from (see dx11_create_resident_texture2d_array).
+static ID3D11Texture2D *
+dx11_create_texture2d_array_mipmapped(u8 **slices, u32 slice_count, s32 texture_width, s32 texture_height)
 {
         ID3D11Texture2D          *tex    = 0;
-        ID3D11ShaderResourceView *result = 0;
+        ID3D11ShaderResourceView *srv    = 0;
+        ID3D11Texture2D          *result = 0;
         
-        s32 texture_comp              = 0;
         s32 texture_bpp               = 4;
-        s32 texture_width             = 0;
-        s32 texture_height            = 0;
-        u8 *texture_data              = stbi_load(filename, &texture_width, &texture_height, &texture_comp, 4);
+        u32 mip_count                 = tex_pack_mip_count(texture_width, texture_height);
         
         D3D11_TEXTURE2D_DESC tex_desc;
         tex_desc.Width               = texture_width;
         tex_desc.Height              = texture_height;
-        tex_desc.MipLevels           = 0;
-        tex_desc.ArraySize           = 1;
+        tex_desc.MipLevels           = mip_count;
+        tex_desc.ArraySize           = slice_count;
         tex_desc.Format              = DXGI_FORMAT_R8G8B8A8_UNORM;
         tex_desc.SampleDesc.Count    = 1;
         tex_desc.SampleDesc.Quality  = 0;
@@ -293,332 +397,153 @@ dx11_create_texture2d_mipmapped(char *filename)
         
         AssertHR(ID3D11Device1_CreateTexture2D(g_dx11_dev, &tex_desc, 0, &tex));
         
-        ID3D11DeviceContext_UpdateSubresource(g_dx11_dev_cont, (ID3D11Resource *)tex, 0, 0, texture_data, texture_width * texture_bpp, 0);
+        for (u32 slice = 0; slice < slice_count; ++slice)
+        {
+                UINT subresource = D3D11CalcSubresource(0, slice, mip_count);
+                ID3D11DeviceContext_UpdateSubresource(g_dx11_dev_cont, (ID3D11Resource *)tex, subresource, 0, slices[slice], texture_width * texture_bpp, 0);
+        }
         
         D3D11_SHADER_RESOURCE_VIEW_DESC tex_srv_desc =
         {
                 .Format             = tex_desc.Format,
-                .ViewDimension      = D3D11_SRV_DIMENSION_TEXTURE2D,
-                .Texture2D          = { .MostDetailedMip = 0, .MipLevels = (UINT)(-1) }
+                .ViewDimension      = D3D11_SRV_DIMENSION_TEXTURE2DARRAY,
+                .Texture2DArray     = { .MostDetailedMip = 0, .MipLevels = (UINT)(-1), .FirstArraySlice = 0, .ArraySize = slice_count }
         };
         
-        AssertHR(ID3D11Device1_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)tex, &tex_srv_desc, &result));
+        AssertHR(ID3D11Device1_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)tex, &tex_srv_desc, &srv));
         
-        ID3D11DeviceContext_GenerateMips(g_dx11_dev_cont, result);
+        ID3D11DeviceContext_GenerateMips(g_dx11_dev_cont, srv);
         
+        tex_desc.Usage               = D3D11_USAGE_STAGING;
+        tex_desc.BindFlags           = 0;
+        tex_desc.CPUAccessFlags      = D3D11_CPU_ACCESS_READ;
+        tex_desc.MiscFlags           = 0;
+        AssertHR(ID3D11Device1_CreateTexture2D(g_dx11_dev, &tex_desc, 0, &result));
+        ID3D11DeviceContext_CopyResource(g_dx11_dev_cont, (ID3D11Resource *)result, (ID3D11Resource *)tex);
+        
+        ID3D11ShaderResourceView_Release(srv);
         ID3D11Texture2D_Release(tex);
-        stbi_image_free(texture_data);
-        return(result);
-}
-
-static Model_Instance *
-add_model_instance(Model_Instances *instances, v3f p, v3f scale, m33 rotate, v4f colour)
-{
-        Assert(instances->count < MaxModelInstances);
-        Model_Instance *result = instances->ins + instances->count++;
-        
-        result->model_to_world_xform                  = m33_mul(m33_make_diag(scale), rotate);
-        result->model_to_world_xform_it               = m33_mul(m33_make_diag((v3f) { 1.0f / scale.x, 1.0f / scale.y, 1.0f / scale.z }), rotate);
-        result->p                                     = p;
-        result->colour                                = colour;
-        result->enable_lighting                       = 1;
         return(result);
 }
 
-static DX11_Model
-create_plane_model(void)
+// Baked containers already carry their mips, and their memory can be handed
+// to D3D as is (it points into the asset pack mapping). Like the above, this
+// makes the staging source only.
+static ID3D11Texture2D *
+dx11_create_texture2d_array_from_tex_files(Tex_File_Header **slices, u32 slice_count)
 {
-        // p <-> tangent <-> bitangent <-> normal <-> uv
-        f32 plane_vbuffer[] =
+        ID3D11Texture2D          *result = 0;
+        Tex_File_Header          *first  = slices[0];
+        
+        DXGI_FORMAT formats[TexFileFormat_Count] =
         {
-                -0.5f, +0.5f, +0.0f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         0.0f, 0.0f,
-                -0.5f, -0.5f, +0.0f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         0.0f, 1.0f,
-                +0.5f, -0.5f, +0.0f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         1.0f, 1.0f,
-                +0.5f, +0.5f, +0.0f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         1.0f, 0.0f,
+                [TexFileFormat_RGBA8] = DXGI_FORMAT_R8G8B8A8_UNORM,
+                [TexFileFormat_BC5]   = DXGI_FORMAT_BC5_UNORM,
+                [TexFileFormat_RG8]   = DXGI_FORMAT_R8G8_UNORM,
         };
         
-        u32 plane_ibuffer[] = { 0, 1, 2, 2, 3, 0 };
-        
-        return dx11_create_model(plane_vbuffer, sizeof(plane_vbuffer), sizeof(Model_Vertex), 
-                                 plane_ibuffer, ArrayCount(plane_ibuffer));
-}
-
-static DX11_Model
-create_sphere_model(f32 radius, u32 quality)
-{
-        HANDLE heap = GetProcessHeap();
-        DX11_Model result;
-        
-        u32 horizontal = quality * 2;
-        u32 vertical   = quality * 2;
-        f32 theta_step = (2.0f * PIF32) / (f32)horizontal;
-        
-        u32             vertex_count        = (vertical + 1) * (horizontal + 1);
-        u32             vertex_index        = 0;
-        Model_Vertex   *vertices            = HeapAlloc(heap, HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE, vertex_count * sizeof(Model_Vertex));
-        
-        u32 index_count   = vertical * horizontal * 6;
-        u32 index_index   = 0;
-        u32 *indices      = HeapAlloc(heap, HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE, index_count * sizeof(u32));
-        
-        for (u32 vert = 0; vert < (vertical + 1); ++vert)
+        D3D11_SUBRESOURCE_DATA subresources[TexPack_MaxSlicesPerArray * TexFile_MaxMips];
+        for (u32 slice = 0; slice < slice_count; ++slice)
         {
-                for (u32 hori = 0; hori < (horizontal + 1); ++hori)
+                Tex_File_Header *header = slices[slice];
+                Assert((header->format == first->format) && (header->width == first->width) &&
+                       (header->height == first->height) && (header->mip_count == first->mip_count));
+                for (u32 mip = 0; mip < header->mip_count; ++mip)
                 {
-                        f32 c = cosf(hori * theta_step);
-                        f32 s = sinf(vert * theta_step);
-                        
-                        f32 cc = cosf(vert * theta_step);
-                        f32 ss = sinf(hori * theta_step);
-                        
-                        f32 x = c * s;
-                        f32 y = cc;
-                        f32 z = ss * s;
-                        v3f tangent     = { -(f32)hori * ss * s + (f32)vert * c * cc, -(f32)vert * s, (f32)hori * c * s + (f32)vert * ss * cc };
-                        v3f normal      = { x, y, z };
-                        vertices[vertex_index++] = (Model_Vertex)
-                        {
-                                .p           = { radius * x, radius * y, radius * z },
-                                .uv          = { (f32)hori / (f32)horizontal, (f32)vert / (f32)vertical },
-                                .normal      = normal,
-                                .tangent     = tangent,
-                                .bitangent   = v3f_cross(tangent, normal)
-                        };
+                        D3D11_SUBRESOURCE_DATA *subresource = subresources + D3D11CalcSubresource(mip, slice, first->mip_count);
+                        subresource->pSysMem            = (u8 *)header + header->mip_offsets[mip];
+                        subresource->SysMemPitch        = tex_file_row_pitch(header->format, Maximum(header->width >> mip, 1));
+                        subresource->SysMemSlicePitch   = 0;
                 }
         }
         
-        Assert(vertex_index == vertex_count);
-        
-        for (u32 vert = 0; vert < vertical; ++vert)
+        D3D11_TEXTURE2D_DESC tex_desc =
         {
-                for (u32 hori = 0; hori < horizontal; ++hori)
-                {
-                        indices[index_index++] = (vert + 1) * (horizontal + 1) + (hori + 0);
-                        indices[index_index++] = (vert + 0) * (horizontal + 1) + (hori + 0);
-                        indices[index_index++] = (vert + 0) * (horizontal + 1) + (hori + 1);
-                        
-                        indices[index_index++] = (vert + 0) * (horizontal + 1) + (hori + 1);
-                        indices[index_index++] = (vert + 1) * (horizontal + 1) + (hori + 1);
-                        indices[index_index++] = (vert + 1) * (horizontal + 1) + (hori + 0);
-                }
-        }
-        
-        Assert(index_index == index_count);
-        result = dx11_create_model((f32 *)vertices, vertex_count * sizeof(Model_Vertex),
-                                   sizeof(Model_Vertex),
-                                   indices, index_count);
+                .Width               = first->width,
+                .Height              = first->height,
+                .MipLevels           = first->mip_count,
+                .ArraySize           = slice_count,
+                .Format              = formats[first->format],
+                .SampleDesc          = { 1, 0 },
+                .Usage               = D3D11_USAGE_STAGING,
+                .CPUAccessFlags      = D3D11_CPU_ACCESS_READ,
+        };
         
-        HeapFree(heap, HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE, vertices);
-        HeapFree(heap, HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE, indices);
+        AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &tex_desc, subresources, &result));
         return(result);
 }
 
-
-static DX11_Model
-create_cylinder_model(f32 bottom_radius, f32 top_radius,
-                      f32 height, u32 slice_count, u32 stack_count)
+// The copy the shaders sample: the source's chain from first_mip down, so
+// mip 0 of the result is the most detailed resident one. Sampling needs no
+// clamp, as the hardware measures gradients against the smaller size and
+// lands on the same texels it would have in the full chain.
+static ID3D11ShaderResourceView *
+dx11_create_resident_texture2d_array(ID3D11Texture2D *source, u32 first_mip)
 {
-        HANDLE heap = GetProcessHeap();
-        DX11_Model result;
-        
-        f32 stack_height   = height / (f32)stack_count;
-        f32 delta_radius   = (top_radius - bottom_radius) / (f32)stack_count;
-        f32 delta_theta    = (2.0f * PIF32) / (f32)slice_count;
-        u32 ring_count     = stack_count + 1;
-        
-        u32             vertex_count    = ring_count * (slice_count + 1) + (slice_count + 1) * 2 + 2;
-        u32             vertex_index    = 0;
-        Model_Vertex   *vertices        = HeapAlloc(heap, HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE, vertex_count * sizeof(Model_Vertex));
-        
-        u32 index_count   = stack_count * slice_count * 6 + slice_count * 6;
-        u32 index_index   = 0;
-        u32 *indices      = HeapAlloc(heap, HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE, index_count * sizeof(u32));
-        for (u32 ring_idx = 0; ring_idx < ring_count; ++ring_idx)
-        {
-                f32 y = -0.5f * height + (f32)ring_idx * stack_height;
-                f32 r = bottom_radius + (f32)ring_idx * delta_radius;
-                
-                for (u32 slice_idx = 0; slice_idx <= slice_count; ++slice_idx)
-                {
-                        Model_Vertex vertex;
-                        
-                        f32 c = cosf((f32)slice_idx * delta_theta);
-                        f32 s = sinf((f32)slice_idx * delta_theta);
-                        
-                        f32 dr           = bottom_radius - top_radius;
-                        vertex.p         = (v3f) { r * c, y, r * s };
-                        vertex.uv        = (v2f) { (f32)slice_idx / (f32)slice_count, 1.0f - (f32)ring_idx / (f32)stack_count };
-                        vertex.tangent   = (v3f) {  -s, 0, c };
-                        vertex.bitangent = (v3f) { dr * c, -height, dr * s };
-                        vertex.normal    = v3f_cross(vertex.tangent, vertex.bitangent);
-                        
-                        vertices[vertex_index++] = vertex;
-                }
-        }
-        
-        u32 start_top_idx = vertex_index;
-        f32 top_y = height * 0.5f;
-        for (u32 slice_idx = 0; slice_idx <= slice_count; ++slice_idx)
-        {
-                f32 x = top_radius * cosf(slice_idx * delta_theta);
-                f32 z = top_radius * sinf(slice_idx * delta_theta);
-                
-                Model_Vertex vertex =
-                {
-                        .p          = { x, top_y, z },
-                        .uv         = { x / height + 0.5f, z / height + 0.5f },
-                        .tangent    = { 1.0f, 0.0f, 0.0f },
-                        .normal     = { 0.0f, 1.0f, 0.0f },
-                        .bitangent  = { 0.0f, 0.0f, 1.0f },
-                };
-                
-                vertices[vertex_index++] = vertex;
-        }
-        
-        u32 top_center_idx = vertex_index++;
-        vertices[top_center_idx] = (Model_Vertex)
-        {
-                .p           = { 0.0f, top_y, 0.0f },
-                .uv          = { 0.5f, 0.5f },
-                .tangent     = { 1.0f, 0.0f, 0.0f },
-                .normal      = { 0.0f, 1.0f, 0.0f },
-                .bitangent   = { 0.0f, 0.0f, 1.0f },
-        };
-        
-        u32 start_bottom_idx = vertex_index;
-        f32 bottom_y = -height * 0.5f;
-        for (u32 slice_idx = 0; slice_idx <= slice_count; ++slice_idx)
-        {
-                f32 x = bottom_radius * cosf(slice_idx * delta_theta);
-                f32 z = bottom_radius * sinf(slice_idx * delta_theta);
-                
-                Model_Vertex vertex =
-                {
-                        .p          = { x, bottom_y, z },
-                        .uv         = { x / height + 0.5f, z / height + 0.5f },
-                        .tangent    = { 1.0f, 0.0f, 0.0f },
-                        .normal     = { 0.0f, -1.0f, 0.0f },
-                        .bitangent  = { 0.0f, 0.0f, -1.0f },
-                };
-                
-                vertices[vertex_index++] = vertex;
-        }
+        ID3D11Texture2D          *tex    = 0;
+        ID3D11ShaderResourceView *result = 0;
         
-        u32 bottom_center_idx = vertex_index++;
-        vertices[bottom_center_idx] = (Model_Vertex)
-        {
-                .p           = { 0.0f, bottom_y, 0.0f },
-                .uv          = { 0.5f, 0.5f },
-                .tangent     = { 1.0f, 0.0f, 0.0f },
-                .normal      = { 0.0f, -1.0f, 0.0f },
-                .bitangent   = { 0.0f, 0.0f, -1.0f },
-        };
+        D3D11_TEXTURE2D_DESC source_desc;
+        ID3D11Texture2D_GetDesc(source, &source_desc);
+        first_mip = Minimum(first_mip, source_desc.MipLevels - 1);
         
-        Assert(vertex_index == vertex_count);
+        D3D11_TEXTURE2D_DESC tex_desc = source_desc;
+        tex_desc.Width               = Maximum(source_desc.Width >> first_mip, 1);
+        tex_desc.Height              = Maximum(source_desc.Height >> first_mip, 1);
+        tex_desc.MipLevels           = source_desc.MipLevels - first_mip;
+        tex_desc.Usage               = D3D11_USAGE_DEFAULT;
+        tex_desc.BindFlags           = D3D11_BIND_SHADER_RESOURCE;
+        tex_desc.CPUAccessFlags      = 0;
+        tex_desc.MiscFlags           = 0;
+        // block compressed mip 0 must be whole blocks; the residency floor keeps it well above that
+        Assert((tex_desc.Format != DXGI_FORMAT_BC5_UNORM) || (!(tex_desc.Width % 4) && !(tex_desc.Height % 4)));
         
-        for (u32 stack_idx = 0; stack_idx < stack_count; ++stack_idx)
+        AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &tex_desc, 0, &tex));
+        for (u32 slice = 0; slice < tex_desc.ArraySize; ++slice)
         {
-                for (u32 slice_idx = 0; slice_idx < slice_count; ++slice_idx)
+                for (u32 mip = 0; mip < tex_desc.MipLevels; ++mip)
                 {
-                        indices[index_index++] = (stack_idx + 1) * (slice_count + 1) + (slice_idx + 0);
-                        indices[index_index++] = (stack_idx + 0) * (slice_count + 1) + (slice_idx + 0);
-                        indices[index_index++] = (stack_idx + 0) * (slice_count + 1) + (slice_idx + 1);
-                        
-                        indices[index_index++] = (stack_idx + 0) * (slice_count + 1) + (slice_idx + 1);
-                        indices[index_index++] = (stack_idx + 1) * (slice_count + 1) + (slice_idx + 1);
-                        indices[index_index++] = (stack_idx + 1) * (slice_count + 1) + (slice_idx + 0);
+                        UINT dest_subresource   = D3D11CalcSubresource(mip, slice, tex_desc.MipLevels);
+                        UINT source_subresource = D3D11CalcSubresource(first_mip + mip, slice, source_desc.MipLevels);
+                        ID3D11DeviceContext_CopySubresourceRegion(g_dx11_dev_cont, (ID3D11Resource *)tex, dest_subresource, 0, 0, 0,
+                                                                  (ID3D11Resource *)source, source_subresource, 0);
                 }
         }
         
-        for (u32 slice_idx = 0; slice_idx < slice_count; ++slice_idx)
-        {
-                indices[index_index++] = top_center_idx;
-                indices[index_index++] = start_top_idx + slice_idx;
-                indices[index_index++] = start_top_idx + slice_idx + 1;
-        }
-        
-        for (u32 slice_idx = 0; slice_idx < slice_count; ++slice_idx)
-        {
-                indices[index_index++] = bottom_center_idx;
-                indices[index_index++] = start_bottom_idx + slice_idx + 1;
-                indices[index_index++] = start_bottom_idx + slice_idx;
-        }
-        Assert(index_index == index_count);
-        
-        result = dx11_create_model((f32 *)vertices, vertex_count * sizeof(Model_Vertex), sizeof(Model_Vertex),
-                                   indices, index_count);
+        AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)tex, 0, &result));
         
-        HeapFree(heap, HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE, vertices);
-        HeapFree(heap, HEAP_GENERATE_EXCEPTIONS | HEAP_NO_SERIALIZE, indices);
+        ID3D11Texture2D_Release(tex);
         return(result);
 }
 
-
 static DX11_Model
-create_cube_model(void)
+create_plane_model(void)
 {
-        // p <-> tangent <-> bitangent <-> normal <-> uv
-        f32 vbuffer[] =
-        {
-                // front face
-                -0.5f, +0.5f, -0.5f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         0.0f, 0.0f,
-                -0.5f, -0.5f, -0.5f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         0.0f, 1.0f,
-                +0.5f, -0.5f, -0.5f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         1.0f, 1.0f,
-                +0.5f, +0.5f, -0.5f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         1.0f, 0.0f,
-                
-                // right face
-                +0.5f, +0.5f, -0.5f,     +0.0f, +0.0f, +1.0f,     +0.0f, +1.0f, 0.0f,    +1.0f, +0.0f, +0.0f,     0.0f, 0.0f,
-                +0.5f, -0.5f, -0.5f,     +0.0f, +0.0f, +1.0f,     +0.0f, +1.0f, 0.0f,    +1.0f, +0.0f, +0.0f,     0.0f, 1.0f,
-                +0.5f, -0.5f, +0.5f,     +0.0f, +0.0f, +1.0f,     +0.0f, +1.0f, 0.0f,    +1.0f, +0.0f, +0.0f,     1.0f, 1.0f,
-                +0.5f, +0.5f, +0.5f,     +0.0f, +0.0f, +1.0f,     +0.0f, +1.0f, 0.0f,    +1.0f, +0.0f, +0.0f,     1.0f, 0.0f,
-                
-                // back face
-                +0.5f, +0.5f, +0.5f,     -1.0f, +0.0f, +0.0f,     +0.0f, +1.0f, +0.0f,   +0.0f, +0.0f, +1.0f,     0.0f, 0.0f,
-                +0.5f, -0.5f, +0.5f,     -1.0f, +0.0f, +0.0f,     +0.0f, +1.0f, +0.0f,   +0.0f, +0.0f, +1.0f,     0.0f, 1.0f,
-                -0.5f, -0.5f, +0.5f,     -1.0f, +0.0f, +0.0f,     +0.0f, +1.0f, +0.0f,   +0.0f, +0.0f, +1.0f,     1.0f, 1.0f,
-                -0.5f, +0.5f, +0.5f,     -1.0f, +0.0f, +0.0f,     +0.0f, +1.0f, +0.0f,   +0.0f, +0.0f, +1.0f,     1.0f, 0.0f,
-                
-                // left face
-                -0.5f, +0.5f, +0.5f,     +0.0f, +0.0f, -1.0f,     +0.0f, +1.0f, +0.0f,   -1.0f, +0.0f, +0.0f,     0.0f, 0.0f,
-                -0.5f, -0.5f, +0.5f,     +0.0f, +0.0f, -1.0f,     +0.0f, +1.0f, +0.0f,   -1.0f, +0.0f, +0.0f,     0.0f, 1.0f,
-                -0.5f, -0.5f, -0.5f,     +0.0f, +0.0f, -1.0f,     +0.0f, +1.0f, +0.0f,   -1.0f, +0.0f, +0.0f,     1.0f, 1.0f,
-                -0.5f, +0.5f, -0.5f,     +0.0f, +0.0f, -1.0f,     +0.0f, +1.0f, +0.0f,   -1.0f, +0.0f, +0.0f,     1.0f, 0.0f,
-                
-                // top face
-                -0.5f, +0.5f, +0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, +1.0f,   +0.0f, +1.0f, +0.0f,     0.0f, 0.0f,
-                -0.5f, +0.5f, -0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, +1.0f,   +0.0f, +1.0f, +0.0f,     0.0f, 1.0f,
-                +0.5f, +0.5f, -0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, +1.0f,   +0.0f, +1.0f, +0.0f,     1.0f, 1.0f,
-                +0.5f, +0.5f, +0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, +1.0f,   +0.0f, +1.0f, +0.0f,     1.0f, 0.0f,
-                
-                // bottom face
-                -0.5f, -0.5f, -0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, -1.0f,   +0.0f, -1.0f, +0.0f,     0.0f, 0.0f,
-                -0.5f, -0.5f, +0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, -1.0f,   +0.0f, -1.0f, +0.0f,     0.0f, 1.0f,
-                +0.5f, -0.5f, +0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, -1.0f,   +0.0f, -1.0f, +0.0f,     1.0f, 1.0f,
-                +0.5f, -0.5f, -0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, -1.0f,   +0.0f, -1.0f, +0.0f,     1.0f, 0.0f,
+        // p <-> tangent <-> bitangent <-> normal <-> uv <-> lightmap chart (0.0f has
+        // the bits of chart 0)
+        f32 plane_vbuffer[] =
+        {
+                -0.5f, +0.5f, +0.0f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         0.0f, 0.0f,    0.0f,
+                -0.5f, -0.5f, +0.0f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         0.0f, 1.0f,    0.0f,
+                +0.5f, -0.5f, +0.0f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         1.0f, 1.0f,    0.0f,
+                +0.5f, +0.5f, +0.0f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         1.0f, 0.0f,    0.0f,
         };
         
-        u32 ibuffer[] = {
-                0, 1, 2,
-                2, 3, 0,
-                
-                4, 5, 6,
-                6, 7, 4,
-                
-                8, 9, 10,
-                10, 11, 8,
-                
-                12, 13, 14,
-                14, 15, 12,
-                
-                16, 17, 18,
-                18, 19, 16,
-                
-                20, 21, 22,
-                22, 23, 20,
-        };
+        u32 plane_ibuffer[] = { 0, 1, 2, 2, 3, 0 };
         
-        return dx11_create_model(vbuffer, sizeof(vbuffer), sizeof(Model_Vertex),
-                                 ibuffer, ArrayCount(ibuffer));
+        return dx11_create_model(plane_vbuffer, sizeof(plane_vbuffer), sizeof(Model_Vertex), 
+                                 plane_ibuffer, ArrayCount(plane_ibuffer));
+}
+
+// the same triangles the CPU side sees (scene_mesh.h)
+static DX11_Model
+dx11_create_scene_model(Scene_Model model)
+{
+        Scene_Mesh mesh   = scene_mesh_for_model(model);
+        DX11_Model result = dx11_create_model((f32 *)mesh.vertices, mesh.vertex_count * sizeof(Model_Vertex), sizeof(Model_Vertex),
+                                              mesh.indices, mesh.index_count);
+        scene_mesh_free(&mesh);
+        return(result);
 }
 
 static void
@@ -705,11 +630,11 @@ dx11_create_swap_chain(void)
                                 swap_chain_desc.AlphaMode          = DXGI_ALPHA_MODE_UNSPECIFIED;
                                 swap_chain_desc.Flags              = 0;
                                 
-                                if (SUCCEEDED(IDXGIFactory2_CreateSwapChainForHwnd(dxgi_factory, (IUnknown *)g_dx11_dev, g_w32_window,
+                                if (SUCCEEDED(IDXGIFactory2_CreateSwapChainForHwnd(dxgi_factory, (IUnknown *)g_dx11_dev, (HWND)g_os_window.handle,
                                                                                    &swap_chain_desc, 0, 0,
                                                                                    &g_dxgi_swap_chain)))
                                 {
-                                        IDXGIFactory2_MakeWindowAssociation(dxgi_factory, g_w32_window, DXGI_MWA_NO_ALT_ENTER);
+                                        IDXGIFactory2_MakeWindowAssociation(dxgi_factory, (HWND)g_os_window.handle, DXGI_MWA_NO_ALT_ENTER);
                                         
                                         if (SUCCEEDED(IDXGISwapChain1_GetBuffer(g_dxgi_swap_chain, 0, &IID_ID3D11Texture2D, &back_buffer_tex)))
                                         {
@@ -844,7 +769,8 @@ dx11_create_sampler_states(void)
         sam_desc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
         AssertHR(ID3D11Device1_CreateSamplerState(g_dx11_dev, &sam_desc, &g_dx11_sampler_point_all));
         
-        sam_desc.Filter              = D3D11_FILTER_COMPARISON_MIN_MAG_MIP_POINT;
+        // bilinear PCF for shaders/shadow_filter.hlsl; the border keeps reads past the cascade lit
+        sam_desc.Filter              = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
         sam_desc.AddressU = D3D11_TEXTURE_ADDRESS_BORDER;
         sam_desc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
         sam_desc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
@@ -900,24 +826,120 @@ dx11_create_depth_stencil_states(void)
 #define DX11_BlobData(blob) ID3D10Blob_GetBufferPointer(blob)
 #define DX11_BlobLength(blob) ID3D10Blob_GetBufferSize(blob)
 
-static void
-dx11_compile_shader_from_file(LPCWSTR filename, char *entry_point, char *compiler_target, ID3DBlob **code_blob, ID3DBlob **error_blob)
+// g_shader_cache's compiler; runs on g_shader_queue's threads
+static b32
+dx11_compile_shader(Shader_Source *source, Shader_Bytecode *result)
 {
-        HRESULT HR = D3DCompileFromFile(filename, 0, D3D_COMPILE_STANDARD_FILE_INCLUDE, entry_point, compiler_target, DX11_ShaderCompileFlags, 0, code_blob, error_blob);
+        ProfileBegin("dx11_compile_shader");
+        WCHAR filename[ShaderCache_MaxPath];
+        MultiByteToWideChar(CP_UTF8, 0, source->path, -1, filename, ArrayCount(filename));
+        
+        ID3DBlob *code_blob = 0, *error_blob = 0;
+        HRESULT HR = D3DCompileFromFile(filename, (D3D_SHADER_MACRO *)source->defines, D3D_COMPILE_STANDARD_FILE_INCLUDE, source->entry_point, source->target,
+                                        source->flags, 0, &code_blob, &error_blob);
         
         if (HR == D3D11_ERROR_FILE_NOT_FOUND)
         {
-                OutputDebugStringA("File not found");
+                os_debug_print("File not found");
+        }
+        
+        if (error_blob)
+        {
+                os_debug_print((char *)DX11_BlobData(error_blob));
+                DX11_BlobFree(error_blob);
+        }
+        
+        b32 ok = SUCCEEDED(HR) && code_blob;
+        if (ok)
+        {
+                result->size     = DX11_BlobLength(code_blob);
+                result->bytecode = os_memory_alloc(result->size);
+                CopyMemory(result->bytecode, DX11_BlobData(code_blob), result->size);
+        }
+        
+        if (code_blob)
+        {
+                DX11_BlobFree(code_blob);
+        }
+        
+        ProfileEnd("dx11_compile_shader");
+        return(ok);
+}
+
+// defines may be 0; job->result is valid once g_shader_queue completes
+static void
+dx11_queue_shader(Shader_Cache_Job *job, char *entry_point, char *compiler_target, Shader_Define *defines)
+{
+        *job = (Shader_Cache_Job)
+        {
+                .cache  = &g_shader_cache,
+                .source =
+                {
+                        .path        = DX11_ShaderPath,
+                        .entry_point = entry_point,
+                        .target      = compiler_target,
+                        .flags       = DX11_ShaderCompileFlags,
+                        .defines     = defines,
+                },
+        };
+        
+        shader_cache_get_async(job, g_shader_queue);
+}
+
+// tools/shader_report.c tabulates the same count for every variant, with
+// release flags, into build/shader_variants.txt
+static u32
+dx11_shader_instruction_count(void *bytecode, u64 size)
+{
+        u32 result = 0;
+        ID3D11ShaderReflection *reflection = 0;
+        if (SUCCEEDED(D3DReflect(bytecode, size, &IID_ID3D11ShaderReflection, (void **)&reflection)))
+        {
+                D3D11_SHADER_DESC shader_desc;
+                reflection->lpVtbl->GetDesc(reflection, &shader_desc);
+                result = shader_desc.InstructionCount;
+                reflection->lpVtbl->Release(reflection);
         }
         
-        if (*error_blob)
+        return(result);
+}
+
+static void
+dx11_queue_pixel_shader_variant(Shader_Key key)
+{
+        shader_key_defines(key, g_dx11_pshader_defines[key]);
+        dx11_queue_shader(g_dx11_pshader_jobs + key, "ps_main", "ps_5_0", g_dx11_pshader_defines[key]);
+}
+
+static ID3D11PixelShader *
+dx11_pixel_shader_variant(Shader_Key key)
+{
+        Assert(key < ShaderKey_Count);
+        if (!g_dx11_pshader_variants[key])
         {
-                OutputDebugStringA(DX11_BlobData(*error_blob));
+                // every normalised key is queued at init; anything else is looked up now
+                Shader_Cache_Job *job = g_dx11_pshader_jobs + key;
+                if (!job->cache)
+                {
+                        dx11_queue_pixel_shader_variant(key);
+                        os_work_queue_complete_all(g_shader_queue);
+                }
+                
+                AssertTrue(job->ok);
+                AssertHR(ID3D11Device_CreatePixelShader(g_dx11_dev, job->result.bytecode, job->result.size, 0, g_dx11_pshader_variants + key));
+                g_dx11_pshader_instruction_counts[key] = dx11_shader_instruction_count(job->result.bytecode, job->result.size);
+                
+                char name[128];
+                char message[256];
+                shader_key_describe(key, name, sizeof(name));
+                wsprintfA(message, "ps_main [%s]: %d instructions, uber shader %d (%s)\n", name,
+                          (s32)g_dx11_pshader_instruction_counts[key], (s32)g_dx11_pshader_uber_instruction_count,
+                          job->result.from_cache ? "cached" : "compiled");
+                os_debug_print(message);
+                shader_bytecode_free(&job->result);
         }
         
-        AssertTrue(*code_blob);
-        AssertFalse(*error_blob);
-        AssertHR(HR);
+        return(g_dx11_pshader_variants[key]);
 }
 
 static ID3D11Buffer *
@@ -954,111 +976,761 @@ dx11_create_constant_buffer(UINT struct_size, void *init_data)
         return result;
 }
 
-static void
-init_rendering_states(void)
+// Dynamic, rewritten with WRITE_DISCARD
+static ID3D11Buffer *
+dx11_create_structured_buffer(UINT struct_size, UINT element_count, ID3D11ShaderResourceView **srv)
 {
-        ID3DBlob *code_blob, *error_blob;
-        
-        dx11_compile_shader_from_file(L"../code/shaders/shader_main.hlsl", "vs_main", "vs_5_0" , &code_blob, &error_blob);
-        AssertHR(ID3D11Device_CreateVertexShader(g_dx11_dev, DX11_BlobData(code_blob), DX11_BlobLength(code_blob), 0, &g_dx11_vshader_main));
-        
-        D3D11_INPUT_ELEMENT_DESC input_layout_desc[] =
-        {
-                {
-                        "IA_Position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
-                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
-                },
-                
-                {
-                        "IA_Tangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
-                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
-                },
-                
-                {
-                        "IA_Bitangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
-                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
-                },
-                
-                {
-                        "IA_Normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
-                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
-                },
-                
-                {
-                        "IA_TextureUV", 0, DXGI_FORMAT_R32G32_FLOAT, 0,
-                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
-                },
-        };
-        
-        AssertHR(ID3D11Device_CreateInputLayout(g_dx11_dev, input_layout_desc, ArrayCount(input_layout_desc), DX11_BlobData(code_blob), DX11_BlobLength(code_blob), &g_dx11_input_layout));
-        DX11_BlobFree(code_blob);
-        
-        dx11_compile_shader_from_file(L"../code/shaders/shader_main.hlsl", "ps_main", "ps_5_0", &code_blob, &error_blob);
-        AssertHR(ID3D11Device_CreatePixelShader(g_dx11_dev, DX11_BlobData(code_blob), DX11_BlobLength(code_blob), 0, &g_dx11_pshader_main));
-        DX11_BlobFree(code_blob);
-        
-        g_dx11_cbuffer_main0 = dx11_create_constant_buffer(sizeof(DX11_CBuffer_Main0), 0);
-        g_dx11_cbuffer_main1 = dx11_create_constant_buffer(sizeof(DX11_CBuffer_Main1), 0);
-        g_dx11_cbuffer_main2 = dx11_create_constant_buffer(sizeof(DX11_CBuffer_Main2), 0);
+        ID3D11Buffer *result = 0;
         
         D3D11_BUFFER_DESC sbuffer_desc =
         {
-                .ByteWidth            = sizeof(Model_Instance) * MaxModelInstances,
+                .ByteWidth            = struct_size * element_count,
                 .Usage                = D3D11_USAGE_DYNAMIC,
                 .BindFlags            = D3D11_BIND_SHADER_RESOURCE,
                 .CPUAccessFlags       = D3D11_CPU_ACCESS_WRITE,
                 .MiscFlags            = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
-                .StructureByteStride  = sizeof(Model_Instance),
+                .StructureByteStride  = struct_size,
         };
         
         D3D11_SHADER_RESOURCE_VIEW_DESC sbuffer_srv_desc =
         {
                 .Format             = DXGI_FORMAT_UNKNOWN,
                 .ViewDimension      = D3D11_SRV_DIMENSION_BUFFER,
-                .Buffer             = { .NumElements = MaxModelInstances }
+                .Buffer             = { .NumElements = element_count }
         };
         
-        AssertHR(ID3D11Device_CreateBuffer(g_dx11_dev, &sbuffer_desc, 0, &g_dx11_sbuffer_model_instances));
-        AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)g_dx11_sbuffer_model_instances, &sbuffer_srv_desc, &g_dx11_sbuffer_model_instances_srv));
-        
-        g_dx11_viewport_main = (D3D11_VIEWPORT)
+        AssertHR(ID3D11Device_CreateBuffer(g_dx11_dev, &sbuffer_desc, 0, &result));
+        AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)result, &sbuffer_srv_desc, srv));
+        return result;
+}
+
+// Decodes straight out of the mapped asset pack; without a pack (a fresh
+// checkout that has not run the packer) it falls back to the loose file.
+static u8 *
+load_image_rgba(char *path, s32 *width, s32 *height)
+{
+        ProfileBegin("load_image_rgba");
+        u8 *result = 0;
+        s32 comp   = 0;
+        Asset_Blob blob = asset_pack_find(&g_asset_pack, path);
+        if (blob.data)
         {
-                .Width     = (f32)g_dx11_resolution_width,
-                .Height    = (f32)g_dx11_resolution_height,
-                .TopLeftX  = 0,
-                .TopLeftY  = 0,
-                .MinDepth  = 0,
-                .MaxDepth  = 1,
-        };
-        
-        g_dx11_cube_model       = create_cube_model();
-        g_dx11_sphere_model     = create_sphere_model(1.0f, 32);
-        g_dx11_cylinder_model   = create_cylinder_model(1.0f, 1.0f, 4.0f, 32, 24);
+                result = stbi_load_from_memory(blob.data, (int)blob.size, width, height, &comp, 4);
+        }
+        else
+        {
+                char loose_path[256];
+                wsprintfA(loose_path, "../data/%s", path);
+                result = stbi_load(loose_path, width, height, &comp, 4);
+        }
         
-        g_gray_brick_tex.diffuse_srv           = dx11_create_texture2d_mipmapped("../data/textures/sloppy-mortar-stone-wall/diffuse.png");
-        g_gray_brick_tex.normal_srv            = dx11_create_texture2d_mipmapped("../data/textures/sloppy-mortar-stone-wall/normal.png");
-        g_gray_brick_tex.displace_srv          = dx11_create_texture2d_mipmapped("../data/textures/sloppy-mortar-stone-wall/displacement.png");
+        ProfileEnd("load_image_rgba");
+        return(result);
+}
+
+// Uploads the probes tools/reflection_bake.c baked into one cube array and
+// returns how many there are; 0 (no file, or one from an older baker) leaves
+// reflections off.
+static u32
+dx11_load_reflection_probes(void)
+{
+        OS_File_Map map  = { 0 };
+        Asset_Blob  blob = asset_pack_find(&g_asset_pack, ReflectionProbe_DefaultPath);
+        if (!blob.data)
+        {
+                map       = os_file_map("../data/" ReflectionProbe_DefaultPath);
+                blob.data = map.data;
+                blob.size = map.size;
+        }
         
-        g_oak_trunk_tex.diffuse_srv           = dx11_create_texture2d_mipmapped("../data/textures/mature-oak-tree/diffuse.png");
-        g_oak_trunk_tex.normal_srv            = dx11_create_texture2d_mipmapped("../data/textures/mature-oak-tree/normal.png");
-        g_oak_trunk_tex.displace_srv          = dx11_create_texture2d_mipmapped("../data/textures/mature-oak-tree/displacement.png");
+        u32 result = 0;
+        Reflection_Probe_Header *header = reflection_probe_parse(blob.data, blob.size);
+        if (header && header->probe_count)
+        {
+                D3D11_SUBRESOURCE_DATA subresources[ReflectionProbe_MaxProbes * 6 * ReflectionProbe_MipCount];
+                u32 *texels = (u32 *)(header + 1);
+                for (u32 probe_idx = 0; probe_idx < header->probe_count; ++probe_idx)
+                {
+                        u32 *probe_texels = texels + probe_idx * reflection_probe_texel_count();
+                        for (u32 face = 0; face < 6; ++face)
+                        {
+                                for (u32 mip = 0; mip < ReflectionProbe_MipCount; ++mip)
+                                {
+                                        D3D11_SUBRESOURCE_DATA *subresource = subresources + D3D11CalcSubresource(mip, probe_idx * 6 + face, ReflectionProbe_MipCount);
+                                        subresource->pSysMem            = probe_texels + reflection_probe_texel_offset(face, mip);
+                                        subresource->SysMemPitch        = (ReflectionProbe_FaceSize >> mip) * sizeof(u32);
+                                        subresource->SysMemSlicePitch   = 0;
+                                }
+                        }
+                }
+                
+                D3D11_TEXTURE2D_DESC tex_desc =
+                {
+                        .Width               = ReflectionProbe_FaceSize,
+                        .Height              = ReflectionProbe_FaceSize,
+                        .MipLevels           = ReflectionProbe_MipCount,
+                        .ArraySize           = 6 * header->probe_count,
+                        .Format              = DXGI_FORMAT_R9G9B9E5_SHAREDEXP,
+                        .SampleDesc          = { 1, 0 },
+                        .Usage               = D3D11_USAGE_IMMUTABLE,
+                        .BindFlags           = D3D11_BIND_SHADER_RESOURCE,
+                        .MiscFlags           = D3D11_RESOURCE_MISC_TEXTURECUBE,
+                };
+                
+                D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc =
+                {
+                        .Format              = DXGI_FORMAT_R9G9B9E5_SHAREDEXP,
+                        .ViewDimension       = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY,
+                        .TextureCubeArray    = { 0, ReflectionProbe_MipCount, 0, header->probe_count },
+                };
+                
+                ID3D11Texture2D *tex = 0;
+                AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &tex_desc, subresources, &tex));
+                AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)tex, &srv_desc, &g_dx11_reflection_probe_srv));
+                ID3D11Texture2D_Release(tex);
+                result = header->probe_count;
+        }
+        
+        // the texture holds its own copy
+        os_file_unmap(&map);
+        return(result);
+}
+
+// Uploads the lightmap tools/lightmap_bake.c baked and points the static
+// instances at their charts. A file baked from a different scene (the static
+// instance count does not match) is ignored and every instance keeps lighting
+// the directional light per pixel.
+static void
+dx11_load_lightmap(void)
+{
+        OS_File_Map map  = { 0 };
+        Asset_Blob  blob = asset_pack_find(&g_asset_pack, Lightmap_DefaultPath);
+        if (!blob.data)
+        {
+                map       = os_file_map("../data/" Lightmap_DefaultPath);
+                blob.data = map.data;
+                blob.size = map.size;
+        }
+        
+        Lightmap_Header *header = lightmap_parse(blob.data, blob.size);
+        if (header && header->chart_count && (header->instance_count == g_scene.static_instance_count))
+        {
+                u32 *first_chart = (u32 *)(header + 1);
+                v4f *charts      = (v4f *)(first_chart + header->instance_count);
+                u16 *texels      = (u16 *)(charts + header->chart_count);
+                
+                D3D11_TEXTURE2D_DESC tex_desc =
+                {
+                        .Width               = header->width,
+                        .Height              = header->height,
+                        .MipLevels           = 1,
+                        .ArraySize           = 1,
+                        .Format              = DXGI_FORMAT_R16G16B16A16_FLOAT,
+                        .SampleDesc          = { 1, 0 },
+                        .Usage               = D3D11_USAGE_IMMUTABLE,
+                        .BindFlags           = D3D11_BIND_SHADER_RESOURCE,
+                };
+                
+                D3D11_SUBRESOURCE_DATA tex_data =
+                {
+                        .pSysMem             = texels,
+                        .SysMemPitch         = header->width * 4 * sizeof(u16),
+                };
+                
+                ID3D11Texture2D *tex = 0;
+                AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &tex_desc, &tex_data, &tex));
+                AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)tex, 0, &g_dx11_lightmap_srv));
+                ID3D11Texture2D_Release(tex);
+                
+                D3D11_BUFFER_DESC charts_desc =
+                {
+                        .ByteWidth            = header->chart_count * sizeof(v4f),
+                        .Usage                = D3D11_USAGE_IMMUTABLE,
+                        .BindFlags            = D3D11_BIND_SHADER_RESOURCE,
+                        .MiscFlags            = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
+                        .StructureByteStride  = sizeof(v4f),
+                };
+                
+                D3D11_SHADER_RESOURCE_VIEW_DESC charts_srv_desc =
+                {
+                        .Format             = DXGI_FORMAT_UNKNOWN,
+                        .ViewDimension      = D3D11_SRV_DIMENSION_BUFFER,
+                        .Buffer             = { .NumElements = header->chart_count }
+                };
+                
+                D3D11_SUBRESOURCE_DATA charts_data = { .pSysMem = charts };
+                ID3D11Buffer *charts_buffer = 0;
+                AssertHR(ID3D11Device_CreateBuffer(g_dx11_dev, &charts_desc, &charts_data, &charts_buffer));
+                AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)charts_buffer, &charts_srv_desc, &g_dx11_lightmap_charts_srv));
+                ID3D11Buffer_Release(charts_buffer);
+                
+                for (u32 instance_idx = 0; instance_idx < header->instance_count; ++instance_idx)
+                {
+                        g_scene.ins[instance_idx].lightmap_first_chart = first_chart[instance_idx];
+                }
+        }
+        
+        // the texture and buffer hold their own copies
+        os_file_unmap(&map);
+}
+
+// Uploads the occlusion tools/vertex_ao_bake.c baked and points the static
+// instances at their runs of it; like the lightmap, a file from a different
+// scene is ignored.
+static void
+dx11_load_vertex_ao(void)
+{
+        OS_File_Map map  = { 0 };
+        Asset_Blob  blob = asset_pack_find(&g_asset_pack, VertexAO_DefaultPath);
+        if (!blob.data)
+        {
+                map       = os_file_map("../data/" VertexAO_DefaultPath);
+                blob.data = map.data;
+                blob.size = map.size;
+        }
+        
+        Vertex_AO_Header *header = vertex_ao_parse(blob.data, blob.size);
+        if (header && header->vertex_count && (header->instance_count == g_scene.static_instance_count))
+        {
+                u32 *first_vertex = (u32 *)(header + 1);
+                u8  *ao           = (u8 *)(first_vertex + header->instance_count);
+                
+                D3D11_BUFFER_DESC ao_desc =
+                {
+                        .ByteWidth            = header->vertex_count,
+                        .Usage                = D3D11_USAGE_IMMUTABLE,
+                        .BindFlags            = D3D11_BIND_SHADER_RESOURCE,
+                };
+                
+                D3D11_SHADER_RESOURCE_VIEW_DESC ao_srv_desc =
+                {
+                        .Format             = DXGI_FORMAT_R8_UNORM,
+                        .ViewDimension      = D3D11_SRV_DIMENSION_BUFFER,
+                        .Buffer             = { .NumElements = header->vertex_count }
+                };
+                
+                D3D11_SUBRESOURCE_DATA ao_data = { .pSysMem = ao };
+                ID3D11Buffer *ao_buffer = 0;
+                AssertHR(ID3D11Device_CreateBuffer(g_dx11_dev, &ao_desc, &ao_data, &ao_buffer));
+                AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)ao_buffer, &ao_srv_desc, &g_dx11_vertex_ao_srv));
+                ID3D11Buffer_Release(ao_buffer);
+                
+                for (u32 instance_idx = 0; instance_idx < header->instance_count; ++instance_idx)
+                {
+                        g_scene.ins[instance_idx].ao_first_vertex = first_vertex[instance_idx];
+                }
+        }
+        
+        // the buffer holds its own copy
+        os_file_unmap(&map);
+}
+
+// Uploads the probes tools/irradiance_bake.c baked and fills in the grid
+// ps_main finds them with; returns whether there were any.
+static b32
+dx11_load_irradiance_volume(DX11_CBuffer_Main1 *cbuffer_main1)
+{
+        OS_File_Map map  = { 0 };
+        Asset_Blob  blob = asset_pack_find(&g_asset_pack, IrradianceVolume_DefaultPath);
+        if (!blob.data)
+        {
+                map       = os_file_map("../data/" IrradianceVolume_DefaultPath);
+                blob.data = map.data;
+                blob.size = map.size;
+        }
+        
+        b32 result = false;
+        Irradiance_Volume_Header *header = irradiance_volume_parse(blob.data, blob.size);
+        if (header)
+        {
+                u32 texel_count = header->probe_count_x * header->probe_count_y * header->probe_count_z * IrradianceVolume_ProbeTexels;
+                
+                D3D11_BUFFER_DESC volume_desc =
+                {
+                        .ByteWidth            = texel_count * 4 * sizeof(u16),
+                        .Usage                = D3D11_USAGE_IMMUTABLE,
+                        .BindFlags            = D3D11_BIND_SHADER_RESOURCE,
+                };
+                
+                D3D11_SHADER_RESOURCE_VIEW_DESC volume_srv_desc =
+                {
+                        .Format             = DXGI_FORMAT_R16G16B16A16_FLOAT,
+                        .ViewDimension      = D3D11_SRV_DIMENSION_BUFFER,
+                        .Buffer             = { .NumElements = texel_count }
+                };
+                
+                D3D11_SUBRESOURCE_DATA volume_data = { .pSysMem = header + 1 };
+                ID3D11Buffer *volume_buffer = 0;
+                AssertHR(ID3D11Device_CreateBuffer(g_dx11_dev, &volume_desc, &volume_data, &volume_buffer));
+                AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)volume_buffer, &volume_srv_desc, &g_dx11_irradiance_volume_srv));
+                ID3D11Buffer_Release(volume_buffer);
+                
+                cbuffer_main1->irradiance_origin         = header->origin;
+                cbuffer_main1->irradiance_spacing        = header->spacing;
+                cbuffer_main1->irradiance_probe_count[0] = header->probe_count_x;
+                cbuffer_main1->irradiance_probe_count[1] = header->probe_count_y;
+                cbuffer_main1->irradiance_probe_count[2] = header->probe_count_z;
+                result = true;
+        }
+        
+        // the buffer holds its own copy
+        os_file_unmap(&map);
+        return(result);
+}
+
+// Finds the sets tools/pvs_bake.c baked for the static instances; rows are
+// unpacked as the camera moves, so the file stays mapped. Sets baked from
+// another scene are ignored, and so are sets no cell would filter by, which
+// saves the per-frame lookup in open scenes like the default hall.
+static void
+scene_load_pvs(void)
+{
+        Asset_Blob blob = asset_pack_find(&g_asset_pack, Pvs_DefaultPath);
+        if (!blob.data)
+        {
+                g_pvs_map = os_file_map("../data/" Pvs_DefaultPath);
+                blob.data = g_pvs_map.data;
+                blob.size = g_pvs_map.size;
+        }
+        
+        Pvs_Header *header = pvs_parse(blob.data, blob.size);
+        if (header && ((header->instance_count != g_scene.static_instance_count) || !header->paying_cell_count))
+        {
+                header = 0;
+        }
+        if (!header)
+        {
+                os_file_unmap(&g_pvs_map);
+        }
+        pvs_view_init(&g_pvs_view, header);
+}
+
+// Decodes every material's PBR set, packs same-sized sets into array bins and
+// uploads one Texture2DArray per map kind per bin. Maps baked offline replace
+// their png when every set in a bin has them: BC5 normals from
+// tools/normal_bake.c, and height plus cone step ratios from
+// tools/cone_bake.c, which switches the bin to parallax_cone_uv.
+static void
+dx11_load_material_arrays(void)
+{
+        char *map_names[]             = { "diffuse.png", "normal.png", "displacement.png" };
+        char *baked_map_names[]       = { 0, "normal.tex", "displacement.tex" };
+        u32   displace_map_idx        = 2;
+        Assert(ArrayCount(map_names) == MaterialArray_MapCount);
+        u8   *pixels[MaterialType_Count][ArrayCount(map_names)] = {0};
+        Tex_File_Header *baked[MaterialType_Count][ArrayCount(map_names)] = {0};
+        s32   widths[MaterialType_Count];
+        s32   heights[MaterialType_Count];
+        
+        Tex_Packer packer = {0};
+        for (Material_Type material = 0; material < MaterialType_Count; ++material)
+        {
+                for (u32 map_idx = 0; map_idx < ArrayCount(map_names); ++map_idx)
+                {
+                        char path[256];
+                        if (baked_map_names[map_idx])
+                        {
+                                wsprintfA(path, "%s/%s", scene_material_dir(material), baked_map_names[map_idx]);
+                                Asset_Blob blob = asset_pack_find(&g_asset_pack, path);
+                                baked[material][map_idx] = tex_file_parse(blob.data, blob.size);
+                                if (baked[material][map_idx])
+                                {
+                                        continue;
+                                }
+                        }
+                        
+                        wsprintfA(path, "%s/%s", scene_material_dir(material), map_names[map_idx]);
+                        
+                        s32 width = 0, height = 0;
+                        pixels[material][map_idx] = load_image_rgba(path, &width, &height);
+                        AssertTrue(pixels[material][map_idx]);
+                        
+                        // every map in a set must share dimensions so the set maps to one slice
+                        if (map_idx == 0)
+                        {
+                                widths[material]  = width;
+                                heights[material] = height;
+                        }
+                        Assert((width == widths[material]) && (height == heights[material]));
+                }
+                
+                for (u32 map_idx = 0; map_idx < ArrayCount(map_names); ++map_idx)
+                {
+                        Tex_File_Header *header = baked[material][map_idx];
+                        Assert(!header || ((header->width == (u32)widths[material]) && (header->height == (u32)heights[material])));
+                }
+                
+                g_material_slots[material] = tex_pack_add(&packer, widths[material], heights[material]);
+        }
+        
+        b32 bin_baked[TexPack_MaxArrays][ArrayCount(map_names)];
+        for (u32 array_idx = 0; array_idx < packer.array_count; ++array_idx)
+        {
+                for (u32 map_idx = 0; map_idx < ArrayCount(map_names); ++map_idx)
+                {
+                        bin_baked[array_idx][map_idx] = true;
+                        for (Material_Type material = 0; material < MaterialType_Count; ++material)
+                        {
+                                if (g_material_slots[material].array_idx == array_idx)
+                                {
+                                        bin_baked[array_idx][map_idx] &= (baked[material][map_idx] != 0);
+                                }
+                        }
+                }
+        }
+        
+        // summed over a bin's slices, so the bin registers as one texture
+        u32 bin_bytes_per_texel[TexPack_MaxArrays] = {0};
+        for (Material_Type material = 0; material < MaterialType_Count; ++material)
+        {
+                u32 array_idx       = g_material_slots[material].array_idx;
+                u32 bytes_per_texel = 0;
+                for (u32 map_idx = 0; map_idx < ArrayCount(map_names); ++map_idx)
+                {
+                        if (bin_baked[array_idx][map_idx])
+                        {
+                                bytes_per_texel += (u32)(tex_file_mip_size(baked[material][map_idx]->format, 4, 4) / 16);
+                                continue;
+                        }
+                        
+                        if (!pixels[material][map_idx])
+                        {
+                                char path[256];
+                                wsprintfA(path, "%s/%s", scene_material_dir(material), map_names[map_idx]);
+                                
+                                s32 width = 0, height = 0;
+                                pixels[material][map_idx] = load_image_rgba(path, &width, &height);
+                                AssertTrue(pixels[material][map_idx]);
+                                Assert((width == widths[material]) && (height == heights[material]));
+                        }
+                        bytes_per_texel += 4;
+                }
+                
+                bin_bytes_per_texel[array_idx] += bytes_per_texel;
+        }
+        
+        g_dx11_material_array_count = packer.array_count;
+        for (u32 array_idx = 0; array_idx < packer.array_count; ++array_idx)
+        {
+                Tex_Pack_Array *array = packer.arrays + array_idx;
+                g_material_array_texture_ids[array_idx] = residency_register(&g_residency, array->width, array->height, bin_bytes_per_texel[array_idx]);
+                for (u32 map_idx = 0; map_idx < ArrayCount(map_names); ++map_idx)
+                {
+                        u8 *slices[TexPack_MaxSlicesPerArray];
+                        Tex_File_Header *baked_slices[TexPack_MaxSlicesPerArray];
+                        for (Material_Type material = 0; material < MaterialType_Count; ++material)
+                        {
+                                if (g_material_slots[material].array_idx == array_idx)
+                                {
+                                        slices[g_material_slots[material].slice]        = pixels[material][map_idx];
+                                        baked_slices[g_material_slots[material].slice]  = baked[material][map_idx];
+                                }
+                        }
+                        
+                        ID3D11Texture2D *source = 0;
+                        if (bin_baked[array_idx][map_idx])
+                        {
+                                source = dx11_create_texture2d_array_from_tex_files(baked_slices, array->slice_count);
+                                if (map_idx == displace_map_idx)
+                                {
+                                        g_dx11_material_array_cone_step[array_idx] = (baked_slices[0]->format == TexFileFormat_RG8);
+                                }
+                        }
+                        else
+                        {
+                                source = dx11_create_texture2d_array_mipmapped(slices, array->slice_count, array->width, array->height);
+                        }
+                        
+                        g_dx11_material_array_sources[array_idx][map_idx] = source;
+                }
+                
+                Residency_Texture *texture = g_residency.textures + g_material_array_texture_ids[array_idx];
+                g_dx11_material_array_resident_mip[array_idx] = texture->resident_mip;
+                for (u32 map_idx = 0; map_idx < MaterialArray_MapCount; ++map_idx)
+                {
+                        g_dx11_material_arrays[array_idx].srvs[map_idx] = dx11_create_resident_texture2d_array(g_dx11_material_array_sources[array_idx][map_idx],
+                                                                                                               texture->resident_mip);
+                }
+                
+                DX11_CBuffer_Material cbuffer_material = { .cone_step_enabled = g_dx11_material_array_cone_step[array_idx] };
+                g_dx11_material_array_cbuffers[array_idx] = dx11_create_constant_buffer(sizeof(DX11_CBuffer_Material), &cbuffer_material);
+        }
+        
+        for (Material_Type material = 0; material < MaterialType_Count; ++material)
+        {
+                g_material_texture_ids[material] = g_material_array_texture_ids[g_material_slots[material].array_idx];
+                for (u32 map_idx = 0; map_idx < ArrayCount(map_names); ++map_idx)
+                {
+                        if (pixels[material][map_idx])
+                        {
+                                stbi_image_free(pixels[material][map_idx]);
+                        }
+                }
+        }
+}
+
+static void
+dx11_vtex_upload(void *user, u32 slot_x, u32 slot_y, u8 *layers[VTexLayer_Count])
+{
+        (void)user;
+        D3D11_BOX box =
+        {
+                .left    = slot_x * VTex_TileSize,
+                .top     = slot_y * VTex_TileSize,
+                .front   = 0,
+                .right   = (slot_x + 1) * VTex_TileSize,
+                .bottom  = (slot_y + 1) * VTex_TileSize,
+                .back    = 1,
+        };
+        
+        for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+        {
+                ID3D11DeviceContext_UpdateSubresource(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_vtex_physical_texs[layer], 0, &box,
+                                                      layers[layer], VTex_TileSize * VTex_BytesPerTexel, 0);
+        }
+}
+
+// Creates the physical tile caches, the page table and the feedback target
+// for a baked .vtex. Returns false (leaving the material on its array bin)
+// when the file is missing.
+static b32
+dx11_load_virtual_texture(char *filename)
+{
+        for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+        {
+                D3D11_TEXTURE2D_DESC physical_desc =
+                {
+                        .Width               = VTexCache_PhysicalSize,
+                        .Height              = VTexCache_PhysicalSize,
+                        .MipLevels           = 1,
+                        .ArraySize           = 1,
+                        .Format              = DXGI_FORMAT_R8G8B8A8_UNORM,
+                        .SampleDesc          = { 1, 0 },
+                        .Usage               = D3D11_USAGE_DEFAULT,
+                        .BindFlags           = D3D11_BIND_SHADER_RESOURCE,
+                };
+                
+                AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &physical_desc, 0, &g_dx11_vtex_physical_texs[layer]));
+                AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)g_dx11_vtex_physical_texs[layer], 0, &g_dx11_vtex_srvs[1 + layer]));
+        }
+        
+        // vtex_open uploads the root tile straight away
+        if (!vtex_open(&g_vtex, filename, g_work_queue, dx11_vtex_upload, 0))
+        {
+                for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+                {
+                        ID3D11ShaderResourceView_Release(g_dx11_vtex_srvs[1 + layer]);
+                        ID3D11Texture2D_Release(g_dx11_vtex_physical_texs[layer]);
+                        g_dx11_vtex_srvs[1 + layer]        = 0;
+                        g_dx11_vtex_physical_texs[layer]   = 0;
+                }
+                return(false);
+        }
+        
+        // page table mip n holds the entries for virtual mip n, so its chain matches the tile counts
+        D3D11_TEXTURE2D_DESC page_table_desc =
+        {
+                .Width               = g_vtex.header.tiles_x[0],
+                .Height              = g_vtex.header.tiles_y[0],
+                .MipLevels           = g_vtex.header.mip_count,
+                .ArraySize           = 1,
+                .Format              = DXGI_FORMAT_R8G8B8A8_UINT,
+                .SampleDesc          = { 1, 0 },
+                .Usage               = D3D11_USAGE_DEFAULT,
+                .BindFlags           = D3D11_BIND_SHADER_RESOURCE,
+        };
+        
+        AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &page_table_desc, 0, &g_dx11_vtex_page_table_tex));
+        AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)g_dx11_vtex_page_table_tex, 0, &g_dx11_vtex_srvs[0]));
+        
+        g_vtex_feedback_width   = (u32)g_dx11_resolution_width / DX11_VTex_FeedbackDivisor;
+        g_vtex_feedback_height  = (u32)g_dx11_resolution_height / DX11_VTex_FeedbackDivisor;
+        g_vtex_feedback_texels  = os_memory_alloc(g_vtex_feedback_width * g_vtex_feedback_height * sizeof(u32));
+        
+        D3D11_TEXTURE2D_DESC feedback_desc =
+        {
+                .Width               = g_vtex_feedback_width,
+                .Height              = g_vtex_feedback_height,
+                .MipLevels           = 1,
+                .ArraySize           = 1,
+                .Format              = DXGI_FORMAT_R32_UINT,
+                .SampleDesc          = { 1, 0 },
+                .Usage               = D3D11_USAGE_DEFAULT,
+                .BindFlags           = D3D11_BIND_UNORDERED_ACCESS,
+        };
+        
+        AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &feedback_desc, 0, &g_dx11_vtex_feedback_tex));
+        AssertHR(ID3D11Device_CreateUnorderedAccessView(g_dx11_dev, (ID3D11Resource *)g_dx11_vtex_feedback_tex, 0, &g_dx11_vtex_feedback_uav));
+        
+        feedback_desc.Usage            = D3D11_USAGE_STAGING;
+        feedback_desc.BindFlags        = 0;
+        feedback_desc.CPUAccessFlags   = D3D11_CPU_ACCESS_READ;
+        for (u32 staging_idx = 0; staging_idx < DX11_VTex_ReadbackLatency; ++staging_idx)
+        {
+                AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &feedback_desc, 0, &g_dx11_vtex_feedback_staging[staging_idx]));
+        }
+        
+        DX11_CBuffer_VTex cbuffer_vtex = {0};
+        g_dx11_vtex_cbuffer = dx11_create_constant_buffer(sizeof(DX11_CBuffer_VTex), &cbuffer_vtex);
+        return(true);
+}
+
+// Reads back the feedback from DX11_VTex_ReadbackLatency frames ago (never
+// stalling on the GPU), streams tiles and pushes page table changes.
+static void
+dx11_update_virtual_texture(void)
+{
+        if (g_vtex_frame >= DX11_VTex_ReadbackLatency)
+        {
+                ID3D11Resource *staging = (ID3D11Resource *)g_dx11_vtex_feedback_staging[g_vtex_frame % DX11_VTex_ReadbackLatency];
+                D3D11_MAPPED_SUBRESOURCE mapped_subresource;
+                if (SUCCEEDED(ID3D11DeviceContext_Map(g_dx11_dev_cont, staging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped_subresource)))
+                {
+                        for (u32 y = 0; y < g_vtex_feedback_height; ++y)
+                        {
+                                CopyMemory(g_vtex_feedback_texels + y * g_vtex_feedback_width,
+                                           (u8 *)mapped_subresource.pData + y * mapped_subresource.RowPitch, g_vtex_feedback_width * sizeof(u32));
+                        }
+                        ID3D11DeviceContext_Unmap(g_dx11_dev_cont, staging, 0);
+                        
+                        vtex_update(&g_vtex, g_vtex_feedback_texels, g_vtex_feedback_width * g_vtex_feedback_height);
+                }
+        }
+        
+        vtex_poll_loads(&g_vtex, dx11_vtex_upload, 0);
+        vtex_update_page_table(&g_vtex);
+        for (u32 mip = 0; mip < g_vtex.header.mip_count; ++mip)
+        {
+                if (g_vtex.page_mip_dirty[mip])
+                {
+                        ID3D11DeviceContext_UpdateSubresource(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_vtex_page_table_tex, mip, 0,
+                                                              g_vtex.pages[mip], g_vtex.header.tiles_x[mip] * sizeof(VTex_Page), 0);
+                        g_vtex.page_mip_dirty[mip] = false;
+                }
+        }
+        
+        DX11_CBuffer_VTex cbuffer_vtex =
+        {
+                .virtual_size        = { (f32)g_vtex.header.width, (f32)g_vtex.header.height },
+                .mip_count           = (f32)g_vtex.header.mip_count,
+                .physical_size       = (f32)VTexCache_PhysicalSize,
+                .feedback_jitter_x   = (u32)(g_vtex_frame % DX11_VTex_FeedbackDivisor),
+                .feedback_jitter_y   = (u32)((g_vtex_frame / DX11_VTex_FeedbackDivisor) % DX11_VTex_FeedbackDivisor),
+        };
+        
+        D3D11_MAPPED_SUBRESOURCE mapped_subresource;
+        ID3D11DeviceContext_Map(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_vtex_cbuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_subresource);
+        CopyMemory(mapped_subresource.pData, &cbuffer_vtex, sizeof(cbuffer_vtex));
+        ID3D11DeviceContext_Unmap(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_vtex_cbuffer, 0);
+}
+
+static void
+init_rendering_states(void)
+{
+        // every shader the frame can use is looked up on g_shader_queue while
+        // the textures load; a cold cache compiles them in parallel
+        u64 shader_begin = os_time_now();
+        
+        g_shader_cache = (Shader_Cache){ .directory = DX11_ShaderCacheDirectory, .compile = dx11_compile_shader };
+        g_shader_queue = os_work_queue_create(Maximum(os_processor_count(), 2) - 1);
+        
+        Shader_Cache_Job vs_main_job, vs_depth_only_job, ps_uber_job;
+        dx11_queue_shader(&vs_main_job, "vs_main", "vs_5_0", 0);
+        dx11_queue_shader(&vs_depth_only_job, "vs_depth_only", "vs_5_0", 0);
+        dx11_queue_shader(&ps_uber_job, "ps_main", "ps_5_0", 0);
+        for (Shader_Key key = 0; key < ShaderKey_Count; ++key)
+        {
+                if (shader_key_normalize(key) == key)
+                {
+                        dx11_queue_pixel_shader_variant(key);
+                }
+        }
+        
+        g_dx11_cbuffer_main0 = dx11_create_constant_buffer(sizeof(DX11_CBuffer_Main0), 0);
+        g_dx11_cbuffer_main2 = dx11_create_constant_buffer(sizeof(DX11_CBuffer_Main2), 0);
+        
+        g_dx11_sbuffer_model_instances = dx11_create_structured_buffer(sizeof(Model_Instance), MaxModelInstances, &g_dx11_sbuffer_model_instances_srv);
+        g_dx11_sbuffer_lights          = dx11_create_structured_buffer(sizeof(Light), MaxLightCount, g_dx11_light_srvs + 0);
+        g_dx11_sbuffer_light_clusters  = dx11_create_structured_buffer(sizeof(Light_Cluster), LightCluster_Count, g_dx11_light_srvs + 1);
+        g_dx11_sbuffer_light_indices   = dx11_create_structured_buffer(sizeof(u32), LightCluster_MaxIndices, g_dx11_light_srvs + 2);
+        
+        g_dx11_viewport_main = (D3D11_VIEWPORT)
+        {
+                .Width     = (f32)g_dx11_resolution_width,
+                .Height    = (f32)g_dx11_resolution_height,
+                .TopLeftX  = 0,
+                .TopLeftY  = 0,
+                .MinDepth  = 0,
+                .MaxDepth  = 1,
+        };
+        
+        g_dx11_cube_model       = dx11_create_scene_model(SceneModel_Cube);
+        g_dx11_sphere_model     = dx11_create_scene_model(SceneModel_Sphere);
+        g_dx11_cylinder_model   = dx11_create_scene_model(SceneModel_Cylinder);
+        
+        g_dx11_scene_models[SceneModel_Cube]       = &g_dx11_cube_model;
+        g_dx11_scene_models[SceneModel_Cylinder]   = &g_dx11_cylinder_model;
+        g_dx11_scene_models[SceneModel_Sphere]     = &g_dx11_sphere_model;
+        
+        char *material_vtex_paths[MaterialType_Count] =
+        {
+                [MaterialType_GrayBrick] = "../data/virtual/sloppy-mortar-stone-wall.vtex",
+        };
+        residency_init(&g_residency, Residency_DefaultBudget, Residency_DefaultLoadPerFrame);
         
+        u64 load_begin = os_time_now();
+        
+        asset_pack_open(&g_asset_pack, AssetPack_DefaultPath);
+        ProfileBegin("dx11_load_material_arrays");
+        dx11_load_material_arrays();
+        ProfileEnd("dx11_load_material_arrays");
+        
+        u64 load_end = os_time_now();
+        {
+                char message[128];
+                wsprintfA(message, "material load (%s): %d ms\n", g_asset_pack.header ? "pack" : "loose files",
+                          (s32)(os_seconds_between(load_begin, load_end) * 1000.0f));
+                os_debug_print(message);
+        }
+        
+        g_work_queue = os_work_queue_create(Maximum(os_processor_count(), 2) - 1);
+        for (Material_Type material = 0; (material < MaterialType_Count) && !g_vtex_enabled; ++material)
+        {
+                if (material_vtex_paths[material] && dx11_load_virtual_texture(material_vtex_paths[material]))
+                {
+                        g_vtex_enabled = true;
+                        g_material_slots[material].array_idx   = SceneBatch_AnyArray;
+                        g_material_slots[material].slice       = TextureSlice_VirtualBit;
+                }
+        }
+        
+        u32 reflection_probe_count = dx11_load_reflection_probes();
+        scene_build_static(&g_scene, g_material_slots, reflection_probe_count);
+        dx11_load_lightmap();
+        dx11_load_vertex_ao();
+        scene_load_pvs();
+        occlusion_buffer_alloc(&g_occlusion);
+        occlusion_gather_occluders(&g_occlusion, &g_scene);
+        
+        DX11_CBuffer_Main1 cbuffer_main1 = {0};
+        cbuffer_main1.enable_reflections = (reflection_probe_count > 0);
+        cbuffer_main1.enable_irradiance_volume = dx11_load_irradiance_volume(&cbuffer_main1);
+        g_dx11_cbuffer_main1 = dx11_create_constant_buffer(sizeof(DX11_CBuffer_Main1), &cbuffer_main1);
         
-        s32 shadow_map_dims = 1024;
         
         g_dx11_shadow_map_vp.TopLeftX = 0.0f;
         g_dx11_shadow_map_vp.TopLeftY = 0.0f;
-        g_dx11_shadow_map_vp.Width    = (f32)(shadow_map_dims);
-        g_dx11_shadow_map_vp.Height   = (f32)(shadow_map_dims);
+        g_dx11_shadow_map_vp.Width    = (f32)(Shadow_MapSize);
+        g_dx11_shadow_map_vp.Height   = (f32)(Shadow_MapSize);
         g_dx11_shadow_map_vp.MinDepth = 0.0f;
         g_dx11_shadow_map_vp.MaxDepth = 1.0f;
         
         D3D11_TEXTURE2D_DESC shadow_map_tex_desc =
         {
-                .Width               = shadow_map_dims,
-                .Height              = shadow_map_dims,
+                .Width               = Shadow_MapSize,
+                .Height              = Shadow_MapSize,
                 .MipLevels           = 1,
-                .ArraySize           = 1,
+                .ArraySize           = Shadow_CascadeCount,
                 .Format              = DXGI_FORMAT_R32_TYPELESS,
                 .SampleDesc          = { 1, 0 },
                 .Usage               = D3D11_USAGE_DEFAULT,
@@ -1069,38 +1741,108 @@ init_rendering_states(void)
         
         AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &shadow_map_tex_desc, 0, &g_dx11_shadow_map_tex));
         
+        shadow_map_tex_desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+        AssertHR(ID3D11Device_CreateTexture2D(g_dx11_dev, &shadow_map_tex_desc, 0, &g_dx11_shadow_static_tex));
+        
         D3D11_SHADER_RESOURCE_VIEW_DESC shadow_map_srv_desc =
         {
                 .Format             = DXGI_FORMAT_R32_FLOAT,
-                .ViewDimension      = D3D11_SRV_DIMENSION_TEXTURE2D,
-                .Texture2D          = { .MipLevels = 1 }
+                .ViewDimension      = D3D11_SRV_DIMENSION_TEXTURE2DARRAY,
+                .Texture2DArray     = { .MipLevels = 1, .ArraySize = Shadow_CascadeCount }
         };
         
         AssertHR(ID3D11Device_CreateShaderResourceView(g_dx11_dev, (ID3D11Resource *)g_dx11_shadow_map_tex,
                                                        &shadow_map_srv_desc, &g_dx11_shadow_map_srv));
         
-        D3D11_DEPTH_STENCIL_VIEW_DESC shadow_map_dsv_desc =
+        for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
         {
-                .Format                 = DXGI_FORMAT_D32_FLOAT,
-                .ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D,
+                D3D11_DEPTH_STENCIL_VIEW_DESC shadow_map_dsv_desc =
+                {
+                        .Format         = DXGI_FORMAT_D32_FLOAT,
+                        .ViewDimension  = D3D11_DSV_DIMENSION_TEXTURE2DARRAY,
+                        .Texture2DArray = { .FirstArraySlice = cascade_idx, .ArraySize = 1 },
+                };
+                
+                AssertHR(ID3D11Device_CreateDepthStencilView(g_dx11_dev, (ID3D11Resource *)g_dx11_shadow_map_tex,
+                                                             &shadow_map_dsv_desc, g_dx11_shadow_map_dsvs + cascade_idx));
+                AssertHR(ID3D11Device_CreateDepthStencilView(g_dx11_dev, (ID3D11Resource *)g_dx11_shadow_static_tex,
+                                                             &shadow_map_dsv_desc, g_dx11_shadow_static_dsvs + cascade_idx));
+        }
+        shadow_cache_invalidate(&g_shadow_cache);
+        
+        g_dx11_cbuffer_shadow = dx11_create_constant_buffer(sizeof(DX11_CBuffer_Shadow), 0);
+        
+        os_work_queue_complete_all(g_shader_queue);
+        AssertTrue(vs_main_job.ok && vs_depth_only_job.ok && ps_uber_job.ok);
+        
+        Shader_Bytecode *vs_main = &vs_main_job.result;
+        AssertHR(ID3D11Device_CreateVertexShader(g_dx11_dev, vs_main->bytecode, vs_main->size, 0, &g_dx11_vshader_main));
+        
+        D3D11_INPUT_ELEMENT_DESC input_layout_desc[] =
+        {
+                {
+                        "IA_Position", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
+                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
+                },
+                
+                {
+                        "IA_Tangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
+                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
+                },
+                
+                {
+                        "IA_Bitangent", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
+                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
+                },
+                
+                {
+                        "IA_Normal", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,
+                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
+                },
+                
+                {
+                        "IA_TextureUV", 0, DXGI_FORMAT_R32G32_FLOAT, 0,
+                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
+                },
+                
+                {
+                        "IA_LightmapChart", 0, DXGI_FORMAT_R32_UINT, 0,
+                        D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0,
+                },
         };
         
-        AssertHR(ID3D11Device_CreateDepthStencilView(g_dx11_dev, (ID3D11Resource *)g_dx11_shadow_map_tex,
-                                                     &shadow_map_dsv_desc, &g_dx11_shadow_map_dsv));
+        AssertHR(ID3D11Device_CreateInputLayout(g_dx11_dev, input_layout_desc, ArrayCount(input_layout_desc), vs_main->bytecode, vs_main->size, &g_dx11_input_layout));
+        AssertHR(ID3D11Device_CreateVertexShader(g_dx11_dev, vs_depth_only_job.result.bytecode, vs_depth_only_job.result.size, 0, &g_dx11_vshader_shadow));
+        g_dx11_pshader_uber_instruction_count = dx11_shader_instruction_count(ps_uber_job.result.bytecode, ps_uber_job.result.size);
         
+        u32 shader_count = 3;
+        u32 cached_count = vs_main_job.result.from_cache + vs_depth_only_job.result.from_cache + ps_uber_job.result.from_cache;
+        shader_bytecode_free(&vs_main_job.result);
+        shader_bytecode_free(&vs_depth_only_job.result);
+        shader_bytecode_free(&ps_uber_job.result);
+        for (Shader_Key key = 0; key < ShaderKey_Count; ++key)
+        {
+                if (g_dx11_pshader_jobs[key].cache)
+                {
+                        cached_count += g_dx11_pshader_jobs[key].result.from_cache;
+                        dx11_pixel_shader_variant(key);
+                        ++shader_count;
+                }
+        }
         
-        dx11_compile_shader_from_file(L"../code/shaders/shader_main.hlsl", "vs_depth_only", "vs_5_0" , &code_blob, &error_blob);
-        AssertHR(ID3D11Device_CreateVertexShader(g_dx11_dev, DX11_BlobData(code_blob), DX11_BlobLength(code_blob), 0, &g_dx11_vshader_shadow));
-        DX11_BlobFree(code_blob);
+        u64 shader_end = os_time_now();
+        {
+                char message[128];
+                wsprintfA(message, "shaders: %d of %d from cache, %d ms\n", (s32)cached_count, (s32)shader_count,
+                          (s32)(os_seconds_between(shader_begin, shader_end) * 1000.0f));
+                os_debug_print(message);
+        }
         
         // Light Setup
-        g_light_count              = 1;
-        g_lights[0] = create_directional_light((v3f){ -5.0f, 25.0f, -5.0f }, (v3f){ 27.5f, 5, 29.5f }, (v4f){ 0.7f, 0.7f, 0.7f, 1.0f });
-        //g_lights[0].dir            = (v3f){ 0.5f, -1.0f, 0.5f };
+        g_light_count = scene_build_lights(g_lights, &g_directional_light_count);
         
-        g_lights[1].P              = (v3f){ 40.0f, 10.0f, 3.0f };
-        g_lights[1].type           = LightType_Point;
-        g_lights[1].intensity      = (v4f){ 3.0f, 0.0f, 2.0f, 1.0f };
+        light_cluster_grid_alloc(&g_light_cluster_grid);
+        g_light_cluster_queue = os_work_queue_create(Maximum(os_processor_count(), 2) - 1);
 }
 
 static void
@@ -1113,335 +1855,236 @@ dx11_set_model(DX11_Model *model)
         ID3D11DeviceContext_IASetIndexBuffer(g_dx11_dev_cont, model->ibuffer, DXGI_FORMAT_R32_UINT, 0);
 }
 
+// Textured-ness is per instance now (texture_slice), so switching material
+// within a bin costs nothing; only crossing into another bin rebinds SRVs.
+// The shipped sets never share one: the stone wall maps are 2048x2048 and
+// the oak set has no maps (the software renderer stands in 1x1 ones), so the
+// hall and the trees still rebind between their batches. Sets merge only
+// once their maps are the same size.
 static void
-dx11_set_texture(DX11_Texture2D_PBR *texture)
+dx11_bind_material_array(u32 array_idx)
 {
-        DX11_CBuffer_Main1  cbuffer_main1   = {0};
-        cbuffer_main1.enable_texture        = !!texture;
-        
-        if (texture)
-        {
-                ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 1, 3, texture->srvs);
-        }
-        else
+        Assert(array_idx < g_dx11_material_array_count);
+        g_dx11_current_material_array = array_idx;
+        ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 1, 3, g_dx11_material_arrays[array_idx].srvs);
+        ID3D11DeviceContext_PSSetConstantBuffers(g_dx11_dev_cont, 3, 1, &g_dx11_material_array_cbuffers[array_idx]);
+}
+
+// Recreates the SRVs of each bin whose resident mip the manager moved, from
+// the staging sources, so evicted mips are freed on the GPU and loaded ones
+// copied back. A change costs one copy of the bin's resident mips.
+static void
+dx11_update_material_residency(void)
+{
+        for (u32 array_idx = 0; array_idx < g_dx11_material_array_count; ++array_idx)
         {
-                ID3D11ShaderResourceView *srvs[3] = { 0, 0, 0 };
-                ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 1, 3, srvs);
+                Residency_Texture *texture = g_residency.textures + g_material_array_texture_ids[array_idx];
+                if (texture->resident_mip == g_dx11_material_array_resident_mip[array_idx])
+                {
+                        continue;
+                }
+                
+                g_dx11_material_array_resident_mip[array_idx] = texture->resident_mip;
+                for (u32 map_idx = 0; map_idx < MaterialArray_MapCount; ++map_idx)
+                {
+                        ID3D11ShaderResourceView_Release(g_dx11_material_arrays[array_idx].srvs[map_idx]);
+                        g_dx11_material_arrays[array_idx].srvs[map_idx] = dx11_create_resident_texture2d_array(g_dx11_material_array_sources[array_idx][map_idx],
+                                                                                                               texture->resident_mip);
+                }
         }
-        
-        D3D11_MAPPED_SUBRESOURCE mapped_subresource;
-        ID3D11DeviceContext_Map(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_cbuffer_main1, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_subresource);
-        CopyMemory(mapped_subresource.pData, &cbuffer_main1, sizeof(cbuffer_main1));
-        ID3D11DeviceContext_Unmap(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_cbuffer_main1, 0);
 }
 
 static void
-dx11_draw_indexed_instanced(Model_Instances *instances)
+dx11_draw_indexed_instanced(Model_Instance *instances, u32 instance_count)
 {
         AssertTrue(g_dx11_current_model && instances);
-        if (instances->count)
+        Assert(instance_count <= MaxModelInstances);
+        if (instance_count)
         {
                 D3D11_MAPPED_SUBRESOURCE mapped_subresource;
                 ID3D11DeviceContext_Map(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_sbuffer_model_instances, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_subresource);
-                CopyMemory(mapped_subresource.pData, instances->ins, sizeof(instances->ins));
+                CopyMemory(mapped_subresource.pData, instances, instance_count * sizeof(Model_Instance));
                 ID3D11DeviceContext_Unmap(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_sbuffer_model_instances, 0);
-                ID3D11DeviceContext_DrawIndexedInstanced(g_dx11_dev_cont, g_dx11_current_model->index_count, (UINT)instances->count, 0, 0, 0);
-                
-                instances->count = 0;
+                ID3D11DeviceContext_DrawIndexedInstanced(g_dx11_dev_cont, g_dx11_current_model->index_count, instance_count, 0, 0, 0);
         }
 }
 
-typedef struct
-{
-        b32 camera_roam;
-        v3f camera_p;
-        f32 camera_rotate_yz;
-        f32 camera_rotate_xz;
-        f32 camera_sens;
-        f32 camera_move_comp;
-} Scene_State;
-
-#define ScenePlatform_BlockCountDepth 40
-#define ScenePlatform_BlockCountWidth 40
-#define Scene_BlockWidth 2.0f
-#define Scene_PillarCount 9
 static void
-scene_init(Scene_State *scene)
+scene_draw(Scene_Instances *scene)
 {
-        scene->camera_roam        = false;
-        scene->camera_p           = v3f_zero();
-        scene->camera_rotate_yz   = 90;
-        scene->camera_rotate_xz   = 90;
-        scene->camera_sens        = 6.0f;
-        scene->camera_move_comp   = 8.0f;
+        ProfileBegin("scene_draw");
+        // SRVs do not survive ClearState, so every pass binds its first bin
+        g_dx11_current_material_array = TexPack_MaxArrays;
+        for (u32 batch_idx = 0; batch_idx < scene->batch_count; ++batch_idx)
+        {
+                Scene_Batch *batch = scene->batches + batch_idx;
+                if ((batch->material_array != SceneBatch_AnyArray) && (batch->material_array != g_dx11_current_material_array))
+                {
+                        dx11_bind_material_array(batch->material_array);
+                }
+                
+                dx11_set_model(g_dx11_scene_models[batch->model]);
+                dx11_draw_indexed_instanced(scene->ins + batch->first_instance, batch->instance_count);
+        }
+        ProfileEnd("scene_draw");
 }
 
+// scene_draw for the shaded pass: each run of instances that share a
+// Shader_Key draws with its own ps_main variant.
 static void
-scene_draw(void)
+scene_draw_shaded(Scene_Instances *scene)
 {
-        f32 scene_width_size      = ((ScenePlatform_BlockCountWidth) * Scene_BlockWidth);
-        f32 scene_depth_size      = ((ScenePlatform_BlockCountDepth) * Scene_BlockWidth);
-        Model_Instances instances = {0};
-        dx11_set_model(&g_dx11_cube_model);
-        // platform
-        dx11_set_texture(&g_gray_brick_tex);
-        for (s32 depth_idx = 0; depth_idx < ScenePlatform_BlockCountDepth; ++depth_idx)
-        {
-                for (s32 width_idx = 0; width_idx < ScenePlatform_BlockCountWidth; ++width_idx)
-                {
-                        add_model_instance(&instances, (v3f){ (f32)(width_idx) * Scene_BlockWidth, 0.0f, (f32)(depth_idx) * Scene_BlockWidth },
-                                           (v3f){ Scene_BlockWidth, Scene_BlockWidth, Scene_BlockWidth },
-                                           m33_make_identity(),
-                                           (v4f){ 0.5f, 0.5f, 0.5f, 1.0f });
-                }
-        }
+        u32 directional_count = Minimum(g_directional_light_count, ShaderKey_MaxDirectional);
+        b32 clustered_lights  = (g_light_count > g_directional_light_count);
         
-        // "roof"
-        
-        for (s32 line_idx = 0; line_idx < 2; ++line_idx)
+        ID3D11PixelShader *current_shader = 0;
+        g_dx11_current_material_array = TexPack_MaxArrays;
+        for (u32 batch_idx = 0; batch_idx < scene->batch_count; ++batch_idx)
         {
-                for (s32 depth_idx = 0; depth_idx < ScenePlatform_BlockCountDepth; ++depth_idx)
+                Scene_Batch *batch = scene->batches + batch_idx;
+                b32 cone_step      = false;
+                if (batch->material_array != SceneBatch_AnyArray)
                 {
-                        add_model_instance(&instances,
-                                           (v3f)
-                                           {
-                                                   (scene_width_size - Scene_BlockWidth) * line_idx,
-                                                   9.0f * Scene_BlockWidth,
-                                                   (f32)(depth_idx) * Scene_BlockWidth
-                                           },
-                                           (v3f){ Scene_BlockWidth, Scene_BlockWidth, Scene_BlockWidth },
-                                           m33_make_identity(),
-                                           (v4f){ 0.5f, 0.5f, 0.5f, 1.0f });
-                } 
-        }
-        
-        {
-                for (s32 line_idx = 0; line_idx <= (ScenePlatform_BlockCountWidth / 8); ++line_idx)
-                {
-                        s32 interval      = 4;
-                        s32 y_level_min   = 9;
-                        s32 y_level_max   = y_level_min + ((ScenePlatform_BlockCountWidth / 2) / interval);
-                        s32 y_level       = y_level_min;
-                        s32 direction     = 1;
-                        for (s32 width_idx = 1; width_idx < (ScenePlatform_BlockCountWidth - 1); ++width_idx)
+                        if (batch->material_array != g_dx11_current_material_array)
                         {
-                                if ((width_idx % interval) == 0)
-                                {
-                                        y_level += direction;
-                                        if (y_level >= y_level_max)
-                                        {
-                                                direction = -1;
-                                        }    
-                                }
-                                add_model_instance(&instances,
-                                                   (v3f)
-                                                   {
-                                                           (f32)width_idx * Scene_BlockWidth,
-                                                           y_level * Scene_BlockWidth,
-                                                           (f32)(line_idx) * 8 * Scene_BlockWidth,
-                                                   },
-                                                   (v3f){ Scene_BlockWidth, Scene_BlockWidth, Scene_BlockWidth },
-                                                   m33_make_identity(),
-                                                   (v4f){ 0.5f, 0.5f, 0.5f, 1.0f });
+                                dx11_bind_material_array(batch->material_array);
                         }
+                        cone_step = g_dx11_material_array_cone_step[batch->material_array];
                 }
-        }
-        
-        dx11_draw_indexed_instanced(&instances);
-        dx11_set_texture(&g_oak_trunk_tex);
-        //dx11_set_texture(0);
-        
-        // pillars
-        {
-                dx11_set_model(&g_dx11_cylinder_model);
                 
-                f32 cylinder_diameter     = 2.0f;
-                f32 offset_per_pillar     = (scene_depth_size / cylinder_diameter) / (Scene_PillarCount);
-                f32 total_length_spanned  = (Scene_PillarCount - 1) * cylinder_diameter + offset_per_pillar * (Scene_PillarCount - 1);
-                f32 offset                = (scene_depth_size - total_length_spanned) * 0.5f;
+                dx11_set_model(g_dx11_scene_models[batch->model]);
                 
-                for (s32 pillar_set_idx = 0; pillar_set_idx < 2; ++pillar_set_idx)
+                // instances keep the order they were added in, so runs are long
+                Shader_Key pass_key  = shader_key_make_pass(cone_step, directional_count, clustered_lights);
+                u32        run_begin = batch->first_instance;
+                u32        batch_end = batch->first_instance + batch->instance_count;
+                while (run_begin < batch_end)
                 {
-                        for (s32 pillar_idx = 0; pillar_idx < Scene_PillarCount; ++pillar_idx)
+                        Shader_Key key     = shader_key_for_instance(scene->ins + run_begin, pass_key);
+                        u32        run_end = run_begin + 1;
+                        while ((run_end < batch_end) && (shader_key_for_instance(scene->ins + run_end, pass_key) == key))
                         {
-                                f32 x = (scene_width_size * pillar_set_idx - Scene_BlockWidth * pillar_set_idx);
-                                f32 y = 5.0f;
-                                f32 z = (f32)pillar_idx * cylinder_diameter + offset_per_pillar * pillar_idx + offset;
-                                
-                                add_model_instance(&instances, (v3f) { x, y + 8.0f, z },
-                                                   (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f });
-                                
-                                add_model_instance(&instances, (v3f) { x, y + 4.0f, z },
-                                                   (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f });
-                                
-                                add_model_instance(&instances, (v3f) { x, y, z },
-                                                   (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f });
-                                
-                                add_model_instance(&instances, (v3f) { x, y - 4.0f, z },
-                                                   (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f });
-                                
-                                
-                                add_model_instance(&instances, (v3f) { x  + (Scene_BlockWidth * 4 * (pillar_set_idx == 0 ? 1 : -1)), 5, z },
-                                                   (v3f){ 2.0f, 2.0f, 2.0f }, m33_make_identity(), (v4f){ 0.0f, 1.0f, 1.0f, 1.0f });
+                                ++run_end;
                         }
-                }
-                
-                dx11_draw_indexed_instanced(&instances);
-                dx11_set_texture(0);
-                
-                dx11_set_model(&g_dx11_sphere_model);
-                
-                for (s32 pillar_set_idx = 0; pillar_set_idx < 2; ++pillar_set_idx)
-                {
-                        for (s32 pillar_idx = 0; pillar_idx < Scene_PillarCount; ++pillar_idx)
+                        
+                        ID3D11PixelShader *shader = dx11_pixel_shader_variant(key);
+                        if (shader != current_shader)
                         {
-                                add_model_instance(&instances,
-                                                   (v3f)
-                                                   {
-                                                           (scene_width_size * pillar_set_idx - Scene_BlockWidth * pillar_set_idx) + (Scene_BlockWidth * 4 * (pillar_set_idx == 0 ? 1 : -1)),
-                                                           10.0f,
-                                                           (f32)pillar_idx * cylinder_diameter + offset_per_pillar * pillar_idx + offset
-                                                   },
-                                                   (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f });
+                                ID3D11DeviceContext_PSSetShader(g_dx11_dev_cont, shader, 0, 0);
+                                current_shader = shader;
                         }
+                        
+                        dx11_draw_indexed_instanced(scene->ins + run_begin, run_end - run_begin);
+                        run_begin = run_end;
                 }
         }
-        
-        for (u32 light_idx = 0; light_idx < g_light_count; ++light_idx)
-        {
-                Light light = g_lights[light_idx];
-                add_model_instance(&instances, light.P, (v3f){ 0.3f, 0.3f, 0.3f }, m33_make_identity(), light.intensity)->enable_lighting = 0;
-        }
-        // reflective sphere
-        {
-                f32 sphere_x = scene_width_size * 0.5f;
-                f32 sphere_z = scene_depth_size * 0.5f;
-                add_model_instance(&instances,
-                                   (v3f)
-                                   {
-                                           sphere_x,
-                                           Scene_BlockWidth + 6,
-                                           sphere_z
-                                   },
-                                   v3f_s(8.0f), m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f });
-        }
-        
-        dx11_draw_indexed_instanced(&instances);
 }
 
+// cursor_dx and cursor_dy are how far the cursor moved this frame, as
+// os_cursor_take_delta or a replay hands them over
 static void
-scene_update_and_render(Scene_State *scene, f32 game_update_secs)
+scene_update_and_render(Scene_State *scene, s32 cursor_dx, s32 cursor_dy, f32 game_update_secs)
 {
+        ProfileBegin("update");
         if (os_key_released(OS_KeyType_Esc))
         {
                 scene->camera_roam = !scene->camera_roam;
-                ShowCursor(!scene->camera_roam);
-        }
-        
-        if (scene->camera_roam)
-        {
-                f32 mouse_delta_x, mouse_delta_y;
-                
-                POINT cursor_p;
-                GetCursorPos(&cursor_p);
-                
-                ScreenToClient(g_w32_window, &cursor_p);
-                
-                POINT middle;
-                middle.x = g_w32_window_width / 2;
-                middle.y = g_w32_window_height / 2;
-                ClientToScreen(g_w32_window, &middle);
-                SetCursorPos(middle.x, middle.y);
-                
-                mouse_delta_x = (f32)((g_w32_window_width * 0.5f) - cursor_p.x) * scene->camera_sens * game_update_secs;
-                mouse_delta_y = (f32)(cursor_p.y - (g_w32_window_height * 0.5f)) * scene->camera_sens * game_update_secs;
-                
-                scene->camera_rotate_yz += mouse_delta_y;
-                scene->camera_rotate_xz += mouse_delta_x;
-                if (scene->camera_rotate_yz < -179.0f)
-                {
-                        scene->camera_rotate_yz = -179.0f;
-                }
-                
-                if (scene->camera_rotate_yz > 179.0f)
-                {
-                        scene->camera_rotate_yz = 179.0f;
-                }
-                
-                if (scene->camera_rotate_yz >= 360.0f)
-                {
-                        scene->camera_rotate_xz = 0.0f;
-                }
-                
-                if (scene->camera_rotate_xz <= 0.0f)
-                {
-                        scene->camera_rotate_xz = 360.0f;
-                } 
+                os_cursor_show(!scene->camera_roam);
         }
         
-        f32 move_comp    = scene->camera_move_comp * game_update_secs;
-        f32 xz           = Radians(scene->camera_rotate_xz);
-        f32 yz           = Radians(scene->camera_rotate_yz);
-        v3f temp_up      = (v3f){ 0.0f, 1.0f, 0.0f };
-        v3f camera_front = v3f_normalized((v3f){ cosf(xz) * sinf(yz), cosf(yz), sinf(xz) * sinf(yz) });
+        Scene_Camera_Input camera_input = {0};
+        camera_input.cursor_dx = cursor_dx;
+        camera_input.cursor_dy = cursor_dy;
+        camera_input.moves |= os_key_held(OS_KeyType_W) ? SceneMove_Forward : 0;
+        camera_input.moves |= os_key_held(OS_KeyType_A) ? SceneMove_Left : 0;
+        camera_input.moves |= os_key_held(OS_KeyType_S) ? SceneMove_Back : 0;
+        camera_input.moves |= os_key_held(OS_KeyType_D) ? SceneMove_Right : 0;
+        camera_input.moves |= os_key_held(OS_KeyType_Space) ? SceneMove_Up : 0;
+        camera_input.moves |= os_key_held(OS_KeyType_X) ? SceneMove_Down : 0;
+        scene_update_camera(scene, &camera_input, game_update_secs);
         
-        f32 scaling          = v3f_inner(temp_up, camera_front);
-        v3f camera_up        = v3f_normalized(v3f_sub(temp_up, v3f_scale(scaling, camera_front)));
-        v3f camera_right     = v3f_normalized(v3f_cross(camera_up, camera_front));
+        Scene_Camera_View camera = scene_camera_view(scene);
         
-        if (os_key_held(OS_KeyType_W))
-        {
-                v3f_add_eq(&scene->camera_p, v3f_scale(move_comp, camera_front));
-        }
+        g_first_light_t            += game_update_secs * 2.0f;
         
-        if (os_key_held(OS_KeyType_A))
-        {
-                v3f_sub_eq(&scene->camera_p, v3f_scale(move_comp, camera_right));
-        }
+        scene_animate_lights(g_lights, g_first_light_t);
         
-        if (os_key_held(OS_KeyType_S))
-        {
-                v3f_sub_eq(&scene->camera_p, v3f_scale(move_comp, camera_front));
-        }
+        scene_begin_dynamic(&g_scene);
+        scene_add_light_gizmos(&g_scene, g_lights, g_light_count);
+        ProfileEnd("update");
         
-        if (os_key_held(OS_KeyType_D))
+        ProfileBegin("residency");
+        f32 camera_fov                    = Radians(Scene_CameraFovDegrees);
+        f32 pixels_per_unit_at_unit_dist  = g_dx11_viewport_main.Width / (2.0f * tanf(camera_fov * 0.5f));
+        residency_request_scene(&g_residency, &g_scene, g_material_texture_ids, scene->camera_p, camera.front, pixels_per_unit_at_unit_dist);
+        residency_update(&g_residency);
+        dx11_update_material_residency();
+        if (g_vtex_enabled)
         {
-                v3f_add_eq(&scene->camera_p, v3f_scale(move_comp, camera_right));
+                dx11_update_virtual_texture();
         }
+        ProfileEnd("residency");
         
-        if (os_key_held(OS_KeyType_Space))
+        DX11_CBuffer_Main0 cbuffer0 =
         {
-                v3f_add_eq(&scene->camera_p, v3f_scale(move_comp, camera_up));
-        }
+                .projection                    = m44_make_perspective_z01(g_dx11_viewport_main.Height / g_dx11_viewport_main.Width, camera_fov, Scene_CameraNear, Scene_CameraFar),
+                .world_basis_to_camera_basis   = camera.world_to_view,
+        };
         
-        if (os_key_held(OS_KeyType_X))
+        f32 tan_half_fov_x = tanf(camera_fov * 0.5f);
+        f32 tan_half_fov_y = tan_half_fov_x * (g_dx11_viewport_main.Height / g_dx11_viewport_main.Width);
+        ProfileBegin("light_cluster_build");
+        light_cluster_set_camera(&g_light_cluster_grid, cbuffer0.world_basis_to_camera_basis, tan_half_fov_x, tan_half_fov_y, Scene_CameraNear, Scene_CameraFar);
+        light_cluster_build(&g_light_cluster_grid, g_lights, g_light_count, g_light_cluster_queue);
+        ProfileEnd("light_cluster_build");
+        // the cluster jobs are all done by now, so the queue is free for the depth tiles
+        ProfileBegin("occlusion_render");
+        occlusion_set_camera(&g_occlusion, scene->camera_p, m44_mul(cbuffer0.world_basis_to_camera_basis, cbuffer0.projection));
+        occlusion_render(&g_occlusion, g_light_cluster_queue);
+        ProfileEnd("occlusion_render");
+        
+        // what the shaded pass draws, first so the shadow pass can tell
+        // whether any of it samples the cascades; only the shaded pass is
+        // filtered, casters outside the set still throw shadows into it
+        ProfileBegin("visible_set");
+        Scene_Instances *visible_scene = &g_scene;
+        if (pvs_view_update(&g_pvs_view, scene->camera_p) && g_pvs_view.row_pays)
         {
-                v3f_sub_eq(&scene->camera_p, v3f_scale(move_comp, camera_up));
+                pvs_cull_scene(g_pvs_view.row, &g_scene, &g_pvs_scene);
+                g_pvs_culled_instances += g_scene.instance_count - g_pvs_scene.instance_count;
+                ++g_pvs_frames_filtered;
+                visible_scene = &g_pvs_scene;
         }
+        occlusion_cull_scene(&g_occlusion, visible_scene, &g_occlusion_scene);
+        b32 shadows_received = shadow_scene_has_receivers(&g_occlusion_scene);
+        ProfileEnd("visible_set");
         
-        g_first_light_t            += game_update_secs * 2.0f;
-        
-        g_lights[1].P              = (v3f){ 40.0f + 18*cosf(g_first_light_t), 10.0f, 40 + 18* sinf(g_first_light_t) };
-        
-        DX11_CBuffer_Main0 cbuffer0 =
+        DX11_CBuffer_Main2 cbuffer_main2 =
         {
-                .projection                    = m44_make_perspective_z01(g_dx11_viewport_main.Height / g_dx11_viewport_main.Width, Radians(66.2f), 0.1f, 1000.0f),
-                .world_basis_to_camera_basis   = (m44)
-                {
-                        camera_right.x, camera_up.x, camera_front.x, 0.0f,
-                        camera_right.y, camera_up.y, camera_front.y, 0.0f,
-                        camera_right.z, camera_up.z, camera_front.z, 0.0f,
-                        -v3f_inner(camera_right, scene->camera_p), -v3f_inner(camera_up, scene->camera_p), -v3f_inner(camera_front, scene->camera_p), 1.0f
-                },
+                .eye_p                   = scene->camera_p,
+                .directional_light_count = g_directional_light_count,
+                .cluster_tiles_per_pixel = { LightCluster_TilesX / g_dx11_viewport_main.Width, LightCluster_TilesY / g_dx11_viewport_main.Height },
+                .cluster_z_scale         = g_light_cluster_grid.z_scale,
+                .cluster_z_bias          = g_light_cluster_grid.z_bias,
         };
+        ProfileBegin("shadow_fit_cascades");
+        // the maps and their constants keep whatever they last held while nothing shaded reads them
+        if (shadows_received)
+        {
+                shadow_fit_cascades(&g_shadow_cascades, g_lights[0].dir, scene->camera_p, camera.front, tan_half_fov_x, tan_half_fov_y, Scene_CameraNear, &g_scene);
+        }
         
-        DX11_CBuffer_Main2 cbuffer_main2 =
+        DX11_CBuffer_Shadow cbuffer_shadow = {0};
+        for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
         {
-                .eye_p       = scene->camera_p,
-                .light_count = g_light_count,
-        };
-        CopyMemory(cbuffer_main2.lights, g_lights, sizeof(g_lights));
+                Shadow_Cascade *cascade = g_shadow_cascades.cascades + cascade_idx;
+                cbuffer_shadow.cascade_world_to_clip[cascade_idx] = cascade->world_to_clip;
+                // about two texels of depth slope, so bigger cascades get more bias
+                cbuffer_shadow.cascade_depth_bias.v[cascade_idx]  = 2.0f * cascade->texel_world_size / (cascade->far_plane - cascade->near_plane);
+        }
+        ProfileEnd("shadow_fit_cascades");
         
+        ProfileBegin("upload");
         D3D11_MAPPED_SUBRESOURCE mapped_subresource;
         ID3D11DeviceContext_Map(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_cbuffer_main0, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_subresource);
         CopyMemory(mapped_subresource.pData, &cbuffer0, sizeof(cbuffer0));
@@ -1451,6 +2094,19 @@ scene_update_and_render(Scene_State *scene, f32 game_update_secs)
         CopyMemory(mapped_subresource.pData, &cbuffer_main2, sizeof(cbuffer_main2));
         ID3D11DeviceContext_Unmap(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_cbuffer_main2, 0);
         
+        ID3D11DeviceContext_Map(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_sbuffer_lights, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_subresource);
+        CopyMemory(mapped_subresource.pData, g_lights, g_light_count * sizeof(Light));
+        ID3D11DeviceContext_Unmap(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_sbuffer_lights, 0);
+        
+        D3D11_MAPPED_SUBRESOURCE mapped_indices;
+        ID3D11DeviceContext_Map(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_sbuffer_light_clusters, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_subresource);
+        ID3D11DeviceContext_Map(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_sbuffer_light_indices, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_indices);
+        light_cluster_copy(&g_light_cluster_grid, (Light_Cluster *)mapped_subresource.pData, (u32 *)mapped_indices.pData);
+        ID3D11DeviceContext_Unmap(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_sbuffer_light_indices, 0);
+        ID3D11DeviceContext_Unmap(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_sbuffer_light_clusters, 0);
+        ProfileEnd("upload");
+        
+        ProfileBegin("shadow_pass");
         ID3D11DeviceContext_IASetPrimitiveTopology(g_dx11_dev_cont, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
         ID3D11DeviceContext_IASetInputLayout(g_dx11_dev_cont, g_dx11_input_layout);
         
@@ -1459,6 +2115,7 @@ scene_update_and_render(Scene_State *scene, f32 game_update_secs)
         ID3D11DeviceContext_VSSetShaderResources(g_dx11_dev_cont, 0, 1, &g_dx11_sbuffer_model_instances_srv);
         
         ID3D11DeviceContext_VSSetConstantBuffers(g_dx11_dev_cont, 2, 1, &g_dx11_cbuffer_main2);
+        ID3D11DeviceContext_VSSetConstantBuffers(g_dx11_dev_cont, 5, 1, &g_dx11_cbuffer_shadow);
         ID3D11DeviceContext_VSSetShader(g_dx11_dev_cont, g_dx11_vshader_shadow, 0, 0);
         ID3D11DeviceContext_VSSetShaderResources(g_dx11_dev_cont, 0, 1, &g_dx11_sbuffer_model_instances_srv);
         
@@ -1470,14 +2127,55 @@ scene_update_and_render(Scene_State *scene, f32 game_update_secs)
         ID3D11DeviceContext_OMSetBlendState(g_dx11_dev_cont, g_dx11_blend_alpha, 0, 0xFFFFFFFF);
         ID3D11DeviceContext_OMSetDepthStencilState(g_dx11_dev_cont, g_dx11_depth_less_stencil_nope, 0);
         
-        ID3D11DeviceContext_ClearDepthStencilView(g_dx11_dev_cont, g_dx11_shadow_map_dsv, D3D11_CLEAR_DEPTH, 1.0f, 0);
-        ID3D11DeviceContext_OMSetRenderTargets(g_dx11_dev_cont, 0, 0, g_dx11_shadow_map_dsv);
+        for (u32 cascade_idx = 0; shadows_received && (cascade_idx < Shadow_CascadeCount); ++cascade_idx)
+        {
+                cbuffer_shadow.cascade_current = cascade_idx;
+                ID3D11DeviceContext_Map(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_cbuffer_shadow, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_subresource);
+                CopyMemory(mapped_subresource.pData, &cbuffer_shadow, sizeof(cbuffer_shadow));
+                ID3D11DeviceContext_Unmap(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_cbuffer_shadow, 0);
+                
+                if (shadow_cache_needs_static_redraw(&g_shadow_cache, &g_shadow_cascades, cascade_idx, g_scene.static_generation))
+                {
+                        ID3D11DeviceContext_ClearDepthStencilView(g_dx11_dev_cont, g_dx11_shadow_static_dsvs[cascade_idx], D3D11_CLEAR_DEPTH, 1.0f, 0);
+                        ID3D11DeviceContext_OMSetRenderTargets(g_dx11_dev_cont, 0, 0, g_dx11_shadow_static_dsvs[cascade_idx]);
+                        
+                        shadow_cull_scene(&g_shadow_cascades, cascade_idx, &g_scene, 0, g_scene.static_instance_count, &g_shadow_cascade_scene);
+                        scene_draw(&g_shadow_cascade_scene);
+                        ID3D11DeviceContext_OMSetRenderTargets(g_dx11_dev_cont, 0, 0, 0);
+                }
+                
+                ID3D11DeviceContext_CopySubresourceRegion(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_shadow_map_tex, cascade_idx, 0, 0, 0,
+                                                          (ID3D11Resource *)g_dx11_shadow_static_tex, cascade_idx, 0);
+                ID3D11DeviceContext_OMSetRenderTargets(g_dx11_dev_cont, 0, 0, g_dx11_shadow_map_dsvs[cascade_idx]);
+                
+                shadow_cull_scene(&g_shadow_cascades, cascade_idx, &g_scene, g_scene.static_instance_count, g_scene.instance_count, &g_shadow_cascade_scene);
+                g_shadow_cache.dynamic_instances += g_shadow_cascade_scene.instance_count;
+                scene_draw(&g_shadow_cascade_scene);
+        }
+        ProfileEnd("shadow_pass");
         
-        scene_draw();
+#if defined(ENGINE_DEBUG)
+        // cache counters and texel density, about once a minute at 60 Hz
+        if ((++g_shadow_frame % 3600) == 0)
+        {
+                char message[512];
+                s32 length = wsprintfA(message, "shadow cache:");
+                for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+                {
+                        length += wsprintfA(message + length, " [%d redrawn, %d skipped, %d texels/m]",
+                                            (s32)g_shadow_cache.static_redraws[cascade_idx], (s32)g_shadow_cache.static_skips[cascade_idx],
+                                            (s32)(shadow_texels_per_unit(g_shadow_cascades.cascades + cascade_idx) + 0.5f));
+                }
+                wsprintfA(message + length, ", %d dynamic casters per frame\n", (s32)(g_shadow_cache.dynamic_instances / g_shadow_frame));
+                os_debug_print(message);
+        }
+#endif
         
         // set DSV to null to avoid D3D11 screaming at us
         ID3D11DeviceContext_OMSetRenderTargets(g_dx11_dev_cont, 0, 0, 0);
         
+        ProfileBegin("shaded_pass");
+        
         float clear_colour[4] = {0};
         ID3D11DeviceContext_ClearRenderTargetView(g_dx11_dev_cont, g_dx11_back_buffer_rtv, clear_colour);
         ID3D11DeviceContext_ClearDepthStencilView(g_dx11_dev_cont, g_dx11_depth_stencil_dsv_main, D3D11_CLEAR_DEPTH, 1.0f, 0);
@@ -1487,11 +2185,17 @@ scene_update_and_render(Scene_State *scene, f32 game_update_secs)
         ID3D11DeviceContext_VSSetConstantBuffers(g_dx11_dev_cont, 2, 1, &null_buffer);
         ID3D11DeviceContext_VSSetShader(g_dx11_dev_cont, g_dx11_vshader_main, 0, 0);
         ID3D11DeviceContext_VSSetShaderResources(g_dx11_dev_cont, 0, 1, &g_dx11_sbuffer_model_instances_srv);
+        ID3D11DeviceContext_VSSetShaderResources(g_dx11_dev_cont, 14, 1, &g_dx11_lightmap_charts_srv);
+        ID3D11DeviceContext_VSSetShaderResources(g_dx11_dev_cont, 15, 1, &g_dx11_vertex_ao_srv);
         
         ID3D11DeviceContext_PSSetConstantBuffers(g_dx11_dev_cont, 1, 1, &g_dx11_cbuffer_main1);
         ID3D11DeviceContext_PSSetConstantBuffers(g_dx11_dev_cont, 2, 1, &g_dx11_cbuffer_main2);
+        ID3D11DeviceContext_PSSetConstantBuffers(g_dx11_dev_cont, 5, 1, &g_dx11_cbuffer_shadow);
         ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 4, 1, &g_dx11_shadow_map_srv);
-        ID3D11DeviceContext_PSSetShader(g_dx11_dev_cont, g_dx11_pshader_main, 0, 0);
+        ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 9, ArrayCount(g_dx11_light_srvs), g_dx11_light_srvs);
+        ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 12, 1, &g_dx11_reflection_probe_srv);
+        ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 13, 1, &g_dx11_lightmap_srv);
+        ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 16, 1, &g_dx11_irradiance_volume_srv);
         ID3D11DeviceContext_PSSetSamplers(g_dx11_dev_cont, 0, 1, &g_dx11_sampler_linear_all);
         ID3D11DeviceContext_PSSetSamplers(g_dx11_dev_cont, 1, 1, &g_dx11_sampler_point_all);
         ID3D11DeviceContext_PSSetSamplers(g_dx11_dev_cont, 2, 1, &g_dx11_sampler_shadow_map);
@@ -1499,12 +2203,55 @@ scene_update_and_render(Scene_State *scene, f32 game_update_secs)
         ID3D11DeviceContext_RSSetState(g_dx11_dev_cont, g_dx11_rasterizer_fill_cull_back_ccw);
         ID3D11DeviceContext_RSSetViewports(g_dx11_dev_cont, 1, &g_dx11_viewport_main);
         
-        ID3D11DeviceContext_OMSetRenderTargets(g_dx11_dev_cont, 1, &g_dx11_back_buffer_rtv, g_dx11_depth_stencil_dsv_main);
+        if (g_vtex_enabled)
+        {
+                UINT clear_feedback[4] = { VTexTile_None, VTexTile_None, VTexTile_None, VTexTile_None };
+                ID3D11DeviceContext_ClearUnorderedAccessViewUint(g_dx11_dev_cont, g_dx11_vtex_feedback_uav, clear_feedback);
+                ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 5, ArrayCount(g_dx11_vtex_srvs), g_dx11_vtex_srvs);
+                ID3D11DeviceContext_PSSetConstantBuffers(g_dx11_dev_cont, 4, 1, &g_dx11_vtex_cbuffer);
+                ID3D11DeviceContext_OMSetRenderTargetsAndUnorderedAccessViews(g_dx11_dev_cont, 1, &g_dx11_back_buffer_rtv, g_dx11_depth_stencil_dsv_main,
+                                                                              1, 1, &g_dx11_vtex_feedback_uav, 0);
+        }
+        else
+        {
+                ID3D11DeviceContext_OMSetRenderTargets(g_dx11_dev_cont, 1, &g_dx11_back_buffer_rtv, g_dx11_depth_stencil_dsv_main);
+        }
+        
+        scene_draw_shaded(&g_occlusion_scene);
+        ProfileEnd("shaded_pass");
         
-        scene_draw();
+#if defined(ENGINE_DEBUG)
+        if (g_pvs_view.file && ((++g_pvs_frame % 3600) == 0))
+        {
+                char message[256];
+                wsprintfA(message, "pvs: %d%% of frames filtered, %d of %d static instances culled per such frame, %d cell changes\n",
+                          (s32)(100 * g_pvs_frames_filtered / g_pvs_frame),
+                          (s32)(g_pvs_frames_filtered ? g_pvs_culled_instances / g_pvs_frames_filtered : 0),
+                          (s32)g_scene.static_instance_count, (s32)g_pvs_view.row_loads);
+                os_debug_print(message);
+        }
+        
+        if ((++g_occlusion_frame % 3600) == 0)
+        {
+                char message[256];
+                wsprintfA(message, "occlusion: %d occluders, %d off screen and %d occluded of %d instances per frame\n",
+                          (s32)g_occlusion.occluder_count,
+                          (s32)(g_occlusion.outside_count / g_occlusion_frame),
+                          (s32)(g_occlusion.occluded_count / g_occlusion_frame),
+                          (s32)(g_occlusion.tested_count / g_occlusion_frame));
+                os_debug_print(message);
+        }
+#endif
         
         ID3D11ShaderResourceView *null_srv = 0;
         ID3D11DeviceContext_PSSetShaderResources(g_dx11_dev_cont, 4, 1, &null_srv);
+        if (g_vtex_enabled)
+        {
+                ID3D11DeviceContext_OMSetRenderTargets(g_dx11_dev_cont, 1, &g_dx11_back_buffer_rtv, g_dx11_depth_stencil_dsv_main);
+                ID3D11DeviceContext_CopyResource(g_dx11_dev_cont, (ID3D11Resource *)g_dx11_vtex_feedback_staging[g_vtex_frame % DX11_VTex_ReadbackLatency],
+                                                 (ID3D11Resource *)g_dx11_vtex_feedback_tex);
+                ++g_vtex_frame;
+        }
 }
 
 int __stdcall
@@ -1515,41 +2262,52 @@ WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nCmdSh
         (void)lpCmdLine;
         (void)nCmdShow;
         
-        SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
-        
-        WNDCLASS wnd_class =
-        {
-                .style           = 0,
-                .lpfnWndProc     = &w32_window_proc,
-                .cbClsExtra      = 0,
-                .cbWndExtra      = 0,
-                .hInstance       = GetModuleHandleA(0),
-                .hIcon           = LoadIconA(0, IDI_APPLICATION),
-                .hCursor         = LoadCursorA(0, IDC_ARROW),
-                .hbrBackground   = GetStockObject(BLACK_BRUSH),
-                .lpszMenuName    = 0,
-                .lpszClassName   = "Game Project",
-        };
-        
-        g_w32_window_width   = 1280;
-        g_w32_window_height  = 720;
-        RegisterClassA(&wnd_class);
-        RECT w32_client_rect =
+        // -headless keeps the window hidden; frames still render and present to it.
+        // -record <file> and -replay <file> save and play back the input of a run
+        // (input_record.h), and -fixed_step advances the game by
+        // InputRecord_FixedStep every frame whatever the display runs at, so
+        // benchmark runs draw the same frames everywhere. -trace <file> writes
+        // the profiler's zones out as a Chrome trace on the way out (profile.h).
+        b32   headless    = false;
+        b32   fixed_step  = false;
+        char *record_path = 0;
+        char *replay_path = 0;
+        char *trace_path  = 0;
+        for (int arg_idx = 1; arg_idx < __argc; ++arg_idx)
         {
-                .left       = 0,
-                .top        = 0,
-                .right      = g_w32_window_width,
-                .bottom     = g_w32_window_height,
-        };
-        AdjustWindowRect(&w32_client_rect, WS_OVERLAPPEDWINDOW, FALSE);
+                char *arg  = __argv[arg_idx];
+                char *next = (arg_idx + 1 < __argc) ? __argv[arg_idx + 1] : 0;
+                if (lstrcmpA(arg, "-headless") == 0)
+                {
+                        headless = true;
+                }
+                else if (lstrcmpA(arg, "-fixed_step") == 0)
+                {
+                        fixed_step = true;
+                }
+                else if ((lstrcmpA(arg, "-record") == 0) && next)
+                {
+                        record_path = next;
+                        ++arg_idx;
+                }
+                else if ((lstrcmpA(arg, "-replay") == 0) && next)
+                {
+                        replay_path = next;
+                        ++arg_idx;
+                }
+                else if ((lstrcmpA(arg, "-trace") == 0) && next)
+                {
+                        trace_path = next;
+                        ++arg_idx;
+                }
+        }
         
         // Learning Basic CG before transitioning to PBR / Realistic Lights / Global Illum!
-        g_w32_window  = CreateWindowA(wnd_class.lpszClassName, "NURR", WS_OVERLAPPEDWINDOW,
-                                      0, 0, w32_client_rect.right - w32_client_rect.left, w32_client_rect.bottom - w32_client_rect.top,
-                                      0, 0, wnd_class.hInstance, 0);
-        AssertTrue(IsWindow(g_w32_window));
-        
-        ShowWindow(g_w32_window, SW_SHOW);
+        g_os_window = os_window_open("NURR", 1280, 720, headless);
+        os_time_init();
+#if defined(ENGINE_PROFILE)
+        profile_init();
+#endif
         
         dx11_create_devices();
         dx11_create_swap_chain();
@@ -1560,49 +2318,89 @@ WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nCmdSh
         
         init_rendering_states();
         
-        TIMECAPS tc;
-        timeGetDevCaps(&tc, sizeof(tc));
-        timeBeginPeriod(tc.wPeriodMin);
+        f32 seconds_per_frame   = 1.0f / g_os_window.refresh_hz;
+        f32 game_update_secs    = fixed_step ? InputRecord_FixedStep : (1.0f / g_os_window.refresh_hz);
         
-        DEVMODE devmode;
-        EnumDisplaySettingsA(0, ENUM_CURRENT_SETTINGS, &devmode);
-        f32 seconds_per_frame   = 1.0f / (f32)devmode.dmDisplayFrequency;
-        f32 game_update_secs    = 1.0f / (f32)devmode.dmDisplayFrequency;
+        if (replay_path && !input_replay_begin(&g_input_recorder, replay_path))
+        {
+                os_debug_print("no recording to replay\n");
+                ExitProcess(1);
+        }
         
-        LARGE_INTEGER perf_freq;
-        QueryPerformanceFrequency(&perf_freq);
+        if (record_path && !replay_path)
+        {
+                input_record_begin(&g_input_recorder, record_path);
+        }
         
-        LARGE_INTEGER perf_count_begin;
-        QueryPerformanceCounter(&perf_count_begin);
+        u64 frame_begin = os_time_now();
         
         Scene_State scene;
         scene_init(&scene);
         
-        while (true)
+        for (;;)
         {
-                os_input_fill_events();
+                ProfileFrameBegin();
+                ProfileBegin("os_input_fill_events");
+                b32 running = os_input_fill_events();
+                ProfileEnd("os_input_fill_events");
+                if (!running)
+                {
+                        break;
+                }
+                
+                s32 cursor_dx = 0, cursor_dy = 0;
+                if (scene.camera_roam)
+                {
+                        os_cursor_take_delta(&g_os_window, &cursor_dx, &cursor_dy);
+                }
+                
+                // a replay stands in for all of the above, and ends the run when it runs out
+                f32 frame_update_secs = game_update_secs;
+                if (!input_record_frame(&g_input_recorder, &cursor_dx, &cursor_dy, &frame_update_secs))
+                {
+                        break;
+                }
                 
-                scene_update_and_render(&scene, game_update_secs);
+                scene_update_and_render(&scene, cursor_dx, cursor_dy, frame_update_secs);
                 
+                ProfileBegin("present");
                 g_dx11_current_model = 0;
                 ID3D11DeviceContext_ClearState(g_dx11_dev_cont);
                 IDXGISwapChain1_Present(g_dxgi_swap_chain, 1, 0);
+                ProfileEnd("present");
                 
-                LARGE_INTEGER perf_count_end;
-                QueryPerformanceCounter(&perf_count_end);
-                
-                f32 seconds_of_work = (f32)(perf_count_end.QuadPart - perf_count_begin.QuadPart) / (f32)perf_freq.QuadPart;
+                f32 seconds_of_work = os_seconds_between(frame_begin, os_time_now());
                 if (seconds_of_work < seconds_per_frame)
                 {
-                        Sleep((u32)((seconds_per_frame - seconds_of_work) * 1000.0f));
+                        os_sleep_seconds(seconds_per_frame - seconds_of_work);
                 }
                 else
                 {
                         //missed frame
                 }
                 
-                QueryPerformanceCounter(&perf_count_begin);
+                frame_begin = os_time_now();
         }
         
+#if defined(ENGINE_PROFILE)
+        {
+                static char     text[8192];
+                Profile_Summary summary;
+                profile_summarise(&summary);
+                profile_summary_text(&summary, text, sizeof(text));
+                os_debug_print(text);
+                if (trace_path && !profile_write_trace(trace_path))
+                {
+                        os_debug_print("could not write the trace\n");
+                }
+        }
+#else
+        if (trace_path)
+        {
+                os_debug_print("-trace: this build has no profiler\n");
+        }
+#endif
+        
+        input_record_end(&g_input_recorder);
         ExitProcess(0);
 }
@@ -0,0 +1,500 @@
+// The engine on the software backend (soft_render.c): the scene, camera,
+// lights and culling of main.c, drawn on the CPU and talking to the platform
+// through os.h alone, so it builds with gcc or clang and runs headless on
+// Linux. A headless window has nothing to present to, so frames run back to
+// back, the last one is written out as a binary PPM and the frame times are
+// printed at the end.
+//
+// usage: engine_soft [-frames N] [-size width height] [-out output.ppm]
+//                    [-record file | -replay file] [-trace trace.json]
+//
+// -record and -replay save and play back the input of a run
+// (input_record.h); a replay runs until the recording or -frames runs out,
+// whichever is first. Headless, the game always advances by
+// InputRecord_FixedStep. Profiling builds print the profiler's summary at
+// the end, and -trace writes its zones out as a Chrome trace (profile.h).
+//
+// Assets come from the pack when there is one and the loose files under
+// ../data otherwise, as in main.c. Material maps that are missing fall back
+// to white, flat and unraised ones instead of stopping the engine.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "base.h"
+#include "my_math.h"
+#include "os/os.h"
+#include "tex_pack.h"
+#include "scene.h"
+#include "scene_mesh.h"
+#include "asset_pack.h"
+#include "tex_file.h"
+#include "cone_step.h"
+#include "shadow.h"
+#include "shadow_filter.h"
+#include "light_cluster.h"
+#include "reflection_probe.h"
+#include "bvh.h"
+#include "lightmap.h"
+#include "vertex_ao.h"
+#include "irradiance_volume.h"
+#include "pvs.h"
+#include "occlusion.h"
+#include "input_record.h"
+#include "profile.h"
+#include "soft_render.h"
+
+#include "my_math.c"
+#if defined(_WIN32)
+# include "os/os_win32.c"
+#else
+# include "os/os_linux.c"
+#endif
+#include "tex_pack.c"
+#include "scene.c"
+#include "scene_mesh.c"
+#include "asset_pack.c"
+#include "tex_file.c"
+#include "shadow.c"
+#include "shadow_filter.c"
+#include "light_cluster.c"
+#include "reflection_probe.c"
+#include "bvh.c"
+#include "lightmap.c"
+#include "vertex_ao.c"
+#include "irradiance_volume.c"
+#include "pvs.c"
+#include "occlusion.c"
+#include "input_record.c"
+#include "profile.c"
+#include "soft_render.c"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "./ext/stb_image.h"
+
+static OS_Window        g_os_window;
+static Input_Recorder   g_input_recorder;
+static Asset_Pack       g_asset_pack;
+static Soft_Renderer    g_renderer;
+static Soft_Material    g_materials[MaterialType_Count];
+static OS_Work_Queue   *g_work_queue;
+
+static Scene_Instances  g_scene;
+static Light            g_lights[Scene_LampCount + 2];
+static u32              g_light_count;
+static u32              g_directional_light_count;
+static f32              g_first_light_t;
+
+static OS_File_Map      g_pvs_map;
+static Pvs_View         g_pvs_view;
+static Scene_Instances  g_pvs_scene;
+static Occlusion_Buffer g_occlusion;
+static Scene_Instances  g_occlusion_scene;
+
+// The pack's copy of path, or the loose file mapped into map; unmap it once
+// the blob is no longer needed.
+static Asset_Blob
+soft_main_find_asset(char *path, OS_File_Map *map)
+{
+  *map = (OS_File_Map){ 0 };
+  Asset_Blob result = asset_pack_find(&g_asset_pack, path);
+  if (!result.data)
+  {
+    char loose_path[256];
+    snprintf(loose_path, sizeof(loose_path), "../data/%s", path);
+    *map        = os_file_map(loose_path);
+    result.data = map->data;
+    result.size = map->size;
+  }
+
+  return(result);
+}
+
+// the baked map if there is one, then the png; false if neither is there
+static b32
+soft_main_load_map(Soft_Texture *texture, Material_Type material, char *baked_name, char *png_name, b32 *baked)
+{
+  ProfileBegin("soft_main_load_map");
+  b32  result = false;
+  char path[256];
+  if (baked_name)
+  {
+    OS_File_Map map;
+    snprintf(path, sizeof(path), "%s/%s", scene_material_dir(material), baked_name);
+    Asset_Blob       blob   = soft_main_find_asset(path, &map);
+    Tex_File_Header *header = tex_file_parse(blob.data, blob.size);
+    if (header)
+    {
+      soft_texture_from_tex_file(texture, header);
+      result = true;
+    }
+    os_file_unmap(&map);
+  }
+
+  *baked = result;
+  if (!result)
+  {
+    OS_File_Map map;
+    snprintf(path, sizeof(path), "%s/%s", scene_material_dir(material), png_name);
+    Asset_Blob blob = soft_main_find_asset(path, &map);
+    s32 width = 0, height = 0, comp = 0;
+    u8 *pixels = blob.data ? stbi_load_from_memory(blob.data, (int)blob.size, &width, &height, &comp, 4) : 0;
+    if (pixels)
+    {
+      soft_texture_from_rgba8(texture, pixels, (u32)width, (u32)height);
+      stbi_image_free(pixels);
+      result = true;
+    }
+    os_file_unmap(&map);
+  }
+
+  ProfileEnd("soft_main_load_map");
+  return(result);
+}
+
+// dx11_load_material_arrays' sets, packed by the size of their maps
+static void
+soft_main_load_materials(Tex_Pack_Slot *material_slots)
+{
+  Tex_Packer packer = { 0 };
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    Soft_Material *set = g_materials + material;
+    b32 baked = false;
+    u8  white[4]    = { 255, 255, 255, 255 };
+    u8  flat[4]     = { 128, 128, 255, 255 };
+    u8  unraised[4] = { 255, 0, 0, 255 };
+    if (!soft_main_load_map(&set->diffuse, material, 0, "diffuse.png", &baked))
+    {
+      soft_texture_from_rgba8(&set->diffuse, white, 1, 1);
+    }
+    if (!soft_main_load_map(&set->normal, material, "normal.tex", "normal.png", &baked))
+    {
+      soft_texture_from_rgba8(&set->normal, flat, 1, 1);
+    }
+    if (!soft_main_load_map(&set->displace, material, "displacement.tex", "displacement.png", &set->cone_step))
+    {
+      soft_texture_from_rgba8(&set->displace, unraised, 1, 1);
+    }
+
+    Soft_Texture *sized = (set->diffuse.width > 1) ? &set->diffuse : ((set->normal.width > 1) ? &set->normal : &set->displace);
+    material_slots[material] = tex_pack_add(&packer, (s32)sized->width, (s32)sized->height);
+    soft_render_set_material(&g_renderer, material_slots[material], set);
+  }
+}
+
+// main.c's init_rendering_states, less everything that lives on the GPU
+static void
+soft_main_init(u32 width, u32 height)
+{
+  u64 load_begin = os_time_now();
+  asset_pack_open(&g_asset_pack, AssetPack_DefaultPath);
+
+  soft_render_alloc(&g_renderer, width, height);
+  Tex_Pack_Slot material_slots[MaterialType_Count];
+  ProfileBegin("soft_main_load_materials");
+  soft_main_load_materials(material_slots);
+  ProfileEnd("soft_main_load_materials");
+
+  OS_File_Map map;
+  Asset_Blob  blob = soft_main_find_asset(ReflectionProbe_DefaultPath, &map);
+  soft_render_load_reflection_probes(&g_renderer, reflection_probe_parse(blob.data, blob.size));
+  os_file_unmap(&map);
+  scene_build_static(&g_scene, material_slots, g_renderer.reflection_probe_count);
+
+  blob = soft_main_find_asset(Lightmap_DefaultPath, &map);
+  soft_render_load_lightmap(&g_renderer, lightmap_parse(blob.data, blob.size), &g_scene);
+  os_file_unmap(&map);
+  blob = soft_main_find_asset(VertexAO_DefaultPath, &map);
+  soft_render_load_vertex_ao(&g_renderer, vertex_ao_parse(blob.data, blob.size), &g_scene);
+  os_file_unmap(&map);
+  blob = soft_main_find_asset(IrradianceVolume_DefaultPath, &map);
+  soft_render_load_irradiance_volume(&g_renderer, irradiance_volume_parse(blob.data, blob.size));
+  os_file_unmap(&map);
+
+  // the view reads its rows out of the mapping for as long as the engine
+  // runs; sets no cell would filter by are not worth the lookup
+  blob = soft_main_find_asset(Pvs_DefaultPath, &g_pvs_map);
+  Pvs_Header *header = pvs_parse(blob.data, blob.size);
+  if (header && ((header->instance_count != g_scene.static_instance_count) || !header->paying_cell_count))
+  {
+    header = 0;
+  }
+  if (!header)
+  {
+    os_file_unmap(&g_pvs_map);
+  }
+  pvs_view_init(&g_pvs_view, header);
+
+  occlusion_buffer_alloc(&g_occlusion);
+  occlusion_gather_occluders(&g_occlusion, &g_scene);
+
+  g_work_queue  = os_work_queue_create(Maximum(os_processor_count(), 2) - 1);
+  g_light_count = scene_build_lights(g_lights, &g_directional_light_count);
+
+  char message[256];
+  snprintf(message, sizeof(message), "load (%s): %d ms\n", g_asset_pack.header ? "pack" : "loose files",
+           (s32)(os_seconds_between(load_begin, os_time_now()) * 1000.0f));
+  os_debug_print(message);
+}
+
+// scene_update_and_render with soft_render_frame in place of the D3D11 passes
+static void
+soft_main_update_and_render(Scene_State *scene, s32 cursor_dx, s32 cursor_dy, f32 game_update_secs)
+{
+  ProfileBegin("update");
+  if (os_key_released(OS_KeyType_Esc))
+  {
+    scene->camera_roam = !scene->camera_roam;
+    os_cursor_show(!scene->camera_roam);
+  }
+
+  Scene_Camera_Input camera_input = { 0 };
+  camera_input.cursor_dx = cursor_dx;
+  camera_input.cursor_dy = cursor_dy;
+
+  camera_input.moves |= os_key_held(OS_KeyType_W) ? SceneMove_Forward : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_A) ? SceneMove_Left : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_S) ? SceneMove_Back : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_D) ? SceneMove_Right : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_Space) ? SceneMove_Up : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_X) ? SceneMove_Down : 0;
+  scene_update_camera(scene, &camera_input, game_update_secs);
+
+  Scene_Camera_View camera = scene_camera_view(scene);
+
+  g_first_light_t += game_update_secs * 2.0f;
+  scene_animate_lights(g_lights, g_first_light_t);
+  scene_begin_dynamic(&g_scene);
+  scene_add_light_gizmos(&g_scene, g_lights, g_light_count);
+  ProfileEnd("update");
+
+  f32 camera_fov = Radians(Scene_CameraFovDegrees);
+  f32 aspect     = (f32)g_renderer.height / (f32)g_renderer.width;
+  Soft_View view =
+  {
+    .eye                     = scene->camera_p,
+    .front                   = camera.front,
+    .world_to_view           = camera.world_to_view,
+    .projection              = m44_make_perspective_z01(aspect, camera_fov, Scene_CameraNear, Scene_CameraFar),
+    .tan_half_fov_x          = tanf(camera_fov * 0.5f),
+    .tan_half_fov_y          = tanf(camera_fov * 0.5f) * aspect,
+    .lights                  = g_lights,
+    .light_count             = g_light_count,
+    .directional_light_count = g_directional_light_count,
+  };
+
+  ProfileBegin("occlusion_render");
+  occlusion_set_camera(&g_occlusion, scene->camera_p, m44_mul(view.world_to_view, view.projection));
+  occlusion_render(&g_occlusion, g_work_queue);
+  ProfileEnd("occlusion_render");
+
+  // only the shaded pass is filtered; casters outside the set still throw shadows into it
+  ProfileBegin("cull");
+  Scene_Instances *visible_scene = &g_scene;
+  if (pvs_view_update(&g_pvs_view, scene->camera_p) && g_pvs_view.row_pays)
+  {
+    pvs_cull_scene(g_pvs_view.row, &g_scene, &g_pvs_scene);
+    visible_scene = &g_pvs_scene;
+  }
+
+  occlusion_cull_scene(&g_occlusion, visible_scene, &g_occlusion_scene);
+  ProfileEnd("cull");
+
+  ProfileBegin("soft_render_frame");
+  soft_render_frame(&g_renderer, &g_scene, &g_occlusion_scene, &view, g_work_queue);
+  ProfileEnd("soft_render_frame");
+}
+
+static b32
+soft_main_write_ppm(char *filename)
+{
+  FILE *file = fopen(filename, "wb");
+  if (file)
+  {
+    fprintf(file, "P6\n%u %u\n255\n", g_renderer.width, g_renderer.height);
+    u64 pixel_count = (u64)g_renderer.width * g_renderer.height;
+    for (u64 pixel = 0; pixel < pixel_count; ++pixel)
+    {
+      u32 colour = g_renderer.colour[pixel];
+      u8  rgb[3] = { (u8)colour, (u8)(colour >> 8), (u8)(colour >> 16) };
+      fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+  }
+
+  return(file != 0);
+}
+
+static int
+soft_main_compare_f32(const void *a, const void *b)
+{
+  f32 x = *(f32 *)a;
+  f32 y = *(f32 *)b;
+  return((x > y) - (x < y));
+}
+
+int
+main(int argc, char **argv)
+{
+  u32   frame_count = 60;
+  u32   width       = 1280;
+  u32   height      = 720;
+  char *out_path    = "engine_soft.ppm";
+  char *record_path = 0;
+  char *replay_path = 0;
+  char *trace_path  = 0;
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx)
+  {
+    char *arg = argv[arg_idx];
+    if (!strcmp(arg, "-frames") && (arg_idx + 1 < argc))
+    {
+      frame_count = (u32)atoi(argv[++arg_idx]);
+    }
+    else if (!strcmp(arg, "-size") && (arg_idx + 2 < argc))
+    {
+      width  = (u32)atoi(argv[++arg_idx]);
+      height = (u32)atoi(argv[++arg_idx]);
+    }
+    else if (!strcmp(arg, "-out") && (arg_idx + 1 < argc))
+    {
+      out_path = argv[++arg_idx];
+    }
+    else if (!strcmp(arg, "-record") && (arg_idx + 1 < argc))
+    {
+      record_path = argv[++arg_idx];
+    }
+    else if (!strcmp(arg, "-replay") && (arg_idx + 1 < argc))
+    {
+      replay_path = argv[++arg_idx];
+    }
+    else if (!strcmp(arg, "-trace") && (arg_idx + 1 < argc))
+    {
+      trace_path = argv[++arg_idx];
+    }
+    else
+    {
+      fprintf(stderr, "engine_soft: unknown argument %s\n", arg);
+      return(1);
+    }
+  }
+  frame_count = Maximum(frame_count, 1);
+  width       = Maximum(width & ~1u, 2);
+  height      = Maximum(height & ~1u, 2);
+
+  if (replay_path && !input_replay_begin(&g_input_recorder, replay_path))
+  {
+    fprintf(stderr, "engine_soft: no recording in %s\n", replay_path);
+    return(1);
+  }
+
+  if (record_path && !replay_path)
+  {
+    input_record_begin(&g_input_recorder, record_path);
+  }
+
+  g_os_window = os_window_open("NURR", (s32)width, (s32)height, true);
+  os_time_init();
+#if defined(ENGINE_PROFILE)
+  profile_init();
+#endif
+  soft_main_init(width, height);
+
+  f32  seconds_per_frame = 1.0f / g_os_window.refresh_hz;
+  f32  game_update_secs  = g_os_window.headless ? InputRecord_FixedStep : (1.0f / g_os_window.refresh_hz);
+  f32 *frame_ms          = malloc(frame_count * sizeof(f32));
+
+  Scene_State scene;
+  scene_init(&scene);
+
+  u32 frames_run  = 0;
+  u64 frame_begin = os_time_now();
+  for (;;)
+  {
+    // every way out leaves the frame it began open, which the profiler skips
+    ProfileFrameBegin();
+    ProfileBegin("os_input_fill_events");
+    b32 running = (frames_run < frame_count) && os_input_fill_events();
+    ProfileEnd("os_input_fill_events");
+    if (!running)
+    {
+      break;
+    }
+
+    s32 cursor_dx = 0, cursor_dy = 0;
+    if (scene.camera_roam)
+    {
+      os_cursor_take_delta(&g_os_window, &cursor_dx, &cursor_dy);
+    }
+
+    // a replay stands in for all of the above, and ends the run when it runs out
+    f32 frame_update_secs = game_update_secs;
+    if (!input_record_frame(&g_input_recorder, &cursor_dx, &cursor_dy, &frame_update_secs))
+    {
+      break;
+    }
+
+    soft_main_update_and_render(&scene, cursor_dx, cursor_dy, frame_update_secs);
+
+    // there is no display to keep pace with headless
+    f32 seconds_of_work = os_seconds_between(frame_begin, os_time_now());
+    if (!g_os_window.headless && (seconds_of_work < seconds_per_frame))
+    {
+      os_sleep_seconds(seconds_per_frame - seconds_of_work);
+    }
+
+    frame_ms[frames_run++] = seconds_of_work * 1000.0f;
+    frame_begin            = os_time_now();
+  }
+
+#if defined(ENGINE_PROFILE)
+  Profile_Summary profile_summary;
+  profile_summarise(&profile_summary);
+  b32 traced = !trace_path || profile_write_trace(trace_path);
+#else
+  b32 traced = !trace_path;
+#endif
+
+  b32 recorded = input_record_end(&g_input_recorder);
+  b32 written  = (frames_run > 0) && soft_main_write_ppm(out_path);
+
+  if (frames_run)
+  {
+    // the first frame draws every static shadow caster, so it is left out
+    u32 steady_count = (frames_run > 1) ? (frames_run - 1) : 1;
+    f32 *steady_ms   = frame_ms + (frames_run - steady_count);
+    qsort(steady_ms, steady_count, sizeof(f32), soft_main_compare_f32);
+    printf("%u frames at %ux%u on %u threads: first %.2f ms, then median %.2f ms, 95th percentile %.2f ms\n",
+           frames_run, width, height, Maximum(os_processor_count(), 2),
+           frame_ms[0], steady_ms[(steady_count - 1) / 2], steady_ms[((steady_count - 1) * 95) / 100]);
+    printf("last frame: camera at (%.3f %.3f %.3f), %u of %u instances shaded, %u triangles, %llu shaded quads\n",
+           scene.camera_p.x, scene.camera_p.y, scene.camera_p.z,
+           g_occlusion_scene.instance_count, g_scene.instance_count, g_renderer.triangle_count,
+           (unsigned long long)g_renderer.shaded_quads);
+  }
+
+#if defined(ENGINE_PROFILE)
+  static char profile_text[8192];
+  profile_summary_text(&profile_summary, profile_text, sizeof(profile_text));
+  fputs(profile_text, stdout);
+#endif
+
+  if (record_path && !replay_path)
+  {
+    printf("%s %s\n", recorded ? "recorded" : "could not record", record_path);
+  }
+  if (trace_path)
+  {
+    printf("%s %s\n", traced ? "traced to" : "could not trace to", trace_path);
+  }
+  printf("%s %s\n", written ? "wrote" : "could not write", out_path);
+  return((written && recorded && traced) ? 0 : 1);
+}
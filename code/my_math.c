@@ -69,6 +69,25 @@ v3f_add_eq(v3f *a, v3f b)
   a->z += b.z;
 }
 
+static v3f
+v3f_add(v3f a, v3f b)
+{
+  v3f result = (v3f) {
+    a.x + b.x,
+    a.y + b.y,
+    a.z + b.z,
+  };
+
+  return(result);
+}
+
+static b32
+v3f_equal(v3f a, v3f b)
+{
+  b32 result = (a.x == b.x) && (a.y == b.y) && (a.z == b.z);
+  return(result);
+}
+
 static Basis_R3
 br3_from_center_to_target(v3f center, v3f target, v3f temp_up)
 {
@@ -222,3 +241,76 @@ m44_mul(m44 a, m44 b)
 
   return(result);
 }
+
+// Row vector convention, matching how the shaders read the matrices.
+static v3f
+m44_transform_point(m44 a, v3f p)
+{
+  v3f result =
+  {
+    p.x * a.m[0][0] + p.y * a.m[1][0] + p.z * a.m[2][0] + a.m[3][0],
+    p.x * a.m[0][1] + p.y * a.m[1][1] + p.z * a.m[2][1] + a.m[3][1],
+    p.x * a.m[0][2] + p.y * a.m[1][2] + p.z * a.m[2][2] + a.m[3][2],
+  };
+
+  return(result);
+}
+
+static m44
+m44_make_view_from_basis(Basis_R3 basis, v3f p)
+{
+  m44 result =
+  {
+    basis.x.x, basis.y.x, basis.z.x, 0.0f,
+    basis.x.y, basis.y.y, basis.z.y, 0.0f,
+    basis.x.z, basis.y.z, basis.z.z, 0.0f,
+    -v3f_inner(basis.x, p), -v3f_inner(basis.y, p), -v3f_inner(basis.z, p), 1.0f
+  };
+
+  return(result);
+}
+
+static b32
+m44_equal(m44 a, m44 b)
+{
+  b32 result = true;
+  for (u32 row = 0; row < 4; ++row)
+  {
+    for (u32 col = 0; col < 4; ++col)
+    {
+      result &= (a.m[row][col] == b.m[row][col]);
+    }
+  }
+
+  return(result);
+}
+
+// The centre sits on the view axis at z, equally far from the near and far
+// corners: (z - n)^2 + n^2 k = (f - z)^2 + f^2 k with k = tx^2 + ty^2. For
+// wide, thin slices that lands past the far plane, and the far rectangle's
+// circumcircle is already the answer.
+static Sphere
+frustum_slice_bounding_sphere(v3f eye, v3f front, f32 tan_half_fov_x, f32 tan_half_fov_y, f32 near_d, f32 far_d)
+{
+  f32 k = tan_half_fov_x * tan_half_fov_x + tan_half_fov_y * tan_half_fov_y;
+  f32 z = 0.5f * (near_d + far_d) * (1.0f + k);
+  if (z > far_d)
+  {
+    z = far_d;
+  }
+
+  Sphere result =
+  {
+    .center = v3f_add(eye, v3f_scale(z, front)),
+    .radius = sqrtf((far_d - z) * (far_d - z) + far_d * far_d * k),
+  };
+
+  return(result);
+}
+
+static f32
+f32_snap_down(f32 value, f32 step)
+{
+  f32 result = floorf(value / step) * step;
+  return(result);
+}
@@ -38,6 +38,8 @@ static v3f  v3f_normalized(v3f a);
 static v3f  v3f_sub(v3f a, v3f b);
 static void v3f_sub_eq(v3f *a, v3f b);
 static void v3f_add_eq(v3f *a, v3f b);
+static v3f  v3f_add(v3f a, v3f b);
+static b32  v3f_equal(v3f a, v3f b);
 
 typedef struct
 {
@@ -84,5 +86,20 @@ typedef union
 static m44 m44_make_perspective_z01(f32 aspect_height_over_width, f32 fov_radians, f32 near_plane, f32 far_plane);
 static m44 m44_make_orthographic_z01(f32 left, f32 right, f32 bottom, f32 top, f32 near_plane, f32 far_plane);
 static m44 m44_mul(m44 a, m44 b);
+static v3f m44_transform_point(m44 a, v3f p);
+static m44 m44_make_view_from_basis(Basis_R3 basis, v3f p);
+static b32 m44_equal(m44 a, m44 b);
+
+typedef struct
+{
+  v3f center;
+  f32 radius;
+} Sphere;
+
+// Smallest sphere around the slice [near_d, far_d] of a symmetric view
+// frustum. It depends only on the distances and the field of view, so its
+// radius does not change as the camera turns.
+static Sphere frustum_slice_bounding_sphere(v3f eye, v3f front, f32 tan_half_fov_x, f32 tan_half_fov_y, f32 near_d, f32 far_d);
+static f32    f32_snap_down(f32 value, f32 step);
 
 #endif
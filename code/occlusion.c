@@ -0,0 +1,559 @@
+static void
+occlusion_buffer_alloc(Occlusion_Buffer *buffer)
+{
+  buffer->triangles      = os_memory_alloc(Occlusion_MaxTriangles * sizeof(Occlusion_Triangle));
+  buffer->tile_triangles = os_memory_alloc((u64)Occlusion_TileCount * Occlusion_MaxTriangles * sizeof(u16));
+  buffer->depth          = os_memory_alloc(Occlusion_Width * Occlusion_Height * sizeof(f32));
+  for (u32 tile = 0; tile < Occlusion_TileCount; ++tile)
+  {
+    buffer->jobs[tile].buffer = buffer;
+    buffer->jobs[tile].tile   = tile;
+  }
+}
+
+// The biggest box inside the mesh of model, in model space.
+static v3f
+occlusion_model_proxy(Scene_Model model)
+{
+  v3f result = v3f_zero();
+  switch (model)
+  {
+    case SceneModel_Cube:
+    {
+      result = v3f_s(SceneCube_HalfExtent);
+    } break;
+
+    case SceneModel_Cylinder:
+    {
+      // the flat sides come in to cos(pi / slices) of the radius
+      f32 half_side = SceneCylinder_Radius * cosf(PIF32 / (f32)SceneCylinder_Slices) / sqrtf(2.0f);
+      result = (v3f){ half_side, 0.5f * SceneCylinder_Height, half_side };
+    } break;
+
+    case SceneModel_Sphere:
+    {
+      // rings and slices are both pi / quality apart
+      f32 inner = cosf(PIF32 / (2.0f * SceneSphere_Quality));
+      result = v3f_s(SceneSphere_Radius * inner * inner / sqrtf(3.0f));
+    } break;
+
+    default:
+    {
+      InvalidCodePath();
+    } break;
+  }
+
+  return(result);
+}
+
+// Merges b into a if the two inner boxes are the same across every axis but
+// axis and touch or overlap along it.
+static b32
+occlusion_occluders_merge(Occlusion_Occluder *a, Occlusion_Occluder *b, u32 axis)
+{
+  b32 result = (a->inner.min.v[axis] <= b->inner.max.v[axis]) && (b->inner.min.v[axis] <= a->inner.max.v[axis]);
+  for (u32 other = 0; other < 3; ++other)
+  {
+    if (other != axis)
+    {
+      result &= (a->inner.min.v[other] == b->inner.min.v[other]) && (a->inner.max.v[other] == b->inner.max.v[other]);
+    }
+  }
+
+  if (result)
+  {
+    a->inner.min.v[axis] = Minimum(a->inner.min.v[axis], b->inner.min.v[axis]);
+    a->inner.max.v[axis] = Maximum(a->inner.max.v[axis], b->inner.max.v[axis]);
+    for (u32 other = 0; other < 3; ++other)
+    {
+      a->outer.min.v[other] = Minimum(a->outer.min.v[other], b->outer.min.v[other]);
+      a->outer.max.v[other] = Maximum(a->outer.max.v[other], b->outer.max.v[other]);
+    }
+  }
+
+  return(result);
+}
+
+static void
+occlusion_gather_occluders(Occlusion_Buffer *buffer, Scene_Instances *scene)
+{
+  Occlusion_Occluder *occluders = os_memory_alloc(MaxSceneInstances * sizeof(Occlusion_Occluder));
+  u32 occluder_count = 0;
+  for (u32 batch_idx = 0; batch_idx < scene->static_batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch = scene->batches + batch_idx;
+    v3f proxy          = occlusion_model_proxy(batch->model);
+    v3f extent         = scene_model_half_extent(batch->model);
+    u32 instance_end   = batch->first_instance + batch->instance_count;
+    if (batch_idx == scene->static_batch_count - 1)
+    {
+      instance_end = batch->first_instance + scene->static_last_batch_instance_count;
+    }
+
+    for (u32 instance_idx = batch->first_instance; instance_idx < instance_end; ++instance_idx)
+    {
+      // a turned box's bounds would stick out of it
+      m33 xform = scene->ins[instance_idx].model_to_world_xform;
+      b32 axis_aligned = (xform.m[0][1] == 0.0f) && (xform.m[0][2] == 0.0f) && (xform.m[1][0] == 0.0f) &&
+                         (xform.m[1][2] == 0.0f) && (xform.m[2][0] == 0.0f) && (xform.m[2][1] == 0.0f);
+      if (axis_aligned)
+      {
+        v3f p     = scene->ins[instance_idx].p;
+        v3f scale = { fabsf(xform.m[0][0]), fabsf(xform.m[1][1]), fabsf(xform.m[2][2]) };
+        v3f inner = { scale.x * proxy.x, scale.y * proxy.y, scale.z * proxy.z };
+        v3f outer = { scale.x * extent.x, scale.y * extent.y, scale.z * extent.z };
+        occluders[occluder_count++] = (Occlusion_Occluder)
+        {
+          { v3f_sub(p, inner), v3f_add(p, inner) },
+          { v3f_sub(p, outer), v3f_add(p, outer) },
+        };
+      }
+    }
+  }
+
+  // rows along x first, then the rows into slabs along z, then stacks along y
+  b32 merged = true;
+  while (merged)
+  {
+    merged = false;
+    u32 axes[3] = { 0, 2, 1 };
+    for (u32 axis_idx = 0; axis_idx < 3; ++axis_idx)
+    {
+      for (u32 occluder_idx = 0; occluder_idx < occluder_count; ++occluder_idx)
+      {
+        for (u32 other_idx = occluder_idx + 1; other_idx < occluder_count;)
+        {
+          if (occlusion_occluders_merge(occluders + occluder_idx, occluders + other_idx, axes[axis_idx]))
+          {
+            occluders[other_idx] = occluders[--occluder_count];
+            merged = true;
+          }
+          else
+          {
+            ++other_idx;
+          }
+        }
+      }
+    }
+  }
+
+  buffer->occluder_count = 0;
+  for (u32 occluder_idx = 0; (occluder_idx < occluder_count) && (buffer->occluder_count < Occlusion_MaxOccluders); ++occluder_idx)
+  {
+    Occlusion_Occluder occluder = occluders[occluder_idx];
+    occluder.inner.min = v3f_add(occluder.inner.min, v3f_s(Occlusion_Inset));
+    occluder.inner.max = v3f_sub(occluder.inner.max, v3f_s(Occlusion_Inset));
+    occluder.outer.min = v3f_sub(occluder.outer.min, v3f_s(Occlusion_EyeMargin));
+    occluder.outer.max = v3f_add(occluder.outer.max, v3f_s(Occlusion_EyeMargin));
+    if ((occluder.inner.min.x < occluder.inner.max.x) && (occluder.inner.min.y < occluder.inner.max.y) &&
+        (occluder.inner.min.z < occluder.inner.max.z))
+    {
+      buffer->occluders[buffer->occluder_count++] = occluder;
+    }
+  }
+
+  os_memory_free(occluders, MaxSceneInstances * sizeof(Occlusion_Occluder));
+}
+
+static void
+occlusion_set_camera(Occlusion_Buffer *buffer, v3f eye, m44 world_to_clip)
+{
+  buffer->eye           = eye;
+  buffer->world_to_clip = world_to_clip;
+}
+
+static v4f
+occlusion_transform(m44 a, v3f p)
+{
+  v4f result =
+  {
+    p.x * a.m[0][0] + p.y * a.m[1][0] + p.z * a.m[2][0] + a.m[3][0],
+    p.x * a.m[0][1] + p.y * a.m[1][1] + p.z * a.m[2][1] + a.m[3][1],
+    p.x * a.m[0][2] + p.y * a.m[1][2] + p.z * a.m[2][2] + a.m[3][2],
+    p.x * a.m[0][3] + p.y * a.m[1][3] + p.z * a.m[2][3] + a.m[3][3],
+  };
+
+  return(result);
+}
+
+// x and y in pixels, z the depth
+static v3f
+occlusion_clip_to_screen(v4f clip)
+{
+  f32 inv_w  = 1.0f / clip.w;
+  v3f result =
+  {
+    (clip.x * inv_w * 0.5f + 0.5f) * (f32)Occlusion_Width,
+    (0.5f - clip.y * inv_w * 0.5f) * (f32)Occlusion_Height,
+    clip.z * inv_w,
+  };
+
+  return(result);
+}
+
+// Sets up and bins a triangle already clipped to the near plane.
+static void
+occlusion_add_triangle(Occlusion_Buffer *buffer, v4f clip_a, v4f clip_b, v4f clip_c)
+{
+  v3f v[3] = { occlusion_clip_to_screen(clip_a), occlusion_clip_to_screen(clip_b), occlusion_clip_to_screen(clip_c) };
+  f32 area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+  if (area < 0.0f)
+  {
+    v3f swap = v[1];
+    v[1] = v[2];
+    v[2] = swap;
+    area = -area;
+  }
+
+  // pixel centres are at .5, and far off screen vertices must not overflow
+  f32 min_x = Minimum(Minimum(v[0].x, v[1].x), v[2].x);
+  f32 max_x = Maximum(Maximum(v[0].x, v[1].x), v[2].x);
+  f32 min_y = Minimum(Minimum(v[0].y, v[1].y), v[2].y);
+  f32 max_y = Maximum(Maximum(v[0].y, v[1].y), v[2].y);
+  s32 pixel_min_x = (s32)ceilf(Maximum(min_x - 0.5f, 0.0f));
+  s32 pixel_max_x = (s32)floorf(Minimum(max_x - 0.5f, (f32)(Occlusion_Width - 1)));
+  s32 pixel_min_y = (s32)ceilf(Maximum(min_y - 0.5f, 0.0f));
+  s32 pixel_max_y = (s32)floorf(Minimum(max_y - 0.5f, (f32)(Occlusion_Height - 1)));
+  if ((area < 1e-6f) || (pixel_min_x > pixel_max_x) || (pixel_min_y > pixel_max_y))
+  {
+    return;
+  }
+
+  if (buffer->triangle_count == Occlusion_MaxTriangles)
+  {
+    ++buffer->dropped_count;
+    return;
+  }
+
+  u32 triangle_idx = buffer->triangle_count++;
+  Occlusion_Triangle *triangle = buffer->triangles + triangle_idx;
+  for (u32 edge = 0; edge < 3; ++edge)
+  {
+    v3f a = v[edge];
+    v3f b = v[(edge + 1) % 3];
+    triangle->edge_a[edge] = -(b.y - a.y);
+    triangle->edge_b[edge] = b.x - a.x;
+    triangle->edge_c[edge] = -(triangle->edge_a[edge] * a.x + triangle->edge_b[edge] * a.y);
+  }
+
+  // each vertex's weight is the edge across from it over the area
+  f32 inv_area = 1.0f / area;
+  triangle->z_a = (triangle->edge_a[1] * v[0].z + triangle->edge_a[2] * v[1].z + triangle->edge_a[0] * v[2].z) * inv_area;
+  triangle->z_b = (triangle->edge_b[1] * v[0].z + triangle->edge_b[2] * v[1].z + triangle->edge_b[0] * v[2].z) * inv_area;
+  triangle->z_c = (triangle->edge_c[1] * v[0].z + triangle->edge_c[2] * v[1].z + triangle->edge_c[0] * v[2].z) * inv_area;
+
+  // Only pixels the triangle covers whole are written, at the furthest depth
+  // it has in them, or a sliver of a box between two pixel centres would be
+  // hidden behind a surface that does not cover it.
+  for (u32 edge = 0; edge < 3; ++edge)
+  {
+    triangle->edge_c[edge] -= 0.5f * (fabsf(triangle->edge_a[edge]) + fabsf(triangle->edge_b[edge]));
+  }
+  triangle->z_c += 0.5f * (fabsf(triangle->z_a) + fabsf(triangle->z_b));
+  triangle->min_x = pixel_min_x;
+  triangle->max_x = pixel_max_x;
+  triangle->min_y = pixel_min_y;
+  triangle->max_y = pixel_max_y;
+
+  for (s32 tile_y = pixel_min_y / Occlusion_TileHeight; tile_y <= pixel_max_y / Occlusion_TileHeight; ++tile_y)
+  {
+    for (s32 tile_x = pixel_min_x / Occlusion_TileWidth; tile_x <= pixel_max_x / Occlusion_TileWidth; ++tile_x)
+    {
+      u32 tile = (u32)tile_y * Occlusion_TilesX + (u32)tile_x;
+      buffer->tile_triangles[(u64)tile * Occlusion_MaxTriangles + buffer->tile_triangle_counts[tile]++] = (u16)triangle_idx;
+    }
+  }
+}
+
+// Draws the faces of box the eye is in front of, clipped to z >= 0.
+static void
+occlusion_add_box(Occlusion_Buffer *buffer, Occlusion_Box *box)
+{
+  v4f corners[8];
+  for (u32 corner = 0; corner < 8; ++corner)
+  {
+    v3f p = { (corner & 1) ? box->max.x : box->min.x, (corner & 2) ? box->max.y : box->min.y, (corner & 4) ? box->max.z : box->min.z };
+    corners[corner] = occlusion_transform(buffer->world_to_clip, p);
+  }
+
+  // -x, +x, -y, +y, -z, +z, corners in order around each
+  u32 faces[6][4] =
+  {
+    { 0, 2, 6, 4 }, { 1, 3, 7, 5 },
+    { 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+    { 0, 1, 3, 2 }, { 4, 5, 7, 6 },
+  };
+  for (u32 face = 0; face < 6; ++face)
+  {
+    u32 axis     = face / 2;
+    b32 faces_eye = (face & 1) ? (buffer->eye.v[axis] > box->max.v[axis]) : (buffer->eye.v[axis] < box->min.v[axis]);
+    if (!faces_eye)
+    {
+      continue;
+    }
+
+    v4f clipped[5];
+    u32 clipped_count = 0;
+    for (u32 vertex = 0; vertex < 4; ++vertex)
+    {
+      v4f current = corners[faces[face][vertex]];
+      v4f next    = corners[faces[face][(vertex + 1) % 4]];
+      if (current.z >= 0.0f)
+      {
+        clipped[clipped_count++] = current;
+      }
+
+      if ((current.z >= 0.0f) != (next.z >= 0.0f))
+      {
+        f32 t = current.z / (current.z - next.z);
+        clipped[clipped_count++] = (v4f)
+        {
+          current.x + t * (next.x - current.x),
+          current.y + t * (next.y - current.y),
+          0.0f,
+          current.w + t * (next.w - current.w),
+        };
+      }
+    }
+
+    for (u32 vertex = 2; vertex < clipped_count; ++vertex)
+    {
+      occlusion_add_triangle(buffer, clipped[0], clipped[vertex - 1], clipped[vertex]);
+    }
+  }
+}
+
+static void
+occlusion_tile_job(void *data)
+{
+  Occlusion_Job    *job    = (Occlusion_Job *)data;
+  Occlusion_Buffer *buffer = job->buffer;
+  s32 tile_x0 = (s32)(job->tile % Occlusion_TilesX) * Occlusion_TileWidth;
+  s32 tile_y0 = (s32)(job->tile / Occlusion_TilesX) * Occlusion_TileHeight;
+  s32 tile_x1 = tile_x0 + Occlusion_TileWidth - 1;
+  s32 tile_y1 = tile_y0 + Occlusion_TileHeight - 1;
+
+  __m128 far_depth = _mm_set1_ps(1.0f);
+  for (s32 y = tile_y0; y <= tile_y1; ++y)
+  {
+    for (s32 x = tile_x0; x <= tile_x1; x += 4)
+    {
+      _mm_storeu_ps(buffer->depth + y * Occlusion_Width + x, far_depth);
+    }
+  }
+
+  __m128 zero         = _mm_setzero_ps();
+  __m128 lane_offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+  u16   *triangles    = buffer->tile_triangles + (u64)job->tile * Occlusion_MaxTriangles;
+  for (u32 bin_idx = 0; bin_idx < buffer->tile_triangle_counts[job->tile]; ++bin_idx)
+  {
+    Occlusion_Triangle *triangle = buffer->triangles + triangles[bin_idx];
+    s32 min_x = Maximum(triangle->min_x, tile_x0) & ~3;
+    s32 max_x = Minimum(triangle->max_x, tile_x1);
+    s32 min_y = Maximum(triangle->min_y, tile_y0);
+    s32 max_y = Minimum(triangle->max_y, tile_y1);
+
+    __m128 edge_a0 = _mm_set1_ps(triangle->edge_a[0]);
+    __m128 edge_a1 = _mm_set1_ps(triangle->edge_a[1]);
+    __m128 edge_a2 = _mm_set1_ps(triangle->edge_a[2]);
+    __m128 z_a     = _mm_set1_ps(triangle->z_a);
+    for (s32 y = min_y; y <= max_y; ++y)
+    {
+      f32 pixel_y = (f32)y + 0.5f;
+      __m128 row0 = _mm_set1_ps(triangle->edge_b[0] * pixel_y + triangle->edge_c[0]);
+      __m128 row1 = _mm_set1_ps(triangle->edge_b[1] * pixel_y + triangle->edge_c[1]);
+      __m128 row2 = _mm_set1_ps(triangle->edge_b[2] * pixel_y + triangle->edge_c[2]);
+      __m128 row_z = _mm_set1_ps(triangle->z_b * pixel_y + triangle->z_c);
+      f32   *depth = buffer->depth + y * Occlusion_Width;
+      for (s32 x = min_x; x <= max_x; x += 4)
+      {
+        __m128 pixel_x = _mm_add_ps(_mm_set1_ps((f32)x), lane_offsets);
+        __m128 inside  = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_a0, pixel_x), row0), zero),
+                                    _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_a1, pixel_x), row1), zero));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edge_a2, pixel_x), row2), zero));
+        if (_mm_movemask_ps(inside))
+        {
+          __m128 old_depth = _mm_loadu_ps(depth + x);
+          __m128 new_depth = _mm_min_ps(old_depth, _mm_add_ps(_mm_mul_ps(z_a, pixel_x), row_z));
+          _mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(inside, new_depth), _mm_andnot_ps(inside, old_depth)));
+        }
+      }
+    }
+  }
+
+  for (s32 block_y = tile_y0 / Occlusion_HizBlock; block_y <= tile_y1 / Occlusion_HizBlock; ++block_y)
+  {
+    for (s32 block_x = tile_x0 / Occlusion_HizBlock; block_x <= tile_x1 / Occlusion_HizBlock; ++block_x)
+    {
+      __m128 furthest = zero;
+      for (s32 y = block_y * Occlusion_HizBlock; y < (block_y + 1) * Occlusion_HizBlock; ++y)
+      {
+        for (s32 x = block_x * Occlusion_HizBlock; x < (block_x + 1) * Occlusion_HizBlock; x += 4)
+        {
+          furthest = _mm_max_ps(furthest, _mm_loadu_ps(buffer->depth + y * Occlusion_Width + x));
+        }
+      }
+
+      furthest = _mm_max_ps(furthest, _mm_shuffle_ps(furthest, furthest, _MM_SHUFFLE(1, 0, 3, 2)));
+      furthest = _mm_max_ps(furthest, _mm_shuffle_ps(furthest, furthest, _MM_SHUFFLE(2, 3, 0, 1)));
+      buffer->hiz[block_y * Occlusion_HizWidth + block_x] = _mm_cvtss_f32(furthest);
+    }
+  }
+}
+
+static void
+occlusion_render(Occlusion_Buffer *buffer, OS_Work_Queue *queue)
+{
+  buffer->triangle_count = 0;
+  buffer->dropped_count  = 0;
+  for (u32 tile = 0; tile < Occlusion_TileCount; ++tile)
+  {
+    buffer->tile_triangle_counts[tile] = 0;
+  }
+
+  for (u32 occluder_idx = 0; occluder_idx < buffer->occluder_count; ++occluder_idx)
+  {
+    Occlusion_Occluder *occluder = buffer->occluders + occluder_idx;
+    v3f eye = buffer->eye;
+    b32 eye_inside = (eye.x > occluder->outer.min.x) && (eye.y > occluder->outer.min.y) && (eye.z > occluder->outer.min.z) &&
+                     (eye.x < occluder->outer.max.x) && (eye.y < occluder->outer.max.y) && (eye.z < occluder->outer.max.z);
+    if (!eye_inside)
+    {
+      occlusion_add_box(buffer, &occluder->inner);
+    }
+  }
+
+  for (u32 tile = 0; tile < Occlusion_TileCount; ++tile)
+  {
+    if (queue)
+    {
+      os_work_queue_add(queue, occlusion_tile_job, buffer->jobs + tile);
+    }
+    else
+    {
+      occlusion_tile_job(buffer->jobs + tile);
+    }
+  }
+
+  if (queue)
+  {
+    os_work_queue_complete_all(queue);
+  }
+}
+
+static Occlusion_Result
+occlusion_test_box(Occlusion_Buffer *buffer, v3f min, v3f max)
+{
+  f32 min_x   = (f32)Occlusion_Width;
+  f32 max_x   = 0.0f;
+  f32 min_y   = (f32)Occlusion_Height;
+  f32 max_y   = 0.0f;
+  f32 nearest = 1.0f;
+  u32 behind  = 0;
+  for (u32 corner = 0; corner < 8; ++corner)
+  {
+    v3f p    = { (corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z };
+    v4f clip = occlusion_transform(buffer->world_to_clip, p);
+    if (clip.z < 0.0f)
+    {
+      ++behind;
+      continue;
+    }
+
+    v3f screen = occlusion_clip_to_screen(clip);
+    min_x   = Minimum(min_x, screen.x);
+    max_x   = Maximum(max_x, screen.x);
+    min_y   = Minimum(min_y, screen.y);
+    max_y   = Maximum(max_y, screen.y);
+    nearest = Minimum(nearest, screen.z);
+  }
+
+  Occlusion_Result result = OcclusionResult_Visible;
+  if (behind == 8)
+  {
+    result = OcclusionResult_Outside;
+  }
+  else if (behind == 0)
+  {
+    if ((max_x < 0.0f) || (max_y < 0.0f) || (min_x >= (f32)Occlusion_Width) || (min_y >= (f32)Occlusion_Height))
+    {
+      result = OcclusionResult_Outside;
+    }
+    else
+    {
+      // every pixel the box touches, not only those whose centres it covers
+      s32 pixel_min_x = (s32)Maximum(min_x, 0.0f);
+      s32 pixel_max_x = (s32)Minimum(max_x, (f32)(Occlusion_Width - 1));
+      s32 pixel_min_y = (s32)Maximum(min_y, 0.0f);
+      s32 pixel_max_y = (s32)Minimum(max_y, (f32)(Occlusion_Height - 1));
+
+      b32 occluded = true;
+      for (s32 block_y = pixel_min_y / Occlusion_HizBlock; occluded && (block_y <= pixel_max_y / Occlusion_HizBlock); ++block_y)
+      {
+        for (s32 block_x = pixel_min_x / Occlusion_HizBlock; block_x <= pixel_max_x / Occlusion_HizBlock; ++block_x)
+        {
+          occluded &= (buffer->hiz[block_y * Occlusion_HizWidth + block_x] < nearest);
+        }
+      }
+
+      if (!occluded && ((pixel_max_x - pixel_min_x + 1) * (pixel_max_y - pixel_min_y + 1) <= Occlusion_FinePixels))
+      {
+        occluded = true;
+        for (s32 y = pixel_min_y; occluded && (y <= pixel_max_y); ++y)
+        {
+          for (s32 x = pixel_min_x; x <= pixel_max_x; ++x)
+          {
+            occluded &= (buffer->depth[y * Occlusion_Width + x] < nearest);
+          }
+        }
+      }
+
+      result = occluded ? OcclusionResult_Occluded : OcclusionResult_Visible;
+    }
+  }
+
+  return(result);
+}
+
+static void
+occlusion_cull_scene(Occlusion_Buffer *buffer, Scene_Instances *scene, Scene_Instances *out)
+{
+  out->instance_count = 0;
+  out->batch_count    = 0;
+  for (u32 batch_idx = 0; batch_idx < scene->batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch     = scene->batches + batch_idx;
+    Scene_Batch *out_batch = out->batches + out->batch_count;
+    v3f          extent    = scene_model_half_extent(batch->model);
+    *out_batch                = *batch;
+    out_batch->first_instance = out->instance_count;
+    out_batch->instance_count = 0;
+    for (u32 instance_idx = batch->first_instance; instance_idx < batch->first_instance + batch->instance_count; ++instance_idx)
+    {
+      Model_Instance *instance = scene->ins + instance_idx;
+      v3f half;
+      for (u32 axis = 0; axis < 3; ++axis)
+      {
+        v3f row = instance->model_to_world_xform.r[axis];
+        half.v[axis] = fabsf(row.x) * extent.x + fabsf(row.y) * extent.y + fabsf(row.z) * extent.z;
+      }
+
+      Occlusion_Result test = occlusion_test_box(buffer, v3f_sub(instance->p, half), v3f_add(instance->p, half));
+      ++buffer->tested_count;
+      buffer->outside_count  += (test == OcclusionResult_Outside);
+      buffer->occluded_count += (test == OcclusionResult_Occluded);
+      if (test == OcclusionResult_Visible)
+      {
+        out->ins[out->instance_count]  = *instance;
+        out->info[out->instance_count] = scene->info[instance_idx];
+        ++out->instance_count;
+        ++out_batch->instance_count;
+      }
+    }
+
+    if (out_batch->instance_count)
+    {
+      ++out->batch_count;
+    }
+  }
+}
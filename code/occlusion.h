@@ -0,0 +1,136 @@
+#if !defined(OCCLUSION_H)
+#define OCCLUSION_H
+
+// CPU occlusion culling. A handful of big boxes standing in for the static
+// scene are drawn into a small depth buffer from the camera, and every
+// instance's box is tested against it before it is uploaded.
+//
+// The occluders are gathered once from the static instances: each axis
+// aligned one gets the biggest box that fits inside its mesh (the cube
+// itself, a square prism in a cylinder, a cube in a sphere), and boxes that
+// line up face to face are merged, so the platform becomes one slab, the
+// roof and arch rows a few beams and every stack of pillar segments one
+// prism. They are then shrunk by Occlusion_Inset, so they never stick out
+// of what they stand for. Back faces are culled, so from inside a mesh the
+// camera sees through it; an occluder is skipped while the eye is in the
+// bounds of the instances it came from.
+//
+// A frame clips the faces of each box that look at the camera to the near
+// plane, sets their triangles up and bins them into Occlusion_TileWidth x
+// Occlusion_TileHeight tiles. One job per tile then rasterises its
+// triangles four pixels at a time and reduces the tile to the hierarchical
+// Z: the furthest depth of each Occlusion_HizBlock square. Only pixels a
+// triangle covers whole are written, at the furthest depth it reaches in
+// them, so nothing between two pixel centres is hidden by a surface that
+// does not cover it. Tiles never share pixels, so the jobs run in any order
+// on any thread and give the same buffer.
+//
+// A box is occluded when its nearest depth is behind the furthest depth of
+// every hierarchical Z block it covers, or failing that, of every pixel,
+// for boxes small enough to look at pixel by pixel. Boxes off the screen
+// are culled too, boxes crossing the near plane never are.
+
+// depth is z over w as m44_make_perspective_z01 leaves it, 1 at the far plane
+#define Occlusion_Width          256
+#define Occlusion_Height         144
+#define Occlusion_TileWidth      32
+#define Occlusion_TileHeight     16
+#define Occlusion_TilesX         (Occlusion_Width / Occlusion_TileWidth)
+#define Occlusion_TilesY         (Occlusion_Height / Occlusion_TileHeight)
+#define Occlusion_TileCount      (Occlusion_TilesX * Occlusion_TilesY)
+#define Occlusion_HizBlock       8
+#define Occlusion_HizWidth       (Occlusion_Width / Occlusion_HizBlock)
+#define Occlusion_HizHeight      (Occlusion_Height / Occlusion_HizBlock)
+// boxes covering at most this many pixels get the per pixel test
+#define Occlusion_FinePixels     256
+#define Occlusion_MaxOccluders   1024
+// three faces of at most five vertices after near clipping, per occluder
+#define Occlusion_MaxTriangles   (Occlusion_MaxOccluders * 9)
+// world units each occluder is shrunk by on every side
+#define Occlusion_Inset          0.02f
+// and how close the eye may come to its instances' bounds, past the near plane
+#define Occlusion_EyeMargin      0.25f
+
+typedef struct
+{
+  v3f min;
+  v3f max;
+} Occlusion_Box;
+
+typedef struct
+{
+  Occlusion_Box inner;
+  // what the instances it stands for fill
+  Occlusion_Box outer;
+} Occlusion_Occluder;
+
+typedef u32 Occlusion_Result;
+enum
+{
+  OcclusionResult_Visible,
+  OcclusionResult_Outside,
+  OcclusionResult_Occluded,
+};
+
+// Edge functions are a*x + b*y + c, all three at least 0 at the centre of a
+// pixel the triangle covers whole; depth is z_a*x + z_b*y + z_c there, the
+// furthest it gets in the pixel. Screen space, pixel centres at .5.
+typedef struct
+{
+  f32 edge_a[3];
+  f32 edge_b[3];
+  f32 edge_c[3];
+  f32 z_a;
+  f32 z_b;
+  f32 z_c;
+  // pixel rectangle, inclusive, already on the screen
+  s32 min_x, min_y;
+  s32 max_x, max_y;
+} Occlusion_Triangle;
+
+typedef struct Occlusion_Buffer Occlusion_Buffer;
+typedef struct
+{
+  Occlusion_Buffer *buffer;
+  u32               tile;
+} Occlusion_Job;
+
+struct Occlusion_Buffer
+{
+  Occlusion_Occluder  occluders[Occlusion_MaxOccluders];
+  u32                 occluder_count;
+
+  m44                 world_to_clip;
+  v3f                 eye;
+
+  Occlusion_Triangle *triangles;
+  u32                 triangle_count;
+  // triangles past Occlusion_MaxTriangles, never drawn
+  u32                 dropped_count;
+  // Occlusion_MaxTriangles indices per tile
+  u16                *tile_triangles;
+  u32                 tile_triangle_counts[Occlusion_TileCount];
+  Occlusion_Job       jobs[Occlusion_TileCount];
+
+  f32                *depth;
+  f32                 hiz[Occlusion_HizHeight * Occlusion_HizWidth];
+
+  // what occlusion_cull_scene dropped, summed until reset
+  u64                 tested_count;
+  u64                 outside_count;
+  u64                 occluded_count;
+};
+
+static void             occlusion_buffer_alloc(Occlusion_Buffer *buffer);
+// Replaces the occluders with those of scene's static instances.
+static void             occlusion_gather_occluders(Occlusion_Buffer *buffer, Scene_Instances *scene);
+// world_to_clip is the camera's view times projection, row vectors
+static void             occlusion_set_camera(Occlusion_Buffer *buffer, v3f eye, m44 world_to_clip);
+// queue may be 0
+static void             occlusion_render(Occlusion_Buffer *buffer, OS_Work_Queue *queue);
+static Occlusion_Result occlusion_test_box(Occlusion_Buffer *buffer, v3f min, v3f max);
+// Copies the instances of scene that are not culled, keeping batches and
+// order, as shadow_cull_scene does.
+static void             occlusion_cull_scene(Occlusion_Buffer *buffer, Scene_Instances *scene, Scene_Instances *out);
+
+#endif
@@ -34,6 +34,83 @@ enum
 #define os_key_pressed(key) !!(g_input_key[key]&OS_InputFlag_Pressed)
 #define os_key_released(key) !!(g_input_key[key]&OS_InputFlag_Released)
 #define os_key_held(key) !!(g_input_key[key]&OS_InputFlag_Held)
-static void os_input_fill_events(void);
+// false once the window has been closed or, headless, on SIGINT/SIGTERM,
+// so the caller can write out what it has before leaving
+static b32 os_input_fill_events(void);
+
+// Window. A headless window has no surface at all: nothing reaches it, the
+// cursor never moves and nothing can be presented to it. The Linux backend
+// only opens headless ones. handle is the HWND on Windows.
+typedef struct
+{
+  u64 handle;
+  s32 width;
+  s32 height;
+  // of the display it is on, or 60 headless
+  f32 refresh_hz;
+  b32 headless;
+} OS_Window;
+
+static OS_Window os_window_open(char *title, s32 width, s32 height, b32 headless);
+static void      os_cursor_show(b32 show);
+// How far the cursor has moved from the middle of the window, in pixels with
+// y down, and puts it back there.
+static void      os_cursor_take_delta(OS_Window *window, s32 *delta_x, s32 *delta_y);
+
+// Time. Ticks only mean something relative to each other. Sleeps may run
+// over by the scheduler's granularity, which os_time_init brings down to the
+// finest the platform allows.
+static void      os_time_init(void);
+static u64       os_time_now(void);
+static f32       os_seconds_between(u64 begin, u64 end);
+static void      os_sleep_seconds(f32 seconds);
+
+// to the debugger on Windows, stderr elsewhere
+static void      os_debug_print(char *message);
+
+// Memory
+static void *os_memory_alloc(u64 size);
+static void  os_memory_free(void *memory, u64 size);
+
+// Files. Reads are positional, so one handle can be shared between threads.
+typedef struct
+{
+  u64 handle;
+  b32 valid;
+} OS_File;
+
+static OS_File os_file_open(char *filename);
+static u64     os_file_size(OS_File file);
+static b32     os_file_read(OS_File file, u64 offset, u64 size, void *dest);
+static void    os_file_close(OS_File file);
+
+// Read-only view of a whole file. Pages fault in on first touch, so mapping
+// costs nothing until the data is used.
+typedef struct
+{
+  u8  *data;
+  u64  size;
+} OS_File_Map;
+
+static OS_File_Map os_file_map(char *filename);
+static void        os_file_unmap(OS_File_Map *map);
+
+// Writes go to a temporary beside filename that is then renamed over it, so
+// a reader never sees half a file, even with other threads writing the same
+// one. create_directory succeeds if the directory already exists.
+static b32 os_file_write_all(char *filename, void *data, u64 size);
+static b32 os_file_delete(char *filename);
+static b32 os_directory_create(char *path);
+
+// Threads. A work queue is fed from one thread and drained by a pool of
+// workers; the feeding thread joins in while waiting in complete_all.
+typedef struct OS_Work_Queue OS_Work_Queue;
+typedef void OS_Work_Proc(void *data);
+
+static u32            os_processor_count(void);
+static OS_Work_Queue *os_work_queue_create(u32 thread_count);
+static void           os_work_queue_add(OS_Work_Queue *queue, OS_Work_Proc *proc, void *data);
+static b32            os_work_queue_is_idle(OS_Work_Queue *queue);
+static void           os_work_queue_complete_all(OS_Work_Queue *queue);
 
 #endif
\ No newline at end of file
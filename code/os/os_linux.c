@@ -0,0 +1,394 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static OS_InputFlag g_input_key[OS_KeyType_Count] = { 0 };
+
+// set from the signal handler, so the frame in flight finishes first
+static volatile sig_atomic_t g_lnx_quit_requested;
+
+static void
+lnx_quit_signal(int signal_number)
+{
+  (void)signal_number;
+  g_lnx_quit_requested = 1;
+}
+
+// Headless, so no key ever goes down; the edges are still cleared each frame
+// for anything that sets keys itself.
+static b32
+os_input_fill_events(void)
+{
+  for (u32 key = 0; key < OS_KeyType_Count; ++key)
+  {
+    g_input_key[key] &= ~(OS_InputFlag_Pressed | OS_InputFlag_Released);
+  }
+
+  b32 result = !g_lnx_quit_requested;
+  return(result);
+}
+
+static OS_Window
+os_window_open(char *title, s32 width, s32 height, b32 headless)
+{
+  (void)title;
+  (void)headless;
+
+  struct sigaction action = { 0 };
+  action.sa_handler = lnx_quit_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, 0);
+  sigaction(SIGTERM, &action, 0);
+
+  OS_Window result =
+  {
+    .handle     = 0,
+    .width      = width,
+    .height     = height,
+    .refresh_hz = 60.0f,
+    .headless   = true,
+  };
+  return(result);
+}
+
+static void
+os_cursor_show(b32 show)
+{
+  (void)show;
+}
+
+static void
+os_cursor_take_delta(OS_Window *window, s32 *delta_x, s32 *delta_y)
+{
+  (void)window;
+  *delta_x = 0;
+  *delta_y = 0;
+}
+
+static void
+os_time_init(void)
+{
+}
+
+// CLOCK_MONOTONIC in nanoseconds
+static u64
+os_time_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return((u64)now.tv_sec * 1000000000ull + (u64)now.tv_nsec);
+}
+
+static f32
+os_seconds_between(u64 begin, u64 end)
+{
+  f32 result = (f32)((f64)(end - begin) * 1e-9);
+  return(result);
+}
+
+static void
+os_sleep_seconds(f32 seconds)
+{
+  if (seconds > 0.0f)
+  {
+    struct timespec duration;
+    duration.tv_sec  = (time_t)seconds;
+    duration.tv_nsec = (long)((seconds - (f32)duration.tv_sec) * 1e9f);
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &duration, &duration) == EINTR);
+  }
+}
+
+static void
+os_debug_print(char *message)
+{
+  fputs(message, stderr);
+}
+
+static void *
+os_memory_alloc(u64 size)
+{
+  // anonymous mappings come back zeroed, same as VirtualAlloc
+  void *result = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (result == MAP_FAILED)
+  {
+    result = 0;
+  }
+
+  return(result);
+}
+
+static void
+os_memory_free(void *memory, u64 size)
+{
+  if (memory)
+  {
+    munmap(memory, size);
+  }
+}
+
+static OS_File
+os_file_open(char *filename)
+{
+  OS_File result = { 0 };
+  int fd = open(filename, O_RDONLY);
+  if (fd >= 0)
+  {
+    result.handle = (u64)fd;
+    result.valid  = true;
+  }
+
+  return(result);
+}
+
+static u64
+os_file_size(OS_File file)
+{
+  u64 result = 0;
+  struct stat file_stat;
+  if (file.valid && (fstat((int)file.handle, &file_stat) == 0))
+  {
+    result = (u64)file_stat.st_size;
+  }
+
+  return(result);
+}
+
+static b32
+os_file_read(OS_File file, u64 offset, u64 size, void *dest)
+{
+  b32 result = file.valid;
+  u8 *at     = (u8 *)dest;
+  while (result && size)
+  {
+    ssize_t read = pread((int)file.handle, at, size, (off_t)offset);
+    if (read < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    result  = (read > 0);
+    if (result)
+    {
+      at     += read;
+      offset += (u64)read;
+      size   -= (u64)read;
+    }
+  }
+
+  return(result);
+}
+
+static void
+os_file_close(OS_File file)
+{
+  if (file.valid)
+  {
+    close((int)file.handle);
+  }
+}
+
+static OS_File_Map
+os_file_map(char *filename)
+{
+  OS_File_Map result = { 0 };
+  OS_File file = os_file_open(filename);
+  u64 size     = os_file_size(file);
+  if (file.valid && size)
+  {
+    // the mapping holds its own reference to the file
+    void *data = mmap(0, size, PROT_READ, MAP_PRIVATE, (int)file.handle, 0);
+    if (data != MAP_FAILED)
+    {
+      result.data = data;
+      result.size = size;
+    }
+  }
+
+  os_file_close(file);
+  return(result);
+}
+
+static void
+os_file_unmap(OS_File_Map *map)
+{
+  if (map->data)
+  {
+    munmap(map->data, map->size);
+  }
+
+  *map = (OS_File_Map){ 0 };
+}
+
+static b32
+os_file_write_all(char *filename, void *data, u64 size)
+{
+  char temp_name[4096];
+  b32  result = (snprintf(temp_name, sizeof(temp_name), "%s.%lx.tmp", filename, (unsigned long)pthread_self()) < (int)sizeof(temp_name));
+  int  fd     = result ? open(temp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+  result      = (fd >= 0);
+
+  u8 *at = (u8 *)data;
+  while (result && size)
+  {
+    ssize_t written = write(fd, at, size);
+    if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    result = (written > 0);
+    if (result)
+    {
+      at   += written;
+      size -= (u64)written;
+    }
+  }
+
+  if (fd >= 0)
+  {
+    result = (close(fd) == 0) && result;
+    result = result && (rename(temp_name, filename) == 0);
+    if (!result)
+    {
+      unlink(temp_name);
+    }
+  }
+
+  return(result);
+}
+
+static b32
+os_file_delete(char *filename)
+{
+  b32 result = (unlink(filename) == 0);
+  return(result);
+}
+
+static b32
+os_directory_create(char *path)
+{
+  b32 result = (mkdir(path, 0755) == 0) || (errno == EEXIST);
+  return(result);
+}
+
+typedef struct
+{
+  OS_Work_Proc *proc;
+  void         *data;
+} OS_Work_Entry;
+
+#define OS_WorkQueue_MaxEntries 1024
+struct OS_Work_Queue
+{
+  volatile u32   completion_goal;
+  volatile u32   completion_count;
+  volatile u32   next_entry_to_write;
+  volatile u32   next_entry_to_read;
+  sem_t          semaphore;
+  OS_Work_Entry  entries[OS_WorkQueue_MaxEntries];
+};
+
+static u32
+os_processor_count(void)
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return((count > 0) ? (u32)count : 1);
+}
+
+// Returns true when there was nothing to take
+static b32
+lnx_work_queue_do_next(OS_Work_Queue *queue)
+{
+  b32 should_sleep = false;
+
+  u32 original_next = queue->next_entry_to_read;
+  u32 new_next      = (original_next + 1) % OS_WorkQueue_MaxEntries;
+  if (original_next != queue->next_entry_to_write)
+  {
+    u32 index = AtomicCompareExchangeU32(&queue->next_entry_to_read, new_next, original_next);
+    if (index == original_next)
+    {
+      OS_Work_Entry entry = queue->entries[index];
+      entry.proc(entry.data);
+      AtomicIncrementU32(&queue->completion_count);
+    }
+  }
+  else
+  {
+    should_sleep = true;
+  }
+
+  return(should_sleep);
+}
+
+static void *
+lnx_work_queue_thread_proc(void *param)
+{
+  OS_Work_Queue *queue = (OS_Work_Queue *)param;
+  for (;;)
+  {
+    if (lnx_work_queue_do_next(queue))
+    {
+      while ((sem_wait(&queue->semaphore) != 0) && (errno == EINTR));
+    }
+  }
+
+  return(0);
+}
+
+static OS_Work_Queue *
+os_work_queue_create(u32 thread_count)
+{
+  OS_Work_Queue *result = os_memory_alloc(sizeof(OS_Work_Queue));
+  sem_init(&result->semaphore, 0, 0);
+  for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx)
+  {
+    pthread_t thread;
+    pthread_create(&thread, 0, lnx_work_queue_thread_proc, result);
+    pthread_detach(thread);
+  }
+
+  return(result);
+}
+
+static void
+os_work_queue_add(OS_Work_Queue *queue, OS_Work_Proc *proc, void *data)
+{
+  u32 new_next_entry_to_write = (queue->next_entry_to_write + 1) % OS_WorkQueue_MaxEntries;
+  Assert(new_next_entry_to_write != queue->next_entry_to_read);
+
+  OS_Work_Entry *entry = queue->entries + queue->next_entry_to_write;
+  entry->proc = proc;
+  entry->data = data;
+  ++queue->completion_goal;
+
+  CompletePreviousWritesBeforeFutureWrites();
+  queue->next_entry_to_write = new_next_entry_to_write;
+  sem_post(&queue->semaphore);
+}
+
+static b32
+os_work_queue_is_idle(OS_Work_Queue *queue)
+{
+  b32 result = (queue->completion_goal == queue->completion_count);
+  return(result);
+}
+
+static void
+os_work_queue_complete_all(OS_Work_Queue *queue)
+{
+  while (queue->completion_goal != queue->completion_count)
+  {
+    lnx_work_queue_do_next(queue);
+  }
+
+  queue->completion_goal  = 0;
+  queue->completion_count = 0;
+}
@@ -1,3 +1,7 @@
+// timeBeginPeriod lives in winmm, which WIN32_LEAN_AND_MEAN leaves out
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+
 static OS_InputFlag g_input_key[OS_KeyType_Count] = { 0 };
 
 static OS_KeyType
@@ -71,9 +75,10 @@ w32_window_proc(HWND window, UINT message, WPARAM wparam, LPARAM lparam)
   return(result);
 }
 
-static void
+static b32
 os_input_fill_events(void)
 {
+  b32 result = true;
   for (u32 key = 0; key < OS_KeyType_Count; ++key)
   {
     g_input_key[key] &= ~(OS_InputFlag_Pressed | OS_InputFlag_Released);
@@ -86,7 +91,7 @@ os_input_fill_events(void)
     {
       case WM_QUIT:
       {
-        ExitProcess(0);
+        result = false;
       } break;
 
       case WM_KEYDOWN:
@@ -115,4 +120,397 @@ os_input_fill_events(void)
       } break;
     }
   }
-}
\ No newline at end of file
+
+  return(result);
+}
+
+static OS_Window
+os_window_open(char *title, s32 width, s32 height, b32 headless)
+{
+  SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+
+  WNDCLASS wnd_class =
+  {
+    .style           = 0,
+    .lpfnWndProc     = &w32_window_proc,
+    .cbClsExtra      = 0,
+    .cbWndExtra      = 0,
+    .hInstance       = GetModuleHandleA(0),
+    .hIcon           = LoadIconA(0, IDI_APPLICATION),
+    .hCursor         = LoadCursorA(0, IDC_ARROW),
+    .hbrBackground   = GetStockObject(BLACK_BRUSH),
+    .lpszMenuName    = 0,
+    .lpszClassName   = "Game Project",
+  };
+  RegisterClassA(&wnd_class);
+
+  RECT client_rect =
+  {
+    .left       = 0,
+    .top        = 0,
+    .right      = width,
+    .bottom     = height,
+  };
+  AdjustWindowRect(&client_rect, WS_OVERLAPPEDWINDOW, FALSE);
+
+  // a headless window is never shown; the swap chain still wants one to hang off
+  HWND window = CreateWindowA(wnd_class.lpszClassName, title, WS_OVERLAPPEDWINDOW,
+                              0, 0, client_rect.right - client_rect.left, client_rect.bottom - client_rect.top,
+                              0, 0, wnd_class.hInstance, 0);
+  AssertTrue(IsWindow(window));
+  if (!headless)
+  {
+    ShowWindow(window, SW_SHOW);
+  }
+
+  DEVMODE devmode = { .dmSize = sizeof(DEVMODE) };
+  EnumDisplaySettingsA(0, ENUM_CURRENT_SETTINGS, &devmode);
+
+  OS_Window result =
+  {
+    .handle     = (u64)window,
+    .width      = width,
+    .height     = height,
+    .refresh_hz = (!headless && devmode.dmDisplayFrequency > 1) ? (f32)devmode.dmDisplayFrequency : 60.0f,
+    .headless   = headless,
+  };
+  return(result);
+}
+
+static void
+os_cursor_show(b32 show)
+{
+  ShowCursor(show);
+}
+
+static void
+os_cursor_take_delta(OS_Window *window, s32 *delta_x, s32 *delta_y)
+{
+  *delta_x = 0;
+  *delta_y = 0;
+  if (!window->headless)
+  {
+    POINT cursor_p;
+    GetCursorPos(&cursor_p);
+    ScreenToClient((HWND)window->handle, &cursor_p);
+
+    POINT middle;
+    middle.x = window->width / 2;
+    middle.y = window->height / 2;
+    *delta_x = cursor_p.x - middle.x;
+    *delta_y = cursor_p.y - middle.y;
+
+    ClientToScreen((HWND)window->handle, &middle);
+    SetCursorPos(middle.x, middle.y);
+  }
+}
+
+static LARGE_INTEGER g_w32_perf_freq;
+
+static void
+os_time_init(void)
+{
+  QueryPerformanceFrequency(&g_w32_perf_freq);
+
+  TIMECAPS tc;
+  timeGetDevCaps(&tc, sizeof(tc));
+  timeBeginPeriod(tc.wPeriodMin);
+}
+
+static u64
+os_time_now(void)
+{
+  LARGE_INTEGER count;
+  QueryPerformanceCounter(&count);
+  return((u64)count.QuadPart);
+}
+
+static f32
+os_seconds_between(u64 begin, u64 end)
+{
+  f32 result = (f32)(end - begin) / (f32)g_w32_perf_freq.QuadPart;
+  return(result);
+}
+
+static void
+os_sleep_seconds(f32 seconds)
+{
+  if (seconds > 0.0f)
+  {
+    Sleep((u32)(seconds * 1000.0f));
+  }
+}
+
+static void
+os_debug_print(char *message)
+{
+  OutputDebugStringA(message);
+}
+
+static void *
+os_memory_alloc(u64 size)
+{
+  // VirtualAlloc hands back zeroed pages
+  void *result = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  return(result);
+}
+
+static void
+os_memory_free(void *memory, u64 size)
+{
+  (void)size;
+  if (memory)
+  {
+    VirtualFree(memory, 0, MEM_RELEASE);
+  }
+}
+
+static OS_File
+os_file_open(char *filename)
+{
+  OS_File result = { 0 };
+  HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if (handle != INVALID_HANDLE_VALUE)
+  {
+    result.handle = (u64)handle;
+    result.valid  = true;
+  }
+
+  return(result);
+}
+
+static u64
+os_file_size(OS_File file)
+{
+  LARGE_INTEGER size = { 0 };
+  if (file.valid)
+  {
+    GetFileSizeEx((HANDLE)file.handle, &size);
+  }
+
+  return((u64)size.QuadPart);
+}
+
+static b32
+os_file_read(OS_File file, u64 offset, u64 size, void *dest)
+{
+  b32 result = file.valid;
+  u8 *at     = (u8 *)dest;
+  while (result && size)
+  {
+    DWORD chunk = (size > MB(512)) ? (DWORD)MB(512) : (DWORD)size;
+    DWORD read  = 0;
+
+    OVERLAPPED overlapped   = { 0 };
+    overlapped.Offset       = (DWORD)(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh   = (DWORD)(offset >> 32);
+    result = ReadFile((HANDLE)file.handle, at, chunk, &read, &overlapped) && (read == chunk);
+
+    at     += chunk;
+    offset += chunk;
+    size   -= chunk;
+  }
+
+  return(result);
+}
+
+static void
+os_file_close(OS_File file)
+{
+  if (file.valid)
+  {
+    CloseHandle((HANDLE)file.handle);
+  }
+}
+
+static OS_File_Map
+os_file_map(char *filename)
+{
+  OS_File_Map result = { 0 };
+  OS_File file = os_file_open(filename);
+  u64 size     = os_file_size(file);
+  if (file.valid && size)
+  {
+    // the view keeps the mapping alive, so both handles can go right away
+    HANDLE mapping = CreateFileMappingA((HANDLE)file.handle, 0, PAGE_READONLY, 0, 0, 0);
+    if (mapping)
+    {
+      result.data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      result.size = result.data ? size : 0;
+      CloseHandle(mapping);
+    }
+  }
+
+  os_file_close(file);
+  return(result);
+}
+
+static void
+os_file_unmap(OS_File_Map *map)
+{
+  if (map->data)
+  {
+    UnmapViewOfFile(map->data);
+  }
+
+  *map = (OS_File_Map){ 0 };
+}
+
+static b32
+os_file_write_all(char *filename, void *data, u64 size)
+{
+  char temp_name[MAX_PATH + 32];
+  wsprintfA(temp_name, "%s.%lx.tmp", filename, GetCurrentThreadId());
+  HANDLE handle = CreateFileA(temp_name, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+  b32    result = (handle != INVALID_HANDLE_VALUE);
+
+  u8 *at = (u8 *)data;
+  while (result && size)
+  {
+    DWORD chunk   = (size > MB(512)) ? (DWORD)MB(512) : (DWORD)size;
+    DWORD written = 0;
+    result = WriteFile(handle, at, chunk, &written, 0) && (written == chunk);
+    at    += chunk;
+    size  -= chunk;
+  }
+
+  if (handle != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(handle);
+    // fails while a reader holds filename open; the caller just keeps the old one
+    result = result && MoveFileExA(temp_name, filename, MOVEFILE_REPLACE_EXISTING);
+    if (!result)
+    {
+      DeleteFileA(temp_name);
+    }
+  }
+
+  return(result);
+}
+
+static b32
+os_file_delete(char *filename)
+{
+  b32 result = DeleteFileA(filename);
+  return(result);
+}
+
+static b32
+os_directory_create(char *path)
+{
+  b32 result = CreateDirectoryA(path, 0) || (GetLastError() == ERROR_ALREADY_EXISTS);
+  return(result);
+}
+
+typedef struct
+{
+  OS_Work_Proc *proc;
+  void         *data;
+} OS_Work_Entry;
+
+#define OS_WorkQueue_MaxEntries 1024
+struct OS_Work_Queue
+{
+  volatile u32   completion_goal;
+  volatile u32   completion_count;
+  volatile u32   next_entry_to_write;
+  volatile u32   next_entry_to_read;
+  HANDLE         semaphore;
+  OS_Work_Entry  entries[OS_WorkQueue_MaxEntries];
+};
+
+static u32
+os_processor_count(void)
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return((u32)info.dwNumberOfProcessors);
+}
+
+// Returns true when there was nothing to take
+static b32
+w32_work_queue_do_next(OS_Work_Queue *queue)
+{
+  b32 should_sleep = false;
+
+  u32 original_next = queue->next_entry_to_read;
+  u32 new_next      = (original_next + 1) % OS_WorkQueue_MaxEntries;
+  if (original_next != queue->next_entry_to_write)
+  {
+    u32 index = AtomicCompareExchangeU32(&queue->next_entry_to_read, new_next, original_next);
+    if (index == original_next)
+    {
+      OS_Work_Entry entry = queue->entries[index];
+      entry.proc(entry.data);
+      AtomicIncrementU32(&queue->completion_count);
+    }
+  }
+  else
+  {
+    should_sleep = true;
+  }
+
+  return(should_sleep);
+}
+
+static DWORD WINAPI
+w32_work_queue_thread_proc(LPVOID param)
+{
+  OS_Work_Queue *queue = (OS_Work_Queue *)param;
+  for (;;)
+  {
+    if (w32_work_queue_do_next(queue))
+    {
+      WaitForSingleObjectEx(queue->semaphore, INFINITE, FALSE);
+    }
+  }
+}
+
+static OS_Work_Queue *
+os_work_queue_create(u32 thread_count)
+{
+  OS_Work_Queue *result = os_memory_alloc(sizeof(OS_Work_Queue));
+  result->semaphore     = CreateSemaphoreExA(0, 0, thread_count ? thread_count : 1, 0, 0, SEMAPHORE_ALL_ACCESS);
+  for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx)
+  {
+    HANDLE thread = CreateThread(0, 0, w32_work_queue_thread_proc, result, 0, 0);
+    CloseHandle(thread);
+  }
+
+  return(result);
+}
+
+static void
+os_work_queue_add(OS_Work_Queue *queue, OS_Work_Proc *proc, void *data)
+{
+  u32 new_next_entry_to_write = (queue->next_entry_to_write + 1) % OS_WorkQueue_MaxEntries;
+  Assert(new_next_entry_to_write != queue->next_entry_to_read);
+
+  OS_Work_Entry *entry = queue->entries + queue->next_entry_to_write;
+  entry->proc = proc;
+  entry->data = data;
+  ++queue->completion_goal;
+
+  CompletePreviousWritesBeforeFutureWrites();
+  queue->next_entry_to_write = new_next_entry_to_write;
+  ReleaseSemaphore(queue->semaphore, 1, 0);
+}
+
+static b32
+os_work_queue_is_idle(OS_Work_Queue *queue)
+{
+  b32 result = (queue->completion_goal == queue->completion_count);
+  return(result);
+}
+
+static void
+os_work_queue_complete_all(OS_Work_Queue *queue)
+{
+  while (queue->completion_goal != queue->completion_count)
+  {
+    w32_work_queue_do_next(queue);
+  }
+
+  queue->completion_goal  = 0;
+  queue->completion_count = 0;
+}
@@ -0,0 +1,537 @@
+#if defined(ENGINE_PROFILE)
+
+static Profile_State g_profile;
+static ThreadLocal Profile_Thread *g_profile_thread;
+// set on threads past Profile_MaxThreads, whose zones go nowhere
+static ThreadLocal b32 g_profile_thread_dropped;
+
+static b32
+profile_names_match(char *a, char *b)
+{
+  while ((a != b) && *a && (*a == *b))
+  {
+    ++a;
+    ++b;
+  }
+
+  return((a == b) || (*a == *b));
+}
+
+static Profile_Thread *
+profile_thread_get(void)
+{
+  Profile_Thread *result = g_profile_thread;
+  if (!result && !g_profile_thread_dropped)
+  {
+    u32 index = AtomicIncrementU32(&g_profile.thread_count) - 1;
+    if (index < Profile_MaxThreads)
+    {
+      result        = os_memory_alloc(sizeof(Profile_Thread));
+      result->index = index;
+      CompletePreviousWritesBeforeFutureWrites();
+      g_profile.threads[index] = result;
+      g_profile_thread         = result;
+    }
+    else
+    {
+      g_profile_thread_dropped = true;
+    }
+  }
+
+  return(result);
+}
+
+static void
+profile_init(void)
+{
+  g_profile.time_start = os_time_now();
+  g_profile.tsc_start  = ReadCPUTimer();
+  profile_thread_get();
+}
+
+static void
+profile_begin(char *name)
+{
+  Profile_Thread *thread = profile_thread_get();
+  if (thread)
+  {
+    u32 depth = thread->depth++;
+    if (depth < Profile_MaxDepth)
+    {
+      thread->open_names[depth]  = name;
+      thread->open_begins[depth] = ReadCPUTimer();
+    }
+  }
+}
+
+static void
+profile_end(char *name)
+{
+  u64             end    = ReadCPUTimer();
+  Profile_Thread *thread = g_profile_thread;
+  if (thread)
+  {
+    Assert(thread->depth > 0);
+    u32 depth = --thread->depth;
+    if (depth < Profile_MaxDepth)
+    {
+      Assert(profile_names_match(thread->open_names[depth], name));
+      Profile_Event *event = thread->events + (thread->event_count & (Profile_RingEvents - 1));
+      event->name  = name;
+      event->begin = thread->open_begins[depth];
+      event->end   = end;
+      event->depth = depth;
+      ++thread->event_count;
+    }
+  }
+}
+
+static void
+profile_frame_begin(void)
+{
+  g_profile.frame_begins[g_profile.frame_count & (Profile_MaxFrames - 1)] = ReadCPUTimer();
+  ++g_profile.frame_count;
+}
+
+static f64
+profile_ticks_per_second(void)
+{
+  u64 tsc_now = ReadCPUTimer();
+  f32 seconds = os_seconds_between(g_profile.time_start, os_time_now());
+  f64 result  = (seconds > 0.0f) ? ((f64)(tsc_now - g_profile.tsc_start) / (f64)seconds) : 1.0;
+  return(result);
+}
+
+static u64
+profile_frame_begin_tsc(u64 frame_idx)
+{
+  return(g_profile.frame_begins[frame_idx & (Profile_MaxFrames - 1)]);
+}
+
+static int
+profile_compare_f32(const void *a, const void *b)
+{
+  f32 x = *(f32 *)a;
+  f32 y = *(f32 *)b;
+  return((x > y) - (x < y));
+}
+
+// slowest median first, then zones that only ran while loading by their time
+static int
+profile_compare_zones(const void *a, const void *b)
+{
+  Profile_Zone_Stats *x = (Profile_Zone_Stats *)a;
+  Profile_Zone_Stats *y = (Profile_Zone_Stats *)b;
+  int result = (x->p50_ms < y->p50_ms) - (x->p50_ms > y->p50_ms);
+  if (!result)
+  {
+    result = (x->max_ms < y->max_ms) - (x->max_ms > y->max_ms);
+  }
+  if (!result)
+  {
+    result = (x->load_ms < y->load_ms) - (x->load_ms > y->load_ms);
+  }
+
+  return(result);
+}
+
+static void
+profile_zone_percentiles(Profile_Zone_Stats *stats, f32 *frame_ms, u32 frame_count)
+{
+  if (frame_count)
+  {
+    qsort(frame_ms, frame_count, sizeof(f32), profile_compare_f32);
+    stats->p50_ms = frame_ms[((frame_count - 1) * 50) / 100];
+    stats->p90_ms = frame_ms[((frame_count - 1) * 90) / 100];
+    stats->p99_ms = frame_ms[((frame_count - 1) * 99) / 100];
+    stats->max_ms = frame_ms[frame_count - 1];
+  }
+}
+
+// Profile_MaxZones once the summary has no room left for name
+static u32
+profile_summary_zone(Profile_Summary *summary, char *name)
+{
+  u32 result = 0;
+  while ((result < summary->zone_count) && !profile_names_match(summary->zones[result].name, name))
+  {
+    ++result;
+  }
+
+  if ((result == summary->zone_count) && (result < Profile_MaxZones))
+  {
+    summary->zones[summary->zone_count++].name = name;
+  }
+
+  return(result);
+}
+
+static void
+profile_summarise(Profile_Summary *summary)
+{
+  *summary = (Profile_Summary){ 0 };
+  summary->frame.name = "frame";
+
+  f64 ms_per_tick  = 1000.0 / profile_ticks_per_second();
+  u32 thread_count = Minimum(g_profile.thread_count, Profile_MaxThreads);
+
+  // A ring that has wrapped lost every zone that ended before its oldest
+  // one did, so only frames that began after that are whole.
+  u64 oldest_kept_end = 0;
+  for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx)
+  {
+    Profile_Thread *thread = g_profile.threads[thread_idx];
+    if (thread && (thread->event_count > Profile_RingEvents))
+    {
+      Profile_Event *oldest = thread->events + (thread->event_count & (Profile_RingEvents - 1));
+      oldest_kept_end = Maximum(oldest_kept_end, oldest->end);
+    }
+  }
+
+  // the frame still open has no end yet
+  u64 closed_count = g_profile.frame_count ? (g_profile.frame_count - 1) : 0;
+  u64 first_frame  = (g_profile.frame_count > Profile_MaxFrames) ? (g_profile.frame_count - Profile_MaxFrames) : 0;
+  while ((first_frame < closed_count) && (profile_frame_begin_tsc(first_frame) < oldest_kept_end))
+  {
+    ++first_frame;
+  }
+  b32 load_kept = (oldest_kept_end == 0) && (first_frame == 0);
+
+  u32 frame_count       = (u32)(closed_count - first_frame);
+  u64 frame_ms_size     = (u64)(Profile_MaxZones + 1) * frame_count * sizeof(f32);
+  f32 *frame_ms         = frame_count ? os_memory_alloc(frame_ms_size) : 0;
+  summary->frame_count  = frame_ms ? frame_count : 0;
+  frame_count           = summary->frame_count;
+
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    u64 begin = profile_frame_begin_tsc(first_frame + frame_idx);
+    u64 end   = profile_frame_begin_tsc(first_frame + frame_idx + 1);
+    frame_ms[frame_idx] = (f32)((f64)(end - begin) * ms_per_tick);
+  }
+
+  // zones from the first frame kept on are not loading, nor are those in
+  // frames dropped for a wrapped ring
+  u64 first_frame_begin = g_profile.frame_count ? profile_frame_begin_tsc(first_frame) : ~0ull;
+  u64 open_frame_begin  = g_profile.frame_count ? profile_frame_begin_tsc(g_profile.frame_count - 1) : ~0ull;
+  for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx)
+  {
+    Profile_Thread *thread = g_profile.threads[thread_idx];
+    u64 kept_count = thread ? Minimum(thread->event_count, Profile_RingEvents) : 0;
+    for (u64 event_idx = 0; event_idx < kept_count; ++event_idx)
+    {
+      Profile_Event *event = thread->events + event_idx;
+      f32            ms    = (f32)((f64)(event->end - event->begin) * ms_per_tick);
+      if (event->begin < first_frame_begin)
+      {
+        u32 zone_idx = load_kept ? profile_summary_zone(summary, event->name) : Profile_MaxZones;
+        if (zone_idx < Profile_MaxZones)
+        {
+          summary->zones[zone_idx].load_ms += ms;
+          ++summary->zones[zone_idx].load_calls;
+        }
+      }
+      else if (frame_count && (event->begin < open_frame_begin))
+      {
+        // the last frame that began at or before the zone did
+        u32 low = 0, high = frame_count;
+        while (high - low > 1)
+        {
+          u32 middle = (low + high) / 2;
+          if (profile_frame_begin_tsc(first_frame + middle) <= event->begin)
+          {
+            low = middle;
+          }
+          else
+          {
+            high = middle;
+          }
+        }
+
+        u32 zone_idx = profile_summary_zone(summary, event->name);
+        if (zone_idx < Profile_MaxZones)
+        {
+          frame_ms[(u64)(zone_idx + 1) * frame_count + low] += ms;
+          summary->zones[zone_idx].calls_per_frame += 1.0f;
+        }
+      }
+    }
+  }
+
+  profile_zone_percentiles(&summary->frame, frame_ms, frame_count);
+  summary->frame.calls_per_frame = frame_count ? 1.0f : 0.0f;
+  for (u32 zone_idx = 0; zone_idx < summary->zone_count; ++zone_idx)
+  {
+    Profile_Zone_Stats *zone = summary->zones + zone_idx;
+    profile_zone_percentiles(zone, frame_ms + (u64)(zone_idx + 1) * frame_count, frame_count);
+    zone->calls_per_frame = frame_count ? (zone->calls_per_frame / (f32)frame_count) : 0.0f;
+  }
+  qsort(summary->zones, summary->zone_count, sizeof(Profile_Zone_Stats), profile_compare_zones);
+
+  if (frame_ms)
+  {
+    os_memory_free(frame_ms, frame_ms_size);
+  }
+}
+
+// Text with no stdio behind it. Appends past size are dropped, and data
+// stays terminated.
+typedef struct
+{
+  char *data;
+  u64   size;
+  u64   length;
+} Profile_Text;
+
+static void
+profile_text_char(Profile_Text *text, char c)
+{
+  if (text->length + 1 < text->size)
+  {
+    text->data[text->length++] = c;
+    text->data[text->length]   = 0;
+  }
+}
+
+static void
+profile_text_append(Profile_Text *text, char *string)
+{
+  for (char *at = string; *at; ++at)
+  {
+    profile_text_char(text, *at);
+  }
+}
+
+// for JSON strings
+static void
+profile_text_escaped(Profile_Text *text, char *string)
+{
+  for (char *at = string; *at; ++at)
+  {
+    if ((*at == '"') || (*at == '\\'))
+    {
+      profile_text_char(text, '\\');
+    }
+    profile_text_char(text, ((u8)*at < ' ') ? ' ' : *at);
+  }
+}
+
+static void
+profile_text_u64(Profile_Text *text, u64 value)
+{
+  char digits[20];
+  u32  digit_count = 0;
+  do
+  {
+    digits[digit_count++] = (char)('0' + (value % 10));
+    value /= 10;
+  } while (value);
+
+  while (digit_count)
+  {
+    profile_text_char(text, digits[--digit_count]);
+  }
+}
+
+static void
+profile_text_fixed(Profile_Text *text, f64 value, u32 decimals)
+{
+  if (value < 0.0)
+  {
+    profile_text_char(text, '-');
+    value = -value;
+  }
+
+  u64 scale = 1;
+  for (u32 decimal_idx = 0; decimal_idx < decimals; ++decimal_idx)
+  {
+    scale *= 10;
+  }
+
+  u64 scaled = (u64)(value * (f64)scale + 0.5);
+  profile_text_u64(text, scaled / scale);
+  if (decimals)
+  {
+    profile_text_char(text, '.');
+    for (u64 place = scale / 10; place; place /= 10)
+    {
+      profile_text_char(text, (char)('0' + ((scaled / place) % 10)));
+    }
+  }
+}
+
+// right aligned in width columns
+static void
+profile_text_column(Profile_Text *text, f64 value, u32 decimals, u32 width)
+{
+  char         cell_data[32];
+  Profile_Text cell = { cell_data, sizeof(cell_data), 0 };
+  profile_text_fixed(&cell, value, decimals);
+  for (u64 pad = cell.length; pad < width; ++pad)
+  {
+    profile_text_char(text, ' ');
+  }
+  profile_text_append(text, cell.data);
+}
+
+static void
+profile_text_name(Profile_Text *text, char *name, u32 width)
+{
+  u64 begin = text->length;
+  profile_text_append(text, name);
+  do
+  {
+    profile_text_char(text, ' ');
+  } while ((text->length - begin < width) && (text->length + 1 < text->size));
+}
+
+static void
+profile_text_zone_row(Profile_Text *text, Profile_Zone_Stats *zone)
+{
+  profile_text_name(text, zone->name, 28);
+  profile_text_column(text, zone->p50_ms, 3, 9);
+  profile_text_column(text, zone->p90_ms, 3, 9);
+  profile_text_column(text, zone->p99_ms, 3, 9);
+  profile_text_column(text, zone->max_ms, 3, 9);
+  profile_text_column(text, zone->calls_per_frame, 2, 11);
+  profile_text_char(text, '\n');
+}
+
+static u32
+profile_summary_text(Profile_Summary *summary, char *buffer, u32 buffer_size)
+{
+  Profile_Text text = { buffer, buffer_size, 0 };
+  if (buffer_size)
+  {
+    buffer[0] = 0;
+  }
+
+  profile_text_append(&text, "profile: ");
+  profile_text_u64(&text, summary->frame_count);
+  profile_text_append(&text, " frames\n");
+  if (summary->frame_count)
+  {
+    profile_text_name(&text, "zone, ms per frame", 28);
+    profile_text_append(&text, "      p50      p90      p99      max  calls/frame\n");
+    profile_text_zone_row(&text, &summary->frame);
+    for (u32 zone_idx = 0; zone_idx < summary->zone_count; ++zone_idx)
+    {
+      if (summary->zones[zone_idx].calls_per_frame > 0.0f)
+      {
+        profile_text_zone_row(&text, summary->zones + zone_idx);
+      }
+    }
+  }
+
+  b32 loaded = false;
+  for (u32 zone_idx = 0; zone_idx < summary->zone_count; ++zone_idx)
+  {
+    Profile_Zone_Stats *zone = summary->zones + zone_idx;
+    if (zone->load_calls)
+    {
+      if (!loaded)
+      {
+        profile_text_append(&text, "before the first frame:\n");
+        loaded = true;
+      }
+      profile_text_name(&text, zone->name, 28);
+      profile_text_column(&text, zone->load_ms, 3, 9);
+      profile_text_append(&text, " ms in ");
+      profile_text_u64(&text, zone->load_calls);
+      profile_text_append(&text, (zone->load_calls == 1) ? " call\n" : " calls\n");
+    }
+  }
+
+  return((u32)text.length);
+}
+
+static void
+profile_trace_event_begin(Profile_Text *text, b32 *first, char *name, char *phase, u32 tid)
+{
+  profile_text_append(text, *first ? "\n{\"name\":\"" : ",\n{\"name\":\"");
+  profile_text_escaped(text, name);
+  profile_text_append(text, "\",\"ph\":\"");
+  profile_text_append(text, phase);
+  profile_text_append(text, "\",\"pid\":1,\"tid\":");
+  profile_text_u64(text, tid);
+  *first = false;
+}
+
+static b32
+profile_write_trace(char *filename)
+{
+  f64 us_per_tick  = 1000000.0 / profile_ticks_per_second();
+  u32 thread_count = Minimum(g_profile.thread_count, Profile_MaxThreads);
+  u64 frame_kept   = Minimum(g_profile.frame_count, Profile_MaxFrames);
+
+  // numbers take at most 21 characters and names at most twice their length escaped
+  u64 size = 64 + 128 * (thread_count + frame_kept);
+  for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx)
+  {
+    Profile_Thread *thread = g_profile.threads[thread_idx];
+    u64 kept_count = thread ? Minimum(thread->event_count, Profile_RingEvents) : 0;
+    for (u64 event_idx = 0; event_idx < kept_count; ++event_idx)
+    {
+      size += 128;
+      for (char *at = thread->events[event_idx].name; *at; ++at)
+      {
+        size += 2;
+      }
+    }
+  }
+
+  Profile_Text text = { os_memory_alloc(size), size, 0 };
+  b32 result = (text.data != 0);
+  if (result)
+  {
+    b32 first = true;
+    profile_text_append(&text, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx)
+    {
+      if (g_profile.threads[thread_idx])
+      {
+        profile_trace_event_begin(&text, &first, "thread_name", "M", thread_idx);
+        profile_text_append(&text, thread_idx ? ",\"args\":{\"name\":\"thread " : ",\"args\":{\"name\":\"main");
+        if (thread_idx)
+        {
+          profile_text_u64(&text, thread_idx);
+        }
+        profile_text_append(&text, "\"}}");
+      }
+    }
+
+    for (u64 frame_idx = g_profile.frame_count - frame_kept; frame_idx < g_profile.frame_count; ++frame_idx)
+    {
+      u64 tsc = profile_frame_begin_tsc(frame_idx);
+      profile_trace_event_begin(&text, &first, "frame", "i", 0);
+      profile_text_append(&text, ",\"s\":\"g\",\"ts\":");
+      profile_text_fixed(&text, (tsc > g_profile.tsc_start) ? (f64)(tsc - g_profile.tsc_start) * us_per_tick : 0.0, 3);
+      profile_text_char(&text, '}');
+    }
+
+    for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx)
+    {
+      Profile_Thread *thread = g_profile.threads[thread_idx];
+      u64 kept_count = thread ? Minimum(thread->event_count, Profile_RingEvents) : 0;
+      for (u64 event_idx = 0; event_idx < kept_count; ++event_idx)
+      {
+        Profile_Event *event = thread->events + event_idx;
+        profile_trace_event_begin(&text, &first, event->name, "X", thread_idx);
+        profile_text_append(&text, ",\"ts\":");
+        profile_text_fixed(&text, (event->begin > g_profile.tsc_start) ? (f64)(event->begin - g_profile.tsc_start) * us_per_tick : 0.0, 3);
+        profile_text_append(&text, ",\"dur\":");
+        profile_text_fixed(&text, (f64)(event->end - event->begin) * us_per_tick, 3);
+        profile_text_char(&text, '}');
+      }
+    }
+    profile_text_append(&text, "\n]}\n");
+
+    Assert(text.length + 1 < text.size);
+    result = os_file_write_all(filename, text.data, text.length);
+    os_memory_free(text.data, size);
+  }
+
+  return(result);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#if !defined(PROFILE_H)
+#define PROFILE_H
+
+// CPU profiler. ProfileBegin and ProfileEnd bracket a zone; zones nest, and
+// each one closed is written with its nesting depth and rdtsc begin and end
+// to a ring buffer of the thread it ran on, so threads never contend and the
+// cost is two timer reads and a handful of stores. A ring keeps the newest
+// Profile_RingEvents zones of its thread and drops older ones.
+//
+// The main loop calls ProfileFrameBegin at the top of every frame, and a
+// frame ends where the next begins. The summary sorts each zone into the
+// frame it began in, totals it per frame and reports percentiles of those
+// totals over the ended frames every ring still covers, plus what ran
+// before the first frame (loading). The frame still open is left out, so a
+// loop that begins a frame only to find it has to stop costs nothing.
+//
+// The trace is the Chrome trace event format, which chrome://tracing and
+// ui.perfetto.dev open: one complete event per zone, an instant event per
+// frame and a name per thread. Both read every ring, so call them while
+// other threads are idle. rdtsc ticks are turned into time against
+// os_time_now between profile_init and the call.
+//
+// Zone names must be string literals, or live as long as the profiler. The
+// profiler is on in debug builds and any other that defines ENGINE_PROFILE;
+// elsewhere the macros expand to nothing and profile.c is empty.
+
+#if defined(ENGINE_DEBUG) && !defined(ENGINE_PROFILE)
+# define ENGINE_PROFILE
+#endif
+
+#if defined(ENGINE_PROFILE)
+
+// a power of two, 2 MB of events per thread
+#define Profile_RingEvents  (1 << 16)
+#define Profile_MaxThreads  64
+// deeper zones are timed by their parents only
+#define Profile_MaxDepth    32
+// frame starts kept, a power of two
+#define Profile_MaxFrames   (1 << 12)
+// distinct zone names the summary reports
+#define Profile_MaxZones    64
+
+typedef struct
+{
+  char *name;
+  u64   begin;
+  u64   end;
+  u32   depth;
+} Profile_Event;
+
+typedef struct
+{
+  u32            index;
+  u32            depth;
+  char          *open_names[Profile_MaxDepth];
+  u64            open_begins[Profile_MaxDepth];
+  // ever written; the newest is events[(event_count - 1) % Profile_RingEvents]
+  u64            event_count;
+  Profile_Event  events[Profile_RingEvents];
+} Profile_Thread;
+
+typedef struct
+{
+  Profile_Thread *threads[Profile_MaxThreads];
+  u32             thread_count;
+  // ever begun; frame i began at frame_begins[i % Profile_MaxFrames]
+  u64             frame_begins[Profile_MaxFrames];
+  u64             frame_count;
+  u64             tsc_start;
+  u64             time_start;
+} Profile_State;
+
+typedef struct
+{
+  char *name;
+  // of the zone's total per frame, 0 in frames it did not run in
+  f32   p50_ms;
+  f32   p90_ms;
+  f32   p99_ms;
+  f32   max_ms;
+  f32   calls_per_frame;
+  // before the first frame
+  f32   load_ms;
+  u32   load_calls;
+} Profile_Zone_Stats;
+
+typedef struct
+{
+  u32                frame_count;
+  // whole frames, named "frame"
+  Profile_Zone_Stats frame;
+  u32                zone_count;
+  // slowest median first
+  Profile_Zone_Stats zones[Profile_MaxZones];
+} Profile_Summary;
+
+// Starts the clock the trace counts from. Called before any other thread
+// opens a zone, it makes the caller thread 0, "main" in the trace.
+static void profile_init(void);
+static void profile_begin(char *name);
+// name must be the innermost open zone's
+static void profile_end(char *name);
+static void profile_frame_begin(void);
+static f64  profile_ticks_per_second(void);
+static void profile_summarise(Profile_Summary *summary);
+// A table of the summary, cut short if buffer_size runs out; returns its length.
+static u32  profile_summary_text(Profile_Summary *summary, char *buffer, u32 buffer_size);
+static b32  profile_write_trace(char *filename);
+
+# define ProfileBegin(name)  profile_begin(name)
+# define ProfileEnd(name)    profile_end(name)
+# define ProfileFrameBegin() profile_frame_begin()
+
+#else
+
+# define ProfileBegin(name)
+# define ProfileEnd(name)
+# define ProfileFrameBegin()
+
+#endif
+
+#endif
@@ -0,0 +1,640 @@
+static void
+pvs_grid(Pvs_Grid *grid, Bvh_Box bounds, f32 cell_size)
+{
+  v3f extent = v3f_sub(bounds.max, bounds.min);
+  u32 counts[3];
+  for (;;)
+  {
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      counts[axis] = Maximum((u32)ceilf(Maximum(extent.v[axis], 0.0f) / cell_size), 1);
+    }
+
+    if ((counts[0] <= Pvs_MaxCellsAxis) && (counts[1] <= Pvs_MaxCellsAxis) && (counts[2] <= Pvs_MaxCellsAxis) &&
+        (counts[0] * counts[1] * counts[2] <= Pvs_MaxCells))
+    {
+      break;
+    }
+    cell_size *= 1.25f;
+  }
+
+  v3f centre = v3f_scale(0.5f, v3f_add(bounds.min, bounds.max));
+  *grid = (Pvs_Grid)
+  {
+    .origin       = v3f_sub(centre, v3f_scale(0.5f * cell_size, (v3f){ (f32)counts[0], (f32)counts[1], (f32)counts[2] })),
+    .cell_size    = cell_size,
+    .cell_count_x = counts[0],
+    .cell_count_y = counts[1],
+    .cell_count_z = counts[2],
+    .cell_count   = counts[0] * counts[1] * counts[2],
+  };
+}
+
+static u32
+pvs_cell_at(Pvs_Grid *grid, v3f p)
+{
+  u32 counts[3] = { grid->cell_count_x, grid->cell_count_y, grid->cell_count_z };
+  u32 cell[3];
+  u32 result = Pvs_NoCell;
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    f32 at = floorf((p.v[axis] - grid->origin.v[axis]) / grid->cell_size);
+    if (!(at >= 0.0f) || (at >= (f32)counts[axis]))
+    {
+      return(result);
+    }
+    cell[axis] = (u32)at;
+  }
+
+  result = (cell[2] * grid->cell_count_y + cell[1]) * grid->cell_count_x + cell[0];
+  return(result);
+}
+
+static v3f
+pvs_cell_min(Pvs_Grid *grid, u32 cell_idx, u32 *cell)
+{
+  cell[0] = cell_idx % grid->cell_count_x;
+  cell[1] = (cell_idx / grid->cell_count_x) % grid->cell_count_y;
+  cell[2] = cell_idx / (grid->cell_count_x * grid->cell_count_y);
+  v3f result = v3f_add(grid->origin, v3f_scale(grid->cell_size, (v3f){ (f32)cell[0], (f32)cell[1], (f32)cell[2] }));
+  return(result);
+}
+
+static f32
+pvs_radical_inverse(u32 index, u32 base)
+{
+  f32 result   = 0.0f;
+  f32 fraction = 1.0f / (f32)base;
+  while (index)
+  {
+    result  += (f32)(index % base) * fraction;
+    index   /= base;
+    fraction /= (f32)base;
+  }
+
+  return(result);
+}
+
+// what the jobs share; next_cell hands them out, one phase at a time
+typedef u32 Pvs_Phase;
+enum
+{
+  // which sample points of a cell are out in the open
+  PvsPhase_Open,
+  // which cells past it a cell sees
+  PvsPhase_Pairs,
+  // the instances of the cells a cell and its neighbours see
+  PvsPhase_Gather,
+};
+
+typedef struct
+{
+  Pvs_Bake     *bake;
+  Pvs_Grid     *grid;
+  Pvs_Phase     phase;
+  u32           cell_words;
+  // cell_count rows of cell_words
+  u64          *cell_visible;
+  // cell_count rows of Pvs_RowWords, the instances overlapping each cell
+  u64          *cell_instances;
+  // per cell, a bit per sample point out in the open
+  u64          *open_points;
+  u64          *visible;
+  // in the unit cube, kept off its faces
+  v3f           samples[Pvs_SamplesPerCell];
+  volatile u64  next_cell;
+} Pvs_Jobs;
+
+// the meshes wind clockwise, front faces toward the viewer
+static b32
+pvs_is_back_face(Pvs_Bake *bake, u32 source_idx, v3f dir)
+{
+  Bvh_Source_Triangle *triangle = bake->triangles + source_idx;
+  v3f normal = v3f_cross(v3f_sub(triangle->p[2], triangle->p[0]), v3f_sub(triangle->p[1], triangle->p[0]));
+  b32 result = (v3f_inner(normal, dir) > 0.0f);
+  return(result);
+}
+
+// A point is inside geometry if a ray from it reaches a back face first;
+// two directions, in case one grazes an edge.
+static void
+pvs_find_open_points(Pvs_Jobs *jobs, u32 cell_idx)
+{
+  Pvs_Bake *bake = jobs->bake;
+  u32 cell[3];
+  v3f cell_min = pvs_cell_min(jobs->grid, cell_idx, cell);
+  v3f dirs[2]  = { { 0.0f, 1.0f, 0.0f }, v3f_normalized((v3f){ 0.6f, -0.3f, 0.74f }) };
+
+  u64 open = 0;
+  for (u32 sample_idx = 0; sample_idx < Pvs_SamplesPerCell; ++sample_idx)
+  {
+    v3f p = v3f_add(cell_min, v3f_scale(jobs->grid->cell_size, jobs->samples[sample_idx]));
+    b32 inside = false;
+    for (u32 dir_idx = 0; (dir_idx < ArrayCount(dirs)) && !inside; ++dir_idx)
+    {
+      Bvh_Hit hit;
+      inside = bvh_intersect(bake->bvh, p, dirs[dir_idx], 0.0f, 1e30f, &hit) && pvs_is_back_face(bake, hit.source_idx, dirs[dir_idx]);
+    }
+
+    if (!inside)
+    {
+      open |= 1ull << sample_idx;
+    }
+  }
+
+  jobs->open_points[cell_idx] = open;
+}
+
+static u32
+pvs_mask_points(u64 mask, u8 *points)
+{
+  u32 result = 0;
+  for (u32 sample_idx = 0; sample_idx < Pvs_SamplesPerCell; ++sample_idx)
+  {
+    if (mask & (1ull << sample_idx))
+    {
+      points[result++] = (u8)sample_idx;
+    }
+  }
+
+  return(result);
+}
+
+// Rays from the open points of cell a toward the points of cell b, the
+// open ones if it has any. One that arrives, or stops on a front face
+// inside b, is a surface of b seen from a.
+static b32
+pvs_cells_see(Pvs_Jobs *jobs, u32 a_idx, u32 b_idx)
+{
+  Pvs_Bake *bake = jobs->bake;
+  Pvs_Grid *grid = jobs->grid;
+  u32 a[3], b[3];
+  v3f a_min = pvs_cell_min(grid, a_idx, a);
+  v3f b_min = pvs_cell_min(grid, b_idx, b);
+  b32 neighbours = true;
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    neighbours = neighbours && ((a[axis] <= b[axis] + 1) && (b[axis] <= a[axis] + 1));
+  }
+
+  u8  origins[Pvs_SamplesPerCell];
+  u8  targets[Pvs_SamplesPerCell];
+  u32 origin_count = pvs_mask_points(jobs->open_points[a_idx], origins);
+  u32 target_count = pvs_mask_points(jobs->open_points[b_idx] ? jobs->open_points[b_idx] : ~0ull, targets);
+  if (neighbours || !origin_count)
+  {
+    return(true);
+  }
+
+  // a little slack for hits on b's faces
+  f32 slack = grid->cell_size * 1e-3f;
+  v3f b_max = v3f_add(b_min, v3f_s(grid->cell_size + slack));
+  b_min     = v3f_sub(b_min, v3f_s(slack));
+  for (u32 first = 0; first < bake->rays_per_pair; first += Bvh_PacketSize)
+  {
+    Bvh_Packet packet;
+    v3f dirs[Bvh_PacketSize];
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      u32 ray_idx = first + lane;
+      v3f origin  = v3f_add(a_min, v3f_scale(grid->cell_size, jobs->samples[origins[ray_idx % origin_count]]));
+      v3f target  = v3f_add(b_min, v3f_add(v3f_s(slack), v3f_scale(grid->cell_size, jobs->samples[targets[(ray_idx * 7 + 1) % target_count]])));
+      v3f to      = v3f_sub(target, origin);
+      f32 length  = sqrtf(v3f_inner(to, to));
+      dirs[lane]  = v3f_scale(1.0f / length, to);
+      packet.origin_x[lane] = origin.x;
+      packet.origin_y[lane] = origin.y;
+      packet.origin_z[lane] = origin.z;
+      packet.dir_x[lane]    = dirs[lane].x;
+      packet.dir_y[lane]    = dirs[lane].y;
+      packet.dir_z[lane]    = dirs[lane].z;
+      packet.t_min[lane]    = 0.0f;
+      packet.t_max[lane]    = length;
+    }
+
+    Bvh_Packet_Hit hit;
+    u32 hits = bvh_intersect_packet(bake->bvh, &packet, &hit);
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      if (!(hits & (1 << lane)))
+      {
+        return(true);
+      }
+
+      v3f p = { packet.origin_x[lane] + hit.t[lane] * dirs[lane].x,
+                packet.origin_y[lane] + hit.t[lane] * dirs[lane].y,
+                packet.origin_z[lane] + hit.t[lane] * dirs[lane].z };
+      if (!pvs_is_back_face(bake, hit.source_idx[lane], dirs[lane]) &&
+          (p.x >= b_min.x) && (p.y >= b_min.y) && (p.z >= b_min.z) && (p.x <= b_max.x) && (p.y <= b_max.y) && (p.z <= b_max.z))
+      {
+        return(true);
+      }
+    }
+  }
+
+  return(false);
+}
+
+static void
+pvs_bake_cell(Pvs_Jobs *jobs, u32 cell_idx)
+{
+  Pvs_Grid *grid = jobs->grid;
+  switch (jobs->phase)
+  {
+    case PvsPhase_Open:
+    {
+      pvs_find_open_points(jobs, cell_idx);
+    } break;
+
+    // the pair is symmetric, so a cell only looks at the cells after it and
+    // writes only its own row
+    case PvsPhase_Pairs:
+    {
+      u64 *row = jobs->cell_visible + (u64)cell_idx * jobs->cell_words;
+      for (u32 other_idx = cell_idx + 1; other_idx < grid->cell_count; ++other_idx)
+      {
+        if (pvs_cells_see(jobs, cell_idx, other_idx))
+        {
+          row[other_idx / 64] |= 1ull << (other_idx % 64);
+        }
+      }
+    } break;
+
+    // A camera can stand anywhere in the cell, nearer an edge than any of
+    // its sample points and so seeing round it, so the cell also takes the
+    // cells its neighbours see: their points stand past that edge. This
+    // samples more of what the cell sees; it does not bound it.
+    case PvsPhase_Gather:
+    {
+      u64 cells[Pvs_MaxCells / 64] = { 0 };
+      u32 counts[3] = { grid->cell_count_x, grid->cell_count_y, grid->cell_count_z };
+      u32 cell[3], first[3], last[3];
+      pvs_cell_min(grid, cell_idx, cell);
+      for (u32 axis = 0; axis < 3; ++axis)
+      {
+        first[axis] = cell[axis] ? cell[axis] - 1 : 0;
+        last[axis]  = (cell[axis] + 1 < counts[axis]) ? cell[axis] + 1 : cell[axis];
+      }
+
+      for (u32 z = first[2]; z <= last[2]; ++z)
+      {
+        for (u32 y = first[1]; y <= last[1]; ++y)
+        {
+          for (u32 x = first[0]; x <= last[0]; ++x)
+          {
+            u64 *neighbour = jobs->cell_visible + (u64)((z * counts[1] + y) * counts[0] + x) * jobs->cell_words;
+            for (u32 cell_word = 0; cell_word < jobs->cell_words; ++cell_word)
+            {
+              cells[cell_word] |= neighbour[cell_word];
+            }
+          }
+        }
+      }
+
+      u64 *row = jobs->visible + (u64)cell_idx * Pvs_RowWords;
+      for (u32 other_idx = 0; other_idx < grid->cell_count; ++other_idx)
+      {
+        if (cells[other_idx / 64] & (1ull << (other_idx % 64)))
+        {
+          u64 *instances = jobs->cell_instances + (u64)other_idx * Pvs_RowWords;
+          for (u32 instance_word = 0; instance_word < Pvs_RowWords; ++instance_word)
+          {
+            row[instance_word] |= instances[instance_word];
+          }
+        }
+      }
+    } break;
+  }
+}
+
+static void
+pvs_cell_job(void *data)
+{
+  Pvs_Jobs *jobs = (Pvs_Jobs *)data;
+  for (u64 cell_idx = AtomicAddU64(&jobs->next_cell, 1); cell_idx < jobs->grid->cell_count;
+       cell_idx = AtomicAddU64(&jobs->next_cell, 1))
+  {
+    pvs_bake_cell(jobs, (u32)cell_idx);
+  }
+}
+
+static void
+pvs_run_phase(Pvs_Jobs *jobs, Pvs_Phase phase, OS_Work_Queue *queue)
+{
+  jobs->phase     = phase;
+  jobs->next_cell = 0;
+  if (queue)
+  {
+    for (u32 job_idx = 0; job_idx < Pvs_JobCount; ++job_idx)
+    {
+      os_work_queue_add(queue, pvs_cell_job, jobs);
+    }
+    os_work_queue_complete_all(queue);
+  }
+  else
+  {
+    pvs_cell_job(jobs);
+  }
+}
+
+static void
+pvs_bake(Pvs_Bake *bake, Pvs_Grid *grid, u64 *visible, OS_Work_Queue *queue)
+{
+  Scene_Instances *scene = bake->scene;
+  Assert((bake->rays_per_pair > 0) && (bake->rays_per_pair <= Pvs_MaxRaysPerPair) && ((bake->rays_per_pair % Bvh_PacketSize) == 0));
+  Assert(grid->cell_count <= Pvs_MaxCells);
+
+  Pvs_Jobs *jobs = (Pvs_Jobs *)os_memory_alloc(sizeof(Pvs_Jobs));
+  jobs->bake           = bake;
+  jobs->grid           = grid;
+  jobs->cell_words     = (grid->cell_count + 63) / 64;
+  jobs->cell_visible   = (u64 *)os_memory_alloc((u64)grid->cell_count * jobs->cell_words * sizeof(u64));
+  jobs->cell_instances = (u64 *)os_memory_alloc((u64)grid->cell_count * Pvs_RowWords * sizeof(u64));
+  jobs->open_points    = (u64 *)os_memory_alloc((u64)grid->cell_count * sizeof(u64));
+  jobs->visible        = visible;
+  for (u32 sample_idx = 0; sample_idx < Pvs_SamplesPerCell; ++sample_idx)
+  {
+    v3f unit = { pvs_radical_inverse(sample_idx + 1, 2), pvs_radical_inverse(sample_idx + 1, 3), pvs_radical_inverse(sample_idx + 1, 5) };
+    jobs->samples[sample_idx] = v3f_add(v3f_s(0.02f), v3f_scale(0.96f, unit));
+  }
+
+  // what each cell holds, by bounding sphere
+  u32 counts[3] = { grid->cell_count_x, grid->cell_count_y, grid->cell_count_z };
+  for (u32 instance_idx = 0; instance_idx < scene->static_instance_count; ++instance_idx)
+  {
+    Scene_Instance_Info *info = scene->info + instance_idx;
+    u32 first[3], last[3];
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      f32 low  = floorf((info->bound_p.v[axis] - info->bound_radius - grid->origin.v[axis]) / grid->cell_size);
+      f32 high = floorf((info->bound_p.v[axis] + info->bound_radius - grid->origin.v[axis]) / grid->cell_size);
+      first[axis] = (u32)Minimum(Maximum(low, 0.0f), (f32)(counts[axis] - 1));
+      last[axis]  = (u32)Minimum(Maximum(high, 0.0f), (f32)(counts[axis] - 1));
+    }
+
+    for (u32 z = first[2]; z <= last[2]; ++z)
+    {
+      for (u32 y = first[1]; y <= last[1]; ++y)
+      {
+        for (u32 x = first[0]; x <= last[0]; ++x)
+        {
+          u64 *instances = jobs->cell_instances + (u64)((z * counts[1] + y) * counts[0] + x) * Pvs_RowWords;
+          instances[instance_idx / 64] |= 1ull << (instance_idx % 64);
+        }
+      }
+    }
+  }
+
+  pvs_run_phase(jobs, PvsPhase_Open, queue);
+  pvs_run_phase(jobs, PvsPhase_Pairs, queue);
+
+  // every cell sees itself, and the rows only hold the cells after them
+  for (u32 cell_idx = 0; cell_idx < grid->cell_count; ++cell_idx)
+  {
+    u64 *row = jobs->cell_visible + (u64)cell_idx * jobs->cell_words;
+    row[cell_idx / 64] |= 1ull << (cell_idx % 64);
+    for (u32 other_idx = cell_idx + 1; other_idx < grid->cell_count; ++other_idx)
+    {
+      if (row[other_idx / 64] & (1ull << (other_idx % 64)))
+      {
+        jobs->cell_visible[(u64)other_idx * jobs->cell_words + cell_idx / 64] |= 1ull << (cell_idx % 64);
+      }
+    }
+  }
+
+  for (u64 word_idx = 0; word_idx < (u64)grid->cell_count * Pvs_RowWords; ++word_idx)
+  {
+    visible[word_idx] = 0;
+  }
+  pvs_run_phase(jobs, PvsPhase_Gather, queue);
+
+  os_memory_free(jobs->open_points, (u64)grid->cell_count * sizeof(u64));
+  os_memory_free(jobs->cell_instances, (u64)grid->cell_count * Pvs_RowWords * sizeof(u64));
+  os_memory_free(jobs->cell_visible, (u64)grid->cell_count * jobs->cell_words * sizeof(u64));
+  os_memory_free(jobs, sizeof(Pvs_Jobs));
+}
+
+static u32
+pvs_compress_row(u64 *row, u32 instance_count, u8 *dest)
+{
+  u8 *bytes     = (u8 *)row;
+  u32 row_bytes = (instance_count + 7) / 8;
+  u32 result    = 0;
+  for (u32 byte_idx = 0; byte_idx < row_bytes;)
+  {
+    u8 value = bytes[byte_idx];
+    if ((value == 0x00) || (value == 0xFF))
+    {
+      u32 run = 1;
+      while ((byte_idx + run < row_bytes) && (bytes[byte_idx + run] == value) && (run < 255))
+      {
+        ++run;
+      }
+      dest[result++] = value;
+      dest[result++] = (u8)run;
+      byte_idx      += run;
+    }
+    else
+    {
+      dest[result++] = value;
+      ++byte_idx;
+    }
+  }
+
+  return(result);
+}
+
+static b32
+pvs_decompress_row(u8 *src, u32 size, u32 instance_count, u64 *row)
+{
+  u8 *bytes     = (u8 *)row;
+  u32 row_bytes = (instance_count + 7) / 8;
+  for (u32 word_idx = 0; word_idx < Pvs_RowWords; ++word_idx)
+  {
+    row[word_idx] = 0;
+  }
+
+  u32 out = 0;
+  for (u32 src_idx = 0; src_idx < size;)
+  {
+    u8 value = src[src_idx++];
+    u32 run  = 1;
+    if ((value == 0x00) || (value == 0xFF))
+    {
+      if (src_idx == size)
+      {
+        return(false);
+      }
+      run = src[src_idx++];
+    }
+
+    if (!run || (out + run > row_bytes))
+    {
+      return(false);
+    }
+    for (u32 repeat = 0; repeat < run; ++repeat)
+    {
+      bytes[out++] = value;
+    }
+  }
+
+  return(out == row_bytes);
+}
+
+static b32
+pvs_row_pays(u64 *row, u32 instance_count, u32 *culled)
+{
+  u32 kept = 0;
+  for (u32 word_idx = 0; word_idx < (instance_count + 63) / 64; ++word_idx)
+  {
+    for (u64 word = row[word_idx]; word; word &= word - 1)
+    {
+      ++kept;
+    }
+  }
+
+  *culled    = instance_count - kept;
+  b32 result = *culled && (*culled * Pvs_MinCullDivisor >= instance_count);
+  return(result);
+}
+
+static u64
+pvs_max_file_size(Pvs_Grid *grid, u32 instance_count)
+{
+  u64 result = sizeof(Pvs_Header) + ((u64)grid->cell_count + 1) * sizeof(u32) + (u64)grid->cell_count * 2 * ((instance_count + 7) / 8);
+  return(result);
+}
+
+static u64
+pvs_encode(u8 *dest, Pvs_Grid *grid, u32 instance_count, u64 *visible)
+{
+  Pvs_Header *header = (Pvs_Header *)dest;
+  *header = (Pvs_Header)
+  {
+    .magic          = Pvs_Magic,
+    .version        = Pvs_Version,
+    .cell_count_x   = grid->cell_count_x,
+    .cell_count_y   = grid->cell_count_y,
+    .cell_count_z   = grid->cell_count_z,
+    .instance_count = instance_count,
+    .origin         = grid->origin,
+    .cell_size      = grid->cell_size,
+  };
+
+  u32 *row_offsets = (u32 *)(header + 1);
+  u8  *rows        = (u8 *)(row_offsets + grid->cell_count + 1);
+  u32  offset      = 0;
+  for (u32 cell_idx = 0; cell_idx < grid->cell_count; ++cell_idx)
+  {
+    u64 *row = visible + (u64)cell_idx * Pvs_RowWords;
+    u32  culled;
+    header->paying_cell_count += pvs_row_pays(row, instance_count, &culled) ? 1 : 0;
+    row_offsets[cell_idx] = offset;
+    offset += pvs_compress_row(row, instance_count, rows + offset);
+  }
+  row_offsets[grid->cell_count] = offset;
+
+  u64 result = (u64)(rows + offset - dest);
+  return(result);
+}
+
+static Pvs_Header *
+pvs_parse(u8 *data, u64 size)
+{
+  Pvs_Header *result = (Pvs_Header *)data;
+  b32 valid = data && (size >= sizeof(Pvs_Header)) &&
+              (result->magic == Pvs_Magic) && (result->version == Pvs_Version) &&
+              (result->cell_count_x - 1 < Pvs_MaxCellsAxis) &&
+              (result->cell_count_y - 1 < Pvs_MaxCellsAxis) &&
+              (result->cell_count_z - 1 < Pvs_MaxCellsAxis) &&
+              (result->cell_count_x * result->cell_count_y * result->cell_count_z <= Pvs_MaxCells) &&
+              (result->instance_count <= MaxSceneInstances) && (result->cell_size > 0.0f) &&
+              (result->paying_cell_count <= result->cell_count_x * result->cell_count_y * result->cell_count_z);
+  if (valid)
+  {
+    u32 cell_count   = result->cell_count_x * result->cell_count_y * result->cell_count_z;
+    u64 rows_at      = sizeof(Pvs_Header) + ((u64)cell_count + 1) * sizeof(u32);
+    u32 *row_offsets = (u32 *)(result + 1);
+    valid = (size >= rows_at) && (row_offsets[0] == 0) && (row_offsets[cell_count] <= size - rows_at);
+    for (u32 cell_idx = 0; valid && (cell_idx < cell_count); ++cell_idx)
+    {
+      u64 row[Pvs_RowWords];
+      valid = (row_offsets[cell_idx] <= row_offsets[cell_idx + 1]) &&
+              pvs_decompress_row(data + rows_at + row_offsets[cell_idx], row_offsets[cell_idx + 1] - row_offsets[cell_idx],
+                                 result->instance_count, row);
+    }
+  }
+
+  return(valid ? result : 0);
+}
+
+static void
+pvs_view_init(Pvs_View *view, Pvs_Header *file)
+{
+  view->file      = file;
+  view->cell       = Pvs_NoCell;
+  view->row_culled = 0;
+  view->row_pays   = false;
+  view->row_loads  = 0;
+  if (file)
+  {
+    view->grid = (Pvs_Grid)
+    {
+      .origin       = file->origin,
+      .cell_size    = file->cell_size,
+      .cell_count_x = file->cell_count_x,
+      .cell_count_y = file->cell_count_y,
+      .cell_count_z = file->cell_count_z,
+      .cell_count   = file->cell_count_x * file->cell_count_y * file->cell_count_z,
+    };
+  }
+}
+
+static b32
+pvs_view_update(Pvs_View *view, v3f p)
+{
+  u32 cell = view->file ? pvs_cell_at(&view->grid, p) : Pvs_NoCell;
+  if ((cell != Pvs_NoCell) && (cell != view->cell))
+  {
+    u32 *row_offsets = (u32 *)(view->file + 1);
+    u8  *rows        = (u8 *)(row_offsets + view->grid.cell_count + 1);
+    // pvs_parse unpacked every row once already
+    pvs_decompress_row(rows + row_offsets[cell], row_offsets[cell + 1] - row_offsets[cell], view->file->instance_count, view->row);
+    view->row_pays = pvs_row_pays(view->row, view->file->instance_count, &view->row_culled);
+    view->cell     = cell;
+    ++view->row_loads;
+  }
+
+  b32 result = (cell != Pvs_NoCell);
+  return(result);
+}
+
+static void
+pvs_cull_scene(u64 *row, Scene_Instances *scene, Scene_Instances *out)
+{
+  out->instance_count = 0;
+  out->batch_count    = 0;
+  for (u32 batch_idx = 0; batch_idx < scene->batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch     = scene->batches + batch_idx;
+    Scene_Batch *out_batch = out->batches + out->batch_count;
+    *out_batch                = *batch;
+    out_batch->first_instance = out->instance_count;
+    out_batch->instance_count = 0;
+    for (u32 instance_idx = batch->first_instance; instance_idx < batch->first_instance + batch->instance_count; ++instance_idx)
+    {
+      if ((instance_idx >= scene->static_instance_count) || (row[instance_idx / 64] & (1ull << (instance_idx % 64))))
+      {
+        out->ins[out->instance_count]  = scene->ins[instance_idx];
+        out->info[out->instance_count] = scene->info[instance_idx];
+        ++out->instance_count;
+        ++out_batch->instance_count;
+      }
+    }
+
+    if (out_batch->instance_count)
+    {
+      ++out->batch_count;
+    }
+  }
+}
@@ -0,0 +1,126 @@
+#if !defined(PVS_H)
+#define PVS_H
+
+// Potentially visible sets: the static scene's bounds cut into cells, and
+// for every cell the static instances that can be seen from somewhere in it,
+// baked offline by tools/pvs_bake.c. The renderer finds the camera's cell
+// and drops the rest before scene_draw_shaded records anything; outside the
+// grid, or where the cell's set drops too little to pay for the copy, nothing
+// is dropped. A file whose cells all drop too little is not loaded at all.
+//
+// A bake first throws out the sample points of each cell that lie inside
+// geometry. Two cells then see each other if any of a few dozen rays from
+// the points of one toward the points of the other, traced against the BVH
+// (bvh.h) four at a time, either gets there or first hits a surface inside
+// the other cell. Neighbouring cells always see each other, and so do cells
+// with no point in the open. A cell's set is every instance whose bounds
+// overlap a cell it or one of its neighbours sees. The sets are sampled with
+// that dilation, not bounded: the neighbours' points stand past the edges a
+// cell's own points miss, but nothing proves a camera there sees no more.
+//
+// A set is a bit per instance, run length coded: a 0x00 or 0xFF byte is
+// followed by how many times it repeats, any other byte stands for itself.
+//
+// Layout of a file:
+//   Pvs_Header
+//   u32 row_offsets[cell_count + 1]  into rows, per cell
+//   u8  rows[]
+//   cells run x fastest, then y, then z
+
+#define Pvs_Magic               0x42535650 // "PVSB"
+#define Pvs_Version             2
+// relative to data/
+#define Pvs_DefaultPath         "visibility.pvs"
+// world units; the blocks are Scene_BlockWidth wide
+#define Pvs_CellSize            8.0f
+#define Pvs_MaxCellsAxis        32
+#define Pvs_MaxCells            4096
+#define Pvs_SamplesPerCell      64
+#define Pvs_MaxRaysPerPair      256
+#define Pvs_NoCell              0xFFFFFFFF
+#define Pvs_RowWords            (MaxSceneInstances / 64)
+// jobs that pull cells until none are left
+#define Pvs_JobCount            64
+// a set is only worth filtering by if it drops at least 1 in this many
+// static instances; below that the copy costs about what the draws save
+#define Pvs_MinCullDivisor      8
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 cell_count_x;
+  u32 cell_count_y;
+  u32 cell_count_z;
+  u32 instance_count;
+  // cells whose set drops enough to filter by; 0 and the file is not loaded
+  u32 paying_cell_count;
+  // the corner of the first cell; cells are cell_size on every side
+  v3f origin;
+  f32 cell_size;
+} Pvs_Header;
+
+typedef struct
+{
+  v3f origin;
+  f32 cell_size;
+  u32 cell_count_x;
+  u32 cell_count_y;
+  u32 cell_count_z;
+  u32 cell_count;
+} Pvs_Grid;
+
+// What a bake sees: the static part of scene through the BVH built from it.
+typedef struct
+{
+  Scene_Instances     *scene;
+  Bvh                 *bvh;
+  // what bvh was built from, to tell front faces from back faces
+  Bvh_Source_Triangle *triangles;
+  // at most Pvs_MaxRaysPerPair
+  u32                  rays_per_pair;
+} Pvs_Bake;
+
+// The set of the cell the camera is in, unpacked when it moves to another.
+typedef struct
+{
+  Pvs_Header *file;
+  Pvs_Grid    grid;
+  // whose set is in row, or Pvs_NoCell
+  u32         cell;
+  u64         row[Pvs_RowWords];
+  // static instances row drops, and whether that is worth filtering by
+  u32         row_culled;
+  b32         row_pays;
+  u32         row_loads;
+} Pvs_View;
+
+// cells cell_size apart covering bounds, made bigger until they fit the caps
+static void        pvs_grid(Pvs_Grid *grid, Bvh_Box bounds, f32 cell_size);
+// Pvs_NoCell outside the grid
+static u32         pvs_cell_at(Pvs_Grid *grid, v3f p);
+// Fills visible with grid->cell_count rows of Pvs_RowWords, a bit per
+// static instance; queue may be 0. The result does not depend on the
+// thread count.
+static void        pvs_bake(Pvs_Bake *bake, Pvs_Grid *grid, u64 *visible, OS_Work_Queue *queue);
+// returns the bytes written, at most twice (instance_count + 7) / 8
+static u32         pvs_compress_row(u64 *row, u32 instance_count, u8 *dest);
+// 0 if src does not unpack to exactly instance_count bits
+static b32         pvs_decompress_row(u8 *src, u32 size, u32 instance_count, u64 *row);
+static u64         pvs_max_file_size(Pvs_Grid *grid, u32 instance_count);
+// returns the bytes written
+static u64         pvs_encode(u8 *dest, Pvs_Grid *grid, u32 instance_count, u64 *visible);
+// Whether row drops at least 1 in Pvs_MinCullDivisor of instance_count, and
+// how many it drops.
+static b32         pvs_row_pays(u64 *row, u32 instance_count, u32 *culled);
+// Validates a file in place, rows included; returns 0 if it is not one.
+static Pvs_Header *pvs_parse(u8 *data, u64 size);
+static void        pvs_view_init(Pvs_View *view, Pvs_Header *file);
+// Returns whether p is in a cell, in which case view->row holds its set
+// and view->row_pays says whether to filter by it.
+static b32         pvs_view_update(Pvs_View *view, v3f p);
+// Copies the static instances of scene that row holds, and every dynamic
+// one, keeping batches and order, as shadow_cull_scene does.
+static void        pvs_cull_scene(u64 *row, Scene_Instances *scene, Scene_Instances *out);
+
+#endif
@@ -0,0 +1,725 @@
+static u32
+reflection_probe_texel_count(void)
+{
+  u32 result = reflection_probe_texel_offset(6, 0);
+  return(result);
+}
+
+static u32
+reflection_probe_texel_offset(u32 face, u32 mip)
+{
+  u32 face_texels = 0;
+  u32 mip_offset  = 0;
+  for (u32 mip_idx = 0; mip_idx < ReflectionProbe_MipCount; ++mip_idx)
+  {
+    u32 size = ReflectionProbe_FaceSize >> mip_idx;
+    if (mip_idx < mip)
+    {
+      mip_offset += size * size;
+    }
+    face_texels += size * size;
+  }
+
+  u32 result = face * face_texels + mip_offset;
+  return(result);
+}
+
+// sc and tc in [-1, 1] as the cube addressing rules name them
+static v3f
+reflection_probe_face_direction(u32 face, f32 u, f32 v)
+{
+  f32 sc = 2.0f * u - 1.0f;
+  f32 tc = 2.0f * v - 1.0f;
+  v3f result = { 0 };
+  switch (face)
+  {
+    case 0: { result = (v3f){ 1.0f, -tc, -sc }; } break;
+    case 1: { result = (v3f){ -1.0f, -tc, sc }; } break;
+    case 2: { result = (v3f){ sc, 1.0f, tc }; } break;
+    case 3: { result = (v3f){ sc, -1.0f, -tc }; } break;
+    case 4: { result = (v3f){ sc, -tc, 1.0f }; } break;
+    case 5: { result = (v3f){ -sc, -tc, -1.0f }; } break;
+    default:
+    {
+      InvalidCodePath();
+    } break;
+  }
+
+  result = v3f_normalized(result);
+  return(result);
+}
+
+static u32
+reflection_probe_direction_face(v3f dir, f32 *u, f32 *v)
+{
+  f32 abs_x = fabsf(dir.x);
+  f32 abs_y = fabsf(dir.y);
+  f32 abs_z = fabsf(dir.z);
+  u32 face  = 0;
+  f32 major = 0.0f, sc = 0.0f, tc = 0.0f;
+  if ((abs_x >= abs_y) && (abs_x >= abs_z))
+  {
+    face  = (dir.x >= 0.0f) ? 0 : 1;
+    major = abs_x;
+    sc    = (dir.x >= 0.0f) ? -dir.z : dir.z;
+    tc    = -dir.y;
+  }
+  else if (abs_y >= abs_z)
+  {
+    face  = (dir.y >= 0.0f) ? 2 : 3;
+    major = abs_y;
+    sc    = dir.x;
+    tc    = (dir.y >= 0.0f) ? dir.z : -dir.z;
+  }
+  else
+  {
+    face  = (dir.z >= 0.0f) ? 4 : 5;
+    major = abs_z;
+    sc    = (dir.z >= 0.0f) ? dir.x : -dir.x;
+    tc    = -dir.y;
+  }
+
+  *u = 0.5f * (sc / major + 1.0f);
+  *v = 0.5f * (tc / major + 1.0f);
+  return(face);
+}
+
+// The shared exponent encoding from the D3D spec: 9 bit mantissas, no
+// implicit one, a 5 bit exponent biased by 15.
+static u32
+reflection_probe_pack_rgb9e5(v3f colour)
+{
+  f32 max_value = 65408.0f;
+  f32 r = Minimum(Maximum(colour.r, 0.0f), max_value);
+  f32 g = Minimum(Maximum(colour.g, 0.0f), max_value);
+  f32 b = Minimum(Maximum(colour.b, 0.0f), max_value);
+  f32 max_channel = Maximum(r, Maximum(g, b));
+
+  u32 result = 0;
+  if (max_channel > 0.0f)
+  {
+    s32 exponent = 0;
+    frexpf(max_channel, &exponent);
+    s32 shared = Maximum(exponent - 1, -16) + 16;
+    f32 denom  = ldexpf(1.0f, shared - 15 - 9);
+    if ((u32)floorf(max_channel / denom + 0.5f) == 512)
+    {
+      denom *= 2.0f;
+      ++shared;
+    }
+
+    u32 r_bits = (u32)floorf(r / denom + 0.5f);
+    u32 g_bits = (u32)floorf(g / denom + 0.5f);
+    u32 b_bits = (u32)floorf(b / denom + 0.5f);
+    result = r_bits | (g_bits << 9) | (b_bits << 18) | ((u32)shared << 27);
+  }
+
+  return(result);
+}
+
+static v3f
+reflection_probe_unpack_rgb9e5(u32 packed)
+{
+  f32 scale  = ldexpf(1.0f, (s32)(packed >> 27) - 15 - 9);
+  v3f result =
+  {
+    (f32)(packed & 0x1FF) * scale,
+    (f32)((packed >> 9) & 0x1FF) * scale,
+    (f32)((packed >> 18) & 0x1FF) * scale,
+  };
+
+  return(result);
+}
+
+static u32
+reflection_probe_gather(Scene_Instances *scene, Reflection_Probe *probes)
+{
+  u32 result = 0;
+  for (u32 instance_idx = 0; instance_idx < scene->static_instance_count; ++instance_idx)
+  {
+    u32 probe_idx = scene->ins[instance_idx].reflection_probe;
+    if (probe_idx < ReflectionProbe_MaxProbes)
+    {
+      probes[probe_idx] = (Reflection_Probe){ .p = scene->ins[instance_idx].p };
+      result = Maximum(result, probe_idx + 1);
+    }
+  }
+
+  return(result);
+}
+
+// M^-1 is the transpose of the inverse transpose scene_add_instance keeps
+static v3f
+reflection_probe_mul_transpose(m33 a, v3f b)
+{
+  v3f result = v3f_add(v3f_add(v3f_scale(b.x, a.r[0]), v3f_scale(b.y, a.r[1])), v3f_scale(b.z, a.r[2]));
+  return(result);
+}
+
+// Intersections in model space, where the meshes are the SceneCube_*,
+// SceneCylinder_* and SceneSphere_* shapes around the origin. d is not unit
+// length, so t stays the world ray's parameter.
+static b32
+reflection_probe_hit_sphere(v3f o, v3f d, f32 t_min, f32 *t, v3f *normal)
+{
+  f32 a    = v3f_inner(d, d);
+  f32 b    = v3f_inner(o, d);
+  f32 c    = v3f_inner(o, o) - SceneSphere_Radius * SceneSphere_Radius;
+  f32 disc = b * b - a * c;
+  b32 result = false;
+  if (disc >= 0.0f)
+  {
+    f32 root = sqrtf(disc);
+    f32 t_hit = (-b - root) / a;
+    if (t_hit < t_min)
+    {
+      t_hit = (-b + root) / a;
+    }
+
+    if ((t_hit >= t_min) && (t_hit < *t))
+    {
+      *t      = t_hit;
+      *normal = v3f_add(o, v3f_scale(t_hit, d));
+      result  = true;
+    }
+  }
+
+  return(result);
+}
+
+static b32
+reflection_probe_hit_box(v3f o, v3f d, f32 t_min, f32 *t, v3f *normal)
+{
+  f32 t_near = -1e30f, t_far = 1e30f;
+  u32 near_axis = 0, far_axis = 0;
+  b32 result = true;
+  for (u32 axis = 0; (axis < 3) && result; ++axis)
+  {
+    if (fabsf(d.v[axis]) < 1e-12f)
+    {
+      result = (fabsf(o.v[axis]) <= SceneCube_HalfExtent);
+    }
+    else
+    {
+      f32 t0 = (-SceneCube_HalfExtent - o.v[axis]) / d.v[axis];
+      f32 t1 = (SceneCube_HalfExtent - o.v[axis]) / d.v[axis];
+      if (t0 > t1)
+      {
+        f32 swap = t0;
+        t0 = t1;
+        t1 = swap;
+      }
+
+      if (t0 > t_near)
+      {
+        t_near    = t0;
+        near_axis = axis;
+      }
+
+      if (t1 < t_far)
+      {
+        t_far    = t1;
+        far_axis = axis;
+      }
+      result = (t_near <= t_far);
+    }
+  }
+
+  if (result)
+  {
+    // from inside the box the exit face is the hit
+    u32 axis  = near_axis;
+    f32 t_hit = t_near;
+    if (t_hit < t_min)
+    {
+      axis  = far_axis;
+      t_hit = t_far;
+    }
+
+    result = (t_hit >= t_min) && (t_hit < *t);
+    if (result)
+    {
+      v3f p    = v3f_add(o, v3f_scale(t_hit, d));
+      *t       = t_hit;
+      *normal  = v3f_zero();
+      normal->v[axis] = (p.v[axis] >= 0.0f) ? 1.0f : -1.0f;
+    }
+  }
+
+  return(result);
+}
+
+static b32
+reflection_probe_hit_cylinder(v3f o, v3f d, f32 t_min, f32 *t, v3f *normal)
+{
+  f32 radius      = SceneCylinder_Radius;
+  f32 half_height = 0.5f * SceneCylinder_Height;
+  b32 result      = false;
+
+  f32 a = d.x * d.x + d.z * d.z;
+  f32 b = o.x * d.x + o.z * d.z;
+  f32 c = o.x * o.x + o.z * o.z - radius * radius;
+  f32 disc = b * b - a * c;
+  if ((a > 1e-12f) && (disc >= 0.0f))
+  {
+    f32 root = sqrtf(disc);
+    f32 roots[2] = { (-b - root) / a, (-b + root) / a };
+    for (u32 root_idx = 0; root_idx < 2; ++root_idx)
+    {
+      f32 t_hit = roots[root_idx];
+      f32 y     = o.y + t_hit * d.y;
+      if ((t_hit >= t_min) && (t_hit < *t) && (fabsf(y) <= half_height))
+      {
+        *t      = t_hit;
+        *normal = (v3f){ o.x + t_hit * d.x, 0.0f, o.z + t_hit * d.z };
+        result  = true;
+      }
+    }
+  }
+
+  if (fabsf(d.y) > 1e-12f)
+  {
+    for (s32 side = -1; side <= 1; side += 2)
+    {
+      f32 t_hit = ((f32)side * half_height - o.y) / d.y;
+      f32 x     = o.x + t_hit * d.x;
+      f32 z     = o.z + t_hit * d.z;
+      if ((t_hit >= t_min) && (t_hit < *t) && (x * x + z * z <= radius * radius))
+      {
+        *t      = t_hit;
+        *normal = (v3f){ 0.0f, (f32)side, 0.0f };
+        result  = true;
+      }
+    }
+  }
+
+  return(result);
+}
+
+static b32
+reflection_probe_trace_any(Scene_Instances *scene, v3f origin, v3f dir, f32 t_max, u32 skip_probe, b32 casters_only, b32 any_hit,
+                           Reflection_Hit *hit)
+{
+  f32 t_min  = ReflectionProbe_RayEpsilon;
+  b32 result = false;
+  hit->t     = t_max;
+  for (u32 batch_idx = 0; (batch_idx < scene->static_batch_count) && !(result && any_hit); ++batch_idx)
+  {
+    Scene_Batch *batch = scene->batches + batch_idx;
+    u32 instance_end   = batch->first_instance + batch->instance_count;
+    if (batch_idx == scene->static_batch_count - 1)
+    {
+      instance_end = batch->first_instance + scene->static_last_batch_instance_count;
+    }
+
+    for (u32 instance_idx = batch->first_instance; (instance_idx < instance_end) && !(result && any_hit); ++instance_idx)
+    {
+      Model_Instance      *instance = scene->ins + instance_idx;
+      Scene_Instance_Info *info     = scene->info + instance_idx;
+      if (((skip_probe != ReflectionProbe_None) && (instance->reflection_probe == skip_probe)) ||
+          (casters_only && !instance->casts_shadow))
+      {
+        continue;
+      }
+
+      // bounding sphere first; dir is unit length
+      v3f to_center = v3f_sub(info->bound_p, origin);
+      f32 along     = v3f_inner(to_center, dir);
+      f32 miss      = v3f_inner(to_center, to_center) - along * along;
+      f32 radius_sq = info->bound_radius * info->bound_radius;
+      if ((miss > radius_sq) || (along + info->bound_radius < t_min) || (along - info->bound_radius > hit->t))
+      {
+        continue;
+      }
+
+      v3f o = reflection_probe_mul_transpose(instance->model_to_world_xform_it, v3f_sub(origin, instance->p));
+      v3f d = reflection_probe_mul_transpose(instance->model_to_world_xform_it, dir);
+      v3f normal;
+      b32 hit_instance = false;
+      switch (batch->model)
+      {
+        case SceneModel_Cube:
+        {
+          hit_instance = reflection_probe_hit_box(o, d, t_min, &hit->t, &normal);
+        } break;
+
+        case SceneModel_Cylinder:
+        {
+          hit_instance = reflection_probe_hit_cylinder(o, d, t_min, &hit->t, &normal);
+        } break;
+
+        case SceneModel_Sphere:
+        {
+          hit_instance = reflection_probe_hit_sphere(o, d, t_min, &hit->t, &normal);
+        } break;
+
+        default:
+        {
+          InvalidCodePath();
+        } break;
+      }
+
+      if (hit_instance)
+      {
+        hit->instance_idx = instance_idx;
+        hit->normal       = v3f_normalized(m33_mul_v3f(instance->model_to_world_xform_it, normal));
+        result            = true;
+      }
+    }
+  }
+
+  return(result);
+}
+
+static b32
+reflection_probe_trace(Scene_Instances *scene, v3f origin, v3f dir, f32 t_max, u32 skip_probe, Reflection_Hit *hit)
+{
+  b32 result = reflection_probe_trace_any(scene, origin, dir, t_max, skip_probe, false, false, hit);
+  return(result);
+}
+
+static f32
+reflection_probe_saturate(f32 value)
+{
+  f32 result = Minimum(Maximum(value, 0.0f), 1.0f);
+  return(result);
+}
+
+static v3f
+reflection_probe_saturate_v3f(v3f value)
+{
+  v3f result = { reflection_probe_saturate(value.x), reflection_probe_saturate(value.y), reflection_probe_saturate(value.z) };
+  return(result);
+}
+
+// ps_main's lighting without the clustered lights: ambient, then each
+// directional light with its specular term, darkened to 0.4 in shadow
+static v3f
+reflection_probe_shade(Reflection_Bake *bake, v3f origin, v3f dir, u32 skip_probe)
+{
+  Reflection_Hit hit;
+  v3f result = bake->sky;
+  if (reflection_probe_trace(bake->scene, origin, dir, 1e30f, skip_probe, &hit))
+  {
+    Model_Instance *instance = bake->scene->ins + hit.instance_idx;
+    Material_Type   material = bake->scene->info[hit.instance_idx].material;
+    v3f albedo = { instance->colour.r, instance->colour.g, instance->colour.b };
+    if (material != MaterialType_None)
+    {
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        albedo.v[channel] *= bake->material_albedo[material].v[channel];
+      }
+    }
+
+    result = albedo;
+    if (instance->enable_lighting)
+    {
+      v3f p      = v3f_add(origin, v3f_scale(hit.t, dir));
+      v3f N      = (v3f_inner(hit.normal, dir) > 0.0f) ? v3f_scale(-1.0f, hit.normal) : hit.normal;
+      v3f to_eye = v3f_scale(-1.0f, dir);
+      v3f lit    = v3f_zero();
+      for (u32 light_idx = 0; light_idx < bake->light_count; ++light_idx)
+      {
+        Light *light = bake->lights + light_idx;
+        Assert(light->type == LightType_Directional);
+
+        v3f L       = v3f_normalized(light->dir);
+        v3f H       = v3f_normalized(v3f_sub(to_eye, L));
+        f32 n_dot_l = Maximum(-v3f_inner(N, L), 0.0f);
+        f32 r_dot_v = Maximum(v3f_inner(N, H), 0.0f);
+        f32 shadow  = 1.0f;
+        if (instance->receives_shadow)
+        {
+          Reflection_Hit blocker;
+          v3f shadow_origin = v3f_add(p, v3f_scale(ReflectionProbe_RayEpsilon, N));
+          if (reflection_probe_trace_any(bake->scene, shadow_origin, v3f_scale(-1.0f, L), 1e30f, ReflectionProbe_None, true, true, &blocker))
+          {
+            shadow = 0.4f;
+          }
+        }
+
+        f32 specular = 0.5f * powf(r_dot_v, 8.0f);
+        for (u32 channel = 0; channel < 3; ++channel)
+        {
+          f32 intensity   = light->intensity.v[channel];
+          lit.v[channel] += (intensity * n_dot_l * albedo.v[channel] + specular * intensity) * shadow;
+        }
+        lit = reflection_probe_saturate_v3f(lit);
+      }
+
+      result = reflection_probe_saturate_v3f(v3f_add(v3f_scale(0.1f, albedo), lit));
+    }
+  }
+
+  return(result);
+}
+
+typedef struct
+{
+  Reflection_Bake *bake;
+  u32              probe_idx;
+  v3f              p;
+  v3f             *cube;
+  // box filtered copies of mip 0 the prefilter reads from
+  v3f             *chain;
+  u32              face;
+  u32              mip;
+  u32              row_begin;
+  u32              row_end;
+} Reflection_Probe_Job;
+
+static void
+reflection_probe_capture_job(void *data)
+{
+  Reflection_Probe_Job *job = (Reflection_Probe_Job *)data;
+  u32 size  = ReflectionProbe_FaceSize;
+  v3f *dest = job->cube + reflection_probe_texel_offset(job->face, 0);
+  f32 weight = 1.0f / (f32)(ReflectionProbe_Supersample * ReflectionProbe_Supersample);
+  for (u32 y = job->row_begin; y < job->row_end; ++y)
+  {
+    for (u32 x = 0; x < size; ++x)
+    {
+      v3f sum = v3f_zero();
+      for (u32 sub_y = 0; sub_y < ReflectionProbe_Supersample; ++sub_y)
+      {
+        for (u32 sub_x = 0; sub_x < ReflectionProbe_Supersample; ++sub_x)
+        {
+          f32 u   = ((f32)x + ((f32)sub_x + 0.5f) / ReflectionProbe_Supersample) / (f32)size;
+          f32 v   = ((f32)y + ((f32)sub_y + 0.5f) / ReflectionProbe_Supersample) / (f32)size;
+          v3f dir = reflection_probe_face_direction(job->face, u, v);
+          sum     = v3f_add(sum, reflection_probe_shade(job->bake, job->p, dir, job->probe_idx));
+        }
+      }
+
+      dest[y * size + x] = v3f_scale(weight, sum);
+    }
+  }
+}
+
+// bilinear within a face, clamped at its edges
+static v3f
+reflection_probe_sample_face(v3f *cube, u32 face, u32 mip, f32 u, f32 v)
+{
+  u32 size  = ReflectionProbe_FaceSize >> mip;
+  v3f *texels = cube + reflection_probe_texel_offset(face, mip);
+  f32 x = Minimum(Maximum(u * (f32)size - 0.5f, 0.0f), (f32)(size - 1));
+  f32 y = Minimum(Maximum(v * (f32)size - 0.5f, 0.0f), (f32)(size - 1));
+  u32 x0 = (u32)x, y0 = (u32)y;
+  u32 x1 = Minimum(x0 + 1, size - 1);
+  u32 y1 = Minimum(y0 + 1, size - 1);
+  f32 t_x = x - (f32)x0, t_y = y - (f32)y0;
+
+  v3f top    = v3f_add(v3f_scale(1.0f - t_x, texels[y0 * size + x0]), v3f_scale(t_x, texels[y0 * size + x1]));
+  v3f bottom = v3f_add(v3f_scale(1.0f - t_x, texels[y1 * size + x0]), v3f_scale(t_x, texels[y1 * size + x1]));
+  v3f result = v3f_add(v3f_scale(1.0f - t_y, top), v3f_scale(t_y, bottom));
+  return(result);
+}
+
+static v3f
+reflection_probe_sample(v3f *cube, v3f dir, f32 level)
+{
+  f32 u, v;
+  u32 face   = reflection_probe_direction_face(dir, &u, &v);
+  level      = Minimum(Maximum(level, 0.0f), (f32)(ReflectionProbe_MipCount - 1));
+  u32 mip0   = (u32)level;
+  u32 mip1   = Minimum(mip0 + 1, ReflectionProbe_MipCount - 1);
+  f32 t      = level - (f32)mip0;
+  v3f result = v3f_add(v3f_scale(1.0f - t, reflection_probe_sample_face(cube, face, mip0, u, v)),
+                       v3f_scale(t, reflection_probe_sample_face(cube, face, mip1, u, v)));
+  return(result);
+}
+
+static f32
+reflection_probe_radical_inverse(u32 bits)
+{
+  bits = (bits << 16) | (bits >> 16);
+  bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+  bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+  bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+  bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+  return((f32)bits * 2.3283064365386963e-10f);
+}
+
+// GGX importance sampled with N = V = R, each sample read from the box
+// chain at the level whose texels cover its share of the lobe, so a few
+// samples give a smooth result (filtered importance sampling)
+static void
+reflection_probe_prefilter_job(void *data)
+{
+  Reflection_Probe_Job *job = (Reflection_Probe_Job *)data;
+  u32 size      = ReflectionProbe_FaceSize >> job->mip;
+  v3f *dest     = job->cube + reflection_probe_texel_offset(job->face, job->mip);
+  f32 roughness = (f32)job->mip / (f32)(ReflectionProbe_MipCount - 1);
+  f32 alpha     = roughness * roughness;
+  f32 alpha_sq  = alpha * alpha;
+  f32 texel_solid_angle = 4.0f * PIF32 / (6.0f * ReflectionProbe_FaceSize * ReflectionProbe_FaceSize);
+  for (u32 y = 0; y < size; ++y)
+  {
+    for (u32 x = 0; x < size; ++x)
+    {
+      v3f N       = reflection_probe_face_direction(job->face, ((f32)x + 0.5f) / (f32)size, ((f32)y + 0.5f) / (f32)size);
+      v3f up      = (fabsf(N.y) < 0.999f) ? (v3f){ 0.0f, 1.0f, 0.0f } : (v3f){ 1.0f, 0.0f, 0.0f };
+      v3f tangent = v3f_normalized(v3f_cross(up, N));
+      v3f bitangent = v3f_cross(N, tangent);
+
+      v3f sum    = v3f_zero();
+      f32 weight = 0.0f;
+      for (u32 sample_idx = 0; sample_idx < ReflectionProbe_FilterSamples; ++sample_idx)
+      {
+        f32 xi_x      = (f32)sample_idx / (f32)ReflectionProbe_FilterSamples;
+        f32 xi_y      = reflection_probe_radical_inverse(sample_idx);
+        f32 phi       = 2.0f * PIF32 * xi_x;
+        f32 cos_theta = sqrtf((1.0f - xi_y) / (1.0f + (alpha_sq - 1.0f) * xi_y));
+        f32 sin_theta = sqrtf(Maximum(1.0f - cos_theta * cos_theta, 0.0f));
+        v3f H = v3f_add(v3f_add(v3f_scale(sin_theta * cosf(phi), tangent), v3f_scale(sin_theta * sinf(phi), bitangent)),
+                        v3f_scale(cos_theta, N));
+        v3f L       = v3f_sub(v3f_scale(2.0f * cos_theta, H), N);
+        f32 n_dot_l = v3f_inner(N, L);
+        if (n_dot_l > 0.0f)
+        {
+          f32 d_denom = cos_theta * cos_theta * (alpha_sq - 1.0f) + 1.0f;
+          f32 pdf     = alpha_sq / (4.0f * PIF32 * d_denom * d_denom);
+          f32 sample_solid_angle = 1.0f / ((f32)ReflectionProbe_FilterSamples * pdf);
+          f32 level   = 0.5f * log2f(sample_solid_angle / texel_solid_angle) + 1.0f;
+          sum         = v3f_add(sum, v3f_scale(n_dot_l, reflection_probe_sample(job->chain, L, level)));
+          weight     += n_dot_l;
+        }
+      }
+
+      dest[y * size + x] = v3f_scale(1.0f / weight, sum);
+    }
+  }
+}
+
+static void
+reflection_probe_bake(Reflection_Bake *bake, u32 probe_idx, v3f p, v3f *cube, OS_Work_Queue *queue)
+{
+  u32 texel_count = reflection_probe_texel_count();
+  u64 chain_size  = texel_count * sizeof(v3f);
+  v3f *chain      = (v3f *)os_memory_alloc(chain_size);
+
+  // mip 0 in bands of rows, so the threads share the busy faces
+  Reflection_Probe_Job jobs[6 * 8];
+  u32 band_rows = ReflectionProbe_FaceSize / 8;
+  u32 job_count = 0;
+  for (u32 face = 0; face < 6; ++face)
+  {
+    for (u32 row = 0; row < ReflectionProbe_FaceSize; row += band_rows)
+    {
+      jobs[job_count] = (Reflection_Probe_Job){ bake, probe_idx, p, cube, chain, face, 0, row, row + band_rows };
+      if (queue)
+      {
+        os_work_queue_add(queue, reflection_probe_capture_job, jobs + job_count);
+      }
+      else
+      {
+        reflection_probe_capture_job(jobs + job_count);
+      }
+      ++job_count;
+    }
+  }
+
+  if (queue)
+  {
+    os_work_queue_complete_all(queue);
+  }
+
+  // the box chain: mip 0 as traced, then 2x2 averages
+  for (u32 face = 0; face < 6; ++face)
+  {
+    u32 base = reflection_probe_texel_offset(face, 0);
+    for (u32 texel = 0; texel < ReflectionProbe_FaceSize * ReflectionProbe_FaceSize; ++texel)
+    {
+      chain[base + texel] = cube[base + texel];
+    }
+
+    for (u32 mip = 1; mip < ReflectionProbe_MipCount; ++mip)
+    {
+      u32 size   = ReflectionProbe_FaceSize >> mip;
+      v3f *above = chain + reflection_probe_texel_offset(face, mip - 1);
+      v3f *dest  = chain + reflection_probe_texel_offset(face, mip);
+      for (u32 y = 0; y < size; ++y)
+      {
+        for (u32 x = 0; x < size; ++x)
+        {
+          u32 above_size = 2 * size;
+          v3f sum = v3f_add(v3f_add(above[(2 * y) * above_size + 2 * x], above[(2 * y) * above_size + 2 * x + 1]),
+                            v3f_add(above[(2 * y + 1) * above_size + 2 * x], above[(2 * y + 1) * above_size + 2 * x + 1]));
+          dest[y * size + x] = v3f_scale(0.25f, sum);
+        }
+      }
+    }
+  }
+
+  // roughness 0 is the mirror, mip 0 itself
+  job_count = 0;
+  for (u32 face = 0; face < 6; ++face)
+  {
+    for (u32 mip = 1; mip < ReflectionProbe_MipCount; ++mip)
+    {
+      jobs[job_count] = (Reflection_Probe_Job){ bake, probe_idx, p, cube, chain, face, mip, 0, 0 };
+      if (queue)
+      {
+        os_work_queue_add(queue, reflection_probe_prefilter_job, jobs + job_count);
+      }
+      else
+      {
+        reflection_probe_prefilter_job(jobs + job_count);
+      }
+      ++job_count;
+    }
+  }
+
+  if (queue)
+  {
+    os_work_queue_complete_all(queue);
+  }
+
+  os_memory_free(chain, chain_size);
+}
+
+static u64
+reflection_probe_file_size(u32 probe_count)
+{
+  u64 result = sizeof(Reflection_Probe_Header) + (u64)probe_count * reflection_probe_texel_count() * sizeof(u32);
+  return(result);
+}
+
+static void
+reflection_probe_encode(u8 *dest, Reflection_Probe *probes, u32 probe_count, v3f *cubes)
+{
+  Assert(probe_count <= ReflectionProbe_MaxProbes);
+  Reflection_Probe_Header *header = (Reflection_Probe_Header *)dest;
+  *header = (Reflection_Probe_Header)
+  {
+    .magic       = ReflectionProbe_Magic,
+    .version     = ReflectionProbe_Version,
+    .probe_count = probe_count,
+    .face_size   = ReflectionProbe_FaceSize,
+    .mip_count   = ReflectionProbe_MipCount,
+  };
+
+  for (u32 probe_idx = 0; probe_idx < probe_count; ++probe_idx)
+  {
+    header->probes[probe_idx] = probes[probe_idx];
+  }
+
+  u32 *texels      = (u32 *)(header + 1);
+  u32  texel_count = probe_count * reflection_probe_texel_count();
+  for (u32 texel = 0; texel < texel_count; ++texel)
+  {
+    texels[texel] = reflection_probe_pack_rgb9e5(cubes[texel]);
+  }
+}
+
+static Reflection_Probe_Header *
+reflection_probe_parse(u8 *data, u64 size)
+{
+  Reflection_Probe_Header *result = (Reflection_Probe_Header *)data;
+  b32 valid = data && (size >= sizeof(Reflection_Probe_Header)) &&
+              (result->magic == ReflectionProbe_Magic) && (result->version == ReflectionProbe_Version) &&
+              (result->face_size == ReflectionProbe_FaceSize) && (result->mip_count == ReflectionProbe_MipCount) &&
+              (result->probe_count <= ReflectionProbe_MaxProbes) && (size >= reflection_probe_file_size(result->probe_count));
+  return(valid ? result : 0);
+}
@@ -0,0 +1,95 @@
+#if !defined(REFLECTION_PROBE_H)
+#define REFLECTION_PROBE_H
+
+// Reflection probes, baked offline by tools/reflection_bake.c. Each one is
+// the static scene ray traced into a cubemap from the centre of the instance
+// that reflects it, lit the way ps_main lights it (ambient, the directional
+// light and its shadows), so no pass renders reflections at runtime. Mip m
+// is that cube prefiltered with a GGX lobe of roughness
+// m / (ReflectionProbe_MipCount - 1), and ps_main reads the mip matching an
+// instance's reflection_roughness.
+//
+// Texels are DXGI_FORMAT_R9G9B9E5_SHAREDEXP, laid out the way
+// CreateTexture2D takes a TextureCubeArray: per probe, per face in the order
+// +x -x +y -y +z -z, every mip.
+//
+// Layout of a file:
+//   Reflection_Probe_Header
+//   u32 texels[probe_count * reflection_probe_texel_count()]
+
+#define ReflectionProbe_Magic         0x424F5250 // "PROB"
+#define ReflectionProbe_Version       1
+#define ReflectionProbe_FaceSize      64
+#define ReflectionProbe_MipCount      5
+#define ReflectionProbe_MaxProbes     8
+// relative to data/
+#define ReflectionProbe_DefaultPath   "reflection_probes.rpb"
+// rays per mip 0 texel along each axis
+#define ReflectionProbe_Supersample   2
+// GGX samples per prefiltered texel
+#define ReflectionProbe_FilterSamples 128
+// ray origins are pushed this far off a surface before tracing on
+#define ReflectionProbe_RayEpsilon    1e-3f
+
+typedef struct
+{
+  v3f p;
+  f32 _pad_a;
+} Reflection_Probe;
+
+typedef struct
+{
+  u32              magic;
+  u32              version;
+  u32              probe_count;
+  u32              face_size;
+  u32              mip_count;
+  u32              _pad_a[3];
+  Reflection_Probe probes[ReflectionProbe_MaxProbes];
+} Reflection_Probe_Header;
+
+// What a bake sees: the static part of scene, with untextured instances in
+// their own colour and textured ones in their colour times the material's
+// average albedo. Rays that leave the scene return sky.
+typedef struct
+{
+  Scene_Instances *scene;
+  // directional only; the point and spot lights all move
+  Light           *lights;
+  u32              light_count;
+  v3f              material_albedo[MaterialType_Count];
+  v3f              sky;
+} Reflection_Bake;
+
+typedef struct
+{
+  f32 t;
+  u32 instance_idx;
+  v3f normal;
+} Reflection_Hit;
+
+// texels in one probe, every face and mip
+static u32  reflection_probe_texel_count(void);
+static u32  reflection_probe_texel_offset(u32 face, u32 mip);
+// uv in [0, 1] on a face to a unit direction, and back
+static v3f  reflection_probe_face_direction(u32 face, f32 u, f32 v);
+static u32  reflection_probe_direction_face(v3f dir, f32 *u, f32 *v);
+static u32  reflection_probe_pack_rgb9e5(v3f colour);
+static v3f  reflection_probe_unpack_rgb9e5(u32 packed);
+// what g_reflection_probes.SampleLevel returns from one cube
+static v3f  reflection_probe_sample(v3f *cube, v3f dir, f32 level);
+// one probe per instance naming one, at its centre; returns how many
+static u32  reflection_probe_gather(Scene_Instances *scene, Reflection_Probe *probes);
+// nearest static instance along the ray, skipping those that reflect skip_probe
+static b32  reflection_probe_trace(Scene_Instances *scene, v3f origin, v3f dir, f32 t_max, u32 skip_probe, Reflection_Hit *hit);
+static v3f  reflection_probe_shade(Reflection_Bake *bake, v3f origin, v3f dir, u32 skip_probe);
+// Fills cube (reflection_probe_texel_count() texels) for probe probe_idx,
+// tracing mip 0 and prefiltering the rest; queue may be 0.
+static void reflection_probe_bake(Reflection_Bake *bake, u32 probe_idx, v3f p, v3f *cube, OS_Work_Queue *queue);
+static u64  reflection_probe_file_size(u32 probe_count);
+// cubes holds probe_count baked cubes back to back
+static void reflection_probe_encode(u8 *dest, Reflection_Probe *probes, u32 probe_count, v3f *cubes);
+// Validates a file in place; returns 0 if it is not one.
+static Reflection_Probe_Header *reflection_probe_parse(u8 *data, u64 size);
+
+#endif
@@ -0,0 +1,486 @@
+static Light
+create_directional_light(v3f P, v3f look_P, v4f intensity)
+{
+  Light result =
+  {
+    .P              = P,
+    .type           = LightType_Directional,
+    .intensity      = intensity,
+    .dir            = v3f_sub(look_P, P),
+  };
+
+  return(result);
+}
+
+static Light
+create_point_light(v3f P, v4f intensity, f32 range)
+{
+  Light result =
+  {
+    .P              = P,
+    .type           = LightType_Point,
+    .intensity      = intensity,
+    .range          = range,
+  };
+
+  return(result);
+}
+
+static Light
+create_spot_light(v3f P, v3f look_P, v4f intensity, f32 range, f32 inner_degrees, f32 outer_degrees)
+{
+  Light result =
+  {
+    .P              = P,
+    .type           = LightType_Spot,
+    .intensity      = intensity,
+    .dir            = v3f_normalized(v3f_sub(look_P, P)),
+    .range          = range,
+    .spot_cos_inner = cosf(Radians(inner_degrees)),
+    .spot_cos_outer = cosf(Radians(outer_degrees)),
+  };
+
+  return(result);
+}
+
+static char *
+scene_material_dir(Material_Type material)
+{
+  static char *material_dirs[MaterialType_Count] =
+  {
+    [MaterialType_GrayBrick] = "textures/sloppy-mortar-stone-wall",
+    [MaterialType_OakTrunk]  = "textures/mature-oak-tree",
+  };
+
+  Assert(material < MaterialType_Count);
+  return(material_dirs[material]);
+}
+
+static Light
+scene_directional_light(void)
+{
+  Light result = create_directional_light((v3f){ -5.0f, 25.0f, -5.0f }, (v3f){ 27.5f, 5, 29.5f }, (v4f){ 0.7f, 0.7f, 0.7f, 1.0f });
+  return(result);
+}
+
+static u32
+scene_build_lights(Light *lights, u32 *directional_count)
+{
+  u32 result = 0;
+  lights[result++]   = scene_directional_light();
+  *directional_count = result;
+
+  lights[result++] = create_point_light((v3f){ 40.0f, 10.0f, 3.0f }, (v4f){ 3.0f, 0.0f, 2.0f, 1.0f }, 50.0f);
+
+  // lamps over the platform, placed by scene_animate_lights
+  for (u32 lamp_idx = 0; lamp_idx < Scene_LampCount; ++lamp_idx)
+  {
+    v4f colour = { 0.3f + 0.7f * (f32)(lamp_idx % 3 == 0), 0.3f + 0.7f * (f32)(lamp_idx % 3 == 1), 0.3f + 0.7f * (f32)(lamp_idx % 3 == 2), 1.0f };
+    lights[result++] = create_point_light(v3f_zero(), colour, 6.0f);
+  }
+
+  return(result);
+}
+
+static void
+scene_animate_lights(Light *lights, f32 t)
+{
+  lights[1].P = (v3f){ 40.0f + 18*cosf(t), 10.0f, 40 + 18* sinf(t) };
+  for (u32 lamp_idx = 0; lamp_idx < Scene_LampCount; ++lamp_idx)
+  {
+    f32 lamp_x = ((f32)(lamp_idx % 8) + 0.5f) * (ScenePlatform_BlockCountWidth * Scene_BlockWidth / 8.0f);
+    f32 lamp_z = ((f32)(lamp_idx / 8) + 0.5f) * (ScenePlatform_BlockCountDepth * Scene_BlockWidth / 8.0f);
+    lights[2 + lamp_idx].P = (v3f){ lamp_x, 3.0f + sinf(t * 0.5f + (f32)lamp_idx), lamp_z };
+  }
+}
+
+static f32
+scene_model_bound_radius(Scene_Model model)
+{
+  f32 result = 0.0f;
+  switch (model)
+  {
+    case SceneModel_Cube:
+    {
+      result = sqrtf(3.0f) * SceneCube_HalfExtent;
+    } break;
+
+    case SceneModel_Cylinder:
+    {
+      f32 half_height = 0.5f * SceneCylinder_Height;
+      result = sqrtf(SceneCylinder_Radius * SceneCylinder_Radius + half_height * half_height);
+    } break;
+
+    case SceneModel_Sphere:
+    {
+      result = SceneSphere_Radius;
+    } break;
+
+    default:
+    {
+      InvalidCodePath();
+    } break;
+  }
+
+  return(result);
+}
+
+static v3f
+scene_model_half_extent(Scene_Model model)
+{
+  v3f result = v3f_zero();
+  switch (model)
+  {
+    case SceneModel_Cube:
+    {
+      result = v3f_s(SceneCube_HalfExtent);
+    } break;
+
+    case SceneModel_Cylinder:
+    {
+      result = (v3f){ SceneCylinder_Radius, 0.5f * SceneCylinder_Height, SceneCylinder_Radius };
+    } break;
+
+    case SceneModel_Sphere:
+    {
+      result = v3f_s(SceneSphere_Radius);
+    } break;
+
+    default:
+    {
+      InvalidCodePath();
+    } break;
+  }
+
+  return(result);
+}
+
+static Model_Instance *
+scene_add_instance(Scene_Instances *scene, Scene_Model model, v3f p, v3f scale, m33 rotate, v4f colour, Material_Type material)
+{
+  Assert(scene->instance_count < MaxSceneInstances);
+
+  u32 material_array = SceneBatch_AnyArray;
+  if (material != MaterialType_None)
+  {
+    material_array = scene->material_slots[material].array_idx;
+  }
+
+  Scene_Batch *batch = scene->batch_count ? (scene->batches + scene->batch_count - 1) : 0;
+  b32 fits_batch = batch && (batch->model == model) && (batch->instance_count < MaxModelInstances) &&
+                   ((material_array == SceneBatch_AnyArray) || (batch->material_array == SceneBatch_AnyArray) ||
+                    (batch->material_array == material_array));
+  if (!fits_batch)
+  {
+    Assert(scene->batch_count < MaxSceneBatches);
+    batch = scene->batches + scene->batch_count++;
+    batch->model          = model;
+    batch->material_array = SceneBatch_AnyArray;
+    batch->first_instance = scene->instance_count;
+    batch->instance_count = 0;
+  }
+
+  if (material_array != SceneBatch_AnyArray)
+  {
+    batch->material_array = material_array;
+  }
+
+  ++batch->instance_count;
+
+  u32 instance_idx                  = scene->instance_count++;
+  Model_Instance *result            = scene->ins + instance_idx;
+  Scene_Instance_Info *info         = scene->info + instance_idx;
+
+  result->model_to_world_xform      = m33_mul(m33_make_diag(scale), rotate);
+  result->model_to_world_xform_it   = m33_mul(m33_make_diag((v3f) { 1.0f / scale.x, 1.0f / scale.y, 1.0f / scale.z }), rotate);
+  result->p                         = p;
+  result->colour                    = colour;
+  result->enable_lighting           = 1;
+  result->texture_slice             = TextureSlice_None;
+  result->casts_shadow              = 1;
+  result->receives_shadow           = 1;
+  result->reflection_probe          = ReflectionProbe_None;
+  result->reflection_roughness      = 0.0f;
+  result->lightmap_first_chart      = Lightmap_None;
+  result->ao_first_vertex           = VertexAO_None;
+  if (material != MaterialType_None)
+  {
+    result->texture_slice = scene->material_slots[material].slice;
+  }
+
+  f32 max_scale = Maximum(scale.x, Maximum(scale.y, scale.z));
+
+  info->material      = material;
+  info->bound_p       = p;
+  info->bound_radius  = scene_model_bound_radius(model) * max_scale;
+  return(result);
+}
+
+static void
+scene_build_static(Scene_Instances *scene, Tex_Pack_Slot material_slots[MaterialType_Count], u32 reflection_probe_count)
+{
+  scene->instance_count = 0;
+  scene->batch_count    = 0;
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    scene->material_slots[material] = material_slots[material];
+  }
+
+  f32 scene_width_size      = ((ScenePlatform_BlockCountWidth) * Scene_BlockWidth);
+  f32 scene_depth_size      = ((ScenePlatform_BlockCountDepth) * Scene_BlockWidth);
+
+  // platform
+  for (s32 depth_idx = 0; depth_idx < ScenePlatform_BlockCountDepth; ++depth_idx)
+  {
+    for (s32 width_idx = 0; width_idx < ScenePlatform_BlockCountWidth; ++width_idx)
+    {
+      scene_add_instance(scene, SceneModel_Cube,
+                         (v3f){ (f32)(width_idx) * Scene_BlockWidth, 0.0f, (f32)(depth_idx) * Scene_BlockWidth },
+                         (v3f){ Scene_BlockWidth, Scene_BlockWidth, Scene_BlockWidth },
+                         m33_make_identity(),
+                         (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_GrayBrick);
+    }
+  }
+
+  // "roof"
+  for (s32 line_idx = 0; line_idx < 2; ++line_idx)
+  {
+    for (s32 depth_idx = 0; depth_idx < ScenePlatform_BlockCountDepth; ++depth_idx)
+    {
+      scene_add_instance(scene, SceneModel_Cube,
+                         (v3f)
+                         {
+                           (scene_width_size - Scene_BlockWidth) * line_idx,
+                           9.0f * Scene_BlockWidth,
+                           (f32)(depth_idx) * Scene_BlockWidth
+                         },
+                         (v3f){ Scene_BlockWidth, Scene_BlockWidth, Scene_BlockWidth },
+                         m33_make_identity(),
+                         (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_GrayBrick);
+    }
+  }
+
+  for (s32 line_idx = 0; line_idx <= (ScenePlatform_BlockCountWidth / 8); ++line_idx)
+  {
+    s32 interval      = 4;
+    s32 y_level_min   = 9;
+    s32 y_level_max   = y_level_min + ((ScenePlatform_BlockCountWidth / 2) / interval);
+    s32 y_level       = y_level_min;
+    s32 direction     = 1;
+    for (s32 width_idx = 1; width_idx < (ScenePlatform_BlockCountWidth - 1); ++width_idx)
+    {
+      if ((width_idx % interval) == 0)
+      {
+        y_level += direction;
+        if (y_level >= y_level_max)
+        {
+          direction = -1;
+        }
+      }
+      scene_add_instance(scene, SceneModel_Cube,
+                         (v3f)
+                         {
+                           (f32)width_idx * Scene_BlockWidth,
+                           y_level * Scene_BlockWidth,
+                           (f32)(line_idx) * 8 * Scene_BlockWidth,
+                         },
+                         (v3f){ Scene_BlockWidth, Scene_BlockWidth, Scene_BlockWidth },
+                         m33_make_identity(),
+                         (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_GrayBrick);
+    }
+  }
+
+  // pillars
+  f32 cylinder_diameter     = 2.0f * SceneCylinder_Radius;
+  f32 offset_per_pillar     = (scene_depth_size / cylinder_diameter) / (Scene_PillarCount);
+  f32 total_length_spanned  = (Scene_PillarCount - 1) * cylinder_diameter + offset_per_pillar * (Scene_PillarCount - 1);
+  f32 offset                = (scene_depth_size - total_length_spanned) * 0.5f;
+
+  for (s32 pillar_set_idx = 0; pillar_set_idx < 2; ++pillar_set_idx)
+  {
+    for (s32 pillar_idx = 0; pillar_idx < Scene_PillarCount; ++pillar_idx)
+    {
+      f32 x = (scene_width_size * pillar_set_idx - Scene_BlockWidth * pillar_set_idx);
+      f32 y = 5.0f;
+      f32 z = (f32)pillar_idx * cylinder_diameter + offset_per_pillar * pillar_idx + offset;
+
+      scene_add_instance(scene, SceneModel_Cylinder, (v3f) { x, y + 8.0f, z },
+                         (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_OakTrunk);
+
+      scene_add_instance(scene, SceneModel_Cylinder, (v3f) { x, y + 4.0f, z },
+                         (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_OakTrunk);
+
+      scene_add_instance(scene, SceneModel_Cylinder, (v3f) { x, y, z },
+                         (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_OakTrunk);
+
+      scene_add_instance(scene, SceneModel_Cylinder, (v3f) { x, y - 4.0f, z },
+                         (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_OakTrunk);
+
+      scene_add_instance(scene, SceneModel_Cylinder, (v3f) { x  + (Scene_BlockWidth * 4 * (pillar_set_idx == 0 ? 1 : -1)), 5, z },
+                         (v3f){ 2.0f, 2.0f, 2.0f }, m33_make_identity(), (v4f){ 0.0f, 1.0f, 1.0f, 1.0f }, MaterialType_OakTrunk);
+    }
+  }
+
+  for (s32 pillar_set_idx = 0; pillar_set_idx < 2; ++pillar_set_idx)
+  {
+    for (s32 pillar_idx = 0; pillar_idx < Scene_PillarCount; ++pillar_idx)
+    {
+      scene_add_instance(scene, SceneModel_Sphere,
+                         (v3f)
+                         {
+                           (scene_width_size * pillar_set_idx - Scene_BlockWidth * pillar_set_idx) + (Scene_BlockWidth * 4 * (pillar_set_idx == 0 ? 1 : -1)),
+                           10.0f,
+                           (f32)pillar_idx * cylinder_diameter + offset_per_pillar * pillar_idx + offset
+                         },
+                         (v3f){ 1.0f, 1.0f, 1.0f }, m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_None);
+    }
+  }
+
+  // reflective sphere
+  {
+    f32 sphere_x = scene_width_size * 0.5f;
+    f32 sphere_z = scene_depth_size * 0.5f;
+    Model_Instance *sphere = scene_add_instance(scene, SceneModel_Sphere,
+                                                (v3f)
+                                                {
+                                                  sphere_x,
+                                                  Scene_BlockWidth + 6,
+                                                  sphere_z
+                                                },
+                                                v3f_s(8.0f), m33_make_identity(), (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_None);
+    if (reflection_probe_count > 0)
+    {
+      sphere->reflection_probe      = 0;
+      sphere->reflection_roughness  = 0.1f;
+    }
+  }
+
+  scene->static_instance_count              = scene->instance_count;
+  scene->static_batch_count                 = scene->batch_count;
+  scene->static_last_batch_instance_count   = scene->batch_count ? scene->batches[scene->batch_count - 1].instance_count : 0;
+  ++scene->static_generation;
+}
+
+static void
+scene_begin_dynamic(Scene_Instances *scene)
+{
+  scene->instance_count   = scene->static_instance_count;
+  scene->batch_count      = scene->static_batch_count;
+  if (scene->batch_count)
+  {
+    scene->batches[scene->batch_count - 1].instance_count = scene->static_last_batch_instance_count;
+  }
+}
+
+static void
+scene_add_light_gizmos(Scene_Instances *scene, Light *lights, u32 light_count)
+{
+  for (u32 light_idx = 0; light_idx < light_count; ++light_idx)
+  {
+    Light light = lights[light_idx];
+    Model_Instance *gizmo = scene_add_instance(scene, SceneModel_Sphere, light.P, (v3f){ 0.3f, 0.3f, 0.3f }, m33_make_identity(), light.intensity, MaterialType_None);
+    // the gizmo sits on its own light and would shadow everything around it
+    gizmo->enable_lighting = 0;
+    gizmo->casts_shadow    = 0;
+    gizmo->receives_shadow = 0;
+  }
+}
+
+static void
+scene_init(Scene_State *scene)
+{
+  scene->camera_roam        = false;
+  scene->camera_p           = v3f_zero();
+  scene->camera_rotate_yz   = 90;
+  scene->camera_rotate_xz   = 90;
+  scene->camera_sens        = 6.0f;
+  scene->camera_move_comp   = 8.0f;
+}
+
+static void
+scene_update_camera(Scene_State *scene, Scene_Camera_Input *input, f32 game_update_secs)
+{
+  if (scene->camera_roam)
+  {
+    f32 mouse_delta_x = -(f32)input->cursor_dx * scene->camera_sens * game_update_secs;
+    f32 mouse_delta_y = (f32)input->cursor_dy * scene->camera_sens * game_update_secs;
+
+    scene->camera_rotate_yz += mouse_delta_y;
+    scene->camera_rotate_xz += mouse_delta_x;
+    if (scene->camera_rotate_yz < -179.0f)
+    {
+      scene->camera_rotate_yz = -179.0f;
+    }
+
+    if (scene->camera_rotate_yz > 179.0f)
+    {
+      scene->camera_rotate_yz = 179.0f;
+    }
+
+    if (scene->camera_rotate_yz >= 360.0f)
+    {
+      scene->camera_rotate_xz = 0.0f;
+    }
+
+    if (scene->camera_rotate_xz <= 0.0f)
+    {
+      scene->camera_rotate_xz = 360.0f;
+    }
+  }
+
+  f32 move_comp          = scene->camera_move_comp * game_update_secs;
+  Scene_Camera_View view = scene_camera_view(scene);
+  if (input->moves & SceneMove_Forward)
+  {
+    v3f_add_eq(&scene->camera_p, v3f_scale(move_comp, view.front));
+  }
+
+  if (input->moves & SceneMove_Left)
+  {
+    v3f_sub_eq(&scene->camera_p, v3f_scale(move_comp, view.right));
+  }
+
+  if (input->moves & SceneMove_Back)
+  {
+    v3f_sub_eq(&scene->camera_p, v3f_scale(move_comp, view.front));
+  }
+
+  if (input->moves & SceneMove_Right)
+  {
+    v3f_add_eq(&scene->camera_p, v3f_scale(move_comp, view.right));
+  }
+
+  if (input->moves & SceneMove_Up)
+  {
+    v3f_add_eq(&scene->camera_p, v3f_scale(move_comp, view.up));
+  }
+
+  if (input->moves & SceneMove_Down)
+  {
+    v3f_sub_eq(&scene->camera_p, v3f_scale(move_comp, view.up));
+  }
+}
+
+static Scene_Camera_View
+scene_camera_view(Scene_State *scene)
+{
+  Scene_Camera_View result;
+  f32 xz       = Radians(scene->camera_rotate_xz);
+  f32 yz       = Radians(scene->camera_rotate_yz);
+  v3f temp_up  = (v3f){ 0.0f, 1.0f, 0.0f };
+  result.front = v3f_normalized((v3f){ cosf(xz) * sinf(yz), cosf(yz), sinf(xz) * sinf(yz) });
+
+  f32 scaling  = v3f_inner(temp_up, result.front);
+  result.up    = v3f_normalized(v3f_sub(temp_up, v3f_scale(scaling, result.front)));
+  result.right = v3f_normalized(v3f_cross(result.up, result.front));
+
+  v3f p = scene->camera_p;
+  result.world_to_view = (m44)
+  {
+    result.right.x, result.up.x, result.front.x, 0.0f,
+    result.right.y, result.up.y, result.front.y, 0.0f,
+    result.right.z, result.up.z, result.front.z, 0.0f,
+    -v3f_inner(result.right, p), -v3f_inner(result.up, p), -v3f_inner(result.front, p), 1.0f
+  };
+  return(result);
+}
@@ -0,0 +1,204 @@
+#if !defined(SCENE_H)
+#define SCENE_H
+
+// Directional lights first, then point and spot lights (see light_cluster.h)
+#define MaxLightCount 16384
+typedef u16 Light_Type;
+enum
+{
+  LightType_Directional,
+  LightType_Spot,
+  LightType_Point,
+  LightType_Count,
+};
+
+typedef struct
+{
+  v3f P;
+  u32 type;
+  // ------------- 16 -------------- //
+  v4f intensity;
+  // ------------- 16 -------------- //
+  v3f dir;
+  // point and spot lights fade to nothing at this distance
+  f32 range;
+  // ------------- 16 -------------- //
+  f32 spot_cos_inner;
+  f32 spot_cos_outer;
+  f32 _pad_a[2];
+} Light;
+
+typedef struct
+{
+  m33 model_to_world_xform;
+  m33 model_to_world_xform_it;
+  v3f p;
+  v4f colour;
+  u32 enable_lighting;
+  u32 texture_slice;
+  // drawn into the shadow maps / darkened by them
+  u32 casts_shadow;
+  u32 receives_shadow;
+  // baked cube this instance reflects (see reflection_probe.h), or
+  // ReflectionProbe_None; roughness picks how blurred a mip it reads
+  u32 reflection_probe;
+  f32 reflection_roughness;
+  // first of its charts in the baked lightmap (see lightmap.h), or
+  // Lightmap_None to be lit per pixel
+  u32 lightmap_first_chart;
+  // first of its values in the baked per vertex occlusion (see
+  // vertex_ao.h), or VertexAO_None for none
+  u32 ao_first_vertex;
+} Model_Instance;
+
+#define TextureSlice_None 0xFFFFFFFF
+// set instead of a slice for the material streamed through vtex.h
+#define TextureSlice_VirtualBit 0x80000000
+#define ReflectionProbe_None 0xFFFFFFFF
+#define Lightmap_None 0xFFFFFFFF
+#define VertexAO_None 0xFFFFFFFF
+typedef u32 Material_Type;
+enum
+{
+  MaterialType_GrayBrick,
+  MaterialType_OakTrunk,
+  MaterialType_Count,
+  MaterialType_None = MaterialType_Count,
+};
+
+typedef u32 Scene_Model;
+enum
+{
+  SceneModel_Cube,
+  SceneModel_Cylinder,
+  SceneModel_Sphere,
+  SceneModel_Count,
+};
+
+// Dimensions the generated meshes are built with. Bounds and the
+// renderer's mesh generation both read these.
+#define SceneCube_HalfExtent      0.5f
+#define SceneCylinder_Radius      1.0f
+#define SceneCylinder_Height      4.0f
+#define SceneSphere_Radius        1.0f
+
+#define ScenePlatform_BlockCountDepth 40
+#define ScenePlatform_BlockCountWidth 40
+#define Scene_BlockWidth 2.0f
+#define Scene_PillarCount 9
+
+// point lights over the platform, after the directional and the orbiting one
+#define Scene_LampCount 64
+
+#define Scene_CameraFovDegrees 66.2f
+#define Scene_CameraNear 0.1f
+#define Scene_CameraFar 1000.0f
+
+// The fly camera. Rotations are in degrees: camera_rotate_xz turns it about
+// y and camera_rotate_yz tilts it down from straight up.
+typedef struct
+{
+  b32 camera_roam;
+  v3f camera_p;
+  f32 camera_rotate_yz;
+  f32 camera_rotate_xz;
+  f32 camera_sens;
+  f32 camera_move_comp;
+} Scene_State;
+
+typedef u32 Scene_Move;
+enum
+{
+  SceneMove_Forward = (1 << 0),
+  SceneMove_Left    = (1 << 1),
+  SceneMove_Back    = (1 << 2),
+  SceneMove_Right   = (1 << 3),
+  SceneMove_Up      = (1 << 4),
+  SceneMove_Down    = (1 << 5),
+};
+
+// One frame of what steers the camera: the movement keys held, and how far
+// the cursor moved in pixels with y down, which is 0 unless roaming.
+typedef struct
+{
+  Scene_Move moves;
+  s32        cursor_dx;
+  s32        cursor_dy;
+} Scene_Camera_Input;
+
+// world_to_view is cbuffer0's, row vectors
+typedef struct
+{
+  v3f front;
+  v3f up;
+  v3f right;
+  m44 world_to_view;
+} Scene_Camera_View;
+
+// A run of instances drawn with one model and one material array bin.
+// Untextured instances fit any bin.
+#define SceneBatch_AnyArray 0xFFFFFFFF
+typedef struct
+{
+  Scene_Model model;
+  u32         material_array;
+  u32         first_instance;
+  u32         instance_count;
+} Scene_Batch;
+
+typedef struct
+{
+  Material_Type material;
+  v3f           bound_p;
+  f32           bound_radius;
+} Scene_Instance_Info;
+
+// MaxModelInstances bounds a single batch (the GPU instance buffer size)
+#define MaxModelInstances 2048
+#define MaxSceneInstances 4096
+#define MaxSceneBatches 32
+typedef struct
+{
+  Model_Instance      ins[MaxSceneInstances];
+  Scene_Instance_Info info[MaxSceneInstances];
+  u32                 instance_count;
+
+  Scene_Batch         batches[MaxSceneBatches];
+  u32                 batch_count;
+
+  Tex_Pack_Slot       material_slots[MaterialType_Count];
+
+  // everything before these marks is built once; scene_begin_dynamic rewinds to them
+  u32                 static_instance_count;
+  u32                 static_batch_count;
+  u32                 static_last_batch_instance_count;
+  // bumped whenever the static part changes, for caches built from it
+  u32                 static_generation;
+} Scene_Instances;
+
+static Light           create_directional_light(v3f P, v3f look_P, v4f intensity);
+static Light           create_point_light(v3f P, v4f intensity, f32 range);
+static Light           create_spot_light(v3f P, v3f look_P, v4f intensity, f32 range, f32 inner_degrees, f32 outer_degrees);
+// under data/, holding the material's diffuse, normal and displacement maps
+static char           *scene_material_dir(Material_Type material);
+// the one light that never moves, so probe bakes can use it
+static Light           scene_directional_light(void);
+// The lights of the default scene, directional_count of them directional and
+// first; returns how many. lights holds at least Scene_LampCount + 2.
+static u32             scene_build_lights(Light *lights, u32 *directional_count);
+// moves the lights scene_build_lights made to where they are at time t
+static void            scene_animate_lights(Light *lights, f32 t);
+static f32             scene_model_bound_radius(Scene_Model model);
+// half the model space box around the model
+static v3f             scene_model_half_extent(Scene_Model model);
+static Model_Instance *scene_add_instance(Scene_Instances *scene, Scene_Model model, v3f p, v3f scale, m33 rotate, v4f colour, Material_Type material);
+// instances that want a probe past reflection_probe_count are left without
+static void            scene_build_static(Scene_Instances *scene, Tex_Pack_Slot material_slots[MaterialType_Count], u32 reflection_probe_count);
+static void            scene_begin_dynamic(Scene_Instances *scene);
+// a small unlit sphere on every light, added as dynamic instances
+static void            scene_add_light_gizmos(Scene_Instances *scene, Light *lights, u32 light_count);
+static void            scene_init(Scene_State *scene);
+static void            scene_update_camera(Scene_State *scene, Scene_Camera_Input *input, f32 game_update_secs);
+static Scene_Camera_View scene_camera_view(Scene_State *scene);
+
+#endif
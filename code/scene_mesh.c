@@ -0,0 +1,350 @@
+static Scene_Mesh
+scene_mesh_sphere(f32 radius, u32 quality)
+{
+  Scene_Mesh result = { 0 };
+
+  u32 horizontal = quality * 2;
+  u32 vertical   = quality * 2;
+  f32 theta_step = (2.0f * PIF32) / (f32)horizontal;
+
+  u32             vertex_count        = (vertical + 1) * (horizontal + 1);
+  u32             vertex_index        = 0;
+  Model_Vertex   *vertices            = (Model_Vertex *)os_memory_alloc(vertex_count * sizeof(Model_Vertex));
+
+  u32 index_count   = vertical * horizontal * 6;
+  u32 index_index   = 0;
+  u32 *indices      = (u32 *)os_memory_alloc(index_count * sizeof(u32));
+
+  for (u32 vert = 0; vert < (vertical + 1); ++vert)
+  {
+    for (u32 hori = 0; hori < (horizontal + 1); ++hori)
+    {
+      f32 c = cosf(hori * theta_step);
+      f32 s = sinf(vert * theta_step);
+
+      f32 cc = cosf(vert * theta_step);
+      f32 ss = sinf(hori * theta_step);
+
+      f32 x = c * s;
+      f32 y = cc;
+      f32 z = ss * s;
+      v3f tangent     = { -(f32)hori * ss * s + (f32)vert * c * cc, -(f32)vert * s, (f32)hori * c * s + (f32)vert * ss * cc };
+      v3f normal      = { x, y, z };
+      vertices[vertex_index++] = (Model_Vertex)
+      {
+        .p           = { radius * x, radius * y, radius * z },
+        .uv          = { (f32)hori / (f32)horizontal, (f32)vert / (f32)vertical },
+        .normal      = normal,
+        .tangent     = tangent,
+        .bitangent   = v3f_cross(tangent, normal)
+      };
+    }
+  }
+
+  Assert(vertex_index == vertex_count);
+
+  for (u32 vert = 0; vert < vertical; ++vert)
+  {
+    for (u32 hori = 0; hori < horizontal; ++hori)
+    {
+      indices[index_index++] = (vert + 1) * (horizontal + 1) + (hori + 0);
+      indices[index_index++] = (vert + 0) * (horizontal + 1) + (hori + 0);
+      indices[index_index++] = (vert + 0) * (horizontal + 1) + (hori + 1);
+
+      indices[index_index++] = (vert + 0) * (horizontal + 1) + (hori + 1);
+      indices[index_index++] = (vert + 1) * (horizontal + 1) + (hori + 1);
+      indices[index_index++] = (vert + 1) * (horizontal + 1) + (hori + 0);
+    }
+  }
+
+  Assert(index_index == index_count);
+  result.vertices     = vertices;
+  result.vertex_count = vertex_count;
+  result.indices      = indices;
+  result.index_count  = index_count;
+  result.charts[0]    = (Scene_Mesh_Chart){ 0, index_count };
+  result.chart_count  = 1;
+  return(result);
+}
+
+static Scene_Mesh
+scene_mesh_cylinder(f32 bottom_radius, f32 top_radius, f32 height, u32 slice_count, u32 stack_count)
+{
+  Scene_Mesh result = { 0 };
+
+  f32 stack_height   = height / (f32)stack_count;
+  f32 delta_radius   = (top_radius - bottom_radius) / (f32)stack_count;
+  f32 delta_theta    = (2.0f * PIF32) / (f32)slice_count;
+  u32 ring_count     = stack_count + 1;
+
+  u32             vertex_count    = ring_count * (slice_count + 1) + (slice_count + 1) * 2 + 2;
+  u32             vertex_index    = 0;
+  Model_Vertex   *vertices        = (Model_Vertex *)os_memory_alloc(vertex_count * sizeof(Model_Vertex));
+
+  u32 index_count   = stack_count * slice_count * 6 + slice_count * 6;
+  u32 index_index   = 0;
+  u32 *indices      = (u32 *)os_memory_alloc(index_count * sizeof(u32));
+  for (u32 ring_idx = 0; ring_idx < ring_count; ++ring_idx)
+  {
+    f32 y = -0.5f * height + (f32)ring_idx * stack_height;
+    f32 r = bottom_radius + (f32)ring_idx * delta_radius;
+
+    for (u32 slice_idx = 0; slice_idx <= slice_count; ++slice_idx)
+    {
+      Model_Vertex vertex;
+
+      f32 c = cosf((f32)slice_idx * delta_theta);
+      f32 s = sinf((f32)slice_idx * delta_theta);
+
+      f32 dr           = bottom_radius - top_radius;
+      vertex.p         = (v3f) { r * c, y, r * s };
+      vertex.uv        = (v2f) { (f32)slice_idx / (f32)slice_count, 1.0f - (f32)ring_idx / (f32)stack_count };
+      vertex.tangent   = (v3f) {  -s, 0, c };
+      vertex.bitangent = (v3f) { dr * c, -height, dr * s };
+      vertex.normal    = v3f_cross(vertex.tangent, vertex.bitangent);
+      vertex.lightmap_chart = 0;
+
+      vertices[vertex_index++] = vertex;
+    }
+  }
+
+  u32 start_top_idx = vertex_index;
+  f32 top_y = height * 0.5f;
+  for (u32 slice_idx = 0; slice_idx <= slice_count; ++slice_idx)
+  {
+    f32 x = top_radius * cosf(slice_idx * delta_theta);
+    f32 z = top_radius * sinf(slice_idx * delta_theta);
+
+    Model_Vertex vertex =
+    {
+      .p          = { x, top_y, z },
+      .uv         = { x / height + 0.5f, z / height + 0.5f },
+      .tangent    = { 1.0f, 0.0f, 0.0f },
+      .normal     = { 0.0f, 1.0f, 0.0f },
+      .bitangent  = { 0.0f, 0.0f, 1.0f },
+      .lightmap_chart = 1,
+    };
+
+    vertices[vertex_index++] = vertex;
+  }
+
+  u32 top_center_idx = vertex_index++;
+  vertices[top_center_idx] = (Model_Vertex)
+  {
+    .p           = { 0.0f, top_y, 0.0f },
+    .uv          = { 0.5f, 0.5f },
+    .tangent     = { 1.0f, 0.0f, 0.0f },
+    .normal      = { 0.0f, 1.0f, 0.0f },
+    .bitangent   = { 0.0f, 0.0f, 1.0f },
+    .lightmap_chart = 1,
+  };
+
+  u32 start_bottom_idx = vertex_index;
+  f32 bottom_y = -height * 0.5f;
+  for (u32 slice_idx = 0; slice_idx <= slice_count; ++slice_idx)
+  {
+    f32 x = bottom_radius * cosf(slice_idx * delta_theta);
+    f32 z = bottom_radius * sinf(slice_idx * delta_theta);
+
+    Model_Vertex vertex =
+    {
+      .p          = { x, bottom_y, z },
+      .uv         = { x / height + 0.5f, z / height + 0.5f },
+      .tangent    = { 1.0f, 0.0f, 0.0f },
+      .normal     = { 0.0f, -1.0f, 0.0f },
+      .bitangent  = { 0.0f, 0.0f, -1.0f },
+      .lightmap_chart = 2,
+    };
+
+    vertices[vertex_index++] = vertex;
+  }
+
+  u32 bottom_center_idx = vertex_index++;
+  vertices[bottom_center_idx] = (Model_Vertex)
+  {
+    .p           = { 0.0f, bottom_y, 0.0f },
+    .uv          = { 0.5f, 0.5f },
+    .tangent     = { 1.0f, 0.0f, 0.0f },
+    .normal      = { 0.0f, -1.0f, 0.0f },
+    .bitangent   = { 0.0f, 0.0f, -1.0f },
+    .lightmap_chart = 2,
+  };
+
+  Assert(vertex_index == vertex_count);
+
+  for (u32 stack_idx = 0; stack_idx < stack_count; ++stack_idx)
+  {
+    for (u32 slice_idx = 0; slice_idx < slice_count; ++slice_idx)
+    {
+      indices[index_index++] = (stack_idx + 1) * (slice_count + 1) + (slice_idx + 0);
+      indices[index_index++] = (stack_idx + 0) * (slice_count + 1) + (slice_idx + 0);
+      indices[index_index++] = (stack_idx + 0) * (slice_count + 1) + (slice_idx + 1);
+
+      indices[index_index++] = (stack_idx + 0) * (slice_count + 1) + (slice_idx + 1);
+      indices[index_index++] = (stack_idx + 1) * (slice_count + 1) + (slice_idx + 1);
+      indices[index_index++] = (stack_idx + 1) * (slice_count + 1) + (slice_idx + 0);
+    }
+  }
+
+  for (u32 slice_idx = 0; slice_idx < slice_count; ++slice_idx)
+  {
+    indices[index_index++] = top_center_idx;
+    indices[index_index++] = start_top_idx + slice_idx;
+    indices[index_index++] = start_top_idx + slice_idx + 1;
+  }
+
+  for (u32 slice_idx = 0; slice_idx < slice_count; ++slice_idx)
+  {
+    indices[index_index++] = bottom_center_idx;
+    indices[index_index++] = start_bottom_idx + slice_idx + 1;
+    indices[index_index++] = start_bottom_idx + slice_idx;
+  }
+  Assert(index_index == index_count);
+
+  u32 side_index_count = stack_count * slice_count * 6;
+  u32 cap_index_count  = slice_count * 3;
+  result.vertices     = vertices;
+  result.vertex_count = vertex_count;
+  result.indices      = indices;
+  result.index_count  = index_count;
+  result.charts[0]    = (Scene_Mesh_Chart){ 0, side_index_count };
+  result.charts[1]    = (Scene_Mesh_Chart){ side_index_count, cap_index_count };
+  result.charts[2]    = (Scene_Mesh_Chart){ side_index_count + cap_index_count, cap_index_count };
+  result.chart_count  = 3;
+  return(result);
+}
+
+static Scene_Mesh
+scene_mesh_cube(void)
+{
+  // p <-> tangent <-> bitangent <-> normal <-> uv
+  static f32 vbuffer[] =
+  {
+    // front face
+    -0.5f, +0.5f, -0.5f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         0.0f, 0.0f,
+    -0.5f, -0.5f, -0.5f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         0.0f, 1.0f,
+    +0.5f, -0.5f, -0.5f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         1.0f, 1.0f,
+    +0.5f, +0.5f, -0.5f,      +1.0f, +0.0f, +0.0f,    +0.0f, 1.0f, 0.0f,     +0.0f, +0.0f, -1.0f,         1.0f, 0.0f,
+
+    // right face
+    +0.5f, +0.5f, -0.5f,     +0.0f, +0.0f, +1.0f,     +0.0f, +1.0f, 0.0f,    +1.0f, +0.0f, +0.0f,     0.0f, 0.0f,
+    +0.5f, -0.5f, -0.5f,     +0.0f, +0.0f, +1.0f,     +0.0f, +1.0f, 0.0f,    +1.0f, +0.0f, +0.0f,     0.0f, 1.0f,
+    +0.5f, -0.5f, +0.5f,     +0.0f, +0.0f, +1.0f,     +0.0f, +1.0f, 0.0f,    +1.0f, +0.0f, +0.0f,     1.0f, 1.0f,
+    +0.5f, +0.5f, +0.5f,     +0.0f, +0.0f, +1.0f,     +0.0f, +1.0f, 0.0f,    +1.0f, +0.0f, +0.0f,     1.0f, 0.0f,
+
+    // back face
+    +0.5f, +0.5f, +0.5f,     -1.0f, +0.0f, +0.0f,     +0.0f, +1.0f, +0.0f,   +0.0f, +0.0f, +1.0f,     0.0f, 0.0f,
+    +0.5f, -0.5f, +0.5f,     -1.0f, +0.0f, +0.0f,     +0.0f, +1.0f, +0.0f,   +0.0f, +0.0f, +1.0f,     0.0f, 1.0f,
+    -0.5f, -0.5f, +0.5f,     -1.0f, +0.0f, +0.0f,     +0.0f, +1.0f, +0.0f,   +0.0f, +0.0f, +1.0f,     1.0f, 1.0f,
+    -0.5f, +0.5f, +0.5f,     -1.0f, +0.0f, +0.0f,     +0.0f, +1.0f, +0.0f,   +0.0f, +0.0f, +1.0f,     1.0f, 0.0f,
+
+    // left face
+    -0.5f, +0.5f, +0.5f,     +0.0f, +0.0f, -1.0f,     +0.0f, +1.0f, +0.0f,   -1.0f, +0.0f, +0.0f,     0.0f, 0.0f,
+    -0.5f, -0.5f, +0.5f,     +0.0f, +0.0f, -1.0f,     +0.0f, +1.0f, +0.0f,   -1.0f, +0.0f, +0.0f,     0.0f, 1.0f,
+    -0.5f, -0.5f, -0.5f,     +0.0f, +0.0f, -1.0f,     +0.0f, +1.0f, +0.0f,   -1.0f, +0.0f, +0.0f,     1.0f, 1.0f,
+    -0.5f, +0.5f, -0.5f,     +0.0f, +0.0f, -1.0f,     +0.0f, +1.0f, +0.0f,   -1.0f, +0.0f, +0.0f,     1.0f, 0.0f,
+
+    // top face
+    -0.5f, +0.5f, +0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, +1.0f,   +0.0f, +1.0f, +0.0f,     0.0f, 0.0f,
+    -0.5f, +0.5f, -0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, +1.0f,   +0.0f, +1.0f, +0.0f,     0.0f, 1.0f,
+    +0.5f, +0.5f, -0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, +1.0f,   +0.0f, +1.0f, +0.0f,     1.0f, 1.0f,
+    +0.5f, +0.5f, +0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, +1.0f,   +0.0f, +1.0f, +0.0f,     1.0f, 0.0f,
+
+    // bottom face
+    -0.5f, -0.5f, -0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, -1.0f,   +0.0f, -1.0f, +0.0f,     0.0f, 0.0f,
+    -0.5f, -0.5f, +0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, -1.0f,   +0.0f, -1.0f, +0.0f,     0.0f, 1.0f,
+    +0.5f, -0.5f, +0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, -1.0f,   +0.0f, -1.0f, +0.0f,     1.0f, 1.0f,
+    +0.5f, -0.5f, -0.5f,     +1.0f, +0.0f, +0.0f,     +0.0f, +0.0f, -1.0f,   +0.0f, -1.0f, +0.0f,     1.0f, 0.0f,
+  };
+
+  static u32 ibuffer[] = {
+    0, 1, 2,
+    2, 3, 0,
+
+    4, 5, 6,
+    6, 7, 4,
+
+    8, 9, 10,
+    10, 11, 8,
+
+    12, 13, 14,
+    14, 15, 12,
+
+    16, 17, 18,
+    18, 19, 16,
+
+    20, 21, 22,
+    22, 23, 20,
+  };
+
+  u32 floats_per_vertex = 14;
+  Scene_Mesh result   = { 0 };
+  result.vertex_count = ArrayCount(vbuffer) / floats_per_vertex;
+  result.index_count  = ArrayCount(ibuffer);
+  result.vertices     = (Model_Vertex *)os_memory_alloc(result.vertex_count * sizeof(Model_Vertex));
+  result.indices      = (u32 *)os_memory_alloc(sizeof(ibuffer));
+  for (u32 vertex_idx = 0; vertex_idx < result.vertex_count; ++vertex_idx)
+  {
+    f32 *v = vbuffer + vertex_idx * floats_per_vertex;
+    result.vertices[vertex_idx] = (Model_Vertex)
+    {
+      .p              = { v[0], v[1], v[2] },
+      .tangent        = { v[3], v[4], v[5] },
+      .bitangent      = { v[6], v[7], v[8] },
+      .normal         = { v[9], v[10], v[11] },
+      .uv             = { v[12], v[13] },
+      // four vertices a face, a chart each
+      .lightmap_chart = vertex_idx / 4,
+    };
+  }
+
+  for (u32 index_idx = 0; index_idx < result.index_count; ++index_idx)
+  {
+    result.indices[index_idx] = ibuffer[index_idx];
+  }
+
+  for (u32 face = 0; face < 6; ++face)
+  {
+    result.charts[face] = (Scene_Mesh_Chart){ face * 6, 6 };
+  }
+  result.chart_count = 6;
+  return(result);
+}
+
+static Scene_Mesh
+scene_mesh_for_model(Scene_Model model)
+{
+  Scene_Mesh result = { 0 };
+  switch (model)
+  {
+    case SceneModel_Cube:
+    {
+      result = scene_mesh_cube();
+    } break;
+
+    case SceneModel_Cylinder:
+    {
+      result = scene_mesh_cylinder(SceneCylinder_Radius, SceneCylinder_Radius, SceneCylinder_Height, SceneCylinder_Slices, SceneCylinder_Stacks);
+    } break;
+
+    case SceneModel_Sphere:
+    {
+      result = scene_mesh_sphere(SceneSphere_Radius, SceneSphere_Quality);
+    } break;
+
+    default:
+    {
+      InvalidCodePath();
+    } break;
+  }
+
+  return(result);
+}
+
+static void
+scene_mesh_free(Scene_Mesh *mesh)
+{
+  os_memory_free(mesh->vertices, mesh->vertex_count * sizeof(Model_Vertex));
+  os_memory_free(mesh->indices, mesh->index_count * sizeof(u32));
+  *mesh = (Scene_Mesh){ 0 };
+}
@@ -0,0 +1,50 @@
+#if !defined(SCENE_MESH_H)
+#define SCENE_MESH_H
+
+// The triangle meshes behind each Scene_Model, in model space. The renderer
+// uploads them as they are; the CPU bakers and ray queries (bvh.h) read the
+// same triangles, so what they see is what gets drawn.
+
+#define SceneSphere_Quality     32
+#define SceneCylinder_Slices    32
+#define SceneCylinder_Stacks    24
+#define SceneMesh_MaxCharts     6
+
+typedef struct
+{
+  v3f p;
+  v3f tangent, bitangent, normal;
+  v2f uv;
+  // which of the mesh's charts the vertex belongs to
+  u32 lightmap_chart;
+} Model_Vertex;
+
+// A run of triangles the lightmap (lightmap.h) lays out on their own:
+// indices [first_index, first_index + index_count), whose uvs do not overlap.
+// A cube has one per face, a cylinder its side and two caps.
+typedef struct
+{
+  u32 first_index;
+  u32 index_count;
+} Scene_Mesh_Chart;
+
+// Three indices per triangle, wound the way the renderer's back face culling
+// expects. vertices and indices come from os_memory_alloc.
+typedef struct
+{
+  Model_Vertex *vertices;
+  u32           vertex_count;
+  u32          *indices;
+  u32           index_count;
+  Scene_Mesh_Chart charts[SceneMesh_MaxCharts];
+  u32           chart_count;
+} Scene_Mesh;
+
+static Scene_Mesh scene_mesh_cube(void);
+static Scene_Mesh scene_mesh_sphere(f32 radius, u32 quality);
+static Scene_Mesh scene_mesh_cylinder(f32 bottom_radius, f32 top_radius, f32 height, u32 slice_count, u32 stack_count);
+// the mesh the renderer draws model with
+static Scene_Mesh scene_mesh_for_model(Scene_Model model);
+static void       scene_mesh_free(Scene_Mesh *mesh);
+
+#endif
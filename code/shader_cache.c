@@ -0,0 +1,270 @@
+static u64
+shader_cache_hash_bytes(u64 hash, void *data, u64 size)
+{
+  u8 *bytes = (u8 *)data;
+  for (u64 byte_idx = 0; byte_idx < size; ++byte_idx)
+  {
+    hash ^= bytes[byte_idx];
+    hash *= 0x100000001b3ull;
+  }
+
+  return(hash);
+}
+
+// the terminator goes in too, so "ab" "c" and "a" "bc" differ
+static u64
+shader_cache_hash_string(u64 hash, char *string)
+{
+  u64 length = 0;
+  if (string)
+  {
+    while (string[length])
+    {
+      ++length;
+    }
+  }
+
+  hash = shader_cache_hash_bytes(hash, string, length);
+  hash = shader_cache_hash_bytes(hash, "", 1);
+  return(hash);
+}
+
+static b32
+shader_cache_match(char *text, u64 size, u64 at, char *word)
+{
+  b32 result = true;
+  for (; *word && result; ++word, ++at)
+  {
+    result = (at < size) && (text[at] == *word);
+  }
+
+  return(result);
+}
+
+// Hashes the file's size and text, then every file it #includes. A missing
+// include hashes as empty, so creating it later still changes the hash.
+static u64
+shader_cache_hash_file(u64 hash, char *path, u32 depth)
+{
+  OS_File_Map map = os_file_map(path);
+  hash = shader_cache_hash_bytes(hash, &map.size, sizeof(map.size));
+  hash = shader_cache_hash_bytes(hash, map.data, map.size);
+
+  u32 directory_length = 0;
+  for (u32 char_idx = 0; path[char_idx]; ++char_idx)
+  {
+    if ((path[char_idx] == '/') || (path[char_idx] == '\\'))
+    {
+      directory_length = char_idx + 1;
+    }
+  }
+
+  // commented out includes are followed too; that only costs a miss
+  char *text = (char *)map.data;
+  for (u64 at = 0; (depth < ShaderCache_MaxIncludeDepth) && (at < map.size); ++at)
+  {
+    if (text[at] != '#')
+    {
+      continue;
+    }
+
+    for (++at; (at < map.size) && ((text[at] == ' ') || (text[at] == '\t')); ++at);
+    if (!shader_cache_match(text, map.size, at, "include"))
+    {
+      continue;
+    }
+
+    for (at += 7; (at < map.size) && ((text[at] == ' ') || (text[at] == '\t')); ++at);
+    if ((at < map.size) && ((text[at] == '"') || (text[at] == '<')))
+    {
+      char close = (text[at] == '"') ? '"' : '>';
+      char include_path[ShaderCache_MaxPath];
+      u32  length = 0;
+      for (u32 char_idx = 0; char_idx < directory_length; ++char_idx)
+      {
+        include_path[length++] = path[char_idx];
+      }
+
+      for (++at; (at < map.size) && (text[at] != close) && (text[at] != '\n') && (length + 1 < ShaderCache_MaxPath); ++at)
+      {
+        include_path[length++] = text[at];
+      }
+
+      include_path[length] = 0;
+      hash = shader_cache_hash_string(hash, include_path + directory_length);
+      hash = shader_cache_hash_file(hash, include_path, depth + 1);
+    }
+  }
+
+  os_file_unmap(&map);
+  return(hash);
+}
+
+static u64
+shader_cache_hash(Shader_Source *source)
+{
+  u64 result = 0;
+  OS_File file = os_file_open(source->path);
+  if (file.valid)
+  {
+    os_file_close(file);
+
+    u32 version = ShaderCache_Version;
+    result = 0xcbf29ce484222325ull;
+    result = shader_cache_hash_bytes(result, &version, sizeof(version));
+    result = shader_cache_hash_file(result, source->path, 0);
+    result = shader_cache_hash_string(result, source->entry_point);
+    result = shader_cache_hash_string(result, source->target);
+    result = shader_cache_hash_bytes(result, &source->flags, sizeof(source->flags));
+    for (Shader_Define *define = source->defines; define && define->name; ++define)
+    {
+      result = shader_cache_hash_string(result, define->name);
+      result = shader_cache_hash_string(result, define->definition);
+    }
+
+    // 0 means unreadable
+    result += !result;
+  }
+
+  return(result);
+}
+
+static void
+shader_cache_file_path(Shader_Cache *cache, u64 hash, char *buffer, u32 buffer_size)
+{
+  static char digits[] = "0123456789abcdef";
+  static char extension[] = ".cso";
+
+  u32 length = 0;
+  for (char *at = cache->directory; *at && (length + 1 < buffer_size); ++at)
+  {
+    buffer[length++] = *at;
+  }
+
+  if (length + 1 < buffer_size)
+  {
+    buffer[length++] = '/';
+  }
+
+  for (s32 nibble = 15; (nibble >= 0) && (length + 1 < buffer_size); --nibble)
+  {
+    buffer[length++] = digits[(hash >> (nibble * 4)) & 0xF];
+  }
+
+  for (char *at = extension; *at && (length + 1 < buffer_size); ++at)
+  {
+    buffer[length++] = *at;
+  }
+
+  buffer[length] = 0;
+}
+
+// rejects anything written by another version, for another hash, or cut short
+static b32
+shader_cache_load(char *path, u64 hash, Shader_Bytecode *result)
+{
+  OS_File file = os_file_open(path);
+  u64 file_size = os_file_size(file);
+  Shader_Cache_Header header = { 0 };
+  b32 ok = file.valid && (file_size > sizeof(header)) && os_file_read(file, 0, sizeof(header), &header) &&
+           (header.magic == ShaderCache_Magic) && (header.version == ShaderCache_Version) &&
+           (header.hash == hash) && (header.bytecode_size == file_size - sizeof(header));
+  if (ok)
+  {
+    result->bytecode = (u8 *)os_memory_alloc(header.bytecode_size);
+    result->size     = header.bytecode_size;
+    ok = result->bytecode && os_file_read(file, sizeof(header), header.bytecode_size, result->bytecode);
+    if (!ok)
+    {
+      shader_bytecode_free(result);
+    }
+  }
+
+  os_file_close(file);
+  return(ok);
+}
+
+static b32
+shader_cache_store(Shader_Cache *cache, char *path, Shader_Bytecode *bytecode)
+{
+  Shader_Cache_Header header =
+  {
+    .magic         = ShaderCache_Magic,
+    .version       = ShaderCache_Version,
+    .hash          = bytecode->hash,
+    .bytecode_size = bytecode->size,
+  };
+
+  u64 file_size = sizeof(header) + bytecode->size;
+  u8 *file_data = (u8 *)os_memory_alloc(file_size);
+  b32 result    = (file_data != 0);
+  if (result)
+  {
+    *(Shader_Cache_Header *)file_data = header;
+    for (u64 byte_idx = 0; byte_idx < bytecode->size; ++byte_idx)
+    {
+      file_data[sizeof(header) + byte_idx] = bytecode->bytecode[byte_idx];
+    }
+
+    result = os_directory_create(cache->directory) && os_file_write_all(path, file_data, file_size);
+    os_memory_free(file_data, file_size);
+  }
+
+  return(result);
+}
+
+static b32
+shader_cache_get(Shader_Cache *cache, Shader_Source *source, Shader_Bytecode *result)
+{
+  *result      = (Shader_Bytecode){ 0 };
+  result->hash = shader_cache_hash(source);
+
+  b32 ok = (result->hash != 0);
+  if (ok)
+  {
+    char path[ShaderCache_MaxPath];
+    shader_cache_file_path(cache, result->hash, path, sizeof(path));
+    result->from_cache = shader_cache_load(path, result->hash, result);
+    ok = result->from_cache;
+    if (!ok)
+    {
+      ok = cache->compile(source, result);
+      if (ok)
+      {
+        // a failed store only means compiling again next time
+        shader_cache_store(cache, path, result);
+      }
+    }
+  }
+
+  return(ok);
+}
+
+static void
+shader_cache_job_proc(void *data)
+{
+  Shader_Cache_Job *job = (Shader_Cache_Job *)data;
+  job->ok = shader_cache_get(job->cache, &job->source, &job->result);
+}
+
+static void
+shader_cache_get_async(Shader_Cache_Job *job, OS_Work_Queue *queue)
+{
+  job->ok = false;
+  if (queue)
+  {
+    os_work_queue_add(queue, shader_cache_job_proc, job);
+  }
+  else
+  {
+    shader_cache_job_proc(job);
+  }
+}
+
+static void
+shader_bytecode_free(Shader_Bytecode *bytecode)
+{
+  os_memory_free(bytecode->bytecode, bytecode->size);
+  bytecode->bytecode = 0;
+  bytecode->size     = 0;
+}
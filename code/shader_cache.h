@@ -0,0 +1,74 @@
+#if !defined(SHADER_CACHE_H)
+#define SHADER_CACHE_H
+
+// Compiled shader bytecode kept on disk, one file per shader keyed by a hash
+// of everything that goes into compiling it: the source text, every file it
+// #includes, the entry point, the target, the compile flags and the defines.
+// A lookup whose file is there and intact loads it; anything else compiles
+// through the cache's compile proc and stores the result. Which compiler that
+// is stays with the caller (D3DCompile in main.c, a stub in
+// tools/shader_cache_check.c), so nothing here needs the D3D headers.
+
+#define ShaderCache_Magic           0x48435348 // "HSCH"
+#define ShaderCache_Version         1
+// includes nested deeper than this are not followed, which also stops cycles
+#define ShaderCache_MaxIncludeDepth 8
+#define ShaderCache_MaxPath         512
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u64 hash;
+  u64 bytecode_size;
+} Shader_Cache_Header;
+
+typedef struct
+{
+  // includes resolve against this file's directory, as
+  // D3D_COMPILE_STANDARD_FILE_INCLUDE does
+  char          *path;
+  char          *entry_point;
+  char          *target;
+  u32            flags;
+  // may be 0
+  Shader_Define *defines;
+} Shader_Source;
+
+typedef struct
+{
+  u8  *bytecode;
+  u64  size;
+  u64  hash;
+  b32  from_cache;
+} Shader_Bytecode;
+
+// Compiles source into result->bytecode, allocated with os_memory_alloc, and
+// sets result->size. Called from worker threads by shader_cache_get_async.
+typedef b32 Shader_Compile_Proc(Shader_Source *source, Shader_Bytecode *result);
+
+typedef struct
+{
+  char                *directory;
+  Shader_Compile_Proc *compile;
+} Shader_Cache;
+
+// One background lookup; result and ok are valid once the queue completes.
+typedef struct
+{
+  Shader_Cache    *cache;
+  Shader_Source    source;
+  Shader_Bytecode  result;
+  b32              ok;
+} Shader_Cache_Job;
+
+// 0 if the source itself cannot be read
+static u64  shader_cache_hash(Shader_Source *source);
+// e.g. "<directory>/0123456789abcdef.cso"
+static void shader_cache_file_path(Shader_Cache *cache, u64 hash, char *buffer, u32 buffer_size);
+static b32  shader_cache_get(Shader_Cache *cache, Shader_Source *source, Shader_Bytecode *result);
+// queue may be 0, which runs the job right away
+static void shader_cache_get_async(Shader_Cache_Job *job, OS_Work_Queue *queue);
+static void shader_bytecode_free(Shader_Bytecode *bytecode);
+
+#endif
@@ -0,0 +1,169 @@
+typedef struct
+{
+  Shader_Key  bit;
+  char       *define;
+  char       *short_name;
+} Shader_Key_Feature;
+
+static Shader_Key_Feature g_shader_key_features[] =
+{
+  { ShaderKey_Textured,        "Permutation_Textured",        "textured"  },
+  { ShaderKey_VirtualTexture,  "Permutation_VirtualTexture",  "virtual"   },
+  { ShaderKey_ConeStep,        "Permutation_ConeStep",        "cone"      },
+  { ShaderKey_Lit,             "Permutation_Lit",             "lit"       },
+  { ShaderKey_ReceivesShadow,  "Permutation_ReceivesShadow",  "shadow"    },
+  { ShaderKey_ClusteredLights, "Permutation_ClusteredLights", "clustered" },
+  { ShaderKey_Reflective,      "Permutation_Reflective",      "reflective" },
+  { ShaderKey_Lightmapped,     "Permutation_Lightmapped",     "lightmap"  },
+};
+
+static char *g_shader_key_digits[] = { "0", "1", "2", "3" };
+
+static Shader_Key
+shader_key_normalize(Shader_Key key)
+{
+  Shader_Key result = key;
+  if (!(result & ShaderKey_Textured))
+  {
+    result &= ~(ShaderKey_VirtualTexture | ShaderKey_ConeStep);
+  }
+
+  // the virtual cache holds no cone step maps
+  if (result & ShaderKey_VirtualTexture)
+  {
+    result &= ~ShaderKey_ConeStep;
+  }
+
+  if (!(result & ShaderKey_Lit))
+  {
+    result &= ~(ShaderKey_ReceivesShadow | ShaderKey_ClusteredLights | ShaderKey_Lightmapped | ShaderKey_DirectionalMask);
+  }
+
+  // only the directional light casts shadows
+  if (!(result & ShaderKey_DirectionalMask))
+  {
+    result &= ~(ShaderKey_ReceivesShadow | ShaderKey_Lightmapped);
+  }
+
+  // the lightmap already holds the directional light's shadow
+  if (result & ShaderKey_Lightmapped)
+  {
+    result &= ~ShaderKey_ReceivesShadow;
+  }
+
+  return(result);
+}
+
+static Shader_Key
+shader_key_make_pass(b32 cone_step, u32 directional_light_count, b32 clustered_lights)
+{
+  Assert(directional_light_count <= ShaderKey_MaxDirectional);
+  Shader_Key result = directional_light_count << ShaderKey_DirectionalShift;
+  if (cone_step)
+  {
+    result |= ShaderKey_ConeStep;
+  }
+
+  if (clustered_lights)
+  {
+    result |= ShaderKey_ClusteredLights;
+  }
+
+  return(result);
+}
+
+static Shader_Key
+shader_key_for_instance(Model_Instance *instance, Shader_Key pass_key)
+{
+  Shader_Key result = pass_key;
+  if (instance->texture_slice != TextureSlice_None)
+  {
+    result |= ShaderKey_Textured;
+    if (instance->texture_slice & TextureSlice_VirtualBit)
+    {
+      result |= ShaderKey_VirtualTexture;
+    }
+  }
+
+  if (instance->enable_lighting)
+  {
+    result |= ShaderKey_Lit;
+  }
+
+  if (instance->receives_shadow)
+  {
+    result |= ShaderKey_ReceivesShadow;
+  }
+
+  if (instance->reflection_probe != ReflectionProbe_None)
+  {
+    result |= ShaderKey_Reflective;
+  }
+
+  if (instance->lightmap_first_chart != Lightmap_None)
+  {
+    result |= ShaderKey_Lightmapped;
+  }
+
+  result = shader_key_normalize(result);
+  return(result);
+}
+
+static u32
+shader_key_defines(Shader_Key key, Shader_Define *defines)
+{
+  u32 result = 0;
+  for (u32 feature_idx = 0; feature_idx < ArrayCount(g_shader_key_features); ++feature_idx)
+  {
+    Shader_Key_Feature *feature = g_shader_key_features + feature_idx;
+    defines[result++] = (Shader_Define){ feature->define, (key & feature->bit) ? "1" : "0" };
+  }
+
+  u32 directional_count = (key & ShaderKey_DirectionalMask) >> ShaderKey_DirectionalShift;
+  defines[result++] = (Shader_Define){ "Permutation_DirectionalLights", g_shader_key_digits[directional_count] };
+  Assert(result < ShaderKey_MaxDefines);
+  defines[result] = (Shader_Define){ 0, 0 };
+  return(result);
+}
+
+static void
+shader_key_append_word(char *buffer, u32 buffer_size, u32 *length, char *word)
+{
+  if (*length && (*length + 1 < buffer_size))
+  {
+    buffer[(*length)++] = ' ';
+  }
+
+  for (char *at = word; *at && (*length + 1 < buffer_size); ++at)
+  {
+    buffer[(*length)++] = *at;
+  }
+
+  buffer[*length] = 0;
+}
+
+static void
+shader_key_describe(Shader_Key key, char *buffer, u32 buffer_size)
+{
+  static char *directional_names[] = { "dir0", "dir1", "dir2", "dir3" };
+
+  u32 length = 0;
+  buffer[0]  = 0;
+  for (u32 feature_idx = 0; feature_idx < ArrayCount(g_shader_key_features); ++feature_idx)
+  {
+    if (key & g_shader_key_features[feature_idx].bit)
+    {
+      shader_key_append_word(buffer, buffer_size, &length, g_shader_key_features[feature_idx].short_name);
+    }
+  }
+
+  if (key & ShaderKey_DirectionalMask)
+  {
+    shader_key_append_word(buffer, buffer_size, &length, directional_names[(key & ShaderKey_DirectionalMask) >> ShaderKey_DirectionalShift]);
+  }
+
+  if (!length)
+  {
+    shader_key_append_word(buffer, buffer_size, &length, "flat");
+  }
+}
@@ -0,0 +1,48 @@
+#if !defined(SHADER_PERMUTATION_H)
+#define SHADER_PERMUTATION_H
+
+// ps_main is compiled once per combination of the features below, each one a
+// Permutation_* define in shader_main.hlsl, so a variant carries no branches
+// for features its draws do not use. A draw's key comes from its instances
+// (textures, lighting, shadows, reflection probes, lightmaps), its material
+// bin (cone step maps) and the frame's lights. Keys are normalised so features that
+// cannot matter, like shadows on unlit draws, do not split variants.
+
+typedef u32 Shader_Key;
+enum
+{
+  ShaderKey_Textured        = (1 << 0),
+  ShaderKey_VirtualTexture  = (1 << 1),
+  ShaderKey_ConeStep        = (1 << 2),
+  ShaderKey_Lit             = (1 << 3),
+  ShaderKey_ReceivesShadow  = (1 << 4),
+  ShaderKey_ClusteredLights = (1 << 5),
+  ShaderKey_Reflective      = (1 << 6),
+  ShaderKey_Lightmapped     = (1 << 7),
+};
+
+// directional light count in the top bits
+#define ShaderKey_DirectionalShift 8
+#define ShaderKey_MaxDirectional   3
+#define ShaderKey_DirectionalMask  (ShaderKey_MaxDirectional << ShaderKey_DirectionalShift)
+#define ShaderKey_Count            (1 << 10)
+// one per feature and the terminator
+#define ShaderKey_MaxDefines       10
+
+// laid out like D3D_SHADER_MACRO; a 0 name ends the list
+typedef struct
+{
+  char *name;
+  char *definition;
+} Shader_Define;
+
+static Shader_Key shader_key_normalize(Shader_Key key);
+// the material and light bits every instance of a draw shares
+static Shader_Key shader_key_make_pass(b32 cone_step, u32 directional_light_count, b32 clustered_lights);
+static Shader_Key shader_key_for_instance(Model_Instance *instance, Shader_Key pass_key);
+// fills defines (ShaderKey_MaxDefines long) and returns how many were set
+static u32        shader_key_defines(Shader_Key key, Shader_Define *defines);
+// e.g. "textured lit shadow clustered dir1"
+static void       shader_key_describe(Shader_Key key, char *buffer, u32 buffer_size);
+
+#endif
@@ -1,8 +1,27 @@
-#define MaxLightCount 8
 #define LightType_Directional 0
 #define LightType_Spot 1
 #define LightType_Point 2
 #define LightType_Count 3
+#define TextureSlice_None 0xFFFFFFFF
+#define TextureSlice_VirtualBit 0x80000000
+#define VTex_TileContent 120
+#define VTex_TileBorder 4
+#define VTex_TileSize 128
+#define ConeStep_HeightScale 0.04f
+#define ConeStep_MaxRatio 4.0f
+#define ConeStep_ConeSteps 12
+#define ConeStep_SearchSteps 5
+#define Shadow_CascadeCount 4
+#define Shadow_MapSize 1024
+#define LightCluster_TilesX 16
+#define LightCluster_TilesY 9
+#define LightCluster_Slices 24
+#define ReflectionProbe_None 0xFFFFFFFF
+#define ReflectionProbe_MipCount 5
+#define Lightmap_None 0xFFFFFFFF
+#define VertexAO_None 0xFFFFFFFF
+#define IrradianceVolume_Coefficients 9
+#define IrradianceVolume_ProbeTexels 7
 
 struct Light
 {
@@ -12,11 +31,11 @@ struct Light
   float4    intensity;
   // ------------- 16 -------------- //
   float3    dir;
-  float     _pad_a;
+  float     range;
   // ------------- 16 -------------- //
-  float4x4  world_to_light;
-  // ------------- 16 -------------- //
-  float4x4  projection;
+  float     spot_cos_inner;
+  float     spot_cos_outer;
+  float2    _pad_a;
 };
 
 cbuffer Constant_Store0 : register(b0)
@@ -27,16 +46,49 @@ cbuffer Constant_Store0 : register(b0)
 
 cbuffer Constant_Store1 : register(b1)
 {
-  uint       enable_texture;
   uint       enable_reflections;
-  float      _pad_c1_a[2];
+  float3     _pad_c1_a;
+  // the first probe of g_irradiance_volume and the distance between probes
+  float3     irradiance_origin;
+  float      irradiance_spacing;
+  uint3      irradiance_probe_counts;
+  uint       enable_irradiance_volume;
 };
 
 cbuffer Constant_Store2 : register(b2)
 {
   float3     eye_p;
-  uint       light_count;
-  Light      lights[MaxLightCount];
+  // g_lights starts with these, the rest are reached through the clusters
+  uint       directional_light_count;
+  float2     cluster_tiles_per_pixel;
+  // slice = log(view z) * cluster_z_scale + cluster_z_bias
+  float      cluster_z_scale;
+  float      cluster_z_bias;
+};
+
+cbuffer Constant_Store3 : register(b3)
+{
+  // g_displace_map is RG8 height + cone ratio (see cone_step.h)
+  uint       cone_step_enabled;
+  uint3      _pad_c3_a;
+};
+
+cbuffer Constant_Store4 : register(b4)
+{
+  float2     vt_virtual_size;
+  float      vt_mip_count;
+  float      vt_physical_size;
+  uint2      vt_feedback_jitter;
+  uint2      _pad_c4_a;
+};
+
+cbuffer Constant_Store5 : register(b5)
+{
+  // light view * ortho per cascade, see shadow.h
+  float4x4   cascade_world_to_clip[Shadow_CascadeCount];
+  float4     cascade_depth_bias;
+  uint       cascade_current;
+  uint3      _pad_c5_a;
 };
 
 struct Model_Instance
@@ -46,6 +98,13 @@ struct Model_Instance
   float3 p;
   float4 colour;
   uint enable_lighting;
+  uint texture_slice;
+  uint casts_shadow;
+  uint receives_shadow;
+  uint reflection_probe;
+  float reflection_roughness;
+  uint lightmap_first_chart;
+  uint ao_first_vertex;
 };
 
 struct VertexShader_Input
@@ -55,6 +114,7 @@ struct VertexShader_Input
   float3 b         : IA_Bitangent;
   float3 n         : IA_Normal;
   float2 uv        : IA_TextureUV;
+  uint   lightmap_chart : IA_LightmapChart;
 };
 
 struct VertexShader_Output
@@ -64,6 +124,13 @@ struct VertexShader_Output
   float2 uv        : TextureUV;
 
   nointerpolation uint enable_lighting    : EnableLighting;
+  nointerpolation uint texture_slice      : TextureSlice;
+  nointerpolation uint receives_shadow    : ReceivesShadow;
+  nointerpolation uint reflection_probe   : ReflectionProbe;
+  nointerpolation float reflection_roughness : ReflectionRoughness;
+  nointerpolation uint lightmapped        : Lightmapped;
+  float2 lightmap_uv                      : LightmapUV;
+  float ambient_occlusion                 : AmbientOcclusion;
   float3 world_p                          : WorldP;
   float3 normal                           : SurfaceNormal;
   
@@ -71,17 +138,98 @@ struct VertexShader_Output
 };
 
 StructuredBuffer<Model_Instance>   g_model_instances   : register(t0);
-Texture2D<float4>                  g_diffuse_map       : register(t1);
-Texture2D<float4>                  g_normal_map        : register(t2);
-Texture2D<float4>                  g_displace_map      : register(t3);
-Texture2D<float4>                  g_shadow_map        : register(t4);
+Texture2DArray<float4>             g_diffuse_map       : register(t1);
+Texture2DArray<float4>             g_normal_map        : register(t2);
+Texture2DArray<float4>             g_displace_map      : register(t3);
+Texture2DArray<float>              g_shadow_map        : register(t4);
+Texture2D<uint4>                   g_vt_page_table     : register(t5);
+Texture2D<float4>                  g_vt_diffuse_cache  : register(t6);
+Texture2D<float4>                  g_vt_normal_cache   : register(t7);
+Texture2D<float4>                  g_vt_displace_cache : register(t8);
+StructuredBuffer<Light>            g_lights            : register(t9);
+// offset and count into g_light_indices per cluster (light_cluster.h)
+StructuredBuffer<uint2>            g_light_clusters    : register(t10);
+StructuredBuffer<uint>             g_light_indices     : register(t11);
+// one baked cube per probe, roughness in the mips (reflection_probe.h)
+TextureCubeArray<float4>           g_reflection_probes : register(t12);
+// baked directional light of the static instances (lightmap.h)
+Texture2D<float4>                  g_lightmap          : register(t13);
+// uv scale in xy, offset in zw
+StructuredBuffer<float4>           g_lightmap_charts   : register(t14);
+// baked occlusion per vertex of the static instances (vertex_ao.h)
+Buffer<float>                      g_vertex_ao         : register(t15);
+// order 2 spherical harmonics per probe, 7 texels each (irradiance_volume.h)
+Buffer<float4>                     g_irradiance_volume : register(t16);
+RWTexture2D<uint>                  g_vt_feedback       : register(u1);
 
 SamplerState g_sample_linear_all : register(s0);
 SamplerState g_sample_point_all  : register(s1);
 SamplerComparisonState sampler_shadow : register(s2);
 
+#include "shadow_filter.hlsl"
+
+// ps_main is specialised on these (shader_permutation.h). Each is 1 to
+// compile a feature in, 0 to compile it out, or left undefined for the uber
+// shader, where the instance and frame data decide per pixel.
+#if defined(Permutation_Textured)
+# define permutation_textured(runtime) (Permutation_Textured)
+#else
+# define permutation_textured(runtime) (runtime)
+#endif
+
+#if defined(Permutation_VirtualTexture)
+# define permutation_virtual_texture(runtime) (Permutation_VirtualTexture)
+#else
+# define permutation_virtual_texture(runtime) (runtime)
+#endif
+
+#if defined(Permutation_ConeStep)
+# define permutation_cone_step(runtime) (Permutation_ConeStep)
+#else
+# define permutation_cone_step(runtime) (runtime)
+#endif
+
+#if defined(Permutation_Lit)
+# define permutation_lit(runtime) (Permutation_Lit)
+#else
+# define permutation_lit(runtime) (runtime)
+#endif
+
+#if defined(Permutation_ReceivesShadow)
+# define permutation_receives_shadow(runtime) (Permutation_ReceivesShadow)
+#else
+# define permutation_receives_shadow(runtime) (runtime)
+#endif
+
+#if defined(Permutation_ClusteredLights)
+# define permutation_clustered_lights(runtime) (Permutation_ClusteredLights)
+#else
+# define permutation_clustered_lights(runtime) (runtime)
+#endif
+
+#if defined(Permutation_Reflective)
+# define permutation_reflective(runtime) (Permutation_Reflective)
+#else
+# define permutation_reflective(runtime) (runtime)
+#endif
+
+#if defined(Permutation_Lightmapped)
+# define permutation_lightmapped(runtime) (Permutation_Lightmapped)
+#else
+# define permutation_lightmapped(runtime) (runtime)
+#endif
+
+// a known count unrolls the directional loop
+#if defined(Permutation_DirectionalLights)
+# define permutation_directional_lights(runtime) (Permutation_DirectionalLights)
+# define Permutation_DirectionalLoop [unroll]
+#else
+# define permutation_directional_lights(runtime) (runtime)
+# define Permutation_DirectionalLoop [loop]
+#endif
+
 VertexShader_Output
-vs_main(VertexShader_Input vs_inp, uint iid : SV_InstanceID)
+vs_main(VertexShader_Input vs_inp, uint iid : SV_InstanceID, uint vid : SV_VertexID)
 {
   Model_Instance instance = g_model_instances[iid];
   
@@ -118,20 +266,32 @@ vs_main(VertexShader_Input vs_inp, uint iid : SV_InstanceID)
   result.world_p         = world_p;
   result.normal          = mul(instance.model_to_world_xform_inverse_transpose, vs_inp.n);
   result.enable_lighting = instance.enable_lighting;
+  result.texture_slice   = instance.texture_slice;
+  result.receives_shadow = instance.receives_shadow;
+  result.reflection_probe     = instance.reflection_probe;
+  result.reflection_roughness = instance.reflection_roughness;
+  result.lightmapped          = (instance.lightmap_first_chart != Lightmap_None);
+  if (result.lightmapped)
+  {
+    float4 chart       = g_lightmap_charts[instance.lightmap_first_chart + vs_inp.lightmap_chart];
+    result.lightmap_uv = vs_inp.uv * chart.xy + chart.zw;
+  }
+
+  result.ambient_occlusion = 1.0f;
+  if (instance.ao_first_vertex != VertexAO_None)
+  {
+    result.ambient_occlusion = g_vertex_ao[instance.ao_first_vertex + vid];
+  }
   return(result);
 }
 
 float4
 vs_depth_only(VertexShader_Input vs_inp, uint iid : SV_InstanceID) : SV_Position
 {
+  // only casters are submitted (shadow_cull_scene)
   Model_Instance instance = g_model_instances[iid];
-  if ((instance.p.x == lights[0].P.x) && (instance.p.y == lights[0].P.y) && (instance.p.z == lights[0].P.z))
-  {
-    return float4(0,0,0,0);
-  }
   float3 world_p          = mul(instance.model_to_world_xform, vs_inp.p) + instance.p;
-  float4 camera_p         = mul(lights[0].world_to_light, float4(world_p, 1.0f));
-  float4 result           = mul(lights[0].projection, camera_p);
+  float4 result           = mul(cascade_world_to_clip[cascade_current], float4(world_p, 1.0f));
   return(result);
 }
 
@@ -170,7 +330,56 @@ float4 srgb_to_linear(float4 c)
   return float4(pow(c.xyz, 2.2f), c.a);
 }
 
-float2 parallax_uv(float3 view_dir, float3 N, float2 tex_coord, float2 dx, float2 dy)
+float vt_mip_from_gradients(float2 dx, float2 dy)
+{
+  float lod = log2(max(length(dx * vt_virtual_size), length(dy * vt_virtual_size)));
+  return clamp(floor(lod), 0.0f, vt_mip_count - 1.0f);
+}
+
+// The page table entry of the wanted tile names the closest resident
+// ancestor (rg: cache slot, b: its mip); address that tile inside the cache.
+float2 vt_physical_uv(float2 uv, float2 dx, float2 dy)
+{
+  float2 texels      = frac(uv) * vt_virtual_size;
+  float  mip         = vt_mip_from_gradients(dx, dy);
+  uint2  tile        = (uint2)(texels / (VTex_TileContent * exp2(mip)));
+  uint4  page        = g_vt_page_table.Load(int3(tile, (int)mip));
+
+  float2 page_texels = texels * exp2(-(float)page.b);
+  float2 in_tile     = page_texels - floor(page_texels / VTex_TileContent) * VTex_TileContent;
+  return (float2(page.rg) * VTex_TileSize + VTex_TileBorder + in_tile) / vt_physical_size;
+}
+
+void vt_write_feedback(float4 position, float2 uv, float2 dx, float2 dy)
+{
+  uint2 pixel = (uint2)position.xy;
+  if (all((pixel & 7) == vt_feedback_jitter))
+  {
+    float2 texels = frac(uv) * vt_virtual_size;
+    float  mip    = vt_mip_from_gradients(dx, dy);
+    uint2  tile   = (uint2)(texels / (VTex_TileContent * exp2(mip)));
+    g_vt_feedback[pixel >> 3] = ((uint)mip << 24) | (tile.y << 12) | tile.x;
+  }
+}
+
+// Every material fetch goes through here so virtual and array-bin materials
+// share the parallax and shading code. The cache has no mips; the page
+// table already picked the level, so the virtual path filters bilinearly.
+float4 material_sample_grad(Texture2DArray<float4> array_map, Texture2D<float4> virtual_map, uint texture_slice, float2 uv, float2 dx, float2 dy)
+{
+  float4 result;
+  if (permutation_virtual_texture((texture_slice & TextureSlice_VirtualBit) != 0))
+  {
+    result = virtual_map.SampleLevel(g_sample_linear_all, vt_physical_uv(uv, dx, dy), 0.0f);
+  }
+  else
+  {
+    result = array_map.SampleGrad(g_sample_linear_all, float3(uv, (float)texture_slice), dx, dy);
+  }
+  return result;
+}
+
+float2 parallax_uv(float3 view_dir, float3 N, float2 tex_coord, uint texture_slice, float2 dx, float2 dy)
 {
   float  height_scale_tweak        = 0.05f;
   uint   sample_count_min_tweak    = 8;
@@ -184,25 +393,25 @@ float2 parallax_uv(float3 view_dir, float3 N, float2 tex_coord, float2 dx, float
   
   float  current_sample_depth      = 0.0f;
   float2 current_tex_coords        = tex_coord;
-  float  current_depth_map_value   = 1.0f - g_displace_map.SampleGrad(g_sample_linear_all, current_tex_coords, dx, dy).r;
+  float  current_depth_map_value   = 1.0f - material_sample_grad(g_displace_map, g_vt_displace_cache, texture_slice, current_tex_coords, dx, dy).r;
   
   while (current_sample_depth < current_depth_map_value)
   {
     current_tex_coords       += tex_sample_step;
-    current_depth_map_value   = 1.0f - g_displace_map.SampleGrad(g_sample_linear_all, current_tex_coords, dx, dy).r;
+    current_depth_map_value   = 1.0f - material_sample_grad(g_displace_map, g_vt_displace_cache, texture_slice, current_tex_coords, dx, dy).r;
     current_sample_depth     += depth_sample_step;
   }
   
   float2 tex_coord_before        = current_tex_coords - tex_sample_step;
   float  depth_after             = current_depth_map_value - current_sample_depth;
-  float  prev_depth_map_value    = 1.0f - g_displace_map.SampleGrad(g_sample_linear_all, tex_coord_before, dx, dy).r;
+  float  prev_depth_map_value    = 1.0f - material_sample_grad(g_displace_map, g_vt_displace_cache, texture_slice, tex_coord_before, dx, dy).r;
   float  depth_before            = prev_depth_map_value - current_sample_depth + depth_sample_step;
   float  t_value                 = depth_after / (depth_after - depth_before);
   float2 result                  = float2(t_value * tex_coord_before + (1.0f - t_value) * current_tex_coords);
   return result;
 }
 
-float2 parallax_uv2(float3 view_dir, float3 N, float2 tex_coord, float2 dx, float2 dy)
+float2 parallax_uv2(float3 view_dir, float3 N, float2 tex_coord, uint texture_slice, float2 dx, float2 dy)
 {
   float  height_scale_tweak     = 0.04f;
   uint   min_sample_count_tweak = 8;
@@ -226,7 +435,7 @@ float2 parallax_uv2(float3 view_dir, float3 N, float2 tex_coord, float2 dx, floa
   float2 final_tex_offset        = 0.0f;  
   while (sample_idx <= sample_count)
   {
-    current_map_depth = g_displace_map.SampleGrad(g_sample_linear_all, tex_coord + current_tex_offset, dx, dy).r;
+    current_map_depth = material_sample_grad(g_displace_map, g_vt_displace_cache, texture_slice, tex_coord + current_tex_offset, dx, dy).r;
     
     if (current_depth < current_map_depth)
     {
@@ -251,125 +460,285 @@ float2 parallax_uv2(float3 view_dir, float3 N, float2 tex_coord, float2 dx, floa
   return tex_coord + final_tex_offset;
 }
 
+// Relaxed cone stepping (see cone_step.h; cone_step_trace_cone is the CPU
+// mirror). Each tap jumps to the edge of the cone stored at the ray's
+// position; once a jump lands under the surface a short binary search and a
+// secant close in on the hit. t is the ray's depth, and a gap is how far
+// the ray is below the surface.
+float2 parallax_cone_uv(float3 view_dir, float2 tex_coord, uint texture_slice, float2 dx, float2 dy)
+{
+  float2 max_parallax_offset = ((-ConeStep_HeightScale) * view_dir.xy) / view_dir.z;
+  max_parallax_offset.y     *= -1.0f;
+  float  travel              = length(view_dir.xy) / view_dir.z;
+  
+  float  t           = 0.0f;
+  float  t_outside   = 0.0f;
+  float  gap         = 0.0f;
+  float  gap_outside = 0.0f;
+  bool   inside      = false;
+  for (uint step_idx = 0; (step_idx < ConeStep_ConeSteps) && !inside; ++step_idx)
+  {
+    float2 texel     = g_displace_map.SampleGrad(g_sample_linear_all, float3(tex_coord + t * max_parallax_offset, (float)texture_slice), dx, dy).rg;
+    float  map_depth = 1.0f - texel.r;
+    gap              = t - map_depth;
+    inside           = (gap >= 0.0f);
+    if (!inside)
+    {
+      float ratio = texel.g * texel.g * ConeStep_MaxRatio;
+      t_outside   = t;
+      gap_outside = gap;
+      t           = min(t + ratio * (map_depth - t) / max(travel + ratio, 1e-5f), 1.0f);
+    }
+  }
+  
+  if (inside && (t > t_outside))
+  {
+    for (uint search_idx = 0; search_idx < ConeStep_SearchSteps; ++search_idx)
+    {
+      float t_middle   = 0.5f * (t_outside + t);
+      float gap_middle = t_middle - (1.0f - g_displace_map.SampleGrad(g_sample_linear_all, float3(tex_coord + t_middle * max_parallax_offset, (float)texture_slice), dx, dy).r);
+      if (gap_middle >= 0.0f)
+      {
+        t   = t_middle;
+        gap = gap_middle;
+      }
+      else
+      {
+        t_outside   = t_middle;
+        gap_outside = gap_middle;
+      }
+    }
+    t = t_outside + (t - t_outside) * (-gap_outside / max(gap - gap_outside, 1e-5f));
+  }
+  
+  return tex_coord + t * max_parallax_offset;
+}
+
+// g_lights[0, directional_light_count) are directional
+float4
+shade_directional_light(Light light, float3 N, float3 to_eye, float4 sample_colour, float shadow_multiplier)
+{
+  float M_diffuse     = 1.0f;
+  float M_specular    = 0.5f;
+  float M_shininess   = 8.0f;
+
+  float3 L          = normalize(light.dir);
+  float3 H          = normalize(-L + to_eye);
+  float n_dot_l     = max(dot(N, -L), 0.0f);
+  float r_dot_v     = max(dot(N, H), 0.0f);
+  
+  float4 diffuse    = M_diffuse * light.intensity * n_dot_l * sample_colour;
+  float4 specular   = M_specular * pow(r_dot_v, M_shininess) * light.intensity;
+  
+  float4 result     = (diffuse + specular) * shadow_multiplier;
+  return(result);
+}
+
+// g_lights[0] on a lightmapped instance: the diffuse term and the shadow
+// were baked, only the specular is left
+float4
+shade_lightmapped_light(Light light, float4 lightmap, float3 N, float3 to_eye, float4 sample_colour)
+{
+  float M_specular    = 0.5f;
+  float M_shininess   = 8.0f;
+
+  float3 L          = normalize(light.dir);
+  float3 H          = normalize(-L + to_eye);
+  float r_dot_v     = max(dot(N, H), 0.0f);
+
+  float4 diffuse    = float4(lightmap.rgb, 1.0f) * sample_colour;
+  float4 specular   = M_specular * pow(r_dot_v, M_shininess) * light.intensity * lerp(0.4f, 1.0f, lightmap.a);
+
+  float4 result     = diffuse + specular;
+  return(result);
+}
+
+// the clustered lights, point or spot
+float4
+shade_local_light(Light light, float3 world_p, float3 N, float3 to_eye, float4 sample_colour)
+{
+  float M_diffuse     = 1.0f;
+  float M_specular    = 0.5f;
+  float M_shininess   = 8.0f;
+
+  float3 L        = light.P - world_p;
+  float  dist     = length(L);
+  L              /= dist;
+  float r0        = 5.0f;
+  float win       = pow(max(1.0f - pow(dist / light.range, 4.0f), 0.0f), 2.0f);
+  float atten     = win*(r0*r0 / (dist*dist + 0.01f));
+  if (light.type == LightType_Spot)
+  {
+    atten        *= smoothstep(light.spot_cos_outer, light.spot_cos_inner, dot(-L, light.dir));
+  }
+  
+  float3 H          = normalize(L + to_eye);
+  
+  float n_dot_l     = max(dot(N, L), 0.0f);
+  float r_dot_v     = max(dot(N, H), 0.0f);
+  
+  float4 diffuse    = M_diffuse * light.intensity * n_dot_l * sample_colour;
+  float4 specular   = M_specular * pow(r_dot_v, M_shininess) * light.intensity;
+  
+  float4 result     = (diffuse + specular) * atten;
+  return(result);
+}
+
+// The cosine weighted mean radiance around N at world_p, from the 8 probes
+// around it. Past the grid the nearest probes are used.
+float3
+irradiance_volume_sample(float3 world_p, float3 N)
+{
+  float3 cell_p  = clamp((world_p - irradiance_origin) / irradiance_spacing, 0.0f, float3(irradiance_probe_counts - 1));
+  uint3  cell    = min(uint3(cell_p), max(irradiance_probe_counts, 2) - 2);
+  float3 t       = saturate(cell_p - float3(cell));
+
+  float basis[IrradianceVolume_Coefficients] =
+  {
+    0.282095f,
+    0.488603f * N.y, 0.488603f * N.z, 0.488603f * N.x,
+    1.092548f * N.x * N.y, 1.092548f * N.y * N.z, 0.315392f * (3.0f * N.z * N.z - 1.0f),
+    1.092548f * N.x * N.z, 0.546274f * (N.x * N.x - N.y * N.y),
+  };
+
+  float3 result = 0;
+  [unroll]
+  for (uint corner = 0; corner < 8; ++corner)
+  {
+    uint3 offset = uint3(corner & 1, (corner >> 1) & 1, corner >> 2);
+    uint3 at     = min(cell + offset, irradiance_probe_counts - 1);
+    float3 w3    = lerp(1.0f - t, t, float3(offset));
+    uint  first  = ((at.z * irradiance_probe_counts.y + at.y) * irradiance_probe_counts.x + at.x) * IrradianceVolume_ProbeTexels;
+
+    // coefficient k of channel c is value 3k + c
+    float values[IrradianceVolume_ProbeTexels * 4];
+    [unroll]
+    for (uint texel = 0; texel < IrradianceVolume_ProbeTexels; ++texel)
+    {
+      float4 texel_value     = g_irradiance_volume[first + texel];
+      values[texel * 4 + 0]  = texel_value.x;
+      values[texel * 4 + 1]  = texel_value.y;
+      values[texel * 4 + 2]  = texel_value.z;
+      values[texel * 4 + 3]  = texel_value.w;
+    }
+
+    float3 probe = 0;
+    [unroll]
+    for (uint k = 0; k < IrradianceVolume_Coefficients; ++k)
+    {
+      probe += basis[k] * float3(values[3 * k], values[3 * k + 1], values[3 * k + 2]);
+    }
+    result += (w3.x * w3.y * w3.z) * probe;
+  }
+
+  return(max(result, 0.0f));
+}
+
 float4 ps_main(VertexShader_Output ps_inp) : SV_Target
 {
   float4 sample_colour     = ps_inp.colour;
   float3 N                 = normalize(ps_inp.normal);
   float3 to_eye            = normalize(eye_p - ps_inp.world_p);
   
-  if (enable_texture)
+  if (permutation_textured(ps_inp.texture_slice != TextureSlice_None))
   {
+    uint     slice           = ps_inp.texture_slice;
     float3x3 world_to_TBN    = transpose(ps_inp.TBN_to_world);
     float3   TBN_E           = normalize(mul(world_to_TBN, to_eye));
     float3   TBN_N           = normalize(mul(world_to_TBN, N));
     
     float2 dx                = ddx(ps_inp.uv);
     float2 dy                = ddy(ps_inp.uv);
-    float2 tex_coord_tweak   = parallax_uv2(TBN_E, TBN_N, ps_inp.uv, dx, dy);
+    bool   is_virtual        = permutation_virtual_texture((slice & TextureSlice_VirtualBit) != 0);
+    if (is_virtual)
+    {
+      vt_write_feedback(ps_inp.p, ps_inp.uv, dx, dy);
+    }
+    float2 tex_coord_tweak;
+    if (permutation_cone_step(cone_step_enabled != 0) && !is_virtual)
+    {
+      tex_coord_tweak        = parallax_cone_uv(TBN_E, ps_inp.uv, slice, dx, dy);
+    }
+    else
+    {
+      tex_coord_tweak        = parallax_uv2(TBN_E, TBN_N, ps_inp.uv, slice, dx, dy);
+    }
     
-    float4 texel             = g_diffuse_map.SampleGrad(g_sample_linear_all, tex_coord_tweak, dx, dy);
+    float4 texel             = material_sample_grad(g_diffuse_map, g_vt_diffuse_cache, slice, tex_coord_tweak, dx, dy);
     sample_colour           *= texel;
     
-    //return g_normal_map.SampleGrad(g_sample_linear_all, tex_coord_tweak, dx, dy);
-    N = g_normal_map.SampleGrad(g_sample_linear_all, tex_coord_tweak, dx, dy).xyz * 2.0f - 1.0f;
+    //return g_normal_map.SampleGrad(g_sample_linear_all, float3(tex_coord_tweak, slice), dx, dy);
+    // only xy is stored (BC5 for baked normals), z is rebuilt from the unit length
+    float2 N_xy = material_sample_grad(g_normal_map, g_vt_normal_cache, slice, tex_coord_tweak, dx, dy).xy * 2.0f - 1.0f;
+    N = float3(N_xy, sqrt(saturate(1.0f - dot(N_xy, N_xy))));
     N = normalize(mul(ps_inp.TBN_to_world, N));
   }
 
-  float shadow_multiplier = 0.0f;
+  bool lightmapped = permutation_lightmapped(ps_inp.lightmapped != 0) && (permutation_directional_lights(directional_light_count) > 0);
+  float shadow_multiplier = 1.0f;
+  if (permutation_receives_shadow(ps_inp.receives_shadow != 0) && !lightmapped)
   {
-    Light light         = lights[0];
-    float4 light_p      = mul(light.world_to_light, float4(ps_inp.world_p, 1.0f));
-    light_p             = mul(light.projection, light_p);
-    light_p.xyz        /= light_p.w;
+    Light light         = g_lights[0];
 
-    if (light_p.z > 1)
-    {
-      shadow_multiplier = 1.0f;
-    }
-    else
+    // the first cascade that holds the pixel with room for the PCF footprint;
+    // past the last one the pixel is lit
+    uint   cascade      = Shadow_CascadeCount;
+    float3 light_p      = 0;
+    float  texel_margin = 3.0f / Shadow_MapSize;
+    [unroll]
+    for (uint cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
     {
-      float  bias           = max(0.005f * (1.0f - dot(N, -light.dir)), 0.0005f);
-      float  current_depth  = light_p.z - bias;
-      float2 shadow_tex_p   = float2(light_p.x * 0.5f + 0.5f, 1.0f - (light_p.y * 0.5f + 0.5f));
-      float2 texel_size     = 1.0f / 1024.0f;
-      float2 texel_p        = shadow_tex_p * 1024.0f;
-      //float4 subpixel       = float4(frac(texel_p), 1.0f - frac(texel_p));
-      //float4 bilinear       = subpixel.zxzx * subpixel.wwyy;
-      float2 t              = frac(texel_p);
-      
-      [unroll]  
-      for(int x = -1; x <= 1; ++x)
+      float3 cascade_p = mul(cascade_world_to_clip[cascade_idx], float4(ps_inp.world_p, 1.0f)).xyz;
+      if ((cascade == Shadow_CascadeCount) && all(abs(cascade_p.xy) <= (1.0f - texel_margin)))
       {
-        [unroll]  
-        for(int y = -1; y <= 1; ++y)
-        {
-          float2 uv            = shadow_tex_p + float2(x, y) * texel_size;
-          float s0             = g_shadow_map.Sample(g_sample_point_all, uv).r;
-          float s1             = g_shadow_map.Sample(g_sample_point_all, uv + float2(texel_size.x, 0.0f)).r;
-          float s2             = g_shadow_map.Sample(g_sample_point_all, uv + float2(0.0f, texel_size.y)).r;
-          float s3             = g_shadow_map.Sample(g_sample_point_all, uv + texel_size).r;
-          float4 tests         = (current_depth < float4(s0, s1, s2, s3)) ? 1.0f : 0.4f;
-          //shadow_multiplier   += dot(bilinear, tests);
-	  shadow_multiplier   += lerp(lerp(tests.x, tests.y, t.x), lerp(tests.z, tests.w, t.x), t.y);
-        }
+        cascade = cascade_idx;
+        light_p = cascade_p;
       }
+    }
 
-      shadow_multiplier /= 9.0f;
+    if (cascade < Shadow_CascadeCount)
+    {
+      float  slope          = 1.0f - saturate(dot(N, -normalize(light.dir)));
+      float  bias           = cascade_depth_bias[cascade] * (1.0f + 4.0f * slope);
+      // the depth range only spans the casters: nearer is lit, further is
+      // behind all of them
+      float  current_depth  = saturate(light_p.z) - bias;
+      float2 shadow_tex_p   = float2(light_p.x * 0.5f + 0.5f, 1.0f - (light_p.y * 0.5f + 0.5f));
+      shadow_multiplier     = lerp(0.4f, 1.0f, shadow_filter(cascade, shadow_tex_p, current_depth));
     }
   }
 
-  float M_diffuse     = 1.0f;
-  float M_specular    = 0.5f;
   float M_ambient     = 1.0f;
-  float M_shininess   = 8.0f;
   
   float4 final_colour = 0;
-  if (ps_inp.enable_lighting)
+  if (permutation_lit(ps_inp.enable_lighting != 0))
   {
-    [unroll]
-    for (uint light_idx = 0; light_idx < light_count; ++light_idx)
+#if !defined(Permutation_DirectionalLights) || (Permutation_DirectionalLights > 0)
+    uint first_light = 0;
+    if (lightmapped)
     {
-      Light light = lights[light_idx];
-      
-      switch (light.type)
+      float4 lightmap = g_lightmap.SampleLevel(g_sample_linear_all, ps_inp.lightmap_uv, 0.0f);
+      final_colour    = saturate(shade_lightmapped_light(g_lights[0], lightmap, N, to_eye, sample_colour));
+      first_light     = 1;
+    }
+
+    Permutation_DirectionalLoop
+    for (uint light_idx = first_light; light_idx < permutation_directional_lights(directional_light_count); ++light_idx)
+    {
+      final_colour = saturate(shade_directional_light(g_lights[light_idx], N, to_eye, sample_colour, shadow_multiplier) + final_colour);
+    }
+#endif
+
+    if (permutation_clustered_lights(true))
+    {
+      // SV_Position.w is the view depth
+      uint2 tile    = min(uint2(ps_inp.p.xy * cluster_tiles_per_pixel), uint2(LightCluster_TilesX - 1, LightCluster_TilesY - 1));
+      uint  slice   = (uint)clamp(floor(log(ps_inp.p.w) * cluster_z_scale + cluster_z_bias), 0.0f, LightCluster_Slices - 1.0f);
+      uint2 cluster = g_light_clusters[(slice * LightCluster_TilesY + tile.y) * LightCluster_TilesX + tile.x];
+      [loop]
+      for (uint index_idx = cluster.x; index_idx < cluster.x + cluster.y; ++index_idx)
       {
-        case LightType_Directional:
-        {
-          float3 L          = normalize(light.dir);
-          float3 R          = normalize(reflect(L, N));
-          float3 H          = normalize(-L + to_eye);
-          float n_dot_l     = max(dot(N, -L), 0.0f);
-          //float r_dot_v     = max(dot(to_eye, R), 0.0f);
-          float r_dot_v     = max(dot(N, H), 0.0f);
-          
-          float4 diffuse    = M_diffuse * light.intensity * n_dot_l * sample_colour;
-          float4 specular   = M_specular * pow(r_dot_v, M_shininess) * light.intensity;
-          
-          final_colour      = saturate((diffuse + specular) * shadow_multiplier + final_colour);
-          //sample_colour.xyz *= n_dot_l;
-        } break;
-        
-        case LightType_Point:
-        {
-          float3 L        = light.P - ps_inp.world_p;
-          float  dist     = length(L);
-          L              /= dist;        
-          float r0        = 5.0f;
-          float rmax      = 50.0f;
-          float win       = pow(max(1.0f - pow(dist / rmax, 4.0f), 0.0f), 2.0f);
-          float atten     = win*(r0*r0 / (dist*dist + 0.01f));
-          
-          float3 R        = normalize(reflect(-L, N));
-          float3 H          = normalize(L + to_eye);
-          
-          float n_dot_l     = max(dot(N, L), 0.0f);
-          float r_dot_v     = max(dot(N, H), 0.0f);
-          
-          float4 diffuse    = M_diffuse * light.intensity * n_dot_l * sample_colour;
-          float4 specular   = M_specular * pow(r_dot_v, M_shininess) * light.intensity;
-          
-          final_colour      = saturate((diffuse + specular)*atten + final_colour);
-        } break;
+        final_colour = saturate(shade_local_light(g_lights[g_light_indices[index_idx]], ps_inp.world_p, N, to_eye, sample_colour) + final_colour);
       }
     }
   }
@@ -378,6 +747,26 @@ float4 ps_main(VertexShader_Output ps_inp) : SV_Target
     final_colour = sample_colour;
   }
   
-  final_colour = saturate(M_ambient * float4(0.1f, 0.1f, 0.1f, 1.0f) * sample_colour + final_colour);
+  // a lightmap already holds the light bounced around the scene, so only
+  // the rest takes it from the volume
+  float3 ambient_rgb = 0.1f.xxx;
+  if ((enable_irradiance_volume != 0) && permutation_lit(ps_inp.enable_lighting != 0) && !lightmapped)
+  {
+    ambient_rgb = irradiance_volume_sample(ps_inp.world_p, N);
+  }
+  float4 ambient = float4(ambient_rgb * ps_inp.ambient_occlusion, 1.0f);
+  final_colour = saturate(M_ambient * ambient * sample_colour + final_colour);
+
+  // the probe was baked without this instance, so it only holds the rest of
+  // the scene; Schlick weights it up at grazing angles
+  if (permutation_reflective((enable_reflections != 0) && (ps_inp.reflection_probe != ReflectionProbe_None)))
+  {
+    float  M_reflectance = 0.6f;
+    float3 R             = reflect(-to_eye, N);
+    float  mip           = ps_inp.reflection_roughness * (ReflectionProbe_MipCount - 1);
+    float3 reflected     = g_reflection_probes.SampleLevel(g_sample_linear_all, float4(R, ps_inp.reflection_probe), mip).rgb;
+    float  fresnel       = M_reflectance + (1.0f - M_reflectance) * pow(1.0f - saturate(dot(N, to_eye)), 5.0f);
+    final_colour.rgb     = lerp(final_colour.rgb, reflected * sample_colour.rgb, fresnel);
+  }
   return final_colour;
 }
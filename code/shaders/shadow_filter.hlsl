@@ -0,0 +1,126 @@
+// Shadow map kernels for ps_main, mirrored on the CPU by shadow_filter.c (see
+// shadow_filter.h for what each one is). Each returns the lit fraction of a
+// receiver at uv in cascade slice with the given light clip depth. Included
+// by shader_main.hlsl after g_shadow_map and the samplers.
+
+#define ShadowFilter_Point         0
+#define ShadowFilter_Hardware      1
+#define ShadowFilter_Gather        2
+#define ShadowFilter_Poisson       3
+#define ShadowFilter_PoissonTaps   12
+#define ShadowFilter_PoissonRadius 1.5f
+
+#if !defined(ShadowFilter_Kernel)
+# define ShadowFilter_Kernel ShadowFilter_Gather
+#endif
+
+static const float2 g_shadow_filter_poisson[ShadowFilter_PoissonTaps] =
+{
+  float2(-0.326212f, -0.405805f), float2(-0.840144f, -0.073580f), float2(-0.695914f,  0.457137f),
+  float2(-0.203345f,  0.620716f), float2( 0.962340f, -0.194983f), float2( 0.473434f, -0.480026f),
+  float2( 0.519456f,  0.767022f), float2( 0.185461f, -0.893124f), float2( 0.507431f,  0.064425f),
+  float2( 0.896420f,  0.412458f), float2(-0.321940f, -0.932615f), float2(-0.791559f, -0.597705f),
+};
+
+float
+shadow_filter_point(uint slice, float2 uv, float depth)
+{
+  float2 texel_size = 1.0f / Shadow_MapSize;
+  float2 t          = frac(uv * Shadow_MapSize);
+  float  result     = 0.0f;
+  [unroll]
+  for (int y = -1; y <= 1; ++y)
+  {
+    [unroll]
+    for (int x = -1; x <= 1; ++x)
+    {
+      float2 tap   = uv + float2(x, y) * texel_size;
+      float  s0    = g_shadow_map.Sample(g_sample_point_all, float3(tap, slice));
+      float  s1    = g_shadow_map.Sample(g_sample_point_all, float3(tap + float2(texel_size.x, 0.0f), slice));
+      float  s2    = g_shadow_map.Sample(g_sample_point_all, float3(tap + float2(0.0f, texel_size.y), slice));
+      float  s3    = g_shadow_map.Sample(g_sample_point_all, float3(tap + texel_size, slice));
+      float4 tests = (depth < float4(s0, s1, s2, s3)) ? 1.0f : 0.0f;
+      result      += lerp(lerp(tests.x, tests.y, t.x), lerp(tests.z, tests.w, t.x), t.y);
+    }
+  }
+
+  return(result / 9.0f);
+}
+
+float
+shadow_filter_hardware(uint slice, float2 uv, float depth)
+{
+  float2 texel_size = 1.0f / Shadow_MapSize;
+  float  result     = 0.0f;
+  [unroll]
+  for (int y = -1; y <= 1; ++y)
+  {
+    [unroll]
+    for (int x = -1; x <= 1; ++x)
+    {
+      result += g_shadow_map.SampleCmpLevelZero(sampler_shadow, float3(uv + float2(x, y) * texel_size, slice), depth);
+    }
+  }
+
+  return(result / 9.0f);
+}
+
+float
+shadow_filter_gather(uint slice, float2 uv, float depth)
+{
+  // summing the 3x3 bilinear taps weighs texels base - 1 .. base + 2 by
+  // 1 - t, 1, 1, t along each axis; each GatherCmp reads one 2x2 quad of them
+  float2 texel_size = 1.0f / Shadow_MapSize;
+  float2 texel_p    = uv * Shadow_MapSize - 0.5f;
+  float2 base       = floor(texel_p);
+  float2 t          = texel_p - base;
+  float4 weights_x  = float4(1.0f - t.x, 1.0f, 1.0f, t.x);
+  float4 weights_y  = float4(1.0f - t.y, 1.0f, 1.0f, t.y);
+  float  result     = 0.0f;
+  [unroll]
+  for (int y = 0; y < 2; ++y)
+  {
+    [unroll]
+    for (int x = 0; x < 2; ++x)
+    {
+      // w z on the quad's top row, x y on the bottom one
+      float2 quad_uv = (base + float2(2 * x, 2 * y)) * texel_size;
+      float4 tests   = g_shadow_map.GatherCmp(sampler_shadow, float3(quad_uv, slice), depth);
+      float2 w_x     = float2(weights_x[2 * x], weights_x[2 * x + 1]);
+      float2 w_y     = float2(weights_y[2 * y], weights_y[2 * y + 1]);
+      result        += w_y.x * dot(w_x, tests.wz) + w_y.y * dot(w_x, tests.xy);
+    }
+  }
+
+  return(result / 9.0f);
+}
+
+float
+shadow_filter_poisson(uint slice, float2 uv, float depth)
+{
+  float2 texel_size = 1.0f / Shadow_MapSize;
+  float  result     = 0.0f;
+  [unroll]
+  for (uint tap_idx = 0; tap_idx < ShadowFilter_PoissonTaps; ++tap_idx)
+  {
+    float2 tap = uv + g_shadow_filter_poisson[tap_idx] * ShadowFilter_PoissonRadius * texel_size;
+    result    += g_shadow_map.SampleCmpLevelZero(sampler_shadow, float3(tap, slice), depth);
+  }
+
+  return(result / ShadowFilter_PoissonTaps);
+}
+
+float
+shadow_filter(uint slice, float2 uv, float depth)
+{
+#if ShadowFilter_Kernel == ShadowFilter_Point
+  float result = shadow_filter_point(slice, uv, depth);
+#elif ShadowFilter_Kernel == ShadowFilter_Hardware
+  float result = shadow_filter_hardware(slice, uv, depth);
+#elif ShadowFilter_Kernel == ShadowFilter_Gather
+  float result = shadow_filter_gather(slice, uv, depth);
+#else
+  float result = shadow_filter_poisson(slice, uv, depth);
+#endif
+  return(result);
+}
@@ -0,0 +1,282 @@
+// splits holds Shadow_CascadeCount + 1 distances, blending the uniform and
+// logarithmic schemes so near cascades stay small without starving far ones.
+static void
+shadow_compute_splits(f32 near_plane, f32 far_plane, f32 *splits)
+{
+  splits[0] = near_plane;
+  for (u32 split_idx = 1; split_idx < Shadow_CascadeCount; ++split_idx)
+  {
+    f32 fraction    = (f32)split_idx / (f32)Shadow_CascadeCount;
+    f32 logarithmic = near_plane * powf(far_plane / near_plane, fraction);
+    f32 uniform     = near_plane + (far_plane - near_plane) * fraction;
+    splits[split_idx] = Shadow_SplitLambda * logarithmic + (1.0f - Shadow_SplitLambda) * uniform;
+  }
+  splits[Shadow_CascadeCount] = far_plane;
+}
+
+// Light space box around every caster's bounding sphere, grown out to
+// Shadow_BoundsSnap so casters moving a little do not refit the cascades.
+static void
+shadow_fit_caster_bounds(Shadow_Cascades *shadows, Scene_Instances *scene)
+{
+  shadows->has_casters = false;
+  for (u32 instance_idx = 0; instance_idx < scene->instance_count; ++instance_idx)
+  {
+    if (!scene->ins[instance_idx].casts_shadow)
+    {
+      continue;
+    }
+
+    Scene_Instance_Info *info = scene->info + instance_idx;
+    v3f light_p = m44_transform_point(shadows->light_view, info->bound_p);
+    v3f min_p   = v3f_sub(light_p, v3f_s(info->bound_radius));
+    v3f max_p   = v3f_add(light_p, v3f_s(info->bound_radius));
+    if (!shadows->has_casters)
+    {
+      shadows->caster_min  = min_p;
+      shadows->caster_max  = max_p;
+      shadows->has_casters = true;
+    }
+
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      shadows->caster_min.v[axis] = Minimum(shadows->caster_min.v[axis], min_p.v[axis]);
+      shadows->caster_max.v[axis] = Maximum(shadows->caster_max.v[axis], max_p.v[axis]);
+    }
+  }
+
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    shadows->caster_min.v[axis] = f32_snap_down(shadows->caster_min.v[axis], Shadow_BoundsSnap);
+    shadows->caster_max.v[axis] = -f32_snap_down(-shadows->caster_max.v[axis], Shadow_BoundsSnap);
+  }
+}
+
+// The part of [center - radius, center + radius] the casters reach along a
+// light space axis; empty (min > max) when they miss it.
+static void
+shadow_caster_range(Shadow_Cascades *shadows, u32 axis, f32 center, f32 radius, f32 *min, f32 *max)
+{
+  *min = center - radius;
+  *max = center + radius;
+  if (shadows->has_casters)
+  {
+    *min = Maximum(*min, shadows->caster_min.v[axis]);
+    *max = Minimum(*max, shadows->caster_max.v[axis]);
+  }
+}
+
+static void
+shadow_fit_cascades(Shadow_Cascades *shadows, v3f light_dir, v3f camera_p, v3f camera_front,
+                    f32 tan_half_fov_x, f32 tan_half_fov_y, f32 near_plane, Scene_Instances *scene)
+{
+  v3f temp_up = (v3f){ 0.0f, 1.0f, 0.0f };
+  if (fabsf(v3f_inner(v3f_normalized(light_dir), temp_up)) > 0.99f)
+  {
+    temp_up = (v3f){ 1.0f, 0.0f, 0.0f };
+  }
+
+  Basis_R3 light_basis = br3_from_center_to_target(v3f_zero(), light_dir, temp_up);
+  m44      light_view  = m44_make_view_from_basis(light_basis, v3f_zero());
+  b32      keep_fits   = shadows->fitted && m44_equal(light_view, shadows->light_view);
+  shadows->light_view  = light_view;
+  shadows->fitted      = true;
+
+  v3f old_caster_min = shadows->caster_min;
+  v3f old_caster_max = shadows->caster_max;
+  b32 had_casters    = shadows->has_casters;
+  shadow_fit_caster_bounds(shadows, scene);
+  keep_fits = keep_fits && (had_casters == shadows->has_casters) &&
+              v3f_equal(old_caster_min, shadows->caster_min) && v3f_equal(old_caster_max, shadows->caster_max);
+
+  // the square never needs to be wider than the casters, plus the texel the
+  // snap can slide it by
+  f32 caster_radius = 0.5f * Maximum(shadows->caster_max.x - shadows->caster_min.x,
+                                     shadows->caster_max.y - shadows->caster_min.y);
+  caster_radius     = ceilf(caster_radius / (1.0f - 2.0f / (f32)Shadow_MapSize) * 16.0f) / 16.0f;
+
+  f32 splits[Shadow_CascadeCount + 1];
+  shadow_compute_splits(near_plane, Shadow_MaxDistance, splits);
+  for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+  {
+    Shadow_Cascade *cascade = shadows->cascades + cascade_idx;
+    Sphere sphere = frustum_slice_bounding_sphere(camera_p, camera_front, tan_half_fov_x, tan_half_fov_y,
+                                                  splits[cascade_idx], splits[cascade_idx + 1]);
+
+    // rounded up so float noise in the fit never resizes the cascade
+    f32 sphere_radius = ceilf(sphere.radius * (1.0f + Shadow_RefitMargin) * 16.0f) / 16.0f;
+    f32 radius        = sphere_radius;
+    if (shadows->has_casters)
+    {
+      radius = Minimum(radius, caster_radius);
+    }
+
+    // the kept square still holds what the casters can reach of the sphere
+    v3f center = m44_transform_point(light_view, sphere.center);
+    if (keep_fits && (cascade->radius == radius))
+    {
+      b32 covered = true;
+      for (u32 axis = 0; axis < 2; ++axis)
+      {
+        f32 min, max;
+        shadow_caster_range(shadows, axis, center.v[axis], sphere.radius, &min, &max);
+        covered &= (min > max) || ((cascade->center.v[axis] - radius <= min) && (cascade->center.v[axis] + radius >= max));
+      }
+
+      f32 min_z, max_z;
+      shadow_caster_range(shadows, 2, center.z, sphere.radius, &min_z, &max_z);
+      covered &= (cascade->far_plane >= max_z);
+      if (covered)
+      {
+        continue;
+      }
+    }
+
+    cascade->radius           = radius;
+    cascade->texel_world_size = (2.0f * cascade->radius) / (f32)Shadow_MapSize;
+    cascade->split_near       = splits[cascade_idx];
+    cascade->split_far        = splits[cascade_idx + 1];
+
+    // slid as little as it takes to hold the casters' part of the margined
+    // sphere, then snapped to texels
+    for (u32 axis = 0; axis < 2; ++axis)
+    {
+      f32 min, max;
+      shadow_caster_range(shadows, axis, center.v[axis], sphere_radius, &min, &max);
+      f32 lowest = center.v[axis];
+      if (min <= max)
+      {
+        lowest         = max - radius;
+        center.v[axis] = Maximum(center.v[axis], lowest);
+        center.v[axis] = Minimum(center.v[axis], min + radius);
+      }
+
+      // the caster radius leaves at least two texels to land in
+      center.v[axis] = f32_snap_down(center.v[axis], cascade->texel_world_size);
+      if (center.v[axis] < lowest)
+      {
+        center.v[axis] += cascade->texel_world_size;
+      }
+    }
+
+    // nothing nearer the light than the casters needs depth, and nothing
+    // past both them and the sphere; z is snapped so the range only changes
+    // when the square moves
+    center.z            = f32_snap_down(center.z, cascade->texel_world_size);
+    cascade->center     = center;
+    cascade->near_plane = center.z - sphere_radius;
+    cascade->far_plane  = center.z + sphere_radius;
+    if (shadows->has_casters)
+    {
+      cascade->near_plane = shadows->caster_min.z;
+      cascade->far_plane  = Minimum(cascade->far_plane, shadows->caster_max.z);
+      cascade->far_plane  = Maximum(cascade->far_plane, cascade->near_plane + cascade->texel_world_size);
+    }
+
+    m44 projection = m44_make_orthographic_z01(center.x - cascade->radius, center.x + cascade->radius,
+                                               center.y - cascade->radius, center.y + cascade->radius,
+                                               cascade->near_plane, cascade->far_plane);
+    cascade->world_to_clip = m44_mul(shadows->light_view, projection);
+  }
+}
+
+static f32
+shadow_texels_per_unit(Shadow_Cascade *cascade)
+{
+  f32 result = 1.0f / cascade->texel_world_size;
+  return(result);
+}
+
+static b32
+shadow_cascade_overlaps_sphere(Shadow_Cascades *shadows, u32 cascade_idx, v3f p, f32 radius)
+{
+  Shadow_Cascade *cascade = shadows->cascades + cascade_idx;
+  v3f light_p = m44_transform_point(shadows->light_view, p);
+  f32 reach   = cascade->radius + radius;
+  b32 result  = (fabsf(light_p.x - cascade->center.x) <= reach) &&
+                (fabsf(light_p.y - cascade->center.y) <= reach) &&
+                (light_p.z + radius >= cascade->near_plane) &&
+                (light_p.z - radius <= cascade->far_plane);
+  return(result);
+}
+
+static b32
+shadow_scene_has_receivers(Scene_Instances *scene)
+{
+  b32 result = false;
+  for (u32 instance_idx = 0; !result && (instance_idx < scene->instance_count); ++instance_idx)
+  {
+    Model_Instance *instance = scene->ins + instance_idx;
+    result = instance->enable_lighting && instance->receives_shadow && (instance->lightmap_first_chart == Lightmap_None);
+  }
+
+  return(result);
+}
+
+// Copies the shadow casters that can land in a cascade, keeping batch order
+// so the result draws like the scene it came from.
+static void
+shadow_cull_scene(Shadow_Cascades *shadows, u32 cascade_idx, Scene_Instances *scene,
+                  u32 first_instance, u32 end_instance, Scene_Instances *out)
+{
+  out->instance_count = 0;
+  out->batch_count    = 0;
+  for (u32 batch_idx = 0; batch_idx < scene->batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch     = scene->batches + batch_idx;
+    Scene_Batch *out_batch = out->batches + out->batch_count;
+    *out_batch                = *batch;
+    out_batch->first_instance = out->instance_count;
+    out_batch->instance_count = 0;
+    u32 batch_begin = Maximum(batch->first_instance, first_instance);
+    u32 batch_end   = Minimum(batch->first_instance + batch->instance_count, end_instance);
+    for (u32 instance_idx = batch_begin; instance_idx < batch_end; ++instance_idx)
+    {
+      Scene_Instance_Info *info = scene->info + instance_idx;
+      if (scene->ins[instance_idx].casts_shadow &&
+          shadow_cascade_overlaps_sphere(shadows, cascade_idx, info->bound_p, info->bound_radius))
+      {
+        out->ins[out->instance_count]  = scene->ins[instance_idx];
+        out->info[out->instance_count] = *info;
+        ++out->instance_count;
+        ++out_batch->instance_count;
+      }
+    }
+
+    if (out_batch->instance_count)
+    {
+      ++out->batch_count;
+    }
+  }
+}
+
+static b32
+shadow_cache_needs_static_redraw(Shadow_Cache *cache, Shadow_Cascades *shadows, u32 cascade_idx, u32 static_generation)
+{
+  Shadow_Cache_Slice *slice   = cache->slices + cascade_idx;
+  Shadow_Cascade     *cascade = shadows->cascades + cascade_idx;
+  b32 result = !slice->valid || (slice->static_generation != static_generation) ||
+               !m44_equal(slice->world_to_clip, cascade->world_to_clip);
+  if (result)
+  {
+    slice->world_to_clip     = cascade->world_to_clip;
+    slice->static_generation = static_generation;
+    slice->valid             = true;
+    ++cache->static_redraws[cascade_idx];
+  }
+  else
+  {
+    ++cache->static_skips[cascade_idx];
+  }
+
+  return(result);
+}
+
+static void
+shadow_cache_invalidate(Shadow_Cache *cache)
+{
+  for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+  {
+    cache->slices[cascade_idx].valid = false;
+  }
+}
@@ -0,0 +1,98 @@
+#if !defined(SHADOW_H)
+#define SHADOW_H
+
+// Cascaded shadow maps for the directional light. The view range up to
+// Shadow_MaxDistance is split into Shadow_CascadeCount slices, each covered
+// by its own Shadow_MapSize square slice of a Texture2DArray.
+//
+// Every cascade is fitted to the bounding sphere of its frustum slice rather
+// than the slice itself. The sphere's radius is fixed for a given field of
+// view, so the cascade never changes size as the camera turns, and its
+// centre is snapped to whole shadow map texels in light space, so moving the
+// camera slides the map in whole texel steps and edges do not shimmer.
+//
+// Nothing outside the casters' light space box can throw or catch a shadow,
+// so each square shrinks to that box when it is the smaller of the two and
+// slides to hold only the part of the sphere the casters reach, and the
+// depth range runs from the nearest caster to the furthest one the slice can
+// see. Both only change with the casters, which keeps the texels as stable
+// as the sphere fit. Receivers past the depth range clamp to it in ps_main.
+//
+// Static casters are drawn into a second, persistent array and only redrawn
+// when a cascade's fit, the light or the static geometry changes; every
+// frame copies that slice into the live map and adds the dynamic casters on
+// top. To keep the fits still while the camera walks, each cascade is
+// Shadow_RefitMargin bigger than its sphere and only re-centres once the
+// sphere wanders out of that margin.
+
+#define Shadow_CascadeCount   4
+#define Shadow_MapSize        1024
+#define Shadow_MaxDistance    120.0f
+// 0 is a uniform split, 1 logarithmic
+#define Shadow_SplitLambda    0.8f
+// the caster box grows out to this grid so small moves keep the fits
+#define Shadow_BoundsSnap     1.0f
+// fraction of a cascade's radius its sphere may drift before it re-centres
+#define Shadow_RefitMargin    0.125f
+
+typedef struct
+{
+  m44 world_to_clip;
+  // light view space, centre snapped to texels
+  v3f center;
+  // half the side of the square
+  f32 radius;
+  f32 near_plane;
+  f32 far_plane;
+  f32 texel_world_size;
+  f32 split_near;
+  f32 split_far;
+} Shadow_Cascade;
+
+typedef struct
+{
+  // rotation only, so snapping in light space is snapping in a fixed grid
+  m44            light_view;
+  Shadow_Cascade cascades[Shadow_CascadeCount];
+  // light view space box of every caster, valid when has_casters is set
+  v3f            caster_min;
+  v3f            caster_max;
+  b32            has_casters;
+  // the cascades above can be kept; zero-initialised fits start over
+  b32            fitted;
+} Shadow_Cascades;
+
+// What a cached static slice was drawn with.
+typedef struct
+{
+  m44 world_to_clip;
+  u32 static_generation;
+  b32 valid;
+} Shadow_Cache_Slice;
+
+typedef struct
+{
+  Shadow_Cache_Slice slices[Shadow_CascadeCount];
+  u64                static_redraws[Shadow_CascadeCount];
+  u64                static_skips[Shadow_CascadeCount];
+  u64                dynamic_instances;
+} Shadow_Cache;
+
+static void shadow_compute_splits(f32 near_plane, f32 far_plane, f32 *splits);
+static void shadow_fit_cascades(Shadow_Cascades *shadows, v3f light_dir, v3f camera_p, v3f camera_front,
+                                f32 tan_half_fov_x, f32 tan_half_fov_y, f32 near_plane, Scene_Instances *scene);
+// shadow map texels along one world unit
+static f32  shadow_texels_per_unit(Shadow_Cascade *cascade);
+static b32  shadow_cascade_overlaps_sphere(Shadow_Cascades *shadows, u32 cascade_idx, v3f p, f32 radius);
+// culls the casters in [first_instance, end_instance)
+static void shadow_cull_scene(Shadow_Cascades *shadows, u32 cascade_idx, Scene_Instances *scene,
+                              u32 first_instance, u32 end_instance, Scene_Instances *out);
+// Whether any instance would sample the cascades: a lit one that receives
+// shadows and has no lightmap to take its directional light from. Without
+// one the whole shadow pass can be skipped.
+static b32  shadow_scene_has_receivers(Scene_Instances *scene);
+// counts the redraw or skip and records the new key when it redraws
+static b32  shadow_cache_needs_static_redraw(Shadow_Cache *cache, Shadow_Cascades *shadows, u32 cascade_idx, u32 static_generation);
+static void shadow_cache_invalidate(Shadow_Cache *cache);
+
+#endif
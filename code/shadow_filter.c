@@ -0,0 +1,205 @@
+static v2f g_shadow_filter_poisson[ShadowFilter_PoissonTaps] =
+{
+  { -0.326212f, -0.405805f }, { -0.840144f, -0.073580f }, { -0.695914f,  0.457137f },
+  { -0.203345f,  0.620716f }, {  0.962340f, -0.194983f }, {  0.473434f, -0.480026f },
+  {  0.519456f,  0.767022f }, {  0.185461f, -0.893124f }, {  0.507431f,  0.064425f },
+  {  0.896420f,  0.412458f }, { -0.321940f, -0.932615f }, { -0.791559f, -0.597705f },
+};
+
+static char *
+shadow_filter_name(Shadow_Filter filter)
+{
+  char *result = "unknown";
+  switch (filter)
+  {
+    case ShadowFilter_Point:
+    {
+      result = "point";
+    } break;
+
+    case ShadowFilter_Hardware:
+    {
+      result = "hardware";
+    } break;
+
+    case ShadowFilter_Gather:
+    {
+      result = "gather";
+    } break;
+
+    case ShadowFilter_Poisson:
+    {
+      result = "poisson";
+    } break;
+  }
+
+  return(result);
+}
+
+static u32
+shadow_filter_tap_count(Shadow_Filter filter)
+{
+  u32 result = 0;
+  switch (filter)
+  {
+    case ShadowFilter_Point:
+    {
+      result = 36;
+    } break;
+
+    case ShadowFilter_Hardware:
+    {
+      result = 9;
+    } break;
+
+    case ShadowFilter_Gather:
+    {
+      result = 4;
+    } break;
+
+    case ShadowFilter_Poisson:
+    {
+      result = ShadowFilter_PoissonTaps;
+    } break;
+  }
+
+  return(result);
+}
+
+// LESS comparison: lit when the receiver is in front of the stored caster
+static f32
+shadow_filter_compare(Shadow_Filter_Map *map, s32 x, s32 y, f32 depth)
+{
+  f32 result = 1.0f;
+  if ((x >= 0) && (y >= 0) && ((u32)x < map->size) && ((u32)y < map->size))
+  {
+    result = (depth < map->depths[(u32)y * map->size + (u32)x]) ? 1.0f : 0.0f;
+  }
+
+  return(result);
+}
+
+static f32
+shadow_filter_compare_point(Shadow_Filter_Map *map, v2f uv, f32 depth)
+{
+  ++map->fetches;
+  f32 result = shadow_filter_compare(map, (s32)floorf(uv.x * (f32)map->size), (s32)floorf(uv.y * (f32)map->size), depth);
+  return(result);
+}
+
+// what GatherCmp returns for the 2x2 quad at texel (x, y): w z on its top row,
+// x y on the bottom one
+static v4f
+shadow_filter_compare_quad(Shadow_Filter_Map *map, s32 x, s32 y, f32 depth)
+{
+  ++map->fetches;
+  v4f result =
+  {
+    shadow_filter_compare(map, x, y + 1, depth),
+    shadow_filter_compare(map, x + 1, y + 1, depth),
+    shadow_filter_compare(map, x + 1, y, depth),
+    shadow_filter_compare(map, x, y, depth),
+  };
+  return(result);
+}
+
+// what SampleCmpLevelZero returns through a linear comparison sampler
+static f32
+shadow_filter_compare_linear(Shadow_Filter_Map *map, v2f uv, f32 depth)
+{
+  ++map->fetches;
+  f32 texel_x = uv.x * (f32)map->size - 0.5f;
+  f32 texel_y = uv.y * (f32)map->size - 0.5f;
+  s32 x       = (s32)floorf(texel_x);
+  s32 y       = (s32)floorf(texel_y);
+  f32 t_x     = texel_x - (f32)x;
+  f32 t_y     = texel_y - (f32)y;
+  f32 top     = (1.0f - t_x) * shadow_filter_compare(map, x, y, depth)     + t_x * shadow_filter_compare(map, x + 1, y, depth);
+  f32 bottom  = (1.0f - t_x) * shadow_filter_compare(map, x, y + 1, depth) + t_x * shadow_filter_compare(map, x + 1, y + 1, depth);
+  f32 result  = (1.0f - t_y) * top + t_y * bottom;
+  return(result);
+}
+
+static f32
+shadow_filter_lit(Shadow_Filter_Map *map, Shadow_Filter filter, v2f uv, f32 depth)
+{
+  f32 texel_size = 1.0f / (f32)map->size;
+  f32 result     = 0.0f;
+  switch (filter)
+  {
+    case ShadowFilter_Point:
+    {
+      f32 t_x = uv.x * (f32)map->size - floorf(uv.x * (f32)map->size);
+      f32 t_y = uv.y * (f32)map->size - floorf(uv.y * (f32)map->size);
+      for (s32 y = -1; y <= 1; ++y)
+      {
+        for (s32 x = -1; x <= 1; ++x)
+        {
+          v2f tap    = { uv.x + (f32)x * texel_size, uv.y + (f32)y * texel_size };
+          f32 s0     = shadow_filter_compare_point(map, tap, depth);
+          f32 s1     = shadow_filter_compare_point(map, (v2f){ tap.x + texel_size, tap.y }, depth);
+          f32 s2     = shadow_filter_compare_point(map, (v2f){ tap.x, tap.y + texel_size }, depth);
+          f32 s3     = shadow_filter_compare_point(map, (v2f){ tap.x + texel_size, tap.y + texel_size }, depth);
+          f32 top    = (1.0f - t_x) * s0 + t_x * s1;
+          f32 bottom = (1.0f - t_x) * s2 + t_x * s3;
+          result    += (1.0f - t_y) * top + t_y * bottom;
+        }
+      }
+
+      result /= 9.0f;
+    } break;
+
+    case ShadowFilter_Hardware:
+    {
+      for (s32 y = -1; y <= 1; ++y)
+      {
+        for (s32 x = -1; x <= 1; ++x)
+        {
+          result += shadow_filter_compare_linear(map, (v2f){ uv.x + (f32)x * texel_size, uv.y + (f32)y * texel_size }, depth);
+        }
+      }
+
+      result /= 9.0f;
+    } break;
+
+    case ShadowFilter_Gather:
+    {
+      // summing the 3x3 bilinear taps weighs texels base - 1 .. base + 2 by
+      // 1 - t, 1, 1, t along each axis
+      f32 texel_x = uv.x * (f32)map->size - 0.5f;
+      f32 texel_y = uv.y * (f32)map->size - 0.5f;
+      s32 base_x  = (s32)floorf(texel_x);
+      s32 base_y  = (s32)floorf(texel_y);
+      f32 t_x     = texel_x - (f32)base_x;
+      f32 t_y     = texel_y - (f32)base_y;
+      f32 weights_x[4] = { 1.0f - t_x, 1.0f, 1.0f, t_x };
+      f32 weights_y[4] = { 1.0f - t_y, 1.0f, 1.0f, t_y };
+      for (s32 y = 0; y < 2; ++y)
+      {
+        for (s32 x = 0; x < 2; ++x)
+        {
+          v4f tests = shadow_filter_compare_quad(map, base_x - 1 + 2 * x, base_y - 1 + 2 * y, depth);
+          f32 w_x0  = weights_x[2 * x];
+          f32 w_x1  = weights_x[2 * x + 1];
+          result   += weights_y[2 * y] * (w_x0 * tests.w + w_x1 * tests.z) + weights_y[2 * y + 1] * (w_x0 * tests.x + w_x1 * tests.y);
+        }
+      }
+
+      result /= 9.0f;
+    } break;
+
+    case ShadowFilter_Poisson:
+    {
+      for (u32 tap_idx = 0; tap_idx < ShadowFilter_PoissonTaps; ++tap_idx)
+      {
+        v2f offset = g_shadow_filter_poisson[tap_idx];
+        v2f tap    = { uv.x + offset.x * ShadowFilter_PoissonRadius * texel_size, uv.y + offset.y * ShadowFilter_PoissonRadius * texel_size };
+        result    += shadow_filter_compare_linear(map, tap, depth);
+      }
+
+      result /= (f32)ShadowFilter_PoissonTaps;
+    } break;
+  }
+
+  return(result);
+}
@@ -0,0 +1,52 @@
+#if !defined(SHADOW_FILTER_H)
+#define SHADOW_FILTER_H
+
+// Shadow map filtering. ps_main runs the kernels in shaders/shadow_filter.hlsl
+// and this is the same set on the CPU, so tools/shadow_filter_check.c can hold
+// them against each other. Every kernel returns the lit fraction of a receiver
+// and covers roughly the same 4x4 texel footprint:
+//
+//   ShadowFilter_Point     the original filter, a 3x3 grid of bilinear taps
+//                          each blended from 4 point samples (36 fetches)
+//   ShadowFilter_Hardware  the same grid as 9 SampleCmpLevelZero taps through
+//                          the linear comparison sampler
+//   ShadowFilter_Gather    the weights that grid puts on the 4x4 texels it
+//                          touches, read with 4 GatherCmp
+//   ShadowFilter_Poisson   ShadowFilter_PoissonTaps SampleCmpLevelZero taps on
+//                          a disc, softer and without the grid's box shape
+//
+// The point filter blends with frac(uv * size) rather than the hardware's
+// frac(uv * size - 0.5): its result at uv is the hardware kernel's at half a
+// texel further along u and v.
+
+typedef u32 Shadow_Filter;
+enum
+{
+  ShadowFilter_Point,
+  ShadowFilter_Hardware,
+  ShadowFilter_Gather,
+  ShadowFilter_Poisson,
+  ShadowFilter_Count,
+};
+
+#define ShadowFilter_PoissonTaps   12
+// in texels
+#define ShadowFilter_PoissonRadius 1.5f
+
+// One slice of the shadow map; depths are light clip z, row 0 at v = 0.
+// Reads outside it are lit, like the sampler's border colour.
+typedef struct
+{
+  f32 *depths;
+  u32  size;
+  // texture instructions the kernels have issued, one per Sample,
+  // SampleCmpLevelZero or GatherCmp the GPU version makes
+  u64  fetches;
+} Shadow_Filter_Map;
+
+static char *shadow_filter_name(Shadow_Filter filter);
+// texture instructions the kernel issues per pixel
+static u32   shadow_filter_tap_count(Shadow_Filter filter);
+static f32   shadow_filter_lit(Shadow_Filter_Map *map, Shadow_Filter filter, v2f uv, f32 depth);
+
+#endif
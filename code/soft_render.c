@@ -0,0 +1,1674 @@
+static f32
+soft_saturate(f32 value)
+{
+  f32 result = (value > 0.0f) ? value : 0.0f;
+  result = (result < 1.0f) ? result : 1.0f;
+  return(result);
+}
+
+static f32
+soft_lerp(f32 a, f32 b, f32 t)
+{
+  f32 result = a + t * (b - a);
+  return(result);
+}
+
+static v4f
+soft_v4f_add(v4f a, v4f b)
+{
+  v4f result = { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w };
+  return(result);
+}
+
+static v4f
+soft_v4f_scale(f32 a, v4f b)
+{
+  v4f result = { a * b.x, a * b.y, a * b.z, a * b.w };
+  return(result);
+}
+
+static v4f
+soft_v4f_mul(v4f a, v4f b)
+{
+  v4f result = { a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w };
+  return(result);
+}
+
+static v4f
+soft_v4f_saturate(v4f a)
+{
+  v4f result = { soft_saturate(a.x), soft_saturate(a.y), soft_saturate(a.z), soft_saturate(a.w) };
+  return(result);
+}
+
+// pow(x, 8), ps_main's shininess
+static f32
+soft_pow8(f32 x)
+{
+  f32 x2     = x * x;
+  f32 x4     = x2 * x2;
+  f32 result = x4 * x4;
+  return(result);
+}
+
+static v4f
+soft_transform(m44 a, v3f p)
+{
+  v4f result =
+  {
+    p.x * a.m[0][0] + p.y * a.m[1][0] + p.z * a.m[2][0] + a.m[3][0],
+    p.x * a.m[0][1] + p.y * a.m[1][1] + p.z * a.m[2][1] + a.m[3][1],
+    p.x * a.m[0][2] + p.y * a.m[1][2] + p.z * a.m[2][2] + a.m[3][2],
+    p.x * a.m[0][3] + p.y * a.m[1][3] + p.z * a.m[2][3] + a.m[3][3],
+  };
+
+  return(result);
+}
+
+// The two texels a linear filter blends along one axis, wrapped; returns the
+// weight of the second.
+static f32
+soft_wrap_texels(f32 coord, u32 size, u32 *texel0, u32 *texel1)
+{
+  // also turns a NaN into something addressable
+  coord = Maximum(coord, -16777216.0f);
+  coord = Minimum(coord, 16777216.0f);
+  f32 floored = floorf(coord);
+  s64 texel   = (s64)floored % (s64)size;
+  if (texel < 0)
+  {
+    texel += size;
+  }
+
+  *texel0 = (u32)texel;
+  *texel1 = (*texel0 + 1 == size) ? 0 : (*texel0 + 1);
+  f32 result = coord - floored;
+  return(result);
+}
+
+static __m128
+soft_unpack_rgba8(u32 texel)
+{
+  __m128i zero   = _mm_setzero_si128();
+  __m128i words  = _mm_unpacklo_epi8(_mm_cvtsi32_si128((s32)texel), zero);
+  __m128  result = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+  return(result);
+}
+
+// 0 to 255 per channel
+static __m128
+soft_texture_bilinear(Soft_Texture *texture, u32 mip, v2f uv)
+{
+  u32 width  = Maximum(texture->width >> mip, 1u);
+  u32 height = Maximum(texture->height >> mip, 1u);
+  u32 x0, x1, y0, y1;
+  f32 t_x = soft_wrap_texels(uv.x * (f32)width - 0.5f, width, &x0, &x1);
+  f32 t_y = soft_wrap_texels(uv.y * (f32)height - 0.5f, height, &y0, &y1);
+
+  u32   *texels       = (u32 *)texture->mips[mip];
+  __m128 top_left     = soft_unpack_rgba8(texels[y0 * width + x0]);
+  __m128 top_right    = soft_unpack_rgba8(texels[y0 * width + x1]);
+  __m128 bottom_left  = soft_unpack_rgba8(texels[y1 * width + x0]);
+  __m128 bottom_right = soft_unpack_rgba8(texels[y1 * width + x1]);
+  __m128 weight_x     = _mm_set1_ps(t_x);
+  __m128 top          = _mm_add_ps(top_left, _mm_mul_ps(weight_x, _mm_sub_ps(top_right, top_left)));
+  __m128 bottom       = _mm_add_ps(bottom_left, _mm_mul_ps(weight_x, _mm_sub_ps(bottom_right, bottom_left)));
+  __m128 result       = _mm_add_ps(top, _mm_mul_ps(_mm_set1_ps(t_y), _mm_sub_ps(bottom, top)));
+  return(result);
+}
+
+static void
+soft_texture_from_rgba8(Soft_Texture *texture, u8 *pixels, u32 width, u32 height)
+{
+  texture->width     = width;
+  texture->height    = height;
+  texture->mip_count = tex_pack_mip_count((s32)width, (s32)height);
+  Assert(texture->mip_count <= TexFile_MaxMips);
+
+  u32 mip_width  = width;
+  u32 mip_height = height;
+  for (u32 mip = 0; mip < texture->mip_count; ++mip)
+  {
+    u8 *dest = os_memory_alloc((u64)mip_width * mip_height * 4);
+    if (mip == 0)
+    {
+      for (u64 byte = 0; byte < (u64)width * height * 4; ++byte)
+      {
+        dest[byte] = pixels[byte];
+      }
+    }
+    else
+    {
+      // a 2x2 box, the last row or column repeated on odd sizes
+      u8 *src        = texture->mips[mip - 1];
+      u32 src_width  = Maximum(width >> (mip - 1), 1u);
+      u32 src_height = Maximum(height >> (mip - 1), 1u);
+      for (u32 y = 0; y < mip_height; ++y)
+      {
+        u32 src_y0 = Minimum(2 * y, src_height - 1);
+        u32 src_y1 = Minimum(2 * y + 1, src_height - 1);
+        for (u32 x = 0; x < mip_width; ++x)
+        {
+          u32 src_x0 = Minimum(2 * x, src_width - 1);
+          u32 src_x1 = Minimum(2 * x + 1, src_width - 1);
+          for (u32 channel = 0; channel < 4; ++channel)
+          {
+            u32 sum = src[(src_y0 * src_width + src_x0) * 4 + channel] + src[(src_y0 * src_width + src_x1) * 4 + channel] +
+                      src[(src_y1 * src_width + src_x0) * 4 + channel] + src[(src_y1 * src_width + src_x1) * 4 + channel];
+            dest[(y * mip_width + x) * 4 + channel] = (u8)((sum + 2) / 4);
+          }
+        }
+      }
+    }
+
+    texture->mips[mip] = dest;
+    mip_width          = Maximum(mip_width >> 1, 1u);
+    mip_height         = Maximum(mip_height >> 1, 1u);
+  }
+}
+
+// the inverse of tex_file_encode_bc4_block, as the hardware decodes it
+static void
+soft_decode_bc4_block(u8 *block, u8 values[16])
+{
+  u32 palette[8];
+  palette[0] = block[0];
+  palette[1] = block[1];
+  if (block[0] > block[1])
+  {
+    for (u32 entry = 2; entry < 8; ++entry)
+    {
+      palette[entry] = ((8 - entry) * block[0] + (entry - 1) * block[1] + 3) / 7;
+    }
+  }
+  else
+  {
+    for (u32 entry = 2; entry < 6; ++entry)
+    {
+      palette[entry] = ((6 - entry) * block[0] + (entry - 1) * block[1] + 2) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  u64 indices = 0;
+  for (u32 byte = 0; byte < 6; ++byte)
+  {
+    indices |= (u64)block[2 + byte] << (8 * byte);
+  }
+
+  for (u32 texel = 0; texel < 16; ++texel)
+  {
+    values[texel] = (u8)palette[(indices >> (3 * texel)) & 7];
+  }
+}
+
+static void
+soft_texture_from_tex_file(Soft_Texture *texture, Tex_File_Header *header)
+{
+  texture->width     = header->width;
+  texture->height    = header->height;
+  texture->mip_count = header->mip_count;
+  for (u32 mip = 0; mip < header->mip_count; ++mip)
+  {
+    u32 width     = Maximum(header->width >> mip, 1u);
+    u32 height    = Maximum(header->height >> mip, 1u);
+    u32 row_pitch = tex_file_row_pitch(header->format, width);
+    u8 *src       = (u8 *)header + header->mip_offsets[mip];
+    u8 *dest      = os_memory_alloc((u64)width * height * 4);
+    if (header->format == TexFileFormat_BC5)
+    {
+      for (u32 block_y = 0; block_y < (height + 3) / 4; ++block_y)
+      {
+        for (u32 block_x = 0; block_x < (width + 3) / 4; ++block_x)
+        {
+          u8 *block = src + block_y * row_pitch + block_x * 16;
+          u8  red[16], green[16];
+          soft_decode_bc4_block(block, red);
+          soft_decode_bc4_block(block + 8, green);
+          for (u32 texel = 0; texel < 16; ++texel)
+          {
+            u32 x = block_x * 4 + (texel % 4);
+            u32 y = block_y * 4 + (texel / 4);
+            if ((x < width) && (y < height))
+            {
+              u8 *pixel = dest + (y * width + x) * 4;
+              pixel[0] = red[texel];
+              pixel[1] = green[texel];
+              pixel[2] = 0;
+              pixel[3] = 255;
+            }
+          }
+        }
+      }
+    }
+    else
+    {
+      for (u32 y = 0; y < height; ++y)
+      {
+        for (u32 x = 0; x < width; ++x)
+        {
+          u8 *pixel = dest + (y * width + x) * 4;
+          if (header->format == TexFileFormat_RG8)
+          {
+            pixel[0] = src[y * row_pitch + x * 2 + 0];
+            pixel[1] = src[y * row_pitch + x * 2 + 1];
+            pixel[2] = 0;
+            pixel[3] = 255;
+          }
+          else
+          {
+            for (u32 channel = 0; channel < 4; ++channel)
+            {
+              pixel[channel] = src[y * row_pitch + x * 4 + channel];
+            }
+          }
+        }
+      }
+    }
+
+    texture->mips[mip] = dest;
+  }
+}
+
+static f32
+soft_texture_lod(Soft_Texture *texture, v2f dx, v2f dy)
+{
+  f32 dx_u = dx.x * (f32)texture->width;
+  f32 dx_v = dx.y * (f32)texture->height;
+  f32 dy_u = dy.x * (f32)texture->width;
+  f32 dy_v = dy.y * (f32)texture->height;
+  f32 length_sq = Maximum(dx_u * dx_u + dx_v * dx_v, dy_u * dy_u + dy_v * dy_v);
+  f32 result    = 0.5f * log2f(length_sq);
+  result = (result > 0.0f) ? result : 0.0f;
+  result = Minimum(result, (f32)(texture->mip_count - 1));
+  return(result);
+}
+
+static v4f
+soft_texture_sample(Soft_Texture *texture, v2f uv, f32 lod)
+{
+  lod = Maximum(lod, 0.0f);
+  lod = Minimum(lod, (f32)(texture->mip_count - 1));
+  u32    mip0   = (u32)lod;
+  f32    t      = lod - (f32)mip0;
+  __m128 texel  = soft_texture_bilinear(texture, mip0, uv);
+  if (t > 0.0f)
+  {
+    __m128 next = soft_texture_bilinear(texture, mip0 + 1, uv);
+    texel = _mm_add_ps(texel, _mm_mul_ps(_mm_set1_ps(t), _mm_sub_ps(next, texel)));
+  }
+
+  v4f result;
+  _mm_storeu_ps(result.v, _mm_mul_ps(texel, _mm_set1_ps(1.0f / 255.0f)));
+  return(result);
+}
+
+static void
+soft_target_alloc(Soft_Target *target, u32 width, u32 height, b32 triangle_ids)
+{
+  target->width   = width;
+  target->height  = height;
+  target->tiles_x = (width + SoftRender_TileSize - 1) / SoftRender_TileSize;
+  target->tiles_y = (height + SoftRender_TileSize - 1) / SoftRender_TileSize;
+  target->depth   = os_memory_alloc((u64)width * height * sizeof(f32));
+  if (triangle_ids)
+  {
+    target->triangle_ids = os_memory_alloc((u64)width * height * sizeof(u32));
+  }
+}
+
+static void
+soft_render_alloc(Soft_Renderer *renderer, u32 width, u32 height)
+{
+  Assert(!(width & 1) && !(height & 1));
+  renderer->width  = width;
+  renderer->height = height;
+  soft_target_alloc(&renderer->target, width, height, true);
+  renderer->colour = os_memory_alloc((u64)width * height * sizeof(u32));
+  for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+  {
+    soft_target_alloc(renderer->shadow_maps + cascade_idx, Shadow_MapSize, Shadow_MapSize, false);
+    renderer->shadow_static[cascade_idx] = os_memory_alloc(Shadow_MapSize * Shadow_MapSize * sizeof(f32));
+  }
+  renderer->cascade_scene = os_memory_alloc(sizeof(Scene_Instances));
+  light_cluster_grid_alloc(&renderer->clusters);
+
+  for (u32 model = 0; model < SceneModel_Count; ++model)
+  {
+    renderer->meshes[model]  = scene_mesh_for_model(model);
+    renderer->max_vertex_count = Maximum(renderer->max_vertex_count, renderer->meshes[model].vertex_count);
+  }
+
+  renderer->max_tile_count = Maximum(renderer->target.tiles_x * renderer->target.tiles_y,
+                                     renderer->shadow_maps[0].tiles_x * renderer->shadow_maps[0].tiles_y);
+  for (u32 job_idx = 0; job_idx < SoftRender_MaxJobs; ++job_idx)
+  {
+    Soft_Draw_Job *job = renderer->draw_jobs + job_idx;
+    job->renderer      = renderer;
+    job->tile_offsets  = os_memory_alloc((renderer->max_tile_count + 1) * sizeof(u32));
+    job->tile_cursors  = os_memory_alloc(renderer->max_tile_count * sizeof(u32));
+    job->vertices      = os_memory_alloc((u64)renderer->max_vertex_count * SoftRender_VertexFloats * sizeof(f32));
+  }
+
+  for (u32 job_idx = 0; job_idx < SoftRender_TileJobCount; ++job_idx)
+  {
+    renderer->tile_jobs[job_idx].renderer = renderer;
+  }
+
+  renderer->triangle_slack = 1;
+  renderer->bin_capacity   = 1 << 20;
+  renderer->bin_entries    = os_memory_alloc(renderer->bin_capacity * sizeof(u32));
+}
+
+static void
+soft_render_set_material(Soft_Renderer *renderer, Tex_Pack_Slot slot, Soft_Material *material)
+{
+  if (slot.slice & TextureSlice_VirtualBit)
+  {
+    renderer->virtual_material = material;
+  }
+  else
+  {
+    renderer->materials[slot.array_idx][slot.slice] = material;
+  }
+}
+
+static Soft_Material *
+soft_render_material(Soft_Renderer *renderer, u32 material_array, u32 texture_slice)
+{
+  Soft_Material *result = 0;
+  if (texture_slice == TextureSlice_None)
+  {
+  }
+  else if (texture_slice & TextureSlice_VirtualBit)
+  {
+    result = renderer->virtual_material;
+  }
+  else if ((material_array < TexPack_MaxArrays) && (texture_slice < TexPack_MaxSlicesPerArray))
+  {
+    result = renderer->materials[material_array][texture_slice];
+  }
+
+  return(result);
+}
+
+static void
+soft_render_load_reflection_probes(Soft_Renderer *renderer, Reflection_Probe_Header *header)
+{
+  if (header && header->probe_count)
+  {
+    u32 texel_count = header->probe_count * reflection_probe_texel_count();
+    u32 *texels     = (u32 *)(header + 1);
+    renderer->reflection_cubes = os_memory_alloc((u64)texel_count * sizeof(v3f));
+    for (u32 texel = 0; texel < texel_count; ++texel)
+    {
+      renderer->reflection_cubes[texel] = reflection_probe_unpack_rgb9e5(texels[texel]);
+    }
+    renderer->reflection_probe_count = header->probe_count;
+  }
+}
+
+static void
+soft_render_load_lightmap(Soft_Renderer *renderer, Lightmap_Header *header, Scene_Instances *scene)
+{
+  if (header && header->chart_count && (header->instance_count == scene->static_instance_count))
+  {
+    u32 *first_chart = (u32 *)(header + 1);
+    v4f *charts      = (v4f *)(first_chart + header->instance_count);
+    u16 *texels      = (u16 *)(charts + header->chart_count);
+
+    renderer->lightmap_charts = os_memory_alloc(header->chart_count * sizeof(v4f));
+    for (u32 chart_idx = 0; chart_idx < header->chart_count; ++chart_idx)
+    {
+      renderer->lightmap_charts[chart_idx] = charts[chart_idx];
+    }
+
+    u32 texel_count = header->width * header->height;
+    renderer->lightmap_texels = os_memory_alloc((u64)texel_count * sizeof(v4f));
+    for (u32 texel = 0; texel < texel_count; ++texel)
+    {
+      for (u32 channel = 0; channel < 4; ++channel)
+      {
+        renderer->lightmap_texels[texel].v[channel] = lightmap_unpack_f16(texels[texel * 4 + channel]);
+      }
+    }
+    renderer->lightmap_width  = header->width;
+    renderer->lightmap_height = header->height;
+
+    for (u32 instance_idx = 0; instance_idx < header->instance_count; ++instance_idx)
+    {
+      scene->ins[instance_idx].lightmap_first_chart = first_chart[instance_idx];
+    }
+  }
+}
+
+static void
+soft_render_load_vertex_ao(Soft_Renderer *renderer, Vertex_AO_Header *header, Scene_Instances *scene)
+{
+  if (header && header->vertex_count && (header->instance_count == scene->static_instance_count))
+  {
+    u32 *first_vertex = (u32 *)(header + 1);
+    u8  *ao           = (u8 *)(first_vertex + header->instance_count);
+    renderer->vertex_ao = os_memory_alloc((u64)header->vertex_count * sizeof(f32));
+    for (u32 vertex_idx = 0; vertex_idx < header->vertex_count; ++vertex_idx)
+    {
+      renderer->vertex_ao[vertex_idx] = (f32)ao[vertex_idx] / 255.0f;
+    }
+
+    for (u32 instance_idx = 0; instance_idx < header->instance_count; ++instance_idx)
+    {
+      scene->ins[instance_idx].ao_first_vertex = first_vertex[instance_idx];
+    }
+  }
+}
+
+static void
+soft_render_load_irradiance_volume(Soft_Renderer *renderer, Irradiance_Volume_Header *header)
+{
+  if (header)
+  {
+    Irradiance_Grid *grid = &renderer->irradiance_grid;
+    grid->origin        = header->origin;
+    grid->spacing       = header->spacing;
+    grid->probe_count_x = header->probe_count_x;
+    grid->probe_count_y = header->probe_count_y;
+    grid->probe_count_z = header->probe_count_z;
+    grid->probe_count   = header->probe_count_x * header->probe_count_y * header->probe_count_z;
+
+    // coefficient k of channel c is half 3k + c
+    u16 *halves = (u16 *)(header + 1);
+    renderer->irradiance_probes = os_memory_alloc((u64)grid->probe_count * sizeof(Irradiance_SH));
+    for (u32 probe_idx = 0; probe_idx < grid->probe_count; ++probe_idx)
+    {
+      u16 *probe_halves = halves + probe_idx * IrradianceVolume_ProbeHalves;
+      for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+      {
+        for (u32 channel = 0; channel < 3; ++channel)
+        {
+          renderer->irradiance_probes[probe_idx].c[coefficient].v[channel] = irradiance_unpack_f16(probe_halves[3 * coefficient + channel]);
+        }
+      }
+    }
+  }
+}
+
+// ------------------------------------------------------------------------
+// vs_main / vs_depth_only, clipping, setup and binning
+
+static void
+soft_render_vertex_stage(Soft_Renderer *renderer, Model_Instance *instance, Scene_Mesh *mesh, f32 *vertices)
+{
+  Soft_Pass *pass         = &renderer->pass;
+  b32 lightmapped         = (instance->lightmap_first_chart != Lightmap_None) && renderer->lightmap_charts;
+  b32 occluded            = (instance->ao_first_vertex != VertexAO_None) && renderer->vertex_ao;
+  u32 vertex_floats       = pass->shaded ? SoftRender_VertexFloats : 4;
+  for (u32 vertex_idx = 0; vertex_idx < mesh->vertex_count; ++vertex_idx)
+  {
+    Model_Vertex *vertex = mesh->vertices + vertex_idx;
+    f32          *dest   = vertices + vertex_idx * vertex_floats;
+    v3f world_p = v3f_add(m33_mul_v3f(instance->model_to_world_xform, vertex->p), instance->p);
+    v4f clip    = soft_transform(pass->world_to_clip, world_p);
+    dest[0] = clip.x;
+    dest[1] = clip.y;
+    dest[2] = clip.z;
+    dest[3] = clip.w;
+
+    if (pass->shaded)
+    {
+      v3f T = m33_mul_v3f(instance->model_to_world_xform_it, vertex->tangent);
+      v3f B = m33_mul_v3f(instance->model_to_world_xform_it, vertex->bitangent);
+      v3f N = m33_mul_v3f(instance->model_to_world_xform_it, vertex->normal);
+      B = v3f_sub(B, v3f_scale(v3f_inner(B, T) / v3f_inner(T, T), T));
+      N = v3f_sub(v3f_sub(N, v3f_scale(v3f_inner(N, T) / v3f_inner(T, T), T)), v3f_scale(v3f_inner(N, B) / v3f_inner(B, B), B));
+      T = v3f_normalized(T);
+      B = v3f_normalized(B);
+      N = v3f_normalized(N);
+
+      f32 *values = dest + 4;
+      values[SoftVarying_U] = vertex->uv.x;
+      values[SoftVarying_V] = vertex->uv.y;
+      values[SoftVarying_LightmapU] = 0.0f;
+      values[SoftVarying_LightmapV] = 0.0f;
+      if (lightmapped)
+      {
+        v4f chart = renderer->lightmap_charts[instance->lightmap_first_chart + vertex->lightmap_chart];
+        values[SoftVarying_LightmapU] = vertex->uv.x * chart.x + chart.z;
+        values[SoftVarying_LightmapV] = vertex->uv.y * chart.y + chart.w;
+      }
+
+      values[SoftVarying_AmbientOcclusion] = occluded ? renderer->vertex_ao[instance->ao_first_vertex + vertex_idx] : 1.0f;
+
+      v3f normal = m33_mul_v3f(instance->model_to_world_xform_it, vertex->normal);
+      for (u32 axis = 0; axis < 3; ++axis)
+      {
+        values[SoftVarying_WorldX + axis]         = world_p.v[axis];
+        values[SoftVarying_NormalX + axis]        = normal.v[axis];
+        values[SoftVarying_TangentX + axis]       = T.v[axis];
+        values[SoftVarying_BitangentX + axis]     = B.v[axis];
+        values[SoftVarying_SurfaceNormalX + axis] = N.v[axis];
+      }
+    }
+  }
+}
+
+static b32
+soft_render_sphere_visible(Soft_Pass *pass, Scene_Instance_Info *info)
+{
+  b32 result = true;
+  for (u32 plane_idx = 0; result && (plane_idx < ArrayCount(pass->planes)); ++plane_idx)
+  {
+    v4f plane = pass->planes[plane_idx];
+    result = (plane.x * info->bound_p.x + plane.y * info->bound_p.y + plane.z * info->bound_p.z + plane.w) >= -info->bound_radius;
+  }
+
+  return(result);
+}
+
+// near, then the four guard band planes; bit 5 is past the far plane, which
+// is only rejected against
+static u32
+soft_clip_outcode(f32 *clip)
+{
+  f32 guard_w = SoftRender_GuardBand * clip[3];
+  u32 result  = (clip[2] < 0.0f) | ((clip[0] < -guard_w) << 1) | ((clip[0] > guard_w) << 2) |
+                ((clip[1] < -guard_w) << 3) | ((clip[1] > guard_w) << 4) | ((clip[2] > clip[3]) << 5);
+  return(result);
+}
+
+static f32
+soft_clip_distance(f32 *clip, u32 plane)
+{
+  f32 guard_w = SoftRender_GuardBand * clip[3];
+  f32 result  = clip[2];
+  switch (plane)
+  {
+    case 1: result = clip[0] + guard_w; break;
+    case 2: result = guard_w - clip[0]; break;
+    case 3: result = clip[1] + guard_w; break;
+    case 4: result = guard_w - clip[1]; break;
+  }
+
+  return(result);
+}
+
+static f32
+soft_snap(f32 value)
+{
+  f32 result = floorf(value * SoftRender_SubpixelSteps + 0.5f) / SoftRender_SubpixelSteps;
+  return(result);
+}
+
+static void
+soft_render_setup_triangle(Soft_Draw_Job *job, u32 instance_idx, f32 *v0, f32 *v1, f32 *v2)
+{
+  Soft_Renderer *renderer = job->renderer;
+  Soft_Pass     *pass     = &renderer->pass;
+  Soft_Target   *target   = pass->target;
+
+  f32 *clip[3] = { v0, v1, v2 };
+  f32  x[3], y[3], z[3], inv_w[3];
+  for (u32 vertex = 0; vertex < 3; ++vertex)
+  {
+    inv_w[vertex] = 1.0f / clip[vertex][3];
+    x[vertex]     = soft_snap((clip[vertex][0] * inv_w[vertex] * 0.5f + 0.5f) * (f32)target->width);
+    y[vertex]     = soft_snap((0.5f - clip[vertex][1] * inv_w[vertex] * 0.5f) * (f32)target->height);
+    z[vertex]     = clip[vertex][2] * inv_w[vertex];
+  }
+
+  // front faces wind counterclockwise on screen, a negative area with y
+  // down; they are flipped so inside is where every edge is positive
+  f32 area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+  if (area < 0.0f)
+  {
+    u32 order[3] = { 0, 2, 1 };
+    f32 min_x = Minimum(x[0], Minimum(x[1], x[2]));
+    f32 max_x = Maximum(x[0], Maximum(x[1], x[2]));
+    f32 min_y = Minimum(y[0], Minimum(y[1], y[2]));
+    f32 max_y = Maximum(y[0], Maximum(y[1], y[2]));
+
+    Soft_Triangle triangle = { 0 };
+    triangle.min_x = Maximum((s32)ceilf(min_x - 0.5f), 0);
+    triangle.min_y = Maximum((s32)ceilf(min_y - 0.5f), 0);
+    triangle.max_x = (s32)floorf(max_x - 0.5f);
+    triangle.max_x = Minimum(triangle.max_x, (s32)target->width - 1);
+    triangle.max_y = (s32)floorf(max_y - 0.5f);
+    triangle.max_y = Minimum(triangle.max_y, (s32)target->height - 1);
+    if ((triangle.min_x <= triangle.max_x) && (triangle.min_y <= triangle.max_y))
+    {
+      for (u32 edge = 0; edge < 3; ++edge)
+      {
+        u32 p = order[edge];
+        u32 q = order[(edge + 1) % 3];
+        f32 dx = x[q] - x[p];
+        f32 dy = y[q] - y[p];
+        // the end both triangles on this edge pick, so their values are
+        // exact negatives of each other
+        u32 origin = ((y[p] < y[q]) || ((y[p] == y[q]) && (x[p] < x[q]))) ? p : q;
+        triangle.edge_a[edge]   = -dy;
+        triangle.edge_b[edge]   = dx;
+        triangle.origin_x[edge] = x[origin];
+        triangle.origin_y[edge] = y[origin];
+        triangle.top_left[edge] = ((dy < 0.0f) || ((dy == 0.0f) && (dx > 0.0f))) ? 0xFFFFFFFF : 0;
+        triangle.z[edge]        = z[p];
+        triangle.inv_w[edge]    = inv_w[p];
+      }
+      triangle.inv_area       = -1.0f / area;
+      triangle.instance_idx   = instance_idx;
+      triangle.material_array = job->batch->material_array;
+
+      if (!pass->shaded)
+      {
+        // the rasterizer state's bias for a float depth buffer: the
+        // constant in units of the largest z's last mantissa bit, plus the
+        // slope; vertex k is weighted by edge k + 1
+        f32 dz_dx = (triangle.edge_a[1] * triangle.z[0] + triangle.edge_a[2] * triangle.z[1] + triangle.edge_a[0] * triangle.z[2]) * triangle.inv_area;
+        f32 dz_dy = (triangle.edge_b[1] * triangle.z[0] + triangle.edge_b[2] * triangle.z[1] + triangle.edge_b[0] * triangle.z[2]) * triangle.inv_area;
+        s32 exponent = 0;
+        frexpf(Maximum(z[0], Maximum(z[1], z[2])), &exponent);
+        f32 bias = SoftRender_ShadowDepthBias * ldexpf(1.0f, exponent - 24) +
+                   SoftRender_ShadowSlopeBias * Maximum(fabsf(dz_dx), fabsf(dz_dy));
+        for (u32 vertex = 0; vertex < 3; ++vertex)
+        {
+          triangle.z[vertex] += bias;
+        }
+      }
+
+      if (job->triangle_count < job->triangle_capacity)
+      {
+        u32 triangle_idx = job->first_triangle + job->triangle_count;
+        renderer->triangles[triangle_idx] = triangle;
+        if (pass->shaded)
+        {
+          f32 *dest = renderer->triangle_varyings + (u64)triangle_idx * 3 * SoftVarying_Count;
+          for (u32 vertex = 0; vertex < 3; ++vertex)
+          {
+            for (u32 varying = 0; varying < SoftVarying_Count; ++varying)
+            {
+              dest[vertex * SoftVarying_Count + varying] = clip[order[vertex]][4 + varying];
+            }
+          }
+        }
+      }
+      ++job->triangle_count;
+    }
+  }
+}
+
+// Sutherland-Hodgman against the planes the triangle crosses, each new
+// vertex interpolated from the inside end so neighbours agree on it
+static void
+soft_render_add_triangle(Soft_Draw_Job *job, u32 instance_idx, f32 *v0, f32 *v1, f32 *v2)
+{
+  u32 vertex_floats = job->renderer->pass.shaded ? SoftRender_VertexFloats : 4;
+  u32 outcode0      = soft_clip_outcode(v0);
+  u32 outcode1      = soft_clip_outcode(v1);
+  u32 outcode2      = soft_clip_outcode(v2);
+  if (!(outcode0 & outcode1 & outcode2))
+  {
+    u32 clip_planes = (outcode0 | outcode1 | outcode2) & 0x1F;
+    if (!clip_planes)
+    {
+      soft_render_setup_triangle(job, instance_idx, v0, v1, v2);
+    }
+    else
+    {
+      f32 polygons[2][SoftRender_MaxClipVertices][SoftRender_VertexFloats];
+      f32 *input[3] = { v0, v1, v2 };
+      for (u32 vertex = 0; vertex < 3; ++vertex)
+      {
+        for (u32 value = 0; value < vertex_floats; ++value)
+        {
+          polygons[0][vertex][value] = input[vertex][value];
+        }
+      }
+
+      u32 current      = 0;
+      u32 vertex_count = 3;
+      for (u32 plane = 0; (plane < 5) && (vertex_count >= 3); ++plane)
+      {
+        if (clip_planes & (1 << plane))
+        {
+          u32 out_count = 0;
+          for (u32 vertex = 0; vertex < vertex_count; ++vertex)
+          {
+            f32 *a      = polygons[current][vertex];
+            f32 *b      = polygons[current][(vertex + 1) % vertex_count];
+            f32  dist_a = soft_clip_distance(a, plane);
+            f32  dist_b = soft_clip_distance(b, plane);
+            if (dist_a >= 0.0f)
+            {
+              Assert(out_count < SoftRender_MaxClipVertices);
+              for (u32 value = 0; value < vertex_floats; ++value)
+              {
+                polygons[current ^ 1][out_count][value] = a[value];
+              }
+              ++out_count;
+            }
+
+            if ((dist_a >= 0.0f) != (dist_b >= 0.0f))
+            {
+              f32 *inside       = (dist_a >= 0.0f) ? a : b;
+              f32 *outside      = (dist_a >= 0.0f) ? b : a;
+              f32  dist_inside  = (dist_a >= 0.0f) ? dist_a : dist_b;
+              f32  dist_outside = (dist_a >= 0.0f) ? dist_b : dist_a;
+              f32  t            = dist_inside / (dist_inside - dist_outside);
+              Assert(out_count < SoftRender_MaxClipVertices);
+              for (u32 value = 0; value < vertex_floats; ++value)
+              {
+                polygons[current ^ 1][out_count][value] = inside[value] + t * (outside[value] - inside[value]);
+              }
+              ++out_count;
+            }
+          }
+
+          current     ^= 1;
+          vertex_count = out_count;
+        }
+      }
+
+      for (u32 vertex = 2; vertex < vertex_count; ++vertex)
+      {
+        soft_render_setup_triangle(job, instance_idx, polygons[current][0], polygons[current][vertex - 1], polygons[current][vertex]);
+      }
+    }
+  }
+}
+
+// counts the triangles per tile, reserves room for them all at once and
+// fills the bins; a pass that ran out leaves them empty and runs again
+static void
+soft_render_bin(Soft_Draw_Job *job)
+{
+  Soft_Renderer *renderer   = job->renderer;
+  Soft_Target   *target     = renderer->pass.target;
+  u32            tile_count = target->tiles_x * target->tiles_y;
+  u32            stored     = Minimum(job->triangle_count, job->triangle_capacity);
+  for (u32 tile = 0; tile <= tile_count; ++tile)
+  {
+    job->tile_offsets[tile] = 0;
+  }
+
+  for (u32 triangle_idx = 0; triangle_idx < stored; ++triangle_idx)
+  {
+    Soft_Triangle *triangle = renderer->triangles + job->first_triangle + triangle_idx;
+    for (s32 tile_y = triangle->min_y / SoftRender_TileSize; tile_y <= triangle->max_y / SoftRender_TileSize; ++tile_y)
+    {
+      for (s32 tile_x = triangle->min_x / SoftRender_TileSize; tile_x <= triangle->max_x / SoftRender_TileSize; ++tile_x)
+      {
+        ++job->tile_offsets[tile_y * target->tiles_x + tile_x + 1];
+      }
+    }
+  }
+
+  for (u32 tile = 1; tile <= tile_count; ++tile)
+  {
+    job->tile_offsets[tile] += job->tile_offsets[tile - 1];
+  }
+
+  u64 entry_count = job->tile_offsets[tile_count];
+  u64 first_entry = AtomicAddU64(&renderer->bin_used, entry_count);
+  if ((first_entry + entry_count <= renderer->bin_capacity) && (job->triangle_count <= job->triangle_capacity))
+  {
+    job->bin_entries = renderer->bin_entries + first_entry;
+    for (u32 tile = 0; tile < tile_count; ++tile)
+    {
+      job->tile_cursors[tile] = job->tile_offsets[tile];
+    }
+
+    for (u32 triangle_idx = 0; triangle_idx < stored; ++triangle_idx)
+    {
+      Soft_Triangle *triangle = renderer->triangles + job->first_triangle + triangle_idx;
+      for (s32 tile_y = triangle->min_y / SoftRender_TileSize; tile_y <= triangle->max_y / SoftRender_TileSize; ++tile_y)
+      {
+        for (s32 tile_x = triangle->min_x / SoftRender_TileSize; tile_x <= triangle->max_x / SoftRender_TileSize; ++tile_x)
+        {
+          job->bin_entries[job->tile_cursors[tile_y * target->tiles_x + tile_x]++] = job->first_triangle + triangle_idx;
+        }
+      }
+    }
+  }
+  else
+  {
+    for (u32 tile = 0; tile <= tile_count; ++tile)
+    {
+      job->tile_offsets[tile] = 0;
+    }
+  }
+}
+
+static void
+soft_render_draw_job(void *data)
+{
+  Soft_Draw_Job   *job           = (Soft_Draw_Job *)data;
+  Soft_Renderer   *renderer      = job->renderer;
+  Soft_Pass       *pass          = &renderer->pass;
+  Scene_Instances *scene         = pass->scene;
+  Scene_Mesh      *mesh          = renderer->meshes + job->batch->model;
+  u32              vertex_floats = pass->shaded ? SoftRender_VertexFloats : 4;
+
+  job->triangle_count = 0;
+  for (u32 instance_idx = job->first_instance; instance_idx < job->end_instance; ++instance_idx)
+  {
+    if (soft_render_sphere_visible(pass, scene->info + instance_idx))
+    {
+      soft_render_vertex_stage(renderer, scene->ins + instance_idx, mesh, job->vertices);
+      for (u32 index = 0; index < mesh->index_count; index += 3)
+      {
+        soft_render_add_triangle(job, instance_idx,
+                                 job->vertices + mesh->indices[index + 0] * vertex_floats,
+                                 job->vertices + mesh->indices[index + 1] * vertex_floats,
+                                 job->vertices + mesh->indices[index + 2] * vertex_floats);
+      }
+    }
+  }
+
+  soft_render_bin(job);
+}
+
+// ------------------------------------------------------------------------
+// raster and ps_main, a tile at a time
+
+static __m128
+soft_load_quad(f32 *row0, f32 *row1)
+{
+  __m128 result = _mm_loadl_pi(_mm_setzero_ps(), (__m64 *)row0);
+  result = _mm_loadh_pi(result, (__m64 *)row1);
+  return(result);
+}
+
+static void
+soft_store_quad(f32 *row0, f32 *row1, __m128 value)
+{
+  _mm_storel_pi((__m64 *)row0, value);
+  _mm_storeh_pi((__m64 *)row1, value);
+}
+
+// lanes are the quad's top left, top right, bottom left, bottom right
+static void
+soft_quad_edges(Soft_Triangle *triangle, s32 x, s32 y, __m128 *edges)
+{
+  __m128 pixel_x = _mm_add_ps(_mm_set1_ps((f32)x), _mm_set_ps(1.5f, 0.5f, 1.5f, 0.5f));
+  __m128 pixel_y = _mm_add_ps(_mm_set1_ps((f32)y), _mm_set_ps(1.5f, 1.5f, 0.5f, 0.5f));
+  for (u32 edge = 0; edge < 3; ++edge)
+  {
+    edges[edge] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle->edge_a[edge]), _mm_sub_ps(pixel_x, _mm_set1_ps(triangle->origin_x[edge]))),
+                             _mm_mul_ps(_mm_set1_ps(triangle->edge_b[edge]), _mm_sub_ps(pixel_y, _mm_set1_ps(triangle->origin_y[edge]))));
+  }
+}
+
+static void
+soft_render_raster(Soft_Renderer *renderer, u32 triangle_idx, s32 tile_x0, s32 tile_y0, s32 tile_x1, s32 tile_y1)
+{
+  Soft_Target   *target   = renderer->pass.target;
+  Soft_Triangle *triangle = renderer->triangles + triangle_idx;
+  s32 min_x = Maximum(triangle->min_x, tile_x0) & ~1;
+  s32 min_y = Maximum(triangle->min_y, tile_y0) & ~1;
+  s32 max_x = Minimum(triangle->max_x, tile_x1);
+  s32 max_y = Minimum(triangle->max_y, tile_y1);
+
+  __m128 zero      = _mm_setzero_ps();
+  __m128 one       = _mm_set1_ps(1.0f);
+  __m128 inv_area  = _mm_set1_ps(triangle->inv_area);
+  __m128 id        = _mm_castsi128_ps(_mm_set1_epi32((s32)triangle_idx));
+  __m128 z[3], top_left[3];
+  for (u32 vertex = 0; vertex < 3; ++vertex)
+  {
+    z[vertex]        = _mm_set1_ps(triangle->z[vertex]);
+    top_left[vertex] = _mm_castsi128_ps(_mm_set1_epi32((s32)triangle->top_left[vertex]));
+  }
+
+  for (s32 y = min_y; y <= max_y; y += 2)
+  {
+    f32 *depth0 = target->depth + y * target->width;
+    f32 *depth1 = depth0 + target->width;
+    for (s32 x = min_x; x <= max_x; x += 2)
+    {
+      __m128 edges[3];
+      soft_quad_edges(triangle, x, y, edges);
+      __m128 inside = _mm_or_ps(_mm_cmpgt_ps(edges[0], zero), _mm_and_ps(_mm_cmpeq_ps(edges[0], zero), top_left[0]));
+      for (u32 edge = 1; edge < 3; ++edge)
+      {
+        inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(edges[edge], zero), _mm_and_ps(_mm_cmpeq_ps(edges[edge], zero), top_left[edge])));
+      }
+
+      if (_mm_movemask_ps(inside))
+      {
+        __m128 depth = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edges[1], z[0]), _mm_mul_ps(edges[2], z[1])), _mm_mul_ps(edges[0], z[2])), inv_area);
+        // depth clip, then the viewport's clamp and LESS
+        inside = _mm_and_ps(inside, _mm_cmple_ps(depth, one));
+        depth  = _mm_max_ps(depth, zero);
+        __m128 old_depth = soft_load_quad(depth0 + x, depth1 + x);
+        inside = _mm_and_ps(inside, _mm_cmplt_ps(depth, old_depth));
+        if (_mm_movemask_ps(inside))
+        {
+          soft_store_quad(depth0 + x, depth1 + x, _mm_or_ps(_mm_and_ps(inside, depth), _mm_andnot_ps(inside, old_depth)));
+          if (target->triangle_ids)
+          {
+            f32 *ids0   = (f32 *)(target->triangle_ids + y * target->width + x);
+            f32 *ids1   = ids0 + target->width;
+            __m128 ids  = soft_load_quad(ids0, ids1);
+            soft_store_quad(ids0, ids1, _mm_or_ps(_mm_and_ps(inside, id), _mm_andnot_ps(inside, ids)));
+          }
+        }
+      }
+    }
+  }
+}
+
+// varyings of a triangle at the four pixels of the quad at x, y, perspective
+// correct, outside it as well: values[varying * 4 + lane]
+static void
+soft_render_interpolate_quad(Soft_Renderer *renderer, u32 triangle_idx, s32 x, s32 y, f32 *values, f32 *view_w)
+{
+  Soft_Triangle *triangle = renderer->triangles + triangle_idx;
+  __m128 edges[3];
+  soft_quad_edges(triangle, x, y, edges);
+
+  __m128 inv_area = _mm_set1_ps(triangle->inv_area);
+  __m128 q0 = _mm_mul_ps(_mm_mul_ps(edges[1], inv_area), _mm_set1_ps(triangle->inv_w[0]));
+  __m128 q1 = _mm_mul_ps(_mm_mul_ps(edges[2], inv_area), _mm_set1_ps(triangle->inv_w[1]));
+  __m128 q2 = _mm_mul_ps(_mm_mul_ps(edges[0], inv_area), _mm_set1_ps(triangle->inv_w[2]));
+  __m128 w  = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(q0, q1), q2));
+  __m128 b0 = _mm_mul_ps(q0, w);
+  __m128 b1 = _mm_mul_ps(q1, w);
+  __m128 b2 = _mm_mul_ps(q2, w);
+  _mm_storeu_ps(view_w, w);
+
+  f32 *vertex_values = renderer->triangle_varyings + (u64)triangle_idx * 3 * SoftVarying_Count;
+  for (u32 varying = 0; varying < SoftVarying_Count; ++varying)
+  {
+    __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(vertex_values[varying])),
+                                         _mm_mul_ps(b1, _mm_set1_ps(vertex_values[SoftVarying_Count + varying]))),
+                              _mm_mul_ps(b2, _mm_set1_ps(vertex_values[2 * SoftVarying_Count + varying])));
+    _mm_storeu_ps(values + varying * 4, value);
+  }
+}
+
+static v2f
+soft_parallax_uv2(Soft_Texture *displace, v3f view_dir, v3f N, v2f tex_coord, f32 lod)
+{
+  f32 sample_countf = soft_lerp((f32)ParallaxLinear_MaxSamples, (f32)ParallaxLinear_MinSamples, Maximum(-v3f_inner(view_dir, N), 0.0f));
+  u32 sample_count  = (u32)sample_countf;
+
+  f32 depth_step = 1.0f / sample_countf;
+  v2f tex_step   = { ((-ConeStep_HeightScale * view_dir.x) / view_dir.z) / sample_countf,
+                     -(((-ConeStep_HeightScale * view_dir.y) / view_dir.z) / sample_countf) };
+
+  u32 sample_idx         = 0;
+  v2f current_offset     = { 0 };
+  v2f previous_offset    = { 0 };
+  f32 current_depth      = 1.0f - depth_step;
+  f32 previous_depth     = 1.0f;
+  f32 previous_map_depth = 0.0f;
+  v2f final_offset       = { 0 };
+  while (sample_idx <= sample_count)
+  {
+    v2f uv = { tex_coord.x + current_offset.x, tex_coord.y + current_offset.y };
+    f32 current_map_depth = soft_texture_sample(displace, uv, lod).r;
+    if (current_depth < current_map_depth)
+    {
+      f32 t = (previous_map_depth - previous_depth) / (current_depth - previous_depth - current_map_depth + previous_map_depth);
+      final_offset.x = previous_offset.x + t * tex_step.x;
+      final_offset.y = previous_offset.y + t * tex_step.y;
+      sample_idx     = sample_count + 1;
+    }
+    else
+    {
+      ++sample_idx;
+      previous_offset     = current_offset;
+      previous_depth      = current_depth;
+      previous_map_depth  = current_map_depth;
+      current_offset.x   += tex_step.x;
+      current_offset.y   += tex_step.y;
+      current_depth      -= depth_step;
+    }
+  }
+
+  v2f result = { tex_coord.x + final_offset.x, tex_coord.y + final_offset.y };
+  return(result);
+}
+
+static v2f
+soft_parallax_cone_uv(Soft_Texture *displace, v3f view_dir, v2f tex_coord, f32 lod)
+{
+  v2f max_offset = { (-ConeStep_HeightScale * view_dir.x) / view_dir.z, -((-ConeStep_HeightScale * view_dir.y) / view_dir.z) };
+  f32 travel     = sqrtf(view_dir.x * view_dir.x + view_dir.y * view_dir.y) / view_dir.z;
+
+  f32 t           = 0.0f;
+  f32 t_outside   = 0.0f;
+  f32 gap         = 0.0f;
+  f32 gap_outside = 0.0f;
+  b32 inside      = false;
+  for (u32 step_idx = 0; (step_idx < ConeStep_ConeSteps) && !inside; ++step_idx)
+  {
+    v4f texel     = soft_texture_sample(displace, (v2f){ tex_coord.x + t * max_offset.x, tex_coord.y + t * max_offset.y }, lod);
+    f32 map_depth = 1.0f - texel.r;
+    gap    = t - map_depth;
+    inside = (gap >= 0.0f);
+    if (!inside)
+    {
+      f32 ratio   = texel.g * texel.g * ConeStep_MaxRatio;
+      t_outside   = t;
+      gap_outside = gap;
+      t           = Minimum(t + ratio * (map_depth - t) / Maximum(travel + ratio, 1e-5f), 1.0f);
+    }
+  }
+
+  if (inside && (t > t_outside))
+  {
+    for (u32 search_idx = 0; search_idx < ConeStep_SearchSteps; ++search_idx)
+    {
+      f32 t_middle   = 0.5f * (t_outside + t);
+      v2f uv         = { tex_coord.x + t_middle * max_offset.x, tex_coord.y + t_middle * max_offset.y };
+      f32 gap_middle = t_middle - (1.0f - soft_texture_sample(displace, uv, lod).r);
+      if (gap_middle >= 0.0f)
+      {
+        t   = t_middle;
+        gap = gap_middle;
+      }
+      else
+      {
+        t_outside   = t_middle;
+        gap_outside = gap_middle;
+      }
+    }
+    t = t_outside + (t - t_outside) * (-gap_outside / Maximum(gap - gap_outside, 1e-5f));
+  }
+
+  v2f result = { tex_coord.x + t * max_offset.x, tex_coord.y + t * max_offset.y };
+  return(result);
+}
+
+static v4f
+soft_shade_directional_light(Light *light, v3f N, v3f to_eye, v4f sample_colour, f32 shadow_multiplier)
+{
+  v3f L       = v3f_normalized(light->dir);
+  v3f H       = v3f_normalized(v3f_sub(to_eye, L));
+  f32 n_dot_l = Maximum(-v3f_inner(N, L), 0.0f);
+  f32 r_dot_v = Maximum(v3f_inner(N, H), 0.0f);
+
+  v4f diffuse  = soft_v4f_scale(n_dot_l, soft_v4f_mul(light->intensity, sample_colour));
+  v4f specular = soft_v4f_scale(0.5f * soft_pow8(r_dot_v), light->intensity);
+  v4f result   = soft_v4f_scale(shadow_multiplier, soft_v4f_add(diffuse, specular));
+  return(result);
+}
+
+static v4f
+soft_shade_lightmapped_light(Light *light, v4f lightmap, v3f N, v3f to_eye, v4f sample_colour)
+{
+  v3f L       = v3f_normalized(light->dir);
+  v3f H       = v3f_normalized(v3f_sub(to_eye, L));
+  f32 r_dot_v = Maximum(v3f_inner(N, H), 0.0f);
+
+  v4f diffuse  = soft_v4f_mul((v4f){ lightmap.r, lightmap.g, lightmap.b, 1.0f }, sample_colour);
+  v4f specular = soft_v4f_scale(0.5f * soft_pow8(r_dot_v) * soft_lerp(0.4f, 1.0f, lightmap.a), light->intensity);
+  v4f result   = soft_v4f_add(diffuse, specular);
+  return(result);
+}
+
+static v4f
+soft_shade_local_light(Light *light, v3f world_p, v3f N, v3f to_eye, v4f sample_colour)
+{
+  v3f L     = v3f_sub(light->P, world_p);
+  f32 dist  = sqrtf(v3f_inner(L, L));
+  L         = v3f_scale(1.0f / dist, L);
+  f32 r0    = 5.0f;
+  f32 ratio = dist / light->range;
+  f32 win   = Maximum(1.0f - (ratio * ratio) * (ratio * ratio), 0.0f);
+  f32 atten = (win * win) * (r0 * r0 / (dist * dist + 0.01f));
+  if (light->type == LightType_Spot)
+  {
+    f32 t = soft_saturate((-v3f_inner(L, light->dir) - light->spot_cos_outer) / (light->spot_cos_inner - light->spot_cos_outer));
+    atten *= t * t * (3.0f - 2.0f * t);
+  }
+
+  v3f H       = v3f_normalized(v3f_add(L, to_eye));
+  f32 n_dot_l = Maximum(v3f_inner(N, L), 0.0f);
+  f32 r_dot_v = Maximum(v3f_inner(N, H), 0.0f);
+
+  v4f diffuse  = soft_v4f_scale(n_dot_l, soft_v4f_mul(light->intensity, sample_colour));
+  v4f specular = soft_v4f_scale(0.5f * soft_pow8(r_dot_v), light->intensity);
+  v4f result   = soft_v4f_scale(atten, soft_v4f_add(diffuse, specular));
+  return(result);
+}
+
+// g_lightmap.SampleLevel at level 0
+static v4f
+soft_render_sample_lightmap(Soft_Renderer *renderer, v2f uv)
+{
+  u32 width  = renderer->lightmap_width;
+  u32 height = renderer->lightmap_height;
+  u32 x0, x1, y0, y1;
+  f32 t_x = soft_wrap_texels(uv.x * (f32)width - 0.5f, width, &x0, &x1);
+  f32 t_y = soft_wrap_texels(uv.y * (f32)height - 0.5f, height, &y0, &y1);
+
+  v4f *texels = renderer->lightmap_texels;
+  v4f  top    = soft_v4f_add(soft_v4f_scale(1.0f - t_x, texels[y0 * width + x0]), soft_v4f_scale(t_x, texels[y0 * width + x1]));
+  v4f  bottom = soft_v4f_add(soft_v4f_scale(1.0f - t_x, texels[y1 * width + x0]), soft_v4f_scale(t_x, texels[y1 * width + x1]));
+  v4f  result = soft_v4f_add(soft_v4f_scale(1.0f - t_y, top), soft_v4f_scale(t_y, bottom));
+  return(result);
+}
+
+// irradiance_volume_sample: the 8 probes around world_p, the nearest past
+// the grid
+static v3f
+soft_render_sample_irradiance(Soft_Renderer *renderer, v3f world_p, v3f N)
+{
+  Irradiance_Grid *grid = &renderer->irradiance_grid;
+  u32 counts[3] = { grid->probe_count_x, grid->probe_count_y, grid->probe_count_z };
+  u32 cell[3];
+  f32 t[3];
+  for (u32 axis = 0; axis < 3; ++axis)
+  {
+    f32 cell_p = (world_p.v[axis] - grid->origin.v[axis]) / grid->spacing;
+    cell_p     = Maximum(cell_p, 0.0f);
+    cell_p     = Minimum(cell_p, (f32)(counts[axis] - 1));
+    cell[axis] = (u32)cell_p;
+    cell[axis] = Minimum(cell[axis], Maximum(counts[axis], 2u) - 2);
+    t[axis]    = soft_saturate(cell_p - (f32)cell[axis]);
+  }
+
+  v3f result = v3f_zero();
+  for (u32 corner = 0; corner < 8; ++corner)
+  {
+    u32 at[3];
+    f32 weight = 1.0f;
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      u32 offset = (corner >> axis) & 1;
+      at[axis]   = Minimum(cell[axis] + offset, counts[axis] - 1);
+      weight    *= offset ? t[axis] : (1.0f - t[axis]);
+    }
+
+    Irradiance_SH *probe = renderer->irradiance_probes + (at[2] * counts[1] + at[1]) * counts[0] + at[0];
+    result = v3f_add(result, v3f_scale(weight, irradiance_sh_evaluate(probe, N)));
+  }
+
+  for (u32 channel = 0; channel < 3; ++channel)
+  {
+    result.v[channel] = Maximum(result.v[channel], 0.0f);
+  }
+  return(result);
+}
+
+static u32
+soft_pack_rgba8(v4f colour)
+{
+  u32 result = 0;
+  for (u32 channel = 0; channel < 4; ++channel)
+  {
+    result |= (u32)(soft_saturate(colour.v[channel]) * 255.0f + 0.5f) << (8 * channel);
+  }
+
+  return(result);
+}
+
+// ps_main at one pixel; values are its varyings, pixel its SV_Position
+static u32
+soft_render_shade_pixel(Soft_Tile_Job *job, Soft_Triangle *triangle, f32 *values, v2f uv_dx, v2f uv_dy, v4f pixel)
+{
+  Soft_Renderer  *renderer = job->renderer;
+  Soft_View      *view     = &renderer->view;
+  Model_Instance *instance = renderer->pass.scene->ins + triangle->instance_idx;
+
+  v3f world_p       = { values[SoftVarying_WorldX], values[SoftVarying_WorldY], values[SoftVarying_WorldZ] };
+  v4f sample_colour = instance->colour;
+  v3f N             = v3f_normalized((v3f){ values[SoftVarying_NormalX], values[SoftVarying_NormalY], values[SoftVarying_NormalZ] });
+  v3f to_eye        = v3f_normalized(v3f_sub(view->eye, world_p));
+
+  Soft_Material *material = soft_render_material(renderer, triangle->material_array, instance->texture_slice);
+  if (material)
+  {
+    v3f T         = { values[SoftVarying_TangentX], values[SoftVarying_TangentY], values[SoftVarying_TangentZ] };
+    v3f B         = { values[SoftVarying_BitangentX], values[SoftVarying_BitangentY], values[SoftVarying_BitangentZ] };
+    v3f surface_N = { values[SoftVarying_SurfaceNormalX], values[SoftVarying_SurfaceNormalY], values[SoftVarying_SurfaceNormalZ] };
+    v3f TBN_E     = v3f_normalized((v3f){ v3f_inner(T, to_eye), v3f_inner(B, to_eye), v3f_inner(surface_N, to_eye) });
+    v3f TBN_N     = v3f_normalized((v3f){ v3f_inner(T, N), v3f_inner(B, N), v3f_inner(surface_N, N) });
+    v2f uv        = { values[SoftVarying_U], values[SoftVarying_V] };
+
+    v2f tex_coord;
+    f32 displace_lod = soft_texture_lod(&material->displace, uv_dx, uv_dy);
+    if (material->cone_step && !(instance->texture_slice & TextureSlice_VirtualBit))
+    {
+      tex_coord = soft_parallax_cone_uv(&material->displace, TBN_E, uv, displace_lod);
+    }
+    else
+    {
+      tex_coord = soft_parallax_uv2(&material->displace, TBN_E, TBN_N, uv, displace_lod);
+    }
+
+    v4f texel = soft_texture_sample(&material->diffuse, tex_coord, soft_texture_lod(&material->diffuse, uv_dx, uv_dy));
+    sample_colour = soft_v4f_mul(sample_colour, texel);
+
+    // only xy is stored, z is rebuilt from the unit length
+    v4f normal_texel = soft_texture_sample(&material->normal, tex_coord, soft_texture_lod(&material->normal, uv_dx, uv_dy));
+    f32 normal_x     = normal_texel.x * 2.0f - 1.0f;
+    f32 normal_y     = normal_texel.y * 2.0f - 1.0f;
+    f32 normal_z     = sqrtf(soft_saturate(1.0f - normal_x * normal_x - normal_y * normal_y));
+    N = v3f_normalized(v3f_add(v3f_add(v3f_scale(normal_x, T), v3f_scale(normal_y, B)), v3f_scale(normal_z, surface_N)));
+  }
+
+  b32 lightmapped = (instance->lightmap_first_chart != Lightmap_None) && (view->directional_light_count > 0);
+  f32 shadow_multiplier = 1.0f;
+  if (instance->receives_shadow && !lightmapped)
+  {
+    Light *light = view->lights;
+
+    // the first cascade that holds the pixel with room for the PCF footprint
+    u32 cascade      = Shadow_CascadeCount;
+    v4f light_p      = { 0 };
+    f32 texel_margin = 3.0f / Shadow_MapSize;
+    for (u32 cascade_idx = 0; (cascade_idx < Shadow_CascadeCount) && (cascade == Shadow_CascadeCount); ++cascade_idx)
+    {
+      v4f cascade_p = soft_transform(renderer->shadows.cascades[cascade_idx].world_to_clip, world_p);
+      if ((fabsf(cascade_p.x) <= (1.0f - texel_margin)) && (fabsf(cascade_p.y) <= (1.0f - texel_margin)))
+      {
+        cascade = cascade_idx;
+        light_p = cascade_p;
+      }
+    }
+
+    if (cascade < Shadow_CascadeCount)
+    {
+      f32 slope         = 1.0f - soft_saturate(-v3f_inner(N, v3f_normalized(light->dir)));
+      f32 bias          = renderer->cascade_depth_bias[cascade] * (1.0f + 4.0f * slope);
+      f32 current_depth = soft_saturate(light_p.z) - bias;
+      v2f shadow_tex_p  = { light_p.x * 0.5f + 0.5f, 1.0f - (light_p.y * 0.5f + 0.5f) };
+      shadow_multiplier = soft_lerp(0.4f, 1.0f, shadow_filter_lit(job->shadow_maps + cascade, ShadowFilter_Gather, shadow_tex_p, current_depth));
+    }
+  }
+
+  v4f final_colour = { 0 };
+  if (instance->enable_lighting)
+  {
+    u32 first_light = 0;
+    if (lightmapped)
+    {
+      v4f lightmap = soft_render_sample_lightmap(renderer, (v2f){ values[SoftVarying_LightmapU], values[SoftVarying_LightmapV] });
+      final_colour = soft_v4f_saturate(soft_shade_lightmapped_light(view->lights, lightmap, N, to_eye, sample_colour));
+      first_light  = 1;
+    }
+
+    for (u32 light_idx = first_light; light_idx < view->directional_light_count; ++light_idx)
+    {
+      final_colour = soft_v4f_saturate(soft_v4f_add(soft_shade_directional_light(view->lights + light_idx, N, to_eye, sample_colour, shadow_multiplier), final_colour));
+    }
+
+    // pixel.w is the view depth
+    Light_Cluster_Grid *grid = &renderer->clusters;
+    u32 tile_x  = (u32)(pixel.x * ((f32)LightCluster_TilesX / (f32)renderer->width));
+    u32 tile_y  = (u32)(pixel.y * ((f32)LightCluster_TilesY / (f32)renderer->height));
+    tile_x      = Minimum(tile_x, LightCluster_TilesX - 1);
+    tile_y      = Minimum(tile_y, LightCluster_TilesY - 1);
+    f32 slice_f = floorf(logf(pixel.w) * grid->z_scale + grid->z_bias);
+    slice_f     = Maximum(slice_f, 0.0f);
+    slice_f     = Minimum(slice_f, LightCluster_Slices - 1.0f);
+    Light_Cluster *cluster = grid->clusters + ((u32)slice_f * LightCluster_TilesY + tile_y) * LightCluster_TilesX + tile_x;
+    for (u32 index_idx = cluster->offset; index_idx < cluster->offset + cluster->count; ++index_idx)
+    {
+      final_colour = soft_v4f_saturate(soft_v4f_add(soft_shade_local_light(view->lights + grid->indices[index_idx], world_p, N, to_eye, sample_colour), final_colour));
+    }
+  }
+  else
+  {
+    final_colour = sample_colour;
+  }
+
+  // a lightmap already holds the light bounced around the scene
+  v3f ambient_rgb = v3f_s(0.1f);
+  if (renderer->irradiance_probes && instance->enable_lighting && !lightmapped)
+  {
+    ambient_rgb = soft_render_sample_irradiance(renderer, world_p, N);
+  }
+  f32 occlusion = values[SoftVarying_AmbientOcclusion];
+  v4f ambient   = { ambient_rgb.r * occlusion, ambient_rgb.g * occlusion, ambient_rgb.b * occlusion, 1.0f };
+  final_colour  = soft_v4f_saturate(soft_v4f_add(soft_v4f_mul(ambient, sample_colour), final_colour));
+
+  if (instance->reflection_probe < renderer->reflection_probe_count)
+  {
+    f32 M_reflectance = 0.6f;
+    v3f R             = v3f_sub(v3f_scale(2.0f * v3f_inner(N, to_eye), N), to_eye);
+    v3f *cube         = renderer->reflection_cubes + instance->reflection_probe * reflection_probe_texel_count();
+    v3f reflected     = reflection_probe_sample(cube, R, instance->reflection_roughness * (ReflectionProbe_MipCount - 1));
+    f32 grazing       = 1.0f - soft_saturate(v3f_inner(N, to_eye));
+    f32 fresnel       = M_reflectance + (1.0f - M_reflectance) * (grazing * grazing) * (grazing * grazing) * grazing;
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      final_colour.v[channel] = soft_lerp(final_colour.v[channel], reflected.v[channel] * sample_colour.v[channel], fresnel);
+    }
+  }
+
+  u32 result = soft_pack_rgba8(final_colour);
+  return(result);
+}
+
+// every triangle left in the quad, once, with the quad's other pixels as
+// helpers for the derivatives; ddx and ddy are the fine ones
+static void
+soft_render_shade_tile(Soft_Tile_Job *job, s32 tile_x0, s32 tile_y0, s32 tile_x1, s32 tile_y1)
+{
+  Soft_Renderer *renderer = job->renderer;
+  Soft_Target   *target   = &renderer->target;
+  for (s32 y = tile_y0; y <= tile_y1; y += 2)
+  {
+    for (s32 x = tile_x0; x <= tile_x1; x += 2)
+    {
+      u32 *ids0 = target->triangle_ids + y * target->width + x;
+      u32 *ids1 = ids0 + target->width;
+      u32  ids[4] = { ids0[0], ids0[1], ids1[0], ids1[1] };
+      u32  colours[4] = { 0 };
+      for (u32 lane = 0; lane < 4; ++lane)
+      {
+        b32 first = (ids[lane] != SoftRender_NoTriangle);
+        for (u32 before = 0; before < lane; ++before)
+        {
+          first &= (ids[before] != ids[lane]);
+        }
+
+        if (first)
+        {
+          Soft_Triangle *triangle = renderer->triangles + ids[lane];
+          f32 values[SoftVarying_Count * 4];
+          f32 view_w[4];
+          soft_render_interpolate_quad(renderer, ids[lane], x, y, values, view_w);
+          ++job->shaded_quads;
+
+          for (u32 pixel_lane = lane; pixel_lane < 4; ++pixel_lane)
+          {
+            if (ids[pixel_lane] == ids[lane])
+            {
+              f32 pixel_values[SoftVarying_Count];
+              for (u32 varying = 0; varying < SoftVarying_Count; ++varying)
+              {
+                pixel_values[varying] = values[varying * 4 + pixel_lane];
+              }
+
+              u32 row    = pixel_lane & 2;
+              u32 column = pixel_lane & 1;
+              f32 *u     = values + SoftVarying_U * 4;
+              f32 *v     = values + SoftVarying_V * 4;
+              v2f uv_dx  = { u[row + 1] - u[row], v[row + 1] - v[row] };
+              v2f uv_dy  = { u[column + 2] - u[column], v[column + 2] - v[column] };
+              v4f pixel  = { (f32)(x + column) + 0.5f, (f32)(y + row / 2) + 0.5f, 0.0f, view_w[pixel_lane] };
+              colours[pixel_lane] = soft_render_shade_pixel(job, triangle, pixel_values, uv_dx, uv_dy, pixel);
+            }
+          }
+        }
+      }
+
+      u32 *colour0 = renderer->colour + y * renderer->width + x;
+      u32 *colour1 = colour0 + renderer->width;
+      colour0[0] = colours[0];
+      colour0[1] = colours[1];
+      colour1[0] = colours[2];
+      colour1[1] = colours[3];
+    }
+  }
+}
+
+static void
+soft_render_tile_job(void *data)
+{
+  Soft_Tile_Job *job        = (Soft_Tile_Job *)data;
+  Soft_Renderer *renderer   = job->renderer;
+  Soft_Pass     *pass       = &renderer->pass;
+  Soft_Target   *target     = pass->target;
+  u32            tile_count = target->tiles_x * target->tiles_y;
+  for (;;)
+  {
+    u32 tile = AtomicIncrementU32(&renderer->next_tile) - 1;
+    if (tile >= tile_count)
+    {
+      break;
+    }
+
+    s32 tile_x0 = (s32)(tile % target->tiles_x) * SoftRender_TileSize;
+    s32 tile_y0 = (s32)(tile / target->tiles_x) * SoftRender_TileSize;
+    s32 tile_x1 = Minimum(tile_x0 + SoftRender_TileSize, (s32)target->width) - 1;
+    s32 tile_y1 = Minimum(tile_y0 + SoftRender_TileSize, (s32)target->height) - 1;
+    if (pass->clear)
+    {
+      for (s32 y = tile_y0; y <= tile_y1; ++y)
+      {
+        for (s32 x = tile_x0; x <= tile_x1; ++x)
+        {
+          target->depth[y * target->width + x] = 1.0f;
+          if (target->triangle_ids)
+          {
+            target->triangle_ids[y * target->width + x] = SoftRender_NoTriangle;
+          }
+        }
+      }
+    }
+
+    for (u32 draw_job_idx = 0; draw_job_idx < renderer->draw_job_count; ++draw_job_idx)
+    {
+      Soft_Draw_Job *draw_job = renderer->draw_jobs + draw_job_idx;
+      for (u32 entry = draw_job->tile_offsets[tile]; entry < draw_job->tile_offsets[tile + 1]; ++entry)
+      {
+        soft_render_raster(renderer, draw_job->bin_entries[entry], tile_x0, tile_y0, tile_x1, tile_y1);
+      }
+    }
+
+    if (pass->shaded)
+    {
+      soft_render_shade_tile(job, tile_x0, tile_y0, tile_x1, tile_y1);
+    }
+  }
+}
+
+// ------------------------------------------------------------------------
+
+static void
+soft_render_run(OS_Work_Proc *proc, void *jobs, u32 job_count, u64 job_size, OS_Work_Queue *queue)
+{
+  for (u32 job_idx = 0; job_idx < job_count; ++job_idx)
+  {
+    void *job = (u8 *)jobs + job_idx * job_size;
+    if (queue)
+    {
+      os_work_queue_add(queue, proc, job);
+    }
+    else
+    {
+      proc(job);
+    }
+  }
+
+  if (queue)
+  {
+    os_work_queue_complete_all(queue);
+  }
+}
+
+static void
+soft_render_pass(Soft_Renderer *renderer, Soft_Target *target, Scene_Instances *scene, m44 world_to_clip, b32 shaded, b32 clear, OS_Work_Queue *queue)
+{
+  Soft_Pass *pass     = &renderer->pass;
+  pass->target        = target;
+  pass->scene         = scene;
+  pass->world_to_clip = world_to_clip;
+  pass->shaded        = shaded;
+  pass->clear         = clear;
+
+  // x + w, w - x, y + w, w - y, z, w - z, all at least 0 inside
+  v4f columns[4];
+  for (u32 column = 0; column < 4; ++column)
+  {
+    columns[column] = (v4f){ world_to_clip.m[0][column], world_to_clip.m[1][column], world_to_clip.m[2][column], world_to_clip.m[3][column] };
+  }
+  pass->planes[0] = soft_v4f_add(columns[3], columns[0]);
+  pass->planes[1] = soft_v4f_add(columns[3], soft_v4f_scale(-1.0f, columns[0]));
+  pass->planes[2] = soft_v4f_add(columns[3], columns[1]);
+  pass->planes[3] = soft_v4f_add(columns[3], soft_v4f_scale(-1.0f, columns[1]));
+  pass->planes[4] = columns[2];
+  pass->planes[5] = soft_v4f_add(columns[3], soft_v4f_scale(-1.0f, columns[2]));
+  for (u32 plane_idx = 0; plane_idx < ArrayCount(pass->planes); ++plane_idx)
+  {
+    v4f plane = pass->planes[plane_idx];
+    pass->planes[plane_idx] = soft_v4f_scale(1.0f / sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z), plane);
+  }
+
+  renderer->draw_job_count = 0;
+  for (u32 batch_idx = 0; batch_idx < scene->batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch        = scene->batches + batch_idx;
+    u32          end_instance = batch->first_instance + batch->instance_count;
+    for (u32 first_instance = batch->first_instance; first_instance < end_instance; first_instance += SoftRender_InstancesPerJob)
+    {
+      Assert(renderer->draw_job_count < SoftRender_MaxJobs);
+      Soft_Draw_Job *job  = renderer->draw_jobs + renderer->draw_job_count++;
+      job->batch          = batch;
+      job->first_instance = first_instance;
+      job->end_instance   = Minimum(first_instance + SoftRender_InstancesPerJob, end_instance);
+    }
+  }
+
+  if (renderer->draw_job_count || clear)
+  {
+    // room for the triangles every job may draw, on a guess of how many
+    // clipping adds; a guess short or bins that overflowed run it again
+    b32 done = false;
+    while (!done)
+    {
+      u32 triangle_total = 0;
+      for (u32 job_idx = 0; job_idx < renderer->draw_job_count; ++job_idx)
+      {
+        Soft_Draw_Job *job  = renderer->draw_jobs + job_idx;
+        u32            wanted = 0;
+        for (u32 instance_idx = job->first_instance; instance_idx < job->end_instance; ++instance_idx)
+        {
+          if (soft_render_sphere_visible(pass, scene->info + instance_idx))
+          {
+            wanted += renderer->meshes[job->batch->model].index_count / 3;
+          }
+        }
+
+        job->first_triangle    = triangle_total;
+        job->triangle_capacity = wanted ? (wanted * renderer->triangle_slack + 64) : 0;
+        triangle_total        += job->triangle_capacity;
+      }
+
+      if (triangle_total > renderer->triangle_capacity)
+      {
+        if (renderer->triangles)
+        {
+          os_memory_free(renderer->triangles, (u64)renderer->triangle_capacity * sizeof(Soft_Triangle));
+        }
+        renderer->triangle_capacity = triangle_total + triangle_total / 2;
+        renderer->triangles         = os_memory_alloc((u64)renderer->triangle_capacity * sizeof(Soft_Triangle));
+      }
+
+      if (shaded && (triangle_total > renderer->varying_capacity))
+      {
+        if (renderer->triangle_varyings)
+        {
+          os_memory_free(renderer->triangle_varyings, (u64)renderer->varying_capacity * 3 * SoftVarying_Count * sizeof(f32));
+        }
+        renderer->varying_capacity  = triangle_total + triangle_total / 2;
+        renderer->triangle_varyings = os_memory_alloc((u64)renderer->varying_capacity * 3 * SoftVarying_Count * sizeof(f32));
+      }
+
+      renderer->bin_used = 0;
+      soft_render_run(soft_render_draw_job, renderer->draw_jobs, renderer->draw_job_count, sizeof(Soft_Draw_Job), queue);
+
+      done = true;
+      for (u32 job_idx = 0; job_idx < renderer->draw_job_count; ++job_idx)
+      {
+        done &= (renderer->draw_jobs[job_idx].triangle_count <= renderer->draw_jobs[job_idx].triangle_capacity);
+      }
+      if (!done)
+      {
+        renderer->triangle_slack *= 2;
+      }
+
+      if (renderer->bin_used > renderer->bin_capacity)
+      {
+        os_memory_free(renderer->bin_entries, renderer->bin_capacity * sizeof(u32));
+        renderer->bin_capacity = renderer->bin_used * 2;
+        renderer->bin_entries  = os_memory_alloc(renderer->bin_capacity * sizeof(u32));
+        done = false;
+      }
+
+      renderer->pass_retries += !done;
+    }
+
+    for (u32 job_idx = 0; job_idx < renderer->draw_job_count; ++job_idx)
+    {
+      renderer->triangle_count += renderer->draw_jobs[job_idx].triangle_count;
+    }
+
+    renderer->next_tile = 0;
+    soft_render_run(soft_render_tile_job, renderer->tile_jobs, SoftRender_TileJobCount, sizeof(Soft_Tile_Job), queue);
+  }
+}
+
+static void
+soft_render_frame(Soft_Renderer *renderer, Scene_Instances *scene, Scene_Instances *shaded, Soft_View *view, OS_Work_Queue *queue)
+{
+  renderer->view           = *view;
+  renderer->triangle_count = 0;
+  renderer->pass_retries   = 0;
+  renderer->shaded_quads   = 0;
+  renderer->shadow_fetches = 0;
+
+  light_cluster_set_camera(&renderer->clusters, view->world_to_view, view->tan_half_fov_x, view->tan_half_fov_y, Scene_CameraNear, Scene_CameraFar);
+  light_cluster_build(&renderer->clusters, view->lights, view->light_count, queue);
+
+  // the maps keep whatever they last held while nothing shaded reads them
+  b32 shadows_received = shadow_scene_has_receivers(shaded);
+  if (shadows_received)
+  {
+    shadow_fit_cascades(&renderer->shadows, view->lights[0].dir, view->eye, view->front, view->tan_half_fov_x, view->tan_half_fov_y, Scene_CameraNear, scene);
+  }
+  for (u32 cascade_idx = 0; shadows_received && (cascade_idx < Shadow_CascadeCount); ++cascade_idx)
+  {
+    Shadow_Cascade *cascade = renderer->shadows.cascades + cascade_idx;
+    Soft_Target    *map     = renderer->shadow_maps + cascade_idx;
+    f32            *cached  = renderer->shadow_static[cascade_idx];
+    renderer->cascade_depth_bias[cascade_idx] = 2.0f * cascade->texel_world_size / (cascade->far_plane - cascade->near_plane);
+
+    if (shadow_cache_needs_static_redraw(&renderer->shadow_cache, &renderer->shadows, cascade_idx, scene->static_generation))
+    {
+      shadow_cull_scene(&renderer->shadows, cascade_idx, scene, 0, scene->static_instance_count, renderer->cascade_scene);
+      soft_render_pass(renderer, map, renderer->cascade_scene, cascade->world_to_clip, false, true, queue);
+      for (u32 texel = 0; texel < Shadow_MapSize * Shadow_MapSize; ++texel)
+      {
+        cached[texel] = map->depth[texel];
+      }
+    }
+    else
+    {
+      for (u32 texel = 0; texel < Shadow_MapSize * Shadow_MapSize; ++texel)
+      {
+        map->depth[texel] = cached[texel];
+      }
+    }
+
+    shadow_cull_scene(&renderer->shadows, cascade_idx, scene, scene->static_instance_count, scene->instance_count, renderer->cascade_scene);
+    renderer->shadow_cache.dynamic_instances += renderer->cascade_scene->instance_count;
+    soft_render_pass(renderer, map, renderer->cascade_scene, cascade->world_to_clip, false, false, queue);
+  }
+
+  for (u32 job_idx = 0; job_idx < SoftRender_TileJobCount; ++job_idx)
+  {
+    Soft_Tile_Job *job = renderer->tile_jobs + job_idx;
+    job->shaded_quads = 0;
+    for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+    {
+      job->shadow_maps[cascade_idx] = (Shadow_Filter_Map){ renderer->shadow_maps[cascade_idx].depth, Shadow_MapSize, 0 };
+    }
+  }
+
+  soft_render_pass(renderer, &renderer->target, shaded, m44_mul(view->world_to_view, view->projection), true, true, queue);
+  for (u32 job_idx = 0; job_idx < SoftRender_TileJobCount; ++job_idx)
+  {
+    Soft_Tile_Job *job = renderer->tile_jobs + job_idx;
+    renderer->shaded_quads += job->shaded_quads;
+    for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+    {
+      renderer->shadow_fetches += job->shadow_maps[cascade_idx].fetches;
+    }
+  }
+}
@@ -0,0 +1,271 @@
+#if !defined(SOFT_RENDER_H)
+#define SOFT_RENDER_H
+
+// A software backend for the frame scene_update_and_render draws through
+// D3D11, for machines without a GPU. It runs vs_depth_only into the shadow
+// cascades and vs_main / ps_main into a colour buffer from the same
+// instances, lights, clusters, baked data and material textures, with the
+// same rasterizer states, so a frame can be rendered and looked at headless.
+//
+// A pass is cut into draw jobs of at most SoftRender_InstancesPerJob
+// instances of one batch. Each runs the vertex stage over its instances,
+// clips their triangles to the near plane and a guard band, culls back faces
+// and sets up the rest, then bins them into SoftRender_TileSize square
+// tiles. SoftRender_TileJobCount jobs then pull tiles until none are left
+// and draw each by walking every draw job's bin for it in submission order,
+// one 2x2 quad of pixels at a time with SSE. The shadow passes keep depth
+// only. The main pass keeps the triangle nearest at every pixel as well, a
+// visibility buffer, and once the tile is done runs ps_main once per quad
+// and triangle in it, with the quad's other pixels as helpers for the uv
+// derivatives, so hidden pixels are never shaded.
+//
+// Vertices snap to 1/SoftRender_SubpixelSteps of a pixel and each edge
+// function is evaluated from the same end in both triangles sharing it, with
+// the top left rule, so shared edges neither crack nor double up. Tiles
+// never share pixels, so the image does not depend on the thread count.
+//
+// Not mirrored: residency, as every material is resident in full; virtual
+// texturing, as a virtual slot draws from a whole material like any other;
+// blending, as everything drawn is opaque.
+
+#define SoftRender_TileSize          32
+#define SoftRender_InstancesPerJob   16
+#define SoftRender_MaxJobs           (MaxSceneInstances / SoftRender_InstancesPerJob + MaxSceneBatches)
+#define SoftRender_TileJobCount      64
+// the hardware's 8 bits of subpixel precision
+#define SoftRender_SubpixelSteps     256.0f
+// triangles are only clipped where they leave this many times the view, so
+// screen coordinates stay small enough for the snapped edges to be exact
+#define SoftRender_GuardBand         4.0f
+// g_dx11_rasterizer_shadow_map_ccw's bias for a 32 bit float depth buffer
+#define SoftRender_ShadowDepthBias   10000.0f
+#define SoftRender_ShadowSlopeBias   1.0f
+#define SoftRender_NoTriangle        0xFFFFFFFF
+// a polygon clipped by the near plane and the four guard band planes
+#define SoftRender_MaxClipVertices   8
+
+// what vs_main hands ps_main, interpolated with perspective
+typedef u32 Soft_Varying;
+enum
+{
+  SoftVarying_U,
+  SoftVarying_V,
+  SoftVarying_LightmapU,
+  SoftVarying_LightmapV,
+  SoftVarying_AmbientOcclusion,
+  SoftVarying_WorldX,
+  SoftVarying_WorldY,
+  SoftVarying_WorldZ,
+  SoftVarying_NormalX,
+  SoftVarying_NormalY,
+  SoftVarying_NormalZ,
+  // the columns of TBN_to_world
+  SoftVarying_TangentX,
+  SoftVarying_TangentY,
+  SoftVarying_TangentZ,
+  SoftVarying_BitangentX,
+  SoftVarying_BitangentY,
+  SoftVarying_BitangentZ,
+  SoftVarying_SurfaceNormalX,
+  SoftVarying_SurfaceNormalY,
+  SoftVarying_SurfaceNormalZ,
+  SoftVarying_Count,
+};
+
+// clip position, then the varyings
+#define SoftRender_VertexFloats      (4 + SoftVarying_Count)
+
+// RGBA8 mips, sampled the way g_sample_linear_all samples: trilinear and
+// wrapping. Each mip comes from os_memory_alloc.
+typedef struct
+{
+  u32  width;
+  u32  height;
+  u32  mip_count;
+  u8  *mips[TexFile_MaxMips];
+} Soft_Texture;
+
+// One material's maps, as a slice of a bin holds them. The normal map keeps
+// x and y in r and g; displace keeps the height in r, and the cone ratio in
+// g when cone_step is set.
+typedef struct
+{
+  Soft_Texture diffuse;
+  Soft_Texture normal;
+  Soft_Texture displace;
+  b32          cone_step;
+} Soft_Material;
+
+// Edge k runs from vertex k to k + 1 and is
+// edge_a * (x - origin_x) + edge_b * (y - origin_y), at least 0 inside. Its
+// origin is the same end in both triangles sharing it. Screen space, pixel
+// centres at .5.
+typedef struct
+{
+  f32 edge_a[3];
+  f32 edge_b[3];
+  f32 origin_x[3];
+  f32 origin_y[3];
+  // all ones for top and left edges, which own the centres they pass through
+  u32 top_left[3];
+  f32 z[3];
+  f32 inv_w[3];
+  f32 inv_area;
+  // pixel rectangle, inclusive, already on the target
+  s32 min_x, min_y;
+  s32 max_x, max_y;
+  u32 instance_idx;
+  u32 material_array;
+} Soft_Triangle;
+
+// Depth rows top to bottom; triangle_ids only for the main pass.
+typedef struct
+{
+  u32  width;
+  u32  height;
+  u32  tiles_x;
+  u32  tiles_y;
+  f32 *depth;
+  u32 *triangle_ids;
+} Soft_Target;
+
+typedef struct
+{
+  Soft_Target     *target;
+  Scene_Instances *scene;
+  m44              world_to_clip;
+  // view frustum planes of world_to_clip, xyz . p + w >= 0 inside
+  v4f              planes[6];
+  // vs_main's varyings and the visibility buffer, or vs_depth_only and bias
+  b32              shaded;
+  // or draw over what the target holds
+  b32              clear;
+} Soft_Pass;
+
+typedef struct Soft_Renderer Soft_Renderer;
+typedef struct
+{
+  Soft_Renderer *renderer;
+  Scene_Batch   *batch;
+  u32            first_instance;
+  u32            end_instance;
+  // its run of the renderer's triangles; triangle_count past the capacity
+  // means the pass has to run again with more room
+  u32            first_triangle;
+  u32            triangle_capacity;
+  u32            triangle_count;
+  // per tile, into bin_entries
+  u32           *tile_offsets;
+  u32           *tile_cursors;
+  u32           *bin_entries;
+  // clip position and varyings of every vertex of the mesh being drawn
+  f32           *vertices;
+} Soft_Draw_Job;
+
+typedef struct
+{
+  Soft_Renderer    *renderer;
+  // its own copies, for the fetch counts
+  Shadow_Filter_Map shadow_maps[Shadow_CascadeCount];
+  u64               shaded_quads;
+} Soft_Tile_Job;
+
+// Where the frame is seen from and lit by. world_to_view and projection are
+// cbuffer0's, row vectors.
+typedef struct
+{
+  v3f    eye;
+  v3f    front;
+  m44    world_to_view;
+  m44    projection;
+  f32    tan_half_fov_x;
+  f32    tan_half_fov_y;
+  Light *lights;
+  u32    light_count;
+  u32    directional_light_count;
+} Soft_View;
+
+struct Soft_Renderer
+{
+  u32                 width;
+  u32                 height;
+  Soft_Target         target;
+  // RGBA8 rows, what the back buffer would hold
+  u32                *colour;
+
+  Shadow_Cascades     shadows;
+  Shadow_Cache        shadow_cache;
+  Soft_Target         shadow_maps[Shadow_CascadeCount];
+  // the static casters of each cascade, copied under the dynamic ones
+  f32                *shadow_static[Shadow_CascadeCount];
+  f32                 cascade_depth_bias[Shadow_CascadeCount];
+  Scene_Instances    *cascade_scene;
+  Light_Cluster_Grid  clusters;
+
+  Scene_Mesh          meshes[SceneModel_Count];
+  u32                 max_vertex_count;
+  Soft_Material      *materials[TexPack_MaxArrays][TexPack_MaxSlicesPerArray];
+  Soft_Material      *virtual_material;
+
+  // baked data, each left empty when it was not loaded
+  v3f                *reflection_cubes;
+  u32                 reflection_probe_count;
+  v4f                *lightmap_texels;
+  u32                 lightmap_width;
+  u32                 lightmap_height;
+  v4f                *lightmap_charts;
+  f32                *vertex_ao;
+  Irradiance_SH      *irradiance_probes;
+  Irradiance_Grid     irradiance_grid;
+
+  Soft_View           view;
+  Soft_Pass           pass;
+
+  Soft_Triangle      *triangles;
+  // three vertices' varyings per triangle, main pass only
+  f32                *triangle_varyings;
+  u32                 triangle_capacity;
+  u32                 varying_capacity;
+  // how many triangles a draw job makes room for per triangle it may draw
+  u32                 triangle_slack;
+  u32                *bin_entries;
+  u64                 bin_capacity;
+  // past bin_capacity when a pass ran out
+  volatile u64        bin_used;
+  Soft_Draw_Job       draw_jobs[SoftRender_MaxJobs];
+  u32                 draw_job_count;
+  u32                 max_tile_count;
+  volatile u32        next_tile;
+  Soft_Tile_Job       tile_jobs[SoftRender_TileJobCount];
+
+  // of the last frame
+  u32                 triangle_count;
+  u32                 pass_retries;
+  u64                 shaded_quads;
+  u64                 shadow_fetches;
+};
+
+// width and height even
+static void soft_render_alloc(Soft_Renderer *renderer, u32 width, u32 height);
+// Box filters pixels (width * height RGBA8) down to 1x1.
+static void soft_texture_from_rgba8(Soft_Texture *texture, u8 *pixels, u32 width, u32 height);
+// every mip of a baked texture, BC5 decoded
+static void soft_texture_from_tex_file(Soft_Texture *texture, Tex_File_Header *header);
+// the mip SampleGrad picks for these uv derivatives
+static f32  soft_texture_lod(Soft_Texture *texture, v2f dx, v2f dy);
+static v4f  soft_texture_sample(Soft_Texture *texture, v2f uv, f32 lod);
+// the material instances in slot draw with, virtual or not; it must outlive
+// the renderer
+static void soft_render_set_material(Soft_Renderer *renderer, Tex_Pack_Slot slot, Soft_Material *material);
+// The baked data main.c's dx11_load_* upload, taken the same way: the
+// renderer keeps its own copy, and the lightmap and occlusion point scene's
+// static instances at theirs. Files baked from another scene are ignored.
+static void soft_render_load_reflection_probes(Soft_Renderer *renderer, Reflection_Probe_Header *header);
+static void soft_render_load_lightmap(Soft_Renderer *renderer, Lightmap_Header *header, Scene_Instances *scene);
+static void soft_render_load_vertex_ao(Soft_Renderer *renderer, Vertex_AO_Header *header, Scene_Instances *scene);
+static void soft_render_load_irradiance_volume(Soft_Renderer *renderer, Irradiance_Volume_Header *header);
+// Draws the shadow cascades from scene and then shaded, which is scene or a
+// culled copy of it, into renderer->colour. queue may be 0.
+static void soft_render_frame(Soft_Renderer *renderer, Scene_Instances *scene, Scene_Instances *shaded, Soft_View *view, OS_Work_Queue *queue);
+
+#endif
@@ -0,0 +1,88 @@
+static u32
+tex_file_row_pitch(Tex_File_Format format, u32 width)
+{
+  u32 result = width * 4;
+  if (format == TexFileFormat_BC5)
+  {
+    result = ((width + 3) / 4) * 16;
+  }
+  else if (format == TexFileFormat_RG8)
+  {
+    result = width * 2;
+  }
+
+  return(result);
+}
+
+// rows as UpdateSubresource counts them: block rows for BC formats
+static u32
+tex_file_row_count(Tex_File_Format format, u32 height)
+{
+  u32 result = height;
+  if (format == TexFileFormat_BC5)
+  {
+    result = (height + 3) / 4;
+  }
+
+  return(result);
+}
+
+static u64
+tex_file_mip_size(Tex_File_Format format, u32 width, u32 height)
+{
+  u64 result = (u64)tex_file_row_pitch(format, width) * tex_file_row_count(format, height);
+  return(result);
+}
+
+// Validates a container in place; returns 0 if it is not one.
+static Tex_File_Header *
+tex_file_parse(u8 *data, u64 size)
+{
+  Tex_File_Header *result = (Tex_File_Header *)data;
+  b32 valid = data && (size >= sizeof(Tex_File_Header)) &&
+              (result->magic == TexFile_Magic) && (result->version == TexFile_Version) &&
+              (result->format < TexFileFormat_Count) && result->mip_count && (result->mip_count <= TexFile_MaxMips);
+  for (u32 mip = 0; valid && (mip < result->mip_count); ++mip)
+  {
+    u32 width  = Maximum(result->width >> mip, 1);
+    u32 height = Maximum(result->height >> mip, 1);
+    valid = (result->mip_sizes[mip] == tex_file_mip_size(result->format, width, height)) &&
+            (result->mip_sizes[mip] <= size) && (result->mip_offsets[mip] <= size - result->mip_sizes[mip]);
+  }
+
+  return(valid ? result : 0);
+}
+
+// 8-value BC4 mode with the block's max and min as endpoints. Palette entry
+// 0 is the max, 1 the min and 2..7 step from max towards min.
+static void
+tex_file_encode_bc4_block(u8 values[16], u8 *dest)
+{
+  u8 max = values[0];
+  u8 min = values[0];
+  for (u32 texel = 1; texel < 16; ++texel)
+  {
+    max = Maximum(max, values[texel]);
+    min = Minimum(min, values[texel]);
+  }
+
+  dest[0] = max;
+  dest[1] = min;
+
+  u64 indices = 0;
+  if (max != min)
+  {
+    u32 range = max - min;
+    for (u32 texel = 0; texel < 16; ++texel)
+    {
+      u32 step  = ((u32)(max - values[texel]) * 7 + range / 2) / range;
+      u64 index = (step == 0) ? 0 : ((step == 7) ? 1 : (step + 1));
+      indices  |= index << (3 * texel);
+    }
+  }
+
+  for (u32 byte = 0; byte < 6; ++byte)
+  {
+    dest[2 + byte] = (u8)(indices >> (8 * byte));
+  }
+}
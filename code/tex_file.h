@@ -0,0 +1,41 @@
+#if !defined(TEX_FILE_H)
+#define TEX_FILE_H
+
+// Baked texture container: a header followed by every mip, ready to hand to
+// UpdateSubresource as is. Lives in the asset pack, so mips are read
+// straight out of the mapping.
+
+#define TexFile_Magic     0x58455454 // "TTEX"
+#define TexFile_Version   1
+#define TexFile_MaxMips   16
+
+typedef u32 Tex_File_Format;
+enum
+{
+  TexFileFormat_RGBA8,
+  // two BC4 blocks per 4x4: x and y of a unit vector, z rebuilt in the shader
+  TexFileFormat_BC5,
+  // height and cone ratio for parallax_cone_uv (see cone_step.h)
+  TexFileFormat_RG8,
+  TexFileFormat_Count,
+};
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 format;
+  u32 width;
+  u32 height;
+  u32 mip_count;
+  u64 mip_offsets[TexFile_MaxMips];
+  u64 mip_sizes[TexFile_MaxMips];
+} Tex_File_Header;
+
+static u32              tex_file_row_pitch(Tex_File_Format format, u32 width);
+static u32              tex_file_row_count(Tex_File_Format format, u32 height);
+static u64              tex_file_mip_size(Tex_File_Format format, u32 width, u32 height);
+static Tex_File_Header *tex_file_parse(u8 *data, u64 size);
+static void             tex_file_encode_bc4_block(u8 values[16], u8 *dest);
+
+#endif
@@ -0,0 +1,148 @@
+static Tex_Pack_Slot
+tex_pack_add(Tex_Packer *packer, s32 width, s32 height)
+{
+  Tex_Pack_Array *array = 0;
+  u32 array_idx = 0;
+  for (; array_idx < packer->array_count; ++array_idx)
+  {
+    Tex_Pack_Array *candidate = packer->arrays + array_idx;
+    if ((candidate->width == width) && (candidate->height == height) &&
+        (candidate->slice_count < TexPack_MaxSlicesPerArray))
+    {
+      array = candidate;
+      break;
+    }
+  }
+
+  if (!array)
+  {
+    Assert(packer->array_count < TexPack_MaxArrays);
+    array_idx           = packer->array_count++;
+    array               = packer->arrays + array_idx;
+    array->width        = width;
+    array->height       = height;
+    array->slice_count  = 0;
+  }
+
+  Tex_Pack_Slot result =
+  {
+    .array_idx = array_idx,
+    .slice     = array->slice_count++,
+  };
+
+  return(result);
+}
+
+static u32
+tex_pack_mip_count(s32 width, s32 height)
+{
+  u32 result = 1;
+  s32 dim    = width > height ? width : height;
+  while (dim > 1)
+  {
+    dim >>= 1;
+    ++result;
+  }
+
+  return(result);
+}
+
+static void
+tex_atlas_begin(Tex_Atlas *atlas, s32 width, s32 height, Tex_Skyline_Segment *segments)
+{
+  atlas->width         = width;
+  atlas->height        = height;
+  atlas->segments      = segments;
+  atlas->segments[0]   = (Tex_Skyline_Segment){ 0, 0, width };
+  atlas->segment_count = 1;
+}
+
+static b32
+tex_atlas_add(Tex_Atlas *atlas, s32 width, s32 height, s32 *x, s32 *y)
+{
+  // the lowest top, then the narrowest segment to start on
+  u32 best_idx   = atlas->segment_count;
+  s32 best_top   = atlas->height;
+  s32 best_width = atlas->width + 1;
+  for (u32 segment_idx = 0; segment_idx < atlas->segment_count; ++segment_idx)
+  {
+    Tex_Skyline_Segment *segment = atlas->segments + segment_idx;
+    if (segment->x + width > atlas->width)
+    {
+      break;
+    }
+
+    s32 bottom = 0;
+    for (u32 span_idx = segment_idx; (span_idx < atlas->segment_count) && (atlas->segments[span_idx].x < segment->x + width); ++span_idx)
+    {
+      bottom = Maximum(bottom, atlas->segments[span_idx].y);
+    }
+
+    s32 top = bottom + height;
+    if ((top <= atlas->height) && ((top < best_top) || ((top == best_top) && (segment->width < best_width))))
+    {
+      best_idx   = segment_idx;
+      best_top   = top;
+      best_width = segment->width;
+      *x         = segment->x;
+      *y         = bottom;
+    }
+  }
+
+  b32 result = (best_idx < atlas->segment_count);
+  if (result)
+  {
+    // drop the segments the rectangle covers, trim the one it ends on
+    s32 right   = *x + width;
+    u32 end_idx = best_idx;
+    while ((end_idx < atlas->segment_count) && (atlas->segments[end_idx].x + atlas->segments[end_idx].width <= right))
+    {
+      ++end_idx;
+    }
+
+    if ((end_idx < atlas->segment_count) && (atlas->segments[end_idx].x < right))
+    {
+      Tex_Skyline_Segment *trimmed = atlas->segments + end_idx;
+      trimmed->width -= right - trimmed->x;
+      trimmed->x      = right;
+    }
+
+    // end_idx - best_idx segments become one
+    u32 removed = end_idx - best_idx;
+    if (removed == 0)
+    {
+      for (u32 segment_idx = atlas->segment_count; segment_idx > best_idx; --segment_idx)
+      {
+        atlas->segments[segment_idx] = atlas->segments[segment_idx - 1];
+      }
+      ++atlas->segment_count;
+    }
+    else
+    {
+      for (u32 segment_idx = end_idx; segment_idx < atlas->segment_count; ++segment_idx)
+      {
+        atlas->segments[segment_idx - removed + 1] = atlas->segments[segment_idx];
+      }
+      atlas->segment_count -= removed - 1;
+    }
+    atlas->segments[best_idx] = (Tex_Skyline_Segment){ *x, best_top, width };
+
+    // neighbours at the same height merge, so the count stays bounded
+    u32 write_idx = 0;
+    for (u32 segment_idx = 1; segment_idx < atlas->segment_count; ++segment_idx)
+    {
+      Tex_Skyline_Segment *last = atlas->segments + write_idx;
+      if (atlas->segments[segment_idx].y == last->y)
+      {
+        last->width += atlas->segments[segment_idx].width;
+      }
+      else
+      {
+        atlas->segments[++write_idx] = atlas->segments[segment_idx];
+      }
+    }
+    atlas->segment_count = write_idx + 1;
+  }
+
+  return(result);
+}
@@ -0,0 +1,54 @@
+#if !defined(TEX_PACK_H)
+#define TEX_PACK_H
+
+// Groups same-sized texture sets into array "bins" so that every set in a bin
+// can live in one Texture2DArray and be addressed by slice index.
+
+#define TexPack_MaxArrays 8
+#define TexPack_MaxSlicesPerArray 64
+
+typedef struct
+{
+  s32 width;
+  s32 height;
+  u32 slice_count;
+} Tex_Pack_Array;
+
+typedef struct
+{
+  u32 array_idx;
+  u32 slice;
+} Tex_Pack_Slot;
+
+typedef struct
+{
+  Tex_Pack_Array arrays[TexPack_MaxArrays];
+  u32            array_count;
+} Tex_Packer;
+
+// Packs rectangles into one texture (the lightmap atlas) along a skyline,
+// the top edge of everything placed so far. Each rectangle goes where its
+// top ends lowest, which wastes little when they come tallest first.
+typedef struct
+{
+  s32 x;
+  s32 y;
+  s32 width;
+} Tex_Skyline_Segment;
+
+typedef struct
+{
+  s32                  width;
+  s32                  height;
+  // room for width of them, from the caller
+  Tex_Skyline_Segment *segments;
+  u32                  segment_count;
+} Tex_Atlas;
+
+static Tex_Pack_Slot tex_pack_add(Tex_Packer *packer, s32 width, s32 height);
+static u32           tex_pack_mip_count(s32 width, s32 height);
+static void          tex_atlas_begin(Tex_Atlas *atlas, s32 width, s32 height, Tex_Skyline_Segment *segments);
+// false if the rectangle fits nowhere
+static b32           tex_atlas_add(Tex_Atlas *atlas, s32 width, s32 height, s32 *x, s32 *y);
+
+#endif
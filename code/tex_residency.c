@@ -0,0 +1,255 @@
+static void
+residency_init(Residency_Manager *manager, u64 budget_bytes, u64 max_load_bytes_per_frame)
+{
+  *manager = (Residency_Manager){ 0 };
+  manager->budget_bytes               = budget_bytes;
+  manager->max_load_bytes_per_frame   = max_load_bytes_per_frame;
+}
+
+static u64
+residency_mip_bytes(Residency_Texture *texture, u32 mip)
+{
+  u64 width  = (u64)Maximum(texture->width >> mip, 1);
+  u64 height = (u64)Maximum(texture->height >> mip, 1);
+  return(width * height * texture->bytes_per_texel);
+}
+
+// Textures start with only their floor tail resident, like a freshly
+// streamed-in asset, and fault in detail as requests arrive.
+static u32
+residency_register(Residency_Manager *manager, s32 width, s32 height, u32 bytes_per_texel)
+{
+  Assert(manager->texture_count < Residency_MaxTextures);
+  u32 result = manager->texture_count++;
+
+  Residency_Texture *texture  = manager->textures + result;
+  texture->width              = width;
+  texture->height             = height;
+  texture->bytes_per_texel    = bytes_per_texel;
+  texture->mip_count          = tex_pack_mip_count(width, height);
+  texture->floor_mip          = 0;
+  while ((texture->floor_mip + 1 < texture->mip_count) &&
+         (Maximum(width >> texture->floor_mip, height >> texture->floor_mip) > ResidencyMip_FloorDim))
+  {
+    ++texture->floor_mip;
+  }
+
+  texture->resident_mip       = texture->floor_mip;
+  texture->wanted_mip         = texture->floor_mip;
+  texture->last_used_frame    = 0;
+
+  for (u32 mip = texture->floor_mip; mip < texture->mip_count; ++mip)
+  {
+    manager->resident_bytes += residency_mip_bytes(texture, mip);
+  }
+
+  return(result);
+}
+
+// The footprint is the on-screen size in pixels of one UV repeat of the
+// texture. Mip n is right once the texture is 2^n times wider than that.
+static u32
+residency_mip_from_footprint(s32 width, s32 height, f32 footprint_pixels)
+{
+  u32 result    = 0;
+  f32 texels    = (f32)Maximum(width, height);
+  f32 footprint = Maximum(footprint_pixels, 1.0f);
+  while (texels > footprint * 2.0f)
+  {
+    texels *= 0.5f;
+    ++result;
+  }
+
+  return(result);
+}
+
+static void
+residency_request(Residency_Manager *manager, u32 texture_id, u32 wanted_mip)
+{
+  Assert(texture_id < manager->texture_count);
+  Residency_Texture *texture = manager->textures + texture_id;
+  if (wanted_mip > texture->floor_mip)
+  {
+    wanted_mip = texture->floor_mip;
+  }
+
+  // first request this frame resets the previous frame's wish
+  if (texture->last_used_frame != manager->frame)
+  {
+    texture->wanted_mip       = wanted_mip;
+    texture->last_used_frame  = manager->frame;
+  }
+  else if (wanted_mip < texture->wanted_mip)
+  {
+    texture->wanted_mip = wanted_mip;
+  }
+
+  ++manager->frame_stats.requests;
+  if (texture->resident_mip <= wanted_mip)
+  {
+    ++manager->frame_stats.hits;
+  }
+}
+
+// what residency_evict_one could free, called until it fails
+static u64
+residency_evictable_bytes(Residency_Manager *manager, u32 protect_id)
+{
+  u64 result = 0;
+  for (u32 texture_id = 0; texture_id < manager->texture_count; ++texture_id)
+  {
+    Residency_Texture *texture = manager->textures + texture_id;
+    u32 keep_mip = (texture->last_used_frame == manager->frame) ? texture->wanted_mip : texture->floor_mip;
+    for (u32 mip = texture->resident_mip; (texture_id != protect_id) && (mip < keep_mip); ++mip)
+    {
+      result += residency_mip_bytes(texture, mip);
+    }
+  }
+
+  return(result);
+}
+
+static b32
+residency_evict_one(Residency_Manager *manager, u32 protect_id)
+{
+  // pick the least recently used texture that still has something above its floor
+  Residency_Texture *victim = 0;
+  for (u32 texture_id = 0; texture_id < manager->texture_count; ++texture_id)
+  {
+    Residency_Texture *texture = manager->textures + texture_id;
+    b32 evictable = (texture_id != protect_id) && (texture->resident_mip < texture->floor_mip);
+    if (evictable && texture->last_used_frame == manager->frame)
+    {
+      // used this frame: only give up mips it did not ask for
+      evictable = texture->resident_mip < texture->wanted_mip;
+    }
+
+    if (evictable && (!victim || texture->last_used_frame < victim->last_used_frame))
+    {
+      victim = texture;
+    }
+  }
+
+  if (victim)
+  {
+    u64 bytes = residency_mip_bytes(victim, victim->resident_mip);
+    ++victim->resident_mip;
+    manager->resident_bytes              -= bytes;
+    manager->frame_stats.bytes_evicted   += bytes;
+    ++manager->frame_stats.mips_evicted;
+  }
+
+  return(!!victim);
+}
+
+static void
+residency_update(Residency_Manager *manager)
+{
+  u64 load_bytes_left = manager->max_load_bytes_per_frame;
+
+  // serve this frame's textures, the ones wanting the most detail first
+  for (;;)
+  {
+    Residency_Texture *next = 0;
+    u32 next_id = 0;
+    for (u32 texture_id = 0; texture_id < manager->texture_count; ++texture_id)
+    {
+      Residency_Texture *texture = manager->textures + texture_id;
+      if ((texture->last_used_frame == manager->frame) && (texture->wanted_mip < texture->resident_mip))
+      {
+        u32 deficit = texture->resident_mip - texture->wanted_mip;
+        if (!next || deficit > (next->resident_mip - next->wanted_mip))
+        {
+          next    = texture;
+          next_id = texture_id;
+        }
+      }
+    }
+
+    if (!next)
+    {
+      break;
+    }
+
+    // a mip bigger than the whole cap still goes through on an otherwise idle frame
+    u64 bytes = residency_mip_bytes(next, next->resident_mip - 1);
+    if ((bytes > load_bytes_left) && (load_bytes_left != manager->max_load_bytes_per_frame))
+    {
+      break;
+    }
+
+    if (manager->resident_bytes + bytes > manager->budget_bytes + residency_evictable_bytes(manager, next_id))
+    {
+      // budget exhausted by textures that are all needed this frame; evict
+      // nothing for a load that would not fit anyway
+      next->wanted_mip = next->resident_mip;
+      continue;
+    }
+
+    while (manager->resident_bytes + bytes > manager->budget_bytes)
+    {
+      residency_evict_one(manager, next_id);
+    }
+
+    --next->resident_mip;
+    load_bytes_left                     = (bytes < load_bytes_left) ? (load_bytes_left - bytes) : 0;
+    manager->resident_bytes            += bytes;
+    manager->frame_stats.bytes_loaded  += bytes;
+    ++manager->frame_stats.mips_loaded;
+  }
+
+  // a lowered budget also applies to textures nobody asked for
+  while (manager->resident_bytes > manager->budget_bytes)
+  {
+    if (!residency_evict_one(manager, Residency_MaxTextures))
+    {
+      break;
+    }
+  }
+
+  if (manager->resident_bytes > manager->peak_resident_bytes)
+  {
+    manager->peak_resident_bytes = manager->resident_bytes;
+  }
+
+  manager->total_stats.requests       += manager->frame_stats.requests;
+  manager->total_stats.hits           += manager->frame_stats.hits;
+  manager->total_stats.bytes_loaded   += manager->frame_stats.bytes_loaded;
+  manager->total_stats.bytes_evicted  += manager->frame_stats.bytes_evicted;
+  manager->total_stats.mips_loaded    += manager->frame_stats.mips_loaded;
+  manager->total_stats.mips_evicted   += manager->frame_stats.mips_evicted;
+  manager->frame_stats = (Residency_Stats){ 0 };
+  ++manager->frame;
+}
+
+// Estimates every textured instance's screen footprint from its bounding
+// sphere. The generated meshes map one UV repeat across each face, so the
+// projected diameter is close to the size of one texture repeat on screen.
+static void
+residency_request_scene(Residency_Manager *manager, Scene_Instances *scene, u32 material_texture_ids[MaterialType_Count],
+                        v3f eye_p, v3f eye_front, f32 pixels_per_unit_at_unit_distance)
+{
+  for (u32 instance_idx = 0; instance_idx < scene->instance_count; ++instance_idx)
+  {
+    Scene_Instance_Info *info = scene->info + instance_idx;
+    if (info->material == MaterialType_None)
+    {
+      continue;
+    }
+
+    v3f to_instance = v3f_sub(info->bound_p, eye_p);
+    f32 depth       = v3f_inner(to_instance, eye_front);
+    if (depth < -info->bound_radius)
+    {
+      continue;
+    }
+
+    f32 distance  = sqrtf(v3f_inner(to_instance, to_instance));
+    f32 diameter  = 2.0f * info->bound_radius;
+    f32 footprint = (diameter * pixels_per_unit_at_unit_distance) / Maximum(distance - info->bound_radius, 0.1f);
+
+    u32 texture_id = material_texture_ids[info->material];
+    Residency_Texture *texture = manager->textures + texture_id;
+    residency_request(manager, texture_id, residency_mip_from_footprint(texture->width, texture->height, footprint));
+  }
+}
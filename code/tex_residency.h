@@ -0,0 +1,62 @@
+#if !defined(TEX_RESIDENCY_H)
+#define TEX_RESIDENCY_H
+
+// Mip-granular texture residency. Each texture keeps a contiguous tail of
+// resident mips [resident_mip, mip_count). Requests lower wanted_mip; when
+// the resident total goes over budget the least recently used textures lose
+// their most detailed mips first. Mips at or below ResidencyMip_FloorDim are
+// never evicted so something is always there to sample. A texture is
+// whatever the caller streams as one chain; the renderer registers each
+// material array bin, as its slices share one.
+
+#define Residency_MaxTextures 64
+#define ResidencyMip_FloorDim 128
+
+typedef struct
+{
+  s32 width;
+  s32 height;
+  u32 bytes_per_texel;
+  u32 mip_count;
+  u32 floor_mip;
+  u32 resident_mip;
+  u32 wanted_mip;
+  u64 last_used_frame;
+} Residency_Texture;
+
+typedef struct
+{
+  u64 requests;
+  u64 hits;
+  u64 bytes_loaded;
+  u64 bytes_evicted;
+  u64 mips_loaded;
+  u64 mips_evicted;
+} Residency_Stats;
+
+typedef struct
+{
+  u64               budget_bytes;
+  u64               resident_bytes;
+  u64               max_load_bytes_per_frame;
+  u64               frame;
+
+  Residency_Texture textures[Residency_MaxTextures];
+  u32               texture_count;
+
+  Residency_Stats   frame_stats;
+  Residency_Stats   total_stats;
+  u64               peak_resident_bytes;
+} Residency_Manager;
+
+static void residency_init(Residency_Manager *manager, u64 budget_bytes, u64 max_load_bytes_per_frame);
+static u32  residency_register(Residency_Manager *manager, s32 width, s32 height, u32 bytes_per_texel);
+static u64  residency_mip_bytes(Residency_Texture *texture, u32 mip);
+static u32  residency_mip_from_footprint(s32 width, s32 height, f32 footprint_pixels);
+static void residency_request(Residency_Manager *manager, u32 texture_id, u32 wanted_mip);
+static void residency_update(Residency_Manager *manager);
+
+static void residency_request_scene(Residency_Manager *manager, Scene_Instances *scene, u32 material_texture_ids[MaterialType_Count],
+                                    v3f eye_p, v3f eye_front, f32 pixels_per_unit_at_unit_distance);
+
+#endif
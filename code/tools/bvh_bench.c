@@ -0,0 +1,384 @@
+// Times the BVH (bvh.c) on the default scene and on a stress scene of
+// random spheres, and checks it. Exits non-zero if a check fails.
+//
+// usage: bvh_bench [stress_triangles] [thread_count]
+//
+//   threads       a build on a work queue is bit-identical to a serial one
+//   structure     every triangle sits in exactly one leaf, and every box
+//                 holds its children and triangles
+//   closest       bvh_intersect finds the same t as testing every triangle
+//   any           bvh_occluded agrees with testing every triangle
+//   packets       packet traversal returns what the same rays do one by one
+//
+// Rays are a 2x2 tiled camera view of the whole scene (closest hit) and
+// shadow rays from what it sees toward the sun (any hit). stress_triangles
+// 0 skips the stress scene.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "check.h"
+
+#define Bench_ImageSize      512
+#define Bench_StressQuality  64
+#define Bench_StressField    400.0f
+
+static Scene_Instances g_scene;
+
+static b32
+bench_box_holds(Bvh_Node *node, u32 slot, v3f p, f32 slack)
+{
+  b32 result = (p.x >= node->min_x[slot] - slack) && (p.x <= node->max_x[slot] + slack) &&
+               (p.y >= node->min_y[slot] - slack) && (p.y <= node->max_y[slot] + slack) &&
+               (p.z >= node->min_z[slot] - slack) && (p.z <= node->max_z[slot] + slack);
+  return(result);
+}
+
+// walks the tree from node_idx, counting each source triangle it reaches
+static void
+bench_check_node(Bvh *bvh, u32 node_idx, u8 *seen, f32 slack)
+{
+  Bvh_Node *node = bvh->nodes + node_idx;
+  for (u32 slot = 0; slot < Bvh_Width; ++slot)
+  {
+    u32 child = node->child[slot];
+    if (child == Bvh_EmptyChild)
+    {
+      check(node->min_x[slot] > node->max_x[slot], "structure", node_idx, node->min_x[slot]);
+    }
+    else if (child & Bvh_LeafBit)
+    {
+      u32 first = child & ~Bvh_LeafBit;
+      check((node->leaf_count[slot] > 0) && (node->leaf_count[slot] <= Bvh_MaxLeafTriangles) &&
+            (first + node->leaf_count[slot] <= bvh->triangle_count), "structure", node_idx, (f32)node->leaf_count[slot]);
+      for (u32 triangle_idx = first; triangle_idx < first + node->leaf_count[slot]; ++triangle_idx)
+      {
+        Bvh_Triangle *triangle = bvh->triangles + triangle_idx;
+        ++seen[triangle->source_idx];
+        check(bench_box_holds(node, slot, triangle->v0, slack) &&
+              bench_box_holds(node, slot, v3f_add(triangle->v0, triangle->e1), slack) &&
+              bench_box_holds(node, slot, v3f_add(triangle->v0, triangle->e2), slack), "structure", triangle_idx, 0.0f);
+      }
+    }
+    else
+    {
+      check(child > node_idx && child < bvh->node_count, "structure", node_idx, (f32)child);
+      Bvh_Node *inner = bvh->nodes + child;
+      for (u32 inner_slot = 0; inner_slot < Bvh_Width; ++inner_slot)
+      {
+        if (inner->child[inner_slot] != Bvh_EmptyChild)
+        {
+          v3f min = { inner->min_x[inner_slot], inner->min_y[inner_slot], inner->min_z[inner_slot] };
+          v3f max = { inner->max_x[inner_slot], inner->max_y[inner_slot], inner->max_z[inner_slot] };
+          check(bench_box_holds(node, slot, min, 0.0f) && bench_box_holds(node, slot, max, 0.0f), "structure", child, 0.0f);
+        }
+      }
+      bench_check_node(bvh, child, seen, slack);
+    }
+  }
+}
+
+static b32
+bench_brute_force(Bvh *bvh, v3f origin, v3f dir, f32 t_min, f32 t_max, Bvh_Hit *hit)
+{
+  b32 result = false;
+  hit->t = t_max;
+  for (u32 triangle_idx = 0; triangle_idx < bvh->triangle_count; ++triangle_idx)
+  {
+    result |= bvh_triangle_intersect(bvh->triangles + triangle_idx, origin, dir, t_min, hit->t, hit);
+  }
+  return(result);
+}
+
+typedef struct
+{
+  v3f origin;
+  v3f dir;
+  f32 t_min;
+  f32 t_max;
+} Bench_Ray;
+
+// Packet p holds the 2x2 pixel tile p, so packets and single rays trace the
+// same rays in the same order.
+static void
+bench_camera_rays(Bvh *bvh, Bench_Ray *rays)
+{
+  v3f center = v3f_scale(0.5f, v3f_add(bvh->bounds.min, bvh->bounds.max));
+  v3f extent = v3f_sub(bvh->bounds.max, bvh->bounds.min);
+  f32 size   = Maximum(extent.x, Maximum(extent.y, extent.z));
+  v3f eye    = v3f_add(center, (v3f){ 0.45f * size, 0.35f * size, -0.75f * size });
+  Basis_R3 basis = br3_from_center_to_target(eye, center, (v3f){ 0.0f, 1.0f, 0.0f });
+  f32 half_fov   = tanf(Radians(Scene_CameraFovDegrees) * 0.5f);
+
+  for (u32 tile_idx = 0; tile_idx < (Bench_ImageSize / 2) * (Bench_ImageSize / 2); ++tile_idx)
+  {
+    u32 tile_x = tile_idx % (Bench_ImageSize / 2);
+    u32 tile_y = tile_idx / (Bench_ImageSize / 2);
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      f32 x = (2.0f * (f32)(tile_x * 2 + (lane & 1)) + 1.0f) / Bench_ImageSize - 1.0f;
+      f32 y = 1.0f - (2.0f * (f32)(tile_y * 2 + (lane >> 1)) + 1.0f) / Bench_ImageSize;
+      v3f dir = v3f_add(basis.z, v3f_add(v3f_scale(x * half_fov, basis.x), v3f_scale(y * half_fov, basis.y)));
+      rays[tile_idx * Bvh_PacketSize + lane] = (Bench_Ray){ eye, v3f_normalized(dir), 0.0f, 1e30f };
+    }
+  }
+}
+
+static void
+bench_packet(Bench_Ray *rays, Bvh_Packet *packet)
+{
+  for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+  {
+    packet->origin_x[lane] = rays[lane].origin.x;
+    packet->origin_y[lane] = rays[lane].origin.y;
+    packet->origin_z[lane] = rays[lane].origin.z;
+    packet->dir_x[lane]    = rays[lane].dir.x;
+    packet->dir_y[lane]    = rays[lane].dir.y;
+    packet->dir_z[lane]    = rays[lane].dir.z;
+    packet->t_min[lane]    = rays[lane].t_min;
+    packet->t_max[lane]    = rays[lane].t_max;
+  }
+}
+
+// Builds a BVH over scene, checks it and times it. brute_force_count camera
+// rays, spread over the image, are also checked against every triangle.
+static void
+bench_scene(char *name, Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count], OS_Work_Queue *queue, u32 thread_count,
+            u32 brute_force_count)
+{
+  u32 triangle_count = bvh_scene_triangle_count(scene, meshes);
+  u64 source_size    = (u64)triangle_count * sizeof(Bvh_Source_Triangle);
+  Bvh_Source_Triangle *source = (Bvh_Source_Triangle *)os_memory_alloc(source_size);
+  bvh_gather_scene(scene, meshes, source);
+
+  // serial, then on the queue
+  Bvh serial, bvh;
+  f64 start = check_seconds();
+  bvh_build(&serial, source, triangle_count, 0);
+  f64 serial_ms = (check_seconds() - start) * 1000.0;
+
+  f64 threaded_ms = serial_ms;
+  if (queue)
+  {
+    start = check_seconds();
+    bvh_build(&bvh, source, triangle_count, queue);
+    threaded_ms = (check_seconds() - start) * 1000.0;
+
+    check((bvh.node_count == serial.node_count) && (bvh.triangle_count == serial.triangle_count) &&
+          !memcmp(bvh.nodes, serial.nodes, (u64)bvh.node_count * sizeof(Bvh_Node)) &&
+          !memcmp(bvh.triangles, serial.triangles, (u64)bvh.triangle_count * sizeof(Bvh_Triangle)), "threads", 0, 0.0f);
+    bvh_free(&serial);
+  }
+  else
+  {
+    bvh = serial;
+  }
+
+  // each triangle once, boxes nested; the slack covers v0 + e1 rounding
+  // away from the vertex the box was built from
+  v3f extent = v3f_sub(bvh.bounds.max, bvh.bounds.min);
+  f32 size   = Maximum(extent.x, Maximum(extent.y, extent.z));
+  u8 *seen   = (u8 *)os_memory_alloc(Maximum(triangle_count, 1));
+  if (bvh.node_count)
+  {
+    bench_check_node(&bvh, 0, seen, 1e-5f * size);
+  }
+  for (u32 triangle_idx = 0; triangle_idx < triangle_count; ++triangle_idx)
+  {
+    check(seen[triangle_idx] == 1, "structure", triangle_idx, (f32)seen[triangle_idx]);
+  }
+  os_memory_free(seen, Maximum(triangle_count, 1));
+
+  u32 ray_count     = Bench_ImageSize * Bench_ImageSize;
+  u32 packet_count  = ray_count / Bvh_PacketSize;
+  Bench_Ray *rays   = (Bench_Ray *)os_memory_alloc((u64)ray_count * sizeof(Bench_Ray));
+  Bench_Ray *shadow = (Bench_Ray *)os_memory_alloc((u64)ray_count * sizeof(Bench_Ray));
+  Bvh_Hit   *hits   = (Bvh_Hit *)os_memory_alloc((u64)ray_count * sizeof(Bvh_Hit));
+  b32       *occluded = (b32 *)os_memory_alloc((u64)ray_count * sizeof(b32));
+  bench_camera_rays(&bvh, rays);
+
+  // closest hit, one by one
+  u32 hit_count = 0;
+  start = check_seconds();
+  for (u32 ray_idx = 0; ray_idx < ray_count; ++ray_idx)
+  {
+    Bench_Ray *ray = rays + ray_idx;
+    hit_count += bvh_intersect(&bvh, ray->origin, ray->dir, ray->t_min, ray->t_max, hits + ray_idx);
+  }
+  f64 closest_single = (check_seconds() - start);
+
+  // shadow rays from the hits toward the sun; misses get an empty interval
+  Light sun = scene_directional_light();
+  v3f to_sun = v3f_normalized(v3f_scale(-1.0f, sun.dir));
+  for (u32 ray_idx = 0; ray_idx < ray_count; ++ray_idx)
+  {
+    Bench_Ray *ray = rays + ray_idx;
+    b32 hit = (hits[ray_idx].t < ray->t_max);
+    v3f p   = v3f_add(ray->origin, v3f_scale(hit ? hits[ray_idx].t : 0.0f, ray->dir));
+    shadow[ray_idx] = (Bench_Ray){ p, to_sun, 1e-4f * size, hit ? 1e30f : 0.0f };
+  }
+
+  u32 occluded_count = 0;
+  start = check_seconds();
+  for (u32 ray_idx = 0; ray_idx < ray_count; ++ray_idx)
+  {
+    Bench_Ray *ray = shadow + ray_idx;
+    occluded[ray_idx] = bvh_occluded(&bvh, ray->origin, ray->dir, ray->t_min, ray->t_max);
+    occluded_count += occluded[ray_idx];
+  }
+  f64 any_single = (check_seconds() - start);
+
+  // the same rays as packets
+  u32 packet_mismatches = 0;
+  start = check_seconds();
+  for (u32 packet_idx = 0; packet_idx < packet_count; ++packet_idx)
+  {
+    Bvh_Packet packet;
+    Bvh_Packet_Hit packet_hit;
+    bench_packet(rays + packet_idx * Bvh_PacketSize, &packet);
+    u32 mask = bvh_intersect_packet(&bvh, &packet, &packet_hit);
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      Bvh_Hit *hit  = hits + packet_idx * Bvh_PacketSize + lane;
+      b32 lane_hit  = (mask >> lane) & 1;
+      packet_mismatches += (lane_hit != (hit->t < 1e30f)) || (packet_hit.t[lane] != hit->t);
+    }
+  }
+  f64 closest_packet = (check_seconds() - start);
+  check(!packet_mismatches, "packets", 0, (f32)packet_mismatches);
+
+  packet_mismatches = 0;
+  start = check_seconds();
+  for (u32 packet_idx = 0; packet_idx < packet_count; ++packet_idx)
+  {
+    Bvh_Packet packet;
+    bench_packet(shadow + packet_idx * Bvh_PacketSize, &packet);
+    u32 mask = bvh_occluded_packet(&bvh, &packet);
+    for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+    {
+      packet_mismatches += (((mask >> lane) & 1) != (u32)occluded[packet_idx * Bvh_PacketSize + lane]);
+    }
+  }
+  f64 any_packet = (check_seconds() - start);
+  check(!packet_mismatches, "packets", 1, (f32)packet_mismatches);
+
+  // a sample against every triangle
+  for (u32 ray_idx = 0; ray_idx < ray_count; ray_idx += ray_count / brute_force_count)
+  {
+    Bench_Ray *ray = rays + ray_idx;
+    Bvh_Hit brute;
+    bench_brute_force(&bvh, ray->origin, ray->dir, ray->t_min, ray->t_max, &brute);
+    check(brute.t == hits[ray_idx].t, "closest", ray_idx, brute.t - hits[ray_idx].t);
+
+    ray = shadow + ray_idx;
+    b32 any = bench_brute_force(&bvh, ray->origin, ray->dir, ray->t_min, ray->t_max, &brute);
+    check(any == occluded[ray_idx], "any", ray_idx, (f32)any);
+  }
+
+  f64 node_mb = (f64)bvh.node_count * sizeof(Bvh_Node) / (1024.0 * 1024.0);
+  f64 tri_mb  = (f64)bvh.triangle_count * sizeof(Bvh_Triangle) / (1024.0 * 1024.0);
+  printf("%s: %u triangles, %u nodes (%.1f MB), triangles %.1f MB\n", name, triangle_count, bvh.node_count, node_mb, tri_mb);
+  printf("  build: %.1f ms serial (%.2f builds/s, %.1f Mtri/s), %.1f ms on %u threads (%.2f builds/s, %.1f Mtri/s)\n",
+         serial_ms, 1000.0 / serial_ms, triangle_count / (serial_ms * 1000.0),
+         threaded_ms, thread_count, 1000.0 / threaded_ms, triangle_count / (threaded_ms * 1000.0));
+  printf("  closest: %.2f Mrays/s single, %.2f Mrays/s packets (%u of %u hit)\n",
+         ray_count / (closest_single * 1e6), ray_count / (closest_packet * 1e6), hit_count, ray_count);
+  printf("  any:     %.2f Mrays/s single, %.2f Mrays/s packets (%u occluded)\n",
+         ray_count / (any_single * 1e6), ray_count / (any_packet * 1e6), occluded_count);
+
+  os_memory_free(occluded, (u64)ray_count * sizeof(b32));
+  os_memory_free(hits, (u64)ray_count * sizeof(Bvh_Hit));
+  os_memory_free(shadow, (u64)ray_count * sizeof(Bench_Ray));
+  os_memory_free(rays, (u64)ray_count * sizeof(Bench_Ray));
+  bvh_free(&bvh);
+  os_memory_free(source, source_size);
+}
+
+// randomly scaled and turned spheres, dense enough to overlap
+static void
+bench_stress_scene(Scene_Instances *scene, u32 sphere_triangles, u32 stress_triangles)
+{
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    scene->material_slots[material] = material_slots[material];
+  }
+  scene->instance_count = 0;
+  scene->batch_count    = 0;
+
+  u32 random         = 0xB4B;
+  u32 instance_count = (stress_triangles + sphere_triangles - 1) / sphere_triangles;
+  instance_count     = Minimum(instance_count, MaxSceneInstances);
+  for (u32 instance_idx = 0; instance_idx < instance_count; ++instance_idx)
+  {
+    v3f p      = { Bench_StressField * check_random(&random), 0.25f * Bench_StressField * check_random(&random),
+                   Bench_StressField * check_random(&random) };
+    v3f scale  = { 1.0f + 4.0f * check_random(&random), 1.0f + 4.0f * check_random(&random), 1.0f + 4.0f * check_random(&random) };
+    m33 rotate = m33_mul(m33_make_rot_xz(6.28318f * check_random(&random)), m33_make_rot_yz(6.28318f * check_random(&random)));
+    scene_add_instance(scene, SceneModel_Sphere, p, scale, rotate, (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_None);
+  }
+
+  scene->static_instance_count            = scene->instance_count;
+  scene->static_batch_count               = scene->batch_count;
+  scene->static_last_batch_instance_count = scene->batch_count ? scene->batches[scene->batch_count - 1].instance_count : 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 stress_triangles = (argc > 1) ? (u32)atoi(argv[1]) : 10000000;
+  u32 thread_count     = (argc > 2) ? (u32)atoi(argv[2]) : Maximum(os_processor_count(), 2) - 1;
+  OS_Work_Queue *queue = thread_count ? os_work_queue_create(thread_count) : 0;
+
+  Scene_Mesh meshes[SceneModel_Count];
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    meshes[model] = scene_mesh_for_model(model);
+  }
+
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+  bench_scene("default scene", &g_scene, meshes, queue, thread_count, 1024);
+
+  if (stress_triangles)
+  {
+    scene_mesh_free(meshes + SceneModel_Sphere);
+    meshes[SceneModel_Sphere] = scene_mesh_sphere(SceneSphere_Radius, Bench_StressQuality);
+    bench_stress_scene(&g_scene, meshes[SceneModel_Sphere].index_count / 3, stress_triangles);
+    bench_scene("stress scene", &g_scene, meshes, queue, thread_count, 32);
+  }
+
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    scene_mesh_free(meshes + model);
+  }
+
+  return(check_report());
+}
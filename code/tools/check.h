@@ -0,0 +1,97 @@
+#if !defined(CHECK_H)
+#define CHECK_H
+
+// What the check tools share: a tally of checks that prints the first few
+// failures, a clock, a repeatable random sequence, and small scenes built by
+// hand. A tool includes this after the modules it checks, and ends with
+// return(check_report()) so that any failure is its exit code. Directions
+// need my_math.h, and the scene helpers scene.h.
+
+#define Check_MaxPrinted 16
+
+typedef struct
+{
+  u32 checks;
+  u32 failures;
+} Check_Totals;
+
+static Check_Totals g_totals;
+
+static void
+check(b32 condition, char *name, u32 index, f64 value)
+{
+  ++g_totals.checks;
+  if (!condition)
+  {
+    if (g_totals.failures < Check_MaxPrinted)
+    {
+      printf("FAIL %-12s %u (%g)\n", name, index, value);
+    }
+    ++g_totals.failures;
+  }
+}
+
+static int
+check_report(void)
+{
+  printf("%u checks, %u failed\n", g_totals.checks, g_totals.failures);
+  return(g_totals.failures ? 1 : 0);
+}
+
+static f64
+check_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+// in [0, 1), the same sequence from the same state on every platform
+static f32
+check_random(u32 *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return((f32)(*state >> 8) / (f32)(1 << 24));
+}
+
+#if defined(MY_MATH_H)
+
+// uniform over the sphere
+static v3f
+check_random_direction(u32 *state)
+{
+  f32 z      = 2.0f * check_random(state) - 1.0f;
+  f32 phi    = 2.0f * PIF32 * check_random(state);
+  f32 radius = sqrtf(Maximum(1.0f - z * z, 0.0f));
+  v3f result = { radius * cosf(phi), radius * sinf(phi), z };
+  return(result);
+}
+
+#endif
+
+#if defined(SCENE_H)
+
+static void
+check_scene_begin(Scene_Instances *scene)
+{
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    scene->material_slots[material] = material_slots[material];
+  }
+  scene->instance_count = 0;
+  scene->batch_count    = 0;
+}
+
+// marks everything added so far static, as scene_build_static does
+static void
+check_scene_end(Scene_Instances *scene)
+{
+  scene->static_instance_count            = scene->instance_count;
+  scene->static_batch_count               = scene->batch_count;
+  scene->static_last_batch_instance_count = scene->batch_count ? scene->batches[scene->batch_count - 1].instance_count : 0;
+}
+
+#endif
+
+#endif
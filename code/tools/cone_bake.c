@@ -0,0 +1,404 @@
+// Bakes a relaxed cone step map (see cone_step.h) from a displacement map and
+// writes height and cone ratio as an RG8 texture container for
+// parallax_cone_uv. Also compares the CPU mirrors of parallax_uv2 and
+// parallax_cone_uv against a fine march of the same texture.
+//
+// usage: cone_bake <displacement.png> <out.tex> [bake_size]
+//        cone_bake compare <cone.tex> [ray_count]
+//
+// The search behind every cone is quadratic in resolution, so cones are
+// baked on a box filtered copy at most bake_size (default 256) wide and
+// spread back over the full resolution height map, each texel taking the
+// narrowest of the cones a bilinear fetch would blend.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_file.h"
+#include "../cone_step.h"
+
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../my_math.c"
+#include "../tex_file.c"
+#include "../cone_step.c"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ext/stb_image.h"
+
+#define ConeBake_DefaultSize    256
+#define ConeBake_RowsPerJob     4
+#define ConeBake_ReferenceSteps 1024
+
+typedef struct
+{
+  Cone_Step_Map    *map;
+  Cone_Step_Offset *offsets;
+  u32               offset_count;
+  u32               row_begin;
+  u32               row_end;
+} Cone_Job;
+
+static f64
+bake_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+static void
+cone_job_bake(void *data)
+{
+  Cone_Job *job = (Cone_Job *)data;
+  cone_step_bake_rows(job->map, job->offsets, job->offset_count, job->row_begin, job->row_end);
+}
+
+// r averages, g keeps the narrowest cone
+static void
+cone_downsample_rg8(u8 *source, u32 source_width, u32 source_height, u8 *dest, u32 width, u32 height)
+{
+  for (u32 y = 0; y < height; ++y)
+  {
+    u32 y0 = Minimum(2 * y, source_height - 1);
+    u32 y1 = Minimum(2 * y + 1, source_height - 1);
+    for (u32 x = 0; x < width; ++x)
+    {
+      u32 x0 = Minimum(2 * x, source_width - 1);
+      u32 x1 = Minimum(2 * x + 1, source_width - 1);
+      u8 *a  = source + ((u64)y0 * source_width + x0) * 2;
+      u8 *b  = source + ((u64)y0 * source_width + x1) * 2;
+      u8 *c  = source + ((u64)y1 * source_width + x0) * 2;
+      u8 *d  = source + ((u64)y1 * source_width + x1) * 2;
+
+      u8 *out = dest + ((u64)y * width + x) * 2;
+      out[0]  = (u8)((a[0] + b[0] + c[0] + d[0] + 2) / 4);
+      out[1]  = Minimum(Minimum(a[1], b[1]), Minimum(c[1], d[1]));
+    }
+  }
+}
+
+static s32
+bake(char *in_path, char *out_path, u32 bake_size)
+{
+  s32 width = 0, height = 0, comp = 0;
+  u8 *displacement = stbi_load(in_path, &width, &height, &comp, 1);
+  if (!displacement)
+  {
+    fprintf(stderr, "cone_bake: cannot load %s\n", in_path);
+    return(1);
+  }
+
+  // power of two reduction keeps every coarse texel an exact box of fine ones
+  u32 shift = 0;
+  while (((u32)width >> shift) > bake_size && ((u32)width >> (shift + 1)) && ((u32)height >> (shift + 1)))
+  {
+    ++shift;
+  }
+
+  Cone_Step_Map map =
+  {
+    .width  = (u32)width >> shift,
+    .height = (u32)height >> shift,
+  };
+  map.depths = os_memory_alloc((u64)map.width * map.height * sizeof(f32));
+  map.ratios = os_memory_alloc((u64)map.width * map.height * sizeof(f32));
+  f32 box    = 1.0f / (255.0f * (f32)(1 << (2 * shift)));
+  for (u32 y = 0; y < map.height; ++y)
+  {
+    for (u32 x = 0; x < map.width; ++x)
+    {
+      u32 sum = 0;
+      for (u32 fine_y = y << shift; fine_y < ((y + 1) << shift); ++fine_y)
+      {
+        for (u32 fine_x = x << shift; fine_x < ((x + 1) << shift); ++fine_x)
+        {
+          sum += displacement[(u64)fine_y * width + fine_x];
+        }
+      }
+      map.depths[(u64)y * map.width + x] = 1.0f - (f32)sum * box;
+    }
+  }
+
+  f64 start = bake_seconds();
+  u32 max_offset_count      = (u32)((2.0f * ConeStep_MaxRatio * ConeStep_HeightScale * map.width + 3.0f) *
+                                    (2.0f * ConeStep_MaxRatio * ConeStep_HeightScale * map.height + 3.0f));
+  Cone_Step_Offset *offsets = os_memory_alloc((u64)max_offset_count * sizeof(Cone_Step_Offset));
+  u32 offset_count          = cone_step_offsets_build(&map, offsets, max_offset_count);
+
+  u32 thread_count      = Maximum(os_processor_count(), 2) - 1;
+  OS_Work_Queue *queue  = os_work_queue_create(thread_count);
+  Cone_Job *jobs        = os_memory_alloc(((u64)map.height / ConeBake_RowsPerJob + 1) * sizeof(Cone_Job));
+  u32 job_count         = 0;
+  for (u32 row = 0; row < map.height; row += ConeBake_RowsPerJob)
+  {
+    jobs[job_count] = (Cone_Job)
+    {
+      .map          = &map,
+      .offsets      = offsets,
+      .offset_count = offset_count,
+      .row_begin    = row,
+      .row_end      = Minimum(row + ConeBake_RowsPerJob, map.height),
+    };
+    os_work_queue_add(queue, cone_job_bake, jobs + job_count);
+    ++job_count;
+  }
+  os_work_queue_complete_all(queue);
+  f64 bake_time = bake_seconds() - start;
+
+  u32 mip_count = 1;
+  while ((Maximum(width >> mip_count, height >> mip_count) > 0) && (mip_count < TexFile_MaxMips))
+  {
+    ++mip_count;
+  }
+
+  Tex_File_Header header =
+  {
+    .magic      = TexFile_Magic,
+    .version    = TexFile_Version,
+    .format     = TexFileFormat_RG8,
+    .width      = (u32)width,
+    .height     = (u32)height,
+    .mip_count  = mip_count,
+  };
+
+  u64 offset = AlignAToB((u64)sizeof(Tex_File_Header), 16ull);
+  for (u32 mip = 0; mip < mip_count; ++mip)
+  {
+    header.mip_offsets[mip] = offset;
+    header.mip_sizes[mip]   = tex_file_mip_size(TexFileFormat_RG8, Maximum((u32)width >> mip, 1), Maximum((u32)height >> mip, 1));
+    offset                  = AlignAToB(offset + header.mip_sizes[mip], 16ull);
+  }
+
+  u8 *file = os_memory_alloc(offset);
+  memcpy(file, &header, sizeof(header));
+
+  // a fine texel blends the 2x2 coarse cones around its centre
+  u8 *texels    = file + header.mip_offsets[0];
+  f64 ratio_sum = 0.0;
+  for (u32 y = 0; y < (u32)height; ++y)
+  {
+    f32 coarse_y = ((f32)y + 0.5f) / (f32)(1 << shift) - 0.5f;
+    s32 y0       = (s32)floorf(coarse_y);
+    for (u32 x = 0; x < (u32)width; ++x)
+    {
+      f32 coarse_x = ((f32)x + 0.5f) / (f32)(1 << shift) - 0.5f;
+      s32 x0       = (s32)floorf(coarse_x);
+      f32 ratio    = ConeStep_MaxRatio;
+      for (s32 corner = 0; corner < 4; ++corner)
+      {
+        u32 cx = (u32)(((x0 + (corner & 1)) % (s32)map.width + (s32)map.width) % (s32)map.width);
+        u32 cy = (u32)(((y0 + (corner >> 1)) % (s32)map.height + (s32)map.height) % (s32)map.height);
+        ratio  = Minimum(ratio, map.ratios[(u64)cy * map.width + cx]);
+      }
+
+      u8 *out    = texels + ((u64)y * width + x) * 2;
+      out[0]     = displacement[(u64)y * width + x];
+      out[1]     = cone_step_encode_ratio(ratio);
+      ratio_sum += ratio;
+    }
+  }
+
+  for (u32 mip = 1; mip < mip_count; ++mip)
+  {
+    cone_downsample_rg8(file + header.mip_offsets[mip - 1], Maximum((u32)width >> (mip - 1), 1), Maximum((u32)height >> (mip - 1), 1),
+                        file + header.mip_offsets[mip], Maximum((u32)width >> mip, 1), Maximum((u32)height >> mip, 1));
+  }
+
+  FILE *out = fopen(out_path, "wb");
+  if (!out || (fwrite(file, 1, offset, out) != offset))
+  {
+    fprintf(stderr, "cone_bake: cannot write %s\n", out_path);
+    return(1);
+  }
+  fclose(out);
+
+  printf("%s: %dx%d, cones baked at %ux%u (%u offsets), mean ratio %.3f, %.1f KB, bake %.1f ms on %u threads\n",
+         out_path, width, height, map.width, map.height, offset_count, ratio_sum / ((f64)width * height),
+         (f64)offset / 1024.0, bake_time * 1000.0, thread_count + 1);
+
+  stbi_image_free(displacement);
+  return(0);
+}
+
+// March fine enough that the hit is exact to well under a texel.
+static Cone_Step_Trace
+compare_reference(u8 *texels, u32 width, u32 height, f32 u, f32 v, f32 view_x, f32 view_y, f32 view_z)
+{
+  Cone_Step_Trace result = { u, v, 0 };
+  f32 offset_u = ((-ConeStep_HeightScale) * view_x) / view_z;
+  f32 offset_v = -(((-ConeStep_HeightScale) * view_y) / view_z);
+
+  f32 previous_t = 0.0f, previous_gap = -1.0f;
+  for (u32 step_idx = 0; step_idx <= ConeBake_ReferenceSteps; ++step_idx)
+  {
+    f32 t = (f32)step_idx / (f32)ConeBake_ReferenceSteps;
+    f32 map_height, cone;
+    cone_step_sample(texels, width, height, u + t * offset_u, v + t * offset_v, &map_height, &cone);
+
+    // gap < 0 while the ray is above the surface
+    f32 gap = t - (1.0f - map_height);
+    if (gap >= 0.0f)
+    {
+      f32 hit  = (step_idx == 0) ? 0.0f : previous_t + (t - previous_t) * (-previous_gap / (gap - previous_gap));
+      result.u = u + hit * offset_u;
+      result.v = v + hit * offset_v;
+      break;
+    }
+
+    previous_t   = t;
+    previous_gap = gap;
+  }
+
+  return(result);
+}
+
+typedef struct
+{
+  u64 rays;
+  u64 taps;
+  u32 max_taps;
+  f64 error_sum;
+  f64 max_error;
+  u64 over_one_texel;
+} Compare_Stats;
+
+static void
+compare_accumulate(Compare_Stats *stats, Cone_Step_Trace trace, Cone_Step_Trace reference, u32 width, u32 height)
+{
+  f32 du      = (trace.u - reference.u) * (f32)width;
+  f32 dv      = (trace.v - reference.v) * (f32)height;
+  f64 error   = sqrt((f64)(du * du + dv * dv));
+  stats->rays           += 1;
+  stats->taps           += trace.taps;
+  stats->max_taps        = Maximum(stats->max_taps, trace.taps);
+  stats->error_sum      += error;
+  stats->max_error       = Maximum(stats->max_error, error);
+  stats->over_one_texel += (error > 1.0);
+}
+
+static void
+compare_print(char *label, Compare_Stats *stats)
+{
+  if (stats->rays)
+  {
+    printf("  %-14s taps mean %5.1f max %3u   error texels mean %6.3f max %7.2f  >1 texel %5.2f%%\n", label,
+           (f64)stats->taps / (f64)stats->rays, stats->max_taps, stats->error_sum / (f64)stats->rays, stats->max_error,
+           100.0 * (f64)stats->over_one_texel / (f64)stats->rays);
+  }
+}
+
+static u32
+compare_random(u32 *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return(*state >> 8);
+}
+
+static s32
+compare(char *path, u32 ray_count)
+{
+  OS_File_Map file_map = os_file_map(path);
+  Tex_File_Header *header = tex_file_parse(file_map.data, file_map.size);
+  if (!header || (header->format != TexFileFormat_RG8))
+  {
+    fprintf(stderr, "cone_bake: %s is not an RG8 cone texture\n", path);
+    return(1);
+  }
+
+  u8 *texels = (u8 *)header + header->mip_offsets[0];
+  u32 width  = header->width;
+  u32 height = header->height;
+
+  // bands of angle between the view direction and the surface normal
+  f32 band_limits[]  = { 30.0f, 60.0f, 80.0f };
+  char *band_names[] = { "0-30 deg", "30-60 deg", "60-80 deg" };
+  Compare_Stats linear[ArrayCount(band_limits)] = {0};
+  Compare_Stats cone[ArrayCount(band_limits)]   = {0};
+  Compare_Stats linear_all = {0}, cone_all = {0};
+
+  f64 linear_seconds = 0.0, cone_seconds = 0.0;
+  u32 random = 0x1234567;
+  for (u32 ray_idx = 0; ray_idx < ray_count; ++ray_idx)
+  {
+    f32 u      = (f32)compare_random(&random) / (f32)(1 << 24);
+    f32 v      = (f32)compare_random(&random) / (f32)(1 << 24);
+    f32 theta  = Radians(band_limits[ArrayCount(band_limits) - 1]) * (f32)compare_random(&random) / (f32)(1 << 24);
+    f32 phi    = 2.0f * PIF32 * (f32)compare_random(&random) / (f32)(1 << 24);
+    f32 view_x = sinf(theta) * cosf(phi);
+    f32 view_y = sinf(theta) * sinf(phi);
+    f32 view_z = cosf(theta);
+
+    u32 band = 0;
+    while (theta > Radians(band_limits[band]))
+    {
+      ++band;
+    }
+
+    Cone_Step_Trace reference = compare_reference(texels, width, height, u, v, view_x, view_y, view_z);
+
+    f64 start = bake_seconds();
+    Cone_Step_Trace linear_trace = cone_step_trace_linear(texels, width, height, u, v, view_x, view_y, view_z);
+    f64 middle = bake_seconds();
+    Cone_Step_Trace cone_trace = cone_step_trace_cone(texels, width, height, u, v, view_x, view_y, view_z);
+    f64 end = bake_seconds();
+    linear_seconds += middle - start;
+    cone_seconds   += end - middle;
+
+    compare_accumulate(linear + band, linear_trace, reference, width, height);
+    compare_accumulate(cone + band, cone_trace, reference, width, height);
+    compare_accumulate(&linear_all, linear_trace, reference, width, height);
+    compare_accumulate(&cone_all, cone_trace, reference, width, height);
+  }
+
+  printf("%s: %ux%u, %u rays\n", path, width, height, ray_count);
+  for (u32 band = 0; band < ArrayCount(band_limits); ++band)
+  {
+    printf(" %s\n", band_names[band]);
+    compare_print("parallax_uv2", linear + band);
+    compare_print("cone", cone + band);
+  }
+  printf(" all\n");
+  compare_print("parallax_uv2", &linear_all);
+  compare_print("cone", &cone_all);
+  printf(" cpu time per ray: parallax_uv2 %.3f us, cone %.3f us\n",
+         linear_seconds * 1e6 / ray_count, cone_seconds * 1e6 / ray_count);
+
+  os_file_unmap(&file_map);
+  return(0);
+}
+
+int
+main(int argc, char **argv)
+{
+  s32 result = 1;
+  if ((argc >= 3) && (argc <= 4) && (strcmp(argv[1], "compare") == 0))
+  {
+    result = compare(argv[2], (argc == 4) ? (u32)atoi(argv[3]) : 100000);
+  }
+  else if ((argc >= 3) && (argc <= 4))
+  {
+    result = bake(argv[1], argv[2], (argc == 4) ? (u32)atoi(argv[3]) : ConeBake_DefaultSize);
+  }
+  else
+  {
+    fprintf(stderr, "usage: cone_bake <displacement.png> <out.tex> [bake_size]\n"
+                    "       cone_bake compare <cone.tex> [ray_count]\n");
+  }
+
+  return(result);
+}
@@ -0,0 +1,207 @@
+// Records a made up run of keys, cursor moves and steps through the input
+// recorder (input_record.c), writes it to input_record_check.inp and plays
+// it back. Exits non-zero if a check fails.
+//
+// usage: input_record_check [frame_count]
+//
+//   keys      every flag combination of every key packs and unpacks to itself
+//   replay    each replayed frame hands back the recorded keys, cursor move
+//             and step, and the replay ends when the frames do
+//   camera    the fly camera steered by the replay ends where the live run
+//             left it, bit for bit
+//   file      the file holds a header and 12 bytes a frame; truncated,
+//             foreign and other key set files are refused
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../input_record.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../input_record.c"
+#include "check.h"
+
+#define Check_File "input_record_check.inp"
+
+// what a main loop would hand the camera for frame_idx: keys held for a
+// while, Esc now and then, and cursor moves and steps that wander
+typedef struct
+{
+  OS_InputFlag keys[OS_KeyType_Count];
+  s32          cursor_dx;
+  s32          cursor_dy;
+  f32          game_update_secs;
+} Check_Frame;
+
+static Check_Frame
+check_make_frame(u32 *random, Check_Frame *previous)
+{
+  Check_Frame result = { 0 };
+  for (u32 key = 0; key < OS_KeyType_Count; ++key)
+  {
+    b32 was_held = !!(previous->keys[key] & OS_InputFlag_Held);
+    b32 held     = (check_random(random) < 0.1f) ? !was_held : was_held;
+    result.keys[key] = (held ? OS_InputFlag_Held : 0) | ((was_held && !held) ? OS_InputFlag_Released : 0);
+  }
+
+  result.cursor_dx        = (s32)(check_random(random) * 81.0f) - 40;
+  result.cursor_dy        = (s32)(check_random(random) * 81.0f) - 40;
+  result.game_update_secs = (check_random(random) < 0.5f) ? InputRecord_FixedStep : (0.004f + 0.03f * check_random(random));
+  return(result);
+}
+
+// the part of the main loop that reads input, on whatever g_input_key holds
+static void
+check_step_camera(Scene_State *scene, s32 cursor_dx, s32 cursor_dy, f32 game_update_secs)
+{
+  if (os_key_released(OS_KeyType_Esc))
+  {
+    scene->camera_roam = !scene->camera_roam;
+  }
+
+  Scene_Camera_Input camera_input = { 0 };
+  camera_input.cursor_dx = scene->camera_roam ? cursor_dx : 0;
+  camera_input.cursor_dy = scene->camera_roam ? cursor_dy : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_W) ? SceneMove_Forward : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_A) ? SceneMove_Left : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_S) ? SceneMove_Back : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_D) ? SceneMove_Right : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_Space) ? SceneMove_Up : 0;
+  camera_input.moves |= os_key_held(OS_KeyType_X) ? SceneMove_Down : 0;
+  scene_update_camera(scene, &camera_input, game_update_secs);
+}
+
+static void
+check_keys(void)
+{
+  for (u32 key = 0; key < OS_KeyType_Count; ++key)
+  {
+    for (u32 flags = 0; flags < (1 << InputRecord_KeyBits); ++flags)
+    {
+      OS_InputFlag keys[OS_KeyType_Count]     = { 0 };
+      OS_InputFlag unpacked[OS_KeyType_Count] = { 0 };
+      keys[key] = flags;
+      input_record_unpack_keys(input_record_pack_keys(keys), unpacked);
+      check(!memcmp(keys, unpacked, sizeof(keys)), "keys", key, (f64)flags);
+    }
+  }
+}
+
+static void
+check_replay(u32 frame_count)
+{
+  Check_Frame *frames   = malloc(frame_count * sizeof(Check_Frame));
+  Check_Frame  previous = { 0 };
+  u32          random   = 0x1A7;
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    frames[frame_idx] = check_make_frame(&random, &previous);
+    previous          = frames[frame_idx];
+  }
+
+  // live, recording as it goes
+  Input_Recorder recorder;
+  Scene_State    live;
+  scene_init(&live);
+  input_record_begin(&recorder, Check_File);
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    Check_Frame *frame = frames + frame_idx;
+    for (u32 key = 0; key < OS_KeyType_Count; ++key)
+    {
+      g_input_key[key] = frame->keys[key];
+    }
+
+    s32 cursor_dx = frame->cursor_dx, cursor_dy = frame->cursor_dy;
+    f32 game_update_secs = frame->game_update_secs;
+    check(input_record_frame(&recorder, &cursor_dx, &cursor_dy, &game_update_secs), "replay record", frame_idx, 0.0);
+    check_step_camera(&live, cursor_dx, cursor_dy, game_update_secs);
+  }
+  check(input_record_end(&recorder), "file write", 0, 0.0);
+
+  OS_File_Map map = os_file_map(Check_File);
+  check(map.size == sizeof(Input_Record_Header) + (u64)frame_count * 12, "file size", frame_count, (f64)map.size);
+  check(input_record_parse(map.data, map.size) != 0, "file parse", 0, 0.0);
+  check(!input_record_parse(map.data, map.size - 1), "file truncated", 0, 0.0);
+  check(!input_record_parse(map.data, sizeof(Input_Record_Header) - 1), "file header", 0, 0.0);
+  if (map.data)
+  {
+    u8 *copy = malloc(map.size);
+    memcpy(copy, map.data, map.size);
+    Input_Record_Header *header = (Input_Record_Header *)copy;
+    header->magic = 0;
+    check(!input_record_parse(copy, map.size), "file magic", 0, 0.0);
+    header->magic     = InputRecord_Magic;
+    header->key_count = OS_KeyType_Count + 1;
+    check(!input_record_parse(copy, map.size), "file keys", 0, 0.0);
+    free(copy);
+  }
+  os_file_unmap(&map);
+
+  // and played back over live input that has nothing to do with it
+  Scene_State replayed;
+  scene_init(&replayed);
+  check(input_replay_begin(&recorder, Check_File), "replay begin", 0, 0.0);
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    Check_Frame *frame = frames + frame_idx;
+    for (u32 key = 0; key < OS_KeyType_Count; ++key)
+    {
+      g_input_key[key] = OS_InputFlag_Held;
+    }
+
+    s32 cursor_dx = 1000, cursor_dy = -1000;
+    f32 game_update_secs = 1.0f;
+    check(input_record_frame(&recorder, &cursor_dx, &cursor_dy, &game_update_secs), "replay frame", frame_idx, 0.0);
+    check(!memcmp(g_input_key, frame->keys, sizeof(frame->keys)), "replay keys", frame_idx, 0.0);
+    check((cursor_dx == frame->cursor_dx) && (cursor_dy == frame->cursor_dy), "replay cursor", frame_idx, (f64)cursor_dx);
+    check(game_update_secs == frame->game_update_secs, "replay step", frame_idx, (f64)game_update_secs);
+    check_step_camera(&replayed, cursor_dx, cursor_dy, game_update_secs);
+  }
+
+  s32 cursor_dx = 0, cursor_dy = 0;
+  f32 game_update_secs = 0.0f;
+  check(!input_record_frame(&recorder, &cursor_dx, &cursor_dy, &game_update_secs), "replay end", frame_count, 0.0);
+  input_record_end(&recorder);
+  os_file_delete(Check_File);
+
+  check(!memcmp(&live, &replayed, sizeof(Scene_State)), "camera", frame_count, (f64)replayed.camera_p.x);
+  check(live.camera_roam || (live.camera_p.x != 0.0f) || (live.camera_p.z != 0.0f), "camera moved", frame_count, (f64)live.camera_p.x);
+  check(!input_replay_begin(&recorder, Check_File), "replay missing", 0, 0.0);
+
+  printf("%u frames: camera ended at (%.3f %.3f %.3f), turned to %.2f %.2f\n", frame_count,
+         replayed.camera_p.x, replayed.camera_p.y, replayed.camera_p.z, replayed.camera_rotate_xz, replayed.camera_rotate_yz);
+  free(frames);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 frame_count = (argc > 1) ? (u32)atoi(argv[1]) : 3600;
+  frame_count = Maximum(frame_count, 1);
+
+  check_keys();
+  check_replay(frame_count);
+
+  return(check_report());
+}
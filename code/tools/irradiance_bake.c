@@ -0,0 +1,162 @@
+// Bakes the irradiance volume of the default scene (see irradiance_volume.h)
+// into one file the engine uploads as an RGBA16F buffer.
+//
+// usage: irradiance_bake <out.irv> [sample_count] [thread_count]
+//
+// Surfaces the probes see reflect in their material's average diffuse
+// colour, as in lightmap_bake, and the sky is the flat ambient the volume
+// replaces.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../irradiance_volume.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../irradiance_volume.c"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ext/stb_image.h"
+
+#define Bake_DefaultSamples 256
+
+static Scene_Instances g_scene;
+
+static f64
+bake_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+// the mean of the texels, as reflection_bake takes it
+static v3f
+bake_material_albedo(char *material_dir)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "../data/%s/diffuse.png", material_dir);
+
+  v3f result = v3f_s(0.5f);
+  s32 width, height, comp;
+  u8 *texels = stbi_load(path, &width, &height, &comp, 3);
+  if (texels)
+  {
+    f64 sum[3] = { 0 };
+    u64 texel_count = (u64)width * height;
+    for (u64 texel = 0; texel < texel_count; ++texel)
+    {
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        sum[channel] += texels[texel * 3 + channel] / 255.0;
+      }
+    }
+
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      result.v[channel] = (f32)(sum[channel] / (f64)texel_count);
+    }
+    stbi_image_free(texels);
+  }
+  else
+  {
+    fprintf(stderr, "irradiance_bake: no %s, baking the material as grey\n", path);
+  }
+
+  return(result);
+}
+
+int
+main(int argc, char **argv)
+{
+  if ((argc < 2) || (argc > 4))
+  {
+    fprintf(stderr, "usage: irradiance_bake <out.irv> [sample_count] [thread_count]\n");
+    return(1);
+  }
+
+  u32 sample_count = (argc >= 3) ? (u32)atoi(argv[2]) : Bake_DefaultSamples;
+  u32 thread_count = (argc == 4) ? (u32)atoi(argv[3]) : Maximum(os_processor_count(), 2) - 1;
+  OS_Work_Queue *queue = thread_count ? os_work_queue_create(thread_count) : 0;
+
+  // the instance order has to match the engine's, probes or not
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+
+  Scene_Mesh meshes[SceneModel_Count];
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    meshes[model] = scene_mesh_for_model(model);
+  }
+
+  f64 start = bake_seconds();
+  u32 triangle_count             = bvh_scene_triangle_count(&g_scene, meshes);
+  Bvh_Source_Triangle *triangles = (Bvh_Source_Triangle *)os_memory_alloc((u64)triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, meshes, triangles);
+  Bvh bvh;
+  bvh_build(&bvh, triangles, triangle_count, queue);
+  f64 build_end = bake_seconds();
+
+  Irradiance_Grid grid;
+  irradiance_volume_grid(&grid, bvh.bounds, IrradianceVolume_ProbeSpacing);
+
+  // packets of four
+  sample_count = Minimum(Maximum(sample_count, Bvh_PacketSize), IrradianceVolume_MaxSamples);
+  Irradiance_Bake bake =
+  {
+    .scene        = &g_scene,
+    .bvh          = &bvh,
+    .triangles    = triangles,
+    .light        = scene_directional_light(),
+    .sky          = v3f_s(0.1f),
+    .sample_count = sample_count & ~(Bvh_PacketSize - 1),
+  };
+
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    bake.material_albedo[material] = bake_material_albedo(scene_material_dir(material));
+  }
+
+  Irradiance_SH *probes = (Irradiance_SH *)os_memory_alloc((u64)grid.probe_count * sizeof(Irradiance_SH));
+  irradiance_volume_bake(&bake, &grid, probes, queue);
+  f64 bake_end = bake_seconds();
+
+  u64 file_size = irradiance_volume_file_size(&grid);
+  u8 *file_data = os_memory_alloc(file_size);
+  irradiance_volume_encode(file_data, &grid, probes);
+  if (!os_file_write_all(argv[1], file_data, file_size))
+  {
+    fprintf(stderr, "irradiance_bake: cannot write %s\n", argv[1]);
+    return(1);
+  }
+
+  printf("%s: %ux%ux%u probes %.2f apart, %.1f KB, %u samples; bvh %.1f ms, bake %.1f ms (%.2f Mrays/s) on %u threads\n",
+         argv[1], grid.probe_count_x, grid.probe_count_y, grid.probe_count_z, grid.spacing, (f64)file_size / 1024.0,
+         bake.sample_count, (build_end - start) * 1000.0, (bake_end - build_end) * 1000.0,
+         (f64)grid.probe_count * bake.sample_count / ((bake_end - build_end) * 1e6), thread_count);
+  return(0);
+}
@@ -0,0 +1,427 @@
+// Checks the irradiance volume (irradiance_volume.c): the spherical harmonic
+// projection and evaluation against environments whose irradiance is known
+// in closed form, and bakes of small scenes. Exits non-zero if a check fails.
+//
+// usage: irradiance_check [thread_count]
+//
+//   basis         the 9 functions are orthonormal over the direction set
+//   constant      a uniform environment evaluates to itself at every normal
+//   linear        a + b (w.d) evaluates to a + 2/3 b (n.d)
+//   quadratic     (w.z)^2 evaluates to 1/3 + (3 (n.z)^2 - 1) / 12
+//   sky           a bright upper hemisphere evaluates to (1 + n.z) / 2, which
+//                 order 2 holds exactly since the clamped cosine has no odd
+//                 bands past the first
+//   f16           signed halves round to within half a step
+//   grid          probes cover the bounds, within the cap on every axis
+//   floor         a probe over a lit floor sees it below and nothing above
+//   inside        probes inside a block are filled from those outside it
+//   threads       a bake on a work queue is bit-identical to a serial one
+//   file          encode and parse round trip, and cut short or foreign
+//                 files are rejected
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../irradiance_volume.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../irradiance_volume.c"
+#include "check.h"
+
+#define Check_SampleCount 1024
+
+static Scene_Instances g_scene;
+static Scene_Mesh      g_meshes[SceneModel_Count];
+static v3f             g_dirs[IrradianceVolume_MaxSamples];
+static v3f             g_radiance[IrradianceVolume_MaxSamples];
+
+typedef u32 Check_Env;
+enum
+{
+  Check_Env_Constant,
+  Check_Env_Linear,
+  Check_Env_Quadratic,
+  Check_Env_Sky,
+  Check_Env_Count,
+};
+
+static char *g_env_names[Check_Env_Count] = { "constant", "linear", "quadratic", "sky" };
+
+// the linear environment's axis
+static v3f
+check_linear_axis(void)
+{
+  v3f result = v3f_normalized((v3f){ 0.3f, -0.5f, 0.8f });
+  return(result);
+}
+
+static v3f
+check_env_radiance(Check_Env env, v3f dir)
+{
+  v3f result = v3f_zero();
+  switch (env)
+  {
+    case Check_Env_Constant:  result = (v3f){ 0.3f, 0.5f, 0.7f }; break;
+    case Check_Env_Linear:    result = v3f_s(0.5f + 0.4f * v3f_inner(dir, check_linear_axis())); break;
+    case Check_Env_Quadratic: result = v3f_s(dir.z * dir.z); break;
+    case Check_Env_Sky:       result = v3f_s((dir.z > 0.0f) ? 1.0f : 0.0f); break;
+  }
+
+  return(result);
+}
+
+// the cosine weighted mean radiance around normal, in closed form
+static v3f
+check_env_expected(Check_Env env, v3f normal)
+{
+  v3f result = v3f_zero();
+  switch (env)
+  {
+    case Check_Env_Constant:  result = (v3f){ 0.3f, 0.5f, 0.7f }; break;
+    case Check_Env_Linear:    result = v3f_s(0.5f + (2.0f / 3.0f) * 0.4f * v3f_inner(normal, check_linear_axis())); break;
+    case Check_Env_Quadratic: result = v3f_s(1.0f / 3.0f + (3.0f * normal.z * normal.z - 1.0f) / 12.0f); break;
+    case Check_Env_Sky:       result = v3f_s(0.5f * (1.0f + normal.z)); break;
+  }
+
+  return(result);
+}
+
+static void
+check_projection(void)
+{
+  irradiance_sphere_directions(g_dirs, Check_SampleCount);
+
+  // basis: the Gram matrix of the functions over the set
+  f32 worst_gram = 0.0f;
+  for (u32 i = 0; i < IrradianceVolume_Coefficients; ++i)
+  {
+    for (u32 j = 0; j < IrradianceVolume_Coefficients; ++j)
+    {
+      f64 sum = 0.0;
+      for (u32 dir_idx = 0; dir_idx < Check_SampleCount; ++dir_idx)
+      {
+        f32 basis[IrradianceVolume_Coefficients];
+        irradiance_sh9_basis(g_dirs[dir_idx], basis);
+        sum += basis[i] * basis[j];
+      }
+      sum *= 4.0 * PIF32 / Check_SampleCount;
+      worst_gram = Maximum(worst_gram, fabsf((f32)sum - ((i == j) ? 1.0f : 0.0f)));
+    }
+  }
+  check(worst_gram < 5e-3f, "basis", 0, worst_gram);
+
+  // the set is unit length and spreads evenly: its mean is the centre
+  v3f mean = v3f_zero();
+  f32 worst_length = 0.0f;
+  for (u32 dir_idx = 0; dir_idx < Check_SampleCount; ++dir_idx)
+  {
+    mean         = v3f_add(mean, v3f_scale(1.0f / Check_SampleCount, g_dirs[dir_idx]));
+    worst_length = Maximum(worst_length, fabsf(v3f_inner(g_dirs[dir_idx], g_dirs[dir_idx]) - 1.0f));
+  }
+  check(worst_length < 1e-5f, "basis", 1, worst_length);
+  check(sqrtf(v3f_inner(mean, mean)) < 1e-3f, "basis", 2, sqrtf(v3f_inner(mean, mean)));
+
+  // a hemisphere cut makes the sky the hardest to sample
+  f32 tolerance[Check_Env_Count] = { 1e-4f, 2e-3f, 2e-3f, 5e-3f };
+  for (Check_Env env = 0; env < Check_Env_Count; ++env)
+  {
+    for (u32 dir_idx = 0; dir_idx < Check_SampleCount; ++dir_idx)
+    {
+      g_radiance[dir_idx] = check_env_radiance(env, g_dirs[dir_idx]);
+    }
+
+    Irradiance_SH sh;
+    irradiance_sh_project(g_dirs, g_radiance, Check_SampleCount, &sh);
+    irradiance_sh_convolve(&sh);
+
+    u32 random = 0x5E + env;
+    f32 worst  = 0.0f;
+    for (u32 normal_idx = 0; normal_idx < 1000; ++normal_idx)
+    {
+      v3f normal   = (normal_idx < 6) ? (v3f){ 0 } : check_random_direction(&random);
+      if (normal_idx < 6)
+      {
+        normal.v[normal_idx / 2] = (normal_idx & 1) ? -1.0f : 1.0f;
+      }
+      v3f value    = irradiance_sh_evaluate(&sh, normal);
+      v3f expected = check_env_expected(env, normal);
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        worst = Maximum(worst, fabsf(value.v[channel] - expected.v[channel]));
+      }
+    }
+    check(worst < tolerance[env], g_env_names[env], 0, worst);
+  }
+}
+
+static void
+check_f16(void)
+{
+  u32 random = 0xF16;
+  for (u32 sample_idx = 0; sample_idx < 10000; ++sample_idx)
+  {
+    f32 value = powf(10.0f, 7.0f * check_random(&random) - 5.0f) * (2.0f * check_random(&random) - 1.0f);
+    f32 back  = irradiance_unpack_f16(irradiance_pack_f16(value));
+    f32 bound = Maximum(fabsf(value), ldexpf(1.0f, -14)) * ldexpf(1.0f, -11);
+    check(fabsf(back - value) <= bound, "f16", sample_idx, value);
+  }
+
+  check(irradiance_pack_f16(-1.0f) == 0xBC00, "f16", 100, (f32)irradiance_pack_f16(-1.0f));
+  check(irradiance_unpack_f16(irradiance_pack_f16(-0.25f)) == -0.25f, "f16", 101, 0.0f);
+  check(irradiance_unpack_f16(irradiance_pack_f16(-1e6f)) == -65504.0f, "f16", 102, 0.0f);
+}
+
+static void
+check_grid(void)
+{
+  Bvh_Box boxes[] =
+  {
+    { { 0.0f, 0.0f, 0.0f }, { 10.0f, 3.0f, 7.0f } },
+    { { -200.0f, -1.0f, -50.0f }, { 200.0f, 1.0f, 50.0f } },
+    { { 5.0f, 5.0f, 5.0f }, { 5.0f, 5.0f, 5.0f } },
+  };
+
+  for (u32 box_idx = 0; box_idx < ArrayCount(boxes); ++box_idx)
+  {
+    Irradiance_Grid grid;
+    irradiance_volume_grid(&grid, boxes[box_idx], IrradianceVolume_ProbeSpacing);
+    u32 counts[3] = { grid.probe_count_x, grid.probe_count_y, grid.probe_count_z };
+    check(grid.spacing >= IrradianceVolume_ProbeSpacing, "grid", box_idx * 10, grid.spacing);
+    check(grid.probe_count == counts[0] * counts[1] * counts[2], "grid", box_idx * 10 + 1, (f32)grid.probe_count);
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      f32 last = grid.origin.v[axis] + grid.spacing * (f32)(counts[axis] - 1);
+      check((counts[axis] >= 1) && (counts[axis] <= IrradianceVolume_MaxProbesAxis), "grid", box_idx * 10 + 2 + axis, (f32)counts[axis]);
+      check((grid.origin.v[axis] <= boxes[box_idx].min.v[axis] + 1e-3f) && (last >= boxes[box_idx].max.v[axis] - 1e-3f),
+            "grid", box_idx * 10 + 5 + axis, grid.origin.v[axis]);
+    }
+  }
+}
+
+// a bake of g_scene as it stands
+typedef struct
+{
+  Irradiance_Grid      grid;
+  Bvh                  bvh;
+  Bvh_Source_Triangle *triangles;
+  u32                  triangle_count;
+  Irradiance_Bake      bake;
+  Irradiance_SH       *probes;
+} Check_Bake;
+
+static void
+check_bake_begin(Check_Bake *check_bake, v3f sky, f32 light_intensity)
+{
+  check_bake->triangle_count = bvh_scene_triangle_count(&g_scene, g_meshes);
+  check_bake->triangles      = (Bvh_Source_Triangle *)os_memory_alloc((u64)check_bake->triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, g_meshes, check_bake->triangles);
+  bvh_build(&check_bake->bvh, check_bake->triangles, check_bake->triangle_count, 0);
+  irradiance_volume_grid(&check_bake->grid, check_bake->bvh.bounds, IrradianceVolume_ProbeSpacing);
+
+  check_bake->bake = (Irradiance_Bake)
+  {
+    .scene        = &g_scene,
+    .bvh          = &check_bake->bvh,
+    .triangles    = check_bake->triangles,
+    .light        = { .type = LightType_Directional, .intensity = { light_intensity, light_intensity, light_intensity, 1.0f }, .dir = { 0.0f, -1.0f, 0.0f } },
+    .sky          = sky,
+    .sample_count = Check_SampleCount,
+  };
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    check_bake->bake.material_albedo[material] = v3f_s(0.5f);
+  }
+
+  check_bake->probes = (Irradiance_SH *)os_memory_alloc((u64)check_bake->grid.probe_count * sizeof(Irradiance_SH));
+}
+
+static void
+check_bake_end(Check_Bake *check_bake)
+{
+  os_memory_free(check_bake->probes, (u64)check_bake->grid.probe_count * sizeof(Irradiance_SH));
+  bvh_free(&check_bake->bvh);
+  os_memory_free(check_bake->triangles, (u64)check_bake->triangle_count * sizeof(Bvh_Source_Triangle));
+}
+
+static v3f
+check_probe_p(Irradiance_Grid *grid, u32 probe_idx)
+{
+  u32 x = probe_idx % grid->probe_count_x;
+  u32 y = (probe_idx / grid->probe_count_x) % grid->probe_count_y;
+  u32 z = probe_idx / (grid->probe_count_x * grid->probe_count_y);
+  v3f result = v3f_add(grid->origin, v3f_scale(grid->spacing, (v3f){ (f32)x, (f32)y, (f32)z }));
+  return(result);
+}
+
+static void
+check_bakes(u32 thread_count)
+{
+  // floor: 400 wide with its top at y = 0.5 and albedo 0.5, the sun straight
+  // down at 1 and no sky. The floor sends back 0.5 + 0.1 ambient of 0.5 from
+  // the whole lower hemisphere, which again order 2 holds exactly.
+  check_scene_begin(&g_scene);
+  scene_add_instance(&g_scene, SceneModel_Cube, v3f_zero(), (v3f){ 400.0f, 1.0f, 400.0f }, m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  check_scene_end(&g_scene);
+
+  Check_Bake floor;
+  check_bake_begin(&floor, v3f_zero(), 1.0f);
+  f64 serial_start = check_seconds();
+  irradiance_volume_bake(&floor.bake, &floor.grid, floor.probes, 0);
+  f64 serial_end = check_seconds();
+  {
+    u32 above_count = 0;
+    f32 worst = 0.0f;
+    for (u32 probe_idx = 0; probe_idx < floor.grid.probe_count; ++probe_idx)
+    {
+      v3f p = check_probe_p(&floor.grid, probe_idx);
+      if ((p.y > 0.5f) && (fabsf(p.x) < 100.0f) && (fabsf(p.z) < 100.0f))
+      {
+        Irradiance_SH *sh = floor.probes + probe_idx;
+        worst = Maximum(worst, fabsf(irradiance_sh_evaluate(sh, (v3f){ 0.0f, -1.0f, 0.0f }).g - 0.55f));
+        worst = Maximum(worst, fabsf(irradiance_sh_evaluate(sh, (v3f){ 0.0f, 1.0f, 0.0f }).g));
+        worst = Maximum(worst, fabsf(irradiance_sh_evaluate(sh, (v3f){ 1.0f, 0.0f, 0.0f }).g - 0.275f));
+        ++above_count;
+      }
+    }
+    check(above_count > 0, "floor", 0, (f32)above_count);
+    check(worst < 0.01f, "floor", 1, worst);
+  }
+
+  // threads: the same bake through the queue
+  {
+    u64 probes_size = (u64)floor.grid.probe_count * sizeof(Irradiance_SH);
+    Irradiance_SH *threaded = (Irradiance_SH *)os_memory_alloc(probes_size);
+    OS_Work_Queue *queue = os_work_queue_create(Maximum(thread_count, 2));
+    f64 threaded_start = check_seconds();
+    irradiance_volume_bake(&floor.bake, &floor.grid, threaded, queue);
+    f64 threaded_end = check_seconds();
+    check(memcmp(floor.probes, threaded, probes_size) == 0, "threads", 0, 0.0f);
+    printf("bake of %u probes at %u samples: serial %.1f ms, %u threads %.1f ms\n", floor.grid.probe_count, Check_SampleCount,
+           (serial_end - serial_start) * 1000.0, Maximum(thread_count, 2), (threaded_end - threaded_start) * 1000.0);
+    os_memory_free(threaded, probes_size);
+  }
+
+  // file: encode, parse and read back
+  {
+    Irradiance_Grid *grid = &floor.grid;
+    u64 file_size = irradiance_volume_file_size(grid);
+    u8 *file_data = os_memory_alloc(file_size);
+    irradiance_volume_encode(file_data, grid, floor.probes);
+
+    Irradiance_Volume_Header *header = irradiance_volume_parse(file_data, file_size);
+    check(header != 0, "file", 0, 0.0f);
+    if (header)
+    {
+      check((header->probe_count_x == grid->probe_count_x) && (header->probe_count_y == grid->probe_count_y) &&
+            (header->probe_count_z == grid->probe_count_z), "file", 1, (f32)header->probe_count_x);
+      check((memcmp(&header->origin, &grid->origin, sizeof(v3f)) == 0) && (header->spacing == grid->spacing), "file", 2, header->spacing);
+      u16 *coefficients = (u16 *)(header + 1);
+      f32 worst = 0.0f;
+      for (u32 probe_idx = 0; probe_idx < grid->probe_count; ++probe_idx)
+      {
+        for (u32 coefficient = 0; coefficient < IrradianceVolume_Coefficients; ++coefficient)
+        {
+          for (u32 channel = 0; channel < 3; ++channel)
+          {
+            f32 value = floor.probes[probe_idx].c[coefficient].v[channel];
+            f32 back  = irradiance_unpack_f16(coefficients[(u64)probe_idx * IrradianceVolume_ProbeHalves + coefficient * 3 + channel]);
+            worst = Maximum(worst, fabsf(back - value) - Maximum(fabsf(value), ldexpf(1.0f, -14)) * ldexpf(1.0f, -11));
+          }
+        }
+      }
+      check(worst <= 0.0f, "file", 3, worst);
+    }
+
+    check(irradiance_volume_parse(file_data, file_size - 1) == 0, "file", 4, 0.0f);
+    check(irradiance_volume_parse(file_data, sizeof(Irradiance_Volume_Header) - 1) == 0, "file", 5, 0.0f);
+    ((Irradiance_Volume_Header *)file_data)->version = IrradianceVolume_Version + 1;
+    check(irradiance_volume_parse(file_data, file_size) == 0, "file", 6, 0.0f);
+    ((Irradiance_Volume_Header *)file_data)->version = IrradianceVolume_Version;
+    ((Irradiance_Volume_Header *)file_data)->magic   = 0;
+    check(irradiance_volume_parse(file_data, file_size) == 0, "file", 7, 0.0f);
+    check(irradiance_volume_parse(0, 0) == 0, "file", 8, 0.0f);
+    os_memory_free(file_data, file_size);
+  }
+  check_bake_end(&floor);
+
+  // inside: a block 10 on a side under a white sky, with a small cube 40 off
+  // to stretch the grid. The probes at x, y = +-2 and z = -2.25 or 1.75 are
+  // inside the block, see only its back faces, and must come out like the
+  // probes around them instead of black.
+  check_scene_begin(&g_scene);
+  scene_add_instance(&g_scene, SceneModel_Cube, v3f_zero(), v3f_s(10.0f), m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  scene_add_instance(&g_scene, SceneModel_Cube, (v3f){ 0.0f, 0.0f, 40.0f }, v3f_s(1.0f), m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  check_scene_end(&g_scene);
+
+  Check_Bake inside;
+  check_bake_begin(&inside, v3f_s(1.0f), 0.0f);
+  irradiance_volume_bake(&inside.bake, &inside.grid, inside.probes, 0);
+  {
+    u32 inside_count = 0;
+    f32 darkest_inside = 1.0f, brightest_outside = 0.0f;
+    for (u32 probe_idx = 0; probe_idx < inside.grid.probe_count; ++probe_idx)
+    {
+      v3f p = check_probe_p(&inside.grid, probe_idx);
+      f32 band0 = inside.probes[probe_idx].c[0].g;
+      if ((fabsf(p.x) < 5.0f) && (fabsf(p.y) < 5.0f) && (fabsf(p.z) < 5.0f))
+      {
+        darkest_inside = Minimum(darkest_inside, band0);
+        ++inside_count;
+      }
+      else
+      {
+        brightest_outside = Maximum(brightest_outside, band0);
+      }
+    }
+    check(inside_count == 8, "inside", 0, (f32)inside_count);
+    // a probe in the open under a sky of 1 has a band 0 of 2 sqrt(pi)
+    check(brightest_outside > 3.0f, "inside", 1, brightest_outside);
+    check(darkest_inside > 0.5f, "inside", 2, darkest_inside);
+  }
+  check_bake_end(&inside);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 thread_count = (argc > 1) ? (u32)atoi(argv[1]) : Maximum(os_processor_count(), 2) - 1;
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    g_meshes[model] = scene_mesh_for_model(model);
+  }
+
+  check_projection();
+  check_f16();
+  check_grid();
+  check_bakes(thread_count);
+
+  return(check_report());
+}
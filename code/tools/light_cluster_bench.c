@@ -0,0 +1,217 @@
+// Times the clustered light binning (light_cluster.c) on a synthetic field
+// of point and spot lights seen from a turning camera, and checks that the
+// packed lists are conservative: every point a light can reach inside the
+// frustum falls in a cluster that lists the light. Exits non-zero if not.
+//
+// usage: light_cluster_bench [light_count] [thread_count] [frame_count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../light_cluster.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../light_cluster.c"
+
+#define Bench_FieldSize      400.0f
+#define Bench_PointsPerLight 16
+#define Bench_ViewWidth      1280.0f
+#define Bench_ViewHeight     720.0f
+
+static Light              g_bench_lights[MaxLightCount];
+static Light_Cluster_Grid g_bench_grid;
+static Light_Cluster      g_bench_clusters[LightCluster_Count];
+static u32                g_bench_indices[LightCluster_MaxIndices];
+
+static f64
+bench_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+static f32
+bench_random(u32 *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return((f32)(*state >> 8) / (f32)(1 << 24));
+}
+
+static v3f
+bench_random_unit(u32 *state)
+{
+  v3f result;
+  do
+  {
+    result = (v3f){ 2.0f * bench_random(state) - 1.0f, 2.0f * bench_random(state) - 1.0f, 2.0f * bench_random(state) - 1.0f };
+  } while ((v3f_inner(result, result) > 1.0f) || (v3f_inner(result, result) < 1e-4f));
+  return(result);
+}
+
+static int
+bench_compare_f64(const void *a, const void *b)
+{
+  f64 x = *(f64 *)a;
+  f64 y = *(f64 *)b;
+  return((x > y) - (x < y));
+}
+
+// A point the light reaches: inside its range, and for spots inside the cone.
+static v3f
+bench_point_in_light(Light *light, u32 *random)
+{
+  for (;;)
+  {
+    v3f offset = v3f_scale(light->range, bench_random_unit(random));
+    if ((light->type != LightType_Spot) ||
+        (v3f_inner(offset, light->dir) >= light->spot_cos_outer * sqrtf(v3f_inner(offset, offset))))
+    {
+      return(v3f_add(light->P, offset));
+    }
+  }
+}
+
+static void
+bench_set_camera(u32 frame_idx, u32 frame_count)
+{
+  f32 angle  = 2.0f * PIF32 * (f32)frame_idx / (f32)frame_count;
+  v3f eye    = (v3f){ 0.5f * Bench_FieldSize, 6.0f, 0.5f * Bench_FieldSize };
+  v3f target = v3f_add(eye, (v3f){ cosf(angle), -0.15f, sinf(angle) });
+
+  f32 tan_half_fov_x = tanf(Radians(Scene_CameraFovDegrees) * 0.5f);
+  f32 tan_half_fov_y = tan_half_fov_x * (Bench_ViewHeight / Bench_ViewWidth);
+  Basis_R3 basis = br3_from_center_to_target(eye, target, (v3f){ 0.0f, 1.0f, 0.0f });
+  light_cluster_set_camera(&g_bench_grid, m44_make_view_from_basis(basis, eye), tan_half_fov_x, tan_half_fov_y,
+                           Scene_CameraNear, Scene_CameraFar);
+}
+
+// Returns the number of sampled points whose cluster misses their light.
+static u32
+bench_check(u32 light_count, u32 *random, u32 *tested)
+{
+  u32 result = 0;
+  for (u32 light_idx = 0; light_idx < light_count; ++light_idx)
+  {
+    Light *light = g_bench_lights + light_idx;
+    for (u32 point_idx = 0; point_idx < Bench_PointsPerLight; ++point_idx)
+    {
+      v3f p      = bench_point_in_light(light, random);
+      v3f view_p = m44_transform_point(g_bench_grid.world_to_view, p);
+      b32 inside = (view_p.z >= g_bench_grid.near_plane) && (view_p.z <= g_bench_grid.far_plane) &&
+                   (fabsf(view_p.x) <= view_p.z * g_bench_grid.tan_half_fov_x) &&
+                   (fabsf(view_p.y) <= view_p.z * g_bench_grid.tan_half_fov_y);
+      if (!inside)
+      {
+        continue;
+      }
+
+      Light_Cluster cluster = g_bench_clusters[light_cluster_index_of(&g_bench_grid, view_p)];
+      b32 listed = false;
+      for (u32 index_idx = cluster.offset; index_idx < cluster.offset + cluster.count; ++index_idx)
+      {
+        listed |= (g_bench_indices[index_idx] == light_idx);
+      }
+
+      ++*tested;
+      result += !listed;
+    }
+  }
+
+  return(result);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 light_count  = (argc > 1) ? (u32)atoi(argv[1]) : 10000;
+  u32 thread_count = (argc > 2) ? (u32)atoi(argv[2]) : os_processor_count();
+  u32 frame_count  = (argc > 3) ? (u32)atoi(argv[3]) : 120;
+  light_count = Minimum(light_count, MaxLightCount);
+  frame_count = Maximum(frame_count, 1);
+
+  // the calling thread joins in, so the queue gets one fewer
+  OS_Work_Queue *queue = (thread_count > 1) ? os_work_queue_create(thread_count - 1) : 0;
+  light_cluster_grid_alloc(&g_bench_grid);
+
+  u32 random = 0x5EED;
+  for (u32 light_idx = 0; light_idx < light_count; ++light_idx)
+  {
+    v3f p         = { Bench_FieldSize * bench_random(&random), 0.5f + 12.0f * bench_random(&random), Bench_FieldSize * bench_random(&random) };
+    v4f intensity = { bench_random(&random), bench_random(&random), bench_random(&random), 1.0f };
+    f32 range     = 1.0f + 3.0f * bench_random(&random);
+    if (light_idx & 1)
+    {
+      v3f look_p = v3f_add(p, v3f_add((v3f){ 0.0f, -1.0f, 0.0f }, v3f_scale(0.7f, bench_random_unit(&random))));
+      g_bench_lights[light_idx] = create_spot_light(p, look_p, intensity, 2.0f * range, 10.0f + 20.0f * bench_random(&random),
+                                                    35.0f + 50.0f * bench_random(&random));
+    }
+    else
+    {
+      g_bench_lights[light_idx] = create_point_light(p, intensity, range);
+    }
+  }
+
+  f64 *frame_ms   = malloc(frame_count * sizeof(f64));
+  u64  index_sum  = 0;
+  u64  occupied   = 0;
+  u32  dropped    = 0;
+  u32  failures   = 0;
+  u32  tested     = 0;
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    bench_set_camera(frame_idx, frame_count);
+
+    f64 begin = bench_seconds();
+    light_cluster_build(&g_bench_grid, g_bench_lights, light_count, queue);
+    frame_ms[frame_idx] = (bench_seconds() - begin) * 1000.0;
+    light_cluster_copy(&g_bench_grid, g_bench_clusters, g_bench_indices);
+
+    index_sum += g_bench_grid.index_count;
+    dropped   += g_bench_grid.dropped_count;
+    for (u32 cluster_idx = 0; cluster_idx < LightCluster_Count; ++cluster_idx)
+    {
+      occupied += (g_bench_clusters[cluster_idx].count != 0);
+    }
+
+    if ((frame_idx % 8) == 0)
+    {
+      failures += bench_check(light_count, &random, &tested);
+    }
+  }
+
+  qsort(frame_ms, frame_count, sizeof(f64), bench_compare_f64);
+  f64 mean_ms = 0.0;
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    mean_ms += frame_ms[frame_idx] / (f64)frame_count;
+  }
+
+  printf("%u lights, %u threads, %u frames, %ux%ux%u clusters\n", light_count, thread_count, frame_count,
+         LightCluster_TilesX, LightCluster_TilesY, LightCluster_Slices);
+  printf("build: median %.3f ms, mean %.3f ms, min %.3f ms, max %.3f ms\n",
+         frame_ms[frame_count / 2], mean_ms, frame_ms[0], frame_ms[frame_count - 1]);
+  printf("%.0f indices per frame, %.1f lights per occupied cluster, %u dropped\n", (f64)index_sum / (f64)frame_count,
+         occupied ? (f64)index_sum / (f64)occupied : 0.0, dropped);
+  printf("%u points checked, %u outside their light's clusters\n", tested, failures);
+  return(failures ? 1 : 0);
+}
@@ -0,0 +1,166 @@
+// Bakes the lightmap of the default scene (see lightmap.h) into one file the
+// engine uploads as an RGBA16F texture.
+//
+// usage: lightmap_bake <out.lmp> [sample_count] [bounce_count] [thread_count]
+//
+// Textured instances bounce light in their material's average diffuse
+// colour, read from data/textures/*/diffuse.png; a material without one
+// bakes as mid grey.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../lightmap.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../lightmap.c"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ext/stb_image.h"
+
+#define Bake_DefaultSamples 16
+#define Bake_DefaultBounces 2
+
+static Scene_Instances g_scene;
+
+static f64
+bake_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+// the mean of the texels, as reflection_bake takes it
+static v3f
+bake_material_albedo(char *material_dir)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "../data/%s/diffuse.png", material_dir);
+
+  v3f result = v3f_s(0.5f);
+  s32 width, height, comp;
+  u8 *texels = stbi_load(path, &width, &height, &comp, 3);
+  if (texels)
+  {
+    f64 sum[3] = { 0 };
+    u64 texel_count = (u64)width * height;
+    for (u64 texel = 0; texel < texel_count; ++texel)
+    {
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        sum[channel] += texels[texel * 3 + channel] / 255.0;
+      }
+    }
+
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      result.v[channel] = (f32)(sum[channel] / (f64)texel_count);
+    }
+    stbi_image_free(texels);
+  }
+  else
+  {
+    fprintf(stderr, "lightmap_bake: no %s, baking the material as grey\n", path);
+  }
+
+  return(result);
+}
+
+int
+main(int argc, char **argv)
+{
+  if ((argc < 2) || (argc > 5))
+  {
+    fprintf(stderr, "usage: lightmap_bake <out.lmp> [sample_count] [bounce_count] [thread_count]\n");
+    return(1);
+  }
+
+  u32 sample_count = (argc >= 3) ? (u32)atoi(argv[2]) : Bake_DefaultSamples;
+  u32 bounce_count = (argc >= 4) ? (u32)atoi(argv[3]) : Bake_DefaultBounces;
+  u32 thread_count = (argc == 5) ? (u32)atoi(argv[4]) : Maximum(os_processor_count(), 2) - 1;
+  OS_Work_Queue *queue = thread_count ? os_work_queue_create(thread_count) : 0;
+
+  // the instance order has to match the engine's, probes or not
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+
+  Scene_Mesh meshes[SceneModel_Count];
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    meshes[model] = scene_mesh_for_model(model);
+  }
+
+  f64 start = bake_seconds();
+  u32 triangle_count             = bvh_scene_triangle_count(&g_scene, meshes);
+  Bvh_Source_Triangle *triangles = (Bvh_Source_Triangle *)os_memory_alloc((u64)triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, meshes, triangles);
+  Bvh bvh;
+  bvh_build(&bvh, triangles, triangle_count, queue);
+  f64 build_end = bake_seconds();
+
+  Lightmap_Layout layout;
+  lightmap_layout(&layout, &g_scene, meshes, Lightmap_TexelsPerUnit);
+  f64 layout_end = bake_seconds();
+
+  Lightmap_Bake bake =
+  {
+    .scene        = &g_scene,
+    .meshes       = meshes,
+    .bvh          = &bvh,
+    .triangles    = triangles,
+    .light        = scene_directional_light(),
+    .sky          = v3f_zero(),
+    .sample_count = Maximum(sample_count, 1),
+    .bounce_count = bounce_count,
+  };
+
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    bake.material_albedo[material] = bake_material_albedo(scene_material_dir(material));
+  }
+
+  u64 texel_count = (u64)layout.width * layout.height;
+  v4f *texels     = (v4f *)os_memory_alloc(texel_count * sizeof(v4f));
+  lightmap_bake(&bake, &layout, texels, queue);
+  f64 bake_end = bake_seconds();
+
+  u64 file_size = lightmap_file_size(&layout);
+  u8 *file_data = os_memory_alloc(file_size);
+  lightmap_encode(file_data, &layout, texels);
+  if (!os_file_write_all(argv[1], file_data, file_size))
+  {
+    fprintf(stderr, "lightmap_bake: cannot write %s\n", argv[1]);
+    return(1);
+  }
+
+  printf("%s: %u charts in %dx%d at %.2f texels per unit, %.1f MB, %u samples %u bounces; bvh %.1f ms, layout %.1f ms, bake %.1f ms on %u threads\n",
+         argv[1], layout.chart_count, layout.width, layout.height, layout.texels_per_unit, (f64)file_size / (1024.0 * 1024.0),
+         bake.sample_count, bake.bounce_count, (build_end - start) * 1000.0, (layout_end - build_end) * 1000.0,
+         (bake_end - layout_end) * 1000.0, thread_count);
+  return(0);
+}
@@ -0,0 +1,452 @@
+// Checks the lightmap packer and baker (lightmap.c) on the default scene and
+// on small scenes whose answers are known. Exits non-zero if a check fails.
+//
+// usage: lightmap_check [thread_count]
+//
+//   f16           halves round to within half a step, and clamp what a
+//                 lightmap cannot hold
+//   skyline       packed rectangles stay inside the atlas and never overlap
+//   layout        every lit static instance of the default scene has one
+//                 chart per mesh chart, the charts do not overlap, and each
+//                 one's uv box lands on its rectangle inside the padding
+//   direct        a floor under the sun with a block above it: lit texels
+//                 hold intensity * n.l, shadowed ones 0.4 of it with no
+//                 visibility, and the padding is filled from the chart
+//   bounce        a wall beside a lit floor gets half the floor's radiance,
+//                 the cosine weighted share of its hemisphere the floor fills
+//   threads       a bake on a work queue is bit-identical to a serial one
+//   file          encode and parse round trip, and cut short or foreign
+//                 files are rejected
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../lightmap.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../lightmap.c"
+#include "check.h"
+
+// the cube's faces in scene_mesh_cube order
+#define Check_CubeSideChart 0
+#define Check_CubeTopChart  4
+
+static Scene_Instances g_scene;
+static Scene_Mesh      g_meshes[SceneModel_Count];
+
+static void
+check_f16(void)
+{
+  u32 random = 0xF16;
+  for (u32 sample_idx = 0; sample_idx < 10000; ++sample_idx)
+  {
+    f32 value = powf(10.0f, 9.0f * check_random(&random) - 5.0f) * check_random(&random);
+    f32 back  = lightmap_unpack_f16(lightmap_pack_f16(value));
+    // 10 bit mantissas: half a step is 2^-11 of the value, or of 2^-14
+    // below the normal range
+    f32 bound = Maximum(value, ldexpf(1.0f, -14)) * ldexpf(1.0f, -11);
+    check(fabsf(back - value) <= bound, "f16", sample_idx, value);
+  }
+
+  f32 exact[] = { 0.0f, 1.0f, 0.5f, 0.25f, 65504.0f, ldexpf(1.0f, -24), ldexpf(1.0f, -14), 1.0f + ldexpf(1.0f, -10) };
+  for (u32 exact_idx = 0; exact_idx < ArrayCount(exact); ++exact_idx)
+  {
+    f32 back = lightmap_unpack_f16(lightmap_pack_f16(exact[exact_idx]));
+    check(back == exact[exact_idx], "f16", exact_idx, back);
+  }
+
+  check(lightmap_pack_f16(1.0f) == 0x3C00, "f16", 100, (f32)lightmap_pack_f16(1.0f));
+  check(lightmap_pack_f16(-3.0f) == 0, "f16", 101, lightmap_unpack_f16(lightmap_pack_f16(-3.0f)));
+  check(lightmap_pack_f16(1e9f) == 0x7BFF, "f16", 102, lightmap_unpack_f16(lightmap_pack_f16(1e9f)));
+  // just under a power of two rounds up into the next exponent
+  check(lightmap_pack_f16(2.0f - ldexpf(1.0f, -13)) == 0x4000, "f16", 103, 0.0f);
+}
+
+static void
+check_skyline(void)
+{
+  s32 size = 512;
+  Tex_Skyline_Segment *segments = (Tex_Skyline_Segment *)os_memory_alloc(size * sizeof(Tex_Skyline_Segment));
+  u8 *owner = (u8 *)os_memory_alloc((u64)size * size);
+  Tex_Atlas atlas;
+  tex_atlas_begin(&atlas, size, size, segments);
+
+  u32 random = 0x5C1;
+  u32 placed = 0;
+  u64 area   = 0;
+  for (u32 rect_idx = 0; rect_idx < 2000; ++rect_idx)
+  {
+    s32 width  = 1 + (s32)(check_random(&random) * 40.0f);
+    s32 height = 1 + (s32)(check_random(&random) * 40.0f);
+    s32 x = -1, y = -1;
+    if (tex_atlas_add(&atlas, width, height, &x, &y))
+    {
+      b32 inside  = (x >= 0) && (y >= 0) && (x + width <= size) && (y + height <= size);
+      b32 overlap = false;
+      check(inside, "skyline", rect_idx, (f32)x);
+      for (s32 row = y; inside && (row < y + height); ++row)
+      {
+        for (s32 column = x; column < x + width; ++column)
+        {
+          overlap |= (owner[row * size + column] != 0);
+          owner[row * size + column] = 1;
+        }
+      }
+      check(!overlap, "skyline", rect_idx, (f32)y);
+      check(atlas.segment_count <= (u32)size, "skyline", rect_idx, (f32)atlas.segment_count);
+      ++placed;
+      area += (u64)width * height;
+    }
+  }
+
+  check(placed > 100, "skyline", 0, (f32)placed);
+  printf("skyline: %u of 2000 rectangles in %dx%d, %.1f%% full\n", placed, size, size, 100.0 * (f64)area / ((f64)size * size));
+
+  os_memory_free(owner, (u64)size * size);
+  os_memory_free(segments, size * sizeof(Tex_Skyline_Segment));
+}
+
+static void
+check_layout(void)
+{
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+
+  Lightmap_Layout layout;
+  lightmap_layout(&layout, &g_scene, g_meshes, Lightmap_TexelsPerUnit);
+  check(layout.instance_count == g_scene.static_instance_count, "layout", 0, (f32)layout.instance_count);
+  check((layout.width <= Lightmap_MaxAtlasSize) && (layout.height <= Lightmap_MaxAtlasSize), "layout", 1, (f32)layout.width);
+
+  Scene_Model models[MaxSceneInstances];
+  lightmap_instance_models(&g_scene, models);
+  u32 expected_chart = 0;
+  for (u32 instance_idx = 0; instance_idx < layout.instance_count; ++instance_idx)
+  {
+    if (g_scene.ins[instance_idx].enable_lighting)
+    {
+      check(layout.first_chart[instance_idx] == expected_chart, "layout", 2, (f32)instance_idx);
+      for (u32 mesh_chart = 0; mesh_chart < g_meshes[models[instance_idx]].chart_count; ++mesh_chart)
+      {
+        Lightmap_Chart *chart = layout.charts + expected_chart + mesh_chart;
+        check((chart->instance_idx == instance_idx) && (chart->mesh_chart == mesh_chart) && (chart->model == models[instance_idx]),
+              "layout", 3, (f32)instance_idx);
+      }
+      expected_chart += g_meshes[models[instance_idx]].chart_count;
+    }
+    else
+    {
+      check(layout.first_chart[instance_idx] == Lightmap_None, "layout", 4, (f32)instance_idx);
+    }
+  }
+  check(expected_chart == layout.chart_count, "layout", 5, (f32)layout.chart_count);
+
+  u8 *owner = (u8 *)os_memory_alloc((u64)layout.width * layout.height);
+  u32 overlaps = 0, outside = 0;
+  f32 worst_corner = 0.0f;
+  for (u32 chart_idx = 0; chart_idx < layout.chart_count; ++chart_idx)
+  {
+    Lightmap_Chart *chart = layout.charts + chart_idx;
+    if ((chart->x < 0) || (chart->y < 0) || (chart->x + chart->width > layout.width) || (chart->y + chart->height > layout.height))
+    {
+      ++outside;
+      continue;
+    }
+
+    for (s32 y = chart->y; y < chart->y + chart->height; ++y)
+    {
+      for (s32 x = chart->x; x < chart->x + chart->width; ++x)
+      {
+        overlaps += owner[(u64)y * layout.width + x];
+        owner[(u64)y * layout.width + x] = 1;
+      }
+    }
+
+    // every vertex lands inside the rectangle less its padding
+    Scene_Mesh       *mesh       = g_meshes + chart->model;
+    Scene_Mesh_Chart *mesh_chart = mesh->charts + chart->mesh_chart;
+    for (u32 index = mesh_chart->first_index; index < mesh_chart->first_index + mesh_chart->index_count; ++index)
+    {
+      v2f uv = mesh->vertices[mesh->indices[index]].uv;
+      f32 x  = (uv.x * chart->uv_transform.x + chart->uv_transform.z) * (f32)layout.width;
+      f32 y  = (uv.y * chart->uv_transform.y + chart->uv_transform.w) * (f32)layout.height;
+      f32 out_x = Maximum((f32)(chart->x + Lightmap_ChartPadding) - x, x - (f32)(chart->x + chart->width - Lightmap_ChartPadding));
+      f32 out_y = Maximum((f32)(chart->y + Lightmap_ChartPadding) - y, y - (f32)(chart->y + chart->height - Lightmap_ChartPadding));
+      worst_corner = Maximum(worst_corner, Maximum(out_x, out_y));
+    }
+  }
+  check(outside == 0, "layout", 6, (f32)outside);
+  check(overlaps == 0, "layout", 7, (f32)overlaps);
+  check(worst_corner < 1e-2f, "layout", 8, worst_corner);
+
+  // the platform cubes are Scene_BlockWidth on a side
+  if (layout.texels_per_unit == Lightmap_TexelsPerUnit)
+  {
+    Lightmap_Chart *platform_top = layout.charts + layout.first_chart[0] + Check_CubeTopChart;
+    s32 expected = (s32)ceilf(Scene_BlockWidth * Lightmap_TexelsPerUnit) + 2 * Lightmap_ChartPadding;
+    check((platform_top->width == expected) && (platform_top->height == expected), "layout", 9, (f32)platform_top->width);
+  }
+
+  u64 used = 0;
+  for (u64 texel = 0; texel < (u64)layout.width * layout.height; ++texel)
+  {
+    used += owner[texel];
+  }
+  printf("layout: %u charts in %dx%d at %.2f texels per unit, %.1f%% used\n", layout.chart_count, layout.width, layout.height,
+         layout.texels_per_unit, 100.0 * (f64)used / ((f64)layout.width * layout.height));
+
+  os_memory_free(owner, (u64)layout.width * layout.height);
+  lightmap_layout_free(&layout);
+}
+
+// a bake of g_scene as it stands
+typedef struct
+{
+  Lightmap_Layout      layout;
+  Bvh                  bvh;
+  Bvh_Source_Triangle *triangles;
+  u32                  triangle_count;
+  Lightmap_Bake        bake;
+  v4f                 *texels;
+} Check_Bake;
+
+static void
+check_bake_begin(Check_Bake *check_bake, f32 texels_per_unit, u32 sample_count, u32 bounce_count)
+{
+  check_bake->triangle_count = bvh_scene_triangle_count(&g_scene, g_meshes);
+  check_bake->triangles      = (Bvh_Source_Triangle *)os_memory_alloc((u64)check_bake->triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, g_meshes, check_bake->triangles);
+  bvh_build(&check_bake->bvh, check_bake->triangles, check_bake->triangle_count, 0);
+  lightmap_layout(&check_bake->layout, &g_scene, g_meshes, texels_per_unit);
+
+  check_bake->bake = (Lightmap_Bake)
+  {
+    .scene        = &g_scene,
+    .meshes       = g_meshes,
+    .bvh          = &check_bake->bvh,
+    .triangles    = check_bake->triangles,
+    .light        = { .type = LightType_Directional, .intensity = { 1.0f, 1.0f, 1.0f, 1.0f }, .dir = { 0.0f, -1.0f, 0.0f } },
+    .sky          = v3f_zero(),
+    .sample_count = sample_count,
+    .bounce_count = bounce_count,
+  };
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    check_bake->bake.material_albedo[material] = v3f_s(0.5f);
+  }
+
+  check_bake->texels = (v4f *)os_memory_alloc((u64)check_bake->layout.width * check_bake->layout.height * sizeof(v4f));
+}
+
+static void
+check_bake_end(Check_Bake *check_bake)
+{
+  os_memory_free(check_bake->texels, (u64)check_bake->layout.width * check_bake->layout.height * sizeof(v4f));
+  lightmap_layout_free(&check_bake->layout);
+  bvh_free(&check_bake->bvh);
+  os_memory_free(check_bake->triangles, (u64)check_bake->triangle_count * sizeof(Bvh_Source_Triangle));
+}
+
+// the mesh uv at texel (x, y) of chart
+static v2f
+check_texel_uv(Lightmap_Layout *layout, Lightmap_Chart *chart, s32 x, s32 y)
+{
+  v4f transform = chart->uv_transform;
+  v2f result = { (((f32)x + 0.5f) / (f32)layout->width - transform.z) / transform.x,
+                 (((f32)y + 0.5f) / (f32)layout->height - transform.w) / transform.y };
+  return(result);
+}
+
+static void
+check_bakes(u32 thread_count)
+{
+  // direct: a 40 wide floor, its top at y = 0.5, and a block of side 2 over
+  // its middle; the sun points straight down
+  check_scene_begin(&g_scene);
+  scene_add_instance(&g_scene, SceneModel_Cube, v3f_zero(), (v3f){ 40.0f, 1.0f, 40.0f }, m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  scene_add_instance(&g_scene, SceneModel_Cube, (v3f){ 0.0f, 5.0f, 0.0f }, v3f_s(2.0f), m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  check_scene_end(&g_scene);
+
+  Check_Bake direct;
+  check_bake_begin(&direct, 2.0f, 8, 0);
+  f64 serial_start = check_seconds();
+  lightmap_bake(&direct.bake, &direct.layout, direct.texels, 0);
+  f64 serial_end = check_seconds();
+  {
+    Lightmap_Layout *layout = &direct.layout;
+    Lightmap_Chart  *top    = layout->charts + layout->first_chart[0] + Check_CubeTopChart;
+    u32 lit_count = 0, shadowed_count = 0;
+    f32 worst_lit = 0.0f, worst_shadowed = 0.0f, darkest = 1.0f;
+    for (s32 y = top->y; y < top->y + top->height; ++y)
+    {
+      for (s32 x = top->x; x < top->x + top->width; ++x)
+      {
+        v4f texel = direct.texels[(u64)y * layout->width + x];
+        darkest   = Minimum(darkest, texel.r);
+
+        // the top face runs x = u - 0.5, z = 0.5 - v in model space
+        v2f uv = check_texel_uv(layout, top, x, y);
+        f32 world_x  = 40.0f * (uv.x - 0.5f);
+        f32 world_z  = 40.0f * (0.5f - uv.y);
+        f32 distance = Maximum(fabsf(world_x), fabsf(world_z));
+        if (distance > 1.5f)
+        {
+          worst_lit = Maximum(worst_lit, Maximum(fabsf(texel.r - 1.0f), fabsf(texel.a - 1.0f)));
+          ++lit_count;
+        }
+        else if (distance < 0.5f)
+        {
+          worst_shadowed = Maximum(worst_shadowed, Maximum(fabsf(texel.r - 0.4f), texel.a));
+          ++shadowed_count;
+        }
+      }
+    }
+    check(lit_count && shadowed_count, "direct", 0, (f32)shadowed_count);
+    check(worst_lit < 1e-5f, "direct", 1, worst_lit);
+    check(worst_shadowed < 1e-5f, "direct", 2, worst_shadowed);
+    // the padding too, so nothing black is filtered in
+    check(darkest >= 0.4f - 1e-5f, "direct", 3, darkest);
+
+    // the block's top is lit, its bottom faces away
+    Lightmap_Chart *block_top    = layout->charts + layout->first_chart[1] + Check_CubeTopChart;
+    Lightmap_Chart *block_bottom = layout->charts + layout->first_chart[1] + Check_CubeTopChart + 1;
+    v4f lit   = direct.texels[(u64)(block_top->y + block_top->height / 2) * layout->width + block_top->x + block_top->width / 2];
+    v4f unlit = direct.texels[(u64)(block_bottom->y + block_bottom->height / 2) * layout->width + block_bottom->x + block_bottom->width / 2];
+    check((lit.r == 1.0f) && (lit.a == 1.0f), "direct", 4, lit.r);
+    check((unlit.r == 0.0f) && (unlit.a == 0.0f), "direct", 5, unlit.r);
+  }
+
+  // threads: the same bake through the queue
+  {
+    u64 texels_size = (u64)direct.layout.width * direct.layout.height * sizeof(v4f);
+    v4f *threaded   = (v4f *)os_memory_alloc(texels_size);
+    OS_Work_Queue *queue = os_work_queue_create(Maximum(thread_count, 2));
+    f64 threaded_start = check_seconds();
+    lightmap_bake(&direct.bake, &direct.layout, threaded, queue);
+    f64 threaded_end = check_seconds();
+    check(memcmp(direct.texels, threaded, texels_size) == 0, "threads", 0, 0.0f);
+    printf("bake of %dx%d: serial %.1f ms, %u threads %.1f ms\n", direct.layout.width, direct.layout.height,
+           (serial_end - serial_start) * 1000.0, Maximum(thread_count, 2), (threaded_end - threaded_start) * 1000.0);
+    os_memory_free(threaded, texels_size);
+  }
+
+  // file: encode, parse and read back
+  {
+    Lightmap_Layout *layout = &direct.layout;
+    u64 file_size = lightmap_file_size(layout);
+    u8 *file_data = os_memory_alloc(file_size);
+    lightmap_encode(file_data, layout, direct.texels);
+
+    Lightmap_Header *header = lightmap_parse(file_data, file_size);
+    check(header != 0, "file", 0, 0.0f);
+    if (header)
+    {
+      check((header->width == (u32)layout->width) && (header->height == (u32)layout->height), "file", 1, (f32)header->width);
+      check((header->instance_count == 2) && (header->chart_count == layout->chart_count), "file", 2, (f32)header->chart_count);
+      u32 *first_chart = (u32 *)(header + 1);
+      v4f *charts      = (v4f *)(first_chart + header->instance_count);
+      u16 *texels      = (u16 *)(charts + header->chart_count);
+      check((first_chart[0] == layout->first_chart[0]) && (first_chart[1] == layout->first_chart[1]), "file", 3, (f32)first_chart[1]);
+      check(memcmp(&charts[5], &layout->charts[5].uv_transform, sizeof(v4f)) == 0, "file", 4, charts[5].x);
+      f32 worst = 0.0f;
+      for (u64 texel = 0; texel < (u64)layout->width * layout->height; ++texel)
+      {
+        for (u32 channel = 0; channel < 4; ++channel)
+        {
+          f32 value = direct.texels[texel].v[channel];
+          worst = Maximum(worst, fabsf(lightmap_unpack_f16(texels[texel * 4 + channel]) - value) - Maximum(value, ldexpf(1.0f, -14)) * ldexpf(1.0f, -11));
+        }
+      }
+      check(worst <= 0.0f, "file", 5, worst);
+    }
+
+    check(lightmap_parse(file_data, file_size - 1) == 0, "file", 6, 0.0f);
+    check(lightmap_parse(file_data, sizeof(Lightmap_Header) - 1) == 0, "file", 7, 0.0f);
+    ((Lightmap_Header *)file_data)->version = Lightmap_Version + 1;
+    check(lightmap_parse(file_data, file_size) == 0, "file", 8, 0.0f);
+    ((Lightmap_Header *)file_data)->version = Lightmap_Version;
+    ((Lightmap_Header *)file_data)->magic   = 0;
+    check(lightmap_parse(file_data, file_size) == 0, "file", 9, 0.0f);
+    check(lightmap_parse(0, 0) == 0, "file", 10, 0.0f);
+    os_memory_free(file_data, file_size);
+  }
+  check_bake_end(&direct);
+
+  // bounce: a 400 wide floor of albedo 0.5 lit at 1, and a wall 4 high
+  // standing on it. The wall's sides face across the light, so all they get
+  // is the floor's 0.5 from the lower half of their hemisphere.
+  check_scene_begin(&g_scene);
+  scene_add_instance(&g_scene, SceneModel_Cube, v3f_zero(), (v3f){ 400.0f, 1.0f, 400.0f }, m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  scene_add_instance(&g_scene, SceneModel_Cube, (v3f){ 0.0f, 2.5f, 0.0f }, (v3f){ 1.0f, 4.0f, 1.0f }, m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  check_scene_end(&g_scene);
+
+  Check_Bake bounce;
+  check_bake_begin(&bounce, 0.25f, 256, 1);
+  lightmap_bake(&bounce.bake, &bounce.layout, bounce.texels, 0);
+  for (u32 side = 0; side < 4; ++side)
+  {
+    Lightmap_Layout *layout = &bounce.layout;
+    Lightmap_Chart  *chart  = layout->charts + layout->first_chart[1] + Check_CubeSideChart + side;
+    f32 sum   = 0.0f;
+    u32 count = 0;
+    for (s32 y = chart->y + Lightmap_ChartPadding; y < chart->y + chart->height - Lightmap_ChartPadding; ++y)
+    {
+      for (s32 x = chart->x + Lightmap_ChartPadding; x < chart->x + chart->width - Lightmap_ChartPadding; ++x)
+      {
+        v4f texel = bounce.texels[(u64)y * layout->width + x];
+        sum += texel.g;
+        ++count;
+        check(texel.a == 0.0f, "bounce", 10 + side, texel.a);
+      }
+    }
+
+    f32 mean = sum / (f32)Maximum(count, 1);
+    check(fabsf(mean - 0.25f) < 0.01f, "bounce", side, mean);
+  }
+  check_bake_end(&bounce);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 thread_count = (argc > 1) ? (u32)atoi(argv[1]) : Maximum(os_processor_count(), 2) - 1;
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    g_meshes[model] = scene_mesh_for_model(model);
+  }
+
+  check_f16();
+  check_skyline();
+  check_layout();
+  check_bakes(thread_count);
+
+  return(check_report());
+}
@@ -0,0 +1,328 @@
+// Derives a tangent-space normal map from a displacement map and writes it as
+// a BC5 texture container (see tex_file.h) with a full mip chain.
+//
+// usage: normal_bake <displacement.png> <out.tex> [strength]
+//
+// Slopes come from a 3x3 Scharr filter (wrapping, the meshes repeat their
+// textures). At strength 1 the normals describe the same surface
+// parallax_uv2 marches through: a full displacement range is
+// NormalBake_ParallaxHeightScale UV units deep.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../os/os.h"
+#include "../tex_file.h"
+
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_file.c"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ext/stb_image.h"
+
+// height_scale_tweak in parallax_uv2
+#define NormalBake_ParallaxHeightScale 0.04f
+#define NormalBake_RowsPerJob 32
+
+typedef struct
+{
+  u32  width;
+  u32  height;
+  f32 *x;
+  f32 *y;
+  f32 *z;
+} Normal_Plane;
+
+typedef struct
+{
+  // heights with a one texel wrapped apron on every side
+  f32          *heights;
+  u32           stride;
+  f32           scale_u;
+  f32           scale_v;
+
+  Normal_Plane *source;
+  Normal_Plane *dest;
+  u8           *blocks;
+  u32           row_begin;
+  u32           row_end;
+} Normal_Job;
+
+static f64
+bake_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+static Normal_Plane
+normal_plane_alloc(u32 width, u32 height)
+{
+  Normal_Plane result = { .width = width, .height = height };
+  u64 size = (u64)width * height * sizeof(f32);
+  result.x = os_memory_alloc(size);
+  result.y = os_memory_alloc(size);
+  result.z = os_memory_alloc(size);
+  return(result);
+}
+
+// Four texels per step. Scharr weights (3, 10, 3) over a two texel span sum
+// to 32, which turns the filter response into a per-texel slope.
+static void
+normal_job_scharr(void *data)
+{
+  Normal_Job *job     = (Normal_Job *)data;
+  Normal_Plane *dest  = job->dest;
+  __m128 three        = _mm_set1_ps(3.0f / 32.0f);
+  __m128 ten          = _mm_set1_ps(10.0f / 32.0f);
+  __m128 scale_u      = _mm_set1_ps(-job->scale_u);
+  __m128 scale_v      = _mm_set1_ps(job->scale_v);
+  __m128 one          = _mm_set1_ps(1.0f);
+  for (u32 y = job->row_begin; y < job->row_end; ++y)
+  {
+    f32 *above = job->heights + (u64)y * job->stride + 1;
+    f32 *row   = above + job->stride;
+    f32 *below = row + job->stride;
+    f32 *out_x = dest->x + (u64)y * dest->width;
+    f32 *out_y = dest->y + (u64)y * dest->width;
+    f32 *out_z = dest->z + (u64)y * dest->width;
+
+    u32 x = 0;
+    for (; x + 4 <= dest->width; x += 4)
+    {
+      __m128 above_l = _mm_loadu_ps(above + x - 1), above_c = _mm_loadu_ps(above + x), above_r = _mm_loadu_ps(above + x + 1);
+      __m128 row_l   = _mm_loadu_ps(row + x - 1),                                      row_r   = _mm_loadu_ps(row + x + 1);
+      __m128 below_l = _mm_loadu_ps(below + x - 1), below_c = _mm_loadu_ps(below + x), below_r = _mm_loadu_ps(below + x + 1);
+
+      __m128 du = _mm_add_ps(_mm_mul_ps(three, _mm_add_ps(_mm_sub_ps(above_r, above_l), _mm_sub_ps(below_r, below_l))),
+                             _mm_mul_ps(ten, _mm_sub_ps(row_r, row_l)));
+      __m128 dv = _mm_add_ps(_mm_mul_ps(three, _mm_add_ps(_mm_sub_ps(below_l, above_l), _mm_sub_ps(below_r, above_r))),
+                             _mm_mul_ps(ten, _mm_sub_ps(below_c, above_c)));
+
+      // +v runs against the bitangent (see tex_step in parallax_uv2), hence the sign
+      __m128 nx  = _mm_mul_ps(du, scale_u);
+      __m128 ny  = _mm_mul_ps(dv, scale_v);
+      __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), one));
+      __m128 inv = _mm_div_ps(one, len);
+      _mm_storeu_ps(out_x + x, _mm_mul_ps(nx, inv));
+      _mm_storeu_ps(out_y + x, _mm_mul_ps(ny, inv));
+      _mm_storeu_ps(out_z + x, inv);
+    }
+
+    for (; x < dest->width; ++x)
+    {
+      f32 du  = (3.0f * ((above[x + 1] - above[x - 1]) + (below[x + 1] - below[x - 1])) + 10.0f * (row[x + 1] - row[x - 1])) / 32.0f;
+      f32 dv  = (3.0f * ((below[x - 1] - above[x - 1]) + (below[x + 1] - above[x + 1])) + 10.0f * (below[x] - above[x])) / 32.0f;
+      f32 nx  = -du * job->scale_u;
+      f32 ny  = dv * job->scale_v;
+      f32 inv = 1.0f / sqrtf(nx * nx + ny * ny + 1.0f);
+      out_x[x] = nx * inv;
+      out_y[x] = ny * inv;
+      out_z[x] = inv;
+    }
+  }
+}
+
+// Averages 2x2 and renormalises, so mips stay unit length.
+static void
+normal_job_downsample(void *data)
+{
+  Normal_Job *job       = (Normal_Job *)data;
+  Normal_Plane *source  = job->source;
+  Normal_Plane *dest    = job->dest;
+  for (u32 y = job->row_begin; y < job->row_end; ++y)
+  {
+    u32 y0 = Minimum(2 * y, source->height - 1);
+    u32 y1 = Minimum(2 * y + 1, source->height - 1);
+    for (u32 x = 0; x < dest->width; ++x)
+    {
+      u32 x0 = Minimum(2 * x, source->width - 1);
+      u32 x1 = Minimum(2 * x + 1, source->width - 1);
+      u64 a = (u64)y0 * source->width + x0, b = (u64)y0 * source->width + x1;
+      u64 c = (u64)y1 * source->width + x0, d = (u64)y1 * source->width + x1;
+
+      f32 nx  = source->x[a] + source->x[b] + source->x[c] + source->x[d];
+      f32 ny  = source->y[a] + source->y[b] + source->y[c] + source->y[d];
+      f32 nz  = source->z[a] + source->z[b] + source->z[c] + source->z[d];
+      f32 len = sqrtf(nx * nx + ny * ny + nz * nz);
+      f32 inv = (len > 0.0f) ? (1.0f / len) : 0.0f;
+
+      u64 out = (u64)y * dest->width + x;
+      dest->x[out] = nx * inv;
+      dest->y[out] = (len > 0.0f) ? ny * inv : 0.0f;
+      dest->z[out] = (len > 0.0f) ? nz * inv : 1.0f;
+    }
+  }
+}
+
+static u8
+normal_quantize(f32 value)
+{
+  f32 unorm = value * 0.5f + 0.5f;
+  unorm = (unorm < 0.0f) ? 0.0f : ((unorm > 1.0f) ? 1.0f : unorm);
+  return((u8)(unorm * 255.0f + 0.5f));
+}
+
+// row_begin/row_end count block rows here
+static void
+normal_job_encode_bc5(void *data)
+{
+  Normal_Job *job       = (Normal_Job *)data;
+  Normal_Plane *source  = job->source;
+  u32 blocks_x          = (source->width + 3) / 4;
+  for (u32 block_y = job->row_begin; block_y < job->row_end; ++block_y)
+  {
+    for (u32 block_x = 0; block_x < blocks_x; ++block_x)
+    {
+      u8 xs[16], ys[16];
+      for (u32 texel = 0; texel < 16; ++texel)
+      {
+        u32 x   = Minimum(block_x * 4 + (texel & 3), source->width - 1);
+        u32 y   = Minimum(block_y * 4 + (texel >> 2), source->height - 1);
+        u64 idx = (u64)y * source->width + x;
+        xs[texel] = normal_quantize(source->x[idx]);
+        ys[texel] = normal_quantize(source->y[idx]);
+      }
+
+      u8 *block = job->blocks + ((u64)block_y * blocks_x + block_x) * 16;
+      tex_file_encode_bc4_block(xs, block);
+      tex_file_encode_bc4_block(ys, block + 8);
+    }
+  }
+}
+
+static void
+normal_run_jobs(OS_Work_Queue *queue, Normal_Job *jobs, Normal_Job base, u32 row_count, OS_Work_Proc *proc)
+{
+  u32 job_count = 0;
+  for (u32 row = 0; row < row_count; row += NormalBake_RowsPerJob)
+  {
+    jobs[job_count]           = base;
+    jobs[job_count].row_begin = row;
+    jobs[job_count].row_end   = Minimum(row + NormalBake_RowsPerJob, row_count);
+    os_work_queue_add(queue, proc, jobs + job_count);
+    ++job_count;
+  }
+
+  os_work_queue_complete_all(queue);
+}
+
+int
+main(int argc, char **argv)
+{
+  if ((argc < 3) || (argc > 4))
+  {
+    fprintf(stderr, "usage: normal_bake <displacement.png> <out.tex> [strength]\n");
+    return(1);
+  }
+
+  f32 strength = (argc == 4) ? (f32)atof(argv[3]) : 1.0f;
+
+  s32 width = 0, height = 0, comp = 0;
+  u8 *displacement = stbi_load(argv[1], &width, &height, &comp, 1);
+  if (!displacement || (width & 3) || (height & 3))
+  {
+    fprintf(stderr, "normal_bake: cannot load %s (BC5 needs dimensions that are multiples of 4)\n", argv[1]);
+    return(1);
+  }
+
+  u32 thread_count      = Maximum(os_processor_count(), 2) - 1;
+  OS_Work_Queue *queue  = os_work_queue_create(thread_count);
+  Normal_Job *jobs      = os_memory_alloc(((u64)height / NormalBake_RowsPerJob + 1) * sizeof(Normal_Job));
+
+  f64 start = bake_seconds();
+  Normal_Job base =
+  {
+    .stride   = (u32)width + 2,
+    .scale_u  = strength * NormalBake_ParallaxHeightScale * (f32)width,
+    .scale_v  = strength * NormalBake_ParallaxHeightScale * (f32)height,
+  };
+  base.heights = os_memory_alloc((u64)base.stride * (height + 2) * sizeof(f32));
+  for (s32 y = -1; y <= height; ++y)
+  {
+    f32 *dest = base.heights + (u64)(y + 1) * base.stride;
+    u8 *source = displacement + (u64)((y + height) % height) * width;
+    for (s32 x = -1; x <= width; ++x)
+    {
+      dest[x + 1] = (f32)source[(x + width) % width] / 255.0f;
+    }
+  }
+
+  u32 mip_count = 1;
+  while ((Maximum(width >> mip_count, height >> mip_count) > 0) && (mip_count < TexFile_MaxMips))
+  {
+    ++mip_count;
+  }
+
+  Normal_Plane planes[TexFile_MaxMips];
+  planes[0]  = normal_plane_alloc((u32)width, (u32)height);
+  base.dest  = planes;
+  normal_run_jobs(queue, jobs, base, (u32)height, normal_job_scharr);
+  f64 filter_seconds = bake_seconds() - start;
+
+  for (u32 mip = 1; mip < mip_count; ++mip)
+  {
+    planes[mip]  = normal_plane_alloc(Maximum((u32)width >> mip, 1), Maximum((u32)height >> mip, 1));
+    base.source  = planes + mip - 1;
+    base.dest    = planes + mip;
+    normal_run_jobs(queue, jobs, base, planes[mip].height, normal_job_downsample);
+  }
+
+  Tex_File_Header header =
+  {
+    .magic      = TexFile_Magic,
+    .version    = TexFile_Version,
+    .format     = TexFileFormat_BC5,
+    .width      = (u32)width,
+    .height     = (u32)height,
+    .mip_count  = mip_count,
+  };
+
+  u64 offset = AlignAToB((u64)sizeof(Tex_File_Header), 16ull);
+  for (u32 mip = 0; mip < mip_count; ++mip)
+  {
+    header.mip_offsets[mip] = offset;
+    header.mip_sizes[mip]   = tex_file_mip_size(TexFileFormat_BC5, planes[mip].width, planes[mip].height);
+    offset                  = AlignAToB(offset + header.mip_sizes[mip], 16ull);
+  }
+
+  u8 *file = os_memory_alloc(offset);
+  memcpy(file, &header, sizeof(header));
+  for (u32 mip = 0; mip < mip_count; ++mip)
+  {
+    base.source = planes + mip;
+    base.blocks = file + header.mip_offsets[mip];
+    normal_run_jobs(queue, jobs, base, tex_file_row_count(TexFileFormat_BC5, planes[mip].height), normal_job_encode_bc5);
+  }
+  f64 total_seconds = bake_seconds() - start;
+
+  FILE *out = fopen(argv[2], "wb");
+  if (!out || (fwrite(file, 1, offset, out) != offset))
+  {
+    fprintf(stderr, "normal_bake: cannot write %s\n", argv[2]);
+    return(1);
+  }
+  fclose(out);
+
+  printf("%s: %dx%d, %u mips, %.1f KB (RGBA8 would be %.1f KB), filter %.1f ms, total %.1f ms on %u threads\n",
+         argv[2], width, height, mip_count, (f64)offset / 1024.0, (f64)width * height * 4 * 4 / 3 / 1024.0,
+         filter_seconds * 1000.0, total_seconds * 1000.0, thread_count + 1);
+
+  stbi_image_free(displacement);
+  return(0);
+}
@@ -0,0 +1,294 @@
+// Times the software occlusion culling (occlusion.c) on the default scene
+// along a camera path, and checks it. Exits non-zero if a check fails.
+//
+// usage: occlusion_bench [thread_count] [frame_count]
+//
+//   occluders     the platform merges into one slab, and a box under it is
+//                 occluded from above while one on top of it is not
+//   threads       a buffer drawn on a work queue is bit-identical to a
+//                 serial one
+//   rays          camera rays traced against the BVH never land on an
+//                 instance the test culled
+//
+// The path walks down the hall, back along the pillars turning round, and
+// then circles the hall from outside and above.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../occlusion.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../occlusion.c"
+#include "check.h"
+
+#define Bench_ViewWidth      1280.0f
+#define Bench_ViewHeight     720.0f
+#define Bench_RaysPerFrame   1024
+
+typedef struct
+{
+  v3f eye;
+  v3f front;
+  v3f right;
+  v3f up;
+} Bench_Camera;
+
+static Scene_Instances  g_scene;
+static Scene_Instances  g_culled;
+static Occlusion_Buffer g_buffer;
+static Occlusion_Buffer g_serial_buffer;
+static Occlusion_Result g_results[MaxSceneInstances];
+
+static int
+bench_compare_f64(const void *a, const void *b)
+{
+  f64 x = *(f64 *)a;
+  f64 y = *(f64 *)b;
+  return((x > y) - (x < y));
+}
+
+// Builds the camera the way scene_update_and_render does, from its angles.
+static Bench_Camera
+bench_camera_from_angles(v3f eye, f32 rotate_xz, f32 rotate_yz)
+{
+  f32 xz = Radians(rotate_xz);
+  f32 yz = Radians(rotate_yz);
+  Bench_Camera result;
+  result.eye   = eye;
+  result.front = v3f_normalized((v3f){ cosf(xz) * sinf(yz), cosf(yz), sinf(xz) * sinf(yz) });
+  result.up    = v3f_normalized(v3f_sub((v3f){ 0.0f, 1.0f, 0.0f }, v3f_scale(result.front.y, result.front)));
+  result.right = v3f_normalized(v3f_cross(result.up, result.front));
+  return(result);
+}
+
+static Bench_Camera
+bench_camera_looking_at(v3f eye, v3f target)
+{
+  v3f to = v3f_normalized(v3f_sub(target, eye));
+  return(bench_camera_from_angles(eye, atan2f(to.z, to.x) * (180.0f / PIF32), acosf(to.y) * (180.0f / PIF32)));
+}
+
+// t in [0, 1) along the path
+static Bench_Camera
+bench_path_camera(f32 t)
+{
+  f32 hall_width = ScenePlatform_BlockCountWidth * Scene_BlockWidth;
+  f32 hall_depth = ScenePlatform_BlockCountDepth * Scene_BlockWidth;
+  Bench_Camera result;
+  if (t < 0.25f)
+  {
+    f32 walk = t / 0.25f;
+    result = bench_camera_from_angles((v3f){ hall_width * 0.5f, 4.0f, 2.0f + walk * (hall_depth - 4.0f) }, 90.0f, 95.0f);
+  }
+  else if (t < 0.5f)
+  {
+    f32 walk = (t - 0.25f) / 0.25f;
+    result = bench_camera_from_angles((v3f){ hall_width * 0.5f + 6.0f, 3.0f, hall_depth - 2.0f - walk * (hall_depth - 4.0f) },
+                                      360.0f * walk * 5.0f, 100.0f);
+  }
+  else
+  {
+    f32 angle  = 2.0f * PIF32 * (t - 0.5f) / 0.5f;
+    f32 radius = hall_width * 1.5f;
+    v3f center = { hall_width * 0.5f, 0.0f, hall_depth * 0.5f };
+    result = bench_camera_looking_at((v3f){ center.x + radius * cosf(angle), 30.0f, center.z + radius * sinf(angle) }, center);
+  }
+
+  return(result);
+}
+
+static void
+bench_set_camera(Occlusion_Buffer *buffer, Bench_Camera *camera)
+{
+  m44 view =
+  {
+    camera->right.x, camera->up.x, camera->front.x, 0.0f,
+    camera->right.y, camera->up.y, camera->front.y, 0.0f,
+    camera->right.z, camera->up.z, camera->front.z, 0.0f,
+    -v3f_inner(camera->right, camera->eye), -v3f_inner(camera->up, camera->eye), -v3f_inner(camera->front, camera->eye), 1.0f
+  };
+  m44 projection = m44_make_perspective_z01(Bench_ViewHeight / Bench_ViewWidth, Radians(Scene_CameraFovDegrees),
+                                            Scene_CameraNear, Scene_CameraFar);
+  occlusion_set_camera(buffer, camera->eye, m44_mul(view, projection));
+}
+
+static void
+check_occluders(void)
+{
+  // the platform, one block deep, is the biggest occluder there is
+  f32 hall_width = ScenePlatform_BlockCountWidth * Scene_BlockWidth;
+  f32 hall_depth = ScenePlatform_BlockCountDepth * Scene_BlockWidth;
+  b32 found_slab = false;
+  for (u32 occluder_idx = 0; occluder_idx < g_buffer.occluder_count; ++occluder_idx)
+  {
+    Occlusion_Box *box = &g_buffer.occluders[occluder_idx].inner;
+    found_slab |= (box->max.x - box->min.x > hall_width - 1.0f) && (box->max.z - box->min.z > hall_depth - 1.0f) &&
+                  (box->max.y < Scene_BlockWidth);
+  }
+  check(found_slab, "occluders slab", 0, (f64)g_buffer.occluder_count);
+
+  // looking straight down at the platform, clear of the big sphere
+  Bench_Camera camera = bench_camera_looking_at((v3f){ hall_width * 0.5f + 3.0f, 40.0f, hall_depth * 0.25f + 3.0f },
+                                                (v3f){ hall_width * 0.5f + 3.0f, 0.0f, hall_depth * 0.25f + 3.1f });
+  bench_set_camera(&g_buffer, &camera);
+  occlusion_render(&g_buffer, 0);
+
+  v3f under_min = { hall_width * 0.5f + 2.0f, -4.0f, hall_depth * 0.25f + 2.0f };
+  v3f under_max = { hall_width * 0.5f + 4.0f, -2.0f, hall_depth * 0.25f + 4.0f };
+  v3f above_min = { hall_width * 0.5f + 2.0f, 2.0f, hall_depth * 0.25f + 2.0f };
+  v3f above_max = { hall_width * 0.5f + 4.0f, 4.0f, hall_depth * 0.25f + 4.0f };
+  v3f behind_min = { hall_width * 0.5f + 2.0f, 50.0f, hall_depth * 0.25f + 2.0f };
+  v3f behind_max = { hall_width * 0.5f + 4.0f, 52.0f, hall_depth * 0.25f + 4.0f };
+  check(occlusion_test_box(&g_buffer, under_min, under_max) == OcclusionResult_Occluded, "occluders under", 0, 0.0);
+  check(occlusion_test_box(&g_buffer, above_min, above_max) == OcclusionResult_Visible, "occluders above", 0, 0.0);
+  check(occlusion_test_box(&g_buffer, behind_min, behind_max) == OcclusionResult_Outside, "occluders behind", 0, 0.0);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 thread_count = (argc > 1) ? (u32)atoi(argv[1]) : os_processor_count();
+  u32 frame_count  = (argc > 2) ? (u32)atoi(argv[2]) : 240;
+  frame_count = Maximum(frame_count, 1);
+
+  // the calling thread joins in, so the queue gets one fewer
+  OS_Work_Queue *queue = (thread_count > 1) ? os_work_queue_create(thread_count - 1) : 0;
+
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+
+  occlusion_buffer_alloc(&g_buffer);
+  occlusion_buffer_alloc(&g_serial_buffer);
+  f64 gather_start = check_seconds();
+  occlusion_gather_occluders(&g_buffer, &g_scene);
+  f64 gather_ms = (check_seconds() - gather_start) * 1000.0;
+  occlusion_gather_occluders(&g_serial_buffer, &g_scene);
+  check_occluders();
+
+  Scene_Mesh meshes[SceneModel_Count];
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    meshes[model] = scene_mesh_for_model(model);
+  }
+  u32 triangle_count             = bvh_scene_triangle_count(&g_scene, meshes);
+  Bvh_Source_Triangle *triangles = (Bvh_Source_Triangle *)os_memory_alloc((u64)triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, meshes, triangles);
+  Bvh bvh;
+  bvh_build(&bvh, triangles, triangle_count, queue);
+
+  f32  tan_half_fov_x = tanf(Radians(Scene_CameraFovDegrees) * 0.5f);
+  f32  tan_half_fov_y = tan_half_fov_x * (Bench_ViewHeight / Bench_ViewWidth);
+  f64 *render_ms      = malloc(frame_count * sizeof(f64));
+  f64 *cull_ms        = malloc(frame_count * sizeof(f64));
+  u64  triangle_sum   = 0;
+  u64  ray_hits       = 0;
+  u32  random         = 0x0CC1;
+  g_buffer.tested_count   = 0;
+  g_buffer.outside_count  = 0;
+  g_buffer.occluded_count = 0;
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    Bench_Camera camera = bench_path_camera((f32)frame_idx / (f32)frame_count);
+    bench_set_camera(&g_buffer, &camera);
+
+    f64 begin = check_seconds();
+    occlusion_render(&g_buffer, queue);
+    f64 rendered = check_seconds();
+    occlusion_cull_scene(&g_buffer, &g_scene, &g_culled);
+    f64 culled = check_seconds();
+    render_ms[frame_idx] = (rendered - begin) * 1000.0;
+    cull_ms[frame_idx]   = (culled - rendered) * 1000.0;
+    triangle_sum        += g_buffer.triangle_count;
+    check(g_buffer.dropped_count == 0, "triangles dropped", frame_idx, (f64)g_buffer.dropped_count);
+
+    if ((frame_idx % 8) == 0)
+    {
+      bench_set_camera(&g_serial_buffer, &camera);
+      occlusion_render(&g_serial_buffer, 0);
+      check(!memcmp(g_buffer.depth, g_serial_buffer.depth, Occlusion_Width * Occlusion_Height * sizeof(f32)) &&
+            !memcmp(g_buffer.hiz, g_serial_buffer.hiz, sizeof(g_buffer.hiz)), "threads", frame_idx, 0.0);
+    }
+
+    for (u32 instance_idx = 0; instance_idx < g_scene.static_instance_count; ++instance_idx)
+    {
+      g_results[instance_idx] = OcclusionResult_Visible;
+    }
+    for (u32 batch_idx = 0; batch_idx < g_scene.batch_count; ++batch_idx)
+    {
+      Scene_Batch *batch  = g_scene.batches + batch_idx;
+      v3f          extent = scene_model_half_extent(batch->model);
+      for (u32 instance_idx = batch->first_instance; instance_idx < batch->first_instance + batch->instance_count; ++instance_idx)
+      {
+        Model_Instance *instance = g_scene.ins + instance_idx;
+        v3f half;
+        for (u32 axis = 0; axis < 3; ++axis)
+        {
+          v3f row = instance->model_to_world_xform.r[axis];
+          half.v[axis] = fabsf(row.x) * extent.x + fabsf(row.y) * extent.y + fabsf(row.z) * extent.z;
+        }
+        g_results[instance_idx] = occlusion_test_box(&g_buffer, v3f_sub(instance->p, half), v3f_add(instance->p, half));
+      }
+    }
+
+    for (u32 ray_idx = 0; ray_idx < Bench_RaysPerFrame; ++ray_idx)
+    {
+      f32 u   = (2.0f * check_random(&random) - 1.0f) * tan_half_fov_x;
+      f32 v   = (2.0f * check_random(&random) - 1.0f) * tan_half_fov_y;
+      v3f dir = v3f_add(camera.front, v3f_add(v3f_scale(u, camera.right), v3f_scale(v, camera.up)));
+      Bvh_Hit hit = { 0 };
+      if (bvh_intersect(&bvh, camera.eye, dir, Scene_CameraNear, Scene_CameraFar, &hit))
+      {
+        ++ray_hits;
+        check(g_results[hit.instance_idx] == OcclusionResult_Visible, "rays", hit.instance_idx, (f64)frame_idx);
+      }
+    }
+  }
+
+  qsort(render_ms, frame_count, sizeof(f64), bench_compare_f64);
+  qsort(cull_ms, frame_count, sizeof(f64), bench_compare_f64);
+  f64 render_mean = 0.0;
+  f64 cull_mean   = 0.0;
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    render_mean += render_ms[frame_idx] / (f64)frame_count;
+    cull_mean   += cull_ms[frame_idx] / (f64)frame_count;
+  }
+
+  f64 tested = (f64)g_buffer.tested_count;
+  printf("%u occluders from %u static instances (%.2f ms), %ux%u depth in %ux%u tiles, %u threads, %u frames\n",
+         g_buffer.occluder_count, g_scene.static_instance_count, gather_ms, Occlusion_Width, Occlusion_Height,
+         Occlusion_TileWidth, Occlusion_TileHeight, thread_count, frame_count);
+  printf("render: median %.3f ms, mean %.3f ms, max %.3f ms, %.0f triangles per frame\n",
+         render_ms[frame_count / 2], render_mean, render_ms[frame_count - 1], (f64)triangle_sum / (f64)frame_count);
+  printf("cull:   median %.3f ms, mean %.3f ms, max %.3f ms\n", cull_ms[frame_count / 2], cull_mean, cull_ms[frame_count - 1]);
+  printf("%.1f instances per frame: %.1f off screen (%.1f%%), %.1f occluded (%.1f%%), %llu camera rays hit\n",
+         tested / (f64)frame_count, (f64)g_buffer.outside_count / (f64)frame_count, 100.0 * (f64)g_buffer.outside_count / tested,
+         (f64)g_buffer.occluded_count / (f64)frame_count, 100.0 * (f64)g_buffer.occluded_count / tested, (unsigned long long)ray_hits);
+  return(check_report());
+}
@@ -0,0 +1,416 @@
+// Packs everything under data/ into one asset pack (see asset_pack.h), and
+// measures startup I/O of the pack against the loose files it replaces.
+//
+// usage: pack_data <data_dir> <out.pak>
+//        pack_data bench <data_dir> <in.pak>
+//
+// data/virtual is left out: .vtex files stream tiles with positional reads
+// and are baked separately by vtex_bake. A png is left out when a .tex of
+// the same name sits next to it (normal_bake, cone_bake), since the engine
+// prefers the baked one.
+//
+// The bench reads every packed file once through fopen/fread from the loose
+// tree, and once by touching every page of the mapped pack. On Linux the
+// cold run drops both from the page cache first (posix_fadvise DONTNEED);
+// elsewhere the first run is only as cold as the OS cache happens to be.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <dirent.h>
+# include <sys/resource.h>
+#endif
+
+#include "../base.h"
+#include "../os/os.h"
+#include "../asset_pack.h"
+
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../asset_pack.c"
+
+#define Pack_MaxFiles 4096
+#define Pack_MaxPath  512
+
+typedef struct
+{
+  char path[Pack_MaxPath];
+  u32  relative_offset;
+  u64  size;
+} Pack_File;
+
+static Pack_File g_files[Pack_MaxFiles];
+static u32       g_file_count;
+
+static f64
+pack_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+static void
+pack_add_file(char *path, u32 relative_offset)
+{
+  if (g_file_count == Pack_MaxFiles)
+  {
+    fprintf(stderr, "pack_data: more than %d files, skipping %s\n", Pack_MaxFiles, path);
+    return;
+  }
+
+  Pack_File *file = g_files + g_file_count++;
+  snprintf(file->path, sizeof(file->path), "%s", path);
+  file->relative_offset = relative_offset;
+}
+
+static b32
+pack_is_superseded(char *path)
+{
+  b32 result = false;
+  u64 length = strlen(path);
+  if ((length >= 4) && (strcmp(path + length - 4, ".png") == 0))
+  {
+    char baked[Pack_MaxPath];
+    snprintf(baked, sizeof(baked), "%.*s.tex", (int)(length - 4), path);
+    OS_File file = os_file_open(baked);
+    result = file.valid;
+    os_file_close(file);
+  }
+
+  return(result);
+}
+
+// Collects files depth first; relative_offset is where the path below data/ starts.
+static void
+pack_walk(char *dir, u32 relative_offset)
+{
+  char path[Pack_MaxPath];
+#if defined(_WIN32)
+  snprintf(path, sizeof(path), "%s/*", dir);
+  WIN32_FIND_DATAA find_data;
+  HANDLE find = FindFirstFileA(path, &find_data);
+  if (find == INVALID_HANDLE_VALUE)
+  {
+    return;
+  }
+
+  do
+  {
+    char *name = find_data.cFileName;
+    b32 is_dir = !!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+  DIR *find = opendir(dir);
+  if (!find)
+  {
+    return;
+  }
+
+  for (struct dirent *dirent = readdir(find); dirent; dirent = readdir(find))
+  {
+    char *name = dirent->d_name;
+    b32 is_dir = (dirent->d_type == DT_DIR);
+#endif
+    if (name[0] == '.')
+    {
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (is_dir)
+    {
+      if (strcmp(path + relative_offset, "virtual") != 0)
+      {
+        pack_walk(path, relative_offset);
+      }
+    }
+    else if (!pack_is_superseded(path))
+    {
+      pack_add_file(path, relative_offset);
+    }
+#if defined(_WIN32)
+  } while (FindNextFileA(find, &find_data));
+  FindClose(find);
+#else
+  }
+  closedir(find);
+#endif
+}
+
+static b32
+pack_read_file(char *path, u8 *dest, u64 size)
+{
+  FILE *in = fopen(path, "rb");
+  b32 result = in && (fread(dest, 1, size, in) == size);
+  if (in)
+  {
+    fclose(in);
+  }
+
+  return(result);
+}
+
+static u64
+pack_file_size(char *path)
+{
+  OS_File file = os_file_open(path);
+  u64 result   = os_file_size(file);
+  os_file_close(file);
+  return(result);
+}
+
+static s32
+pack(char *data_dir, char *out_path)
+{
+  pack_walk(data_dir, (u32)strlen(data_dir) + 1);
+
+  u32 slot_count = 16;
+  while (slot_count < 2 * g_file_count)
+  {
+    slot_count *= 2;
+  }
+
+  Asset_Pack_Header header =
+  {
+    .magic          = AssetPack_Magic,
+    .version        = AssetPack_Version,
+    .entry_count    = g_file_count,
+    .slot_count     = slot_count,
+    .entries_offset = sizeof(Asset_Pack_Header) + slot_count * sizeof(Asset_Pack_Slot),
+  };
+  header.paths_offset = header.entries_offset + g_file_count * sizeof(Asset_Pack_Entry);
+
+  Asset_Pack_Slot  *slots   = calloc(slot_count, sizeof(Asset_Pack_Slot));
+  Asset_Pack_Entry *entries = calloc(g_file_count + 1, sizeof(Asset_Pack_Entry));
+
+  u64 paths_size = 0;
+  for (u32 file_idx = 0; file_idx < g_file_count; ++file_idx)
+  {
+    paths_size += strlen(g_files[file_idx].path + g_files[file_idx].relative_offset);
+  }
+
+  u64 payload_offset = AlignAToB(header.paths_offset + paths_size, (u64)AssetPack_PayloadAlign);
+  u32 path_offset    = 0;
+  for (u32 file_idx = 0; file_idx < g_file_count; ++file_idx)
+  {
+    Pack_File *file         = g_files + file_idx;
+    char *relative          = file->path + file->relative_offset;
+    u32 length              = (u32)strlen(relative);
+    file->size              = pack_file_size(file->path);
+
+    Asset_Pack_Entry *entry = entries + file_idx;
+    entry->path_hash        = asset_pack_hash_path(relative, length);
+    entry->offset           = payload_offset;
+    entry->size             = file->size;
+    entry->path_offset      = path_offset;
+    entry->path_length      = length;
+    path_offset            += length;
+    payload_offset          = AlignAToB(payload_offset + file->size, (u64)AssetPack_PayloadAlign);
+
+    u32 slot_idx = (u32)entry->path_hash & (slot_count - 1);
+    while (slots[slot_idx].entry_idx_plus_one)
+    {
+      slot_idx = (slot_idx + 1) & (slot_count - 1);
+    }
+    slots[slot_idx].path_hash           = entry->path_hash;
+    slots[slot_idx].entry_idx_plus_one  = file_idx + 1;
+  }
+
+  FILE *out = fopen(out_path, "wb");
+  if (!out)
+  {
+    fprintf(stderr, "pack_data: cannot write %s\n", out_path);
+    return(1);
+  }
+
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(slots, sizeof(Asset_Pack_Slot), slot_count, out);
+  fwrite(entries, sizeof(Asset_Pack_Entry), g_file_count, out);
+  for (u32 file_idx = 0; file_idx < g_file_count; ++file_idx)
+  {
+    fputs(g_files[file_idx].path + g_files[file_idx].relative_offset, out);
+  }
+
+  u64 total_bytes = 0;
+  for (u32 file_idx = 0; file_idx < g_file_count; ++file_idx)
+  {
+    Pack_File *file = g_files + file_idx;
+    u8 *contents    = malloc(file->size ? file->size : 1);
+    if (!pack_read_file(file->path, contents, file->size))
+    {
+      fprintf(stderr, "pack_data: cannot read %s\n", file->path);
+      fclose(out);
+      return(1);
+    }
+
+    fseek(out, (long)entries[file_idx].offset, SEEK_SET);
+    fwrite(contents, 1, file->size, out);
+    total_bytes += file->size;
+    free(contents);
+  }
+
+  // pad the tail so the last payload ends on an alignment boundary too
+  fseek(out, (long)(payload_offset - 1), SEEK_SET);
+  fputc(0, out);
+  fclose(out);
+
+  printf("%s: %u files, %.1f MB payload, %.1f MB pack\n", out_path, g_file_count,
+         (f64)total_bytes / (f64)MB(1), (f64)payload_offset / (f64)MB(1));
+
+  free(slots);
+  free(entries);
+  return(0);
+}
+
+static void
+bench_drop_cache(char *path)
+{
+#if defined(_WIN32)
+  (void)path;
+#else
+  OS_File file = os_file_open(path);
+  if (file.valid)
+  {
+    posix_fadvise((int)file.handle, 0, 0, POSIX_FADV_DONTNEED);
+  }
+  os_file_close(file);
+#endif
+}
+
+typedef struct
+{
+  f64 seconds;
+  u64 bytes;
+  s64 major_faults;
+  s64 minor_faults;
+} Bench_Result;
+
+static s64
+bench_faults(b32 major)
+{
+#if defined(_WIN32)
+  (void)major;
+  return(0);
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return(major ? usage.ru_majflt : usage.ru_minflt);
+#endif
+}
+
+static Bench_Result
+bench_loose(void)
+{
+  Bench_Result result = { 0 };
+  s64 major = bench_faults(true);
+  s64 minor = bench_faults(false);
+  f64 start = pack_seconds();
+  for (u32 file_idx = 0; file_idx < g_file_count; ++file_idx)
+  {
+    Pack_File *file = g_files + file_idx;
+    file->size      = pack_file_size(file->path);
+    u8 *contents    = malloc(file->size ? file->size : 1);
+    pack_read_file(file->path, contents, file->size);
+    result.bytes   += file->size;
+    free(contents);
+  }
+
+  result.seconds      = pack_seconds() - start;
+  result.major_faults = bench_faults(true) - major;
+  result.minor_faults = bench_faults(false) - minor;
+  return(result);
+}
+
+// What the engine does: map, look every file up by path, touch its pages.
+static Bench_Result
+bench_pack(char *pack_path)
+{
+  Bench_Result result = { 0 };
+  s64 major = bench_faults(true);
+  s64 minor = bench_faults(false);
+  f64 start = pack_seconds();
+
+  Asset_Pack asset_pack;
+  if (asset_pack_open(&asset_pack, pack_path))
+  {
+    u64 checksum = 0;
+    for (u32 file_idx = 0; file_idx < g_file_count; ++file_idx)
+    {
+      Pack_File *file = g_files + file_idx;
+      Asset_Blob blob = asset_pack_find(&asset_pack, file->path + file->relative_offset);
+      for (u64 offset = 0; offset < blob.size; offset += 4096)
+      {
+        checksum += blob.data[offset];
+      }
+      result.bytes += blob.size;
+    }
+
+    // keeps the page touches from being optimised out
+    if (checksum == 1)
+    {
+      printf(" ");
+    }
+    asset_pack_close(&asset_pack);
+  }
+
+  result.seconds      = pack_seconds() - start;
+  result.major_faults = bench_faults(true) - major;
+  result.minor_faults = bench_faults(false) - minor;
+  return(result);
+}
+
+static void
+bench_print(char *label, Bench_Result result)
+{
+  printf("%-12s %8.2f ms %8.1f MB %9.1f MB/s  faults major %lld minor %lld\n", label, result.seconds * 1000.0,
+         (f64)result.bytes / (f64)MB(1), ((f64)result.bytes / (f64)MB(1)) / Maximum(result.seconds, 1e-9),
+         (long long)result.major_faults, (long long)result.minor_faults);
+}
+
+static s32
+bench(char *data_dir, char *pack_path)
+{
+  pack_walk(data_dir, (u32)strlen(data_dir) + 1);
+
+  for (u32 file_idx = 0; file_idx < g_file_count; ++file_idx)
+  {
+    bench_drop_cache(g_files[file_idx].path);
+  }
+  bench_print("loose cold", bench_loose());
+  bench_print("loose warm", bench_loose());
+
+  bench_drop_cache(pack_path);
+  bench_print("pack cold", bench_pack(pack_path));
+  bench_print("pack warm", bench_pack(pack_path));
+  return(0);
+}
+
+int
+main(int argc, char **argv)
+{
+  s32 result = 1;
+  if ((argc == 4) && (strcmp(argv[1], "bench") == 0))
+  {
+    result = bench(argv[2], argv[3]);
+  }
+  else if (argc == 3)
+  {
+    result = pack(argv[1], argv[2]);
+  }
+  else
+  {
+    fprintf(stderr, "usage: pack_data <data_dir> <out.pak>\n"
+                    "       pack_data bench <data_dir> <in.pak>\n");
+  }
+
+  return(result);
+}
@@ -0,0 +1,310 @@
+// Runs made up zones through the profiler (profile.c) on this thread and a
+// work queue, then checks what the rings, the summary and the trace hold.
+// Exits non-zero if a check fails.
+//
+// usage: profile_check [thread_count]
+//
+//   nesting   zones close innermost first, with their depth, inside the
+//             zones around them
+//   threads   every zone lands in the ring of the thread that ran it
+//   summary   zones are totalled into the frame they began in, with calls
+//             per frame and percentiles in order; zones before the first
+//             frame are counted as loading, those in the open one not at all
+//   trace     the trace holds a complete event per zone kept, an instant
+//             per frame and nothing unbalanced
+//   wrap      a ring that wraps keeps its newest zones, and the summary
+//             drops the frames it no longer covers whole
+
+#define ENGINE_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../os/os.h"
+#include "../profile.h"
+
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../profile.c"
+#include "check.h"
+
+#define Check_TraceFile    "profile_check.json"
+#define Check_JobCount     64
+#define Check_FrameCount   50
+#define Check_WrapFrames   8
+// so the ring wraps half way through the wrap frames
+#define Check_WrapPerFrame (Profile_RingEvents / 4 + 1)
+
+static void
+check_spin(f32 seconds)
+{
+  u64 begin = os_time_now();
+  while (os_seconds_between(begin, os_time_now()) < seconds)
+  {
+  }
+}
+
+static Profile_Zone_Stats *
+check_find_zone(Profile_Summary *summary, char *name)
+{
+  Profile_Zone_Stats *result = 0;
+  for (u32 zone_idx = 0; zone_idx < summary->zone_count; ++zone_idx)
+  {
+    if (!strcmp(summary->zones[zone_idx].name, name))
+    {
+      result = summary->zones + zone_idx;
+    }
+  }
+
+  return(result);
+}
+
+static void
+check_nesting(void)
+{
+  ProfileBegin("outer");
+  for (u32 inner_idx = 0; inner_idx < 3; ++inner_idx)
+  {
+    ProfileBegin("inner");
+    check_spin(0.0001f);
+    ProfileEnd("inner");
+  }
+  ProfileEnd("outer");
+
+  Profile_Thread *thread = g_profile.threads[0];
+  check(thread == g_profile_thread, "nesting thread", 0, (f64)g_profile.thread_count);
+  check((thread->event_count == 4) && (thread->depth == 0), "nesting count", 0, (f64)thread->event_count);
+
+  Profile_Event *outer = thread->events + 3;
+  check(!strcmp(outer->name, "outer") && (outer->depth == 0), "nesting outer", 3, (f64)outer->depth);
+  for (u32 inner_idx = 0; inner_idx < 3; ++inner_idx)
+  {
+    Profile_Event *inner = thread->events + inner_idx;
+    check(!strcmp(inner->name, "inner") && (inner->depth == 1), "nesting inner", inner_idx, (f64)inner->depth);
+    check((inner->begin >= outer->begin) && (inner->end <= outer->end) && (inner->begin < inner->end), "nesting inside", inner_idx, 0.0);
+    check(!inner_idx || (inner->begin >= thread->events[inner_idx - 1].end), "nesting order", inner_idx, 0.0);
+  }
+
+  char copy[] = "outer";
+  check(profile_names_match(outer->name, copy) && !profile_names_match(outer->name, "inner") &&
+        !profile_names_match(outer->name, "out"), "nesting names", 0, 0.0);
+}
+
+typedef struct
+{
+  u32 thread_index;
+} Check_Job;
+
+static void
+check_job(void *data)
+{
+  Check_Job *job = (Check_Job *)data;
+  ProfileBegin("job");
+  ProfileBegin("job_inner");
+  // long enough that the workers get a share of the jobs
+  os_sleep_seconds(0.001f);
+  ProfileEnd("job_inner");
+  ProfileEnd("job");
+  job->thread_index = g_profile_thread->index;
+}
+
+static void
+check_threads(u32 thread_count)
+{
+  static Check_Job jobs[Check_JobCount];
+  OS_Work_Queue   *queue = os_work_queue_create(thread_count);
+  for (u32 job_idx = 0; job_idx < Check_JobCount; ++job_idx)
+  {
+    os_work_queue_add(queue, check_job, jobs + job_idx);
+  }
+  os_work_queue_complete_all(queue);
+
+  u32 threads_used = 0;
+  u32 job_events   = 0;
+  for (u32 thread_idx = 0; thread_idx < g_profile.thread_count; ++thread_idx)
+  {
+    Profile_Thread *thread = g_profile.threads[thread_idx];
+    check(thread && (thread->index == thread_idx) && (thread->depth == 0), "threads ring", thread_idx, 0.0);
+
+    u32 expected = 0;
+    for (u32 job_idx = 0; job_idx < Check_JobCount; ++job_idx)
+    {
+      expected += (jobs[job_idx].thread_index == thread_idx);
+    }
+
+    u32 jobs_here = 0, inners_here = 0;
+    for (u64 event_idx = 0; thread && (event_idx < thread->event_count); ++event_idx)
+    {
+      Profile_Event *event = thread->events + event_idx;
+      if (!strcmp(event->name, "job"))
+      {
+        ++jobs_here;
+        Profile_Event *inner = event - 1;
+        check(!strcmp(inner->name, "job_inner") && (inner->depth == event->depth + 1) &&
+              (inner->begin >= event->begin) && (inner->end <= event->end), "threads nesting", thread_idx, (f64)event_idx);
+      }
+      inners_here += !strcmp(event->name, "job_inner");
+    }
+
+    check((jobs_here == expected) && (inners_here == expected), "threads jobs", thread_idx, (f64)jobs_here);
+    threads_used += (jobs_here > 0);
+    job_events   += jobs_here;
+  }
+
+  check(job_events == Check_JobCount, "threads total", 0, (f64)job_events);
+  printf("threads: %u jobs ran on %u of %u threads\n", Check_JobCount, threads_used, g_profile.thread_count);
+}
+
+static void
+check_summary(void)
+{
+  for (u32 frame_idx = 0; frame_idx < Check_FrameCount; ++frame_idx)
+  {
+    ProfileFrameBegin();
+    ProfileBegin("work");
+    check_spin(0.00002f * (f32)(frame_idx % 10 + 1));
+    ProfileEnd("work");
+    if ((frame_idx % 4) == 0)
+    {
+      ProfileBegin("sometimes");
+      check_spin(0.00005f);
+      ProfileEnd("sometimes");
+    }
+  }
+
+  // ends the last frame; what runs in this one stays out of the summary
+  ProfileFrameBegin();
+  ProfileBegin("open");
+  ProfileEnd("open");
+
+  Profile_Summary summary;
+  profile_summarise(&summary);
+  check(summary.frame_count == Check_FrameCount, "summary frames", 0, (f64)summary.frame_count);
+
+  Profile_Zone_Stats *work      = check_find_zone(&summary, "work");
+  Profile_Zone_Stats *sometimes = check_find_zone(&summary, "sometimes");
+  Profile_Zone_Stats *outer     = check_find_zone(&summary, "outer");
+  Profile_Zone_Stats *job       = check_find_zone(&summary, "job");
+  check(work && sometimes && outer && job, "summary zones", summary.zone_count, 0.0);
+  check(!check_find_zone(&summary, "open"), "summary open", 0, 0.0);
+  if (work && sometimes && outer && job)
+  {
+    check(work->calls_per_frame == 1.0f, "summary calls", 0, (f64)work->calls_per_frame);
+    check(fabsf(sometimes->calls_per_frame - 13.0f / Check_FrameCount) < 1e-6f, "summary calls", 1, (f64)sometimes->calls_per_frame);
+    check((work->p50_ms <= work->p90_ms) && (work->p90_ms <= work->p99_ms) && (work->p99_ms <= work->max_ms), "summary order", 0, (f64)work->p50_ms);
+    // 20 to 200 us spins, generous either way for a busy machine
+    check((work->max_ms >= 0.19f) && (work->p50_ms >= 0.09f) && (work->p50_ms < 50.0f), "summary work", 0, (f64)work->p50_ms);
+    check((sometimes->p50_ms == 0.0f) && (sometimes->max_ms >= 0.045f), "summary sometimes", 0, (f64)sometimes->max_ms);
+    check(summary.frame.p50_ms >= work->p50_ms, "summary frame", 0, (f64)summary.frame.p50_ms);
+    check((outer->load_calls == 1) && (outer->calls_per_frame == 0.0f) && (outer->load_ms >= 0.25f), "summary load", 0, (f64)outer->load_ms);
+    check(job->load_calls == Check_JobCount, "summary load", 1, (f64)job->load_calls);
+    check((summary.zones[0].p50_ms >= summary.zones[summary.zone_count - 1].p50_ms), "summary sorted", 0, 0.0);
+  }
+
+  char text[4096];
+  u32  length = profile_summary_text(&summary, text, sizeof(text));
+  check((length == strlen(text)) && strstr(text, "work") && strstr(text, "before the first frame"), "summary text", 0, (f64)length);
+  fputs(text, stdout);
+
+  char small[16];
+  check(profile_summary_text(&summary, small, sizeof(small)) == sizeof(small) - 1, "summary short", 0, 0.0);
+}
+
+static u32
+check_count(char *text, u64 size, char *pattern)
+{
+  u32 result         = 0;
+  u64 pattern_length = strlen(pattern);
+  for (u64 at = 0; at + pattern_length <= size; ++at)
+  {
+    result += !memcmp(text + at, pattern, pattern_length);
+  }
+
+  return(result);
+}
+
+static void
+check_trace(void)
+{
+  u64 event_count = 0;
+  for (u32 thread_idx = 0; thread_idx < g_profile.thread_count; ++thread_idx)
+  {
+    event_count += g_profile.threads[thread_idx]->event_count;
+  }
+
+  check(profile_write_trace(Check_TraceFile), "trace write", 0, 0.0);
+  OS_File_Map map  = os_file_map(Check_TraceFile);
+  char       *text = (char *)map.data;
+  check(map.size > 64, "trace size", 0, (f64)map.size);
+  if (map.size > 64)
+  {
+    check(!memcmp(text, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39) && !memcmp(text + map.size - 4, "\n]}\n", 4), "trace shape", 0, 0.0);
+    check(check_count(text, map.size, "\"ph\":\"X\"") == event_count, "trace zones", 0, (f64)event_count);
+    check(check_count(text, map.size, "\"ph\":\"i\"") == Check_FrameCount + 1, "trace frames", 0, 0.0);
+    check(check_count(text, map.size, "\"ph\":\"M\"") == g_profile.thread_count, "trace threads", 0, 0.0);
+    check(check_count(text, map.size, "{") == check_count(text, map.size, "}"), "trace braces", 0, 0.0);
+    check(check_count(text, map.size, "\"name\":\"job_inner\"") == Check_JobCount, "trace names", 0, 0.0);
+  }
+  os_file_unmap(&map);
+  os_file_delete(Check_TraceFile);
+}
+
+static void
+check_wrap(void)
+{
+  Profile_Thread *thread      = g_profile_thread;
+  u64             frame_first = g_profile.frame_count;
+  for (u32 frame_idx = 0; frame_idx < Check_WrapFrames; ++frame_idx)
+  {
+    ProfileFrameBegin();
+    for (u32 zone_idx = 0; zone_idx < Check_WrapPerFrame; ++zone_idx)
+    {
+      ProfileBegin("wrap");
+      ProfileEnd("wrap");
+    }
+  }
+
+  check(thread->event_count > Profile_RingEvents, "wrap count", 0, (f64)thread->event_count);
+  u64            newest_idx = (thread->event_count - 1) & (Profile_RingEvents - 1);
+  Profile_Event *newest     = thread->events + newest_idx;
+  Profile_Event *oldest     = thread->events + (thread->event_count & (Profile_RingEvents - 1));
+  check(!strcmp(newest->name, "wrap") && !strcmp(oldest->name, "wrap") && (oldest->end <= newest->end), "wrap kept", 0, 0.0);
+
+  Profile_Summary summary;
+  profile_summarise(&summary);
+  Profile_Zone_Stats *wrap  = check_find_zone(&summary, "wrap");
+  Profile_Zone_Stats *outer = check_find_zone(&summary, "outer");
+  // whole frames only: the first ones lost zones, the work frames are gone
+  check((summary.frame_count >= 2) && (summary.frame_count < Check_WrapFrames - 1), "wrap frames", 0, (f64)summary.frame_count);
+  check(wrap && (wrap->calls_per_frame == (f32)Check_WrapPerFrame), "wrap calls", 0, wrap ? (f64)wrap->calls_per_frame : 0.0);
+  check(!check_find_zone(&summary, "work") && (!outer || !outer->load_calls), "wrap dropped", 0, 0.0);
+  check(profile_frame_begin_tsc(g_profile.frame_count - summary.frame_count) >= oldest->end, "wrap first frame", (u32)frame_first, 0.0);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 thread_count = (argc > 1) ? (u32)atoi(argv[1]) : 3;
+  thread_count = Maximum(thread_count, 1);
+
+  profile_init();
+  check_nesting();
+  check_threads(thread_count);
+  check_summary();
+  check_trace();
+  check_wrap();
+
+  return(check_report());
+}
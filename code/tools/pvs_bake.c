@@ -0,0 +1,127 @@
+// Bakes the potentially visible sets of the default scene (see pvs.h) into
+// one file the engine filters the shaded pass with. It also reports how many
+// cells drop enough to filter by; with none, the engine does not load it.
+//
+// usage: pvs_bake <out.pvs> [cell_size] [rays_per_pair] [thread_count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../pvs.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../pvs.c"
+
+#define Bake_DefaultRaysPerPair 64
+
+static Scene_Instances g_scene;
+
+static f64
+bake_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+int
+main(int argc, char **argv)
+{
+  if ((argc < 2) || (argc > 5))
+  {
+    fprintf(stderr, "usage: pvs_bake <out.pvs> [cell_size] [rays_per_pair] [thread_count]\n");
+    return(1);
+  }
+
+  f32 cell_size     = (argc >= 3) ? (f32)atof(argv[2]) : Pvs_CellSize;
+  u32 rays_per_pair = (argc >= 4) ? (u32)atoi(argv[3]) : Bake_DefaultRaysPerPair;
+  u32 thread_count  = (argc == 5) ? (u32)atoi(argv[4]) : Maximum(os_processor_count(), 2) - 1;
+  OS_Work_Queue *queue = thread_count ? os_work_queue_create(thread_count) : 0;
+
+  // the instance order has to match the engine's, probes or not
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+
+  Scene_Mesh meshes[SceneModel_Count];
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    meshes[model] = scene_mesh_for_model(model);
+  }
+
+  f64 start = bake_seconds();
+  u32 triangle_count             = bvh_scene_triangle_count(&g_scene, meshes);
+  Bvh_Source_Triangle *triangles = (Bvh_Source_Triangle *)os_memory_alloc((u64)triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, meshes, triangles);
+  Bvh bvh;
+  bvh_build(&bvh, triangles, triangle_count, queue);
+  f64 build_end = bake_seconds();
+
+  Pvs_Grid grid;
+  pvs_grid(&grid, bvh.bounds, Maximum(cell_size, 0.5f));
+
+  // packets of four
+  rays_per_pair = Minimum(Maximum(rays_per_pair, Bvh_PacketSize), Pvs_MaxRaysPerPair);
+  Pvs_Bake bake =
+  {
+    .scene         = &g_scene,
+    .bvh           = &bvh,
+    .triangles     = triangles,
+    .rays_per_pair = rays_per_pair & ~(Bvh_PacketSize - 1),
+  };
+
+  u64 *visible = (u64 *)os_memory_alloc((u64)grid.cell_count * Pvs_RowWords * sizeof(u64));
+  pvs_bake(&bake, &grid, visible, queue);
+  f64 bake_end = bake_seconds();
+
+  u64 visible_count = 0;
+  for (u32 cell_idx = 0; cell_idx < grid.cell_count; ++cell_idx)
+  {
+    for (u32 instance_idx = 0; instance_idx < g_scene.static_instance_count; ++instance_idx)
+    {
+      visible_count += (visible[(u64)cell_idx * Pvs_RowWords + instance_idx / 64] >> (instance_idx % 64)) & 1;
+    }
+  }
+
+  u64 max_size  = pvs_max_file_size(&grid, g_scene.static_instance_count);
+  u8 *file_data = os_memory_alloc(max_size);
+  u64 file_size = pvs_encode(file_data, &grid, g_scene.static_instance_count, visible);
+  if (!os_file_write_all(argv[1], file_data, file_size))
+  {
+    fprintf(stderr, "pvs_bake: cannot write %s\n", argv[1]);
+    return(1);
+  }
+
+  u64 raw_size = (u64)grid.cell_count * ((g_scene.static_instance_count + 7) / 8);
+  printf("%s: %ux%ux%u cells of %.2f, %.1f%% of %u instances visible on average, %.1f KB (%.1f KB unpacked), %u rays a pair; bvh %.1f ms, bake %.1f ms on %u threads\n",
+         argv[1], grid.cell_count_x, grid.cell_count_y, grid.cell_count_z, grid.cell_size,
+         100.0 * (f64)visible_count / ((f64)grid.cell_count * g_scene.static_instance_count), g_scene.static_instance_count,
+         (f64)file_size / 1024.0, (f64)raw_size / 1024.0, bake.rays_per_pair, (build_end - start) * 1000.0, (bake_end - build_end) * 1000.0,
+         thread_count);
+  printf("%s: %u of %u cells drop enough to filter by%s\n", argv[1], ((Pvs_Header *)file_data)->paying_cell_count, grid.cell_count,
+         ((Pvs_Header *)file_data)->paying_cell_count ? "" : ", so the renderers will not load it");
+  return(0);
+}
@@ -0,0 +1,484 @@
+// Checks the potentially visible set baker (pvs.c) on small scenes whose
+// answers are known. Exits non-zero if a check fails.
+//
+// usage: pvs_check [thread_count]
+//
+//   grid          cells cover the bounds within the caps, and a point finds
+//                 the cell it is in
+//   rows          run length coding round trips rows of every density and
+//                 rejects cut short and overlong ones
+//   wall          a wall to the ceiling hides each side's marker from the
+//                 other, so its cells pay to filter by; one halfway up does
+//                 not hide them
+//   sampled       no ray from the open part of a cell hits an instance the
+//                 cell's set lacks, behind walls and over a scatter of
+//                 blocks; the sets are sampled with dilation, so this is a
+//                 test of the sampling, not a proof
+//   threads       a bake on a work queue is bit-identical to a serial one
+//   file          encode and parse round trip, the header counts the cells
+//                 that pay, the view unpacks the set of the cell it is in
+//                 and counts what it drops, and cut short or foreign files
+//                 are rejected
+//   cull          pvs_cull_scene keeps the set's static instances and every
+//                 dynamic one, batches and order intact
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../pvs.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../pvs.c"
+#include "check.h"
+
+#define Check_RaysPerPair 64
+
+static Scene_Instances g_scene;
+static Scene_Instances g_culled;
+static Scene_Mesh      g_meshes[SceneModel_Count];
+
+static b32
+check_bit(u64 *row, u32 index)
+{
+  b32 result = !!(row[index / 64] & (1ull << (index % 64)));
+  return(result);
+}
+
+static void
+check_add_block(v3f p, v3f scale)
+{
+  scene_add_instance(&g_scene, SceneModel_Cube, p, scale, m33_make_identity(), (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+}
+
+// a bake of g_scene as it stands
+typedef struct
+{
+  Pvs_Grid             grid;
+  Bvh                  bvh;
+  Bvh_Source_Triangle *triangles;
+  u32                  triangle_count;
+  Pvs_Bake             bake;
+  u64                 *visible;
+} Check_Bake;
+
+static void
+check_bake_begin(Check_Bake *check_bake, f32 cell_size)
+{
+  check_bake->triangle_count = bvh_scene_triangle_count(&g_scene, g_meshes);
+  check_bake->triangles      = (Bvh_Source_Triangle *)os_memory_alloc((u64)check_bake->triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, g_meshes, check_bake->triangles);
+  bvh_build(&check_bake->bvh, check_bake->triangles, check_bake->triangle_count, 0);
+  pvs_grid(&check_bake->grid, check_bake->bvh.bounds, cell_size);
+
+  check_bake->bake = (Pvs_Bake)
+  {
+    .scene         = &g_scene,
+    .bvh           = &check_bake->bvh,
+    .triangles     = check_bake->triangles,
+    .rays_per_pair = Check_RaysPerPair,
+  };
+  check_bake->visible = (u64 *)os_memory_alloc((u64)check_bake->grid.cell_count * Pvs_RowWords * sizeof(u64));
+}
+
+static void
+check_bake_end(Check_Bake *check_bake)
+{
+  os_memory_free(check_bake->visible, (u64)check_bake->grid.cell_count * Pvs_RowWords * sizeof(u64));
+  bvh_free(&check_bake->bvh);
+  os_memory_free(check_bake->triangles, (u64)check_bake->triangle_count * sizeof(Bvh_Source_Triangle));
+}
+
+static u64 *
+check_row_at(Check_Bake *check_bake, v3f p)
+{
+  u32 cell = pvs_cell_at(&check_bake->grid, p);
+  u64 *result = (cell == Pvs_NoCell) ? 0 : check_bake->visible + (u64)cell * Pvs_RowWords;
+  return(result);
+}
+
+static void
+check_grid(void)
+{
+  Bvh_Box boxes[] =
+  {
+    { { 0.0f, 0.0f, 0.0f }, { 10.0f, 3.0f, 7.0f } },
+    { { -1.0f, -1.0f, -1.0f }, { 79.0f, 29.0f, 79.0f } },
+    { { -500.0f, -500.0f, -500.0f }, { 500.0f, 500.0f, 500.0f } },
+    { { 5.0f, 5.0f, 5.0f }, { 5.0f, 5.0f, 5.0f } },
+  };
+
+  u32 random = 0x9D;
+  for (u32 box_idx = 0; box_idx < ArrayCount(boxes); ++box_idx)
+  {
+    Pvs_Grid grid;
+    pvs_grid(&grid, boxes[box_idx], Pvs_CellSize);
+    u32 counts[3] = { grid.cell_count_x, grid.cell_count_y, grid.cell_count_z };
+    check(grid.cell_size >= Pvs_CellSize, "grid", box_idx * 10, grid.cell_size);
+    check((grid.cell_count == counts[0] * counts[1] * counts[2]) && (grid.cell_count <= Pvs_MaxCells), "grid", box_idx * 10 + 1, (f32)grid.cell_count);
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      f32 last = grid.origin.v[axis] + grid.cell_size * (f32)counts[axis];
+      check((counts[axis] >= 1) && (counts[axis] <= Pvs_MaxCellsAxis), "grid", box_idx * 10 + 2 + axis, (f32)counts[axis]);
+      check((grid.origin.v[axis] <= boxes[box_idx].min.v[axis]) && (last >= boxes[box_idx].max.v[axis]), "grid", box_idx * 10 + 5 + axis, grid.origin.v[axis]);
+    }
+
+    for (u32 point_idx = 0; point_idx < 1000; ++point_idx)
+    {
+      v3f unit = { check_random(&random), check_random(&random), check_random(&random) };
+      u32 cell[3];
+      v3f p = v3f_zero();
+      for (u32 axis = 0; axis < 3; ++axis)
+      {
+        cell[axis] = Minimum((u32)(unit.v[axis] * (f32)counts[axis]), counts[axis] - 1);
+        p.v[axis]  = grid.origin.v[axis] + grid.cell_size * ((f32)cell[axis] + 0.5f);
+      }
+      u32 expected = (cell[2] * counts[1] + cell[1]) * counts[0] + cell[0];
+      check(pvs_cell_at(&grid, p) == expected, "grid", box_idx * 10 + 8, (f32)point_idx);
+    }
+
+    v3f outside = v3f_sub(grid.origin, v3f_s(0.5f));
+    check(pvs_cell_at(&grid, outside) == Pvs_NoCell, "grid", box_idx * 10 + 9, 0.0f);
+    outside = v3f_add(grid.origin, v3f_scale(grid.cell_size, (v3f){ (f32)counts[0] + 0.5f, 0.5f, 0.5f }));
+    check(pvs_cell_at(&grid, outside) == Pvs_NoCell, "grid", box_idx * 10 + 9, 1.0f);
+  }
+}
+
+static void
+check_rows(void)
+{
+  u32 random = 0x80;
+  u32 instance_counts[] = { 1, 7, 8, 63, 64, 65, 1000, 2017, MaxSceneInstances };
+  f32 densities[]       = { 0.0f, 1.0f, 0.5f, 0.02f, 0.98f };
+  for (u32 count_idx = 0; count_idx < ArrayCount(instance_counts); ++count_idx)
+  {
+    u32 instance_count = instance_counts[count_idx];
+    u32 row_bytes      = (instance_count + 7) / 8;
+    for (u32 density_idx = 0; density_idx < ArrayCount(densities) + 1; ++density_idx)
+    {
+      u64 row[Pvs_RowWords] = { 0 };
+      for (u32 instance_idx = 0; instance_idx < instance_count; ++instance_idx)
+      {
+        // the last pattern is long runs of either, as a hall's rows are
+        b32 set = (density_idx < ArrayCount(densities)) ? (check_random(&random) < densities[density_idx]) : ((instance_idx / 300) & 1);
+        row[instance_idx / 64] |= (u64)set << (instance_idx % 64);
+      }
+
+      u8  packed[2 * MaxSceneInstances / 8];
+      u64 back[Pvs_RowWords];
+      u32 size  = pvs_compress_row(row, instance_count, packed);
+      u32 index = count_idx * 10 + density_idx;
+      check(size <= 2 * row_bytes, "rows", index, (f32)size);
+      check(pvs_decompress_row(packed, size, instance_count, back) && (memcmp(row, back, sizeof(row)) == 0), "rows", index, (f32)size);
+      if ((density_idx == 0) || (density_idx == 1))
+      {
+        // runs of 255 bytes, and a partial last byte
+        check(size <= 2 * ((row_bytes + 254) / 255) + 1, "rows", index, (f32)size);
+      }
+      check(!pvs_decompress_row(packed, size - 1, instance_count, back), "rows", index, (f32)size);
+      check(!pvs_decompress_row(packed, size, instance_count + 8, back), "rows", index, (f32)size);
+      if (instance_count > 8)
+      {
+        check(!pvs_decompress_row(packed, size, instance_count - 8, back), "rows", index, (f32)size);
+      }
+    }
+  }
+
+  u8  zero_run[] = { 0x00, 0 };
+  u64 back[Pvs_RowWords];
+  check(!pvs_decompress_row(zero_run, sizeof(zero_run), 8, back), "rows", 100, 0.0f);
+}
+
+// Rays from random open points of every cell; an instance one hits first
+// that the cell's set lacks is a miss. Returns how many of the rays missed.
+static u32
+check_sampled(Check_Bake *check_bake, u32 points_per_cell, u32 rays_per_point, u32 *ray_count)
+{
+  u32 random = 0xC0;
+  u32 misses = 0;
+  *ray_count = 0;
+  for (u32 cell_idx = 0; cell_idx < check_bake->grid.cell_count; ++cell_idx)
+  {
+    u32 cell[3];
+    v3f cell_min = pvs_cell_min(&check_bake->grid, cell_idx, cell);
+    u64 *row     = check_bake->visible + (u64)cell_idx * Pvs_RowWords;
+    for (u32 point_idx = 0; point_idx < points_per_cell; ++point_idx)
+    {
+      v3f unit = { check_random(&random), check_random(&random), check_random(&random) };
+      v3f p    = v3f_add(cell_min, v3f_scale(check_bake->grid.cell_size, unit));
+      Bvh_Hit hit;
+      v3f up = { 0.0f, 1.0f, 0.0f };
+      if (bvh_intersect(&check_bake->bvh, p, up, 0.0f, 1e30f, &hit) && pvs_is_back_face(&check_bake->bake, hit.source_idx, up))
+      {
+        continue;
+      }
+
+      for (u32 ray_idx = 0; ray_idx < rays_per_point; ++ray_idx)
+      {
+        v3f dir = check_random_direction(&random);
+        ++*ray_count;
+        if (bvh_intersect(&check_bake->bvh, p, dir, 0.0f, 1e30f, &hit) && !check_bit(row, hit.instance_idx))
+        {
+          ++misses;
+        }
+      }
+    }
+  }
+
+  return(misses);
+}
+
+static void
+check_walls(void)
+{
+  for (u32 wall_idx = 0; wall_idx < 2; ++wall_idx)
+  {
+    // a wall 2 thick across the middle, a marker either side of it above
+    // where the low wall stops
+    check_scene_begin(&g_scene);
+    if (wall_idx == 0)
+    {
+      check_add_block(v3f_zero(), (v3f){ 2.0f, 40.0f, 40.0f });
+    }
+    else
+    {
+      check_add_block((v3f){ 0.0f, -10.0f, 0.0f }, (v3f){ 2.0f, 20.0f, 40.0f });
+      check_add_block((v3f){ 0.0f, 19.5f, 0.0f }, (v3f){ 1.0f, 1.0f, 1.0f });
+    }
+    check_add_block((v3f){ -12.0f, 10.0f, 0.0f }, v3f_s(1.0f));
+    check_add_block((v3f){ 12.0f, 10.0f, 0.0f }, v3f_s(1.0f));
+    check_scene_end(&g_scene);
+    u32 left  = g_scene.instance_count - 2;
+    u32 right = g_scene.instance_count - 1;
+
+    Check_Bake wall;
+    check_bake_begin(&wall, Pvs_CellSize);
+    pvs_bake(&wall.bake, &wall.grid, wall.visible, 0);
+
+    u64 *left_row  = check_row_at(&wall, (v3f){ -12.0f, 10.0f, 0.0f });
+    u64 *right_row = check_row_at(&wall, (v3f){ 12.0f, 10.0f, 0.0f });
+    check(left_row && right_row && (left_row != right_row), "wall", wall_idx * 10, 0.0f);
+    if (left_row && right_row)
+    {
+      check(check_bit(left_row, 0) && check_bit(right_row, 0), "wall", wall_idx * 10 + 1, 0.0f);
+      check(check_bit(left_row, left) && check_bit(right_row, right), "wall", wall_idx * 10 + 2, 0.0f);
+      check(check_bit(left_row, right) == (wall_idx == 1), "wall", wall_idx * 10 + 3, 0.0f);
+      check(check_bit(right_row, left) == (wall_idx == 1), "wall", wall_idx * 10 + 4, 0.0f);
+    }
+
+    u32 ray_count;
+    u32 misses = check_sampled(&wall, 16, 64, &ray_count);
+    check(misses == 0, "sampled", wall_idx, (f32)misses);
+
+    // a wall to the ceiling hides a quarter of the scene from either side,
+    // which is enough to filter by
+    if (wall_idx == 0)
+    {
+      u32 instance_count = g_scene.static_instance_count;
+      u64 max_size       = pvs_max_file_size(&wall.grid, instance_count);
+      u8 *file_data      = os_memory_alloc(max_size);
+      Pvs_Header *header = pvs_parse(file_data, pvs_encode(file_data, &wall.grid, instance_count, wall.visible));
+      check(header && header->paying_cell_count, "wall", 5, header ? (f32)header->paying_cell_count : -1.0f);
+      os_memory_free(file_data, max_size);
+    }
+    check_bake_end(&wall);
+  }
+}
+
+static void
+check_scatter(u32 thread_count)
+{
+  // blocks of every size strewn over a floor, some stacked into walls
+  check_scene_begin(&g_scene);
+  check_add_block(v3f_zero(), (v3f){ 80.0f, 1.0f, 80.0f });
+  u32 random = 0x5CA;
+  for (u32 block_idx = 0; block_idx < 200; ++block_idx)
+  {
+    v3f p     = { 72.0f * check_random(&random) - 36.0f, 0.0f, 72.0f * check_random(&random) - 36.0f };
+    v3f scale = { 1.0f + 4.0f * check_random(&random), 1.0f + 12.0f * check_random(&random), 1.0f + 4.0f * check_random(&random) };
+    if (block_idx % 8 == 0)
+    {
+      scale.v[block_idx % 16 ? 0 : 2] = 20.0f;
+    }
+    p.y = 0.5f + 0.5f * scale.y;
+    check_add_block(p, scale);
+  }
+  check_scene_end(&g_scene);
+
+  Check_Bake scatter;
+  check_bake_begin(&scatter, Pvs_CellSize);
+  f64 serial_start = check_seconds();
+  pvs_bake(&scatter.bake, &scatter.grid, scatter.visible, 0);
+  f64 serial_end = check_seconds();
+
+  u64 rows_size = (u64)scatter.grid.cell_count * Pvs_RowWords * sizeof(u64);
+  u64 visible_count = 0;
+  for (u32 cell_idx = 0; cell_idx < scatter.grid.cell_count; ++cell_idx)
+  {
+    u64 *row = scatter.visible + (u64)cell_idx * Pvs_RowWords;
+    for (u32 instance_idx = 0; instance_idx < g_scene.static_instance_count; ++instance_idx)
+    {
+      visible_count += check_bit(row, instance_idx);
+    }
+  }
+
+  u32 ray_count;
+  u32 misses = check_sampled(&scatter, 8, 64, &ray_count);
+  check(misses == 0, "sampled", 2, (f32)misses);
+  printf("scatter: %u cells of %.1f, %.1f%% of %u blocks visible on average, %u of %u rays missed\n",
+         scatter.grid.cell_count, scatter.grid.cell_size, 100.0 * (f64)visible_count / ((f64)scatter.grid.cell_count * g_scene.static_instance_count),
+         g_scene.static_instance_count, misses, ray_count);
+
+  // threads: the same bake through the queue
+  {
+    u64 *threaded = (u64 *)os_memory_alloc(rows_size);
+    OS_Work_Queue *queue = os_work_queue_create(Maximum(thread_count, 2));
+    f64 threaded_start = check_seconds();
+    pvs_bake(&scatter.bake, &scatter.grid, threaded, queue);
+    f64 threaded_end = check_seconds();
+    check(memcmp(scatter.visible, threaded, rows_size) == 0, "threads", 0, 0.0f);
+    printf("bake of %u cells at %u rays a pair: serial %.1f ms, %u threads %.1f ms\n", scatter.grid.cell_count, Check_RaysPerPair,
+           (serial_end - serial_start) * 1000.0, Maximum(thread_count, 2), (threaded_end - threaded_start) * 1000.0);
+    os_memory_free(threaded, rows_size);
+  }
+
+  // file: encode, parse and read back through a view
+  {
+    Pvs_Grid *grid = &scatter.grid;
+    u32 instance_count = g_scene.static_instance_count;
+    u64 max_size  = pvs_max_file_size(grid, instance_count);
+    u8 *file_data = os_memory_alloc(max_size);
+    u64 file_size = pvs_encode(file_data, grid, instance_count, scatter.visible);
+    check(file_size <= max_size, "file", 0, (f32)file_size);
+
+    Pvs_Header *header = pvs_parse(file_data, file_size);
+    check(header != 0, "file", 1, 0.0f);
+    if (header)
+    {
+      check((header->cell_count_x == grid->cell_count_x) && (header->cell_count_y == grid->cell_count_y) &&
+            (header->cell_count_z == grid->cell_count_z) && (header->instance_count == instance_count), "file", 2, 0.0f);
+
+      static Pvs_View view;
+      pvs_view_init(&view, header);
+      b32 all_match    = true;
+      u32 paying_cells = 0;
+      for (u32 cell_idx = 0; cell_idx < grid->cell_count; ++cell_idx)
+      {
+        u32 cell[3];
+        v3f p = v3f_add(pvs_cell_min(grid, cell_idx, cell), v3f_s(0.5f * grid->cell_size));
+        u64 *row  = scatter.visible + (u64)cell_idx * Pvs_RowWords;
+        u32 culled = 0;
+        for (u32 instance_idx = 0; instance_idx < instance_count; ++instance_idx)
+        {
+          culled += !check_bit(row, instance_idx);
+        }
+        all_match = all_match && pvs_view_update(&view, p) && (view.cell == cell_idx) &&
+                    (memcmp(view.row, row, sizeof(view.row)) == 0) && (view.row_culled == culled) &&
+                    (view.row_pays == (culled && (culled * Pvs_MinCullDivisor >= instance_count)));
+        paying_cells += view.row_pays ? 1 : 0;
+      }
+      check(all_match, "file", 3, 0.0f);
+      check(header->paying_cell_count == paying_cells, "file", 15, (f32)header->paying_cell_count);
+      check(view.row_loads == grid->cell_count, "file", 4, (f32)view.row_loads);
+      check(!pvs_view_update(&view, v3f_sub(grid->origin, v3f_s(1.0f))), "file", 5, 0.0f);
+      check(pvs_view_update(&view, v3f_add(grid->origin, v3f_s(0.5f * grid->cell_size))) && (view.row_loads == grid->cell_count + 1), "file", 6, 0.0f);
+      check(pvs_view_update(&view, v3f_add(grid->origin, v3f_s(0.6f * grid->cell_size))) && (view.row_loads == grid->cell_count + 1), "file", 7, 0.0f);
+
+      // cull: the set of one cell with two dynamic instances after it
+      u64 *row = scatter.visible;
+      u32 kept = 0;
+      for (u32 instance_idx = 0; instance_idx < instance_count; ++instance_idx)
+      {
+        kept += check_bit(row, instance_idx);
+      }
+      scene_begin_dynamic(&g_scene);
+      check_add_block((v3f){ 1000.0f, 0.0f, 0.0f }, v3f_s(1.0f));
+      scene_add_instance(&g_scene, SceneModel_Sphere, (v3f){ 1000.0f, 5.0f, 0.0f }, v3f_s(1.0f), m33_make_identity(),
+                         (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_None);
+      pvs_cull_scene(row, &g_scene, &g_culled);
+      check(g_culled.instance_count == kept + 2, "cull", 0, (f32)g_culled.instance_count);
+      u32 culled_idx = 0;
+      b32 in_order   = true;
+      for (u32 batch_idx = 0; batch_idx < g_culled.batch_count; ++batch_idx)
+      {
+        Scene_Batch *batch = g_culled.batches + batch_idx;
+        in_order = in_order && (batch->first_instance == culled_idx) && batch->instance_count;
+        culled_idx += batch->instance_count;
+      }
+      for (u32 instance_idx = 0, out_idx = 0; instance_idx < g_scene.instance_count; ++instance_idx)
+      {
+        if ((instance_idx >= instance_count) || check_bit(row, instance_idx))
+        {
+          in_order = in_order && (out_idx < g_culled.instance_count) &&
+                     (memcmp(g_culled.ins + out_idx, g_scene.ins + instance_idx, sizeof(Model_Instance)) == 0);
+          ++out_idx;
+        }
+      }
+      check(in_order && (culled_idx == g_culled.instance_count), "cull", 1, 0.0f);
+      check(g_culled.batches[g_culled.batch_count - 1].model == SceneModel_Sphere, "cull", 2, 0.0f);
+    }
+
+    u32 *row_offsets = (u32 *)(file_data + sizeof(Pvs_Header));
+    check(pvs_parse(file_data, file_size - 1) == 0, "file", 8, 0.0f);
+    check(pvs_parse(file_data, sizeof(Pvs_Header) - 1) == 0, "file", 9, 0.0f);
+    row_offsets[1] += 1;
+    check(pvs_parse(file_data, file_size) == 0, "file", 10, 0.0f);
+    row_offsets[1] -= 1;
+    ((Pvs_Header *)file_data)->instance_count += 8;
+    check(pvs_parse(file_data, file_size) == 0, "file", 11, 0.0f);
+    ((Pvs_Header *)file_data)->instance_count -= 8;
+    ((Pvs_Header *)file_data)->version = Pvs_Version + 1;
+    check(pvs_parse(file_data, file_size) == 0, "file", 12, 0.0f);
+    ((Pvs_Header *)file_data)->version = Pvs_Version;
+    u32 paying_cell_count = ((Pvs_Header *)file_data)->paying_cell_count;
+    ((Pvs_Header *)file_data)->paying_cell_count = grid->cell_count + 1;
+    check(pvs_parse(file_data, file_size) == 0, "file", 16, 0.0f);
+    ((Pvs_Header *)file_data)->paying_cell_count = paying_cell_count;
+    ((Pvs_Header *)file_data)->magic   = 0;
+    check(pvs_parse(file_data, file_size) == 0, "file", 13, 0.0f);
+    check(pvs_parse(0, 0) == 0, "file", 14, 0.0f);
+    os_memory_free(file_data, max_size);
+  }
+  check_bake_end(&scatter);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 thread_count = (argc > 1) ? (u32)atoi(argv[1]) : Maximum(os_processor_count(), 2) - 1;
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    g_meshes[model] = scene_mesh_for_model(model);
+  }
+
+  check_grid();
+  check_rows();
+  check_walls();
+  check_scatter(thread_count);
+
+  return(check_report());
+}
@@ -0,0 +1,247 @@
+// Replays a camera path through the default scene against its baked
+// potentially visible sets (see pvs.h) and reports how much of the static
+// scene they cull on the frames the renderer would filter by them, and how
+// much of what the camera can actually see they would have wrongly dropped.
+// Exits non-zero if they drop anything it can see. The sets are sampled, so
+// this is what shows whether they missed anything along the path; it checks
+// every frame in the grid, whether or not the renderers would load the file.
+//
+// usage: pvs_sim [pvs_file] [camera_path_file]
+//
+// The sets default to ../data/visibility.pvs. A camera path file is the one
+// residency_sim reads: one frame per line, x y z rotate_xz rotate_yz, with
+// the angles in degrees as in Scene_State. Without one, the same built-in
+// path walks the hall and then circles it from outside. Misses are found by
+// tracing rays over the view cone of every frame against the BVH.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../pvs.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../pvs.c"
+
+typedef struct
+{
+  v3f p;
+  f32 rotate_xz;
+  f32 rotate_yz;
+} Camera_Key;
+
+#define Sim_MaxFrames 16384
+#define Sim_RaysPerFrame 256
+
+static Scene_Instances g_scene;
+static Scene_Instances g_culled;
+static Pvs_View        g_view;
+static Camera_Key      g_path[Sim_MaxFrames];
+
+static f64
+sim_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+static f32
+sim_random(u32 *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return((f32)(*state >> 8) / (f32)(1 << 24));
+}
+
+static u32
+sim_builtin_path(Camera_Key *path)
+{
+  u32 count        = 0;
+  f32 hall_width   = ScenePlatform_BlockCountWidth * Scene_BlockWidth;
+  f32 hall_depth   = ScenePlatform_BlockCountDepth * Scene_BlockWidth;
+
+  // walk down the middle of the hall looking ahead, then back looking at the pillars
+  for (u32 frame = 0; frame < 600; ++frame)
+  {
+    f32 t = (f32)frame / 600.0f;
+    path[count++] = (Camera_Key){ { hall_width * 0.5f, 4.0f, 2.0f + t * (hall_depth - 4.0f) }, 90.0f, 95.0f };
+  }
+
+  for (u32 frame = 0; frame < 600; ++frame)
+  {
+    f32 t = (f32)frame / 600.0f;
+    path[count++] = (Camera_Key){ { hall_width * 0.5f + 6.0f, 3.0f, hall_depth - 2.0f - t * (hall_depth - 4.0f) }, 360.0f * (f32)frame / 120.0f, 100.0f };
+  }
+
+  // orbit outside
+  for (u32 frame = 0; frame < 1200; ++frame)
+  {
+    f32 angle   = 2.0f * PIF32 * (f32)frame / 1200.0f;
+    f32 radius  = hall_width * 1.5f;
+    v3f center  = { hall_width * 0.5f, 0.0f, hall_depth * 0.5f };
+    v3f p       = { center.x + radius * cosf(angle), 30.0f, center.z + radius * sinf(angle) };
+    v3f to      = v3f_normalized(v3f_sub(center, p));
+    path[count++] = (Camera_Key){ p, atan2f(to.z, to.x) * (180.0f / PIF32), acosf(to.y) * (180.0f / PIF32) };
+  }
+
+  return(count);
+}
+
+static u32
+sim_load_path(char *filename, Camera_Key *path)
+{
+  u32 count = 0;
+  FILE *file = fopen(filename, "rb");
+  if (file)
+  {
+    Camera_Key key;
+    while ((count < Sim_MaxFrames) &&
+           (fscanf(file, "%f %f %f %f %f", &key.p.x, &key.p.y, &key.p.z, &key.rotate_xz, &key.rotate_yz) == 5))
+    {
+      path[count++] = key;
+    }
+    fclose(file);
+  }
+
+  return(count);
+}
+
+int
+main(int argc, char **argv)
+{
+  char *pvs_path    = (argc > 1) ? argv[1] : "../data/" Pvs_DefaultPath;
+  u32   frame_count = (argc > 2) ? sim_load_path(argv[2], g_path) : sim_builtin_path(g_path);
+  if (!frame_count)
+  {
+    fprintf(stderr, "no camera path frames\n");
+    return(1);
+  }
+
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+
+  OS_File_Map map  = os_file_map(pvs_path);
+  Pvs_Header *file = pvs_parse(map.data, map.size);
+  if (!file || (file->instance_count != g_scene.static_instance_count))
+  {
+    fprintf(stderr, "pvs_sim: %s is missing or was baked from another scene\n", pvs_path);
+    return(1);
+  }
+  pvs_view_init(&g_view, file);
+
+  Scene_Mesh meshes[SceneModel_Count];
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    meshes[model] = scene_mesh_for_model(model);
+  }
+  u32 triangle_count             = bvh_scene_triangle_count(&g_scene, meshes);
+  Bvh_Source_Triangle *triangles = (Bvh_Source_Triangle *)os_memory_alloc((u64)triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, meshes, triangles);
+  Bvh bvh;
+  bvh_build(&bvh, triangles, triangle_count, 0);
+
+  // rays fill the cone around the view's diagonal
+  f32 tan_half_fov = tanf(Radians(Scene_CameraFovDegrees) * 0.5f);
+  f32 cos_cone     = 1.0f / sqrtf(1.0f + 2.0f * tan_half_fov * tan_half_fov);
+
+  u32 static_count   = g_scene.static_instance_count;
+  u32 frames_in_grid = 0;
+  u32 frames_filtered = 0;
+  u64 drawn_sum      = 0;
+  f32 min_culled     = 1.0f;
+  f32 max_culled     = 0.0f;
+  u64 ray_hits       = 0;
+  u64 ray_misses     = 0;
+  u32 miss_frames    = 0;
+  f64 cull_seconds   = 0.0;
+  u32 random         = 0x9F5;
+  for (u32 frame = 0; frame < frame_count; ++frame)
+  {
+    Camera_Key *key = g_path + frame;
+    f32 xz          = Radians(key->rotate_xz);
+    f32 yz          = Radians(key->rotate_yz);
+    v3f front       = v3f_normalized((v3f){ cosf(xz) * sinf(yz), cosf(yz), sinf(xz) * sinf(yz) });
+
+    f64 cull_start = sim_seconds();
+    b32 in_grid    = pvs_view_update(&g_view, key->p);
+    b32 filtered   = in_grid && g_view.row_pays;
+    if (filtered)
+    {
+      pvs_cull_scene(g_view.row, &g_scene, &g_culled);
+    }
+    cull_seconds += sim_seconds() - cull_start;
+
+    u32 drawn = filtered ? g_culled.instance_count : static_count;
+    f32 culled = 1.0f - (f32)drawn / (f32)static_count;
+    drawn_sum  += drawn;
+    min_culled  = Minimum(min_culled, culled);
+    max_culled  = Maximum(max_culled, culled);
+    frames_in_grid  += in_grid ? 1 : 0;
+    frames_filtered += filtered ? 1 : 0;
+    if (!in_grid)
+    {
+      continue;
+    }
+
+    v3f up    = (fabsf(front.y) < 0.99f) ? (v3f){ 0.0f, 1.0f, 0.0f } : (v3f){ 1.0f, 0.0f, 0.0f };
+    v3f right = v3f_normalized(v3f_cross(up, front));
+    up        = v3f_cross(front, right);
+    u32 frame_misses = 0;
+    for (u32 ray_idx = 0; ray_idx < Sim_RaysPerFrame; ++ray_idx)
+    {
+      f32 cos_theta = 1.0f - sim_random(&random) * (1.0f - cos_cone);
+      f32 sin_theta = sqrtf(Maximum(1.0f - cos_theta * cos_theta, 0.0f));
+      f32 phi       = 2.0f * PIF32 * sim_random(&random);
+      v3f dir       = v3f_add(v3f_scale(cos_theta, front),
+                              v3f_add(v3f_scale(sin_theta * cosf(phi), right), v3f_scale(sin_theta * sinf(phi), up)));
+      Bvh_Hit hit = { 0 };
+      if (bvh_intersect(&bvh, key->p, dir, Scene_CameraNear, Scene_CameraFar, &hit))
+      {
+        ++ray_hits;
+        if (!(g_view.row[hit.instance_idx / 64] & (1ull << (hit.instance_idx % 64))))
+        {
+          ++frame_misses;
+        }
+      }
+    }
+    ray_misses  += frame_misses;
+    miss_frames += frame_misses ? 1 : 0;
+  }
+
+  printf("frames              %u, %u in the grid of %ux%ux%u cells of %.2f, %u filtered\n", frame_count, frames_in_grid,
+         g_view.grid.cell_count_x, g_view.grid.cell_count_y, g_view.grid.cell_count_z, g_view.grid.cell_size, frames_filtered);
+  printf("paying cells        %u of %u%s\n", file->paying_cell_count, g_view.grid.cell_count,
+         file->paying_cell_count ? "" : ", so the renderers do not load these sets");
+  printf("static instances    %u\n", static_count);
+  printf("culled              %.1f%% avg, %.1f%% min, %.1f%% max\n",
+         100.0 * (1.0 - (f64)drawn_sum / ((f64)frame_count * static_count)), 100.0 * min_culled, 100.0 * max_culled);
+  printf("drawn               %.1f instances/frame avg\n", (f64)drawn_sum / (f64)frame_count);
+  printf("cell changes        %u\n", g_view.row_loads);
+  printf("cull cost           %.2f us/frame avg\n", cull_seconds * 1e6 / (f64)frame_count);
+  printf("wrongly culled      %llu of %llu view rays that hit (%.3f%%), on %u frames\n",
+         (unsigned long long)ray_misses, (unsigned long long)ray_hits, ray_hits ? 100.0 * (f64)ray_misses / (f64)ray_hits : 0.0, miss_frames);
+  return(ray_misses ? 1 : 0);
+}
@@ -0,0 +1,142 @@
+// Bakes the reflection probes of the default scene (see reflection_probe.h)
+// into one file the engine uploads as a cube array.
+//
+// usage: reflection_bake <out.rpb> [thread_count]
+//
+// Textured instances stand in with their material's average diffuse colour,
+// read from data/textures/*/diffuse.png; a material without one bakes as mid
+// grey.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../reflection_probe.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../reflection_probe.c"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ext/stb_image.h"
+
+static Scene_Instances g_scene;
+
+static f64
+bake_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+// the mean of the texels, what the sampler's filtering lands on from far
+// enough away; the material arrays are UNORM, so no sRGB decode
+static v3f
+bake_material_albedo(char *material_dir)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "../data/%s/diffuse.png", material_dir);
+
+  v3f result = v3f_s(0.5f);
+  s32 width, height, comp;
+  u8 *texels = stbi_load(path, &width, &height, &comp, 3);
+  if (texels)
+  {
+    f64 sum[3] = { 0 };
+    u64 texel_count = (u64)width * height;
+    for (u64 texel = 0; texel < texel_count; ++texel)
+    {
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        sum[channel] += texels[texel * 3 + channel] / 255.0;
+      }
+    }
+
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      result.v[channel] = (f32)(sum[channel] / (f64)texel_count);
+    }
+    stbi_image_free(texels);
+  }
+  else
+  {
+    fprintf(stderr, "reflection_bake: no %s, baking the material as grey\n", path);
+  }
+
+  return(result);
+}
+
+int
+main(int argc, char **argv)
+{
+  if ((argc < 2) || (argc > 3))
+  {
+    fprintf(stderr, "usage: reflection_bake <out.rpb> [thread_count]\n");
+    return(1);
+  }
+
+  u32 thread_count = (argc == 3) ? (u32)atoi(argv[2]) : Maximum(os_processor_count(), 2) - 1;
+  OS_Work_Queue *queue = thread_count ? os_work_queue_create(thread_count) : 0;
+
+  // the engine hands out probes the same way once it has the file
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, ReflectionProbe_MaxProbes);
+
+  Light sun = scene_directional_light();
+  Reflection_Bake bake =
+  {
+    .scene       = &g_scene,
+    .lights      = &sun,
+    .light_count = 1,
+    .sky         = v3f_zero(),
+  };
+
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    bake.material_albedo[material] = bake_material_albedo(scene_material_dir(material));
+  }
+
+  Reflection_Probe probes[ReflectionProbe_MaxProbes];
+  u32 probe_count = reflection_probe_gather(&g_scene, probes);
+  u32 texel_count = reflection_probe_texel_count();
+  v3f *cubes      = os_memory_alloc((u64)Maximum(probe_count, 1) * texel_count * sizeof(v3f));
+
+  f64 start = bake_seconds();
+  for (u32 probe_idx = 0; probe_idx < probe_count; ++probe_idx)
+  {
+    reflection_probe_bake(&bake, probe_idx, probes[probe_idx].p, cubes + (u64)probe_idx * texel_count, queue);
+  }
+  f64 bake_end = bake_seconds();
+
+  u64 file_size = reflection_probe_file_size(probe_count);
+  u8 *file_data = os_memory_alloc(file_size);
+  reflection_probe_encode(file_data, probes, probe_count, cubes);
+  if (!os_file_write_all(argv[1], file_data, file_size))
+  {
+    fprintf(stderr, "reflection_bake: cannot write %s\n", argv[1]);
+    return(1);
+  }
+
+  printf("%s: %u probes, %ux%u faces, %u mips, %.1f KB (RGBA16F would be %.1f KB), bake %.1f ms on %u threads\n",
+         argv[1], probe_count, ReflectionProbe_FaceSize, ReflectionProbe_FaceSize, ReflectionProbe_MipCount,
+         (f64)file_size / 1024.0, (f64)probe_count * texel_count * 8 / 1024.0, (bake_end - start) * 1000.0, thread_count);
+  return(0);
+}
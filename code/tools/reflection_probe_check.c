@@ -0,0 +1,342 @@
+// Checks the reflection probe baker (reflection_probe.c) on small scenes
+// whose answers are known. Exits non-zero if a check fails.
+//
+// usage: reflection_probe_check [thread_count]
+//
+//   rgb9e5        packing keeps each channel within half a step of the
+//                 shared exponent, and clamps out of range input
+//   faces         face_direction and direction_face invert each other
+//   trace         rays hit scaled and rotated cubes, cylinders and spheres
+//                 at the analytic distance, with outward normals
+//   sky           an empty scene bakes to the sky in every texel of every mip
+//   mirror        mip 0 sees an unlit sphere in its own colour on one side
+//                 and the sky on the other
+//   energy        each prefiltered mip keeps the mean radiance of mip 0
+//   threads       a bake on a work queue is bit-identical to a serial one
+//   file          encode and parse round trip, and cut short or foreign
+//                 files are rejected
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../reflection_probe.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../reflection_probe.c"
+#include "check.h"
+
+static Scene_Instances g_scene;
+
+static void
+check_rgb9e5(void)
+{
+  u32 random = 0x9E5;
+  for (u32 sample_idx = 0; sample_idx < 10000; ++sample_idx)
+  {
+    f32 range  = powf(10.0f, 6.0f * check_random(&random) - 3.0f);
+    v3f colour = { range * check_random(&random), range * check_random(&random), range * check_random(&random) };
+    v3f back   = reflection_probe_unpack_rgb9e5(reflection_probe_pack_rgb9e5(colour));
+    f32 max_channel = Maximum(colour.r, Maximum(colour.g, colour.b));
+    f32 error  = 0.0f;
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      error = Maximum(error, fabsf(back.v[channel] - colour.v[channel]));
+    }
+    // 9 bit mantissas that need not be normalised: half a step of 2^-8 of
+    // the largest channel, plus rounding the exponent up
+    check(error <= max_channel / 256.0f, "rgb9e5", sample_idx, error / max_channel);
+  }
+
+  v3f zero = reflection_probe_unpack_rgb9e5(reflection_probe_pack_rgb9e5(v3f_zero()));
+  check((zero.r == 0.0f) && (zero.g == 0.0f) && (zero.b == 0.0f), "rgb9e5", 0, zero.r);
+
+  v3f clamped = reflection_probe_unpack_rgb9e5(reflection_probe_pack_rgb9e5((v3f){ -1.0f, 1e9f, 1.0f }));
+  check(clamped.r == 0.0f, "rgb9e5", 1, clamped.r);
+  check(clamped.g == 65408.0f, "rgb9e5", 2, clamped.g);
+}
+
+static void
+check_faces(void)
+{
+  u32 size = ReflectionProbe_FaceSize;
+  for (u32 face = 0; face < 6; ++face)
+  {
+    for (u32 y = 0; y < size; ++y)
+    {
+      for (u32 x = 0; x < size; ++x)
+      {
+        f32 u = ((f32)x + 0.5f) / (f32)size;
+        f32 v = ((f32)y + 0.5f) / (f32)size;
+        v3f dir = reflection_probe_face_direction(face, u, v);
+        f32 back_u, back_v;
+        u32 back_face = reflection_probe_direction_face(dir, &back_u, &back_v);
+        check(back_face == face, "faces", face, (f32)back_face);
+        check((fabsf(back_u - u) < 1e-5f) && (fabsf(back_v - v) < 1e-5f), "faces", face, back_u - u);
+        check(fabsf(v3f_inner(dir, dir) - 1.0f) < 1e-5f, "faces", face, v3f_inner(dir, dir));
+      }
+    }
+
+    // the face centre looks down its axis
+    v3f centre = reflection_probe_face_direction(face, 0.5f, 0.5f);
+    f32 axis   = centre.v[face / 2] * ((face & 1) ? -1.0f : 1.0f);
+    check(fabsf(axis - 1.0f) < 1e-6f, "faces", face, axis);
+  }
+}
+
+static void
+check_trace_hit_side(v3f origin, v3f target, f32 expect_t, u32 expect_instance, u32 index, f32 facing)
+{
+  Reflection_Hit hit;
+  v3f dir = v3f_normalized(v3f_sub(target, origin));
+  b32 hit_any = reflection_probe_trace(&g_scene, origin, dir, 1e30f, ReflectionProbe_None, &hit);
+  check(hit_any, "trace", index, 0.0f);
+  if (hit_any)
+  {
+    check(fabsf(hit.t - expect_t) < 1e-3f, "trace", index, hit.t - expect_t);
+    check(hit.instance_idx == expect_instance, "trace", index, (f32)hit.instance_idx);
+    // normals point out, so against the ray from outside and along it from inside
+    check(facing * v3f_inner(hit.normal, dir) > 0.999f, "trace", index, v3f_inner(hit.normal, dir));
+  }
+}
+
+static void
+check_trace_hit(v3f origin, v3f target, f32 expect_t, u32 expect_instance, u32 index)
+{
+  check_trace_hit_side(origin, target, expect_t, expect_instance, index, -1.0f);
+}
+
+static void
+check_trace(void)
+{
+  check_scene_begin(&g_scene);
+  v4f white = { 1.0f, 1.0f, 1.0f, 1.0f };
+  scene_add_instance(&g_scene, SceneModel_Sphere, (v3f){ 0.0f, 0.0f, 0.0f }, (v3f){ 2.0f, 2.0f, 2.0f }, m33_make_identity(), white, MaterialType_None);
+  scene_add_instance(&g_scene, SceneModel_Cube, (v3f){ 20.0f, 0.0f, 0.0f }, (v3f){ 2.0f, 4.0f, 6.0f }, m33_make_rot_xz(0.5f), white, MaterialType_None);
+  // lying along x
+  scene_add_instance(&g_scene, SceneModel_Cylinder, (v3f){ 0.0f, 0.0f, 20.0f }, (v3f){ 3.0f, 1.5f, 1.5f }, m33_make_rot_xy(0.5f * PIF32), white, MaterialType_None);
+  check_scene_end(&g_scene);
+
+  // sphere of radius 2, from outside along each axis and a diagonal
+  check_trace_hit((v3f){ -10.0f, 0.0f, 0.0f }, v3f_zero(), 8.0f, 0, 0);
+  check_trace_hit((v3f){ 0.0f, 10.0f, 0.0f }, v3f_zero(), 8.0f, 0, 1);
+  check_trace_hit((v3f){ 0.0f, -6.0f, -8.0f }, v3f_zero(), 8.0f, 0, 2);
+
+  // cube: 6 tall in y regardless of the turn about y
+  check_trace_hit((v3f){ 20.0f, 10.0f, 0.0f }, (v3f){ 20.0f, 0.0f, 0.0f }, 8.0f, 1, 3);
+  check_trace_hit((v3f){ 20.0f, -10.0f, 0.0f }, (v3f){ 20.0f, 0.0f, 0.0f }, 8.0f, 1, 4);
+
+  // cylinder: the cap at x = 2 * 3, the side at radius 1.5
+  check_trace_hit((v3f){ 16.0f, 0.0f, 20.0f }, (v3f){ 0.0f, 0.0f, 20.0f }, 10.0f, 2, 5);
+  check_trace_hit((v3f){ 1.0f, 10.0f, 20.0f }, (v3f){ 1.0f, 0.0f, 20.0f }, 8.5f, 2, 6);
+  check_trace_hit((v3f){ -2.0f, 0.0f, 30.0f }, (v3f){ -2.0f, 0.0f, 20.0f }, 8.5f, 2, 7);
+
+  // from inside the sphere the far side is hit
+  check_trace_hit_side(v3f_zero(), (v3f){ 1.0f, 0.0f, 0.0f }, 2.0f, 0, 8, 1.0f);
+
+  Reflection_Hit hit;
+  b32 missed = !reflection_probe_trace(&g_scene, (v3f){ 10.0f, 10.0f, 10.0f }, (v3f){ 0.0f, 1.0f, 0.0f }, 1e30f, ReflectionProbe_None, &hit);
+  check(missed, "trace", 9, 0.0f);
+  b32 short_ray = !reflection_probe_trace(&g_scene, (v3f){ -10.0f, 0.0f, 0.0f }, (v3f){ 1.0f, 0.0f, 0.0f }, 7.0f, ReflectionProbe_None, &hit);
+  check(short_ray, "trace", 10, 0.0f);
+
+  // a probe's own instance is not in its cube
+  g_scene.ins[0].reflection_probe = 0;
+  b32 skipped = !reflection_probe_trace(&g_scene, (v3f){ 0.0f, -10.0f, 0.0f }, (v3f){ 0.0f, 1.0f, 0.0f }, 1e30f, 0, &hit);
+  check(skipped, "trace", 11, 0.0f);
+}
+
+static f32
+check_texel_solid_angle(u32 mip, u32 x, u32 y)
+{
+  u32 size = ReflectionProbe_FaceSize >> mip;
+  f32 sc   = 2.0f * ((f32)x + 0.5f) / (f32)size - 1.0f;
+  f32 tc   = 2.0f * ((f32)y + 0.5f) / (f32)size - 1.0f;
+  f32 area = (2.0f / (f32)size) * (2.0f / (f32)size);
+  f32 result = area / powf(1.0f + sc * sc + tc * tc, 1.5f);
+  return(result);
+}
+
+static v3f
+check_mip_mean(v3f *cube, u32 mip)
+{
+  u32 size   = ReflectionProbe_FaceSize >> mip;
+  v3f sum    = v3f_zero();
+  f32 weight = 0.0f;
+  for (u32 face = 0; face < 6; ++face)
+  {
+    v3f *texels = cube + reflection_probe_texel_offset(face, mip);
+    for (u32 y = 0; y < size; ++y)
+    {
+      for (u32 x = 0; x < size; ++x)
+      {
+        f32 solid_angle = check_texel_solid_angle(mip, x, y);
+        sum     = v3f_add(sum, v3f_scale(solid_angle, texels[y * size + x]));
+        weight += solid_angle;
+      }
+    }
+  }
+
+  v3f result = v3f_scale(1.0f / weight, sum);
+  return(result);
+}
+
+static void
+check_bakes(u32 thread_count)
+{
+  u32 texel_count = reflection_probe_texel_count();
+  u64 cube_size   = texel_count * sizeof(v3f);
+  v3f *cube       = os_memory_alloc(cube_size);
+  v3f *threaded   = os_memory_alloc(cube_size);
+  Light sun       = scene_directional_light();
+  Reflection_Bake bake = { .scene = &g_scene, .lights = &sun, .light_count = 1, .sky = { 0.3f, 0.5f, 0.7f } };
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    bake.material_albedo[material] = v3f_s(0.5f);
+  }
+
+  // sky: nothing to hit
+  check_scene_begin(&g_scene);
+  check_scene_end(&g_scene);
+  reflection_probe_bake(&bake, 0, v3f_zero(), cube, 0);
+  f32 sky_error = 0.0f;
+  for (u32 texel = 0; texel < texel_count; ++texel)
+  {
+    sky_error = Maximum(sky_error, fabsf(v3f_sub(cube[texel], bake.sky).v[0]));
+    sky_error = Maximum(sky_error, fabsf(v3f_sub(cube[texel], bake.sky).v[1]));
+    sky_error = Maximum(sky_error, fabsf(v3f_sub(cube[texel], bake.sky).v[2]));
+  }
+  check(sky_error < 1e-4f, "sky", 0, sky_error);
+
+  // mirror: an unlit red sphere down +x
+  check_scene_begin(&g_scene);
+  Model_Instance *red = scene_add_instance(&g_scene, SceneModel_Sphere, (v3f){ 10.0f, 0.0f, 0.0f }, v3f_s(3.0f), m33_make_identity(),
+                                           (v4f){ 1.0f, 0.0f, 0.0f, 1.0f }, MaterialType_None);
+  red->enable_lighting = 0;
+  check_scene_end(&g_scene);
+  reflection_probe_bake(&bake, 0, v3f_zero(), cube, 0);
+  {
+    u32 centre = (ReflectionProbe_FaceSize / 2) * ReflectionProbe_FaceSize + ReflectionProbe_FaceSize / 2;
+    v3f toward = cube[reflection_probe_texel_offset(0, 0) + centre];
+    v3f away   = cube[reflection_probe_texel_offset(1, 0) + centre];
+    check((fabsf(toward.r - 1.0f) < 1e-4f) && (toward.g < 1e-4f) && (toward.b < 1e-4f), "mirror", 0, toward.r);
+    check(fabsf(away.b - bake.sky.b) < 1e-4f, "mirror", 1, away.b);
+  }
+
+  // energy and threads: a lit floor, a wall and the red sphere around the probe
+  check_scene_begin(&g_scene);
+  scene_add_instance(&g_scene, SceneModel_Cube, (v3f){ 0.0f, -4.0f, 0.0f }, (v3f){ 40.0f, 1.0f, 40.0f }, m33_make_identity(),
+                     (v4f){ 0.8f, 0.8f, 0.8f, 1.0f }, MaterialType_GrayBrick);
+  scene_add_instance(&g_scene, SceneModel_Cube, (v3f){ 0.0f, 0.0f, 12.0f }, (v3f){ 20.0f, 10.0f, 1.0f }, m33_make_identity(),
+                     (v4f){ 0.2f, 0.9f, 0.3f, 1.0f }, MaterialType_None);
+  scene_add_instance(&g_scene, SceneModel_Cylinder, (v3f){ -8.0f, 0.0f, 0.0f }, v3f_s(1.0f), m33_make_identity(),
+                     (v4f){ 0.9f, 0.9f, 0.2f, 1.0f }, MaterialType_OakTrunk);
+  red = scene_add_instance(&g_scene, SceneModel_Sphere, (v3f){ 10.0f, 0.0f, 0.0f }, v3f_s(3.0f), m33_make_identity(),
+                           (v4f){ 1.0f, 0.0f, 0.0f, 1.0f }, MaterialType_None);
+  red->enable_lighting = 0;
+  check_scene_end(&g_scene);
+
+  f64 serial_start = check_seconds();
+  reflection_probe_bake(&bake, 0, v3f_zero(), cube, 0);
+  f64 serial_end = check_seconds();
+
+  v3f mip0_mean = check_mip_mean(cube, 0);
+  for (u32 mip = 1; mip < ReflectionProbe_MipCount; ++mip)
+  {
+    v3f mean = check_mip_mean(cube, mip);
+    for (u32 channel = 0; channel < 3; ++channel)
+    {
+      f32 ratio = mean.v[channel] / mip0_mean.v[channel];
+      check(fabsf(ratio - 1.0f) < 0.1f, "energy", mip, ratio);
+    }
+  }
+
+  OS_Work_Queue *queue = os_work_queue_create(Maximum(thread_count, 2));
+  f64 threaded_start = check_seconds();
+  reflection_probe_bake(&bake, 0, v3f_zero(), threaded, queue);
+  f64 threaded_end = check_seconds();
+  check(memcmp(cube, threaded, cube_size) == 0, "threads", 0, 0.0f);
+
+  printf("bake of %u texels: serial %.1f ms, %u threads %.1f ms\n", texel_count, (serial_end - serial_start) * 1000.0,
+         Maximum(thread_count, 2), (threaded_end - threaded_start) * 1000.0);
+
+  // file: two probes, the second a copy of the first scaled up
+  for (u32 texel = 0; texel < texel_count; ++texel)
+  {
+    threaded[texel] = v3f_scale(40.0f, cube[texel]);
+  }
+
+  v3f *cubes = os_memory_alloc(2 * cube_size);
+  memcpy(cubes, cube, cube_size);
+  memcpy(cubes + texel_count, threaded, cube_size);
+  Reflection_Probe probes[2] = { { .p = { 1.0f, 2.0f, 3.0f } }, { .p = { -4.0f, 5.0f, -6.0f } } };
+  u64 file_size = reflection_probe_file_size(2);
+  u8 *file_data = os_memory_alloc(file_size);
+  reflection_probe_encode(file_data, probes, 2, cubes);
+
+  Reflection_Probe_Header *header = reflection_probe_parse(file_data, file_size);
+  check(header != 0, "file", 0, 0.0f);
+  if (header)
+  {
+    check(header->probe_count == 2, "file", 1, (f32)header->probe_count);
+    check(v3f_equal(header->probes[1].p, probes[1].p), "file", 2, header->probes[1].p.x);
+    u32 *texels = (u32 *)(header + 1);
+    f32 worst   = 0.0f;
+    for (u32 texel = 0; texel < 2 * texel_count; ++texel)
+    {
+      v3f back = reflection_probe_unpack_rgb9e5(texels[texel]);
+      f32 max_channel = Maximum(cubes[texel].r, Maximum(cubes[texel].g, cubes[texel].b));
+      for (u32 channel = 0; channel < 3; ++channel)
+      {
+        worst = Maximum(worst, fabsf(back.v[channel] - cubes[texel].v[channel]) - max_channel / 256.0f);
+      }
+    }
+    check(worst <= 0.0f, "file", 3, worst);
+  }
+
+  check(reflection_probe_parse(file_data, file_size - 1) == 0, "file", 4, 0.0f);
+  check(reflection_probe_parse(file_data, sizeof(Reflection_Probe_Header) - 1) == 0, "file", 5, 0.0f);
+  ((Reflection_Probe_Header *)file_data)->version = ReflectionProbe_Version + 1;
+  check(reflection_probe_parse(file_data, file_size) == 0, "file", 6, 0.0f);
+  ((Reflection_Probe_Header *)file_data)->version = ReflectionProbe_Version;
+  ((Reflection_Probe_Header *)file_data)->magic   = 0;
+  check(reflection_probe_parse(file_data, file_size) == 0, "file", 7, 0.0f);
+  check(reflection_probe_parse(0, 0) == 0, "file", 8, 0.0f);
+
+  os_memory_free(file_data, file_size);
+  os_memory_free(cubes, 2 * cube_size);
+  os_memory_free(threaded, cube_size);
+  os_memory_free(cube, cube_size);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 thread_count = (argc > 1) ? (u32)atoi(argv[1]) : Maximum(os_processor_count(), 2) - 1;
+
+  check_rgb9e5();
+  check_faces();
+  check_trace();
+  check_bakes(thread_count);
+
+  return(check_report());
+}
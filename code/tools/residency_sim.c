@@ -0,0 +1,294 @@
+// Replays a camera path through the default scene against the texture
+// residency manager and reports hit rate and churn. Exits non-zero if the
+// resident total ever ends a frame over budget.
+//
+// usage: residency_sim [-synthetic] [budget_mb] [load_mb_per_frame] [camera_path_file]
+//
+// A camera path file holds one frame per line: x y z rotate_xz rotate_yz,
+// with the angles in degrees as in Scene_State. Without one, a built-in path
+// walks the hall, circles it from outside and comes back in to a pillar.
+//
+// The bins are sized and costed from the maps in ../data, as the renderer
+// would upload them: a baked .tex at its own format, a png as RGBA8, and a
+// set with no maps at all as the 1x1 stand-in soft_frame draws. The shipped
+// sets then fit the default budget. -synthetic instead gives each set an
+// RGBA8 2048 >> material square, so the bins compete: the default budget is
+// short of both in full, and the pillar costs the floor its top mip.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../tex_file.h"
+#include "../tex_residency.h"
+
+#include "../my_math.c"
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../tex_file.c"
+#include "../tex_residency.c"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ext/stb_image.h"
+
+typedef struct
+{
+  v3f p;
+  f32 rotate_xz;
+  f32 rotate_yz;
+} Camera_Key;
+
+#define Sim_MaxFrames 16384
+#define Sim_TextureDim 2048
+#define Sim_ViewportWidth 1280.0f
+
+typedef struct
+{
+  s32 width;
+  s32 height;
+  u32 bytes_per_texel;
+} Sim_Material_Size;
+
+static Scene_Instances g_scene;
+static Camera_Key      g_path[Sim_MaxFrames];
+
+// A baked map's size and bytes per texel from its header; false if there is
+// no valid one.
+static b32
+sim_read_tex_file(char *path, s32 *width, s32 *height, u32 *bytes_per_texel)
+{
+  b32 result = false;
+  FILE *file = fopen(path, "rb");
+  if (file)
+  {
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    u8 *data = (size > 0) ? malloc((u64)size) : 0;
+    if (data && (fread(data, 1, (u64)size, file) == (u64)size))
+    {
+      Tex_File_Header *header = tex_file_parse(data, (u64)size);
+      if (header)
+      {
+        *width           = (s32)header->width;
+        *height          = (s32)header->height;
+        *bytes_per_texel = (u32)(tex_file_mip_size(header->format, 4, 4) / 16);
+        result           = true;
+      }
+    }
+    free(data);
+    fclose(file);
+  }
+
+  return(result);
+}
+
+// dx11_load_material_arrays' maps in its order, the first found sizing the
+// set. A missing png still costs RGBA8 at that size, since the renderer
+// needs it; a set with nothing on disk is 1x1.
+static Sim_Material_Size
+sim_material_size(Material_Type material)
+{
+  char *map_names[]       = { "diffuse.png", "normal.png", "displacement.png" };
+  char *baked_map_names[] = { 0, "normal.tex", "displacement.tex" };
+  Sim_Material_Size result = { 0 };
+  for (u32 map_idx = 0; map_idx < ArrayCount(map_names); ++map_idx)
+  {
+    char path[256];
+    s32  width = 0, height = 0, comp = 0;
+    u32  bytes_per_texel = 4;
+    b32  found = false;
+    if (baked_map_names[map_idx])
+    {
+      snprintf(path, sizeof(path), "../data/%s/%s", scene_material_dir(material), baked_map_names[map_idx]);
+      found = sim_read_tex_file(path, &width, &height, &bytes_per_texel);
+    }
+    if (!found)
+    {
+      snprintf(path, sizeof(path), "../data/%s/%s", scene_material_dir(material), map_names[map_idx]);
+      found = stbi_info(path, &width, &height, &comp);
+    }
+
+    if (found && !result.width)
+    {
+      result.width  = width;
+      result.height = height;
+    }
+    result.bytes_per_texel += bytes_per_texel;
+  }
+
+  if (!result.width)
+  {
+    result.width  = 1;
+    result.height = 1;
+  }
+  return(result);
+}
+
+static u32
+sim_builtin_path(Camera_Key *path)
+{
+  u32 count        = 0;
+  f32 hall_width   = ScenePlatform_BlockCountWidth * Scene_BlockWidth;
+  f32 hall_depth   = ScenePlatform_BlockCountDepth * Scene_BlockWidth;
+
+  // walk down the middle of the hall looking ahead, then back looking at the pillars
+  for (u32 frame = 0; frame < 600; ++frame)
+  {
+    f32 t = (f32)frame / 600.0f;
+    path[count++] = (Camera_Key){ { hall_width * 0.5f, 4.0f, 2.0f + t * (hall_depth - 4.0f) }, 90.0f, 95.0f };
+  }
+
+  for (u32 frame = 0; frame < 600; ++frame)
+  {
+    f32 t = (f32)frame / 600.0f;
+    path[count++] = (Camera_Key){ { hall_width * 0.5f + 6.0f, 3.0f, hall_depth - 2.0f - t * (hall_depth - 4.0f) }, 360.0f * (f32)frame / 120.0f, 100.0f };
+  }
+
+  // orbit outside
+  for (u32 frame = 0; frame < 1200; ++frame)
+  {
+    f32 angle   = 2.0f * PIF32 * (f32)frame / 1200.0f;
+    f32 radius  = hall_width * 1.5f;
+    v3f center  = { hall_width * 0.5f, 0.0f, hall_depth * 0.5f };
+    v3f p       = { center.x + radius * cosf(angle), 30.0f, center.z + radius * sinf(angle) };
+    v3f to      = v3f_normalized(v3f_sub(center, p));
+    path[count++] = (Camera_Key){ p, atan2f(to.z, to.x) * (180.0f / PIF32), acosf(to.y) * (180.0f / PIF32) };
+  }
+
+  // and back in, up to the first pillar on the left
+  for (u32 frame = 0; frame < 600; ++frame)
+  {
+    f32 t = (f32)frame / 600.0f;
+    path[count++] = (Camera_Key){ { hall_width * 0.5f * (1.0f - t) + 2.5f * t, 5.0f, hall_depth * 0.5f }, 180.0f, 90.0f };
+  }
+
+  return(count);
+}
+
+static u32
+sim_load_path(char *filename, Camera_Key *path)
+{
+  u32 count = 0;
+  FILE *file = fopen(filename, "rb");
+  if (file)
+  {
+    Camera_Key key;
+    while ((count < Sim_MaxFrames) &&
+           (fscanf(file, "%f %f %f %f %f", &key.p.x, &key.p.y, &key.p.z, &key.rotate_xz, &key.rotate_yz) == 5))
+    {
+      path[count++] = key;
+    }
+    fclose(file);
+  }
+
+  return(count);
+}
+
+int
+main(int argc, char **argv)
+{
+  b32 synthetic = (argc > 1) && !strcmp(argv[1], "-synthetic");
+  if (synthetic)
+  {
+    --argc;
+    ++argv;
+  }
+
+  u64 budget_mb         = (argc > 1) ? (u64)atoi(argv[1]) : 72;
+  u64 load_mb_per_frame = (argc > 2) ? (u64)atoi(argv[2]) : 8;
+  u32 frame_count       = (argc > 3) ? sim_load_path(argv[3], g_path) : sim_builtin_path(g_path);
+  if (!frame_count)
+  {
+    fprintf(stderr, "no camera path frames\n");
+    return(1);
+  }
+
+  // same-sized sets share a bin, as in the renderer
+  Tex_Packer        packer = { 0 };
+  Tex_Pack_Slot     material_slots[MaterialType_Count];
+  Sim_Material_Size sizes[MaterialType_Count];
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    if (synthetic)
+    {
+      sizes[material] = (Sim_Material_Size){ Sim_TextureDim >> material, Sim_TextureDim >> material, 4 * 3 };
+    }
+    else
+    {
+      sizes[material] = sim_material_size(material);
+    }
+    material_slots[material] = tex_pack_add(&packer, sizes[material].width, sizes[material].height);
+    printf("%-40s %dx%d, %u bytes/texel, bin %u\n", scene_material_dir(material), sizes[material].width,
+           sizes[material].height, sizes[material].bytes_per_texel, material_slots[material].array_idx);
+  }
+  scene_build_static(&g_scene, material_slots, 0);
+
+  // same accounting as the renderer: a bin streams as one texture, its
+  // bytes per texel summed over its slices
+  u32 bin_bytes_per_texel[TexPack_MaxArrays] = { 0 };
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    bin_bytes_per_texel[material_slots[material].array_idx] += sizes[material].bytes_per_texel;
+  }
+
+  static Residency_Manager manager;
+  residency_init(&manager, MB(budget_mb), MB(load_mb_per_frame));
+  u32 array_texture_ids[TexPack_MaxArrays];
+  for (u32 array_idx = 0; array_idx < packer.array_count; ++array_idx)
+  {
+    Tex_Pack_Array *array = packer.arrays + array_idx;
+    array_texture_ids[array_idx] = residency_register(&manager, array->width, array->height, bin_bytes_per_texel[array_idx]);
+  }
+
+  u32 material_texture_ids[MaterialType_Count];
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    material_texture_ids[material] = array_texture_ids[material_slots[material].array_idx];
+  }
+
+  f32 pixels_per_unit   = Sim_ViewportWidth / (2.0f * tanf(Radians(Scene_CameraFovDegrees) * 0.5f));
+  u64 max_frame_churn   = 0;
+  u32 churn_frames      = 0;
+  u32 over_budget       = 0;
+  for (u32 frame = 0; frame < frame_count; ++frame)
+  {
+    Camera_Key *key = g_path + frame;
+    f32 xz          = Radians(key->rotate_xz);
+    f32 yz          = Radians(key->rotate_yz);
+    v3f front       = v3f_normalized((v3f){ cosf(xz) * sinf(yz), cosf(yz), sinf(xz) * sinf(yz) });
+
+    u64 loaded_before   = manager.total_stats.bytes_loaded + manager.total_stats.bytes_evicted;
+    residency_request_scene(&manager, &g_scene, material_texture_ids, key->p, front, pixels_per_unit);
+    residency_update(&manager);
+    u64 churn           = manager.total_stats.bytes_loaded + manager.total_stats.bytes_evicted - loaded_before;
+
+    max_frame_churn = Maximum(max_frame_churn, churn);
+    churn_frames   += churn ? 1 : 0;
+    over_budget    += (manager.resident_bytes > manager.budget_bytes) ? 1 : 0;
+  }
+
+  Residency_Stats *total = &manager.total_stats;
+  printf("frames              %u\n", frame_count);
+  printf("budget              %llu MB, %llu MB/frame load cap\n", (unsigned long long)budget_mb, (unsigned long long)load_mb_per_frame);
+  printf("requests            %llu\n", (unsigned long long)total->requests);
+  printf("hit rate            %.2f%%\n", total->requests ? (100.0 * (f64)total->hits / (f64)total->requests) : 100.0);
+  printf("loaded              %.2f MB (%llu mips)\n", (f64)total->bytes_loaded / (f64)MB(1), (unsigned long long)total->mips_loaded);
+  printf("evicted             %.2f MB (%llu mips)\n", (f64)total->bytes_evicted / (f64)MB(1), (unsigned long long)total->mips_evicted);
+  printf("churn               %.3f MB/frame avg, %.2f MB max, %u frames with traffic\n",
+         (f64)(total->bytes_loaded + total->bytes_evicted) / (f64)MB(1) / (f64)frame_count,
+         (f64)max_frame_churn / (f64)MB(1), churn_frames);
+  printf("resident            %.2f MB final, %.2f MB peak\n", (f64)manager.resident_bytes / (f64)MB(1), (f64)manager.peak_resident_bytes / (f64)MB(1));
+  printf("over budget         %u frames\n", over_budget);
+  for (u32 array_idx = 0; array_idx < packer.array_count; ++array_idx)
+  {
+    Residency_Texture *texture = manager.textures + array_texture_ids[array_idx];
+    printf("bin %u               resident mip %u of %u\n", array_idx, texture->resident_mip, texture->mip_count);
+  }
+
+  return(over_budget ? 1 : 0);
+}
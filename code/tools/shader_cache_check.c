@@ -0,0 +1,400 @@
+// Drives the shader bytecode cache (shader_cache.c) with a stub compiler in
+// place of D3DCompile, on a small tree of shader sources it writes under
+// shader_cache_check_data/. Exits non-zero if a check fails.
+//
+// usage: shader_cache_check [thread_count]
+//
+//   hash          changes with the source, each level of include, the entry
+//                 point, the target, the flags and the defines, and only then
+//   hit           a second lookup, or one through a fresh cache, loads what
+//                 the first compiled without compiling again
+//   corrupt       truncated, foreign or mismatched files are compiled over
+//   fail          missing sources and failed compiles store nothing
+//   async         every ps_main permutation looked up on a work queue matches
+//                 the serial result, cold and then warm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../shader_permutation.h"
+#include "../shader_cache.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../shader_permutation.c"
+#include "../shader_cache.c"
+
+#define Check_Directory "shader_cache_check_data"
+#define Check_Main      Check_Directory "/main.hlsl"
+#define Check_Common    Check_Directory "/common.hlsl"
+#define Check_Deep      Check_Directory "/deep.hlsl"
+#define Check_Late      Check_Directory "/late.hlsl"
+
+typedef struct
+{
+  u32 checks;
+  u32 failures;
+} Check_Totals;
+
+static Check_Totals  g_totals;
+static volatile u32  g_compile_count;
+
+static char *g_main_text   = "#include \"common.hlsl\"\n#  include <late.hlsl>\nfloat4 ps_main() : SV_Target { return(common()); }\n";
+static char *g_common_text = "#include \"deep.hlsl\"\nfloat4 common() { return(deep()); }\n";
+static char *g_deep_text   = "float4 deep() { return(1.0f); }\n";
+
+static void
+check(b32 condition, char *name, char *detail)
+{
+  ++g_totals.checks;
+  if (!condition)
+  {
+    if (g_totals.failures < 16)
+    {
+      printf("FAIL %-8s %s\n", name, detail);
+    }
+    ++g_totals.failures;
+  }
+}
+
+static f64
+check_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+static void
+check_write(char *path, char *text)
+{
+  if (!os_file_write_all(path, text, strlen(text)))
+  {
+    printf("could not write %s\n", path);
+    exit(1);
+  }
+}
+
+// The "bytecode" spells out what went into it, so a result loaded for the
+// wrong inputs shows up as a mismatch. An entry point named "broken" fails.
+static b32
+check_stub_compile(Shader_Source *source, Shader_Bytecode *result)
+{
+#if defined(_WIN32)
+  InterlockedIncrement((volatile LONG *)&g_compile_count);
+#else
+  __atomic_add_fetch(&g_compile_count, 1, __ATOMIC_SEQ_CST);
+#endif
+
+  b32 ok = (strcmp(source->entry_point, "broken") != 0);
+  if (ok)
+  {
+    OS_File_Map map = os_file_map(source->path);
+    char text[1024];
+    u32  length = (u32)snprintf(text, sizeof(text), "%s %s %x %u", source->entry_point, source->target, source->flags, (u32)map.size);
+    for (Shader_Define *define = source->defines; define && define->name && (length < sizeof(text)); ++define)
+    {
+      length += (u32)snprintf(text + length, sizeof(text) - length, " %s=%s", define->name, define->definition);
+    }
+    os_file_unmap(&map);
+
+    length           = Minimum(length, (u32)sizeof(text) - 1);
+    result->bytecode = (u8 *)os_memory_alloc(length);
+    result->size     = length;
+    memcpy(result->bytecode, text, length);
+  }
+
+  return(ok);
+}
+
+static b32
+check_same_bytes(Shader_Bytecode *a, Shader_Bytecode *b)
+{
+  b32 result = (a->size == b->size) && a->size && (memcmp(a->bytecode, b->bytecode, a->size) == 0);
+  return(result);
+}
+
+static void
+check_forget(Shader_Cache *cache, Shader_Source *source)
+{
+  char path[ShaderCache_MaxPath];
+  shader_cache_file_path(cache, shader_cache_hash(source), path, sizeof(path));
+  os_file_delete(path);
+}
+
+// one lookup, checking whether it hit and how many compiles it cost
+static void
+check_get(Shader_Cache *cache, Shader_Source *source, b32 expect_hit, char *name, char *detail, Shader_Bytecode *result)
+{
+  u32 compiles = g_compile_count;
+  b32 ok       = shader_cache_get(cache, source, result);
+  check(ok, name, detail);
+  check(result->from_cache == expect_hit, name, detail);
+  check(g_compile_count - compiles == (expect_hit ? 0 : 1), name, detail);
+}
+
+static void
+check_hashes(Shader_Source *base)
+{
+  Shader_Define define_a[] = { { "Permutation_Lit", "1" }, { 0, 0 } };
+  Shader_Define define_b[] = { { "Permutation_Lit", "0" }, { 0, 0 } };
+  Shader_Define define_c[] = { { "Permutation_Li", "t1" }, { 0, 0 } };
+  Shader_Define define_d[] = { { "Permutation_Lit", "1" }, { "Permutation_Textured", "1" }, { 0, 0 } };
+
+  u64 hashes[16];
+  char *names[16];
+  u32 hash_count = 0;
+
+#define Check_AddHash(label, hash_value) names[hash_count] = label; hashes[hash_count++] = (hash_value)
+  Shader_Source variant = *base;
+  Check_AddHash("base", shader_cache_hash(base));
+  check(hashes[0] == shader_cache_hash(base), "hash", "stable");
+
+  variant.entry_point = "ps_other";        Check_AddHash("entry point", shader_cache_hash(&variant)); variant = *base;
+  variant.target      = "ps_4_0";          Check_AddHash("target", shader_cache_hash(&variant));      variant = *base;
+  variant.flags       = base->flags | 0x8; Check_AddHash("flags", shader_cache_hash(&variant));       variant = *base;
+  variant.defines     = define_a;          Check_AddHash("define", shader_cache_hash(&variant));
+  variant.defines     = define_b;          Check_AddHash("define value", shader_cache_hash(&variant));
+  variant.defines     = define_c;          Check_AddHash("define split", shader_cache_hash(&variant));
+  variant.defines     = define_d;          Check_AddHash("second define", shader_cache_hash(&variant));
+
+  check_write(Check_Main, "// edited\n#include \"common.hlsl\"\n#  include <late.hlsl>\n");
+  Check_AddHash("source", shader_cache_hash(base));
+  check_write(Check_Main, g_main_text);
+
+  check_write(Check_Common, "#include \"deep.hlsl\"\nfloat4 common() { return(deep() * 2.0f); }\n");
+  Check_AddHash("include", shader_cache_hash(base));
+  check_write(Check_Common, g_common_text);
+
+  check_write(Check_Deep, "float4 deep() { return(0.5f); }\n");
+  Check_AddHash("nested include", shader_cache_hash(base));
+  check_write(Check_Deep, g_deep_text);
+
+  check_write(Check_Late, "// now it exists\n");
+  Check_AddHash("new include", shader_cache_hash(base));
+  os_file_delete(Check_Late);
+#undef Check_AddHash
+
+  // restoring every file gives back the first hash
+  check(shader_cache_hash(base) == hashes[0], "hash", "restored sources");
+  for (u32 a = 0; a < hash_count; ++a)
+  {
+    for (u32 b = a + 1; b < hash_count; ++b)
+    {
+      char detail[128];
+      snprintf(detail, sizeof(detail), "%s collides with %s", names[a], names[b]);
+      check(hashes[a] != hashes[b], "hash", detail);
+    }
+  }
+}
+
+static void
+check_hits(Shader_Cache *cache, Shader_Source *base)
+{
+  Shader_Bytecode first, second, fresh, edited;
+  check_forget(cache, base);
+  check_get(cache, base, false, "hit", "cold lookup", &first);
+  check_get(cache, base, true, "hit", "warm lookup", &second);
+  check(check_same_bytes(&first, &second), "hit", "warm bytes");
+
+  // as if the engine had restarted
+  Shader_Cache restarted = *cache;
+  check_get(&restarted, base, true, "hit", "fresh cache", &fresh);
+  check(check_same_bytes(&first, &fresh), "hit", "fresh cache bytes");
+
+  // editing an include misses once, then hits; restoring it hits the old file
+  check_write(Check_Deep, "float4 deep() { return(0.25f); }\n");
+  check_forget(cache, base);
+  check_get(cache, base, false, "hit", "edited include", &edited);
+  shader_bytecode_free(&edited);
+  check_get(cache, base, true, "hit", "edited include again", &edited);
+  shader_bytecode_free(&edited);
+  check_write(Check_Deep, g_deep_text);
+  check_get(cache, base, true, "hit", "restored include", &edited);
+  check(check_same_bytes(&first, &edited), "hit", "restored include bytes");
+
+  shader_bytecode_free(&first);
+  shader_bytecode_free(&second);
+  shader_bytecode_free(&fresh);
+  shader_bytecode_free(&edited);
+}
+
+static void
+check_corruption(Shader_Cache *cache, Shader_Source *base)
+{
+  Shader_Bytecode reference;
+  check_forget(cache, base);
+  shader_cache_get(cache, base, &reference);
+
+  char path[ShaderCache_MaxPath];
+  shader_cache_file_path(cache, reference.hash, path, sizeof(path));
+
+  Shader_Cache_Header good = { ShaderCache_Magic, ShaderCache_Version, reference.hash, reference.size };
+  u8 file[sizeof(Shader_Cache_Header) + 1024];
+  memcpy(file + sizeof(good), reference.bytecode, reference.size);
+
+  struct
+  {
+    char *name;
+    u64   magic, version, hash, size, file_size;
+  } cases[] =
+  {
+    { "empty file",      good.magic,     good.version,     good.hash,     good.bytecode_size,     0 },
+    { "header only",     good.magic,     good.version,     good.hash,     good.bytecode_size,     sizeof(good) },
+    { "truncated",       good.magic,     good.version,     good.hash,     good.bytecode_size,     sizeof(good) + reference.size - 1 },
+    { "trailing bytes",  good.magic,     good.version,     good.hash,     good.bytecode_size,     sizeof(good) + reference.size + 1 },
+    { "wrong magic",     good.magic + 1, good.version,     good.hash,     good.bytecode_size,     sizeof(good) + reference.size },
+    { "old version",     good.magic,     good.version - 1, good.hash,     good.bytecode_size,     sizeof(good) + reference.size },
+    { "other hash",      good.magic,     good.version,     good.hash ^ 1, good.bytecode_size,     sizeof(good) + reference.size },
+    { "wrong size",      good.magic,     good.version,     good.hash,     good.bytecode_size - 1, sizeof(good) + reference.size },
+  };
+
+  for (u32 case_idx = 0; case_idx < ArrayCount(cases); ++case_idx)
+  {
+    Shader_Cache_Header header = { (u32)cases[case_idx].magic, (u32)cases[case_idx].version, cases[case_idx].hash, cases[case_idx].size };
+    memcpy(file, &header, sizeof(header));
+    os_file_write_all(path, file, cases[case_idx].file_size);
+
+    // compiled over, then the rewritten file loads
+    Shader_Bytecode result;
+    check_get(cache, base, false, "corrupt", cases[case_idx].name, &result);
+    check(check_same_bytes(&reference, &result), "corrupt", cases[case_idx].name);
+    shader_bytecode_free(&result);
+    check_get(cache, base, true, "corrupt", cases[case_idx].name, &result);
+    check(check_same_bytes(&reference, &result), "corrupt", cases[case_idx].name);
+    shader_bytecode_free(&result);
+  }
+
+  shader_bytecode_free(&reference);
+}
+
+static void
+check_failures(Shader_Cache *cache, Shader_Source *base)
+{
+  Shader_Bytecode result;
+  Shader_Source missing = *base;
+  missing.path = Check_Directory "/missing.hlsl";
+  u32 compiles = g_compile_count;
+  check(!shader_cache_get(cache, &missing, &result), "fail", "missing source loads");
+  check(g_compile_count == compiles, "fail", "missing source compiles");
+  check(!result.bytecode, "fail", "missing source bytecode");
+
+  Shader_Source broken = *base;
+  broken.entry_point = "broken";
+  check_forget(cache, &broken);
+  check(!shader_cache_get(cache, &broken, &result), "fail", "broken source loads");
+  check(!result.bytecode, "fail", "broken source bytecode");
+
+  char path[ShaderCache_MaxPath];
+  shader_cache_file_path(cache, shader_cache_hash(&broken), path, sizeof(path));
+  OS_File file = os_file_open(path);
+  check(!file.valid, "fail", "broken source stored");
+  os_file_close(file);
+}
+
+static void
+check_async(Shader_Cache *cache, Shader_Source *base, u32 thread_count)
+{
+  static Shader_Define    defines[ShaderKey_Count][ShaderKey_MaxDefines];
+  static Shader_Cache_Job jobs[ShaderKey_Count];
+  static Shader_Bytecode  serial[ShaderKey_Count];
+
+  u32 job_count = 0;
+  for (Shader_Key key = 0; key < ShaderKey_Count; ++key)
+  {
+    if (shader_key_normalize(key) == key)
+    {
+      shader_key_defines(key, defines[job_count]);
+      jobs[job_count] = (Shader_Cache_Job){ .cache = cache, .source = *base };
+      jobs[job_count].source.defines = defines[job_count];
+      check_forget(cache, &jobs[job_count].source);
+      ++job_count;
+    }
+  }
+
+  OS_Work_Queue *queue = os_work_queue_create(thread_count);
+  f64 pass_ms[2];
+  for (u32 pass = 0; pass < 2; ++pass)
+  {
+    u32 compiles = g_compile_count;
+    f64 begin    = check_seconds();
+    for (u32 job_idx = 0; job_idx < job_count; ++job_idx)
+    {
+      shader_cache_get_async(jobs + job_idx, queue);
+    }
+    os_work_queue_complete_all(queue);
+    pass_ms[pass] = (check_seconds() - begin) * 1000.0;
+
+    u32 hits = 0;
+    for (u32 job_idx = 0; job_idx < job_count; ++job_idx)
+    {
+      Shader_Cache_Job *job = jobs + job_idx;
+      check(job->ok, "async", pass ? "warm lookup" : "cold lookup");
+      hits += job->result.from_cache;
+      if (!pass)
+      {
+        check_stub_compile(&job->source, serial + job_idx);
+      }
+      check(check_same_bytes(&job->result, serial + job_idx), "async", pass ? "warm bytes" : "cold bytes");
+      shader_bytecode_free(&job->result);
+    }
+
+    // the serial reference compiles count on the cold pass
+    u32 compiled = g_compile_count - compiles - (pass ? 0 : job_count);
+    check(compiled == (pass ? 0 : job_count), "async", pass ? "warm compiles" : "cold compiles");
+    check(hits == (pass ? job_count : 0), "async", pass ? "warm hits" : "cold hits");
+  }
+
+  for (u32 job_idx = 0; job_idx < job_count; ++job_idx)
+  {
+    shader_bytecode_free(serial + job_idx);
+  }
+
+  printf("%u permutations on %u threads: cold %.2f ms, warm %.2f ms\n", job_count, thread_count, pass_ms[0], pass_ms[1]);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 thread_count = (argc > 1) ? (u32)atoi(argv[1]) : Maximum(os_processor_count(), 2) - 1;
+  if (!os_directory_create(Check_Directory))
+  {
+    printf("could not create %s\n", Check_Directory);
+    return(1);
+  }
+
+  check_write(Check_Main, g_main_text);
+  check_write(Check_Common, g_common_text);
+  check_write(Check_Deep, g_deep_text);
+  os_file_delete(Check_Late);
+
+  Shader_Cache  cache = { .directory = Check_Directory "/cache", .compile = check_stub_compile };
+  Shader_Source base  = { .path = Check_Main, .entry_point = "ps_main", .target = "ps_5_0", .flags = 0x801 };
+
+  check_hashes(&base);
+  check_hits(&cache, &base);
+  check_corruption(&cache, &base);
+  check_failures(&cache, &base);
+  check_async(&cache, &base, thread_count);
+
+  printf("%u checks, %u failed\n", g_totals.checks, g_totals.failures);
+  return(g_totals.failures ? 1 : 0);
+}
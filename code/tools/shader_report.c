@@ -0,0 +1,126 @@
+// Compiles ps_main once per normalised Shader_Key, as the engine queues them
+// at init, and writes each variant's instruction count next to the uber
+// shader's. Windows only: it needs D3DCompile, the compiler fxc wraps. Exits
+// non-zero if a variant fails to compile.
+//
+// usage: shader_report [table_file]
+//
+// The table goes to stdout and, given a file, there too. Variants compile
+// with the engine's release flags, since the ENGINE_DEBUG build skips
+// optimisation and its counts say little about what ships.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <d3dcompiler.h>
+#include <d3d11shader.h>
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../shader_permutation.h"
+
+#include "../my_math.c"
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../shader_permutation.c"
+
+#define Report_ShaderPath L"../code/shaders/shader_main.hlsl"
+#define Report_Flags      (D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR|D3DCOMPILE_OPTIMIZATION_LEVEL3)
+
+// 0 if it does not compile; the compiler's errors go to stderr
+static u32
+report_instruction_count(Shader_Define *defines)
+{
+  u32       result     = 0;
+  ID3DBlob *code_blob  = 0;
+  ID3DBlob *error_blob = 0;
+  HRESULT   hr         = D3DCompileFromFile(Report_ShaderPath, (D3D_SHADER_MACRO *)defines, D3D_COMPILE_STANDARD_FILE_INCLUDE,
+                                            "ps_main", "ps_5_0", Report_Flags, 0, &code_blob, &error_blob);
+  if (error_blob)
+  {
+    fprintf(stderr, "%s\n", (char *)error_blob->lpVtbl->GetBufferPointer(error_blob));
+    error_blob->lpVtbl->Release(error_blob);
+  }
+
+  if (SUCCEEDED(hr) && code_blob)
+  {
+    ID3D11ShaderReflection *reflection = 0;
+    if (SUCCEEDED(D3DReflect(code_blob->lpVtbl->GetBufferPointer(code_blob), code_blob->lpVtbl->GetBufferSize(code_blob),
+                             &IID_ID3D11ShaderReflection, (void **)&reflection)))
+    {
+      D3D11_SHADER_DESC shader_desc;
+      reflection->lpVtbl->GetDesc(reflection, &shader_desc);
+      result = shader_desc.InstructionCount;
+      reflection->lpVtbl->Release(reflection);
+    }
+  }
+
+  if (code_blob)
+  {
+    code_blob->lpVtbl->Release(code_blob);
+  }
+  return(result);
+}
+
+int
+main(int argc, char **argv)
+{
+  FILE *table = (argc > 1) ? fopen(argv[1], "w") : 0;
+  if ((argc > 1) && !table)
+  {
+    fprintf(stderr, "cannot write %s\n", argv[1]);
+    return(1);
+  }
+
+  u32 uber_count = report_instruction_count(0);
+  u32 variants   = 0;
+  u32 failures   = !uber_count;
+  u64 total      = 0;
+  char line[256];
+  snprintf(line, sizeof(line), "%-5s %-56s %6s %6s\n%-5s %-56s %6u\n", "key", "features", "instrs", "vs uber",
+           "-", "uber (no defines)", uber_count);
+  fputs(line, stdout);
+  if (table)
+  {
+    fputs(line, table);
+  }
+
+  for (Shader_Key key = 0; key < ShaderKey_Count; ++key)
+  {
+    if (shader_key_normalize(key) != key)
+    {
+      continue;
+    }
+
+    Shader_Define defines[ShaderKey_MaxDefines];
+    char          name[128];
+    shader_key_defines(key, defines);
+    shader_key_describe(key, name, sizeof(name));
+    u32 count = report_instruction_count(defines);
+    failures += !count;
+    total    += count;
+    ++variants;
+
+    snprintf(line, sizeof(line), "%-5u %-56s %6u %+6d\n", key, name, count, (s32)count - (s32)uber_count);
+    fputs(line, stdout);
+    if (table)
+    {
+      fputs(line, table);
+    }
+  }
+
+  snprintf(line, sizeof(line), "%u variants, %.1f instructions on average, %u failed to compile\n", variants,
+           variants ? (f64)total / (f64)variants : 0.0, failures);
+  fputs(line, stdout);
+  if (table)
+  {
+    fputs(line, table);
+    fclose(table);
+  }
+
+  return(failures ? 1 : 0);
+}
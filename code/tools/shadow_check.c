@@ -0,0 +1,266 @@
+// Checks the cascade fitting math (my_math.c, shadow.c) against the
+// properties the renderer relies on, over many random cameras in the default
+// scene. Exits non-zero if any check fails.
+//
+// usage: shadow_check [camera_count]
+//
+//   splits        increasing, from the near plane to Shadow_MaxDistance
+//   containment   every corner of a frustum slice lies in its sphere, and
+//                 the cascade holds the part of the slice casters reach
+//   rotation      a cascade's size does not change as the camera turns
+//   stability     moving the camera moves the map in whole texels, so a
+//                 fixed world point keeps its sub-texel position
+//   refit         a cascade kept or re-centred across a camera move holds
+//                 the moved frustum slice
+//   culling       every caster dropped for a cascade is outside the
+//                 cascade's clip volume
+//
+// It also reports each cascade's texels per metre next to the plain sphere
+// fit's, and the map size the sphere fit would need to match it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../shadow.h"
+
+#include "../my_math.c"
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../shadow.c"
+#include "check.h"
+
+static Scene_Instances g_scene;
+static Scene_Instances g_culled;
+// no casters, so the cascades fall back to their spheres
+static Scene_Instances g_empty_scene;
+
+// the part of a frustum slice the casters reach lies in the cascade's
+// square, and its depth range holds every caster that can shadow it
+static void
+check_slice_in_cascade(Shadow_Cascades *shadows, u32 cascade_idx, v3f camera_p, v3f front, v3f right, v3f up,
+                       f32 tan_half_x, f32 tan_half_y, char *name, u32 camera_idx)
+{
+  Shadow_Cascade *cascade = shadows->cascades + cascade_idx;
+  v3f min_p = v3f_zero();
+  v3f max_p = v3f_zero();
+  for (u32 corner = 0; corner < 8; ++corner)
+  {
+    f32 distance = (corner & 4) ? cascade->split_far : cascade->split_near;
+    f32 x        = ((corner & 1) ? 1.0f : -1.0f) * tan_half_x * distance;
+    f32 y        = ((corner & 2) ? 1.0f : -1.0f) * tan_half_y * distance;
+    v3f p        = v3f_add(camera_p, v3f_add(v3f_scale(distance, front), v3f_add(v3f_scale(x, right), v3f_scale(y, up))));
+    v3f light_p  = m44_transform_point(shadows->light_view, p);
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+      min_p.v[axis] = corner ? Minimum(min_p.v[axis], light_p.v[axis]) : light_p.v[axis];
+      max_p.v[axis] = corner ? Maximum(max_p.v[axis], light_p.v[axis]) : light_p.v[axis];
+    }
+  }
+
+  // float rounding at the snapped edges
+  f32 slack = 1e-3f * cascade->texel_world_size;
+  for (u32 axis = 0; axis < 2; ++axis)
+  {
+    f32 min = Maximum(min_p.v[axis], shadows->caster_min.v[axis]);
+    f32 max = Minimum(max_p.v[axis], shadows->caster_max.v[axis]);
+    if (min <= max)
+    {
+      check(cascade->center.v[axis] - cascade->radius <= min + slack, name, camera_idx, min);
+      check(cascade->center.v[axis] + cascade->radius >= max - slack, name, camera_idx, max);
+    }
+  }
+
+  f32 max_z = Minimum(max_p.z, shadows->caster_max.z);
+  check(cascade->near_plane <= shadows->caster_min.z, name, camera_idx, cascade->near_plane);
+  check((max_z < shadows->caster_min.z) || (cascade->far_plane >= max_z - slack), name, camera_idx, cascade->far_plane);
+}
+
+static v3f
+check_random_front(u32 *state)
+{
+  f32 xz = 2.0f * PIF32 * check_random(state);
+  f32 yz = Radians(10.0f + 160.0f * check_random(state));
+  return(v3f_normalized((v3f){ cosf(xz) * sinf(yz), cosf(yz), sinf(xz) * sinf(yz) }));
+}
+
+// The camera basis as scene_update_and_render builds it.
+static void
+check_camera_basis(v3f front, v3f *right, v3f *up)
+{
+  v3f temp_up = (v3f){ 0.0f, 1.0f, 0.0f };
+  *up         = v3f_normalized(v3f_sub(temp_up, v3f_scale(v3f_inner(temp_up, front), front)));
+  *right      = v3f_normalized(v3f_cross(*up, front));
+}
+
+static f32
+check_texel_phase(f32 clip)
+{
+  f32 texel = (clip * 0.5f + 0.5f) * (f32)Shadow_MapSize;
+  return(texel - floorf(texel));
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 camera_count  = (argc > 1) ? (u32)atoi(argv[1]) : 2000;
+  f32 aspect        = 720.0f / 1280.0f;
+  f32 tan_half_x    = tanf(Radians(Scene_CameraFovDegrees) * 0.5f);
+  f32 tan_half_y    = aspect * tan_half_x;
+  v3f light_dir     = scene_directional_light().dir;
+
+  Tex_Pack_Slot slots[MaterialType_Count] = {0};
+  scene_build_static(&g_scene, slots, 0);
+
+  f32 splits[Shadow_CascadeCount + 1];
+  shadow_compute_splits(Scene_CameraNear, Shadow_MaxDistance, splits);
+  check(splits[0] == Scene_CameraNear, "splits", 0, splits[0]);
+  check(splits[Shadow_CascadeCount] == Shadow_MaxDistance, "splits", 0, splits[Shadow_CascadeCount]);
+  for (u32 split_idx = 0; split_idx < Shadow_CascadeCount; ++split_idx)
+  {
+    check(splits[split_idx] < splits[split_idx + 1], "splits", 0, splits[split_idx + 1]);
+  }
+
+  Shadow_Cascades reference = {0};
+  shadow_fit_cascades(&reference, light_dir, v3f_zero(), (v3f){ 0.0f, 0.0f, 1.0f }, tan_half_x, tan_half_y, Scene_CameraNear, &g_scene);
+  Shadow_Cascades sphere_fit = {0};
+  shadow_fit_cascades(&sphere_fit, light_dir, v3f_zero(), (v3f){ 0.0f, 0.0f, 1.0f }, tan_half_x, tan_half_y, Scene_CameraNear, &g_empty_scene);
+
+  u64 kept_total = 0;
+  u32 refit_kept[Shadow_CascadeCount] = {0};
+  u32 random     = 0xC0FFEE;
+  for (u32 camera_idx = 0; camera_idx < camera_count; ++camera_idx)
+  {
+    v3f camera_p = { 80.0f * check_random(&random), 2.0f + 20.0f * check_random(&random), 80.0f * check_random(&random) };
+    v3f front    = check_random_front(&random);
+    v3f right, up;
+    check_camera_basis(front, &right, &up);
+
+    Shadow_Cascades shadows = {0};
+    shadow_fit_cascades(&shadows, light_dir, camera_p, front, tan_half_x, tan_half_y, Scene_CameraNear, &g_scene);
+
+    // a small move along a random direction, as one frame of walking would be
+    v3f step   = v3f_scale(0.05f + 0.5f * check_random(&random), check_random_front(&random));
+    v3f moved_p = v3f_add(camera_p, step);
+    Shadow_Cascades moved = {0};
+    shadow_fit_cascades(&moved, light_dir, moved_p, front, tan_half_x, tan_half_y, Scene_CameraNear, &g_scene);
+
+    // refitting the cascades the renderer keeps between frames, after a
+    // move of up to a few units so near cascades have to re-centre
+    v3f jump_p = v3f_add(camera_p, v3f_scale(4.0f * check_random(&random), check_random_front(&random)));
+    Shadow_Cascades refit = shadows;
+    shadow_fit_cascades(&refit, light_dir, jump_p, front, tan_half_x, tan_half_y, Scene_CameraNear, &g_scene);
+
+    for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+    {
+      Shadow_Cascade *cascade = shadows.cascades + cascade_idx;
+      Sphere sphere = frustum_slice_bounding_sphere(camera_p, front, tan_half_x, tan_half_y, cascade->split_near, cascade->split_far);
+
+      for (u32 corner = 0; corner < 8; ++corner)
+      {
+        f32 distance = (corner & 4) ? cascade->split_far : cascade->split_near;
+        f32 x        = ((corner & 1) ? 1.0f : -1.0f) * tan_half_x * distance;
+        f32 y        = ((corner & 2) ? 1.0f : -1.0f) * tan_half_y * distance;
+        v3f p        = v3f_add(camera_p, v3f_add(v3f_scale(distance, front), v3f_add(v3f_scale(x, right), v3f_scale(y, up))));
+        v3f to_p     = v3f_sub(p, sphere.center);
+        f32 excess   = sqrtf(v3f_inner(to_p, to_p)) - sphere.radius;
+        check(excess <= 1e-3f * sphere.radius, "containment", camera_idx, excess);
+      }
+
+      // and the snapped cascade still covers it
+      check_slice_in_cascade(&shadows, cascade_idx, camera_p, front, right, up, tan_half_x, tan_half_y, "containment", camera_idx);
+      check_slice_in_cascade(&refit, cascade_idx, jump_p, front, right, up, tan_half_x, tan_half_y, "refit", camera_idx);
+      refit_kept[cascade_idx] += m44_equal(refit.cascades[cascade_idx].world_to_clip, cascade->world_to_clip);
+
+      check(cascade->radius == reference.cascades[cascade_idx].radius, "rotation", camera_idx, cascade->radius);
+
+      // both maps sample this point at the same sub-texel offset
+      v3f anchor      = sphere.center;
+      v3f clip        = m44_transform_point(cascade->world_to_clip, anchor);
+      v3f moved_clip  = m44_transform_point(moved.cascades[cascade_idx].world_to_clip, anchor);
+      f32 phase_delta = fabsf(check_texel_phase(clip.x) - check_texel_phase(moved_clip.x)) +
+                        fabsf(check_texel_phase(clip.y) - check_texel_phase(moved_clip.y));
+      phase_delta     = Minimum(phase_delta, fabsf(phase_delta - 1.0f));
+      check(phase_delta < 0.02f, "stability", camera_idx, phase_delta);
+
+      shadow_cull_scene(&shadows, cascade_idx, &g_scene, 0, g_scene.instance_count, &g_culled);
+      kept_total += g_culled.instance_count;
+
+      u32 kept_idx = 0;
+      for (u32 instance_idx = 0; instance_idx < g_scene.instance_count; ++instance_idx)
+      {
+        Scene_Instance_Info *info = g_scene.info + instance_idx;
+        b32 kept = (kept_idx < g_culled.instance_count) && (g_culled.info[kept_idx].bound_p.x == info->bound_p.x) &&
+                   (g_culled.info[kept_idx].bound_p.y == info->bound_p.y) && (g_culled.info[kept_idx].bound_p.z == info->bound_p.z);
+        if (kept)
+        {
+          ++kept_idx;
+          continue;
+        }
+
+        if (!g_scene.ins[instance_idx].casts_shadow)
+        {
+          continue;
+        }
+
+        // dropped: the sphere's clip box must miss [-1, 1]^2 x [0, 1], give or
+        // take float rounding for spheres that just touch it
+        v3f center_clip = m44_transform_point(cascade->world_to_clip, info->bound_p);
+        f32 radius_xy   = info->bound_radius / cascade->radius - 1e-4f;
+        f32 radius_z    = info->bound_radius / (cascade->far_plane - cascade->near_plane) - 1e-4f;
+        b32 outside     = (fabsf(center_clip.x) > 1.0f + radius_xy) || (fabsf(center_clip.y) > 1.0f + radius_xy) ||
+                          (center_clip.z < -radius_z) || (center_clip.z > 1.0f + radius_z);
+        check(outside, "culling", camera_idx, center_clip.x);
+      }
+    }
+  }
+
+  // a walk at the renderer's camera speed (8 units/s at 60 Hz) while turning
+  // slowly, counting what the static cache would redraw
+  Shadow_Cascades walk  = {0};
+  Shadow_Cache    cache = {0};
+  for (u32 frame_idx = 0; frame_idx < 3600; ++frame_idx)
+  {
+    f32 t        = (f32)frame_idx / 60.0f;
+    v3f camera_p = { 10.0f + (8.0f / 60.0f) * (f32)(frame_idx % 450), 3.0f, 40.0f };
+    f32 xz       = 0.25f * sinf(0.5f * t);
+    v3f front    = v3f_normalized((v3f){ cosf(xz), -0.1f, sinf(xz) });
+    shadow_fit_cascades(&walk, light_dir, camera_p, front, tan_half_x, tan_half_y, Scene_CameraNear, &g_scene);
+    for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+    {
+      shadow_cache_needs_static_redraw(&cache, &walk, cascade_idx, 1);
+    }
+  }
+
+  printf("static redraws over a 3600 frame walk:");
+  for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+  {
+    printf(" %u", (u32)cache.static_redraws[cascade_idx]);
+  }
+  printf("\n");
+
+  // the map size the sphere fits would need for the same density
+  printf("cascades:\n");
+  for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+  {
+    Shadow_Cascade *cascade = reference.cascades + cascade_idx;
+    Shadow_Cascade *loose   = sphere_fit.cascades + cascade_idx;
+    printf("  [%5.1f, %5.1f] r %6.2f, %6.1f texels/m (sphere fit %6.1f, same density at %4.0f), depth range %6.1f\n",
+           cascade->split_near, cascade->split_far, cascade->radius, shadow_texels_per_unit(cascade), shadow_texels_per_unit(loose),
+           (f32)Shadow_MapSize * cascade->radius / loose->radius, cascade->far_plane - cascade->near_plane);
+  }
+  printf("%u cameras, %.1f of %u instances kept per cascade\n", camera_count,
+         (f64)kept_total / (f64)(camera_count * Shadow_CascadeCount), g_scene.instance_count);
+  printf("kept across a move of up to 4 units:");
+  for (u32 cascade_idx = 0; cascade_idx < Shadow_CascadeCount; ++cascade_idx)
+  {
+    printf(" %.1f%%", 100.0 * (f64)refit_kept[cascade_idx] / (f64)camera_count);
+  }
+  printf("\n");
+  return(check_report());
+}
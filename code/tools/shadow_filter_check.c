@@ -0,0 +1,160 @@
+// Holds the shadow filter kernels (shadow_filter.c, mirroring
+// shaders/shadow_filter.hlsl) against the original point sampled filter on
+// synthetic shadow maps: a sloped ground plane under random box and disc
+// casters, with receivers on the ground. Exits non-zero if a check fails.
+//
+// usage: shadow_filter_check [receiver_count]
+//
+//   taps          each kernel issues the texture instructions it claims
+//   hardware      equals the point filter read half a texel further on
+//   gather        equals the hardware kernel
+//   poisson       stays close to the hardware kernel on average
+//
+// It also reports each kernel's difference from the point filter, over all
+// receivers and over the penumbra (receivers it leaves partly lit).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../shadow_filter.h"
+
+#include "../my_math.c"
+#include "../shadow_filter.c"
+#include "check.h"
+
+#define Check_MapSize      256
+#define Check_MapCount     8
+#define Check_CasterCount  40
+// uv are whole multiples of this, so uv * size and the half texel shift are
+// exact and the kernels can be compared bit for bit
+#define Check_UVStep       (1.0f / (f32)(1 << 20))
+
+typedef struct
+{
+  f64 sum;
+  f64 penumbra_sum;
+  f32 max;
+  u32 penumbra_count;
+} Check_Difference;
+
+static f32 g_depths[Check_MapSize * Check_MapSize];
+
+static f32
+check_random_uv(u32 *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return((f32)(*state >> 12) * Check_UVStep);
+}
+
+static f32
+check_ground_depth(f32 u, f32 v)
+{
+  f32 result = 0.6f + 0.2f * u + 0.1f * v;
+  return(result);
+}
+
+static void
+check_fill_map(u32 *random)
+{
+  for (u32 y = 0; y < Check_MapSize; ++y)
+  {
+    for (u32 x = 0; x < Check_MapSize; ++x)
+    {
+      g_depths[y * Check_MapSize + x] = check_ground_depth(((f32)x + 0.5f) / Check_MapSize, ((f32)y + 0.5f) / Check_MapSize);
+    }
+  }
+
+  for (u32 caster_idx = 0; caster_idx < Check_CasterCount; ++caster_idx)
+  {
+    f32 center_x = (f32)Check_MapSize * check_random(random);
+    f32 center_y = (f32)Check_MapSize * check_random(random);
+    f32 extent   = 2.0f + 14.0f * check_random(random);
+    f32 depth    = 0.1f + 0.4f * check_random(random);
+    b32 disc     = (caster_idx & 1);
+    for (u32 y = 0; y < Check_MapSize; ++y)
+    {
+      for (u32 x = 0; x < Check_MapSize; ++x)
+      {
+        f32 d_x    = (f32)x + 0.5f - center_x;
+        f32 d_y    = (f32)y + 0.5f - center_y;
+        b32 inside = disc ? (d_x * d_x + d_y * d_y <= extent * extent) : ((fabsf(d_x) <= extent) && (fabsf(d_y) <= 0.5f * extent));
+        if (inside)
+        {
+          g_depths[y * Check_MapSize + x] = Minimum(g_depths[y * Check_MapSize + x], depth);
+        }
+      }
+    }
+  }
+}
+
+static void
+check_add_difference(Check_Difference *difference, f32 value, f32 reference)
+{
+  f32 delta = fabsf(value - reference);
+  difference->sum += delta;
+  difference->max  = Maximum(difference->max, delta);
+  if ((value > 0.0f) && (value < 1.0f))
+  {
+    difference->penumbra_sum += delta;
+    ++difference->penumbra_count;
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 receiver_count = (argc > 1) ? (u32)atoi(argv[1]) : 200000;
+  u32 per_map        = Maximum(receiver_count / Check_MapCount, 1);
+  Shadow_Filter_Map map = { .depths = g_depths, .size = Check_MapSize };
+  f32 half_texel = 0.5f / (f32)Check_MapSize;
+
+  Check_Difference differences[ShadowFilter_Count] = {0};
+  Check_Difference poisson_to_hardware = {0};
+  u32 random = 0x5AD0;
+  u32 tested = 0;
+  for (u32 map_idx = 0; map_idx < Check_MapCount; ++map_idx)
+  {
+    check_fill_map(&random);
+    for (u32 receiver_idx = 0; receiver_idx < per_map; ++receiver_idx, ++tested)
+    {
+      v2f uv    = { check_random_uv(&random), check_random_uv(&random) };
+      // a receiver on the ground, biased as ps_main does
+      f32 depth = check_ground_depth(uv.x, uv.y) - 0.002f;
+
+      f32 lit[ShadowFilter_Count];
+      for (Shadow_Filter filter = 0; filter < ShadowFilter_Count; ++filter)
+      {
+        u64 fetches = map.fetches;
+        lit[filter] = shadow_filter_lit(&map, filter, uv, depth);
+        check(map.fetches - fetches == shadow_filter_tap_count(filter), "taps", tested, (f32)(map.fetches - fetches));
+        check_add_difference(differences + filter, lit[filter], lit[ShadowFilter_Point]);
+      }
+
+      f32 point_shifted = shadow_filter_lit(&map, ShadowFilter_Point, (v2f){ uv.x - half_texel, uv.y - half_texel }, depth);
+      check(fabsf(point_shifted - lit[ShadowFilter_Hardware]) <= 1e-5f, "hardware", tested, point_shifted - lit[ShadowFilter_Hardware]);
+      check(fabsf(lit[ShadowFilter_Gather] - lit[ShadowFilter_Hardware]) <= 1e-5f, "gather", tested,
+            lit[ShadowFilter_Gather] - lit[ShadowFilter_Hardware]);
+      check_add_difference(&poisson_to_hardware, lit[ShadowFilter_Poisson], lit[ShadowFilter_Hardware]);
+    }
+  }
+
+  // edges soften differently, but on average a pixel's shade barely moves
+  f32 poisson_mean = (f32)(poisson_to_hardware.sum / (f64)tested);
+  check(poisson_mean <= 0.01f, "poisson", 0, poisson_mean);
+
+  printf("%u receivers on %u %ux%u maps\n", tested, Check_MapCount, Check_MapSize, Check_MapSize);
+  printf("kernel     taps  |lit - point| mean    max  penumbra mean\n");
+  for (Shadow_Filter filter = 0; filter < ShadowFilter_Count; ++filter)
+  {
+    Check_Difference *difference = differences + filter;
+    printf("%-9s  %4u  %18.4f  %6.3f  %13.4f\n", shadow_filter_name(filter), shadow_filter_tap_count(filter),
+           difference->sum / (f64)tested, difference->max,
+           difference->penumbra_count ? difference->penumbra_sum / (f64)difference->penumbra_count : 0.0);
+  }
+  printf("poisson against hardware: mean %.4f, max %.3f\n", poisson_mean, poisson_to_hardware.max);
+  return(check_report());
+}
@@ -0,0 +1,340 @@
+// Renders the default scene through the software backend (soft_render.c),
+// times it on 1, 2, 4, ... threads up to the processor count and writes the
+// frame as a binary PPM. Exits non-zero if a check fails.
+//
+// usage: soft_frame [output.ppm] [width height] [frame_count]
+//
+//   threads   every thread count draws the frame one thread draws, bit for bit
+//   cache     the frames drawn over the cached static shadow casters match the
+//             first, which drew them
+//   coverage  most of the frame is drawn and it is not one flat colour
+//   shadows   the frame samples the cascades, which only the sphere added to
+//             the scene does: every static instance reads the lightmap
+//
+// Materials and baked data are read from ../data the way the engine reads
+// them without a pack, and the shaded pass is culled by the occlusion buffer
+// as the engine culls it. Maps missing from ../data fall back to white, flat
+// and unraised ones.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../tex_file.h"
+#include "../cone_step.h"
+#include "../shadow.h"
+#include "../shadow_filter.h"
+#include "../light_cluster.h"
+#include "../reflection_probe.h"
+#include "../bvh.h"
+#include "../lightmap.h"
+#include "../vertex_ao.h"
+#include "../irradiance_volume.h"
+#include "../occlusion.h"
+#include "../soft_render.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../tex_file.c"
+#include "../shadow.c"
+#include "../shadow_filter.c"
+#include "../light_cluster.c"
+#include "../reflection_probe.c"
+#include "../bvh.c"
+#include "../lightmap.c"
+#include "../vertex_ao.c"
+#include "../irradiance_volume.c"
+#include "../occlusion.c"
+#include "../soft_render.c"
+#include "check.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ext/stb_image.h"
+
+static Soft_Renderer    g_renderer;
+static Soft_Material    g_materials[MaterialType_Count];
+static Scene_Instances  g_scene;
+static Scene_Instances  g_shaded;
+static Occlusion_Buffer g_occlusion;
+static Light            g_lights[Scene_LampCount + 2];
+
+static int
+bench_compare_f64(const void *a, const void *b)
+{
+  f64 x = *(f64 *)a;
+  f64 y = *(f64 *)b;
+  return((x > y) - (x < y));
+}
+
+// a baked map, or a png expanded to RGBA8; false if neither is there
+static b32
+frame_load_map(Soft_Texture *texture, Material_Type material, char *baked_name, char *png_name, b32 *baked)
+{
+  b32  result = false;
+  char path[256];
+  if (baked_name)
+  {
+    snprintf(path, sizeof(path), "../data/%s/%s", scene_material_dir(material), baked_name);
+    OS_File_Map      map    = os_file_map(path);
+    Tex_File_Header *header = tex_file_parse(map.data, map.size);
+    if (header)
+    {
+      soft_texture_from_tex_file(texture, header);
+      result = true;
+    }
+    os_file_unmap(&map);
+  }
+
+  *baked = result;
+  if (!result)
+  {
+    snprintf(path, sizeof(path), "../data/%s/%s", scene_material_dir(material), png_name);
+    s32 width = 0, height = 0, comp = 0;
+    u8 *pixels = stbi_load(path, &width, &height, &comp, 4);
+    if (pixels)
+    {
+      soft_texture_from_rgba8(texture, pixels, (u32)width, (u32)height);
+      stbi_image_free(pixels);
+      result = true;
+    }
+  }
+
+  return(result);
+}
+
+// dx11_load_material_arrays' sets, packed by the size of their maps
+static void
+frame_load_materials(Tex_Pack_Slot *material_slots)
+{
+  Tex_Packer packer = { 0 };
+  for (Material_Type material = 0; material < MaterialType_Count; ++material)
+  {
+    Soft_Material *set = g_materials + material;
+    b32 baked = false;
+    u8  white[4]    = { 255, 255, 255, 255 };
+    u8  flat[4]     = { 128, 128, 255, 255 };
+    u8  unraised[4] = { 255, 0, 0, 255 };
+    if (!frame_load_map(&set->diffuse, material, 0, "diffuse.png", &baked))
+    {
+      soft_texture_from_rgba8(&set->diffuse, white, 1, 1);
+    }
+    if (!frame_load_map(&set->normal, material, "normal.tex", "normal.png", &baked))
+    {
+      soft_texture_from_rgba8(&set->normal, flat, 1, 1);
+    }
+    if (!frame_load_map(&set->displace, material, "displacement.tex", "displacement.png", &set->cone_step))
+    {
+      soft_texture_from_rgba8(&set->displace, unraised, 1, 1);
+    }
+
+    Soft_Texture *sized = (set->diffuse.width > 1) ? &set->diffuse : ((set->normal.width > 1) ? &set->normal : &set->displace);
+    material_slots[material] = tex_pack_add(&packer, (s32)sized->width, (s32)sized->height);
+    soft_render_set_material(&g_renderer, material_slots[material], set);
+    printf("%s: %ux%u, %u mips%s\n", scene_material_dir(material), sized->width, sized->height, sized->mip_count,
+           set->cone_step ? ", cone step" : "");
+  }
+}
+
+static void
+frame_render(Soft_View *view, u32 frame_count, OS_Work_Queue *queue, f64 *frame_ms, u32 *first_frame)
+{
+  shadow_cache_invalidate(&g_renderer.shadow_cache);
+  for (u32 frame_idx = 0; frame_idx < frame_count; ++frame_idx)
+  {
+    f64 begin = check_seconds();
+    soft_render_frame(&g_renderer, &g_scene, &g_shaded, view, queue);
+    frame_ms[frame_idx] = (check_seconds() - begin) * 1000.0;
+    if (frame_idx == 0)
+    {
+      memcpy(first_frame, g_renderer.colour, (u64)g_renderer.width * g_renderer.height * sizeof(u32));
+    }
+  }
+
+  check(!memcmp(first_frame, g_renderer.colour, (u64)g_renderer.width * g_renderer.height * sizeof(u32)), "cache", frame_count, 0.0);
+}
+
+int
+main(int argc, char **argv)
+{
+  char *out_path    = (argc > 1) ? argv[1] : "soft_frame.ppm";
+  u32   width       = (argc > 3) ? (u32)atoi(argv[2]) : 1280;
+  u32   height      = (argc > 3) ? (u32)atoi(argv[3]) : 720;
+  u32   frame_count = (argc > 4) ? (u32)atoi(argv[4]) : 4;
+  width       = Maximum(width & ~1u, 2);
+  height      = Maximum(height & ~1u, 2);
+  frame_count = Maximum(frame_count, 1);
+
+  soft_render_alloc(&g_renderer, width, height);
+  Tex_Pack_Slot material_slots[MaterialType_Count];
+  frame_load_materials(material_slots);
+
+  OS_File_Map probe_map = os_file_map("../data/" ReflectionProbe_DefaultPath);
+  soft_render_load_reflection_probes(&g_renderer, reflection_probe_parse(probe_map.data, probe_map.size));
+  os_file_unmap(&probe_map);
+  scene_build_static(&g_scene, material_slots, g_renderer.reflection_probe_count);
+
+  OS_File_Map lightmap_map = os_file_map("../data/" Lightmap_DefaultPath);
+  soft_render_load_lightmap(&g_renderer, lightmap_parse(lightmap_map.data, lightmap_map.size), &g_scene);
+  os_file_unmap(&lightmap_map);
+  OS_File_Map ao_map = os_file_map("../data/" VertexAO_DefaultPath);
+  soft_render_load_vertex_ao(&g_renderer, vertex_ao_parse(ao_map.data, ao_map.size), &g_scene);
+  os_file_unmap(&ao_map);
+  OS_File_Map irradiance_map = os_file_map("../data/" IrradianceVolume_DefaultPath);
+  soft_render_load_irradiance_volume(&g_renderer, irradiance_volume_parse(irradiance_map.data, irradiance_map.size));
+  os_file_unmap(&irradiance_map);
+  printf("baked: %u reflection probes, %ux%u lightmap, %s vertex occlusion, %u irradiance probes\n",
+         g_renderer.reflection_probe_count, g_renderer.lightmap_width, g_renderer.lightmap_height,
+         g_renderer.vertex_ao ? "with" : "no", g_renderer.irradiance_probes ? g_renderer.irradiance_grid.probe_count : 0);
+
+  u32 directional_light_count = 0;
+  u32 light_count = scene_build_lights(g_lights, &directional_light_count);
+  scene_animate_lights(g_lights, 0.0f);
+  scene_begin_dynamic(&g_scene);
+  scene_add_light_gizmos(&g_scene, g_lights, light_count);
+  // a lit dynamic sphere on the platform, with no lightmap, so the threads
+  // and cache checks cover the shadow pass and shadow_filter too
+  scene_add_instance(&g_scene, SceneModel_Sphere, (v3f){ 14.0f, 4.0f, 14.0f }, (v3f){ 3.0f, 3.0f, 3.0f }, m33_make_identity(),
+                     (v4f){ 0.8f, 0.8f, 0.8f, 1.0f }, MaterialType_None);
+
+  // from a corner of the hall, above the platform and looking across it
+  f32 rotate_xz = Radians(45.0f);
+  f32 rotate_yz = Radians(110.0f);
+  v3f eye       = { -6.0f, 16.0f, -6.0f };
+  v3f front     = v3f_normalized((v3f){ cosf(rotate_xz) * sinf(rotate_yz), cosf(rotate_yz), sinf(rotate_xz) * sinf(rotate_yz) });
+  v3f up        = v3f_normalized(v3f_sub((v3f){ 0.0f, 1.0f, 0.0f }, v3f_scale(front.y, front)));
+  v3f right     = v3f_normalized(v3f_cross(up, front));
+
+  f32 camera_fov = Radians(Scene_CameraFovDegrees);
+  Soft_View view =
+  {
+    .eye                     = eye,
+    .front                   = front,
+    .world_to_view           = (m44)
+    {
+      right.x, up.x, front.x, 0.0f,
+      right.y, up.y, front.y, 0.0f,
+      right.z, up.z, front.z, 0.0f,
+      -v3f_inner(right, eye), -v3f_inner(up, eye), -v3f_inner(front, eye), 1.0f
+    },
+    .projection              = m44_make_perspective_z01((f32)height / (f32)width, camera_fov, Scene_CameraNear, Scene_CameraFar),
+    .tan_half_fov_x          = tanf(camera_fov * 0.5f),
+    .tan_half_fov_y          = tanf(camera_fov * 0.5f) * ((f32)height / (f32)width),
+    .lights                  = g_lights,
+    .light_count             = light_count,
+    .directional_light_count = directional_light_count,
+  };
+
+  occlusion_buffer_alloc(&g_occlusion);
+  occlusion_gather_occluders(&g_occlusion, &g_scene);
+  occlusion_set_camera(&g_occlusion, eye, m44_mul(view.world_to_view, view.projection));
+  occlusion_render(&g_occlusion, 0);
+  occlusion_cull_scene(&g_occlusion, &g_scene, &g_shaded);
+
+  u64  pixel_count = (u64)width * height;
+  u32 *serial      = malloc(pixel_count * sizeof(u32));
+  u32 *first_frame = malloc(pixel_count * sizeof(u32));
+  f64 *frame_ms    = malloc(frame_count * sizeof(f64));
+  printf("%ux%u, %u of %u instances shaded, %u lights, %u frames per run\n",
+         width, height, g_shaded.instance_count, g_scene.instance_count, light_count, frame_count);
+
+  // powers of two and then the processor count, and at least 4 so the
+  // threads check has something to compare on a small machine
+  u32 processor_count = os_processor_count();
+  u32 thread_counts[32];
+  u32 run_count = 0;
+  for (u32 thread_count = 1; thread_count < Maximum(processor_count, 4); thread_count *= 2)
+  {
+    thread_counts[run_count++] = thread_count;
+  }
+  thread_counts[run_count++] = Maximum(processor_count, 4);
+
+  f64 serial_ms = 0.0;
+  for (u32 run_idx = 0; run_idx < run_count; ++run_idx)
+  {
+    u32 thread_count = thread_counts[run_idx];
+    // the calling thread joins in, so the queue gets one fewer
+    OS_Work_Queue *queue = (thread_count > 1) ? os_work_queue_create(thread_count - 1) : 0;
+    frame_render(&view, frame_count, queue, frame_ms, first_frame);
+    if (thread_count == 1)
+    {
+      memcpy(serial, g_renderer.colour, pixel_count * sizeof(u32));
+    }
+    check(!memcmp(serial, g_renderer.colour, pixel_count * sizeof(u32)), "threads", thread_count, 0.0);
+
+    // the first frame redraws the static casters, the rest reuse them
+    f64 first_ms = frame_ms[0];
+    qsort(frame_ms, frame_count, sizeof(f64), bench_compare_f64);
+    f64 median_ms = frame_ms[(frame_count - 1) / 2];
+    if (thread_count == 1)
+    {
+      serial_ms = median_ms;
+    }
+    printf("%2u threads: %8.2f ms first frame, %8.2f ms median, %5.2fx\n", thread_count, first_ms, median_ms, serial_ms / median_ms);
+  }
+
+  printf("last frame: %u triangles, %llu shaded quads (%.2f pixels each), %llu shadow fetches, %u pass retries\n",
+         g_renderer.triangle_count, (unsigned long long)g_renderer.shaded_quads,
+         g_renderer.shaded_quads ? (f64)pixel_count / (f64)g_renderer.shaded_quads : 0.0,
+         (unsigned long long)g_renderer.shadow_fetches, g_renderer.pass_retries);
+
+  u64 drawn = 0;
+  for (u64 pixel = 0; pixel < pixel_count; ++pixel)
+  {
+    drawn += (serial[pixel] != 0);
+  }
+  u32 samples[256];
+  u32 distinct = 0;
+  for (u32 sample_idx = 0; sample_idx < ArrayCount(samples); ++sample_idx)
+  {
+    u32 value = serial[(pixel_count * sample_idx) / ArrayCount(samples)];
+    b32 seen  = false;
+    for (u32 before = 0; before < distinct; ++before)
+    {
+      seen |= (samples[before] == value);
+    }
+    if (!seen)
+    {
+      samples[distinct++] = value;
+    }
+  }
+  check(g_renderer.shadow_fetches > 0, "shadows", 0, (f64)g_renderer.shadow_fetches);
+  check(drawn * 4 >= pixel_count, "coverage drawn", 0, (f64)drawn / (f64)pixel_count);
+  check(distinct >= 16, "coverage distinct", 0, (f64)distinct);
+
+  FILE *file = fopen(out_path, "wb");
+  if (file)
+  {
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    for (u64 pixel = 0; pixel < pixel_count; ++pixel)
+    {
+      u8 rgb[3] = { (u8)serial[pixel], (u8)(serial[pixel] >> 8), (u8)(serial[pixel] >> 16) };
+      fwrite(rgb, 1, 3, file);
+    }
+    fclose(file);
+    printf("wrote %s\n", out_path);
+  }
+  check(file != 0, "write", 0, 0.0);
+
+  return(check_report());
+}
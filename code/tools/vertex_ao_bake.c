@@ -0,0 +1,117 @@
+// Bakes the per vertex occlusion of the default scene (see vertex_ao.h) into
+// one file the engine uploads as an R8_UNORM buffer.
+//
+// usage: vertex_ao_bake <out.vao> [sample_count] [thread_count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../vertex_ao.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../vertex_ao.c"
+
+#define Bake_DefaultSamples 64
+
+static Scene_Instances g_scene;
+
+static f64
+bake_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+int
+main(int argc, char **argv)
+{
+  if ((argc < 2) || (argc > 4))
+  {
+    fprintf(stderr, "usage: vertex_ao_bake <out.vao> [sample_count] [thread_count]\n");
+    return(1);
+  }
+
+  u32 sample_count = (argc >= 3) ? (u32)atoi(argv[2]) : Bake_DefaultSamples;
+  u32 thread_count = (argc == 4) ? (u32)atoi(argv[3]) : Maximum(os_processor_count(), 2) - 1;
+  OS_Work_Queue *queue = thread_count ? os_work_queue_create(thread_count) : 0;
+
+  // the instance order has to match the engine's, probes or not
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+
+  Scene_Mesh meshes[SceneModel_Count];
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    meshes[model] = scene_mesh_for_model(model);
+  }
+
+  f64 start = bake_seconds();
+  u32 triangle_count             = bvh_scene_triangle_count(&g_scene, meshes);
+  Bvh_Source_Triangle *triangles = (Bvh_Source_Triangle *)os_memory_alloc((u64)triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, meshes, triangles);
+  Bvh bvh;
+  bvh_build(&bvh, triangles, triangle_count, queue);
+  f64 build_end = bake_seconds();
+
+  Vertex_AO_Layout layout;
+  vertex_ao_layout(&layout, &g_scene, meshes);
+
+  Vertex_AO_Bake bake =
+  {
+    .scene        = &g_scene,
+    .meshes       = meshes,
+    .bvh          = &bvh,
+    .sample_count = Minimum(Maximum(sample_count, 1), VertexAO_MaxSamples),
+    .distance     = VertexAO_Distance,
+  };
+
+  f32 *ao = (f32 *)os_memory_alloc(Maximum(layout.vertex_count, 1) * sizeof(f32));
+  vertex_ao_bake(&bake, &layout, ao, queue);
+  f64 bake_end = bake_seconds();
+
+  f64 sum = 0.0;
+  for (u32 vertex_idx = 0; vertex_idx < layout.vertex_count; ++vertex_idx)
+  {
+    sum += ao[vertex_idx];
+  }
+
+  u64 file_size = vertex_ao_file_size(&layout);
+  u8 *file_data = os_memory_alloc(file_size);
+  vertex_ao_encode(file_data, &layout, ao);
+  if (!os_file_write_all(argv[1], file_data, file_size))
+  {
+    fprintf(stderr, "vertex_ao_bake: cannot write %s\n", argv[1]);
+    return(1);
+  }
+
+  printf("%s: %u vertices over %u instances, mean %.3f, %.1f KB, %u samples; bvh %.1f ms, bake %.1f ms (%.2f Mrays/s) on %u threads\n",
+         argv[1], layout.vertex_count, layout.instance_count, sum / (f64)Maximum(layout.vertex_count, 1), (f64)file_size / 1024.0,
+         bake.sample_count, (build_end - start) * 1000.0, (bake_end - build_end) * 1000.0,
+         (f64)layout.vertex_count * bake.sample_count / ((bake_end - build_end) * 1e6), thread_count);
+  return(0);
+}
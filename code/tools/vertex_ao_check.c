@@ -0,0 +1,282 @@
+// Checks the per vertex occlusion baker (vertex_ao.c) on the default scene and
+// on small scenes whose answers are known. Exits non-zero if a check fails.
+//
+// usage: vertex_ao_check [thread_count]
+//
+//   layout        every lit static instance of the default scene has a run
+//                 of its mesh's vertex count, back to back
+//   open          a cube alone sees nothing of itself, a sphere next to
+//                 nothing; both stay unoccluded
+//   contact       a block resting on a floor: the sides' bottom vertices
+//                 lose the lower half of their hemisphere, the top ones
+//                 less, the top face and the floor's far corners nothing,
+//                 and the face pressed into the floor nearly all
+//   threads       a bake on a work queue is bit-identical to a serial one
+//   file          encode and parse round trip, and cut short or foreign
+//                 files are rejected
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <emmintrin.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../my_math.h"
+#include "../os/os.h"
+#include "../tex_pack.h"
+#include "../scene.h"
+#include "../scene_mesh.h"
+#include "../bvh.h"
+#include "../vertex_ao.h"
+
+#include "../my_math.c"
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../tex_pack.c"
+#include "../scene.c"
+#include "../scene_mesh.c"
+#include "../bvh.c"
+#include "../vertex_ao.c"
+#include "check.h"
+
+#define Check_SampleCount 64
+
+static Scene_Instances g_scene;
+static Scene_Mesh      g_meshes[SceneModel_Count];
+
+// a bake of g_scene as it stands
+typedef struct
+{
+  Vertex_AO_Layout     layout;
+  Bvh                  bvh;
+  Bvh_Source_Triangle *triangles;
+  u32                  triangle_count;
+  Vertex_AO_Bake       bake;
+  f32                 *ao;
+} Check_Bake;
+
+static void
+check_bake_begin(Check_Bake *check_bake)
+{
+  check_bake->triangle_count = bvh_scene_triangle_count(&g_scene, g_meshes);
+  check_bake->triangles      = (Bvh_Source_Triangle *)os_memory_alloc((u64)check_bake->triangle_count * sizeof(Bvh_Source_Triangle));
+  bvh_gather_scene(&g_scene, g_meshes, check_bake->triangles);
+  bvh_build(&check_bake->bvh, check_bake->triangles, check_bake->triangle_count, 0);
+  vertex_ao_layout(&check_bake->layout, &g_scene, g_meshes);
+
+  check_bake->bake = (Vertex_AO_Bake)
+  {
+    .scene        = &g_scene,
+    .meshes       = g_meshes,
+    .bvh          = &check_bake->bvh,
+    .sample_count = Check_SampleCount,
+    .distance     = VertexAO_Distance,
+  };
+  check_bake->ao = (f32 *)os_memory_alloc(Maximum(check_bake->layout.vertex_count, 1) * sizeof(f32));
+}
+
+static void
+check_bake_end(Check_Bake *check_bake)
+{
+  os_memory_free(check_bake->ao, Maximum(check_bake->layout.vertex_count, 1) * sizeof(f32));
+  bvh_free(&check_bake->bvh);
+  os_memory_free(check_bake->triangles, (u64)check_bake->triangle_count * sizeof(Bvh_Source_Triangle));
+}
+
+static void
+check_layout(void)
+{
+  Tex_Pack_Slot material_slots[MaterialType_Count] = { 0 };
+  scene_build_static(&g_scene, material_slots, 0);
+
+  Vertex_AO_Layout layout;
+  vertex_ao_layout(&layout, &g_scene, g_meshes);
+  check(layout.instance_count == g_scene.static_instance_count, "layout", 0, (f32)layout.instance_count);
+
+  u32 expected_vertex = 0;
+  for (u32 batch_idx = 0; batch_idx < g_scene.static_batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch = g_scene.batches + batch_idx;
+    u32 instance_end   = batch->first_instance + batch->instance_count;
+    if (batch_idx == g_scene.static_batch_count - 1)
+    {
+      instance_end = batch->first_instance + g_scene.static_last_batch_instance_count;
+    }
+
+    for (u32 instance_idx = batch->first_instance; instance_idx < instance_end; ++instance_idx)
+    {
+      if (g_scene.ins[instance_idx].enable_lighting)
+      {
+        check(layout.first_vertex[instance_idx] == expected_vertex, "layout", 1, (f32)instance_idx);
+        expected_vertex += g_meshes[batch->model].vertex_count;
+      }
+      else
+      {
+        check(layout.first_vertex[instance_idx] == VertexAO_None, "layout", 2, (f32)instance_idx);
+      }
+    }
+  }
+  check(expected_vertex == layout.vertex_count, "layout", 3, (f32)layout.vertex_count);
+  printf("layout: %u vertices over %u instances, %.1f KB\n", layout.vertex_count, layout.instance_count,
+         (f64)vertex_ao_file_size(&layout) / 1024.0);
+}
+
+static void
+check_bakes(u32 thread_count)
+{
+  // open: a cube and, far off, a sphere
+  check_scene_begin(&g_scene);
+  scene_add_instance(&g_scene, SceneModel_Cube, v3f_zero(), v3f_s(2.0f), m33_make_identity(),
+                     (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_None);
+  scene_add_instance(&g_scene, SceneModel_Sphere, (v3f){ 100.0f, 0.0f, 0.0f }, v3f_s(1.0f), m33_make_identity(),
+                     (v4f){ 1.0f, 1.0f, 1.0f, 1.0f }, MaterialType_None);
+  check_scene_end(&g_scene);
+
+  Check_Bake open;
+  check_bake_begin(&open);
+  vertex_ao_bake(&open.bake, &open.layout, open.ao, 0);
+  {
+    u32 cube   = open.layout.first_vertex[0];
+    u32 sphere = open.layout.first_vertex[1];
+    for (u32 vertex_idx = 0; vertex_idx < g_meshes[SceneModel_Cube].vertex_count; ++vertex_idx)
+    {
+      check(open.ao[cube + vertex_idx] == 1.0f, "open", vertex_idx, open.ao[cube + vertex_idx]);
+    }
+
+    // flat triangles dip below a smooth normal's horizon, but only just
+    f32 darkest = 1.0f;
+    for (u32 vertex_idx = 0; vertex_idx < g_meshes[SceneModel_Sphere].vertex_count; ++vertex_idx)
+    {
+      darkest = Minimum(darkest, open.ao[sphere + vertex_idx]);
+    }
+    check(darkest >= 0.95f, "open", 1000, darkest);
+  }
+  check_bake_end(&open);
+
+  // contact: a 40 wide floor, its top at y = 0.5, and a block of side 2
+  // resting on its middle
+  check_scene_begin(&g_scene);
+  scene_add_instance(&g_scene, SceneModel_Cube, v3f_zero(), (v3f){ 40.0f, 1.0f, 40.0f }, m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  scene_add_instance(&g_scene, SceneModel_Cube, (v3f){ 0.0f, 1.5f, 0.0f }, v3f_s(2.0f), m33_make_identity(),
+                     (v4f){ 0.5f, 0.5f, 0.5f, 1.0f }, MaterialType_None);
+  check_scene_end(&g_scene);
+
+  Check_Bake contact;
+  check_bake_begin(&contact);
+  f64 serial_start = check_seconds();
+  vertex_ao_bake(&contact.bake, &contact.layout, contact.ao, 0);
+  f64 serial_end = check_seconds();
+  {
+    Scene_Mesh *cube  = g_meshes + SceneModel_Cube;
+    u32         floor = contact.layout.first_vertex[0];
+    u32         block = contact.layout.first_vertex[1];
+    f32 side_bottom_min = 1.0f, side_bottom_max = 0.0f, side_top_min = 1.0f, bottom_max = 0.0f, top_min = 1.0f, floor_min = 1.0f;
+    for (u32 vertex_idx = 0; vertex_idx < cube->vertex_count; ++vertex_idx)
+    {
+      Model_Vertex *vertex = cube->vertices + vertex_idx;
+      f32 value = contact.ao[block + vertex_idx];
+      if (vertex->normal.y > 0.5f)
+      {
+        top_min = Minimum(top_min, value);
+      }
+      else if (vertex->normal.y < -0.5f)
+      {
+        bottom_max = Maximum(bottom_max, value);
+      }
+      else if (vertex->p.y < 0.0f)
+      {
+        side_bottom_min = Minimum(side_bottom_min, value);
+        side_bottom_max = Maximum(side_bottom_max, value);
+      }
+      else
+      {
+        side_top_min = Minimum(side_top_min, value);
+      }
+
+      // the floor's corners are 19 from the block, past VertexAO_Distance
+      floor_min = Minimum(floor_min, contact.ao[floor + vertex_idx]);
+    }
+
+    check(fabsf(side_bottom_min - 0.5f) < 0.05f, "contact", 0, side_bottom_min);
+    check(fabsf(side_bottom_max - 0.5f) < 0.05f, "contact", 1, side_bottom_max);
+    check((side_top_min > side_bottom_max) && (side_top_min < 1.0f), "contact", 2, side_top_min);
+    check(top_min == 1.0f, "contact", 3, top_min);
+    check(bottom_max < 0.1f, "contact", 4, bottom_max);
+    check(floor_min == 1.0f, "contact", 5, floor_min);
+  }
+
+  // threads: the same bake through the queue
+  {
+    u64 ao_size = (u64)contact.layout.vertex_count * sizeof(f32);
+    f32 *threaded = (f32 *)os_memory_alloc(ao_size);
+    OS_Work_Queue *queue = os_work_queue_create(Maximum(thread_count, 2));
+    f64 threaded_start = check_seconds();
+    vertex_ao_bake(&contact.bake, &contact.layout, threaded, queue);
+    f64 threaded_end = check_seconds();
+    check(memcmp(contact.ao, threaded, ao_size) == 0, "threads", 0, 0.0f);
+    printf("bake of %u vertices: serial %.2f ms, %u threads %.2f ms\n", contact.layout.vertex_count,
+           (serial_end - serial_start) * 1000.0, Maximum(thread_count, 2), (threaded_end - threaded_start) * 1000.0);
+    os_memory_free(threaded, ao_size);
+  }
+
+  // file: encode, parse and read back
+  {
+    Vertex_AO_Layout *layout = &contact.layout;
+    u64 file_size = vertex_ao_file_size(layout);
+    u8 *file_data = os_memory_alloc(file_size);
+    vertex_ao_encode(file_data, layout, contact.ao);
+
+    Vertex_AO_Header *header = vertex_ao_parse(file_data, file_size);
+    check(header != 0, "file", 0, 0.0f);
+    if (header)
+    {
+      check((header->instance_count == 2) && (header->vertex_count == layout->vertex_count), "file", 1, (f32)header->vertex_count);
+      u32 *first_vertex = (u32 *)(header + 1);
+      u8  *ao           = (u8 *)(first_vertex + header->instance_count);
+      check((first_vertex[0] == layout->first_vertex[0]) && (first_vertex[1] == layout->first_vertex[1]), "file", 2, (f32)first_vertex[1]);
+      f32 worst = 0.0f;
+      for (u32 vertex_idx = 0; vertex_idx < layout->vertex_count; ++vertex_idx)
+      {
+        worst = Maximum(worst, fabsf((f32)ao[vertex_idx] / 255.0f - contact.ao[vertex_idx]));
+      }
+      check(worst <= 0.5f / 255.0f + 1e-6f, "file", 3, worst);
+    }
+
+    check(vertex_ao_parse(file_data, file_size - 1) == 0, "file", 4, 0.0f);
+    check(vertex_ao_parse(file_data, sizeof(Vertex_AO_Header) - 1) == 0, "file", 5, 0.0f);
+    ((Vertex_AO_Header *)file_data)->version = VertexAO_Version + 1;
+    check(vertex_ao_parse(file_data, file_size) == 0, "file", 6, 0.0f);
+    ((Vertex_AO_Header *)file_data)->version = VertexAO_Version;
+    ((Vertex_AO_Header *)file_data)->magic   = 0;
+    check(vertex_ao_parse(file_data, file_size) == 0, "file", 7, 0.0f);
+    check(vertex_ao_parse(0, 0) == 0, "file", 8, 0.0f);
+    os_memory_free(file_data, file_size);
+  }
+  check_bake_end(&contact);
+}
+
+int
+main(int argc, char **argv)
+{
+  u32 thread_count = (argc > 1) ? (u32)atoi(argv[1]) : Maximum(os_processor_count(), 2) - 1;
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    g_meshes[model] = scene_mesh_for_model(model);
+  }
+
+  check_layout();
+  check_bakes(thread_count);
+
+  return(check_report());
+}
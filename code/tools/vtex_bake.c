@@ -0,0 +1,554 @@
+// Bakes material maps into a .vtex virtual texture, and replays a synthetic
+// camera against one to exercise the runtime side (feedback analysis, tile
+// cache, page table and threaded loads) without a GPU.
+//
+// usage: vtex_bake bake <out.vtex> <diffuse> <normal> <displacement> [tiles_per_side]
+//        vtex_bake replay <in.vtex> [frame_count] [cache_slots]
+//
+// Any map may be given as "-" to fill that layer with a neutral value. The
+// virtual size is tiles_per_side * VTex_TileContent; without a count the
+// power of two closest to the largest source map is used.
+//
+// The replay checks the page table and the cache after every frame, then
+// that damaged copies of the file are refused, and exits non-zero if any of
+// it is off. cache_slots caps the cache below its
+// VTexCache_SlotCount slots, so a small file still has to evict.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include "../base.h"
+#include "../os/os.h"
+#include "../vtex.h"
+
+#if defined(_WIN32)
+# include "../os/os_win32.c"
+#else
+# include "../os/os_linux.c"
+#endif
+#include "../vtex.c"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../ext/stb_image.h"
+
+typedef struct
+{
+  u8  *texels;
+  s32  width;
+  s32  height;
+} Bake_Image;
+
+static u8 g_bake_neutral[VTexLayer_Count][4] =
+{
+  [VTexLayer_Diffuse]   = { 255, 255, 255, 255 },
+  [VTexLayer_Normal]    = { 128, 128, 255, 255 },
+  [VTexLayer_Displace]  = { 0, 0, 0, 255 },
+};
+
+static f64
+bake_seconds(void)
+{
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return((f64)now.tv_sec + (f64)now.tv_nsec * 1e-9);
+}
+
+// Bilinear resample with wrapping; the engine's meshes repeat the texture.
+static Bake_Image
+bake_resample(u8 *source, s32 source_width, s32 source_height, s32 width, s32 height)
+{
+  Bake_Image result = { malloc((size_t)width * height * 4), width, height };
+  for (s32 y = 0; y < height; ++y)
+  {
+    f32 fy  = ((f32)y + 0.5f) * (f32)source_height / (f32)height - 0.5f;
+    s32 y0  = (s32)floorf(fy);
+    f32 ty  = fy - (f32)y0;
+    s32 sy0 = ((y0 % source_height) + source_height) % source_height;
+    s32 sy1 = (sy0 + 1) % source_height;
+    for (s32 x = 0; x < width; ++x)
+    {
+      f32 fx  = ((f32)x + 0.5f) * (f32)source_width / (f32)width - 0.5f;
+      s32 x0  = (s32)floorf(fx);
+      f32 tx  = fx - (f32)x0;
+      s32 sx0 = ((x0 % source_width) + source_width) % source_width;
+      s32 sx1 = (sx0 + 1) % source_width;
+
+      u8 *a = source + (sy0 * source_width + sx0) * 4;
+      u8 *b = source + (sy0 * source_width + sx1) * 4;
+      u8 *c = source + (sy1 * source_width + sx0) * 4;
+      u8 *d = source + (sy1 * source_width + sx1) * 4;
+      u8 *dest = result.texels + ((size_t)y * width + x) * 4;
+      for (s32 channel = 0; channel < 4; ++channel)
+      {
+        f32 top    = (f32)a[channel] + ((f32)b[channel] - (f32)a[channel]) * tx;
+        f32 bottom = (f32)c[channel] + ((f32)d[channel] - (f32)c[channel]) * tx;
+        dest[channel] = (u8)(top + (bottom - top) * ty + 0.5f);
+      }
+    }
+  }
+
+  return(result);
+}
+
+static Bake_Image
+bake_downsample(Bake_Image *source)
+{
+  s32 width  = Maximum(source->width / 2, 1);
+  s32 height = Maximum(source->height / 2, 1);
+  Bake_Image result = { malloc((size_t)width * height * 4), width, height };
+  for (s32 y = 0; y < height; ++y)
+  {
+    s32 y0 = (2 * y) % source->height;
+    s32 y1 = (2 * y + 1) % source->height;
+    for (s32 x = 0; x < width; ++x)
+    {
+      s32 x0 = (2 * x) % source->width;
+      s32 x1 = (2 * x + 1) % source->width;
+      u8 *dest = result.texels + ((size_t)y * width + x) * 4;
+      for (s32 channel = 0; channel < 4; ++channel)
+      {
+        u32 sum = source->texels[((size_t)y0 * source->width + x0) * 4 + channel] +
+                  source->texels[((size_t)y0 * source->width + x1) * 4 + channel] +
+                  source->texels[((size_t)y1 * source->width + x0) * 4 + channel] +
+                  source->texels[((size_t)y1 * source->width + x1) * 4 + channel];
+        dest[channel] = (u8)((sum + 2) / 4);
+      }
+    }
+  }
+
+  return(result);
+}
+
+// Copies one tile plus its border out of a mip, wrapping at the edges.
+static void
+bake_copy_tile(Bake_Image *mip, u32 tile_x, u32 tile_y, u8 *dest)
+{
+  s32 origin_x = (s32)(tile_x * VTex_TileContent) - VTex_TileBorder;
+  s32 origin_y = (s32)(tile_y * VTex_TileContent) - VTex_TileBorder;
+  for (s32 y = 0; y < VTex_TileSize; ++y)
+  {
+    s32 source_y = (((origin_y + y) % mip->height) + mip->height) % mip->height;
+    for (s32 x = 0; x < VTex_TileSize; ++x)
+    {
+      s32 source_x = (((origin_x + x) % mip->width) + mip->width) % mip->width;
+      memcpy(dest + (y * VTex_TileSize + x) * 4, mip->texels + ((size_t)source_y * mip->width + source_x) * 4, 4);
+    }
+  }
+}
+
+static s32
+bake(char *out_path, char *layer_paths[VTexLayer_Count], u32 tiles_per_side)
+{
+  u8 *sources[VTexLayer_Count]  = { 0 };
+  s32 widths[VTexLayer_Count]   = { 0 };
+  s32 heights[VTexLayer_Count]  = { 0 };
+  s32 largest = 0;
+  for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+  {
+    if (strcmp(layer_paths[layer], "-") == 0)
+    {
+      sources[layer] = g_bake_neutral[layer];
+      widths[layer]  = 1;
+      heights[layer] = 1;
+      continue;
+    }
+
+    s32 comp = 0;
+    sources[layer] = stbi_load(layer_paths[layer], widths + layer, heights + layer, &comp, 4);
+    if (!sources[layer])
+    {
+      fprintf(stderr, "vtex_bake: cannot load %s\n", layer_paths[layer]);
+      return(1);
+    }
+
+    largest = Maximum(largest, Maximum(widths[layer], heights[layer]));
+  }
+
+  if (!tiles_per_side)
+  {
+    tiles_per_side = 1;
+    while ((tiles_per_side * 2 * VTex_TileContent) <= (u32)(largest + largest / 2))
+    {
+      tiles_per_side *= 2;
+    }
+  }
+
+  if ((tiles_per_side & (tiles_per_side - 1)) || (tiles_per_side > 256))
+  {
+    fprintf(stderr, "vtex_bake: tiles_per_side must be a power of two no larger than 256\n");
+    return(1);
+  }
+
+  VTex_File_Header header =
+  {
+    .magic        = VTex_Magic,
+    .version      = VTex_Version,
+    .width        = tiles_per_side * VTex_TileContent,
+    .height       = tiles_per_side * VTex_TileContent,
+    .layer_count  = VTexLayer_Count,
+  };
+
+  for (u32 tiles = tiles_per_side; ; tiles /= 2)
+  {
+    Assert(header.mip_count < VTex_MaxMips);
+    header.tiles_x[header.mip_count]    = tiles;
+    header.tiles_y[header.mip_count]    = tiles;
+    header.first_tile[header.mip_count] = header.tile_count;
+    header.tile_count                  += tiles * tiles;
+    ++header.mip_count;
+    if (tiles == 1)
+    {
+      break;
+    }
+  }
+
+  FILE *out = fopen(out_path, "wb");
+  if (!out)
+  {
+    fprintf(stderr, "vtex_bake: cannot write %s\n", out_path);
+    return(1);
+  }
+
+  VTex_Tile_Entry *tiles = calloc(header.tile_count, sizeof(VTex_Tile_Entry));
+  u64 table_end          = sizeof(VTex_File_Header) + header.tile_count * sizeof(VTex_Tile_Entry);
+  u64 payload_stride     = AlignAToB((u64)VTex_TilePayloadBytes, (u64)VTex_PayloadAlign);
+  u64 payload_start      = AlignAToB(table_end, (u64)VTex_PayloadAlign);
+  for (u32 tile_idx = 0; tile_idx < header.tile_count; ++tile_idx)
+  {
+    tiles[tile_idx].offset = payload_start + tile_idx * payload_stride;
+    tiles[tile_idx].size   = VTex_TilePayloadBytes;
+  }
+
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(tiles, sizeof(VTex_Tile_Entry), header.tile_count, out);
+
+  f64 start = bake_seconds();
+  Bake_Image mips[VTexLayer_Count];
+  for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+  {
+    mips[layer] = bake_resample(sources[layer], widths[layer], heights[layer], (s32)header.width, (s32)header.height);
+  }
+
+  u8 *payload = calloc(1, payload_stride);
+  fseek(out, (long)payload_start, SEEK_SET);
+  for (u32 mip = 0; mip < header.mip_count; ++mip)
+  {
+    if (mip)
+    {
+      for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+      {
+        Bake_Image next = bake_downsample(mips + layer);
+        free(mips[layer].texels);
+        mips[layer] = next;
+      }
+    }
+
+    for (u32 tile_y = 0; tile_y < header.tiles_y[mip]; ++tile_y)
+    {
+      for (u32 tile_x = 0; tile_x < header.tiles_x[mip]; ++tile_x)
+      {
+        for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+        {
+          bake_copy_tile(mips + layer, tile_x, tile_y, payload + layer * (VTex_TileSize * VTex_TileSize * VTex_BytesPerTexel));
+        }
+        fwrite(payload, payload_stride, 1, out);
+      }
+    }
+  }
+
+  fclose(out);
+  printf("%s: %ux%u virtual, %u mips, %u tiles, %.1f MB, baked in %.2fs\n", out_path, header.width, header.height,
+         header.mip_count, header.tile_count, (f64)(payload_start + header.tile_count * payload_stride) / (f64)MB(1),
+         bake_seconds() - start);
+
+  for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+  {
+    free(mips[layer].texels);
+    if (sources[layer] != g_bake_neutral[layer])
+    {
+      stbi_image_free(sources[layer]);
+    }
+  }
+  free(payload);
+  free(tiles);
+  return(0);
+}
+
+#define Replay_FeedbackWidth  160
+#define Replay_FeedbackHeight 90
+#define Replay_ScreenWidth    1280.0f
+
+static u32 g_replay_uploads;
+static u32 g_replay_failures;
+
+static void
+replay_check(b32 passed, char *name, u32 frame, u32 index)
+{
+  if (!passed)
+  {
+    ++g_replay_failures;
+    if (g_replay_failures <= 20)
+    {
+      printf("FAIL %s frame %u [%u]\n", name, frame, index);
+    }
+  }
+}
+
+// Every entry points at a resident slot holding the tile itself or an
+// ancestor of it, and at the tile itself whenever that is resident.
+static void
+replay_check_pages(VTex_System *system, u32 frame, u32 slot_count)
+{
+  VTex_File_Header *header = &system->header;
+  for (u32 mip = 0; mip < header->mip_count; ++mip)
+  {
+    for (u32 y = 0; y < header->tiles_y[mip]; ++y)
+    {
+      for (u32 x = 0; x < header->tiles_x[mip]; ++x)
+      {
+        VTex_Page page  = system->pages[mip][y * header->tiles_x[mip] + x];
+        u32 slot_idx    = page.phys_y * VTexCache_TilesX + page.phys_x;
+        b32 ok          = page.valid && (page.mip >= mip) && (page.mip < header->mip_count) && (slot_idx < slot_count);
+        if (ok)
+        {
+          u32 shift       = page.mip - mip;
+          VTex_Slot *slot = system->slots + slot_idx;
+          ok = (slot->state == VTexSlotState_Resident) && (slot->tile == vtex_tile_id(x >> shift, y >> shift, page.mip));
+        }
+
+        u32 own_slot = vtex_find_slot(system, vtex_tile_id(x, y, mip));
+        if (ok && (own_slot != VTexSlot_None) && (system->slots[own_slot].state == VTexSlotState_Resident))
+        {
+          ok = (page.mip == mip);
+        }
+        replay_check(ok, "page", frame, vtex_tile_id(x, y, mip));
+      }
+    }
+  }
+}
+
+// The LRU list holds the resident slots, most recently used first, the free
+// list the free ones, and together with the loads they account for every
+// slot once. Each tile is findable through the hash, and what is resident is
+// the root tile plus every load less every eviction.
+static void
+replay_check_cache(VTex_System *system, u32 frame, u32 slot_count)
+{
+  u32 resident_count = 0;
+  u64 last_used      = system->frame;
+  for (u16 slot_idx = system->lru_head; (slot_idx != VTexSlot_None) && (resident_count <= slot_count); slot_idx = system->slots[slot_idx].lru_next)
+  {
+    VTex_Slot *slot = system->slots + slot_idx;
+    replay_check((slot_idx < slot_count) && (slot->state == VTexSlotState_Resident), "cache lru state", frame, slot_idx);
+    replay_check(vtex_find_slot(system, slot->tile) == slot_idx, "cache lru hash", frame, slot_idx);
+    replay_check(slot->last_used_frame <= last_used, "cache lru order", frame, slot_idx);
+    last_used = slot->last_used_frame;
+    ++resident_count;
+  }
+
+  u32 free_count = 0;
+  for (u16 slot_idx = system->free_head; (slot_idx != VTexSlot_None) && (free_count <= slot_count); slot_idx = system->slots[slot_idx].lru_next)
+  {
+    replay_check((slot_idx < slot_count) && (system->slots[slot_idx].state == VTexSlotState_Free), "cache free state", frame, slot_idx);
+    ++free_count;
+  }
+
+  u32 loading_count = 0;
+  for (u32 slot_idx = 0; slot_idx < slot_count; ++slot_idx)
+  {
+    VTex_Slot *slot = system->slots + slot_idx;
+    if (slot->state == VTexSlotState_Loading)
+    {
+      replay_check(vtex_find_slot(system, slot->tile) == slot_idx, "cache loading hash", frame, slot_idx);
+      ++loading_count;
+    }
+  }
+
+  u64 loaded  = system->total_stats.tiles_loaded + system->frame_stats.tiles_loaded;
+  u64 evicted = system->total_stats.tiles_evicted + system->frame_stats.tiles_evicted;
+  replay_check(resident_count + free_count + loading_count == slot_count, "cache slot count", frame, resident_count + free_count + loading_count);
+  replay_check(loading_count == system->load_count, "cache loads", frame, loading_count);
+  replay_check(resident_count == 1 + loaded - evicted, "cache resident count", frame, resident_count);
+}
+
+static void
+replay_upload(void *user, u32 slot_x, u32 slot_y, u8 *layers[VTexLayer_Count])
+{
+  (void)user;
+  Assert((slot_x < VTexCache_TilesX) && (slot_y < VTexCache_TilesY) && layers[0]);
+  ++g_replay_uploads;
+}
+
+// Damaged copies of the file must not open: a mip past the tile table, a
+// chain that does not halve, tile counts whose product wraps, a table cut
+// short and a payload past the end. The copy as is still opens.
+static void
+replay_check_rejects(char *path, OS_Work_Queue *queue)
+{
+  OS_File_Map map = os_file_map(path);
+  if (!map.data || (map.size < sizeof(VTex_File_Header)))
+  {
+    replay_check(false, "reject map", 0, 0);
+    return;
+  }
+
+  char bad_path[512];
+  snprintf(bad_path, sizeof(bad_path), "%s.bad", path);
+  u8 *copy = os_memory_alloc(map.size);
+  VTex_System *system = os_memory_alloc(sizeof(VTex_System));
+  for (u32 case_idx = 0; case_idx < 6; ++case_idx)
+  {
+    memcpy(copy, map.data, map.size);
+    VTex_File_Header *header = (VTex_File_Header *)copy;
+    VTex_Tile_Entry  *tiles  = (VTex_Tile_Entry *)(header + 1);
+    u64 size = map.size;
+    switch (case_idx)
+    {
+      case 1: header->first_tile[header->mip_count - 1] = header->tile_count; break;
+      case 2: header->tiles_x[0] *= 2; header->tiles_y[0] *= 2; break;
+      case 3: header->tiles_x[0] = 0x10000; header->tiles_y[0] = 0x10000; break;
+      case 4: size = sizeof(VTex_File_Header) + header->tile_count * sizeof(VTex_Tile_Entry) / 2; break;
+      case 5: tiles[0].offset = map.size; break;
+    }
+
+    b32 opened = os_file_write_all(bad_path, copy, size) && vtex_open(system, bad_path, queue, replay_upload, 0);
+    if (opened)
+    {
+      vtex_close(system);
+    }
+    replay_check(opened == (case_idx == 0), "reject", 0, case_idx);
+  }
+
+  os_file_delete(bad_path);
+  os_memory_free(system, sizeof(VTex_System));
+  os_memory_free(copy, map.size);
+  os_file_unmap(&map);
+}
+
+// Fills a feedback buffer the way ps_main would for a flat view of the
+// virtual texture: extent is the width of uv space covered by the screen.
+static void
+replay_feedback(VTex_File_Header *header, u32 *feedback, f32 center_u, f32 center_v, f32 extent)
+{
+  f32 lod = log2f(Maximum(extent * (f32)header->width / Replay_ScreenWidth, 1.0f));
+  u32 mip = Minimum((u32)lod, header->mip_count - 1);
+  for (u32 y = 0; y < Replay_FeedbackHeight; ++y)
+  {
+    for (u32 x = 0; x < Replay_FeedbackWidth; ++x)
+    {
+      f32 u = center_u + extent * (((f32)x + 0.5f) / Replay_FeedbackWidth - 0.5f);
+      f32 v = center_v + extent * (((f32)y + 0.5f) / Replay_FeedbackWidth - 0.5f * Replay_FeedbackHeight / Replay_FeedbackWidth);
+      u -= floorf(u);
+      v -= floorf(v);
+      u32 tile_x = (u32)(u * (f32)header->tiles_x[mip]);
+      u32 tile_y = (u32)(v * (f32)header->tiles_y[mip]);
+      feedback[y * Replay_FeedbackWidth + x] = vtex_tile_id(tile_x, tile_y, mip);
+    }
+  }
+}
+
+static s32
+replay(char *path, u32 frame_count, u32 slot_count)
+{
+  OS_Work_Queue *queue = os_work_queue_create(Maximum(os_processor_count(), 2) - 1);
+  VTex_System *system  = os_memory_alloc(sizeof(VTex_System));
+  if (!vtex_open(system, path, queue, replay_upload, 0))
+  {
+    fprintf(stderr, "vtex_bake: cannot open %s\n", path);
+    return(1);
+  }
+
+  if ((slot_count < 2) || (slot_count > VTexCache_SlotCount))
+  {
+    fprintf(stderr, "vtex_bake: cache_slots must be from 2 to %u\n", VTexCache_SlotCount);
+    vtex_close(system);
+    return(1);
+  }
+  vtex_limit_cache(system, slot_count);
+
+  static u32 feedback[Replay_FeedbackWidth * Replay_FeedbackHeight];
+  f64 analyze_seconds = 0.0;
+  f64 page_seconds    = 0.0;
+  u32 exact_frames    = 0;
+  for (u32 frame = 0; frame < frame_count; ++frame)
+  {
+    // pan across the texture while zooming in and out
+    f32 t       = (f32)frame / (f32)frame_count;
+    f32 extent  = 0.02f + 0.98f * (0.5f + 0.5f * cosf(t * 6.2831853f * 3.0f));
+    replay_feedback(&system->header, feedback, t * 2.0f, 0.3f + 0.2f * sinf(t * 6.2831853f), extent);
+
+    f64 start = bake_seconds();
+    vtex_update(system, feedback, ArrayCount(feedback));
+    analyze_seconds += bake_seconds() - start;
+
+    vtex_poll_loads(system, replay_upload, 0);
+
+    start = bake_seconds();
+    vtex_update_page_table(system);
+    page_seconds += bake_seconds() - start;
+    for (u32 mip = 0; mip < system->header.mip_count; ++mip)
+    {
+      system->page_mip_dirty[mip] = false;
+    }
+
+    replay_check_pages(system, frame, slot_count);
+    replay_check_cache(system, frame, slot_count);
+
+    // how often everything the frame asked for is there at the requested mip
+    b32 exact = true;
+    for (u32 texel_idx = 0; texel_idx < ArrayCount(feedback); ++texel_idx)
+    {
+      u32 tile  = feedback[texel_idx];
+      u32 mip   = vtex_tile_mip(tile);
+      VTex_Page page = system->pages[mip][vtex_tile_y(tile) * system->header.tiles_x[mip] + vtex_tile_x(tile)];
+      exact = exact && (page.mip == mip);
+    }
+    exact_frames += exact;
+  }
+
+  VTex_Stats *stats = &system->total_stats;
+  printf("frames:              %u, %u cache slots\n", frame_count, slot_count);
+  printf("tile requests:       %llu (%.2f%% resident)\n", (unsigned long long)stats->requests,
+         stats->requests ? 100.0 * (f64)stats->hits / (f64)stats->requests : 100.0);
+  printf("tiles loaded:        %llu (%u uploads)\n", (unsigned long long)stats->tiles_loaded, g_replay_uploads);
+  printf("tiles evicted:       %llu\n", (unsigned long long)stats->tiles_evicted);
+  printf("loads deferred:      %llu\n", (unsigned long long)stats->loads_deferred);
+  printf("page entries moved:  %llu\n", (unsigned long long)stats->page_entries_changed);
+  printf("fully exact frames:  %.2f%%\n", 100.0 * (f64)exact_frames / (f64)frame_count);
+  printf("feedback analysis:   %.3f ms/frame\n", 1000.0 * analyze_seconds / (f64)frame_count);
+  printf("page table rebuild:  %.3f ms/frame\n", 1000.0 * page_seconds / (f64)frame_count);
+
+  vtex_close(system);
+  replay_check_rejects(path, queue);
+  printf("invariant failures:  %u\n", g_replay_failures);
+  return(g_replay_failures ? 1 : 0);
+}
+
+int
+main(int argc, char **argv)
+{
+  s32 result = 1;
+  if ((argc >= 6) && (strcmp(argv[1], "bake") == 0))
+  {
+    char *layer_paths[VTexLayer_Count] = { argv[3], argv[4], argv[5] };
+    result = bake(argv[2], layer_paths, (argc > 6) ? (u32)atoi(argv[6]) : 0);
+  }
+  else if ((argc >= 3) && (strcmp(argv[1], "replay") == 0))
+  {
+    result = replay(argv[2], (argc > 3) ? (u32)atoi(argv[3]) : 2000, (argc > 4) ? (u32)atoi(argv[4]) : VTexCache_SlotCount);
+  }
+  else
+  {
+    fprintf(stderr, "usage: vtex_bake bake <out.vtex> <diffuse> <normal> <displacement> [tiles_per_side]\n"
+                    "       vtex_bake replay <in.vtex> [frame_count] [cache_slots]\n");
+  }
+
+  return(result);
+}
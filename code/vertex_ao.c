@@ -0,0 +1,302 @@
+static void
+vertex_ao_layout(Vertex_AO_Layout *layout, Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count])
+{
+  layout->instance_count = scene->static_instance_count;
+  layout->vertex_count   = 0;
+  for (u32 instance_idx = 0; instance_idx < layout->instance_count; ++instance_idx)
+  {
+    layout->first_vertex[instance_idx] = VertexAO_None;
+  }
+
+  for (u32 batch_idx = 0; batch_idx < scene->static_batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch = scene->batches + batch_idx;
+    u32 instance_end   = batch->first_instance + batch->instance_count;
+    if (batch_idx == scene->static_batch_count - 1)
+    {
+      instance_end = batch->first_instance + scene->static_last_batch_instance_count;
+    }
+
+    for (u32 instance_idx = batch->first_instance; instance_idx < instance_end; ++instance_idx)
+    {
+      if (scene->ins[instance_idx].enable_lighting)
+      {
+        layout->first_vertex[instance_idx] = layout->vertex_count;
+        layout->vertex_count              += meshes[batch->model].vertex_count;
+      }
+    }
+  }
+}
+
+static f32
+vertex_ao_random(u32 *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  f32 result = (f32)(*state >> 8) * (1.0f / 16777216.0f);
+  return(result);
+}
+
+static f32
+vertex_ao_radical_inverse(u32 bits)
+{
+  bits = (bits << 16) | (bits >> 16);
+  bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+  bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+  bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+  bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+  return((f32)bits * 2.3283064365386963e-10f);
+}
+
+// what the jobs share; next_instance hands out the static instances
+typedef struct
+{
+  Vertex_AO_Bake   *bake;
+  Vertex_AO_Layout *layout;
+  Scene_Model       models[MaxSceneInstances];
+  // per model, each vertex moved VertexAO_Inset of the way toward the
+  // centroid of its triangles, in model space
+  v3f              *inset_p[SceneModel_Count];
+  f32              *ao;
+  volatile u64      next_instance;
+} Vertex_AO_Jobs;
+
+// sample_count cosine weighted directions about normal, a Hammersley set
+// under a per vertex shift, traced in packets of one octant each
+static f32
+vertex_ao_occlusion(Vertex_AO_Bake *bake, v3f origin, v3f normal, u32 seed)
+{
+  v3f up        = (fabsf(normal.y) < 0.999f) ? (v3f){ 0.0f, 1.0f, 0.0f } : (v3f){ 1.0f, 0.0f, 0.0f };
+  v3f tangent   = v3f_normalized(v3f_cross(up, normal));
+  v3f bitangent = v3f_cross(normal, tangent);
+  u32 rng       = seed;
+  f32 shift_x   = vertex_ao_random(&rng);
+  f32 shift_y   = vertex_ao_random(&rng);
+
+  v3f dirs[VertexAO_MaxSamples];
+  u32 octants[VertexAO_MaxSamples];
+  u32 octant_counts[8] = { 0 };
+  for (u32 sample_idx = 0; sample_idx < bake->sample_count; ++sample_idx)
+  {
+    f32 xi_x   = (f32)sample_idx / (f32)bake->sample_count + shift_x;
+    f32 xi_y   = vertex_ao_radical_inverse(sample_idx) + shift_y;
+    xi_x      -= floorf(xi_x);
+    xi_y      -= floorf(xi_y);
+    f32 radius = sqrtf(xi_x);
+    f32 phi    = 2.0f * PIF32 * xi_y;
+    v3f dir    = v3f_add(v3f_add(v3f_scale(radius * cosf(phi), tangent), v3f_scale(radius * sinf(phi), bitangent)),
+                         v3f_scale(sqrtf(Maximum(1.0f - xi_x, 0.0f)), normal));
+    dirs[sample_idx]    = dir;
+    octants[sample_idx] = (dir.x < 0.0f) | ((dir.y < 0.0f) << 1) | ((dir.z < 0.0f) << 2);
+    ++octant_counts[octants[sample_idx]];
+  }
+
+  // counting sort, so every packet shares its signs and stays coherent
+  u32 octant_first[8];
+  u32 order[VertexAO_MaxSamples];
+  u32 running = 0;
+  for (u32 octant = 0; octant < 8; ++octant)
+  {
+    octant_first[octant] = running;
+    running             += octant_counts[octant];
+  }
+
+  for (u32 sample_idx = 0; sample_idx < bake->sample_count; ++sample_idx)
+  {
+    order[octant_first[octants[sample_idx]]++] = sample_idx;
+  }
+
+  u32 occluded = 0;
+  u32 start    = 0;
+  for (u32 octant = 0; octant < 8; ++octant)
+  {
+    u32 end = start + octant_counts[octant];
+    for (u32 first = start; first < end; first += Bvh_PacketSize)
+    {
+      // lanes past the octant's end repeat its first ray and are not counted
+      u32 lane_count = Minimum(end - first, Bvh_PacketSize);
+      Bvh_Packet packet;
+      for (u32 lane = 0; lane < Bvh_PacketSize; ++lane)
+      {
+        v3f dir = dirs[order[first + ((lane < lane_count) ? lane : 0)]];
+        packet.origin_x[lane] = origin.x;
+        packet.origin_y[lane] = origin.y;
+        packet.origin_z[lane] = origin.z;
+        packet.dir_x[lane]    = dir.x;
+        packet.dir_y[lane]    = dir.y;
+        packet.dir_z[lane]    = dir.z;
+        packet.t_min[lane]    = 0.0f;
+        packet.t_max[lane]    = bake->distance;
+      }
+
+      u32 hits = bvh_occluded_packet(bake->bvh, &packet) & ((1u << lane_count) - 1);
+      for (u32 lane = 0; lane < lane_count; ++lane)
+      {
+        occluded += (hits >> lane) & 1;
+      }
+    }
+    start = end;
+  }
+
+  f32 result = 1.0f - (f32)occluded / (f32)bake->sample_count;
+  return(result);
+}
+
+static void
+vertex_ao_job(void *data)
+{
+  Vertex_AO_Jobs   *jobs   = (Vertex_AO_Jobs *)data;
+  Vertex_AO_Bake   *bake   = jobs->bake;
+  Vertex_AO_Layout *layout = jobs->layout;
+  for (u64 instance_idx = AtomicAddU64(&jobs->next_instance, 1); instance_idx < layout->instance_count;
+       instance_idx = AtomicAddU64(&jobs->next_instance, 1))
+  {
+    u32 first_vertex = layout->first_vertex[instance_idx];
+    if (first_vertex == VertexAO_None)
+    {
+      continue;
+    }
+
+    Model_Instance *instance = bake->scene->ins + instance_idx;
+    Scene_Mesh     *mesh     = bake->meshes + jobs->models[instance_idx];
+    v3f            *inset_p  = jobs->inset_p[jobs->models[instance_idx]];
+    for (u32 vertex_idx = 0; vertex_idx < mesh->vertex_count; ++vertex_idx)
+    {
+      v3f normal = v3f_normalized(m33_mul_v3f(instance->model_to_world_xform_it, mesh->vertices[vertex_idx].normal));
+      v3f p      = v3f_add(m33_mul_v3f(instance->model_to_world_xform, inset_p[vertex_idx]), instance->p);
+      v3f origin = v3f_add(p, v3f_scale(VertexAO_RayEpsilon, normal));
+      u32 seed   = (first_vertex + vertex_idx) * 0x9E3779B9u + 0x7F4A7C15u;
+      jobs->ao[first_vertex + vertex_idx] = vertex_ao_occlusion(bake, origin, normal, seed);
+    }
+  }
+}
+
+static void
+vertex_ao_bake(Vertex_AO_Bake *bake, Vertex_AO_Layout *layout, f32 *ao, OS_Work_Queue *queue)
+{
+  Assert((bake->sample_count > 0) && (bake->sample_count <= VertexAO_MaxSamples));
+  Vertex_AO_Jobs *jobs = (Vertex_AO_Jobs *)os_memory_alloc(sizeof(Vertex_AO_Jobs));
+  jobs->bake          = bake;
+  jobs->layout        = layout;
+  jobs->ao            = ao;
+  jobs->next_instance = 0;
+
+  Scene_Instances *scene = bake->scene;
+  for (u32 batch_idx = 0; batch_idx < scene->static_batch_count; ++batch_idx)
+  {
+    Scene_Batch *batch = scene->batches + batch_idx;
+    u32 instance_end   = batch->first_instance + batch->instance_count;
+    if (batch_idx == scene->static_batch_count - 1)
+    {
+      instance_end = batch->first_instance + scene->static_last_batch_instance_count;
+    }
+
+    for (u32 instance_idx = batch->first_instance; instance_idx < instance_end; ++instance_idx)
+    {
+      jobs->models[instance_idx] = batch->model;
+    }
+  }
+
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    Scene_Mesh *mesh = bake->meshes + model;
+    v3f *centroid_sum = (v3f *)os_memory_alloc(Maximum(mesh->vertex_count, 1) * sizeof(v3f));
+    f32 *weight       = (f32 *)os_memory_alloc(Maximum(mesh->vertex_count, 1) * sizeof(f32));
+    jobs->inset_p[model] = (v3f *)os_memory_alloc(Maximum(mesh->vertex_count, 1) * sizeof(v3f));
+    for (u32 vertex_idx = 0; vertex_idx < mesh->vertex_count; ++vertex_idx)
+    {
+      centroid_sum[vertex_idx] = v3f_zero();
+      weight[vertex_idx]       = 0.0f;
+    }
+
+    for (u32 index = 0; index < mesh->index_count; index += 3)
+    {
+      v3f p0 = mesh->vertices[mesh->indices[index + 0]].p;
+      v3f p1 = mesh->vertices[mesh->indices[index + 1]].p;
+      v3f p2 = mesh->vertices[mesh->indices[index + 2]].p;
+      v3f centroid = v3f_scale(1.0f / 3.0f, v3f_add(v3f_add(p0, p1), p2));
+      for (u32 vertex = 0; vertex < 3; ++vertex)
+      {
+        u32 vertex_idx = mesh->indices[index + vertex];
+        centroid_sum[vertex_idx] = v3f_add(centroid_sum[vertex_idx], centroid);
+        weight[vertex_idx]      += 1.0f;
+      }
+    }
+
+    for (u32 vertex_idx = 0; vertex_idx < mesh->vertex_count; ++vertex_idx)
+    {
+      v3f p = mesh->vertices[vertex_idx].p;
+      if (weight[vertex_idx] > 0.0f)
+      {
+        v3f centroid = v3f_scale(1.0f / weight[vertex_idx], centroid_sum[vertex_idx]);
+        p = v3f_add(p, v3f_scale(VertexAO_Inset, v3f_sub(centroid, p)));
+      }
+      jobs->inset_p[model][vertex_idx] = p;
+    }
+
+    os_memory_free(centroid_sum, Maximum(mesh->vertex_count, 1) * sizeof(v3f));
+    os_memory_free(weight, Maximum(mesh->vertex_count, 1) * sizeof(f32));
+  }
+
+  if (queue)
+  {
+    for (u32 job_idx = 0; job_idx < VertexAO_JobCount; ++job_idx)
+    {
+      os_work_queue_add(queue, vertex_ao_job, jobs);
+    }
+    os_work_queue_complete_all(queue);
+  }
+  else
+  {
+    vertex_ao_job(jobs);
+  }
+
+  for (Scene_Model model = 0; model < SceneModel_Count; ++model)
+  {
+    os_memory_free(jobs->inset_p[model], Maximum(bake->meshes[model].vertex_count, 1) * sizeof(v3f));
+  }
+  os_memory_free(jobs, sizeof(Vertex_AO_Jobs));
+}
+
+static u64
+vertex_ao_file_size(Vertex_AO_Layout *layout)
+{
+  u64 result = sizeof(Vertex_AO_Header) + (u64)layout->instance_count * sizeof(u32) + layout->vertex_count;
+  return(result);
+}
+
+static void
+vertex_ao_encode(u8 *dest, Vertex_AO_Layout *layout, f32 *ao)
+{
+  Vertex_AO_Header *header = (Vertex_AO_Header *)dest;
+  *header = (Vertex_AO_Header)
+  {
+    .magic          = VertexAO_Magic,
+    .version        = VertexAO_Version,
+    .instance_count = layout->instance_count,
+    .vertex_count   = layout->vertex_count,
+  };
+
+  u32 *first_vertex = (u32 *)(header + 1);
+  for (u32 instance_idx = 0; instance_idx < layout->instance_count; ++instance_idx)
+  {
+    first_vertex[instance_idx] = layout->first_vertex[instance_idx];
+  }
+
+  u8 *packed = (u8 *)(first_vertex + layout->instance_count);
+  for (u32 vertex_idx = 0; vertex_idx < layout->vertex_count; ++vertex_idx)
+  {
+    f32 value = Minimum(Maximum(ao[vertex_idx], 0.0f), 1.0f);
+    packed[vertex_idx] = (u8)(value * 255.0f + 0.5f);
+  }
+}
+
+static Vertex_AO_Header *
+vertex_ao_parse(u8 *data, u64 size)
+{
+  Vertex_AO_Header *result = (Vertex_AO_Header *)data;
+  b32 valid = data && (size >= sizeof(Vertex_AO_Header)) &&
+              (result->magic == VertexAO_Magic) && (result->version == VertexAO_Version) &&
+              (result->instance_count <= MaxSceneInstances) &&
+              (size >= sizeof(Vertex_AO_Header) + (u64)result->instance_count * sizeof(u32) + result->vertex_count);
+  return(valid ? result : 0);
+}
@@ -0,0 +1,77 @@
+#if !defined(VERTEX_AO_H)
+#define VERTEX_AO_H
+
+// Ambient occlusion per vertex of the static instances, baked offline by
+// tools/vertex_ao_bake.c. It darkens ps_main's flat ambient where geometry
+// meets, so no screen space pass is needed at runtime.
+//
+// Every instance of a model shares the model's vertex buffer, so the values
+// cannot ride along in it. Each lit static instance instead owns a run of
+// them, one per vertex of its mesh (scene_mesh.h): vs_main reads
+// g_vertex_ao[ao_first_vertex + SV_VertexID] and the value is interpolated
+// like any other attribute.
+//
+// A vertex's value is the fraction of cosine weighted rays, out to
+// VertexAO_Distance, that leave without hitting the BVH (bvh.h). The rays
+// start a little inside the triangles around the vertex, so a vertex on a
+// face resting against another sees that face instead of slipping past it.
+// Directions are sorted by octant and traced four at a time as packets.
+//
+// Layout of a file:
+//   Vertex_AO_Header
+//   u32 first_vertex[instance_count]  per static instance, or VertexAO_None
+//   u8  ao[vertex_count]              DXGI_FORMAT_R8_UNORM
+
+#define VertexAO_Magic          0x4F415856 // "VXAO"
+#define VertexAO_Version        1
+// relative to data/
+#define VertexAO_DefaultPath    "vertex_ao.vao"
+// world units; the blocks are Scene_BlockWidth wide
+#define VertexAO_Distance       4.0f
+// how far a ray origin moves from the vertex toward the centroid of the
+// triangles around it, as a fraction of the way
+#define VertexAO_Inset          0.02f
+// ray origins are pushed this far off a surface before tracing on
+#define VertexAO_RayEpsilon     1e-3f
+#define VertexAO_MaxSamples     256
+// jobs that pull instances until none are left
+#define VertexAO_JobCount       64
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 instance_count;
+  u32 vertex_count;
+} Vertex_AO_Header;
+
+typedef struct
+{
+  // the static instances, each VertexAO_None or the first of its vertices
+  u32 instance_count;
+  u32 vertex_count;
+  u32 first_vertex[MaxSceneInstances];
+} Vertex_AO_Layout;
+
+// What a bake sees: the static part of scene through the BVH built from it.
+typedef struct
+{
+  Scene_Instances *scene;
+  Scene_Mesh      *meshes;
+  Bvh             *bvh;
+  // at most VertexAO_MaxSamples
+  u32              sample_count;
+  f32              distance;
+} Vertex_AO_Bake;
+
+// a run of vertices for every lit static instance of scene
+static void              vertex_ao_layout(Vertex_AO_Layout *layout, Scene_Instances *scene, Scene_Mesh meshes[SceneModel_Count]);
+// Fills ao (layout->vertex_count) with values in [0, 1], 1 unoccluded;
+// queue may be 0. The result does not depend on the thread count.
+static void              vertex_ao_bake(Vertex_AO_Bake *bake, Vertex_AO_Layout *layout, f32 *ao, OS_Work_Queue *queue);
+static u64               vertex_ao_file_size(Vertex_AO_Layout *layout);
+static void              vertex_ao_encode(u8 *dest, Vertex_AO_Layout *layout, f32 *ao);
+// Validates a file in place; returns 0 if it is not one.
+static Vertex_AO_Header *vertex_ao_parse(u8 *data, u64 size);
+
+#endif
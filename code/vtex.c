@@ -0,0 +1,595 @@
+static u32
+vtex_tile_index(VTex_File_Header *header, u32 tile)
+{
+  u32 mip    = vtex_tile_mip(tile);
+  u32 result = header->first_tile[mip] + vtex_tile_y(tile) * header->tiles_x[mip] + vtex_tile_x(tile);
+  return(result);
+}
+
+static b32
+vtex_tile_is_valid(VTex_File_Header *header, u32 tile)
+{
+  u32 mip    = vtex_tile_mip(tile);
+  b32 result = (tile != VTexTile_None) && (mip < header->mip_count) &&
+               (vtex_tile_x(tile) < header->tiles_x[mip]) && (vtex_tile_y(tile) < header->tiles_y[mip]);
+  return(result);
+}
+
+static u32
+vtex_hash_tile(u32 tile)
+{
+  u32 result = tile * 2654435761u;
+  result ^= result >> 15;
+  return(result);
+}
+
+static VTex_Request *
+vtex_feedback_add(VTex_Feedback *feedback, u32 tile, u32 count)
+{
+  VTex_Request *result = 0;
+  u32 bucket = vtex_hash_tile(tile) & (VTexFeedback_HashCount - 1);
+  for (u32 probe = 0; probe < VTexFeedback_HashCount; ++probe)
+  {
+    u32 *entry = feedback->hash + bucket;
+    if (*entry == 0)
+    {
+      if (feedback->request_count < VTexFeedback_MaxTiles)
+      {
+        VTex_Request *request = feedback->requests + feedback->request_count++;
+        request->tile   = tile;
+        request->count  = count;
+        *entry          = feedback->request_count;
+        result          = request;
+      }
+      break;
+    }
+
+    VTex_Request *request = feedback->requests + (*entry - 1);
+    if (request->tile == tile)
+    {
+      request->count += count;
+      result = request;
+      break;
+    }
+
+    bucket = (bucket + 1) & (VTexFeedback_HashCount - 1);
+  }
+
+  return(result);
+}
+
+// Turns the raw feedback buffer into a list of unique tiles. Every ancestor
+// of a requested tile is requested too, so a page never has to fall back
+// more than one mip while its children stream in. The list comes out coarse
+// mips first, then by how many feedback texels asked for the tile.
+static void
+vtex_feedback_analyze(VTex_Feedback *feedback, VTex_File_Header *header, u32 *texels, u32 texel_count)
+{
+  for (u32 bucket = 0; bucket < VTexFeedback_HashCount; ++bucket)
+  {
+    feedback->hash[bucket] = 0;
+  }
+  feedback->request_count = 0;
+
+  // neighbouring feedback texels mostly agree, so runs skip the hash
+  u32 last_tile = VTexTile_None;
+  VTex_Request *last_request = 0;
+  for (u32 texel_idx = 0; texel_idx < texel_count; ++texel_idx)
+  {
+    u32 tile = texels[texel_idx];
+    if (tile == last_tile)
+    {
+      if (last_request)
+      {
+        ++last_request->count;
+      }
+      continue;
+    }
+
+    last_tile    = tile;
+    last_request = vtex_tile_is_valid(header, tile) ? vtex_feedback_add(feedback, tile, 1) : 0;
+  }
+
+  for (u32 request_idx = 0; request_idx < feedback->request_count; ++request_idx)
+  {
+    VTex_Request request = feedback->requests[request_idx];
+    u32 mip = vtex_tile_mip(request.tile);
+    if (mip + 1 < header->mip_count)
+    {
+      u32 parent = vtex_tile_id(vtex_tile_x(request.tile) >> 1, vtex_tile_y(request.tile) >> 1, mip + 1);
+      vtex_feedback_add(feedback, parent, request.count);
+    }
+  }
+
+  // insertion sort: the list is a few hundred entries and mostly ordered by construction
+  for (u32 request_idx = 1; request_idx < feedback->request_count; ++request_idx)
+  {
+    VTex_Request request = feedback->requests[request_idx];
+    u64 key = ((u64)vtex_tile_mip(request.tile) << 32) | request.count;
+
+    u32 insert_idx = request_idx;
+    while (insert_idx > 0)
+    {
+      VTex_Request *other = feedback->requests + insert_idx - 1;
+      u64 other_key = ((u64)vtex_tile_mip(other->tile) << 32) | other->count;
+      if (other_key >= key)
+      {
+        break;
+      }
+
+      feedback->requests[insert_idx] = *other;
+      --insert_idx;
+    }
+
+    feedback->requests[insert_idx] = request;
+  }
+}
+
+static u32
+vtex_find_slot(VTex_System *system, u32 tile)
+{
+  u32 result = VTexSlot_None;
+  u32 bucket = vtex_hash_tile(tile) & (VTexCache_HashCount - 1);
+  for (u16 slot_idx = system->hash[bucket]; slot_idx != VTexSlot_None; slot_idx = system->slots[slot_idx].hash_next)
+  {
+    if (system->slots[slot_idx].tile == tile)
+    {
+      result = slot_idx;
+      break;
+    }
+  }
+
+  return(result);
+}
+
+static void
+vtex_hash_insert(VTex_System *system, u16 slot_idx)
+{
+  VTex_Slot *slot = system->slots + slot_idx;
+  u32 bucket      = vtex_hash_tile(slot->tile) & (VTexCache_HashCount - 1);
+  slot->hash_next = system->hash[bucket];
+  system->hash[bucket] = slot_idx;
+}
+
+static void
+vtex_hash_remove(VTex_System *system, u16 slot_idx)
+{
+  VTex_Slot *slot = system->slots + slot_idx;
+  u16 *link = system->hash + (vtex_hash_tile(slot->tile) & (VTexCache_HashCount - 1));
+  while (*link != slot_idx)
+  {
+    Assert(*link != VTexSlot_None);
+    link = &system->slots[*link].hash_next;
+  }
+
+  *link           = slot->hash_next;
+  slot->hash_next = VTexSlot_None;
+}
+
+static void
+vtex_lru_unlink(VTex_System *system, u16 slot_idx)
+{
+  VTex_Slot *slot = system->slots + slot_idx;
+  if (slot->lru_prev != VTexSlot_None) system->slots[slot->lru_prev].lru_next = slot->lru_next;
+  else                                 system->lru_head = slot->lru_next;
+  if (slot->lru_next != VTexSlot_None) system->slots[slot->lru_next].lru_prev = slot->lru_prev;
+  else                                 system->lru_tail = slot->lru_prev;
+
+  slot->lru_prev = VTexSlot_None;
+  slot->lru_next = VTexSlot_None;
+}
+
+static void
+vtex_lru_push_head(VTex_System *system, u16 slot_idx)
+{
+  VTex_Slot *slot = system->slots + slot_idx;
+  slot->lru_prev  = VTexSlot_None;
+  slot->lru_next  = system->lru_head;
+  if (system->lru_head != VTexSlot_None)
+  {
+    system->slots[system->lru_head].lru_prev = slot_idx;
+  }
+  else
+  {
+    system->lru_tail = slot_idx;
+  }
+
+  system->lru_head      = slot_idx;
+  slot->last_used_frame = system->frame;
+}
+
+// A free slot if there is one, otherwise the least recently used resident
+// tile that nobody asked for this frame. Returns VTexSlot_None when the whole
+// cache is in use, which defers the request instead of thrashing.
+static u16
+vtex_alloc_slot(VTex_System *system)
+{
+  u16 result = system->free_head;
+  if (result != VTexSlot_None)
+  {
+    system->free_head = system->slots[result].lru_next;
+    system->slots[result].lru_next = VTexSlot_None;
+  }
+  else
+  {
+    for (u16 slot_idx = system->lru_tail; slot_idx != VTexSlot_None; slot_idx = system->slots[slot_idx].lru_prev)
+    {
+      VTex_Slot *slot = system->slots + slot_idx;
+      if (slot->last_used_frame == system->frame)
+      {
+        break;
+      }
+
+      if (!slot->pinned)
+      {
+        vtex_lru_unlink(system, slot_idx);
+        vtex_hash_remove(system, slot_idx);
+        slot->state               = VTexSlotState_Free;
+        system->page_table_stale  = true;
+        ++system->frame_stats.tiles_evicted;
+        result = slot_idx;
+        break;
+      }
+    }
+  }
+
+  return(result);
+}
+
+static void
+vtex_free_slot(VTex_System *system, u16 slot_idx)
+{
+  VTex_Slot *slot   = system->slots + slot_idx;
+  slot->state       = VTexSlotState_Free;
+  slot->tile        = VTexTile_None;
+  slot->lru_next    = system->free_head;
+  system->free_head = slot_idx;
+}
+
+static void
+vtex_load_proc(void *data)
+{
+  VTex_Load *load         = (VTex_Load *)data;
+  VTex_System *system     = load->system;
+  VTex_Tile_Entry *entry  = system->tiles + vtex_tile_index(&system->header, load->tile);
+
+  load->ok = (entry->size == VTex_TilePayloadBytes) && os_file_read(system->file, entry->offset, entry->size, load->pixels);
+
+  CompletePreviousWritesBeforeFutureWrites();
+  load->done = true;
+}
+
+static void
+vtex_upload_load(VTex_Load *load, VTex_Upload_Proc *upload, void *user)
+{
+  u8 *layers[VTexLayer_Count];
+  for (u32 layer = 0; layer < VTexLayer_Count; ++layer)
+  {
+    layers[layer] = load->pixels + layer * (VTex_TileSize * VTex_TileSize * VTex_BytesPerTexel);
+  }
+
+  upload(user, load->slot % VTexCache_TilesX, load->slot / VTexCache_TilesX, layers);
+}
+
+static b32
+vtex_open(VTex_System *system, char *filename, OS_Work_Queue *queue, VTex_Upload_Proc *upload, void *user)
+{
+  *system = (VTex_System){ 0 };
+  system->file  = os_file_open(filename);
+  system->queue = queue;
+
+  VTex_File_Header *header = &system->header;
+  b32 result = system->file.valid && os_file_read(system->file, 0, sizeof(VTex_File_Header), header) &&
+               (header->magic == VTex_Magic) && (header->version == VTex_Version) &&
+               (header->layer_count == VTexLayer_Count) && (header->mip_count > 0) && (header->mip_count <= VTex_MaxMips) &&
+               (header->tiles_x[header->mip_count - 1] == 1) && (header->tiles_y[header->mip_count - 1] == 1);
+
+  // every mip's tiles lie inside the table, each mip halves the one above
+  // down to 1x1, and the tile ids have room for them
+  u64 file_size = result ? os_file_size(system->file) : 0;
+  for (u32 mip = 0; result && (mip < header->mip_count); ++mip)
+  {
+    u32 tiles_x = header->tiles_x[mip];
+    u32 tiles_y = header->tiles_y[mip];
+    result = (tiles_x > 0) && (tiles_x <= 0x1000) && (tiles_y > 0) && (tiles_y <= 0x1000) &&
+             ((u64)header->first_tile[mip] + (u64)tiles_x * tiles_y <= header->tile_count);
+    if (result && mip)
+    {
+      result = (tiles_x == Maximum(header->tiles_x[mip - 1] / 2, 1)) && (tiles_y == Maximum(header->tiles_y[mip - 1] / 2, 1));
+    }
+  }
+  result = result && ((u64)header->tile_count * sizeof(VTex_Tile_Entry) <= file_size - sizeof(VTex_File_Header));
+
+  if (result)
+  {
+    system->tiles = os_memory_alloc(header->tile_count * sizeof(VTex_Tile_Entry));
+    result = os_file_read(system->file, sizeof(VTex_File_Header), header->tile_count * sizeof(VTex_Tile_Entry), system->tiles);
+    for (u32 tile_idx = 0; result && (tile_idx < header->tile_count); ++tile_idx)
+    {
+      VTex_Tile_Entry *entry = system->tiles + tile_idx;
+      result = (entry->size <= file_size) && (entry->offset <= file_size - entry->size);
+    }
+  }
+
+  if (!result)
+  {
+    vtex_close(system);
+    return(result);
+  }
+
+  for (u32 mip = 0; mip < header->mip_count; ++mip)
+  {
+    system->pages[mip]          = os_memory_alloc(header->tiles_x[mip] * header->tiles_y[mip] * sizeof(VTex_Page));
+    system->page_mip_dirty[mip] = true;
+  }
+
+  u8 *load_pixels = os_memory_alloc(VTex_MaxLoadsInFlight * VTex_TilePayloadBytes);
+  for (u32 load_idx = 0; load_idx < VTex_MaxLoadsInFlight; ++load_idx)
+  {
+    VTex_Load *load = system->loads + load_idx;
+    load->system    = system;
+    load->slot      = VTexSlot_None;
+    load->pixels    = load_pixels + load_idx * VTex_TilePayloadBytes;
+  }
+
+  for (u32 bucket = 0; bucket < VTexCache_HashCount; ++bucket)
+  {
+    system->hash[bucket] = VTexSlot_None;
+  }
+
+  system->lru_head  = VTexSlot_None;
+  system->lru_tail  = VTexSlot_None;
+  system->free_head = VTexSlot_None;
+  for (s32 slot_idx = VTexCache_SlotCount - 1; slot_idx >= 0; --slot_idx)
+  {
+    system->slots[slot_idx].lru_prev  = VTexSlot_None;
+    system->slots[slot_idx].hash_next = VTexSlot_None;
+    vtex_free_slot(system, (u16)slot_idx);
+  }
+
+  // the single tile of the last mip is loaded up front and never leaves,
+  // so the page table always has somewhere to point
+  VTex_Load *root = system->loads;
+  root->tile      = vtex_tile_id(0, 0, header->mip_count - 1);
+  root->slot      = vtex_alloc_slot(system);
+  vtex_load_proc(root);
+  if (root->ok)
+  {
+    VTex_Slot *slot = system->slots + root->slot;
+    slot->tile      = root->tile;
+    slot->state     = VTexSlotState_Resident;
+    slot->pinned    = true;
+    vtex_hash_insert(system, (u16)root->slot);
+    vtex_lru_push_head(system, (u16)root->slot);
+    vtex_upload_load(root, upload, user);
+
+    system->page_table_stale = true;
+    vtex_update_page_table(system);
+  }
+
+  result      = root->ok;
+  root->slot  = VTexSlot_None;
+  root->done  = false;
+  if (!result)
+  {
+    vtex_close(system);
+  }
+
+  return(result);
+}
+
+static void
+vtex_close(VTex_System *system)
+{
+  // workers may still be reading into the staging memory
+  for (u32 load_idx = 0; load_idx < VTex_MaxLoadsInFlight; ++load_idx)
+  {
+    VTex_Load *load = system->loads + load_idx;
+    while (load->pixels && (load->slot != VTexSlot_None) && !load->done);
+  }
+
+  if (system->loads[0].pixels)
+  {
+    os_memory_free(system->loads[0].pixels, VTex_MaxLoadsInFlight * VTex_TilePayloadBytes);
+  }
+
+  for (u32 mip = 0; mip < VTex_MaxMips; ++mip)
+  {
+    if (system->pages[mip])
+    {
+      os_memory_free(system->pages[mip], system->header.tiles_x[mip] * system->header.tiles_y[mip] * sizeof(VTex_Page));
+    }
+  }
+
+  if (system->tiles)
+  {
+    os_memory_free(system->tiles, system->header.tile_count * sizeof(VTex_Tile_Entry));
+  }
+
+  os_file_close(system->file);
+  *system = (VTex_System){ 0 };
+}
+
+static void
+vtex_limit_cache(VTex_System *system, u32 slot_count)
+{
+  Assert((slot_count > 0) && (slot_count <= VTexCache_SlotCount) && !system->load_count);
+  u16 *link = &system->free_head;
+  while (*link != VTexSlot_None)
+  {
+    if (*link >= slot_count)
+    {
+      *link = system->slots[*link].lru_next;
+    }
+    else
+    {
+      link = &system->slots[*link].lru_next;
+    }
+  }
+
+  for (u16 slot_idx = system->lru_head; slot_idx != VTexSlot_None; slot_idx = system->slots[slot_idx].lru_next)
+  {
+    Assert(slot_idx < slot_count);
+  }
+}
+
+// Feeds one frame of GPU feedback. Tiles already resident are marked used
+// first so that starting new loads can never evict something this frame needs.
+static void
+vtex_update(VTex_System *system, u32 *feedback_texels, u32 feedback_texel_count)
+{
+  system->total_stats.requests              += system->frame_stats.requests;
+  system->total_stats.hits                  += system->frame_stats.hits;
+  system->total_stats.tiles_loaded          += system->frame_stats.tiles_loaded;
+  system->total_stats.tiles_evicted         += system->frame_stats.tiles_evicted;
+  system->total_stats.loads_deferred        += system->frame_stats.loads_deferred;
+  system->total_stats.page_entries_changed  += system->frame_stats.page_entries_changed;
+  system->frame_stats = (VTex_Stats){ 0 };
+  ++system->frame;
+
+  VTex_Feedback *feedback = &system->feedback;
+  vtex_feedback_analyze(feedback, &system->header, feedback_texels, feedback_texel_count);
+
+  for (u32 request_idx = 0; request_idx < feedback->request_count; ++request_idx)
+  {
+    u32 slot_idx = vtex_find_slot(system, feedback->requests[request_idx].tile);
+    ++system->frame_stats.requests;
+    if ((slot_idx != VTexSlot_None) && (system->slots[slot_idx].state == VTexSlotState_Resident))
+    {
+      ++system->frame_stats.hits;
+      vtex_lru_unlink(system, (u16)slot_idx);
+      vtex_lru_push_head(system, (u16)slot_idx);
+    }
+  }
+
+  u32 load_idx = 0;
+  for (u32 request_idx = 0; request_idx < feedback->request_count; ++request_idx)
+  {
+    u32 tile = feedback->requests[request_idx].tile;
+    if (vtex_find_slot(system, tile) != VTexSlot_None)
+    {
+      continue;
+    }
+
+    while ((load_idx < VTex_MaxLoadsInFlight) && (system->loads[load_idx].slot != VTexSlot_None))
+    {
+      ++load_idx;
+    }
+
+    u16 slot_idx = (load_idx < VTex_MaxLoadsInFlight) ? vtex_alloc_slot(system) : VTexSlot_None;
+    if (slot_idx == VTexSlot_None)
+    {
+      ++system->frame_stats.loads_deferred;
+      continue;
+    }
+
+    VTex_Slot *slot = system->slots + slot_idx;
+    slot->tile      = tile;
+    slot->state     = VTexSlotState_Loading;
+    slot->pinned    = false;
+    vtex_hash_insert(system, slot_idx);
+
+    VTex_Load *load = system->loads + load_idx;
+    load->slot      = slot_idx;
+    load->tile      = tile;
+    load->ok        = false;
+    load->done      = false;
+    ++system->load_count;
+
+    if (system->queue)
+    {
+      os_work_queue_add(system->queue, vtex_load_proc, load);
+    }
+    else
+    {
+      vtex_load_proc(load);
+    }
+  }
+}
+
+// Hands finished tiles to the renderer. Called from the thread that owns the
+// GPU context; tiles become visible once vtex_update_page_table runs.
+static void
+vtex_poll_loads(VTex_System *system, VTex_Upload_Proc *upload, void *user)
+{
+  for (u32 load_idx = 0; load_idx < VTex_MaxLoadsInFlight; ++load_idx)
+  {
+    VTex_Load *load = system->loads + load_idx;
+    if ((load->slot == VTexSlot_None) || !load->done)
+    {
+      continue;
+    }
+
+    CompletePreviousReadsBeforeFutureReads();
+    u16 slot_idx = (u16)load->slot;
+    if (load->ok)
+    {
+      vtex_upload_load(load, upload, user);
+      system->slots[slot_idx].state = VTexSlotState_Resident;
+      vtex_lru_push_head(system, slot_idx);
+      system->page_table_stale = true;
+      ++system->frame_stats.tiles_loaded;
+    }
+    else
+    {
+      vtex_hash_remove(system, slot_idx);
+      vtex_free_slot(system, slot_idx);
+    }
+
+    load->slot = VTexSlot_None;
+    load->done = false;
+    --system->load_count;
+  }
+}
+
+// Rebuilds the page table coarse to fine: a resident tile points at itself,
+// anything else inherits its parent's entry. Mips whose entries changed are
+// flagged in page_mip_dirty for the renderer to upload and clear.
+static void
+vtex_update_page_table(VTex_System *system)
+{
+  if (!system->page_table_stale)
+  {
+    return;
+  }
+
+  VTex_File_Header *header = &system->header;
+  for (s32 mip = (s32)header->mip_count - 1; mip >= 0; --mip)
+  {
+    u32 tiles_x         = header->tiles_x[mip];
+    u32 tiles_y         = header->tiles_y[mip];
+    VTex_Page *pages    = system->pages[mip];
+    VTex_Page *parents  = (mip + 1 < (s32)header->mip_count) ? system->pages[mip + 1] : 0;
+    u32 parent_tiles_x  = parents ? header->tiles_x[mip + 1] : 0;
+    for (u32 y = 0; y < tiles_y; ++y)
+    {
+      for (u32 x = 0; x < tiles_x; ++x)
+      {
+        VTex_Page page = { 0 };
+        u32 slot_idx   = vtex_find_slot(system, vtex_tile_id(x, y, mip));
+        if ((slot_idx != VTexSlot_None) && (system->slots[slot_idx].state == VTexSlotState_Resident))
+        {
+          page.phys_x = (u8)(slot_idx % VTexCache_TilesX);
+          page.phys_y = (u8)(slot_idx / VTexCache_TilesX);
+          page.mip    = (u8)mip;
+          page.valid  = 1;
+        }
+        else if (parents)
+        {
+          page = parents[(y >> 1) * parent_tiles_x + (x >> 1)];
+        }
+
+        VTex_Page *dest = pages + y * tiles_x + x;
+        if ((dest->phys_x != page.phys_x) || (dest->phys_y != page.phys_y) ||
+            (dest->mip != page.mip) || (dest->valid != page.valid))
+        {
+          *dest = page;
+          system->page_mip_dirty[mip] = true;
+          ++system->frame_stats.page_entries_changed;
+        }
+      }
+    }
+  }
+
+  system->page_table_stale = false;
+}
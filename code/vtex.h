@@ -0,0 +1,177 @@
+#if !defined(VTEX_H)
+#define VTEX_H
+
+// Sparse virtual texturing. A .vtex file stores every mip of a large texture
+// cut into fixed size tiles (with a border so bilinear filtering never reads
+// a neighbour). At runtime a small physical cache holds the tiles the GPU
+// asked for through feedback, and a page table maps each virtual tile to the
+// closest resident ancestor so every lookup lands on something valid.
+//
+// Layout of a .vtex file:
+//   VTex_File_Header
+//   VTex_Tile_Entry[tile_count]       (mip 0 tiles first, row major)
+//   payloads, each VTex_PayloadAlign aligned: layer_count * VTex_TileSize^2 RGBA8 texels
+
+#define VTex_Magic          0x58455456 // "VTEX"
+#define VTex_Version        1
+#define VTex_TileContent    120
+#define VTex_TileBorder     4
+#define VTex_TileSize       (VTex_TileContent + 2 * VTex_TileBorder)
+#define VTex_BytesPerTexel  4
+#define VTex_MaxMips        12
+#define VTex_PayloadAlign   4096
+
+typedef u32 VTex_Layer;
+enum
+{
+  VTexLayer_Diffuse,
+  VTexLayer_Normal,
+  VTexLayer_Displace,
+  VTexLayer_Count,
+};
+
+typedef struct
+{
+  u32 magic;
+  u32 version;
+  u32 width;
+  u32 height;
+  u32 mip_count;
+  u32 layer_count;
+  u32 tile_count;
+  u32 _pad_a;
+  u32 tiles_x[VTex_MaxMips];
+  u32 tiles_y[VTex_MaxMips];
+  u32 first_tile[VTex_MaxMips];
+} VTex_File_Header;
+
+typedef struct
+{
+  u64 offset;
+  u32 size;
+  u32 _pad_a;
+} VTex_Tile_Entry;
+
+// Tile ids pack x (12 bits), y (12 bits) and mip (4 bits). The GPU writes the
+// same packing into the feedback buffer; cleared texels are VTexTile_None.
+#define VTexTile_None 0xFFFFFFFF
+#define vtex_tile_id(x, y, mip) (((u32)(mip) << 24) | ((u32)(y) << 12) | (u32)(x))
+#define vtex_tile_x(id)         ((id) & 0xFFF)
+#define vtex_tile_y(id)         (((id) >> 12) & 0xFFF)
+#define vtex_tile_mip(id)       (((id) >> 24) & 0xF)
+
+typedef struct
+{
+  u32 tile;
+  u32 count;
+} VTex_Request;
+
+#define VTexFeedback_HashCount  4096
+#define VTexFeedback_MaxTiles   2048
+typedef struct
+{
+  u32          hash[VTexFeedback_HashCount];
+  VTex_Request requests[VTexFeedback_MaxTiles];
+  u32          request_count;
+} VTex_Feedback;
+
+#define VTexCache_TilesX        16
+#define VTexCache_TilesY        16
+#define VTexCache_SlotCount     (VTexCache_TilesX * VTexCache_TilesY)
+#define VTexCache_PhysicalSize  (VTexCache_TilesX * VTex_TileSize)
+#define VTexCache_HashCount     512
+#define VTexSlot_None           0xFFFF
+
+typedef u32 VTex_Slot_State;
+enum
+{
+  VTexSlotState_Free,
+  VTexSlotState_Loading,
+  VTexSlotState_Resident,
+};
+
+typedef struct
+{
+  u32             tile;
+  VTex_Slot_State state;
+  u64             last_used_frame;
+  u16             lru_prev;
+  u16             lru_next;
+  u16             hash_next;
+  b32             pinned;
+} VTex_Slot;
+
+#define VTex_MaxLoadsInFlight   16
+#define VTex_TilePayloadBytes   (VTexLayer_Count * VTex_TileSize * VTex_TileSize * VTex_BytesPerTexel)
+
+typedef struct VTex_System VTex_System;
+typedef struct
+{
+  VTex_System  *system;
+  u32           slot;
+  u32           tile;
+  b32           ok;
+  volatile u32  done;
+  u8           *pixels;
+} VTex_Load;
+
+typedef struct
+{
+  u64 requests;
+  u64 hits;
+  u64 tiles_loaded;
+  u64 tiles_evicted;
+  u64 loads_deferred;
+  u64 page_entries_changed;
+} VTex_Stats;
+
+// Page table entries mirror the GPU format (R8G8B8A8_UINT): physical slot
+// x/y, the mip of the tile that is actually resident, and a valid flag.
+typedef struct
+{
+  u8 phys_x;
+  u8 phys_y;
+  u8 mip;
+  u8 valid;
+} VTex_Page;
+
+typedef void VTex_Upload_Proc(void *user, u32 slot_x, u32 slot_y, u8 *layers[VTexLayer_Count]);
+
+struct VTex_System
+{
+  OS_File            file;
+  VTex_File_Header   header;
+  VTex_Tile_Entry   *tiles;
+  OS_Work_Queue     *queue;
+
+  VTex_Slot          slots[VTexCache_SlotCount];
+  u16                hash[VTexCache_HashCount];
+  u16                lru_head;
+  u16                lru_tail;
+  u16                free_head;
+  u64                frame;
+
+  VTex_Load          loads[VTex_MaxLoadsInFlight];
+  u32                load_count;
+
+  VTex_Page         *pages[VTex_MaxMips];
+  b32                page_mip_dirty[VTex_MaxMips];
+  b32                page_table_stale;
+
+  VTex_Feedback      feedback;
+  VTex_Stats         frame_stats;
+  VTex_Stats         total_stats;
+};
+
+static b32   vtex_open(VTex_System *system, char *filename, OS_Work_Queue *queue, VTex_Upload_Proc *upload, void *user);
+static void  vtex_close(VTex_System *system);
+// Shrinks the cache to its first slot_count slots, to replay a smaller budget
+// than the physical texture holds. Call straight after vtex_open.
+static void  vtex_limit_cache(VTex_System *system, u32 slot_count);
+static void  vtex_feedback_analyze(VTex_Feedback *feedback, VTex_File_Header *header, u32 *texels, u32 texel_count);
+static void  vtex_update(VTex_System *system, u32 *feedback_texels, u32 feedback_texel_count);
+static void  vtex_poll_loads(VTex_System *system, VTex_Upload_Proc *upload, void *user);
+static void  vtex_update_page_table(VTex_System *system);
+static u32   vtex_find_slot(VTex_System *system, u32 tile);
+
+#endif